@@ -0,0 +1,19 @@
+# - Find libFLAC
+# Once done this will define
+#
+#  FLAC_FOUND - system has libFLAC
+#  FLAC_INCLUDE_DIR - the libFLAC include directory
+#  FLAC_LIBRARIES - Link these to use libFLAC
+
+find_path(FLAC_INCLUDE_DIR NAMES FLAC/stream_decoder.h)
+
+find_library(FLAC_LIBRARY NAMES FLAC libFLAC libFLAC_dynamic)
+
+set(FLAC_LIBRARIES ${FLAC_LIBRARY})
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set FLAC_FOUND to TRUE if
+# all listed variables are TRUE
+find_package_handle_standard_args(FLAC DEFAULT_MSG FLAC_LIBRARY FLAC_INCLUDE_DIR)
+
+mark_as_advanced(FLAC_INCLUDE_DIR FLAC_LIBRARY)
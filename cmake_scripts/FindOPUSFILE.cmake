@@ -0,0 +1,26 @@
+# - Find libopusfile
+# Once done this will define
+#
+#  OPUSFILE_FOUND - system has libopusfile
+#  OPUSFILE_INCLUDE_DIR - the libopusfile include directory
+#  OPUSFILE_LIBRARIES - Link these to use libopusfile
+#
+# opusfile.h includes the Opus headers by their bare names, so they have to
+# be on the include path too; they normally live alongside it.  There's no
+# OPUSFILE_LIBRARY, so that playd links all three libraries.
+
+find_path(OPUSFILE_INCLUDE_DIR NAMES opusfile.h PATH_SUFFIXES opus)
+
+find_library(OPUSFILE_OPUSFILE_LIBRARY NAMES opusfile libopusfile)
+find_library(OPUSFILE_OPUS_LIBRARY NAMES opus libopus)
+find_library(OPUSFILE_OGG_LIBRARY NAMES ogg libogg)
+
+set(OPUSFILE_LIBRARIES ${OPUSFILE_OPUSFILE_LIBRARY} ${OPUSFILE_OPUS_LIBRARY} ${OPUSFILE_OGG_LIBRARY})
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set OPUSFILE_FOUND to TRUE if
+# all listed variables are TRUE
+find_package_handle_standard_args(OPUSFILE DEFAULT_MSG OPUSFILE_OPUSFILE_LIBRARY OPUSFILE_OPUS_LIBRARY
+        OPUSFILE_OGG_LIBRARY OPUSFILE_INCLUDE_DIR)
+
+mark_as_advanced(OPUSFILE_INCLUDE_DIR OPUSFILE_OPUSFILE_LIBRARY OPUSFILE_OPUS_LIBRARY OPUSFILE_OGG_LIBRARY)
@@ -0,0 +1,91 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of whole-file analysis.
+ * @see audio/analysis.h
+ */
+
+#include "analysis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "../errors.h"
+#include "convert.h"
+#include "loudness.h"
+#include "sample_format.h"
+#include "source.h"
+#include "waveform.h"
+
+namespace Playd::Audio
+{
+/// The sample frames decoded and converted to floating point at a time.
+static constexpr std::size_t CHUNK_FRAMES = 4096;
+
+Analysis Analyse(Source &source, const AnalysisPlan &plan)
+{
+	const auto format = source.OutputSampleFormat();
+	if (!CanConvert(format, SampleFormat::FLOAT32)) throw FileError("can't analyse this sample format");
+	const auto channels = source.ChannelCount();
+	const auto bps = source.BytesPerSample();
+	const auto length = source.Length();
+
+	std::vector<WaveformBuilder> waveforms;
+	waveforms.reserve(plan.waveforms.size());
+	for (const auto buckets : plan.waveforms) waveforms.emplace_back(length, buckets);
+
+	// The meter takes only some formats and layouts; the rest just go
+	// without a loudness.
+	std::optional<LoudnessMeter> meter;
+	try {
+		meter.emplace(format, channels, source.SampleRate());
+	} catch (FileError &) {
+	}
+
+	const auto level = plan.trim_db ? static_cast<float>(std::pow(10.0, *plan.trim_db / 20.0)) : 0.0F;
+	std::optional<std::uint64_t> first;
+	std::uint64_t last = 0;
+
+	std::vector<std::byte> raw(CHUNK_FRAMES * bps);
+	std::vector<float> floats(CHUNK_FRAMES * channels);
+	std::uint64_t pos = 0;
+	for (auto state = Source::DecodeState::DECODING; state != Source::DecodeState::END_OF_FILE;) {
+		const auto [decode_state, bytes] = source.Decode(raw);
+		state = decode_state;
+		const auto frames = bytes / bps;
+		const auto samples = gsl::span<float>{floats}.first(frames * channels);
+		ConvertSamples(format, SampleFormat::FLOAT32, gsl::span<const std::byte>{raw}.first(bytes),
+		               gsl::span<std::byte>{reinterpret_cast<std::byte *>(samples.data()), samples.size_bytes()});
+
+		if (meter) meter->Feed(gsl::span<const std::byte>{raw}.first(bytes));
+		for (auto &waveform : waveforms) waveform.Add(samples, channels);
+		if (plan.trim_db) {
+			if (const auto [loud, end] = FindLoud(samples, level); loud < samples.size()) {
+				if (!first) first = pos + (loud / channels);
+				last = pos + ((end + channels - 1) / channels);
+			}
+		}
+		pos += frames;
+	}
+
+	Analysis analysis{pos, std::nullopt, {}, std::nullopt};
+	if (plan.trim_db) {
+		// As with FindCuePoints, files silent throughout are left whole.
+		analysis.cues = first ? CuePoints{source.MicrosFromSamples(*first), source.MicrosFromSamples(last)}
+		                      : CuePoints{std::chrono::microseconds{0}, source.MicrosFromSamples(std::max(length, pos))};
+	}
+	for (const auto &waveform : waveforms) analysis.waveforms.push_back(waveform.Finish());
+	if (meter) analysis.loudness = meter->Read();
+
+	source.WaitForScans();
+	return analysis;
+}
+
+} // namespace Playd::Audio
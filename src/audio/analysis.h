@@ -0,0 +1,58 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of whole-file analysis.
+ * @see audio/analysis.cpp
+ */
+
+#ifndef PLAYD_AUDIO_ANALYSIS_H
+#define PLAYD_AUDIO_ANALYSIS_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "loudness.h"
+#include "source.h"
+#include "waveform.h"
+
+namespace Playd::Audio
+{
+/// Which analyses to run over a file.
+struct AnalysisPlan {
+	std::optional<double> trim_db;         ///< The threshold to find cue points at, if any.
+	std::vector<std::uint32_t> waveforms;  ///< The bucket counts of the overviews to find.
+};
+
+/// What analysing a file found out.
+struct Analysis {
+	std::uint64_t length;                          ///< How long the file decoded to, in samples.
+	std::optional<CuePoints> cues;                 ///< The cue points, if asked for.
+	std::vector<Waveform> waveforms;               ///< The overviews, as asked for.
+	std::optional<LoudnessMeter::Reading> loudness; ///< The loudness, if it can be metered.
+};
+
+/**
+ * Runs every analysis playd caches over a file, in one decode of it.
+ *
+ * Loading a file for air can need its cue points (see FindCuePoints), and
+ * clients may ask for its overview (see ComputeWaveform); each of those
+ * decodes some or all of the file for itself.  This decodes the whole file
+ * once, from the start, and works them all out on the way, along with its
+ * loudness (as LoudnessMeter would meter it playing).  The source then
+ * waits for its background scans (see Source::WaitForScans), so that they
+ * are cached when it goes.
+ *
+ * @param source The source, at its start.
+ * @param plan What to find out.
+ * @return What was found out.
+ * @exception FileError if the source can't be decoded, or its samples can't
+ *   be converted to FLOAT32.
+ */
+Analysis Analyse(Source &source, const AnalysisPlan &plan);
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_ANALYSIS_H
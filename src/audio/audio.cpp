@@ -10,11 +10,19 @@
 #include "audio.h"
 
 #include <chrono>
+#include <functional>
 #include <gsl/gsl>
+#include <mutex>
+#include <utility>
 
 #include "../messages.h"
+#include "../metrics.h"
+#include "../trace.h"
+#include "decode_scheduler.h"
+#include "gain.h"
 #include "sink.h"
 #include "source.h"
+#include "time_stretch.h"
 
 namespace Playd::Audio
 {
@@ -38,16 +46,41 @@ Audio::State NullAudio::CurrentState() const
 	return State::NONE;
 }
 
+bool NullAudio::PreRolled(std::chrono::microseconds) const
+{
+	return false;
+}
+
+bool NullAudio::Sounding() const
+{
+	return false;
+}
+
 void NullAudio::SetPlaying(bool)
 {
 	throw NotSupportedInNullAudio();
 }
 
+void NullAudio::SetPlayingAt(bool, PlayheadClock::Clock::time_point)
+{
+	throw NotSupportedInNullAudio();
+}
+
 void NullAudio::SetPosition(std::chrono::microseconds)
 {
 	throw NotSupportedInNullAudio();
 }
 
+void NullAudio::Fade(std::chrono::microseconds, double, Gain::Shape)
+{
+	throw NotSupportedInNullAudio();
+}
+
+void NullAudio::SetSpeed(double)
+{
+	throw NotSupportedInNullAudio();
+}
+
 std::chrono::microseconds NullAudio::Position() const
 {
 	throw NotSupportedInNullAudio();
@@ -58,19 +91,143 @@ std::chrono::microseconds NullAudio::Length() const
 	throw NotSupportedInNullAudio();
 }
 
+double NullAudio::Speed() const
+{
+	throw NotSupportedInNullAudio();
+}
+
 std::string_view NullAudio::File() const
 {
 	throw NotSupportedInNullAudio();
 }
 
+std::optional<CallbackStats::Snapshot> NullAudio::Stats() const
+{
+	return std::nullopt;
+}
+
+std::optional<LoudnessMeter::Reading> NullAudio::Loudness() const
+{
+	return std::nullopt;
+}
+
+std::optional<CuePoints> NullAudio::Cues() const
+{
+	return std::nullopt;
+}
+
+std::optional<StreamStats> NullAudio::Streaming() const
+{
+	return std::nullopt;
+}
+
+MemoryUse NullAudio::Memory() const
+{
+	return {0, 0};
+}
+
+std::uint64_t NullAudio::SkippedFrames() const
+{
+	return 0;
+}
+
+ConversionList NullAudio::Conversions() const
+{
+	return {};
+}
+
+void NullAudio::SetTap(std::shared_ptr<PcmTap>)
+{
+}
+
 //
 // BasicAudio
 //
 
 BasicAudio::BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink)
-    : src{std::move(src)}, sink{std::move(sink)}
+    : src{std::make_unique<StretchedSource>(std::move(src))},
+      sink{std::move(sink)},
+      format{this->src->Format()},
+      gain{this->format.format, this->format.channels, this->format.rate}
 {
+	// We allocate the frame once, up front, and decode into it for the
+	// rest of the audio's life.
+	this->frame.resize(this->src->FrameBytes());
 	this->ClearFrame();
+	this->PublishPosition();
+}
+
+BasicAudio::~BasicAudio()
+{
+	this->StopWorker();
+
+	// The sink's wake-ups refer to us, and may outlive us otherwise.
+	if (this->sink != nullptr) this->sink->SetWakeHandler({});
+}
+
+void BasicAudio::StartWorker(DecodeScheduler &new_scheduler, std::function<void()> new_notify)
+{
+	Expects(this->scheduler == nullptr);
+	Expects(new_notify);
+
+	this->notify = std::move(new_notify);
+	this->last_state = this->sink->CurrentState();
+	this->scheduler = &new_scheduler;
+	new_scheduler.Add(*this);
+}
+
+void BasicAudio::SetWakeHandler(Sink::WakeFn wake)
+{
+	Expects(this->sink != nullptr);
+
+	this->sink->SetWakeHandler([this, wake = std::move(wake)] {
+		this->WakeWorker();
+		if (wake) wake();
+	});
+}
+
+void BasicAudio::EnableLoudnessMeter()
+{
+	Expects(this->src != nullptr);
+
+	std::lock_guard lock{this->decode_lock};
+	this->meter = std::make_unique<LoudnessMeter>(this->format.format, this->format.channels, this->format.rate);
+}
+
+void BasicAudio::WakeWorker()
+{
+	if (auto *s = this->scheduler.load()) s->Wake(*this);
+}
+
+void BasicAudio::StopWorker()
+{
+	auto *s = this->scheduler.exchange(nullptr);
+	if (s != nullptr) s->Remove(*this);
+}
+
+std::chrono::microseconds BasicAudio::Headroom()
+{
+	// Sinks that aren't playing aren't draining, so they can wait for the
+	// ones that are; sinks that can't tell us are treated as empty.
+	if (this->sink->CurrentState() != Audio::State::PLAYING) return IDLE_HEADROOM;
+
+	const auto buffered = this->sink->Buffered();
+	if (!buffered) return {};
+	return this->format.MicrosFromSamples(*buffered);
+}
+
+void BasicAudio::Run()
+{
+	std::unique_lock lock{this->decode_lock};
+	const auto state = this->Pump();
+	this->PublishPosition();
+	if (state == this->last_state) return;
+	this->last_state = state;
+
+	// We don't hold the lock while notifying, in case whoever we're
+	// notifying wants to talk to us straight away.
+	lock.unlock();
+	this->notify();
 }
 
 std::string_view BasicAudio::File() const
@@ -81,6 +238,7 @@ std::string_view BasicAudio::File() const
 void BasicAudio::SetPlaying(bool playing)
 {
 	Expects(this->sink != nullptr);
+	std::lock_guard lock{this->decode_lock};
 
 	if (playing) {
 		this->sink->Start();
@@ -95,25 +253,139 @@ void BasicAudio::SetPlaying(bool playing)
 	}
 }
 
+void BasicAudio::SetPlayingAt(bool playing, PlayheadClock::Clock::time_point when)
+{
+	Expects(this->sink != nullptr);
+	std::lock_guard lock{this->decode_lock};
+
+	if (playing) {
+		this->sink->StartAt(when);
+	} else {
+		this->sink->StopAt(when);
+	}
+}
+
 Audio::State BasicAudio::CurrentState() const
 {
 	return this->sink->CurrentState();
 }
 
-std::chrono::microseconds BasicAudio::Position() const
+bool BasicAudio::PreRolled(std::chrono::microseconds amount) const
 {
 	Expects(this->sink != nullptr);
 	Expects(this->src != nullptr);
 
-	return this->src->MicrosFromSamples(this->sink->Position());
+	std::lock_guard lock{this->decode_lock};
+	if (this->source_out || !this->sink->WantsMore()) return true;
+
+	const auto buffered = this->sink->Buffered();
+	return !buffered || amount <= this->format.MicrosFromSamples(*buffered);
+}
+
+bool BasicAudio::Sounding() const
+{
+	Expects(this->sink != nullptr);
+	return this->sink->Sounding();
+}
+
+std::chrono::microseconds BasicAudio::Position() const
+{
+	return std::chrono::microseconds{this->published_position.load(std::memory_order_acquire)};
 }
 
 std::chrono::microseconds BasicAudio::Length() const
+{
+	return std::chrono::microseconds{this->published_length.load(std::memory_order_acquire)};
+}
+
+void BasicAudio::PublishPosition()
 {
 	Expects(this->sink != nullptr);
 	Expects(this->src != nullptr);
 
-	return this->src->MicrosFromSamples(this->src->Length());
+	// Lengths can firm up as the file decodes (say, once an MP3 is
+	// indexed), so this goes out with every position.
+	const auto position = this->format.MicrosFromSamples(this->src->InnerPosition(this->sink->Position()));
+	this->published_position.store(position.count(), std::memory_order_release);
+	const auto length = this->format.MicrosFromSamples(this->src->Length());
+	this->published_length.store(length.count(), std::memory_order_release);
+}
+
+double BasicAudio::Speed() const
+{
+	Expects(this->src != nullptr);
+
+	std::lock_guard lock{this->decode_lock};
+	return this->src->Speed();
+}
+
+std::optional<CallbackStats::Snapshot> BasicAudio::Stats() const
+{
+	Expects(this->sink != nullptr);
+
+	// The statistics are lock-free, so this doesn't need the decode lock.
+	return this->sink->Stats();
+}
+
+std::optional<LoudnessMeter::Reading> BasicAudio::Loudness() const
+{
+	std::lock_guard lock{this->decode_lock};
+	if (this->meter == nullptr) return std::nullopt;
+	return this->meter->Read();
+}
+
+std::optional<CuePoints> BasicAudio::Cues() const
+{
+	Expects(this->src != nullptr);
+
+	// Cue points are fixed when the source is made, so need no lock.
+	return this->src->Cues();
+}
+
+std::optional<StreamStats> BasicAudio::Streaming() const
+{
+	Expects(this->src != nullptr);
+
+	// Streaming sources lock their own statistics.
+	return this->src->Streaming();
+}
+
+MemoryUse BasicAudio::Memory() const
+{
+	Expects(this->src != nullptr);
+	Expects(this->sink != nullptr);
+
+	// Decoding can grow the frame and the source's scratch space, but
+	// sinks' buffers are fixed once made.
+	std::lock_guard lock{this->decode_lock};
+	return {this->sink->BufferBytes(), this->src->ScratchBytes() + this->frame.capacity()};
+}
+
+std::uint64_t BasicAudio::SkippedFrames() const
+{
+	Expects(this->src != nullptr);
+
+	// Sources count their skips atomically.
+	return this->src->SkippedFrames();
+}
+
+ConversionList BasicAudio::Conversions() const
+{
+	Expects(this->src != nullptr);
+	Expects(this->sink != nullptr);
+
+	// Whether the source is stretching changes as it decodes.
+	std::lock_guard lock{this->decode_lock};
+	auto steps = this->src->Conversions();
+	for (auto &step : this->sink->Conversions()) steps.push_back(std::move(step));
+	return steps;
+}
+
+void BasicAudio::SetTap(std::shared_ptr<PcmTap> new_tap)
+{
+	// Taking the lock waits out any decoding feeding the old tap.
+	std::lock_guard lock{this->decode_lock};
+	this->tap = std::move(new_tap);
 }
 
 void BasicAudio::SetPosition(std::chrono::microseconds position)
@@ -121,71 +393,175 @@ void BasicAudio::SetPosition(std::chrono::microseconds position)
 	Expects(this->sink != nullptr);
 	Expects(this->src != nullptr);
 
-	auto in_samples = this->src->SamplesFromMicros(position);
-	auto out_samples = this->src->Seek(in_samples);
-	this->sink->SetPosition(out_samples);
+	{
+		std::lock_guard lock{this->decode_lock};
 
-	// We might still have decoded samples from the old position in
-	// our frame, so clear them out.
-	this->ClearFrame();
+		// Short hops forwards often land in what the sink already has,
+		// in which case neither it nor the source need to start over.
+		// Stretched samples aren't the file's, so can't be skipped to.
+		auto in_samples = this->format.SamplesFromMicros(position);
+		if (!this->src->Stretching() && this->sink->SkipTo(in_samples)) {
+			this->PublishPosition();
+			return;
+		}
+
+		auto out_samples = this->src->Seek(in_samples);
+		this->sink->SetPosition(out_samples);
+		this->source_out = false;
+
+		// We might still have decoded samples from the old position in
+		// our frame, so clear them out.
+		this->ClearFrame();
+		if (this->meter != nullptr) this->meter->Restart();
+
+		// The sink fades out the old position while the new one starts,
+		// so give it something to fade into straight away, rather than
+		// on the next update.
+		if (this->scheduler == nullptr) this->Pump();
+		this->PublishPosition();
+	}
+
+	// The sink is now empty, so get the workers refilling it straight away.
+	this->WakeWorker();
+}
+
+void BasicAudio::Fade(std::chrono::microseconds duration, double db, Gain::Shape shape)
+{
+	std::lock_guard lock{this->decode_lock};
+	this->gain.Fade(duration, db, shape);
+}
+
+void BasicAudio::SetSpeed(double speed)
+{
+	Expects(this->src != nullptr);
+
+	std::lock_guard lock{this->decode_lock};
+	this->src->SetSpeed(speed);
 }
 
 void BasicAudio::ClearFrame()
 {
-	this->frame.clear();
 	this->frame_span = gsl::span<std::byte, 0>();
 }
 
 Audio::State BasicAudio::Update()
 {
 	Expects(this->sink != nullptr);
-	Expects(this->src != nullptr);
 
-	const auto more_available = this->DecodeIfFrameEmpty();
-	if (!more_available) this->sink->SourceOut();
+	if (this->scheduler == nullptr) {
+		std::lock_guard lock{this->decode_lock};
+		const auto state = this->Pump();
+		this->PublishPosition();
+		return state;
+	}
 
-	if (!this->FrameFinished()) this->TransferFrame();
+	// The scheduler does all of the decoding, and publishes after each of
+	// its rounds.  We only freshen the position between rounds, and never
+	// wait for one to finish: mid-round, the last round's position stands.
+	if (std::unique_lock lock{this->decode_lock, std::try_to_lock}) this->PublishPosition();
+	return this->sink->CurrentState();
+}
+
+Audio::State BasicAudio::Pump()
+{
+	Expects(this->sink != nullptr);
+	Expects(this->src != nullptr);
+
+	// Sinks with watermarks want filling up in one go, so that they
+	// don't need to wake us again until they've drained a fair bit.
+	// Others get one round per update.
+	for (auto more = true; more;) {
+		// We only decode when the last frame has gone to the sink, so
+		// that frames are never decoded out of order.
+		if (this->FrameFinished()) {
+			const auto [decode_state, count] = this->DecodeRound();
+			if (decode_state == Source::DecodeState::END_OF_FILE) {
+				this->sink->SourceOut();
+				this->source_out = true;
+				more = false;
+			}
+
+			// Some decoding rounds produce nothing (for example,
+			// when the sink is full); don't spin on them.
+			if (count == 0) more = false;
+		}
+
+		if (!this->FrameFinished()) this->TransferFrame();
+
+		// If the sink didn't take the whole frame, it's full.
+		more = more && this->FrameFinished() && this->sink->WantsMore();
+	}
 
 	return this->sink->CurrentState();
 }
 
 void BasicAudio::TransferFrame()
 {
-	Expects(!this->frame.empty());
+	Expects(!this->FrameFinished());
 	Expects(this->sink != nullptr);
 	Expects(this->src != nullptr);
 
 	auto written = this->sink->Transfer(this->frame_span);
+	Trace::Record(TraceKind::TRANSFER, written);
+	if (this->meter != nullptr) this->meter->Feed(this->frame_span.first(written));
+	if (this->tap != nullptr) this->tap->Feed(this->format, this->frame_span.first(written));
 	this->frame_span = this->frame_span.last(this->frame_span.size() - written);
 
-	// We empty the frame once we're done with it.  This
-	// maintains FrameFinished(), as an empty frame is a finished one.
-	if (this->FrameFinished()) {
-		this->ClearFrame();
-		Ensures(this->FrameFinished());
+	// Once the span runs out, the frame is finished, and the next
+	// update decodes over the top of it.
+}
+
+Source::DecodeSpanResult BasicAudio::DecodeRound()
+{
+	Expects(this->FrameFinished());
+	Expects(this->sink != nullptr);
+	Expects(this->src != nullptr);
+
+	// If the sink can't lend us any of its own storage, fall back to
+	// decoding into our frame and copying it over.
+	auto region = this->sink->AcquireTransfer();
+	if (!region.has_value()) {
+		const auto more_available = this->DecodeIfFrameEmpty();
+		const auto decode_state =
+		        more_available ? Source::DecodeState::DECODING : Source::DecodeState::END_OF_FILE;
+		return std::make_pair(decode_state, this->frame_span.size());
 	}
 
-	// The frame span should not be empty unless the frame was emptied.
-	Ensures(this->frame.empty() || !this->frame_span.empty());
+	// The sink is full; try again next update.
+	if (region->empty()) return std::make_pair(Source::DecodeState::DECODING, 0);
+
+	Trace::Record(TraceKind::DECODE_BEGIN);
+	auto result = this->src->Decode(*region);
+	Trace::Record(TraceKind::DECODE_END, result.second);
+	Metrics::AddDecoded(result.second);
+	this->gain.Apply(region->first(result.second));
+	if (this->meter != nullptr) this->meter->Feed(region->first(result.second));
+	if (this->tap != nullptr) this->tap->Feed(this->format, region->first(result.second));
+	this->sink->CommitTransfer(result.second);
+	Trace::Record(TraceKind::TRANSFER, result.second);
+
+	return result;
 }
 
 bool BasicAudio::DecodeIfFrameEmpty()
 {
-	// Either the current frame is in progress, or has been emptied.
-	// AdvanceFrameIterator() establishes this assertion by emptying a
-	// frame as soon as it finishes.
-	Expects(this->frame.empty() || !this->FrameFinished());
-
 	// If we still have a frame, don't bother decoding yet.
 	if (!this->FrameFinished()) return true;
 
 	Expects(this->src != nullptr);
-	auto result = this->src->Decode();
-
-	this->frame = result.second;
-	this->frame_span = this->frame;
-
-	return result.first != Source::DecodeState::END_OF_FILE;
+	Trace::Record(TraceKind::DECODE_BEGIN);
+	auto [decode_state, count] = this->src->Decode(this->frame);
+	Trace::Record(TraceKind::DECODE_END, count);
+	Metrics::AddDecoded(count);
+	Ensures(count <= this->frame.size());
+
+	// The frame is ours, so the gain goes on here, once, rather than as
+	// each part of it is transferred.
+	const auto decoded = gsl::span<std::byte>{this->frame}.first(count);
+	this->gain.Apply(decoded);
+	this->frame_span = decoded;
+
+	return decode_state != Source::DecodeState::END_OF_FILE;
 }
 
 inline bool BasicAudio::FrameFinished() const
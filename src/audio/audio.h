@@ -10,9 +10,13 @@
 #ifndef PLAYD_AUDIO_H
 #define PLAYD_AUDIO_H
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,8 +25,15 @@
 #include <gsl/gsl>
 
 #include "../response.h"
+#include "decode_scheduler.h"
+#include "gain.h"
+#include "loudness.h"
+#include "pcm_tap.h"
+#include "rt_memory.h"
 #include "sink.h"
 #include "source.h"
+#include "stats.h"
+#include "time_stretch.h"
 
 namespace Playd::Audio
 {
@@ -69,6 +80,18 @@ public:
 	 */
 	virtual void SetPlaying(bool playing) = 0;
 
+	/**
+	 * Schedules this Audio to start or stop playing at a given time.
+	 * The change happens when the sink gets to the sample heard at
+	 * @a when, rather than when this is called.
+	 * @param playing True for playing; false for stopped.
+	 * @param when When the change should be heard.
+	 * @exception NoAudioError if the current state is NONE.
+	 * @see Sink::StartAt
+	 * @see Sink::StopAt
+	 */
+	virtual void SetPlayingAt(bool playing, PlayheadClock::Clock::time_point when) = 0;
+
 	/**
 	 * Attempts to seek to the given position.
 	 * @param position The position to seek to, in microseconds.
@@ -77,6 +100,32 @@ public:
 	 */
 	virtual void SetPosition(std::chrono::microseconds position) = 0;
 
+	/**
+	 * Fades this Audio to another level.
+	 * The fade starts from the next sample decoded, so it is heard once
+	 * whatever the sink already has buffered has played out.
+	 * * Precondition: @a db is at most Gain::MAX_DB, and isn't NaN.
+	 * @param duration How long the fade takes; zero is a jump.
+	 * @param db The level to fade to, in dB (0 is unity).
+	 * @param shape The shape of the fade.
+	 * @exception NoAudioError if the current state is NONE.
+	 * @see Gain
+	 */
+	virtual void Fade(std::chrono::microseconds duration, double db, Gain::Shape shape) = 0;
+
+	/**
+	 * Changes how fast this Audio plays, without changing its pitch.
+	 * As with Fade(), the change starts from the next sample decoded.
+	 * Positions and lengths stay in the file's own time.
+	 * * Precondition: @a speed is between TimeStretch::MIN_SPEED and
+	 *     TimeStretch::MAX_SPEED.
+	 * @param speed How much faster than normal to play; 1 is normal.
+	 * @exception NoAudioError if the current state is NONE.
+	 * @exception FileError if the file's format can't be stretched.
+	 * @see TimeStretch
+	 */
+	virtual void SetSpeed(double speed) = 0;
+
 	//
 	// Property access
 	//
@@ -94,11 +143,30 @@ public:
 	 */
 	[[nodiscard]] virtual State CurrentState() const = 0;
 
+	/**
+	 * Whether this Audio has enough buffered to start playing smoothly.
+	 * That is at least @a amount of audio, or as much as the sink will
+	 * take, or the rest of the file.  Audio whose sink can't say how much
+	 * it holds always has enough.
+	 * @param amount How much audio to want buffered.
+	 * @return Whether playing now would start with enough buffered.
+	 */
+	[[nodiscard]] virtual bool PreRolled(std::chrono::microseconds amount) const = 0;
+
+	/**
+	 * Whether this Audio is being heard yet.
+	 * @return Whether the Audio is playing, and its sink has been heard.
+	 * @see Sink::Sounding
+	 */
+	[[nodiscard]] virtual bool Sounding() const = 0;
+
 	/**
 	 * This Audio's current position.
 	 *
-	 * As this may be executing whilst the playing callback is running,
-	 * do not expect it to be highly accurate.
+	 * This is estimated from when the sink last handed audio to its
+	 * device, and how much audio the device had still to play, so it
+	 * tracks what is actually being heard.  It may be as old as the last
+	 * Update() or SetPosition(), which is when it is worked out.
 	 *
 	 * @return The current position, in microseconds.
 	 * @exception NoAudioError if the current state is NONE.
@@ -114,6 +182,74 @@ public:
 	 * @see Seek
 	 */
 	[[nodiscard]] virtual std::chrono::microseconds Length() const = 0;
+
+	/**
+	 * How fast this Audio is playing.
+	 * @return How much faster than normal it plays; 1 is normal.
+	 * @exception NoAudioError if the current state is NONE.
+	 * @see SetSpeed
+	 */
+	[[nodiscard]] virtual double Speed() const = 0;
+
+	/**
+	 * Statistics about how this Audio's playback is going.
+	 * @return A snapshot of the sink's statistics, if it keeps any.
+	 */
+	[[nodiscard]] virtual std::optional<CallbackStats::Snapshot> Stats() const = 0;
+
+	/**
+	 * Reads this Audio's loudness meter.
+	 * @return The meter's readings, if this Audio is being metered.
+	 */
+	[[nodiscard]] virtual std::optional<LoudnessMeter::Reading> Loudness() const = 0;
+
+	/**
+	 * Where this Audio was trimmed from its file, if it was.
+	 * Positions and lengths are all relative to the in point.
+	 * @return The cue points, in the file's own time.
+	 * @see TrimmedSource
+	 */
+	[[nodiscard]] virtual std::optional<CuePoints> Cues() const = 0;
+
+	/**
+	 * How this Audio's file is streaming, if it is fetched over the network.
+	 * @return The statistics, if any.
+	 * @see Source::Streaming
+	 */
+	[[nodiscard]] virtual std::optional<StreamStats> Streaming() const = 0;
+
+	/**
+	 * How much memory this Audio's buffers take up.
+	 * @return The sizes, in bytes.
+	 * @see Sink::BufferBytes
+	 * @see Source::ScratchBytes
+	 */
+	[[nodiscard]] virtual MemoryUse Memory() const = 0;
+
+	/**
+	 * How many damaged frames this Audio's file has had skipped over.
+	 * @return The number of frames skipped since the file was loaded.
+	 * @see Source::SkippedFrames
+	 */
+	[[nodiscard]] virtual std::uint64_t SkippedFrames() const = 0;
+
+	/**
+	 * Lists the conversions this Audio's samples go through, from its
+	 * decoder to its device.
+	 * @return The conversions, in order.
+	 * @see Source::Conversions
+	 * @see Sink::Conversions
+	 */
+	[[nodiscard]] virtual ConversionList Conversions() const = 0;
+
+	/**
+	 * Sends everything this Audio decodes from now on, after the gain, to
+	 * a tap, as well as to the sink.
+	 * Once this returns, the tap it replaces gets nothing more.
+	 * @param tap The tap, or nullptr to stop tapping.
+	 * @see PcmTap
+	 */
+	virtual void SetTap(std::shared_ptr<PcmTap> tap) = 0;
 };
 
 /**
@@ -132,16 +268,54 @@ public:
 
 	[[nodiscard]] Audio::State CurrentState() const override;
 
+	/// @return False, as there is nothing to play.
+	[[nodiscard]] bool PreRolled(std::chrono::microseconds amount) const override;
+
+	/// @return False, as there is nothing to hear.
+	[[nodiscard]] bool Sounding() const override;
+
+	/// @return Nothing, as there is nothing playing.
+	[[nodiscard]] std::optional<CallbackStats::Snapshot> Stats() const override;
+
+	/// @return Nothing, as there is nothing to meter.
+	[[nodiscard]] std::optional<LoudnessMeter::Reading> Loudness() const override;
+
+	/// @return Nothing, as there is nothing to trim.
+	[[nodiscard]] std::optional<CuePoints> Cues() const override;
+
+	/// @return Nothing, as there is nothing streaming.
+	[[nodiscard]] std::optional<StreamStats> Streaming() const override;
+
+	/// @return Nothing, as there are no buffers.
+	[[nodiscard]] MemoryUse Memory() const override;
+
+	/// @return Zero, as there is nothing to skip.
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	/// @return Nothing, as there is nothing to convert.
+	[[nodiscard]] ConversionList Conversions() const override;
+
+	/// Does nothing, as there is nothing to tap.
+	void SetTap(std::shared_ptr<PcmTap> tap) override;
+
 	// The following all raise an exception:
 
 	void SetPlaying(bool playing) override;
 
+	void SetPlayingAt(bool playing, PlayheadClock::Clock::time_point when) override;
+
 	void SetPosition(std::chrono::microseconds position) override;
 
+	void Fade(std::chrono::microseconds duration, double db, Gain::Shape shape) override;
+
+	void SetSpeed(double speed) override;
+
 	[[nodiscard]] std::chrono::microseconds Position() const override;
 
 	[[nodiscard]] std::chrono::microseconds Length() const override;
 
+	[[nodiscard]] double Speed() const override;
+
 	[[nodiscard]] std::string_view File() const override;
 };
 
@@ -150,13 +324,25 @@ public:
  *
  * BasicAudio is comprised of a 'source', which decodes frames from a
  * file, and a 'sink', which plays out the decoded frames.  Updating
- * consists of shifting frames from the source to the sink.
+ * consists of shifting frames from the source to the sink.  The source
+ * goes through a StretchedSource, so that it can change speed; the sink's
+ * positions are the StretchedSource's, and are mapped back to the file's.
+ *
+ * The position and length are published, as microseconds in the file, on
+ * every decoding round and seek; Position() and Length() just read them back,
+ * without taking the decode lock or asking the source or sink anything.
+ *
+ * Optionally, BasicAudio can do this shifting on a DecodeScheduler's worker
+ * threads, so that slow decoding doesn't hold up whoever is calling Update().
+ * In this case, Update() only reports the sink's state, freshening the
+ * position if no round is under way, and never waits for the decode lock; the
+ * workers call a notification function whenever that state changes.
  *
  * @see Audio
  * @see Sink
  * @see Source
  */
-class BasicAudio : public Audio
+class BasicAudio : public Audio, private DecodeScheduler::Job
 {
 public:
 	/**
@@ -167,36 +353,186 @@ public:
 	 */
 	BasicAudio(std::unique_ptr<Source> src, std::unique_ptr<Sink> sink);
 
+	/// Destructs a BasicAudio, taking it off its scheduler if it has one.
+	~BasicAudio() override;
+
+	/// Deleted copy constructor.
+	BasicAudio(const BasicAudio &) = delete;
+
+	/// Deleted copy-assignment.
+	BasicAudio &operator=(const BasicAudio &) = delete;
+
+	/**
+	 * Hands decoding over to a scheduler, which keeps the sink topped up.
+	 *
+	 * Once this is called, the scheduler's workers own decoding, and
+	 * Update() no longer decodes anything.
+	 *
+	 * * Precondition: Decoding hasn't already been handed over.
+	 *
+	 * @param scheduler The scheduler, which must outlive this audio.
+	 * @param notify The function the workers call, from their threads,
+	 *   whenever they see the sink change state.  This must be safe to
+	 *   call from any thread.
+	 */
+	void StartWorker(DecodeScheduler &scheduler, std::function<void()> notify);
+
+	/**
+	 * Sets the function called when this audio wants an Update().
+	 *
+	 * This is driven by the sink's wake-ups: for example, when it needs a
+	 * refill, passes a position milestone, or reaches the end.  If there
+	 * is a scheduler, it is asked for a decoding round as well.
+	 *
+	 * @param wake The function to call, which must be safe to call from
+	 *   any thread.
+	 * @see Sink::SetWakeHandler
+	 */
+	void SetWakeHandler(Sink::WakeFn wake);
+
+	/**
+	 * Meters the loudness of everything decoded from now on.
+	 * The meter runs wherever decoding does, as samples go to the sink,
+	 * so it costs the audio callback nothing.  It meters what goes to the
+	 * sink, after any fade.
+	 * @exception FileError if the source's format can't be metered.
+	 * @see LoudnessMeter
+	 */
+	void EnableLoudnessMeter();
+
 	Audio::State Update() override;
 
 	[[nodiscard]] std::string_view File() const override;
 
 	void SetPlaying(bool playing) override;
 
+	void SetPlayingAt(bool playing, PlayheadClock::Clock::time_point when) override;
+
 	[[nodiscard]] Audio::State CurrentState() const override;
 
+	[[nodiscard]] bool PreRolled(std::chrono::microseconds amount) const override;
+
+	[[nodiscard]] bool Sounding() const override;
+
 	void SetPosition(std::chrono::microseconds position) override;
 
+	void Fade(std::chrono::microseconds duration, double db, Gain::Shape shape) override;
+
+	void SetSpeed(double speed) override;
+
 	[[nodiscard]] std::chrono::microseconds Position() const override;
 
 	[[nodiscard]] std::chrono::microseconds Length() const override;
 
+	[[nodiscard]] double Speed() const override;
+
+	[[nodiscard]] std::optional<CallbackStats::Snapshot> Stats() const override;
+
+	[[nodiscard]] std::optional<LoudnessMeter::Reading> Loudness() const override;
+
+	[[nodiscard]] std::optional<CuePoints> Cues() const override;
+
+	[[nodiscard]] std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] MemoryUse Memory() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+	void SetTap(std::shared_ptr<PcmTap> tap) override;
+
 private:
-	/// The source of audio data.
-	std::unique_ptr<Source> src;
+	/// The source of audio data, which can be played faster or slower.
+	std::unique_ptr<StretchedSource> src;
 
 	/// The sink to which audio data is sent.
 	std::unique_ptr<Sink> sink;
 
-	/// The current decoded frame.
-	Source::DecodeVector frame;
+	/// The source's format, captured when it was loaded.
+	StreamFormat format;
+
+	/// The buffer into which frames are decoded, allocated once.
+	RtVector<std::byte> frame;
 
 	/// A span representing the unclaimed part of the decoded frame.
 	gsl::span<const std::byte> frame_span;
 
-	/// Clears the current frame and its iterator.
+	/// The loudness meter, if any; guarded by decode_lock.
+	std::unique_ptr<LoudnessMeter> meter;
+
+	/// The tap, if any; guarded by decode_lock.
+	std::shared_ptr<PcmTap> tap;
+
+	/// The gain applied as samples are decoded; guarded by decode_lock.
+	Gain gain;
+
+	/// How far off the deadline of a sink that isn't playing is.
+	static constexpr std::chrono::seconds IDLE_HEADROOM{1};
+
+	/// Guards the source and the frame, and the producer side of the
+	/// sink, against the scheduler's workers.
+	mutable std::mutex decode_lock;
+
+	/// The function the workers call when the sink changes state.
+	std::function<void()> notify;
+
+	/// The sink state the workers last saw; guarded by decode_lock.
+	Audio::State last_state{Audio::State::NONE};
+
+	/// Whether the source has run out since the last seek; guarded by
+	/// decode_lock.
+	bool source_out{false};
+
+	/// The scheduler decoding this audio, if any.
+	std::atomic<DecodeScheduler *> scheduler{nullptr};
+
+	/// The position last published, in microseconds into the file.
+	std::atomic<std::int64_t> published_position{0};
+
+	/// The length last published, in microseconds.
+	std::atomic<std::int64_t> published_length{0};
+
+	/**
+	 * Works out where the sink has got to in the file, and how long the
+	 * file is, and publishes them for Position() and Length().
+	 * The caller must hold decode_lock.
+	 */
+	void PublishPosition();
+
+	/**
+	 * Moves decoded audio from the source to the sink.
+	 * This fills the sink for as long as it WantsMore(), or otherwise
+	 * does one round.
+	 * The caller must hold decode_lock if there is a worker.
+	 * @return The state of the sink after the round.
+	 */
+	Audio::State Pump();
+
+	/// Works out how long until the sink runs dry, for the scheduler.
+	std::chrono::microseconds Headroom() override;
+
+	/// Does one of the scheduler's decoding rounds.
+	void Run() override;
+
+	/// Asks the scheduler, if any, for a decoding round.
+	void WakeWorker();
+
+	/// Takes this audio off its scheduler, if any.
+	void StopWorker();
+
+	/// Marks the current frame as finished, discarding its samples.
 	void ClearFrame();
 
+	/**
+	 * Performs one round of decoding, straight into the sink if possible.
+	 * If the sink lends out part of its buffer, we decode into that and
+	 * skip the frame altogether; otherwise, we decode a frame as usual.
+	 * @return A pair of the decoder's state after the round, and the number
+	 *   of bytes decoded (into the sink or the frame).
+	 */
+	Source::DecodeSpanResult DecodeRound();
+
 	/**
 	 * Decodes a new frame, if the current frame is empty.
 	 * @return True if more frames are available to decode; false otherwise.
@@ -205,8 +541,8 @@ private:
 
 	/**
 	 * Returns whether the current frame has been finished.
-	 * If this is true, then either the frame is empty, or all of the samples in the frame have been fed to the
-	 * ringbuffer.
+	 * If this is true, then either no frame has been decoded, or all of the samples in the frame have been fed to
+	 * the ringbuffer.
 	 * @return True if the frame is finished; false otherwise.
 	 */
 	[[nodiscard]] bool FrameFinished() const;
@@ -0,0 +1,122 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the BufferPolicy class.
+ * @see audio/buffer_policy.h
+ */
+
+#include "buffer_policy.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <gsl/gsl>
+
+#include "../errors.h"
+
+namespace Playd::Audio
+{
+BufferPolicy::BufferPolicy(std::chrono::milliseconds min, std::chrono::milliseconds max)
+    : min{min.count()}, max{max.count()}, size{max.count()}
+{
+	Expects(0 < min.count());
+	Expects(min <= max);
+}
+
+std::size_t BufferPolicy::Bytes(std::uint32_t rate, std::size_t bytes_per_sample) const
+{
+	return BytesFor(this->Size(), rate, bytes_per_sample);
+}
+
+/* static */ std::size_t BufferPolicy::BytesFor(std::chrono::milliseconds size, std::uint32_t rate,
+                                                std::size_t bytes_per_sample)
+{
+	// Always leave room for at least one sample, however short the size.
+	const auto samples = std::max<std::size_t>((static_cast<std::size_t>(size.count()) * rate) / 1000, 1);
+	return samples * bytes_per_sample;
+}
+
+std::chrono::milliseconds BufferPolicy::Size() const
+{
+	return std::chrono::milliseconds{this->size.load(std::memory_order_relaxed)};
+}
+
+/* static */ BufferPolicy::Range BufferPolicy::ParseRange(std::string_view value)
+{
+	const auto parse = [value](std::string_view part) {
+		std::chrono::milliseconds::rep ms = 0;
+		const auto end = part.data() + part.size();
+		const auto [p, ec] = std::from_chars(part.data(), end, ms);
+		if (ec != std::errc{} || p != end || ms <= 0) {
+			throw ConfigError("not a valid buffer size: " + std::string{value});
+		}
+		return std::chrono::milliseconds{ms};
+	};
+
+	const auto dash = value.find('-');
+	if (dash == std::string_view::npos) {
+		const auto size = parse(value);
+		return std::make_pair(size, size);
+	}
+
+	const auto min = parse(value.substr(0, dash));
+	const auto max = parse(value.substr(dash + 1));
+	if (max < min) throw ConfigError("buffer size range is backwards: " + std::string{value});
+	return std::make_pair(min, max);
+}
+
+/* static */ std::string BufferPolicy::FormatRange(Range range)
+{
+	const auto min = std::to_string(range.first.count());
+	if (range.first == range.second) return min;
+	return min + "-" + std::to_string(range.second.count());
+}
+
+BufferPolicy::Range BufferPolicy::Sizes() const
+{
+	return std::make_pair(std::chrono::milliseconds{this->min.load(std::memory_order_relaxed)},
+	                      std::chrono::milliseconds{this->max.load(std::memory_order_relaxed)});
+}
+
+void BufferPolicy::SetSizes(std::chrono::milliseconds min, std::chrono::milliseconds max)
+{
+	Expects(0 < min.count());
+	Expects(min <= max);
+
+	// A sink reporting in the meantime may see one bound before the other,
+	// but only ever moves the size by clamping it into whichever it sees.
+	this->min.store(min.count(), std::memory_order_relaxed);
+	this->max.store(max.count(), std::memory_order_relaxed);
+	this->size.store(std::clamp(this->Size(), min, max).count(), std::memory_order_relaxed);
+}
+
+void BufferPolicy::Report(const Outcome &outcome)
+{
+	const auto [min, max] = this->Sizes();
+	if (min == max) return;
+
+	// Sinks wake their decoders at half full, so how far below that they
+	// got is how long decoding took to catch up.  Getting within an eighth
+	// of empty is too close for comfort.
+	const auto current = this->Size();
+	if (outcome.underruns != 0 || outcome.lowest < outcome.capacity / 8) {
+		this->size.store(std::min(current * 2, max).count(), std::memory_order_relaxed);
+		return;
+	}
+
+	// A sink that never got near empty, over a whole buffer's worth of
+	// playing, could have done with less.  We shrink from the size we
+	// asked for, not the one the sink got, as sinks round their buffers up.
+	if (outcome.capacity <= outcome.played && outcome.capacity * 3 / 8 <= outcome.lowest) {
+		this->size.store(std::max(current * 3 / 4, min).count(), std::memory_order_relaxed);
+	}
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,137 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the BufferPolicy class.
+ * @see audio/buffer_policy.cpp
+ */
+
+#ifndef PLAYD_AUDIO_BUFFER_POLICY_H
+#define PLAYD_AUDIO_BUFFER_POLICY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace Playd::Audio
+{
+/**
+ * Decides how much audio each new sink buffers.
+ *
+ * Sizes are in milliseconds rather than samples, so that a buffer holds the
+ * same amount of time whatever the rate and sample format of the file.
+ *
+ * A policy with a range of sizes adapts to what the sinks it sizes go through.
+ * Each sink reports, as it goes, whether it ran dry, and how low it got before
+ * the decoder topped it back up (which is how long decoding took to respond).
+ * Sinks that ran dry, or came close, make the next sink's buffer bigger; ones
+ * that never got near make it smaller.  Memory thus follows what the decoder
+ * actually needs, rather than what the worst case might be.
+ */
+class BufferPolicy
+{
+public:
+	/// The buffer size used if nothing else is asked for.
+	static constexpr std::chrono::milliseconds DEFAULT_SIZE{1000};
+
+	/// A range of sizes, smallest first.
+	using Range = std::pair<std::chrono::milliseconds, std::chrono::milliseconds>;
+
+	/// What a sink went through, reported as it goes away.
+	struct Outcome {
+		std::chrono::milliseconds capacity; ///< How much the sink held.
+		std::chrono::milliseconds lowest;   ///< The least it held while playing.
+		std::chrono::milliseconds played;   ///< How much it played.
+		std::uint64_t underruns;            ///< How often it ran dry.
+	};
+
+	/**
+	 * Constructs a BufferPolicy, starting at the largest size.
+	 * * Precondition: 0 < @a min and @a min <= @a max.
+	 * @param min The smallest size to shrink to.
+	 * @param max The largest size to grow to; if this is @a min, the size
+	 *   never changes.
+	 */
+	BufferPolicy(std::chrono::milliseconds min, std::chrono::milliseconds max);
+
+	/**
+	 * Works out how big a buffer to give a new sink, in bytes.
+	 * @param rate The sink's sample rate, in Hz.
+	 * @param bytes_per_sample The size of one sample frame, in bytes.
+	 * @return The buffer size, in bytes.
+	 */
+	[[nodiscard]] std::size_t Bytes(std::uint32_t rate, std::size_t bytes_per_sample) const;
+
+	/**
+	 * Works out how big a buffer of a given size is, in bytes.
+	 * @param size The buffer size, in milliseconds.
+	 * @param rate The sample rate, in Hz.
+	 * @param bytes_per_sample The size of one sample frame, in bytes.
+	 * @return The buffer size, in bytes.
+	 */
+	[[nodiscard]] static std::size_t BytesFor(std::chrono::milliseconds size, std::uint32_t rate,
+	                                          std::size_t bytes_per_sample);
+
+	/**
+	 * The size new sinks get right now.
+	 * @return The size, in milliseconds.
+	 */
+	[[nodiscard]] std::chrono::milliseconds Size() const;
+
+	/**
+	 * Parses a range of sizes, as an option or setting gives it.
+	 * @param value Either MS, for a fixed size, or MIN-MAX, for a size
+	 *   that adapts between the two.
+	 * @return The range, in milliseconds.
+	 * @exception ConfigError if the value isn't one or two positive whole
+	 *   numbers, in order.
+	 */
+	[[nodiscard]] static Range ParseRange(std::string_view value);
+
+	/**
+	 * Formats a range of sizes, as ParseRange() reads it.
+	 * @param range The range.
+	 * @return The range, as MS or MIN-MAX.
+	 */
+	[[nodiscard]] static std::string FormatRange(Range range);
+
+	/// @return The smallest and largest sizes, in milliseconds.
+	[[nodiscard]] Range Sizes() const;
+
+	/**
+	 * Changes the smallest and largest sizes.
+	 * The current size moves into the new range, and sinks made from now
+	 * on get sizes from it; sinks already made keep their buffers.  This
+	 * is safe to call from any thread.
+	 * * Precondition: 0 < @a min and @a min <= @a max.
+	 * @param min The smallest size to shrink to.
+	 * @param max The largest size to grow to.
+	 */
+	void SetSizes(std::chrono::milliseconds min, std::chrono::milliseconds max);
+
+	/**
+	 * Adjusts the size according to how a sink got on.
+	 * This is safe to call from any thread.
+	 * @param outcome What the sink went through.
+	 */
+	void Report(const Outcome &outcome);
+
+private:
+	/// The smallest size, in milliseconds.
+	std::atomic<std::chrono::milliseconds::rep> min;
+
+	/// The largest size, in milliseconds.
+	std::atomic<std::chrono::milliseconds::rep> max;
+
+	/// The current size, in milliseconds.
+	std::atomic<std::chrono::milliseconds::rep> size;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_BUFFER_POLICY_H
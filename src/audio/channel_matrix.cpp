@@ -0,0 +1,337 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the ChannelMatrix and RemixedSource classes.
+ * @see audio/channel_matrix.h
+ */
+
+#include "channel_matrix.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLAYD_CHANNEL_MATRIX_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PLAYD_CHANNEL_MATRIX_NEON
+#include <arm_neon.h>
+#endif
+
+#include "../errors.h"
+#include "convert.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/// The speakers that channels can stand for.
+enum class Speaker : std::uint8_t {
+	MONO, ///< The only channel of a mono file.
+	FL,   ///< Front left.
+	FR,   ///< Front right.
+	FC,   ///< Front centre (and a mono device's only speaker).
+	LFE,  ///< Low-frequency effects.
+	BL,   ///< Back left.
+	BR,   ///< Back right.
+	BC,   ///< Back centre.
+	SL,   ///< Side left.
+	SR,   ///< Side right.
+};
+
+/// A channel layout: the speaker for each channel, in order.
+struct Layout {
+	std::uint8_t count;                                      ///< Number of channels.
+	std::array<Speaker, ChannelMatrix::MAX_CHANNELS> speakers; ///< What each channel is.
+};
+
+/// SDL's channel layouts, by channel count less one.
+static constexpr std::array<Layout, ChannelMatrix::MAX_CHANNELS> LAYOUTS{{
+        {1, {Speaker::MONO}},
+        {2, {Speaker::FL, Speaker::FR}},
+        {3, {Speaker::FL, Speaker::FR, Speaker::LFE}},
+        {4, {Speaker::FL, Speaker::FR, Speaker::BL, Speaker::BR}},
+        {5, {Speaker::FL, Speaker::FR, Speaker::LFE, Speaker::BL, Speaker::BR}},
+        {6, {Speaker::FL, Speaker::FR, Speaker::FC, Speaker::LFE, Speaker::BL, Speaker::BR}},
+        {7, {Speaker::FL, Speaker::FR, Speaker::FC, Speaker::LFE, Speaker::BC, Speaker::SL, Speaker::SR}},
+        {8, {Speaker::FL, Speaker::FR, Speaker::FC, Speaker::LFE, Speaker::BL, Speaker::BR, Speaker::SL, Speaker::SR}},
+}};
+
+/// -3 dB, the level at which a channel is folded into each of two others.
+static constexpr float MINUS_3DB = std::numbers::sqrt2_v<float> / 2.0F;
+
+/**
+ * Finds a speaker in a layout.
+ * A mono device's speaker counts as a centre.
+ * @param layout The layout.
+ * @param speaker The speaker.
+ * @return Its channel, or nothing if the layout lacks it.
+ */
+static std::optional<std::uint8_t> Find(const Layout &layout, Speaker speaker)
+{
+	if (layout.count == 1) {
+		if (speaker == Speaker::FC || speaker == Speaker::MONO) return 0;
+		return std::nullopt;
+	}
+	for (std::uint8_t c = 0; c < layout.count; c++) {
+		if (layout.speakers[c] == speaker) return c;
+	}
+	return std::nullopt;
+}
+
+/**
+ * Routes one input speaker into a column of output gains, folding it into
+ * its neighbours if the output lacks it.
+ * @param column The gains of the speaker's input channel, to add to.
+ * @param out The output layout.
+ * @param speaker The speaker.
+ * @param gain How much of it to route.
+ */
+static void Fold(std::array<float, ChannelMatrix::MAX_CHANNELS> &column, const Layout &out, Speaker speaker,
+                 float gain)
+{
+	if (const auto c = Find(out, speaker)) {
+		column[*c] += gain;
+		return;
+	}
+
+	const auto has = [&out](Speaker s) { return Find(out, s).has_value(); };
+	switch (speaker) {
+	case Speaker::MONO:
+		if (has(Speaker::FC)) {
+			Fold(column, out, Speaker::FC, gain);
+		} else {
+			Fold(column, out, Speaker::FL, gain);
+			Fold(column, out, Speaker::FR, gain);
+		}
+		break;
+	case Speaker::FL:
+	case Speaker::FR:
+		Fold(column, out, Speaker::FC, gain * MINUS_3DB);
+		break;
+	case Speaker::FC:
+		Fold(column, out, Speaker::FL, gain * MINUS_3DB);
+		Fold(column, out, Speaker::FR, gain * MINUS_3DB);
+		break;
+	case Speaker::LFE:
+		break;
+	case Speaker::BL:
+		if (has(Speaker::SL)) Fold(column, out, Speaker::SL, gain);
+		else Fold(column, out, Speaker::FL, gain * MINUS_3DB);
+		break;
+	case Speaker::BR:
+		if (has(Speaker::SR)) Fold(column, out, Speaker::SR, gain);
+		else Fold(column, out, Speaker::FR, gain * MINUS_3DB);
+		break;
+	case Speaker::SL:
+		if (has(Speaker::BL)) Fold(column, out, Speaker::BL, gain);
+		else Fold(column, out, Speaker::FL, gain * MINUS_3DB);
+		break;
+	case Speaker::SR:
+		if (has(Speaker::BR)) Fold(column, out, Speaker::BR, gain);
+		else Fold(column, out, Speaker::FR, gain * MINUS_3DB);
+		break;
+	case Speaker::BC:
+		if (has(Speaker::SL) || has(Speaker::BL)) {
+			Fold(column, out, Speaker::SL, gain * MINUS_3DB);
+			Fold(column, out, Speaker::SR, gain * MINUS_3DB);
+		} else {
+			Fold(column, out, Speaker::FL, gain * 0.5F);
+			Fold(column, out, Speaker::FR, gain * 0.5F);
+		}
+		break;
+	}
+}
+
+//
+// ChannelMatrix
+//
+
+ChannelMatrix::ChannelMatrix(std::uint8_t in, std::uint8_t out) : in{in}, out{out}, columns{}
+{
+	Expects(0 < in && in <= MAX_CHANNELS);
+	Expects(0 < out && out <= MAX_CHANNELS);
+
+	const auto &in_layout = LAYOUTS[in - 1];
+	const auto &out_layout = LAYOUTS[out - 1];
+	for (std::uint8_t c = 0; c < in; c++) Fold(this->columns[c], out_layout, in_layout.speakers[c], 1.0F);
+}
+
+float ChannelMatrix::Gain(std::uint8_t out_channel, std::uint8_t in_channel) const
+{
+	Expects(out_channel < this->out && in_channel < this->in);
+	return this->columns[in_channel][out_channel];
+}
+
+void ChannelMatrix::SetGain(std::uint8_t out_channel, std::uint8_t in_channel, float gain)
+{
+	Expects(out_channel < this->out && in_channel < this->in);
+	this->columns[in_channel][out_channel] = gain;
+}
+
+void ChannelMatrix::Apply(gsl::span<const float> src, gsl::span<float> dest) const
+{
+	Expects(src.size() % this->in == 0);
+	const auto frames = src.size() / this->in;
+	Expects(dest.size() == frames * this->out);
+
+	const auto *x = src.data();
+	auto *y = dest.data();
+	const auto out_bytes = this->out * sizeof(float);
+
+	// Each output frame is the sum of the columns, each scaled by its input
+	// sample: two vectors of four outputs at a time, whatever the layout.
+	for (std::size_t f = 0; f < frames; f++, x += this->in, y += this->out) {
+#if defined(PLAYD_CHANNEL_MATRIX_SSE2)
+		auto lo = _mm_setzero_ps();
+		auto hi = _mm_setzero_ps();
+		for (std::uint8_t c = 0; c < this->in; c++) {
+			const auto v = _mm_set1_ps(x[c]);
+			lo = _mm_add_ps(lo, _mm_mul_ps(v, _mm_loadu_ps(this->columns[c].data())));
+			hi = _mm_add_ps(hi, _mm_mul_ps(v, _mm_loadu_ps(this->columns[c].data() + 4)));
+		}
+		alignas(16) std::array<float, MAX_CHANNELS> frame;
+		_mm_store_ps(frame.data(), lo);
+		_mm_store_ps(frame.data() + 4, hi);
+#elif defined(PLAYD_CHANNEL_MATRIX_NEON)
+		auto lo = vdupq_n_f32(0.0F);
+		auto hi = vdupq_n_f32(0.0F);
+		for (std::uint8_t c = 0; c < this->in; c++) {
+			lo = vfmaq_n_f32(lo, vld1q_f32(this->columns[c].data()), x[c]);
+			hi = vfmaq_n_f32(hi, vld1q_f32(this->columns[c].data() + 4), x[c]);
+		}
+		std::array<float, MAX_CHANNELS> frame;
+		vst1q_f32(frame.data(), lo);
+		vst1q_f32(frame.data() + 4, hi);
+#else
+		std::array<float, MAX_CHANNELS> frame{};
+		for (std::uint8_t c = 0; c < this->in; c++) {
+			for (std::uint8_t o = 0; o < this->out; o++) frame[o] += x[c] * this->columns[c][o];
+		}
+#endif
+		std::memcpy(y, frame.data(), out_bytes);
+	}
+}
+
+std::uint8_t ChannelMatrix::InChannels() const
+{
+	return this->in;
+}
+
+std::uint8_t ChannelMatrix::OutChannels() const
+{
+	return this->out;
+}
+
+//
+// RemixedSource
+//
+
+RemixedSource::RemixedSource(std::unique_ptr<Source> inner, std::uint8_t channels)
+    : Source{inner->Path()},
+      inner{std::move(inner)},
+      matrix{std::clamp<std::uint8_t>(this->inner->ChannelCount(), 1, ChannelMatrix::MAX_CHANNELS), channels},
+      raw(this->inner->FrameBytes()),
+      floats(this->raw.size() / sample_format_bps[static_cast<int>(this->inner->OutputSampleFormat())])
+{
+	if (!CanConvert(this->inner->OutputSampleFormat(), SampleFormat::FLOAT32)) {
+		throw FileError("can't remix sample format");
+	}
+	if (ChannelMatrix::MAX_CHANNELS < this->inner->ChannelCount()) {
+		throw FileError("can't remix more than " + std::to_string(ChannelMatrix::MAX_CHANNELS) + " channels");
+	}
+}
+
+RemixedSource::DecodeSpanResult RemixedSource::Decode(gsl::span<std::byte> out)
+{
+	Expects(out.size() % this->BytesPerSample() == 0);
+	if (out.empty()) return std::make_pair(DecodeState::DECODING, 0);
+
+	// As with the sndfile source, spans of whole samples will be aligned.
+	assert(reinterpret_cast<std::uintptr_t>(out.data()) % alignof(float) == 0);
+
+	// Only decode as many samples as there is room for once remixed.
+	const auto in_bytes = this->inner->BytesPerSample();
+	const auto wanted = std::min(out.size() / this->BytesPerSample() * in_bytes, this->raw.size());
+	const auto [state, count] = this->inner->Decode(gsl::span<std::byte>(this->raw).first(wanted));
+	if (count == 0) return std::make_pair(state, 0);
+
+	const auto in_format = this->inner->OutputSampleFormat();
+	const auto mono_count = count / sample_format_bps[static_cast<int>(in_format)];
+	const auto in_floats = gsl::span<float>(this->floats).first(mono_count);
+	ConvertSamples(in_format, SampleFormat::FLOAT32, gsl::span<const std::byte>(this->raw).first(count),
+	               gsl::span<std::byte>(reinterpret_cast<std::byte *>(in_floats.data()), mono_count * sizeof(float)));
+
+	const auto samples = count / in_bytes;
+	const gsl::span<float> dest(reinterpret_cast<float *>(out.data()), samples * this->matrix.OutChannels());
+	this->matrix.Apply(in_floats, dest);
+	return std::make_pair(state, samples * this->BytesPerSample());
+}
+
+std::uint64_t RemixedSource::Seek(std::uint64_t position)
+{
+	return this->inner->Seek(position);
+}
+
+std::uint64_t RemixedSource::Length() const
+{
+	return this->inner->Length();
+}
+
+std::uint8_t RemixedSource::ChannelCount() const
+{
+	return this->matrix.OutChannels();
+}
+
+std::uint32_t RemixedSource::SampleRate() const
+{
+	return this->inner->SampleRate();
+}
+
+SampleFormat RemixedSource::OutputSampleFormat() const
+{
+	return SampleFormat::FLOAT32;
+}
+
+std::optional<CuePoints> RemixedSource::Cues() const
+{
+	return this->inner->Cues();
+}
+
+std::optional<StreamStats> RemixedSource::Streaming() const
+{
+	return this->inner->Streaming();
+}
+
+std::size_t RemixedSource::ScratchBytes() const
+{
+	return this->inner->ScratchBytes() + this->raw.capacity() + this->floats.capacity() * sizeof(float);
+}
+
+std::uint64_t RemixedSource::SkippedFrames() const
+{
+	return this->inner->SkippedFrames();
+}
+
+ConversionList RemixedSource::Conversions() const
+{
+	auto steps = this->inner->Conversions();
+	const auto in_format = this->inner->OutputSampleFormat();
+	if (in_format != SampleFormat::FLOAT32) steps.push_back(DescribeConversion(in_format, SampleFormat::FLOAT32));
+	steps.push_back(std::to_string(this->matrix.InChannels()) + ">" + std::to_string(this->matrix.OutChannels()) +
+	                "ch");
+	return steps;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,140 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The ChannelMatrix and RemixedSource classes.
+ * @see audio/channel_matrix.cpp
+ */
+
+#ifndef PLAYD_AUDIO_CHANNEL_MATRIX_H
+#define PLAYD_AUDIO_CHANNEL_MATRIX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#undef max
+#include <gsl/gsl>
+
+#include "rt_memory.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A matrix routing packed FLOAT32 audio from one channel layout to another.
+ *
+ * Each output channel is a weighted sum of the input channels.  The standard
+ * matrices follow SDL's layouts for each channel count (mono; stereo; 2.1;
+ * quad; 4.1; 5.1; 6.1; 7.1), and fold channels the output doesn't have into
+ * their nearest neighbours, at the ITU-R BS.775 levels: a missing centre goes
+ * to left and right at -3 dB, missing surrounds go to the front on their own
+ * side at -3 dB, and a missing LFE is dropped.  Mono files go to the centre,
+ * if there is one, and otherwise to left and right at full level, so that
+ * they sound the same as on a mono device.
+ */
+class ChannelMatrix
+{
+public:
+	/// The most channels on either side; SDL has no layouts past 7.1.
+	static constexpr std::uint8_t MAX_CHANNELS = 8;
+
+	/**
+	 * Constructs the standard matrix from one channel count to another.
+	 * * Precondition: both counts are between 1 and MAX_CHANNELS.
+	 * @param in The number of input channels.
+	 * @param out The number of output channels.
+	 */
+	ChannelMatrix(std::uint8_t in, std::uint8_t out);
+
+	/**
+	 * Gets how much of an input channel goes into an output channel.
+	 * @param out The output channel.
+	 * @param in The input channel.
+	 * @return The gain.
+	 */
+	[[nodiscard]] float Gain(std::uint8_t out, std::uint8_t in) const;
+
+	/**
+	 * Sets how much of an input channel goes into an output channel.
+	 * @param out The output channel.
+	 * @param in The input channel.
+	 * @param gain The gain.
+	 */
+	void SetGain(std::uint8_t out, std::uint8_t in, float gain);
+
+	/**
+	 * Routes packed samples through the matrix.
+	 * @param in The input samples; a whole number of input samples.
+	 * @param out Where to put the output samples, with room for as many.
+	 */
+	void Apply(gsl::span<const float> in, gsl::span<float> out) const;
+
+	/// @return The number of input channels.
+	[[nodiscard]] std::uint8_t InChannels() const;
+
+	/// @return The number of output channels.
+	[[nodiscard]] std::uint8_t OutChannels() const;
+
+private:
+	std::uint8_t in;  ///< Number of input channels.
+	std::uint8_t out; ///< Number of output channels.
+
+	/// The gains, by input channel then output channel (unused outputs
+	/// being zero), so that each input sample scales one column.
+	std::array<std::array<float, MAX_CHANNELS>, MAX_CHANNELS> columns;
+};
+
+/**
+ * A Source that remixes another Source's audio to a fixed channel count.
+ * Output is always FLOAT32, at the inner Source's rate.
+ */
+class RemixedSource : public Source
+{
+public:
+	/**
+	 * Constructs a RemixedSource.
+	 * @param inner The Source to remix.
+	 * @param channels The number of channels to output.
+	 * @exception FileError if @a inner's samples can't be remixed.
+	 */
+	RemixedSource(std::unique_ptr<Source> inner, std::uint8_t channels);
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	std::optional<CuePoints> Cues() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+private:
+	std::unique_ptr<Source> inner; ///< The Source being remixed.
+	ChannelMatrix matrix;          ///< The routing from its channels to ours.
+	RtVector<std::byte> raw;       ///< Samples decoded by the inner Source.
+	RtVector<float> floats;        ///< The same samples, as FLOAT32.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_CHANNEL_MATRIX_H
@@ -0,0 +1,573 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of sample format conversion.
+ * @see audio/convert.h
+ */
+
+#include "convert.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLAYD_CONVERT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define PLAYD_CONVERT_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PLAYD_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+#include "../errors.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/* The kernels below all follow the same pattern: as many whole vectors as
+   fit, then a scalar loop for the tail.  The scalar code is written to give
+   exactly the same answers as the vector code (same clamping order, same
+   round-to-nearest conversion), so the split point never shows in the
+   output.  The one exception is NaN, which NEON turns into silence rather
+   than full scale.  Samples are loaded and stored unaligned throughout, as the
+   ring buffer makes no promises about where a chunk starts. */
+
+/// Scale from 16-bit integer samples to floats.
+static constexpr float S16_SCALE = 32768.0f;
+
+/// Scale from 32-bit integer samples to floats.
+static constexpr float S32_SCALE = 2147483648.0f;
+
+/// Largest float not above INT16_MAX (which is itself exact).
+static constexpr float S16_MAX = 32767.0f;
+
+/// Largest float that converts to a 32-bit integer without overflowing.
+static constexpr float S32_MAX = 2147483520.0f;
+
+template <typename T> static T Load(const std::byte *p)
+{
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+template <typename T> static void Store(std::byte *p, T value)
+{
+	std::memcpy(p, &value, sizeof(T));
+}
+
+/**
+ * Scales and saturates a float sample into an integer range.
+ * This mirrors the min-then-max clamp the x86 kernels do, so NaNs come
+ * out as @a hi on both paths.
+ */
+static std::int32_t Saturate(float sample, float scale, float hi)
+{
+	auto v = sample * scale;
+	v = v < hi ? v : hi;
+	v = v > -scale ? v : -scale;
+	return static_cast<std::int32_t>(std::lrint(v));
+}
+
+static void S16ToF32(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_AVX2)
+	const auto scale = _mm256_set1_ps(1.0f / S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+		const auto wide = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(in));
+		_mm256_storeu_ps(reinterpret_cast<float *>(dest + i * 4), _mm256_mul_ps(wide, scale));
+	}
+#elif defined(PLAYD_CONVERT_SSE2)
+	const auto scale = _mm_set1_ps(1.0f / S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+		// Unpacking into the high half and shifting back sign-extends.
+		const auto lo = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), in), 16);
+		const auto hi = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), in), 16);
+		auto *out = reinterpret_cast<float *>(dest + i * 4);
+		_mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	const auto scale = vdupq_n_f32(1.0f / S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto in = vld1q_s16(reinterpret_cast<const int16_t *>(src + i * 2));
+		auto *out = reinterpret_cast<float *>(dest + i * 4);
+		vst1q_f32(out, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(in))), scale));
+		vst1q_f32(out + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(in))), scale));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<std::int16_t>(src + i * 2);
+		Store<float>(dest + i * 4, static_cast<float>(in) * (1.0f / S16_SCALE));
+	}
+}
+
+static void F32ToS16(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_AVX2)
+	const auto scale = _mm256_set1_ps(S16_SCALE);
+	const auto hi = _mm256_set1_ps(S16_MAX);
+	const auto lo = _mm256_set1_ps(-S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		auto v = _mm256_mul_ps(_mm256_loadu_ps(reinterpret_cast<const float *>(src + i * 4)), scale);
+		v = _mm256_max_ps(_mm256_min_ps(v, hi), lo);
+		const auto ints = _mm256_cvtps_epi32(v);
+		const auto packed = _mm_packs_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2), packed);
+	}
+#elif defined(PLAYD_CONVERT_SSE2)
+	const auto scale = _mm_set1_ps(S16_SCALE);
+	const auto hi = _mm_set1_ps(S16_MAX);
+	const auto lo = _mm_set1_ps(-S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto *in = reinterpret_cast<const float *>(src + i * 4);
+		auto a = _mm_mul_ps(_mm_loadu_ps(in), scale);
+		auto b = _mm_mul_ps(_mm_loadu_ps(in + 4), scale);
+		a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+		b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+		const auto packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2), packed);
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	const auto scale = vdupq_n_f32(S16_SCALE);
+	const auto hi = vdupq_n_f32(S16_MAX);
+	const auto lo = vdupq_n_f32(-S16_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto *in = reinterpret_cast<const float *>(src + i * 4);
+		const auto a = vcvtnq_s32_f32(vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in), scale), hi), lo));
+		const auto b = vcvtnq_s32_f32(vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(in + 4), scale), hi), lo));
+		vst1q_s16(reinterpret_cast<int16_t *>(dest + i * 2), vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<float>(src + i * 4);
+		Store<std::int16_t>(dest + i * 2, static_cast<std::int16_t>(Saturate(in, S16_SCALE, S16_MAX)));
+	}
+}
+
+static void S32ToF32(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_AVX2)
+	const auto scale = _mm256_set1_ps(1.0f / S32_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		const auto in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+		_mm256_storeu_ps(reinterpret_cast<float *>(dest + i * 4), _mm256_mul_ps(_mm256_cvtepi32_ps(in), scale));
+	}
+#elif defined(PLAYD_CONVERT_SSE2)
+	const auto scale = _mm_set1_ps(1.0f / S32_SCALE);
+	for (; i + 4 <= count; i += 4) {
+		const auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+		_mm_storeu_ps(reinterpret_cast<float *>(dest + i * 4), _mm_mul_ps(_mm_cvtepi32_ps(in), scale));
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	const auto scale = vdupq_n_f32(1.0f / S32_SCALE);
+	for (; i + 4 <= count; i += 4) {
+		const auto in = vld1q_s32(reinterpret_cast<const int32_t *>(src + i * 4));
+		vst1q_f32(reinterpret_cast<float *>(dest + i * 4), vmulq_f32(vcvtq_f32_s32(in), scale));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<std::int32_t>(src + i * 4);
+		Store<float>(dest + i * 4, static_cast<float>(in) * (1.0f / S32_SCALE));
+	}
+}
+
+static void F32ToS32(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_AVX2)
+	const auto scale = _mm256_set1_ps(S32_SCALE);
+	const auto hi = _mm256_set1_ps(S32_MAX);
+	const auto lo = _mm256_set1_ps(-S32_SCALE);
+	for (; i + 8 <= count; i += 8) {
+		auto v = _mm256_mul_ps(_mm256_loadu_ps(reinterpret_cast<const float *>(src + i * 4)), scale);
+		v = _mm256_max_ps(_mm256_min_ps(v, hi), lo);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i * 4), _mm256_cvtps_epi32(v));
+	}
+#elif defined(PLAYD_CONVERT_SSE2)
+	const auto scale = _mm_set1_ps(S32_SCALE);
+	const auto hi = _mm_set1_ps(S32_MAX);
+	const auto lo = _mm_set1_ps(-S32_SCALE);
+	for (; i + 4 <= count; i += 4) {
+		auto v = _mm_mul_ps(_mm_loadu_ps(reinterpret_cast<const float *>(src + i * 4)), scale);
+		v = _mm_max_ps(_mm_min_ps(v, hi), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 4), _mm_cvtps_epi32(v));
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	const auto scale = vdupq_n_f32(S32_SCALE);
+	const auto hi = vdupq_n_f32(S32_MAX);
+	const auto lo = vdupq_n_f32(-S32_SCALE);
+	for (; i + 4 <= count; i += 4) {
+		auto v = vmulq_f32(vld1q_f32(reinterpret_cast<const float *>(src + i * 4)), scale);
+		v = vmaxq_f32(vminq_f32(v, hi), lo);
+		vst1q_s32(reinterpret_cast<int32_t *>(dest + i * 4), vcvtnq_s32_f32(v));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<float>(src + i * 4);
+		Store<std::int32_t>(dest + i * 4, Saturate(in, S32_SCALE, S32_MAX));
+	}
+}
+
+static void S16ToS32(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		const auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+		// Putting each sample in the top half of a 32-bit lane is the
+		// whole conversion.
+		auto *out = reinterpret_cast<__m128i *>(dest + i * 4);
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(_mm_setzero_si128(), in));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(_mm_setzero_si128(), in));
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	for (; i + 8 <= count; i += 8) {
+		const auto in = vld1q_s16(reinterpret_cast<const int16_t *>(src + i * 2));
+		auto *out = reinterpret_cast<int32_t *>(dest + i * 4);
+		vst1q_s32(out, vshll_n_s16(vget_low_s16(in), 16));
+		vst1q_s32(out + 4, vshll_n_s16(vget_high_s16(in), 16));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<std::int16_t>(src + i * 2);
+		Store<std::int32_t>(dest + i * 4, static_cast<std::int32_t>(in) * 65536);
+	}
+}
+
+static void S32ToS16(const std::byte *src, std::byte *dest, size_t count)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		const auto *in = reinterpret_cast<const __m128i *>(src + i * 4);
+		// After the shift everything fits, so packs never saturates.
+		const auto a = _mm_srai_epi32(_mm_loadu_si128(in), 16);
+		const auto b = _mm_srai_epi32(_mm_loadu_si128(in + 1), 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i * 2), _mm_packs_epi32(a, b));
+	}
+#elif defined(PLAYD_CONVERT_NEON)
+	for (; i + 8 <= count; i += 8) {
+		const auto *in = reinterpret_cast<const int32_t *>(src + i * 4);
+		const auto a = vshrn_n_s32(vld1q_s32(in), 16);
+		const auto b = vshrn_n_s32(vld1q_s32(in + 4), 16);
+		vst1q_s16(reinterpret_cast<int16_t *>(dest + i * 2), vcombine_s16(a, b));
+	}
+#endif
+	for (; i < count; i++) {
+		const auto in = Load<std::int32_t>(src + i * 4);
+		Store<std::int16_t>(dest + i * 2, static_cast<std::int16_t>(in >> 16));
+	}
+}
+
+static void U8ToF32(const std::byte *src, std::byte *dest, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const auto in = static_cast<int>(std::to_integer<std::uint8_t>(src[i])) - 128;
+		Store<float>(dest + i * 4, static_cast<float>(in) * (1.0f / 128.0f));
+	}
+}
+
+static void S8ToF32(const std::byte *src, std::byte *dest, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const auto in = static_cast<std::int8_t>(std::to_integer<std::uint8_t>(src[i]));
+		Store<float>(dest + i * 4, static_cast<float>(in) * (1.0f / 128.0f));
+	}
+}
+
+/// Copies samples that are already in the right format.
+template <size_t Bytes> static void Copy(const std::byte *src, std::byte *dest, size_t count)
+{
+	std::memcpy(dest, src, count * Bytes);
+}
+
+/**
+ * The kernel for each conversion, by source and then destination format, or
+ * nullptr if there isn't one.  Each kernel has its sample sizes built in, so
+ * looking one up once is all the dispatch a conversion needs.
+ */
+static constexpr std::array<std::array<ConvertFn, SAMPLE_FORMAT_COUNT>, SAMPLE_FORMAT_COUNT> KERNELS{{
+        // To UINT8, SINT8, SINT16, SINT32, FLOAT32
+        {{Copy<1>, nullptr, nullptr, nullptr, U8ToF32}},   // from UINT8
+        {{nullptr, Copy<1>, nullptr, nullptr, S8ToF32}},   // from SINT8
+        {{nullptr, nullptr, Copy<2>, S16ToS32, S16ToF32}}, // from SINT16
+        {{nullptr, nullptr, S32ToS16, Copy<4>, S32ToF32}}, // from SINT32
+        {{nullptr, nullptr, F32ToS16, F32ToS32, Copy<4>}}, // from FLOAT32
+}};
+
+ConvertFn FindConverter(SampleFormat from, SampleFormat to)
+{
+	return KERNELS[static_cast<size_t>(from)][static_cast<size_t>(to)];
+}
+
+bool CanConvert(SampleFormat from, SampleFormat to)
+{
+	return FindConverter(from, to) != nullptr;
+}
+
+void ConvertSamples(SampleFormat from, SampleFormat to, gsl::span<const std::byte> src, gsl::span<std::byte> dest)
+{
+	const auto from_bps = sample_format_bps[static_cast<int>(from)];
+	const auto to_bps = sample_format_bps[static_cast<int>(to)];
+
+	const auto count = src.size() / from_bps;
+	Expects(src.size() % from_bps == 0);
+	Expects(dest.size() == count * to_bps);
+
+	const auto kernel = FindConverter(from, to);
+	if (kernel == nullptr) throw InternalError("unsupported sample conversion");
+	kernel(src.data(), dest.data(), count);
+}
+
+void MixSamples(gsl::span<const std::byte> src, gsl::span<std::byte> dest, gsl::span<const float> gains)
+{
+	const auto channels = gains.size();
+	const auto count = src.size() / sizeof(float);
+	Expects(0 < channels);
+	Expects(src.size() == dest.size());
+	Expects(count % channels == 0);
+
+	const auto *in = src.data();
+	auto *out = dest.data();
+	size_t i = 0;
+
+#if defined(PLAYD_CONVERT_AVX2) || defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+	// A run of one vector per channel starts and ends on a frame boundary,
+	// so each vector lines up with the same slice of this gain pattern.
+#if defined(PLAYD_CONVERT_AVX2)
+	constexpr size_t lanes = 8;
+#else
+	constexpr size_t lanes = 4;
+#endif
+	if (channels <= MIX_MAX_CHANNELS) {
+		std::array<float, MIX_MAX_CHANNELS * lanes> pattern{};
+		for (size_t j = 0; j < channels * lanes; j++) pattern[j] = gains[j % channels];
+
+		const auto run = channels * lanes;
+		for (; i + run <= count; i += run) {
+			for (size_t k = 0; k < channels; k++) {
+				const auto at = (i + k * lanes) * 4;
+				const auto *gain = pattern.data() + k * lanes;
+#if defined(PLAYD_CONVERT_AVX2)
+				const auto v = _mm256_mul_ps(_mm256_loadu_ps(reinterpret_cast<const float *>(in + at)),
+				                             _mm256_loadu_ps(gain));
+				auto *o = reinterpret_cast<float *>(out + at);
+				_mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), v));
+#elif defined(PLAYD_CONVERT_SSE2)
+				const auto v = _mm_mul_ps(_mm_loadu_ps(reinterpret_cast<const float *>(in + at)),
+				                          _mm_loadu_ps(gain));
+				auto *o = reinterpret_cast<float *>(out + at);
+				_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), v));
+#elif defined(PLAYD_CONVERT_NEON)
+				const auto v = vmulq_f32(vld1q_f32(reinterpret_cast<const float *>(in + at)), vld1q_f32(gain));
+				auto *o = reinterpret_cast<float *>(out + at);
+				vst1q_f32(o, vaddq_f32(vld1q_f32(o), v));
+#endif
+			}
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		const auto v = Load<float>(in + i * 4) * gains[i % channels];
+		Store<float>(out + i * 4, Load<float>(out + i * 4) + v);
+	}
+}
+
+/**
+ * Works out the gain of one sample frame of a ramp.
+ * The vector kernels work each lane's gain out the same way.
+ */
+static float RampGain(float start, float step, size_t frame)
+{
+	return start + (step * static_cast<float>(frame));
+}
+
+/**
+ * Makes the frame offsets of each vector in a run of one vector per channel.
+ * As in MixSamples(), such a run is a whole number of frames, so each vector
+ * in it always covers the same frames, relative to the start of the run.
+ */
+static std::array<float, MIX_MAX_CHANNELS * 4> RampOffsets(size_t channels)
+{
+	std::array<float, MIX_MAX_CHANNELS * 4> offsets{};
+	for (size_t j = 0; j < channels * 4; j++) offsets[j] = static_cast<float>(j / channels);
+	return offsets;
+}
+
+static void GainF32(std::byte *samples, size_t count, size_t channels, float start, float step)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+	if (channels <= MIX_MAX_CHANNELS) {
+		const auto offsets = RampOffsets(channels);
+		const auto run = channels * 4;
+		for (; i + run <= count; i += run) {
+			const auto frame = static_cast<float>(i / channels);
+			for (size_t k = 0; k < channels; k++) {
+				auto *p = reinterpret_cast<float *>(samples + (i + k * 4) * 4);
+#if defined(PLAYD_CONVERT_SSE2)
+				const auto at = _mm_add_ps(_mm_set1_ps(frame), _mm_loadu_ps(offsets.data() + k * 4));
+				const auto gain = _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(_mm_set1_ps(step), at));
+				_mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), gain));
+#elif defined(PLAYD_CONVERT_NEON)
+				const auto at = vaddq_f32(vdupq_n_f32(frame), vld1q_f32(offsets.data() + k * 4));
+				const auto gain = vaddq_f32(vdupq_n_f32(start), vmulq_f32(vdupq_n_f32(step), at));
+				vst1q_f32(p, vmulq_f32(vld1q_f32(p), gain));
+#endif
+			}
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		auto *p = samples + i * 4;
+		Store<float>(p, Load<float>(p) * RampGain(start, step, i / channels));
+	}
+}
+
+static void GainS16(std::byte *samples, size_t count, size_t channels, float start, float step)
+{
+	size_t i = 0;
+#if defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+	if (channels <= MIX_MAX_CHANNELS) {
+		const auto offsets = RampOffsets(channels);
+		const auto run = channels * 4;
+		for (; i + run <= count; i += run) {
+			const auto frame = static_cast<float>(i / channels);
+			for (size_t k = 0; k < channels; k++) {
+				auto *p = samples + (i + k * 4) * 2;
+#if defined(PLAYD_CONVERT_SSE2)
+				const auto at = _mm_add_ps(_mm_set1_ps(frame), _mm_loadu_ps(offsets.data() + k * 4));
+				const auto gain = _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(_mm_set1_ps(step), at));
+				const auto in = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+				const auto wide = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), in), 16);
+				auto v = _mm_mul_ps(_mm_cvtepi32_ps(wide), gain);
+				v = _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(S16_MAX)), _mm_set1_ps(-S16_SCALE));
+				const auto packed = _mm_packs_epi32(_mm_cvtps_epi32(v), _mm_setzero_si128());
+				_mm_storel_epi64(reinterpret_cast<__m128i *>(p), packed);
+#elif defined(PLAYD_CONVERT_NEON)
+				const auto at = vaddq_f32(vdupq_n_f32(frame), vld1q_f32(offsets.data() + k * 4));
+				const auto gain = vaddq_f32(vdupq_n_f32(start), vmulq_f32(vdupq_n_f32(step), at));
+				const auto in = vld1_s16(reinterpret_cast<const int16_t *>(p));
+				auto v = vmulq_f32(vcvtq_f32_s32(vmovl_s16(in)), gain);
+				v = vmaxq_f32(vminq_f32(v, vdupq_n_f32(S16_MAX)), vdupq_n_f32(-S16_SCALE));
+				vst1_s16(reinterpret_cast<int16_t *>(p), vqmovn_s32(vcvtnq_s32_f32(v)));
+#endif
+			}
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		auto *p = samples + i * 2;
+		auto v = static_cast<float>(Load<std::int16_t>(p)) * RampGain(start, step, i / channels);
+		v = v < S16_MAX ? v : S16_MAX;
+		v = v > -S16_SCALE ? v : -S16_SCALE;
+		Store<std::int16_t>(p, static_cast<std::int16_t>(std::lrint(v)));
+	}
+}
+
+static void GainS32(std::byte *samples, size_t count, size_t channels, float start, float step)
+{
+	for (size_t i = 0; i < count; i++) {
+		auto *p = samples + i * 4;
+		auto v = static_cast<double>(Load<std::int32_t>(p)) * RampGain(start, step, i / channels);
+		v = std::clamp(v, static_cast<double>(INT32_MIN), static_cast<double>(INT32_MAX));
+		Store<std::int32_t>(p, static_cast<std::int32_t>(std::lrint(v)));
+	}
+}
+
+static void Gain8(std::byte *samples, size_t count, size_t channels, float start, float step, int bias)
+{
+	for (size_t i = 0; i < count; i++) {
+		const auto in = static_cast<int>(std::to_integer<std::uint8_t>(samples[i]));
+		const auto centred = static_cast<float>(bias == 0 ? static_cast<std::int8_t>(in) : in - bias);
+		const auto v = std::clamp(std::lrint(centred * RampGain(start, step, i / channels)), -128L, 127L);
+		samples[i] = static_cast<std::byte>(static_cast<std::uint8_t>(v + bias));
+	}
+}
+
+void ApplyGain(SampleFormat format, size_t channels, gsl::span<std::byte> samples, float start, float step)
+{
+	const auto bps = sample_format_bps[static_cast<int>(format)];
+	const auto count = samples.size() / bps;
+	Expects(0 < channels);
+	Expects(samples.size() % (bps * channels) == 0);
+
+	switch (format) {
+	case SampleFormat::UINT8:
+		Gain8(samples.data(), count, channels, start, step, 128);
+		break;
+	case SampleFormat::SINT8:
+		Gain8(samples.data(), count, channels, start, step, 0);
+		break;
+	case SampleFormat::SINT16:
+		GainS16(samples.data(), count, channels, start, step);
+		break;
+	case SampleFormat::SINT32:
+		GainS32(samples.data(), count, channels, start, step);
+		break;
+	case SampleFormat::FLOAT32:
+		GainF32(samples.data(), count, channels, start, step);
+		break;
+	default:
+		throw InternalError("unsupported sample format for gain");
+	}
+}
+
+/// Whether a sample is loud, exactly as the vector kernels see it.
+static bool IsLoud(float sample, float level)
+{
+	return std::fabs(sample) > level;
+}
+
+#if defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+/// Whether any of four samples is loud; the scalar code then finds which.
+static bool AnyLoud(const float *samples, float level)
+{
+#if defined(PLAYD_CONVERT_SSE2)
+	const auto magnitude = _mm_and_ps(_mm_loadu_ps(samples), _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)));
+	return _mm_movemask_ps(_mm_cmpgt_ps(magnitude, _mm_set1_ps(level))) != 0;
+#elif defined(PLAYD_CONVERT_NEON)
+	return vmaxvq_u32(vcagtq_f32(vld1q_f32(samples), vdupq_n_f32(level))) != 0;
+#endif
+}
+#endif
+
+std::pair<size_t, size_t> FindLoud(gsl::span<const float> samples, float level)
+{
+	const auto *in = samples.data();
+	const auto count = samples.size();
+
+	// Whole vectors get us near each end, and the scalar loops find the
+	// exact sample from there.
+	size_t first = 0;
+#if defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+	while (first + 4 <= count && !AnyLoud(in + first, level)) first += 4;
+#endif
+	while (first < count && !IsLoud(in[first], level)) first++;
+
+	size_t end = count;
+#if defined(PLAYD_CONVERT_SSE2) || defined(PLAYD_CONVERT_NEON)
+	while (first + 4 <= end && !AnyLoud(in + end - 4, level)) end -= 4;
+#endif
+	while (first < end && !IsLoud(in[end - 1], level)) end--;
+
+	return std::make_pair(first, end);
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,138 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Sample format conversion.
+ * @see audio/convert.cpp
+ */
+
+#ifndef PLAYD_AUDIO_CONVERT_H
+#define PLAYD_AUDIO_CONVERT_H
+
+#include <cstddef>
+#include <utility>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * Whether ConvertSamples() can convert between two sample formats.
+ *
+ * Every format can be converted to FLOAT32; SINT16, SINT32 and FLOAT32 can
+ * also be converted to each other.
+ *
+ * @param from The format of the input samples.
+ * @param to The format of the output samples.
+ * @return True if the conversion is supported; false otherwise.
+ */
+bool CanConvert(SampleFormat from, SampleFormat to);
+
+/**
+ * A sample conversion, with its formats fixed.
+ * The arguments are the input bytes, the output bytes, and the number of
+ * mono samples to convert.
+ */
+using ConvertFn = void (*)(const std::byte *src, std::byte *dest, size_t count);
+
+/**
+ * Finds the conversion between two sample formats, for callers that convert
+ * many chunks of the same formats and only want to look it up once.
+ *
+ * The conversion does what ConvertSamples() does, but leaves checking the
+ * sizes of its input and output to the caller; a conversion between the same
+ * two formats is a copy.
+ *
+ * @param from The format of the input samples.
+ * @param to The format of the output samples.
+ * @return The conversion, or nullptr if !CanConvert(@a from, @a to).
+ */
+ConvertFn FindConverter(SampleFormat from, SampleFormat to);
+
+/**
+ * Converts packed samples from one format to another.
+ *
+ * This works on mono samples, so it doesn't care how many channels are
+ * interleaved in the input.  The common conversions (between SINT16, SINT32
+ * and FLOAT32) use SSE2, AVX2 or NEON kernels where the compiler targets
+ * them, and scalar code otherwise; the results are the same either way.
+ *
+ * Floating-point samples are in the range [-1, 1]; converting them to
+ * integers saturates anything outside that range.
+ *
+ * * Precondition: CanConvert(@a from, @a to).
+ * * Precondition: @a src holds a whole number of mono samples, and @a dest
+ *     is exactly big enough for the same number of samples in @a to.
+ *
+ * @param from The format of the samples in @a src.
+ * @param to The format of the samples to write into @a dest.
+ * @param src The input samples.
+ * @param dest The span into which the output samples are written.
+ * @exception InternalError if the conversion is not supported.
+ */
+void ConvertSamples(SampleFormat from, SampleFormat to, gsl::span<const std::byte> src, gsl::span<std::byte> dest);
+
+/**
+ * Mixes interleaved FLOAT32 samples into others, with a gain per channel.
+ *
+ * Each sample in @a src is multiplied by the gain of its channel, and added
+ * to the sample at the same place in @a dest.  As with ConvertSamples(), this
+ * uses SSE2, AVX2 or NEON kernels where it can (for up to MIX_MAX_CHANNELS
+ * channels), with the same results as the scalar code.  Nothing is clamped,
+ * so loud mixes can go outside [-1, 1].
+ *
+ * * Precondition: @a src and @a dest are the same size, and hold a whole
+ *     number of sample frames of @a gains.size() channels.
+ *
+ * @param src The samples to mix in.
+ * @param dest The samples to mix into.
+ * @param gains The gain of each channel, as a linear multiplier.
+ */
+void MixSamples(gsl::span<const std::byte> src, gsl::span<std::byte> dest, gsl::span<const float> gains);
+
+/// The most channels MixSamples() has vector kernels for.
+constexpr size_t MIX_MAX_CHANNELS = 8;
+
+/**
+ * Applies a linear gain ramp to interleaved samples, in place.
+ *
+ * Sample frame f (counting from 0) is multiplied by @a start + (@a step * f),
+ * so a zero @a step is a constant gain.  Integer samples saturate, rather
+ * than wrapping.  As with MixSamples(), FLOAT32 and SINT16 samples have SSE2
+ * and NEON kernels (for up to MIX_MAX_CHANNELS channels), which give the
+ * same results as the scalar code; SINT32 samples go through doubles, so as
+ * not to lose their low bits.
+ *
+ * * Precondition: @a samples holds a whole number of sample frames.
+ *
+ * @param format The format of the samples.
+ * @param channels The number of channels.
+ * @param samples The samples.
+ * @param start The gain of the first sample frame, as a linear multiplier.
+ * @param step How much the gain changes by from one sample frame to the next.
+ */
+void ApplyGain(SampleFormat format, size_t channels, gsl::span<std::byte> samples, float start, float step);
+
+/**
+ * Finds where the loud part of some FLOAT32 samples starts and ends.
+ *
+ * A sample is loud if its magnitude is above @a level; NaNs never are.  The
+ * scan works in from both ends, and stops each way at the first loud sample
+ * it finds, so quiet stretches cost little and loud ones nothing.  As with
+ * the other kernels, it tests four samples at a time with SSE2 or NEON where
+ * it can.  This works on mono samples, so it doesn't care about channels.
+ *
+ * @param samples The samples.
+ * @param level The level above which samples are loud, full scale at 1.
+ * @return The index of the first loud sample, and one past that of the last;
+ *   both are the number of samples if none are loud.
+ */
+std::pair<size_t, size_t> FindLoud(gsl::span<const float> samples, float level);
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_CONVERT_H
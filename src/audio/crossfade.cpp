@@ -0,0 +1,176 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the CrossfadeSource class.
+ * @see audio/crossfade.h
+ */
+
+#include "crossfade.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "convert.h"
+#include "gain.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/* static */ bool CrossfadeSource::CanMix(const Source &tail, const Source &inner)
+{
+	const auto format = inner.OutputSampleFormat();
+	return tail.SampleRate() == inner.SampleRate() && tail.ChannelCount() == inner.ChannelCount() &&
+	       CanConvert(tail.OutputSampleFormat(), SampleFormat::FLOAT32) &&
+	       CanConvert(format, SampleFormat::FLOAT32) && CanConvert(SampleFormat::FLOAT32, format);
+}
+
+CrossfadeSource::CrossfadeSource(std::unique_ptr<Source> inner, std::unique_ptr<Source> tail,
+                                 std::chrono::microseconds from, std::chrono::microseconds overlap)
+    : Source{inner->Path()},
+      inner{std::move(inner)},
+      tail{std::move(tail)},
+      from{this->tail->SamplesFromMicros(from)},
+      overlap{this->inner->SamplesFromMicros(overlap)},
+      mixed{0},
+      overlap_time{overlap},
+      fade_in{SampleFormat::FLOAT32, this->inner->ChannelCount(), this->inner->SampleRate()},
+      fade_out{SampleFormat::FLOAT32, this->inner->ChannelCount(), this->inner->SampleRate()},
+      unity(this->inner->ChannelCount(), 1.0F)
+{
+	Expects(CanMix(*this->tail, *this->inner));
+	this->Restart();
+}
+
+CrossfadeSource::DecodeSpanResult CrossfadeSource::Decode(gsl::span<std::byte> out)
+{
+	const auto [state, bytes] = this->inner->Decode(out);
+	if (this->mixed < this->overlap && bytes != 0) {
+		const auto bps = this->BytesPerSample();
+		const auto frames = std::min<std::uint64_t>(bytes / bps, this->overlap - this->mixed);
+		this->Mix(out.first(frames * bps));
+	}
+	return std::make_pair(state, bytes);
+}
+
+void CrossfadeSource::Mix(gsl::span<std::byte> samples)
+{
+	const auto frames = samples.size() / this->BytesPerSample();
+	const auto floats = frames * this->ChannelCount() * sizeof(float);
+	const auto raw_bytes = frames * this->tail->BytesPerSample();
+
+	// These only ever grow, and only once or twice, to the sink's size.
+	if (this->tail_raw.size() < raw_bytes) this->tail_raw.resize(raw_bytes);
+	if (this->tail_mix.size() < floats) this->tail_mix.resize(floats);
+	if (this->inner_mix.size() < floats) this->inner_mix.resize(floats);
+
+	const auto raw = gsl::span<std::byte>{this->tail_raw}.first(raw_bytes);
+	std::size_t got = 0;
+	while (got < raw.size()) {
+		const auto [state, count] = this->tail->Decode(raw.subspan(got));
+		got += count;
+		if (state == DecodeState::END_OF_FILE) break;
+	}
+
+	// A tail that runs out early (its length was a guess, say) is silence
+	// from then on.
+	const auto tail_mix = gsl::span<std::byte>{this->tail_mix}.first(floats);
+	const auto tail_floats = (got / this->tail->BytesPerSample()) * this->ChannelCount() * sizeof(float);
+	ConvertSamples(this->tail->OutputSampleFormat(), SampleFormat::FLOAT32, raw.first(got),
+	               tail_mix.first(tail_floats));
+	std::fill(tail_mix.begin() + static_cast<std::ptrdiff_t>(tail_floats), tail_mix.end(), std::byte{0});
+
+	const auto format = this->OutputSampleFormat();
+	const auto inner_mix = gsl::span<std::byte>{this->inner_mix}.first(floats);
+	ConvertSamples(format, SampleFormat::FLOAT32, samples, inner_mix);
+
+	this->fade_in.Apply(inner_mix);
+	this->fade_out.Apply(tail_mix);
+	MixSamples(tail_mix, inner_mix, this->unity);
+	ConvertSamples(SampleFormat::FLOAT32, format, inner_mix, samples);
+
+	this->mixed += frames;
+}
+
+void CrossfadeSource::Restart()
+{
+	this->tail->Seek(this->from);
+	this->mixed = 0;
+
+	// Each pair of jump and fade puts the curve back at its start.
+	this->fade_in.Fade(std::chrono::microseconds{0}, Gain::FLOOR_DB, Gain::Shape::LINEAR);
+	this->fade_in.Fade(this->overlap_time, 0.0, Gain::Shape::EQUAL_POWER);
+	this->fade_out.Fade(std::chrono::microseconds{0}, 0.0, Gain::Shape::LINEAR);
+	this->fade_out.Fade(this->overlap_time, Gain::FLOOR_DB, Gain::Shape::EQUAL_POWER);
+}
+
+std::uint64_t CrossfadeSource::Seek(std::uint64_t position)
+{
+	const auto landed = this->inner->Seek(position);
+	if (landed == 0) {
+		this->Restart();
+		return landed;
+	}
+
+	// Anywhere else plays as the file is, with the crossfade over.
+	this->mixed = this->overlap;
+	this->fade_in.Fade(std::chrono::microseconds{0}, 0.0, Gain::Shape::LINEAR);
+	return landed;
+}
+
+std::uint64_t CrossfadeSource::Length() const
+{
+	return this->inner->Length();
+}
+
+std::uint8_t CrossfadeSource::ChannelCount() const
+{
+	return this->inner->ChannelCount();
+}
+
+std::uint32_t CrossfadeSource::SampleRate() const
+{
+	return this->inner->SampleRate();
+}
+
+SampleFormat CrossfadeSource::OutputSampleFormat() const
+{
+	return this->inner->OutputSampleFormat();
+}
+
+std::optional<CuePoints> CrossfadeSource::Cues() const
+{
+	return this->inner->Cues();
+}
+
+std::optional<StreamStats> CrossfadeSource::Streaming() const
+{
+	return this->inner->Streaming();
+}
+
+std::size_t CrossfadeSource::ScratchBytes() const
+{
+	return this->inner->ScratchBytes() + this->tail->ScratchBytes() + this->unity.capacity() * sizeof(float) +
+	       this->tail_raw.capacity() + this->tail_mix.capacity() + this->inner_mix.capacity();
+}
+
+std::uint64_t CrossfadeSource::SkippedFrames() const
+{
+	// The tail's damage is heard in this source's overlap.
+	return this->inner->SkippedFrames() + this->tail->SkippedFrames();
+}
+
+ConversionList CrossfadeSource::Conversions() const
+{
+	// Only the overlap goes through the mix, so the path is the inner source's.
+	return this->inner->Conversions();
+}
+
+} // namespace Playd::Audio
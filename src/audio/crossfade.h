@@ -0,0 +1,120 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the CrossfadeSource class.
+ * @see audio/crossfade.cpp
+ */
+
+#ifndef PLAYD_AUDIO_CROSSFADE_H
+#define PLAYD_AUDIO_CROSSFADE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "gain.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source that starts with the end of another source mixed in.
+ *
+ * For the first stretch of the source (the overlap), the end of the file
+ * before it--the tail, from a source of its own--is mixed in, fading out as
+ * this one fades in, along equal-power curves.  The mix happens as the source
+ * is decoded, so whatever plays it out sees one stream, and a file played
+ * straight after the tail's file stopped at the start of its overlap sounds
+ * crossfaded into.
+ *
+ * Positions are this source's own, so the overlap counts as the start of
+ * this file.  Seeking anywhere but the start skips the rest of the overlap;
+ * seeking back to the start mixes it in again.
+ */
+class CrossfadeSource : public Source
+{
+public:
+	/**
+	 * Whether a source's tail can be mixed into another.
+	 * The two need the same rate and channel count, and formats that
+	 * convert to and from FLOAT32, in which the mixing is done.
+	 * @param tail The source whose end is mixed in.
+	 * @param inner The source it is mixed into.
+	 * @return Whether CrossfadeSource can mix the two.
+	 */
+	static bool CanMix(const Source &tail, const Source &inner);
+
+	/**
+	 * Constructs a CrossfadeSource, moving the tail to where it starts.
+	 * * Precondition: CanMix(@a *tail, @a *inner).
+	 * @param inner The source being crossfaded into.
+	 * @param tail A source over the file before it.
+	 * @param from Where, in @a tail's time, the overlap starts.
+	 * @param overlap How long the overlap lasts.
+	 */
+	CrossfadeSource(std::unique_ptr<Source> inner, std::unique_ptr<Source> tail, std::chrono::microseconds from,
+	                std::chrono::microseconds overlap);
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	std::optional<CuePoints> Cues() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+private:
+	/**
+	 * Mixes the tail into some of the overlap, moving it and the fades on.
+	 * @param samples Decoded samples of the inner source, all within the
+	 *   overlap.
+	 */
+	void Mix(gsl::span<std::byte> samples);
+
+	/// Restarts the overlap, from the start of the inner source.
+	void Restart();
+
+	std::unique_ptr<Source> inner; ///< The source being crossfaded into.
+	std::unique_ptr<Source> tail;  ///< The source whose end is mixed in.
+	std::uint64_t from;            ///< Where the tail starts, in its samples.
+	std::uint64_t overlap;         ///< How long the overlap is, in samples.
+	std::uint64_t mixed;           ///< How much of the overlap is done, in samples.
+
+	std::chrono::microseconds overlap_time; ///< How long the overlap is.
+	Gain fade_in;                           ///< The inner source's rising curve.
+	Gain fade_out;                          ///< The tail's falling curve.
+	std::vector<float> unity;               ///< A unity gain per channel, for mixing.
+
+	std::vector<std::byte> tail_raw;  ///< The tail, decoded.
+	std::vector<std::byte> tail_mix;  ///< The tail, as FLOAT32.
+	std::vector<std::byte> inner_mix; ///< The inner source, as FLOAT32.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_CROSSFADE_H
@@ -0,0 +1,226 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the DecodeScheduler class.
+ * @see audio/decode_scheduler.h
+ */
+
+#include "decode_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gsl/gsl>
+
+#include "../errors.h"
+#include "rt_thread.h"
+
+namespace Playd::Audio
+{
+/// The index of the worker running on this thread, if any.
+static thread_local std::size_t current_worker = SIZE_MAX;
+
+/// Orders tasks so that the soonest deadline ends up on top of a heap.
+static bool Later(const auto &a, const auto &b)
+{
+	return b.deadline < a.deadline;
+}
+
+DecodeScheduler::DecodeScheduler(std::size_t count, ThreadPolicy policy)
+    : next_poll{Clock::now() + POLL_PERIOD}, policy{std::move(policy)}
+{
+	if (count == 0 && !this->policy.cpus.empty()) count = this->policy.cpus.size();
+	if (count == 0) count = std::max(1U, std::thread::hardware_concurrency());
+
+	this->queues.reserve(count);
+	for (std::size_t i = 0; i < count; i++) this->queues.push_back(std::make_unique<Queue>());
+
+	this->workers.reserve(count);
+	for (std::size_t i = 0; i < count; i++) this->workers.emplace_back(&DecodeScheduler::WorkerLoop, this, i);
+}
+
+DecodeScheduler::~DecodeScheduler()
+{
+	{
+		std::lock_guard guard{this->idle_lock};
+		this->stopping = true;
+	}
+	this->idle.notify_all();
+	for (auto &worker : this->workers) worker.join();
+}
+
+void DecodeScheduler::Add(Job &job)
+{
+	Expects(!job.enrolled);
+
+	{
+		std::lock_guard guard{this->jobs_lock};
+		this->jobs.push_back(&job);
+		job.queued = false;
+		job.enrolled = true;
+	}
+	this->Wake(job, job.Headroom());
+}
+
+void DecodeScheduler::Remove(Job &job)
+{
+	{
+		std::lock_guard guard{this->jobs_lock};
+		job.enrolled = false;
+		std::erase(this->jobs, &job);
+	}
+
+	// Wake() only queues enrolled jobs, and checks under the queue's lock,
+	// so once we've been through every queue, the job can't come back.
+	for (const auto &queue : this->queues) {
+		std::lock_guard guard{queue->lock};
+		auto &heap = queue->heap;
+		const auto end = std::remove_if(heap.begin(), heap.end(), [&](const Task &t) { return t.job == &job; });
+		if (end == heap.end()) continue;
+
+		heap.erase(end, heap.end());
+		std::make_heap(heap.begin(), heap.end(), Later<Task, Task>);
+	}
+
+	// Take() marks jobs as running under the queue lock, so any worker
+	// that got the job before we emptied its queue is counted here.
+	std::unique_lock guard{this->idle_lock};
+	this->idle.wait(guard, [&] { return job.running == 0; });
+}
+
+void DecodeScheduler::Wake(Job &job, std::chrono::microseconds headroom)
+{
+	// A wake during a round asks for another, as the round may already
+	// have missed whatever the wake was about.
+	if (job.queued.exchange(true)) {
+		if (job.running != 0) job.again = true;
+		return;
+	}
+
+	// Wakes on a worker go on its own queue, so that streams woken by
+	// their own decoding stay put; others are spread around.
+	auto index = current_worker;
+	if (this->queues.size() <= index) index = this->next_queue++ % this->queues.size();
+	auto &queue = *this->queues[index];
+
+	{
+		std::lock_guard guard{queue.lock};
+		if (!job.enrolled) {
+			job.queued = false;
+			return;
+		}
+		queue.heap.push_back(Task{Clock::now() + headroom, &job});
+		std::push_heap(queue.heap.begin(), queue.heap.end(), Later<Task, Task>);
+	}
+
+	{
+		std::lock_guard guard{this->idle_lock};
+		this->epoch++;
+	}
+	this->idle.notify_one();
+}
+
+std::size_t DecodeScheduler::WorkerCount() const
+{
+	return this->workers.size();
+}
+
+void DecodeScheduler::WorkerLoop(std::size_t index)
+{
+	current_worker = index;
+
+	try {
+		this->policy.ApplyToThisThread();
+	} catch (ConfigError &e) {
+		Debug() << "scheduler: worker" << index << ":" << e.Message() << std::endl;
+	}
+
+	for (;;) {
+		std::uint64_t seen = 0;
+		{
+			std::lock_guard guard{this->idle_lock};
+			if (this->stopping) return;
+			seen = this->epoch;
+		}
+
+		this->MaybePoll();
+
+		if (auto *job = this->Take(index)) {
+			job->Run();
+			job->queued = false;
+			if (job->again.exchange(false)) this->Wake(*job);
+			{
+				std::lock_guard guard{this->idle_lock};
+				job->running--;
+			}
+			// Someone may be waiting in Remove() for this job.
+			this->idle.notify_all();
+			continue;
+		}
+
+		// Nothing to do; sleep until something is queued, or the next poll.
+		std::unique_lock guard{this->idle_lock};
+		this->idle.wait_for(guard, POLL_PERIOD, [&] { return this->stopping || this->epoch != seen; });
+	}
+}
+
+DecodeScheduler::Job *DecodeScheduler::Take(std::size_t index)
+{
+	const auto count = this->queues.size();
+
+	for (;;) {
+		// Find the queue with the soonest deadline at its head, looking at
+		// our own first so that ties stay local.
+		std::size_t best = count;
+		Clock::time_point best_deadline{};
+		for (std::size_t k = 0; k < count; k++) {
+			const auto i = (index + k) % count;
+			std::lock_guard guard{this->queues[i]->lock};
+			const auto &heap = this->queues[i]->heap;
+			if (heap.empty()) continue;
+			if (best == count || heap.front().deadline < best_deadline) {
+				best = i;
+				best_deadline = heap.front().deadline;
+			}
+		}
+		if (best == count) return nullptr;
+
+		auto &queue = *this->queues[best];
+		std::lock_guard guard{queue.lock};
+		// Another worker may have beaten us to it; if so, look again.
+		if (queue.heap.empty()) continue;
+
+		std::pop_heap(queue.heap.begin(), queue.heap.end(), Later<Task, Task>);
+		auto *job = queue.heap.back().job;
+		queue.heap.pop_back();
+
+		// The job stays marked as queued until its round is over, so no
+		// other worker can take it in the meantime.
+		job->running++;
+		return job;
+	}
+}
+
+void DecodeScheduler::MaybePoll()
+{
+	std::lock_guard guard{this->jobs_lock};
+
+	const auto now = Clock::now();
+	if (now < this->next_poll) return;
+	this->next_poll = now + POLL_PERIOD;
+
+	for (auto *job : this->jobs) {
+		if (!job->queued) this->Wake(*job, job->Headroom());
+	}
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,172 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the DecodeScheduler class.
+ * @see audio/decode_scheduler.cpp
+ */
+
+#ifndef PLAYD_AUDIO_DECODE_SCHEDULER_H
+#define PLAYD_AUDIO_DECODE_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rt_thread.h"
+
+namespace Playd::Audio
+{
+/**
+ * A pool of decoding threads shared between many streams.
+ *
+ * Giving every stream a thread of its own doesn't scale past a few dozen
+ * streams, and leaves the OS to decide which stream decodes next.  Instead,
+ * streams enrol here as jobs, and get woken up when they need decoding; each
+ * wake-up carries a deadline, which is when the stream's sink would run dry.
+ *
+ * Each worker has its own queue, ordered by deadline, which wake-ups from that
+ * worker go onto.  Workers always take the most urgent job they can see: their
+ * own, or, if another worker's queue has a sooner one at its head, that one
+ * (stealing it).  The stream closest to underrunning is thus always decoded
+ * next, however many workers there are.
+ *
+ * Streams with sinks that never wake them up are still polled, every
+ * POLL_PERIOD, with a deadline worked out from how much they have buffered.
+ */
+class DecodeScheduler
+{
+public:
+	/// A stream that can be scheduled for decoding.
+	class Job
+	{
+	public:
+		/// Virtual, empty destructor for Job.
+		virtual ~Job() = default;
+
+		/**
+		 * Works out how long this job's sink can go before running dry.
+		 * This is called from worker threads, and when the job is added.
+		 * @return The time until the sink underruns.
+		 */
+		virtual std::chrono::microseconds Headroom() = 0;
+
+		/**
+		 * Does one round of decoding.
+		 * This is called on a worker thread, and never on two at once.
+		 */
+		virtual void Run() = 0;
+
+	private:
+		friend class DecodeScheduler;
+
+		std::atomic<bool> enrolled{false}; ///< Whether the job is added.
+		std::atomic<bool> queued{false};   ///< Whether queued or running.
+		std::atomic<bool> again{false};    ///< Whether woken while running.
+		std::atomic<int> running{0};       ///< Whether a worker is running it.
+	};
+
+	/// How often jobs are polled, even if nothing wakes them.
+	static constexpr std::chrono::milliseconds POLL_PERIOD{5};
+
+	/**
+	 * Constructs a DecodeScheduler, starting its workers.
+	 * @param workers The number of worker threads, or 0 for one per core
+	 *   (or, if @a policy pins workers to some CPUs, one per CPU).
+	 * @param policy How the worker threads are scheduled; failures to apply
+	 *   it are only logged, so check it first with ThreadPolicy::Check().
+	 */
+	explicit DecodeScheduler(std::size_t workers, ThreadPolicy policy = {});
+
+	/// Destructs a DecodeScheduler, stopping its workers.
+	~DecodeScheduler();
+
+	/// Deleted copy constructor.
+	DecodeScheduler(const DecodeScheduler &) = delete;
+
+	/// Deleted copy-assignment.
+	DecodeScheduler &operator=(const DecodeScheduler &) = delete;
+
+	/**
+	 * Adds a job, and schedules its first round.
+	 * @param job The job, which must stay alive until Remove()d.
+	 */
+	void Add(Job &job);
+
+	/**
+	 * Removes a job.
+	 * If a worker is running the job, this waits for it to finish.
+	 * @param job The job.
+	 */
+	void Remove(Job &job);
+
+	/**
+	 * Schedules a round of a job, if one isn't already scheduled.
+	 * This is safe to call from any thread, including audio callbacks.
+	 * @param job The job.
+	 * @param headroom How long until the job's sink runs dry; the default
+	 *   of zero, for wake-ups from sinks that are running low, is the most
+	 *   urgent.
+	 */
+	void Wake(Job &job, std::chrono::microseconds headroom = {});
+
+	/**
+	 * @return The number of worker threads.
+	 */
+	[[nodiscard]] std::size_t WorkerCount() const;
+
+private:
+	/// The clock deadlines are measured on.
+	using Clock = std::chrono::steady_clock;
+
+	/// A scheduled round of a job.
+	struct Task {
+		Clock::time_point deadline; ///< When the job's sink runs dry.
+		Job *job;                   ///< The job.
+	};
+
+	/// One worker's queue, ordered as a heap with the soonest deadline on top.
+	struct Queue {
+		std::mutex lock;        ///< Guards the heap.
+		std::vector<Task> heap; ///< The scheduled tasks.
+	};
+
+	/// The body of each worker thread.
+	void WorkerLoop(std::size_t index);
+
+	/**
+	 * Takes the most urgent job in any queue, marking it as running.
+	 * @param index The index of the worker taking it.
+	 * @return The job, or nullptr if there is nothing to do.
+	 */
+	Job *Take(std::size_t index);
+
+	/// Polls every job that isn't already queued, if it's time to.
+	void MaybePoll();
+
+	std::vector<std::unique_ptr<Queue>> queues; ///< One queue per worker.
+	std::atomic<std::size_t> next_queue{0};     ///< Where outside wakes go.
+
+	std::mutex jobs_lock;         ///< Guards jobs and next_poll.
+	std::vector<Job *> jobs;      ///< The added jobs.
+	Clock::time_point next_poll;  ///< When jobs are next polled.
+
+	std::mutex idle_lock;         ///< Guards the fields below.
+	std::condition_variable idle; ///< Wakes idle workers, and removers.
+	std::uint64_t epoch{0};       ///< Bumped whenever work is queued.
+	bool stopping{false};         ///< Whether the workers should stop.
+
+	ThreadPolicy policy;              ///< How workers are scheduled.
+	std::vector<std::thread> workers; ///< The worker threads.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_DECODE_SCHEDULER_H
@@ -0,0 +1,103 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the DriftResampler class.
+ * @see audio/drift_resampler.h
+ */
+
+#include "drift_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+DriftResampler::DriftResampler(std::uint8_t channels)
+    : channels{channels}, step{1.0}, history{}, frac{0.0}, consumed{0.0}, produced{0}
+{
+	Expects(0 < channels);
+	this->Reset();
+}
+
+void DriftResampler::SetStep(double new_step)
+{
+	// Past 2, outputs would skip whole input samples without looking.
+	Expects(0.0 < new_step && new_step < 2.0);
+	this->step = new_step;
+}
+
+double DriftResampler::Step() const
+{
+	return this->step;
+}
+
+void DriftResampler::Process(gsl::span<const float> in, std::vector<float> &out)
+{
+	Expects(in.size() % this->channels == 0);
+
+	this->history.insert(this->history.end(), in.begin(), in.end());
+	const auto ch = static_cast<std::size_t>(this->channels);
+	const auto frames = this->history.size() / ch;
+	const auto *h = this->history.data();
+
+	// Each output needs the input sample before it and the two after.
+	std::size_t at = 1;
+	while (at + 2 < frames) {
+		const auto t = static_cast<float>(this->frac);
+		for (std::size_t c = 0; c < ch; c++) {
+			const auto p0 = h[(at - 1) * ch + c];
+			const auto p1 = h[at * ch + c];
+			const auto p2 = h[(at + 1) * ch + c];
+			const auto p3 = h[(at + 2) * ch + c];
+			out.push_back(p1 + 0.5F * t *
+			                           (p2 - p0 +
+			                            t * (2.0F * p0 - 5.0F * p1 + 4.0F * p2 - p3 + t * (3.0F * (p1 - p2) + p3 - p0))));
+		}
+		this->produced++;
+		this->consumed += this->step;
+
+		this->frac += this->step;
+		const auto whole = std::floor(this->frac);
+		at += static_cast<std::size_t>(whole);
+		this->frac -= whole;
+	}
+
+	// Keep the sample before the next output's, and everything after it.
+	const auto drop = std::min(at - 1, frames) * ch;
+	this->history.erase(this->history.begin(), this->history.begin() + static_cast<std::ptrdiff_t>(drop));
+}
+
+void DriftResampler::Reset()
+{
+	// The first output falls exactly on the first input sample, after one
+	// of silence.
+	this->history.assign(this->channels, 0.0F);
+	this->frac = 0.0;
+	this->consumed = 0.0;
+	this->produced = 0;
+}
+
+double DriftResampler::Consumed() const
+{
+	return this->consumed;
+}
+
+std::uint64_t DriftResampler::Produced() const
+{
+	return this->produced;
+}
+
+std::size_t DriftResampler::ScratchBytes() const
+{
+	return this->history.capacity() * sizeof(float);
+}
+
+} // namespace Playd::Audio
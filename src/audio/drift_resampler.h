@@ -0,0 +1,90 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The DriftResampler class.
+ * @see audio/drift_resampler.cpp
+ */
+
+#ifndef PLAYD_AUDIO_DRIFT_RESAMPLER_H
+#define PLAYD_AUDIO_DRIFT_RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+/**
+ * A streaming resampler for packed FLOAT32 audio, whose ratio can change as
+ * it goes, by a little.
+ *
+ * This is for keeping one device in step with another whose clock runs at a
+ * slightly different rate: the ratio is within a fraction of a percent of 1,
+ * and changes every so often, as the devices drift.  Unlike Resampler, whose
+ * filter bank is fixed by the two rates, this interpolates each output sample
+ * with a four-point cubic (Catmull-Rom) spline.  That is cheap, has no latency
+ * to speak of, and is transparent at ratios this close to 1; at a ratio of
+ * exactly 1, it passes its input through untouched.
+ */
+class DriftResampler
+{
+public:
+	/**
+	 * Constructs a DriftResampler, at a ratio of 1.
+	 * @param channels The number of interleaved channels.
+	 */
+	explicit DriftResampler(std::uint8_t channels);
+
+	/**
+	 * Sets how far each output sample moves on through the input.
+	 * * Precondition: @a step is positive.
+	 * @param step The number of input samples per output sample; above 1
+	 *   makes fewer samples than it is given, and below 1 more.
+	 */
+	void SetStep(double step);
+
+	/// @return The number of input samples per output sample.
+	[[nodiscard]] double Step() const;
+
+	/**
+	 * Resamples some input, appending the output to a vector.
+	 * Input that isn't used yet is kept for the next call.
+	 * @param in Packed input samples; must be a whole number of samples.
+	 * @param out The vector to append packed output samples to.
+	 */
+	void Process(gsl::span<const float> in, std::vector<float> &out);
+
+	/// Forgets all input, ready to resample from a new position; the step
+	/// stays as it was.
+	void Reset();
+
+	/**
+	 * How far through the input the output has got, counting from the last
+	 * Reset(): every output sample so far has moved on by its step.
+	 * @return The input position of the next output sample.
+	 */
+	[[nodiscard]] double Consumed() const;
+
+	/// @return The number of samples output since the last Reset().
+	[[nodiscard]] std::uint64_t Produced() const;
+
+	/// @return How much memory the kept input takes up, in bytes.
+	[[nodiscard]] std::size_t ScratchBytes() const;
+
+private:
+	std::uint8_t channels;      ///< Number of interleaved channels.
+	double step;                ///< Input samples per output sample.
+	std::vector<float> history; ///< Input still needed, led by one sample before the next output's.
+	double frac;                ///< Where the next output falls past history's second sample.
+	double consumed;            ///< @see Consumed
+	std::uint64_t produced;     ///< @see Produced
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_DRIFT_RESAMPLER_H
@@ -0,0 +1,108 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Gain class.
+ * @see audio/gain.h
+ */
+
+#include "gain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "convert.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * Converts decibels to a linear multiplier.
+ * @param db The gain, in dB.
+ * @return The gain, as a multiplier.
+ */
+static double FromDb(double db)
+{
+	return std::pow(10.0, db / 20.0);
+}
+
+Gain::Gain(SampleFormat format, std::uint8_t channels, std::uint32_t rate)
+    : format{format},
+      channels{channels},
+      bytes_per_frame{sample_format_bps[static_cast<std::size_t>(format)] * channels},
+      rate{rate},
+      shape{Shape::LINEAR},
+      from{1.0},
+      to{1.0},
+      fade_frames{0},
+      fade_done{0}
+{
+	Expects(0 < channels);
+}
+
+void Gain::Fade(std::chrono::microseconds duration, double db, Shape new_shape)
+{
+	Expects(!std::isnan(db) && db <= MAX_DB);
+	Expects(duration.count() >= 0);
+
+	this->from = this->Level();
+	this->to = db <= FLOOR_DB ? 0.0 : FromDb(db);
+	this->shape = new_shape;
+	this->fade_frames = static_cast<std::uint64_t>(duration.count()) * this->rate / 1000000;
+	this->fade_done = 0;
+}
+
+void Gain::Apply(gsl::span<std::byte> samples)
+{
+	Expects(samples.size() % this->bytes_per_frame == 0);
+
+	while (this->fade_done < this->fade_frames && !samples.empty()) {
+		const auto frames = std::min({RAMP_BLOCK, this->fade_frames - this->fade_done,
+		                              static_cast<std::uint64_t>(samples.size() / this->bytes_per_frame)});
+		const auto start = this->LevelAt(this->fade_done);
+		const auto end = this->LevelAt(this->fade_done + frames);
+		const auto bytes = frames * this->bytes_per_frame;
+		ApplyGain(this->format, this->channels, samples.first(bytes), static_cast<float>(start),
+		          static_cast<float>((end - start) / static_cast<double>(frames)));
+
+		this->fade_done += frames;
+		samples = samples.subspan(bytes);
+	}
+
+	// This is the pass-through case, which is most of the time.
+	if (samples.empty() || this->to == 1.0) return;
+	ApplyGain(this->format, this->channels, samples, static_cast<float>(this->to), 0.0F);
+}
+
+double Gain::Level() const
+{
+	return this->LevelAt(this->fade_done);
+}
+
+double Gain::LevelAt(std::uint64_t frame) const
+{
+	if (this->fade_frames <= frame) return this->to;
+	const auto t = static_cast<double>(frame) / static_cast<double>(this->fade_frames);
+
+	if (this->shape == Shape::LINEAR) return this->from + ((this->to - this->from) * t);
+
+	// A fade out along this curve and a fade in along its mirror image
+	// always add up to the power of either alone.
+	if (this->shape == Shape::EQUAL_POWER) {
+		const auto from_power = this->from * this->from;
+		return std::sqrt(from_power + ((this->to * this->to - from_power) * t));
+	}
+
+	// Silence is -inf dB, which we can't fade through, so logarithmic
+	// fades go to and from FLOOR_DB instead.
+	const auto floor = FromDb(FLOOR_DB);
+	const auto from_db = this->from <= floor ? FLOOR_DB : 20.0 * std::log10(this->from);
+	const auto to_db = this->to <= floor ? FLOOR_DB : 20.0 * std::log10(this->to);
+	return FromDb(from_db + ((to_db - from_db) * t));
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,110 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Gain class.
+ * @see audio/gain.cpp
+ */
+
+#ifndef PLAYD_AUDIO_GAIN_H
+#define PLAYD_AUDIO_GAIN_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * A gain stage, which fades samples from one level to another.
+ *
+ * Fades are sample-accurate: they start on the next sample frame through
+ * Apply(), and take exactly as many frames as their duration does at the
+ * audio's sample rate.  Ramps are worked out in blocks of RAMP_BLOCK frames,
+ * each a straight line between the exact levels at its ends, which ApplyGain()
+ * then applies in vector kernels.
+ *
+ * At unity gain, with no fade going, Apply() doesn't touch the samples at
+ * all.  Gains aren't thread-safe; BasicAudio applies them under its decoding
+ * lock.
+ */
+class Gain
+{
+public:
+	/// The shapes a fade can take.
+	enum class Shape : std::uint8_t {
+		LINEAR,     ///< Straight from one amplitude to the other.
+		LOG,        ///< Straight from one level in decibels to the other.
+		EQUAL_POWER ///< Straight from one power to the other, as in crossfades.
+	};
+
+	/// The loudest gain allowed, in dB.
+	static constexpr double MAX_DB = 24.0;
+
+	/// Where logarithmic fades start from (or end at) for silence, in dB.
+	static constexpr double FLOOR_DB = -96.0;
+
+	/**
+	 * Constructs a Gain, at unity.
+	 * @param format The format of the samples.
+	 * @param channels The number of channels.
+	 * @param rate The sample rate, in Hz.
+	 */
+	Gain(SampleFormat format, std::uint8_t channels, std::uint32_t rate);
+
+	/**
+	 * Starts fading from the current level to another.
+	 * Any fade already going stops where it is, and this one starts from
+	 * there.  Gains of FLOOR_DB or below are silence.
+	 * * Precondition: @a db is at most MAX_DB, and isn't NaN.
+	 * @param duration How long the fade takes; zero is a jump.
+	 * @param db The level to fade to, in dB (0 is unity).
+	 * @param shape The shape of the fade.
+	 */
+	void Fade(std::chrono::microseconds duration, double db, Shape shape);
+
+	/**
+	 * Applies the gain to samples, in place, moving any fade on.
+	 * * Precondition: @a samples holds a whole number of sample frames.
+	 * @param samples The samples, in the Gain's format.
+	 */
+	void Apply(gsl::span<std::byte> samples);
+
+	/**
+	 * The level at the next sample frame.
+	 * @return The level, as a linear multiplier.
+	 */
+	[[nodiscard]] double Level() const;
+
+private:
+	/// The most sample frames a ramp is worked out for at once.
+	static constexpr std::uint64_t RAMP_BLOCK = 32;
+
+	/**
+	 * Works out the level at some point in the current fade.
+	 * @param frame How many frames into the fade.
+	 * @return The level, as a linear multiplier.
+	 */
+	[[nodiscard]] double LevelAt(std::uint64_t frame) const;
+
+	SampleFormat format;         ///< The format of the samples.
+	std::uint8_t channels;       ///< The number of channels.
+	std::size_t bytes_per_frame; ///< Bytes in one sample frame.
+	std::uint32_t rate;          ///< The sample rate, in Hz.
+
+	Shape shape;               ///< The shape of the current fade.
+	double from;               ///< The level the fade started at.
+	double to;                 ///< The level the fade ends at.
+	std::uint64_t fade_frames; ///< How long the fade is, in frames.
+	std::uint64_t fade_done;   ///< How far through the fade we are.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_GAIN_H
@@ -0,0 +1,639 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the HttpStream class.
+ * @see audio/http_stream.h
+ */
+
+#include "http_stream.h"
+
+#include <uv.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "../errors.h"
+#include "../messages.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/// One attempt at fetching the file, from resolving its host to its last
+/// byte.  Each is freed once libuv has let go of all its handles.
+struct HttpStream::Connection {
+	HttpStream *stream;      ///< The stream this is fetching for.
+	Url url;                 ///< The URL being fetched.
+	std::uint64_t offset;    ///< Where in the file this asked to start.
+	int redirects;           ///< How many redirects led here.
+	std::uint64_t generation; ///< The restart this belongs to.
+
+	uv_getaddrinfo_t resolver; ///< Resolves the host.
+	uv_connect_t connector;    ///< Connects to the host.
+	uv_tcp_t tcp;              ///< The connection itself.
+	uv_write_t writer;         ///< Writes the request.
+
+	std::string request;   ///< The request, kept alive until written.
+	std::string head;      ///< The response head, as it arrives.
+	bool in_body;          ///< Whether the head has all arrived.
+	std::uint64_t skip;    ///< Body bytes to throw away before the offset.
+	bool resolving;        ///< Whether resolver is still working.
+	bool tcp_open;         ///< Whether tcp needs closing.
+	bool stale;            ///< Whether this has been dropped.
+
+	std::array<char, READ_BYTES> read_buf; ///< Where libuv reads into.
+};
+
+//
+// Parsing
+//
+
+/// @return s, without whitespace at either end.
+static std::string_view Trim(std::string_view s)
+{
+	const auto space = [](char c) { return c == ' ' || c == '\t'; };
+	while (!s.empty() && space(s.front())) s.remove_prefix(1);
+	while (!s.empty() && space(s.back())) s.remove_suffix(1);
+	return s;
+}
+
+/// @return Whether a and b are equal, ignoring the case of letters.
+static bool EqualsIgnoringCase(std::string_view a, std::string_view b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+		       return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+	       });
+}
+
+/// @return The unsigned number s is all of, if it is one.
+static std::optional<std::uint64_t> ParseNumber(std::string_view s)
+{
+	std::uint64_t n = 0;
+	const auto [end, err] = std::from_chars(s.data(), s.data() + s.size(), n);
+	if (s.empty() || err != std::errc{} || end != s.data() + s.size()) return std::nullopt;
+	return n;
+}
+
+/* static */ HttpStream::Url HttpStream::ParseUrl(std::string_view url)
+{
+	const auto bad = [url](std::string_view why) { return FileError("http: " + std::string{why} + ": " + std::string{url}); };
+
+	const auto colon = url.find("://");
+	if (colon == std::string_view::npos) throw bad("not a URL");
+	const auto scheme = url.substr(0, colon);
+	if (EqualsIgnoringCase(scheme, "https")) throw bad("https isn't supported, as playd has no TLS");
+	if (!EqualsIgnoringCase(scheme, "http")) throw bad("not an http:// URL");
+
+	auto rest = url.substr(colon + 3);
+	rest = rest.substr(0, rest.find('#'));
+	const auto slash = rest.find_first_of("/?");
+	auto authority = rest.substr(0, slash);
+	std::string target{slash == std::string_view::npos ? "" : rest.substr(slash)};
+	if (target.empty() || target.front() == '?') target.insert(0, "/");
+	if (authority.find('@') != std::string_view::npos) throw bad("user names aren't supported");
+
+	// IPv6 addresses are bracketed, as they have colons of their own.
+	std::string_view host = authority;
+	std::string_view port;
+	if (!authority.empty() && authority.front() == '[') {
+		const auto close = authority.find(']');
+		if (close == std::string_view::npos) throw bad("unclosed '['");
+		host = authority.substr(1, close - 1);
+		const auto after = authority.substr(close + 1);
+		if (!after.empty()) {
+			if (after.front() != ':') throw bad("junk after ']'");
+			port = after.substr(1);
+		}
+	} else if (const auto pc = authority.rfind(':'); pc != std::string_view::npos) {
+		host = authority.substr(0, pc);
+		port = authority.substr(pc + 1);
+	}
+	if (host.empty()) throw bad("no host");
+
+	std::uint16_t port_num = 80;
+	if (!port.empty()) {
+		const auto n = ParseNumber(port);
+		if (!n || *n == 0 || UINT16_MAX < *n) throw bad("bad port");
+		port_num = static_cast<std::uint16_t>(*n);
+	}
+
+	return {std::string{host}, port_num, target};
+}
+
+/* static */ std::optional<HttpStream::Head> HttpStream::ParseHead(std::string_view head)
+{
+	// Lines should end in CRLF, but some servers only send LF.
+	const auto next_line = [&head]() {
+		const auto end = head.find('\n');
+		auto line = head.substr(0, end);
+		head = end == std::string_view::npos ? std::string_view{} : head.substr(end + 1);
+		if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+		return line;
+	};
+
+	auto status_line = next_line();
+	if (status_line.substr(0, 5) != "HTTP/" && status_line.substr(0, 4) != "ICY ") return std::nullopt;
+	const auto sp = status_line.find(' ');
+	const auto code = ParseNumber(status_line.substr(sp + 1, 3));
+	if (!code || 999 < *code) return std::nullopt;
+
+	// Partial content means the server takes ranges, whatever else it says.
+	Head result{static_cast<int>(*code), std::nullopt, 0, *code == 206, std::nullopt};
+	std::optional<std::uint64_t> length;
+	std::optional<std::uint64_t> total;
+
+	while (!head.empty()) {
+		const auto line = next_line();
+		const auto hc = line.find(':');
+		if (hc == std::string_view::npos) continue;
+		const auto name = Trim(line.substr(0, hc));
+		const auto value = Trim(line.substr(hc + 1));
+
+		if (EqualsIgnoringCase(name, "Content-Length")) {
+			length = ParseNumber(value);
+		} else if (EqualsIgnoringCase(name, "Accept-Ranges")) {
+			result.ranges = result.ranges || EqualsIgnoringCase(value, "bytes");
+		} else if (EqualsIgnoringCase(name, "Location")) {
+			result.location = std::string{value};
+		} else if (EqualsIgnoringCase(name, "Content-Range")) {
+			// bytes FIRST-LAST/TOTAL, where TOTAL may be '*'.
+			if (!EqualsIgnoringCase(value.substr(0, 6), "bytes ")) return std::nullopt;
+			const auto range = value.substr(6);
+			const auto dash = range.find('-');
+			const auto over = range.find('/');
+			if (dash == std::string_view::npos || over == std::string_view::npos || over < dash) {
+				return std::nullopt;
+			}
+			const auto first = ParseNumber(range.substr(0, dash));
+			if (!first) return std::nullopt;
+			result.offset = *first;
+			total = ParseNumber(range.substr(over + 1));
+		}
+	}
+
+	// A partial body's length is only part of the file's.
+	result.size = result.status == 206 ? total : length;
+	return result;
+}
+
+//
+// HttpStream
+//
+
+HttpStream::HttpStream(std::string_view url, std::size_t capacity)
+    : url{ParseUrl(url)},
+      capacity{std::max(capacity, READ_BYTES)},
+      loop{},
+      wake{},
+      current{nullptr},
+      buffer(this->capacity),
+      start{0},
+      count{0},
+      stopping{false},
+      generation{0},
+      paused{false},
+      ended{false},
+      seekable{false},
+      primed{false},
+      stats{}
+{
+	uv_loop_init(&this->loop);
+	uv_async_init(&this->loop, &this->wake, [](uv_async_t *handle) { static_cast<HttpStream *>(handle->data)->OnWake(); });
+	this->wake.data = this;
+
+	// The loop isn't running yet, so this can start it off from here.
+	this->Begin(this->url, 0, 0);
+	this->thread = std::thread(&HttpStream::Run, this);
+}
+
+HttpStream::~HttpStream()
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->stopping = true;
+	}
+	uv_async_send(&this->wake);
+	this->thread.join();
+	uv_loop_close(&this->loop);
+}
+
+std::size_t HttpStream::Read(gsl::span<std::byte> out)
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	this->ThrowIfFailed();
+
+	const auto n = std::min(static_cast<std::size_t>(out.size()), this->count);
+	const auto first = std::min(n, this->capacity - this->start);
+	std::copy_n(this->buffer.begin() + static_cast<std::ptrdiff_t>(this->start), first, out.begin());
+	std::copy_n(this->buffer.begin(), n - first, out.begin() + static_cast<std::ptrdiff_t>(first));
+	this->start = (this->start + n) % this->capacity;
+	this->count -= n;
+
+	// Running dry before anything has arrived is just starting up.
+	if (n == 0 && this->primed && !this->ended && !this->dry_since) {
+		this->stats.underruns++;
+		this->dry_since = std::chrono::steady_clock::now();
+	}
+
+	// Fetching resumes at half full, rather than a read's worth at a time.
+	if (this->paused && this->count <= this->capacity / 2) uv_async_send(&this->wake);
+	return n;
+}
+
+bool HttpStream::WaitForData(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> guard{this->lock};
+	this->arrived.wait_for(guard, timeout, [this] { return 0 < this->count || this->ended || this->error; });
+	this->ThrowIfFailed();
+	return 0 < this->count;
+}
+
+void HttpStream::Restart(std::uint64_t offset)
+{
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		this->start = this->count = 0;
+		this->restart = offset;
+		this->generation++;
+		this->paused = this->ended = this->primed = false;
+		this->error.reset();
+		this->dry_since.reset();
+	}
+	uv_async_send(&this->wake);
+}
+
+bool HttpStream::Ended() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->ended && this->count == 0;
+}
+
+std::optional<std::uint64_t> HttpStream::Size() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->file_size;
+}
+
+bool HttpStream::Seekable() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	return this->seekable;
+}
+
+StreamStats HttpStream::Stats() const
+{
+	std::lock_guard<std::mutex> guard{this->lock};
+	auto stats = this->stats;
+	stats.buffered_bytes = this->count;
+	if (this->dry_since) {
+		const auto stall = std::chrono::steady_clock::now() - *this->dry_since;
+		stats.stall_us += std::chrono::duration_cast<std::chrono::microseconds>(stall).count();
+	}
+	return stats;
+}
+
+std::size_t HttpStream::Capacity() const
+{
+	return this->capacity;
+}
+
+void HttpStream::ThrowIfFailed() const
+{
+	if (this->error && this->count == 0) throw FileError(*this->error);
+}
+
+void HttpStream::Run()
+{
+	uv_run(&this->loop, UV_RUN_DEFAULT);
+}
+
+void HttpStream::OnWake()
+{
+	std::unique_lock<std::mutex> guard{this->lock};
+
+	if (this->stopping) {
+		guard.unlock();
+		if (this->current != nullptr) this->Drop(this->current);
+		// With the last handle closed, Run() returns.
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->wake), nullptr);
+		return;
+	}
+
+	if (this->restart) {
+		const auto offset = *this->restart;
+		this->restart.reset();
+		guard.unlock();
+		this->Begin(this->url, offset, 0);
+		return;
+	}
+
+	if (this->paused && this->count <= this->capacity / 2 && this->current != nullptr) {
+		this->paused = false;
+		uv_read_start(reinterpret_cast<uv_stream_t *>(&this->current->tcp), &OnAlloc, &OnRead);
+	}
+}
+
+void HttpStream::Begin(const Url &target, std::uint64_t offset, int redirects)
+{
+	if (this->current != nullptr) this->Drop(this->current);
+
+	auto *conn = new Connection{};
+	conn->stream = this;
+	conn->url = target;
+	conn->offset = offset;
+	conn->redirects = redirects;
+	conn->resolver.data = conn;
+	conn->connector.data = conn;
+	conn->tcp.data = conn;
+	conn->writer.data = conn;
+	this->current = conn;
+
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		conn->generation = this->generation;
+		this->stats.requests++;
+	}
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	const auto port = std::to_string(target.port);
+	conn->resolving = true;
+	if (const auto err = uv_getaddrinfo(&this->loop, &conn->resolver, &OnResolved, conn->url.host.c_str(),
+	                                    port.c_str(), &hints);
+	    err != 0) {
+		conn->resolving = false;
+		this->Fail(conn, std::string{"can't resolve "} + conn->url.host + ": " + uv_strerror(err));
+	}
+}
+
+void HttpStream::Drop(Connection *conn)
+{
+	if (this->current == conn) this->current = nullptr;
+	if (conn->stale) return;
+	conn->stale = true;
+
+	if (conn->resolving) uv_cancel(reinterpret_cast<uv_req_t *>(&conn->resolver));
+	// Closing cancels any connect or write still going.
+	if (conn->tcp_open) uv_close(reinterpret_cast<uv_handle_t *>(&conn->tcp), &OnClosed);
+	Release(conn);
+}
+
+void HttpStream::Fail(Connection *conn, const std::string &message)
+{
+	Debug() << "http:" << message << std::endl;
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (conn->generation == this->generation) {
+			this->error = "http: " + message;
+			this->arrived.notify_all();
+		}
+	}
+	this->Drop(conn);
+}
+
+void HttpStream::Finish(Connection *conn)
+{
+	if (!conn->in_body) {
+		this->Fail(conn, conn->url.host + " closed before responding");
+		return;
+	}
+
+	// Without chunking or lengths to go by, the end of the connection is
+	// the end of the file.
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (conn->generation == this->generation) {
+			this->ended = true;
+			this->arrived.notify_all();
+		}
+	}
+	this->Drop(conn);
+}
+
+std::size_t HttpStream::ReadSpace(const Connection &conn) const
+{
+	// Heads and skipped bytes don't go into the buffer.
+	if (!conn.in_body || conn.skip != 0) return READ_BYTES;
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	return std::min(READ_BYTES, this->capacity - this->count);
+}
+
+void HttpStream::Receive(Connection *conn, std::string_view bytes)
+{
+	if (conn->in_body) {
+		this->Deliver(conn, bytes);
+		return;
+	}
+
+	conn->head.append(bytes);
+	const auto end = conn->head.find("\r\n\r\n");
+	if (end == std::string::npos) {
+		if (MAX_HEAD_BYTES < conn->head.size()) this->Fail(conn, "response head too long");
+		return;
+	}
+
+	const auto head = ParseHead(std::string_view{conn->head}.substr(0, end));
+	if (!head) {
+		this->Fail(conn, "malformed response from " + conn->url.host);
+		return;
+	}
+
+	if (head->location && 300 <= head->status && head->status < 400) {
+		if (MAX_REDIRECTS <= conn->redirects) {
+			this->Fail(conn, "too many redirects");
+			return;
+		}
+		auto next = conn->url;
+		try {
+			if (head->location->front() == '/') {
+				next.target = *head->location;
+			} else {
+				next = ParseUrl(*head->location);
+			}
+		} catch (const FileError &) {
+			this->Fail(conn, "can't follow redirect to " + *head->location);
+			return;
+		}
+		// Restarts go straight to where this ends up.
+		this->url = next;
+		this->Begin(next, conn->offset, conn->redirects + 1);
+		return;
+	}
+
+	// Asking for a range at (or past) the end of the file gets 416.
+	if (head->status == 416) {
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (conn->generation == this->generation) {
+			this->ended = true;
+			this->arrived.notify_all();
+		}
+		this->Drop(conn);
+		return;
+	}
+
+	// Servers that can't do ranges send the whole file, so the start of it
+	// has to be thrown away.
+	if (head->status == 200) {
+		conn->skip = conn->offset;
+	} else if (head->status == 206 && head->offset <= conn->offset) {
+		conn->skip = conn->offset - head->offset;
+	} else {
+		this->Fail(conn, "status " + std::to_string(head->status) + " from " + conn->url.host);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard{this->lock};
+		if (head->size) this->file_size = head->size;
+		this->seekable = head->ranges;
+	}
+
+	conn->in_body = true;
+	const auto body = conn->head.substr(end + 4);
+	conn->head.clear();
+	this->Deliver(conn, body);
+}
+
+void HttpStream::Deliver(Connection *conn, std::string_view bytes)
+{
+	const auto skipped = std::min<std::uint64_t>(conn->skip, bytes.size());
+	conn->skip -= skipped;
+	bytes.remove_prefix(skipped);
+	if (bytes.empty()) return;
+
+	std::lock_guard<std::mutex> guard{this->lock};
+	if (conn->generation != this->generation) return;
+
+	// OnAlloc keeps reads within the free space, and only the end of
+	// the first read can arrive any other way, into an empty buffer.
+	const auto n = std::min(bytes.size(), this->capacity - this->count);
+	const auto end = (this->start + this->count) % this->capacity;
+	const auto first = std::min(n, this->capacity - end);
+	const auto *in = reinterpret_cast<const std::byte *>(bytes.data());
+	std::copy_n(in, first, this->buffer.begin() + static_cast<std::ptrdiff_t>(end));
+	std::copy_n(in + first, n - first, this->buffer.begin());
+	this->count += n;
+
+	this->primed = true;
+	if (this->dry_since) {
+		const auto stall = std::chrono::steady_clock::now() - *this->dry_since;
+		this->stats.stall_us += std::chrono::duration_cast<std::chrono::microseconds>(stall).count();
+		this->dry_since.reset();
+	}
+
+	if (this->count == this->capacity) {
+		uv_read_stop(reinterpret_cast<uv_stream_t *>(&conn->tcp));
+		this->paused = true;
+	}
+	this->arrived.notify_all();
+}
+
+//
+// libuv callbacks
+//
+
+/* static */ void HttpStream::Release(Connection *conn)
+{
+	if (conn->stale && !conn->resolving && !conn->tcp_open) delete conn;
+}
+
+/* static */ void HttpStream::OnResolved(uv_getaddrinfo_t *req, int status, struct addrinfo *res)
+{
+	auto *conn = static_cast<Connection *>(req->data);
+	conn->resolving = false;
+	const auto free_res = gsl::finally([res] { uv_freeaddrinfo(res); });
+
+	if (conn->stale) {
+		Release(conn);
+		return;
+	}
+	if (status < 0) {
+		conn->stream->Fail(conn, "can't resolve " + conn->url.host + ": " + uv_strerror(status));
+		return;
+	}
+
+	uv_tcp_init(req->loop, &conn->tcp);
+	conn->tcp_open = true;
+	if (const auto err = uv_tcp_connect(&conn->connector, &conn->tcp, res->ai_addr, &OnConnected); err != 0) {
+		conn->stream->Fail(conn, "can't connect to " + conn->url.host + ": " + uv_strerror(err));
+	}
+}
+
+/* static */ void HttpStream::OnConnected(uv_connect_t *req, int status)
+{
+	auto *conn = static_cast<Connection *>(req->data);
+	if (conn->stale) return;
+	if (status < 0) {
+		conn->stream->Fail(conn, "can't connect to " + conn->url.host + ": " + uv_strerror(status));
+		return;
+	}
+
+	// HTTP/1.0, so that bodies are never chunked.  Asking for a range even
+	// from the start gets servers that can seek to say so.
+	const auto &url = conn->url;
+	const auto host = url.host.find(':') == std::string::npos ? url.host : "[" + url.host + "]";
+	conn->request = "GET " + url.target + " HTTP/1.0\r\nHost: " + host +
+	                (url.port == 80 ? "" : ":" + std::to_string(url.port)) + "\r\nUser-Agent: playd/" PD_VERSION
+	                "\r\nRange: bytes=" + std::to_string(conn->offset) + "-\r\nConnection: close\r\n\r\n";
+
+	auto buf = uv_buf_init(conn->request.data(), static_cast<unsigned int>(conn->request.size()));
+	auto *stream = reinterpret_cast<uv_stream_t *>(&conn->tcp);
+	if (const auto err = uv_write(&conn->writer, stream, &buf, 1, &OnWritten); err != 0) {
+		conn->stream->Fail(conn, std::string{"can't send request: "} + uv_strerror(err));
+		return;
+	}
+	uv_read_start(stream, &OnAlloc, &OnRead);
+}
+
+/* static */ void HttpStream::OnWritten(uv_write_t *req, int status)
+{
+	auto *conn = static_cast<Connection *>(req->data);
+	if (conn->stale || 0 <= status) return;
+	conn->stream->Fail(conn, std::string{"can't send request: "} + uv_strerror(status));
+}
+
+/* static */ void HttpStream::OnAlloc(uv_handle_t *handle, size_t, uv_buf_t *buf)
+{
+	auto *conn = static_cast<Connection *>(handle->data);
+	buf->base = conn->read_buf.data();
+	buf->len = static_cast<decltype(buf->len)>(conn->stream->ReadSpace(*conn));
+}
+
+/* static */ void HttpStream::OnRead(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
+{
+	auto *conn = static_cast<Connection *>(handle->data);
+	if (conn->stale) return;
+
+	if (nread == UV_EOF) {
+		conn->stream->Finish(conn);
+	} else if (nread == UV_ENOBUFS) {
+		// OnAlloc found the buffer full; Deliver() should have stopped us.
+		uv_read_stop(handle);
+	} else if (nread < 0) {
+		conn->stream->Fail(conn, std::string{"can't read: "} + uv_strerror(static_cast<int>(nread)));
+	} else {
+		conn->stream->Receive(conn, std::string_view{buf->base, static_cast<std::size_t>(nread)});
+	}
+}
+
+/* static */ void HttpStream::OnClosed(uv_handle_t *handle)
+{
+	auto *conn = static_cast<Connection *>(handle->data);
+	conn->tcp_open = false;
+	Release(conn);
+}
+
+} // namespace Playd::Audio
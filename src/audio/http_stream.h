@@ -0,0 +1,264 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the HttpStream class.
+ * @see audio/http_stream.cpp
+ */
+
+#ifndef PLAYD_AUDIO_HTTP_STREAM_H
+#define PLAYD_AUDIO_HTTP_STREAM_H
+
+#include <uv.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A file fetched over HTTP, read through a bounded prefetch buffer.
+ *
+ * This is the network's half of a streaming source, as MappedFile is the
+ * disk's: it fetches the file into a buffer on its own thread and libuv
+ * loop, and the decoder reads out of the buffer.  The buffer's size bounds
+ * how far ahead of the decoder the fetching gets, and so (for live streams,
+ * such as Icecast's) how far behind live playback runs; once it's full,
+ * fetching stops until the decoder catches up, and TCP holds the server
+ * back.
+ *
+ * Every request asks for a range of the file, so that servers that can
+ * seek say so; seeking makes a new request from the new offset.  Redirects
+ * are followed.  Only plain HTTP is supported, as playd links no TLS
+ * library.
+ */
+class HttpStream
+{
+public:
+	/// The parts of an http:// URL needed to fetch it.
+	struct Url {
+		std::string host;   ///< The host name or address, without brackets.
+		std::uint16_t port; ///< The port.
+		std::string target; ///< The path and query, starting with '/'.
+	};
+
+	/// What the head of a response says about the body.
+	struct Head {
+		int status;                          ///< The status code.
+		std::optional<std::uint64_t> size;   ///< The size of the whole file, if known.
+		std::uint64_t offset;                ///< Where in the file the body starts.
+		bool ranges;                         ///< Whether the server takes range requests.
+		std::optional<std::string> location; ///< Where a redirect points.
+	};
+
+	/// The most redirects followed for one request.
+	static constexpr int MAX_REDIRECTS = 5;
+
+	/// The longest response head accepted, in bytes.
+	static constexpr std::size_t MAX_HEAD_BYTES = 16384;
+
+	/// The most read from the socket at a time, and so the least the
+	/// buffer can hold.
+	static constexpr std::size_t READ_BYTES = 16384;
+
+	/**
+	 * Parses an http:// URL.
+	 * @param url The URL.
+	 * @return The parsed URL.
+	 * @exception FileError if the URL isn't a well-formed http:// URL.
+	 */
+	static Url ParseUrl(std::string_view url);
+
+	/**
+	 * Parses the head of a response, minus its final blank line.
+	 * Icecast's (and Shoutcast's) 'ICY' status lines count as HTTP ones.
+	 * @param head The head.
+	 * @return The parsed head, or nothing if it's malformed.
+	 */
+	static std::optional<Head> ParseHead(std::string_view head);
+
+	/**
+	 * Starts fetching a file.
+	 * This returns straight away; use WaitForData() to wait for the start
+	 * of the file.
+	 * @param url The file's http:// URL.
+	 * @param capacity The size of the prefetch buffer, in bytes.
+	 * @exception FileError if the URL isn't a well-formed http:// URL.
+	 */
+	HttpStream(std::string_view url, std::size_t capacity);
+
+	/// Destructs an HttpStream, stopping the fetch.
+	~HttpStream();
+
+	/// Deleted copy constructor.
+	HttpStream(const HttpStream &) = delete;
+
+	/// Deleted copy-assignment.
+	HttpStream &operator=(const HttpStream &) = delete;
+
+	/**
+	 * Takes what bytes have been fetched, without waiting for more.
+	 * @param out Where to put the bytes.
+	 * @return The number of bytes taken, which is 0 if none have been
+	 *   fetched (or the file has ended).
+	 * @exception FileError if the fetch failed, and nothing is left of it.
+	 */
+	std::size_t Read(gsl::span<std::byte> out);
+
+	/**
+	 * Waits until there are bytes to read, or the fetch has ended.
+	 * @param timeout The longest to wait.
+	 * @return Whether there are bytes to read.
+	 * @exception FileError if the fetch failed, and nothing is left of it.
+	 */
+	bool WaitForData(std::chrono::milliseconds timeout);
+
+	/**
+	 * Throws away anything fetched, and fetches again from an offset.
+	 * @param offset The offset into the file, in bytes.
+	 */
+	void Restart(std::uint64_t offset);
+
+	/// @return Whether the whole file has been fetched and read.
+	[[nodiscard]] bool Ended() const;
+
+	/// @return The size of the file, if the server has said yet.
+	[[nodiscard]] std::optional<std::uint64_t> Size() const;
+
+	/// @return Whether the server has said it takes range requests.
+	[[nodiscard]] bool Seekable() const;
+
+	/// @return Statistics for the fetch so far.
+	[[nodiscard]] StreamStats Stats() const;
+
+	/// @return The size of the prefetch buffer, in bytes.
+	[[nodiscard]] std::size_t Capacity() const;
+
+private:
+	struct Connection;
+
+	/// Runs the loop until the stream is stopped; this is the thread's body.
+	void Run();
+
+	/// Handles a wake-up from another thread: a restart, resume or stop.
+	void OnWake();
+
+	/**
+	 * Starts a request, dropping whatever request was going.
+	 * This runs on the loop thread.
+	 * @param url The URL to fetch.
+	 * @param offset Where in the file to start.
+	 * @param redirects How many redirects led here.
+	 */
+	void Begin(const Url &url, std::uint64_t offset, int redirects);
+
+	/**
+	 * Closes a request's connection, and frees it once libuv is done.
+	 * @param conn The request.
+	 */
+	void Drop(Connection *conn);
+
+	/**
+	 * Handles bytes arriving on a request's connection.
+	 * @param conn The request.
+	 * @param bytes The bytes.
+	 */
+	void Receive(Connection *conn, std::string_view bytes);
+
+	/**
+	 * Puts body bytes into the buffer, and stops reading if it's full.
+	 * @param conn The request.
+	 * @param bytes The bytes.
+	 */
+	void Deliver(Connection *conn, std::string_view bytes);
+
+	/**
+	 * Ends the fetch, as a request's connection has closed.
+	 * @param conn The request, which is dropped.
+	 */
+	void Finish(Connection *conn);
+
+	/**
+	 * Fails the fetch.
+	 * @param conn The request that failed, which is dropped.
+	 * @param message What went wrong.
+	 */
+	void Fail(Connection *conn, const std::string &message);
+
+	/**
+	 * Works out how much the next read from the socket can take.
+	 * @param conn The request.
+	 * @return The number of bytes, which is 0 if the buffer is full.
+	 */
+	std::size_t ReadSpace(const Connection &conn) const;
+
+	/// Throws the fetch's error, if it has one and nothing is left to read.
+	/// The lock must be held.
+	void ThrowIfFailed() const;
+
+	// libuv's callbacks; the data of each handle and request is its
+	// Connection.
+
+	static void Release(Connection *conn);
+	static void OnResolved(uv_getaddrinfo_t *req, int status, struct addrinfo *res);
+	static void OnConnected(uv_connect_t *req, int status);
+	static void OnWritten(uv_write_t *req, int status);
+	static void OnAlloc(uv_handle_t *handle, size_t suggested, uv_buf_t *buf);
+	static void OnRead(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf);
+	static void OnClosed(uv_handle_t *handle);
+
+	Url url;              ///< The file's URL.
+	std::size_t capacity; ///< The size of the buffer.
+
+	uv_loop_t loop;     ///< The fetch's own loop.
+	uv_async_t wake;    ///< Wakes the loop for restarts, resumes and stops.
+	std::thread thread; ///< The thread running the loop.
+
+	/// The request being fetched, if any.  Touched only on the loop thread.
+	Connection *current;
+
+	/// Guards everything below, which both threads touch.
+	mutable std::mutex lock;
+
+	/// Signalled when bytes arrive, or the fetch ends or fails.
+	std::condition_variable arrived;
+
+	std::vector<std::byte> buffer; ///< The fetched bytes, as a ring.
+	std::size_t start;             ///< Where the oldest byte in buffer is.
+	std::size_t count;             ///< How many bytes buffer holds.
+
+	bool stopping;                          ///< Whether the loop should stop.
+	std::optional<std::uint64_t> restart;   ///< Where to fetch again from, if asked.
+	std::uint64_t generation;               ///< How many restarts there have been.
+	bool paused;                            ///< Whether reading stopped as buffer was full.
+	bool ended;                             ///< Whether the body has all arrived.
+	std::optional<std::string> error;       ///< What went wrong, if anything did.
+	std::optional<std::uint64_t> file_size; ///< The size of the file, if known.
+	bool seekable;                          ///< Whether the server takes ranges.
+
+	/// Whether anything has arrived since the last restart.
+	bool primed;
+
+	/// When the decoder last ran dry, if it hasn't had data since.
+	std::optional<std::chrono::steady_clock::time_point> dry_since;
+
+	StreamStats stats; ///< The statistics so far.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_HTTP_STREAM_H
@@ -0,0 +1,244 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the LoudnessMeter class.
+ * @see audio/loudness.h
+ */
+
+#include "loudness.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <numeric>
+
+#include "../errors.h"
+#include "convert.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/// The gap between the integrated loudness and its relative gate, in LU.
+static constexpr double RELATIVE_GATE = 10.0;
+
+LoudnessMeter::LoudnessMeter(SampleFormat format, std::uint8_t channels, std::uint32_t rate)
+    : format{format},
+      channels{channels},
+      metered{std::min<std::size_t>(channels, MAX_CHANNELS)},
+      step_frames{std::max<std::size_t>(rate / 10, 1)},
+      shelf{},
+      pass{},
+      weight{},
+      interpolator{},
+      shelf_state{},
+      pass_state{},
+      history{},
+      history_pos{0},
+      step_power{},
+      peak{},
+      step_fill{0},
+      steps{},
+      steps_seen{0},
+      histogram(HISTOGRAM_BINS),
+      floats(CHUNK_FRAMES * channels)
+{
+	Expects(0 < channels);
+	Expects(0 < rate);
+	if (!CanConvert(format, SampleFormat::FLOAT32)) throw FileError("can't meter this sample format");
+
+	// BS.1770 only gives K-weighting's coefficients at 48kHz; these are
+	// the analogue filters they come from, bilinear-transformed to our
+	// rate, which gives the same coefficients at 48kHz.
+	const auto pi = std::numbers::pi;
+	{
+		constexpr double f0 = 1681.974450955533;
+		constexpr double gain_db = 3.999843853973347;
+		constexpr double q = 0.7071752369554196;
+		const auto k = std::tan(pi * f0 / rate);
+		const auto vh = std::pow(10.0, gain_db / 20.0);
+		const auto vb = std::pow(vh, 0.4996667741545416);
+		const auto a0 = 1.0 + (k / q) + (k * k);
+		this->shelf = Biquad{(vh + (vb * k / q) + (k * k)) / a0, 2.0 * ((k * k) - vh) / a0,
+		                     (vh - (vb * k / q) + (k * k)) / a0, 2.0 * ((k * k) - 1.0) / a0,
+		                     (1.0 - (k / q) + (k * k)) / a0};
+	}
+	{
+		constexpr double f0 = 38.13547087602444;
+		constexpr double q = 0.5003270373238773;
+		const auto k = std::tan(pi * f0 / rate);
+		const auto a0 = 1.0 + (k / q) + (k * k);
+		this->pass = Biquad{1.0, -2.0, 1.0, 2.0 * ((k * k) - 1.0) / a0, (1.0 - (k / q) + (k * k)) / a0};
+	}
+
+	// Everything counts the same, except in 5.1 (L, R, C, LFE, Ls, Rs),
+	// where the LFE doesn't count and the surrounds count for more.
+	std::fill_n(this->weight.begin(), this->metered, 1.0);
+	if (channels == 6) {
+		this->weight[3] = 0.0;
+		this->weight[4] = 1.41;
+		this->weight[5] = 1.41;
+	}
+
+	// Each phase of the interpolator is a Hann-windowed sinc, sampled at
+	// that phase's offset between the middle two of its taps, and scaled
+	// so that it passes DC unchanged.
+	const auto half = static_cast<double>(PHASE_TAPS) / 2.0;
+	for (std::size_t p = 0; p < OVERSAMPLE; p++) {
+		auto &phase = this->interpolator[p];
+		const auto offset = (static_cast<double>(p) + 0.5) / OVERSAMPLE;
+		for (std::size_t k = 0; k < PHASE_TAPS; k++) {
+			const auto t = static_cast<double>(k) - half + offset;
+			const auto sinc = std::sin(pi * t) / (pi * t);
+			phase[k] = sinc * 0.5 * (1.0 + std::cos(pi * t / half));
+		}
+		const auto sum = std::accumulate(phase.begin(), phase.end(), 0.0);
+		for (auto &tap : phase) tap /= sum;
+	}
+}
+
+void LoudnessMeter::Feed(gsl::span<const std::byte> samples)
+{
+	const auto in_bps = sample_format_bps[static_cast<std::size_t>(this->format)] * this->channels;
+	Expects(samples.size() % in_bps == 0);
+
+	while (!samples.empty()) {
+		const auto frames = std::min(samples.size() / in_bps, CHUNK_FRAMES);
+		const auto count = frames * this->channels;
+		auto out = gsl::span<float>{this->floats}.first(count);
+		ConvertSamples(this->format, SampleFormat::FLOAT32, samples.first(frames * in_bps),
+		               gsl::span<std::byte>{reinterpret_cast<std::byte *>(out.data()), count * sizeof(float)});
+
+		// Stereo and mono are most of what we meter, and don't need all
+		// of the lanes.
+		if (this->channels <= 2) {
+			this->FeedFrames<2>(out);
+		} else {
+			this->FeedFrames<MAX_CHANNELS>(out);
+		}
+		samples = samples.subspan(frames * in_bps);
+	}
+}
+
+template <std::size_t LANES>
+void LoudnessMeter::FeedFrames(gsl::span<const float> frames)
+{
+	static_assert(LANES <= MAX_CHANNELS);
+
+	const auto &s = this->shelf;
+	const auto &h = this->pass;
+	auto &[s1, s2] = this->shelf_state;
+	auto &[h1, h2] = this->pass_state;
+
+	for (std::size_t i = 0; i < frames.size(); i += this->channels) {
+		// Unmetered lanes stay at zero, so they never add anything.
+		this->history_pos = (this->history_pos + PHASE_TAPS - 1) % PHASE_TAPS;
+		const auto latest = gsl::span{this->history}.subspan(this->history_pos, PHASE_TAPS);
+		auto &x = latest[0];
+		for (std::size_t c = 0; c < this->metered; c++) x[c] = frames[i + c];
+		this->history[this->history_pos + PHASE_TAPS] = x;
+
+		// K-weighting, as two transposed direct form II biquads.
+		for (std::size_t c = 0; c < LANES; c++) {
+			const auto y = (s.b0 * x[c]) + s1[c];
+			s1[c] = (s.b1 * x[c]) - (s.a1 * y) + s2[c];
+			s2[c] = (s.b2 * x[c]) - (s.a2 * y);
+
+			const auto z = (h.b0 * y) + h1[c];
+			h1[c] = (h.b1 * y) - (h.a1 * z) + h2[c];
+			h2[c] = (h.b2 * y) - (h.a2 * z);
+
+			this->step_power[c] += z * z;
+		}
+
+		// True peak: the samples themselves, and each oversampled point
+		// between the middle two in the history.
+		for (std::size_t c = 0; c < LANES; c++) this->peak[c] = std::max(this->peak[c], std::abs(x[c]));
+		for (const auto &phase : this->interpolator) {
+			Lanes acc{};
+			for (std::size_t k = 0; k < PHASE_TAPS; k++) {
+				for (std::size_t c = 0; c < LANES; c++) acc[c] += phase[k] * latest[k][c];
+			}
+			for (std::size_t c = 0; c < LANES; c++) this->peak[c] = std::max(this->peak[c], std::abs(acc[c]));
+		}
+
+		if (++this->step_fill == this->step_frames) this->EndStep();
+	}
+}
+
+void LoudnessMeter::EndStep()
+{
+	double power = 0.0;
+	for (std::size_t c = 0; c < this->metered; c++) power += this->weight[c] * this->step_power[c];
+	this->steps[this->steps_seen % SHORT_TERM_STEPS] = power;
+	this->steps_seen++;
+	this->step_power = {};
+	this->step_fill = 0;
+
+	// Gating blocks are 400ms long, and start every 100ms.
+	if (this->steps_seen < MOMENTARY_STEPS) return;
+	double block = 0.0;
+	for (std::size_t i = 1; i <= MOMENTARY_STEPS; i++) block += this->steps[(this->steps_seen - i) % SHORT_TERM_STEPS];
+	block /= static_cast<double>(MOMENTARY_STEPS * this->step_frames);
+
+	const auto loudness = LoudnessOf(block);
+	if (loudness < HISTOGRAM_FLOOR) return;
+	const auto bin = std::min(static_cast<std::size_t>((loudness - HISTOGRAM_FLOOR) * 10.0), HISTOGRAM_BINS - 1);
+	this->histogram[bin].count++;
+	this->histogram[bin].power += block;
+}
+
+void LoudnessMeter::Restart()
+{
+	this->shelf_state = {};
+	this->pass_state = {};
+	this->history = {};
+	this->history_pos = 0;
+	this->step_power = {};
+	this->step_fill = 0;
+	this->steps_seen = 0;
+}
+
+LoudnessMeter::Reading LoudnessMeter::Read() const
+{
+	// Until a window has filled up, it covers what there is so far.
+	const auto window = [this](std::size_t size) {
+		const auto n = std::min(size, this->steps_seen);
+		double power = 0.0;
+		for (std::size_t i = 1; i <= n; i++) power += this->steps[(this->steps_seen - i) % SHORT_TERM_STEPS];
+		return n == 0 ? SILENCE : LoudnessOf(power / static_cast<double>(n * this->step_frames));
+	};
+
+	// The relative gate sits RELATIVE_GATE below the loudness of every
+	// block over the absolute gate; we then take the blocks over both.
+	const auto gated = [this](std::size_t from) {
+		std::uint64_t count = 0;
+		double power = 0.0;
+		for (auto bin = this->histogram.begin() + from; bin != this->histogram.end(); ++bin) {
+			count += bin->count;
+			power += bin->power;
+		}
+		return count == 0 ? SILENCE : LoudnessOf(power / static_cast<double>(count));
+	};
+	auto integrated = gated(0);
+	if (integrated != SILENCE) {
+		const auto gate = std::ceil((integrated - RELATIVE_GATE - HISTOGRAM_FLOOR) * 10.0);
+		integrated = gated(std::min(static_cast<std::size_t>(std::max(gate, 0.0)), HISTOGRAM_BINS));
+	}
+
+	const auto peak = *std::max_element(this->peak.begin(), this->peak.end());
+
+	return Reading{window(MOMENTARY_STEPS), window(SHORT_TERM_STEPS), integrated,
+	               0.0 < peak ? 20.0 * std::log10(peak) : SILENCE};
+}
+
+/* static */ double LoudnessMeter::LoudnessOf(double power)
+{
+	return 0.0 < power ? -0.691 + (10.0 * std::log10(power)) : SILENCE;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,181 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the LoudnessMeter class.
+ * @see audio/loudness.cpp
+ */
+
+#ifndef PLAYD_AUDIO_LOUDNESS_H
+#define PLAYD_AUDIO_LOUDNESS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A streaming loudness and true-peak meter, after ITU-R BS.1770-4 and EBU R128.
+ *
+ * Samples are K-weighted as they're fed in, and summed over 100ms steps;
+ * momentary loudness is the last 4 steps (400ms), short-term the last 30
+ * (3s), and integrated loudness gates every 400ms block since the start, as
+ * R128 does.  Blocks are kept in a histogram of 0.1 LU bins, so integrated
+ * loudness takes constant memory however long the audio is, at the cost of
+ * up to 0.1 LU of error at the relative gate.
+ *
+ * True peak is the highest sample of the audio oversampled four times, after
+ * Annex 2 of BS.1770.
+ *
+ * The filters run on up to MAX_CHANNELS channels in lockstep, in fixed-width
+ * lanes, so that the compiler can vectorise them; further channels aren't
+ * metered.  Meters aren't thread-safe, and are meant to be fed on whichever
+ * thread decodes, well away from the audio callback.
+ */
+class LoudnessMeter
+{
+public:
+	/// The readings of a meter.
+	struct Reading {
+		double momentary;  ///< Loudness over the last 400ms, in LUFS.
+		double short_term; ///< Loudness over the last 3s, in LUFS.
+		double integrated; ///< Gated loudness since the start, in LUFS.
+		double true_peak;  ///< The highest true peak so far, in dBTP.
+	};
+
+	/// The reading given for silence (or no audio at all).
+	static constexpr double SILENCE = -std::numeric_limits<double>::infinity();
+
+	/// The most channels metered.
+	static constexpr std::size_t MAX_CHANNELS = 8;
+
+	/**
+	 * Constructs a LoudnessMeter.
+	 * @param format The format of the samples fed in.
+	 * @param channels The number of channels.
+	 * @param rate The sample rate, in Hz.
+	 * @exception FileError if @a format can't be metered.
+	 */
+	LoudnessMeter(SampleFormat format, std::uint8_t channels, std::uint32_t rate);
+
+	/**
+	 * Meters some samples.
+	 * * Precondition: @a samples holds a whole number of sample frames.
+	 * @param samples The samples, in the meter's format.
+	 */
+	void Feed(gsl::span<const std::byte> samples);
+
+	/**
+	 * Starts metering afresh from somewhere else in the audio.
+	 * The filters and the momentary and short-term windows start over, so
+	 * that the jump doesn't count as audio; integrated loudness and true
+	 * peak carry on.
+	 */
+	void Restart();
+
+	/**
+	 * Reads the meter.
+	 * @return The current readings.
+	 */
+	[[nodiscard]] Reading Read() const;
+
+	/// The number of 100ms steps in a momentary (400ms) block.
+	static constexpr std::size_t MOMENTARY_STEPS = 4;
+
+	/// The number of 100ms steps in a short-term (3s) block.
+	static constexpr std::size_t SHORT_TERM_STEPS = 30;
+
+private:
+	/// The oversampling factor of the true-peak meter.
+	static constexpr std::size_t OVERSAMPLE = 4;
+
+	/// The taps in each phase of the true-peak interpolator.
+	static constexpr std::size_t PHASE_TAPS = 12;
+
+	/// The lowest loudness the integrated histogram holds (the absolute
+	/// gate), in LUFS.
+	static constexpr double HISTOGRAM_FLOOR = -70.0;
+
+	/// The number of 0.1 LU bins in the histogram, up to +10 LUFS.
+	static constexpr std::size_t HISTOGRAM_BINS = 800;
+
+	/// The sample frames converted to floating point at a time.
+	static constexpr std::size_t CHUNK_FRAMES = 1024;
+
+	/// A biquad filter's coefficients.
+	struct Biquad {
+		double b0, b1, b2; ///< The feed-forward coefficients.
+		double a1, a2;     ///< The feedback coefficients (a0 is 1).
+	};
+
+	/// Per-channel filter state, one lane per channel.
+	using Lanes = std::array<double, MAX_CHANNELS>;
+
+	/// A bin of the integrated loudness histogram.
+	struct Bin {
+		std::uint64_t count; ///< The blocks in the bin.
+		double power;        ///< The sum of their mean-square powers.
+	};
+
+	/**
+	 * Meters some floating-point sample frames.
+	 * @tparam LANES The number of lanes to run, at least the channels.
+	 * @param frames The interleaved samples.
+	 */
+	template <std::size_t LANES>
+	void FeedFrames(gsl::span<const float> frames);
+
+	/// Finishes a 100ms step, moving the windows on.
+	void EndStep();
+
+	/**
+	 * Converts a mean-square power to loudness.
+	 * @param power The channel-weighted mean-square power.
+	 * @return The loudness, in LUFS.
+	 */
+	static double LoudnessOf(double power);
+
+	SampleFormat format;     ///< The format of samples fed in.
+	std::uint8_t channels;   ///< The number of channels fed in.
+	std::size_t metered;     ///< The number of channels metered.
+	std::size_t step_frames; ///< The frames in a 100ms step.
+
+	Biquad shelf; ///< The first stage of K-weighting, a high shelf.
+	Biquad pass;  ///< The second stage of K-weighting, a high pass.
+	Lanes weight; ///< The weight of each channel.
+
+	/// The true-peak interpolator, by phase then tap.
+	std::array<std::array<double, PHASE_TAPS>, OVERSAMPLE> interpolator;
+
+	// The rest is per-channel state, in lanes.
+	std::array<Lanes, 2> shelf_state; ///< The shelf's delay line.
+	std::array<Lanes, 2> pass_state;  ///< The high pass's delay line.
+
+	/// The last samples, for the true-peak interpolator, twice over: the
+	/// PHASE_TAPS from history_pos are always the latest, newest first.
+	std::array<Lanes, 2 * PHASE_TAPS> history;
+	std::size_t history_pos; ///< Where the newest sample is in history.
+
+	Lanes step_power;      ///< The K-weighted power in the current step.
+	Lanes peak;            ///< The highest true peak of each channel.
+	std::size_t step_fill; ///< The frames in the current step.
+
+	/// The weighted power of the last SHORT_TERM_STEPS steps, as a ring.
+	std::array<double, SHORT_TERM_STEPS> steps;
+	std::size_t steps_seen; ///< Steps completed since the last restart.
+
+	std::vector<Bin> histogram; ///< Gating blocks, by loudness.
+
+	std::vector<float> floats; ///< Samples converted for metering.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_LOUDNESS_H
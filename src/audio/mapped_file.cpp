@@ -0,0 +1,157 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the MappedFile class.
+ * @see audio/mapped_file.h
+ */
+
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../errors.h"
+
+namespace Playd::Audio
+{
+MappedFile::MappedFile(const std::string &path) : data{nullptr}, size{0}, pos{0}, prefetched_to{0}
+{
+#ifdef _WIN32
+	// Sharing everything lets files be replaced (though not truncated) while
+	// loaded, as on POSIX; the scan hint is the nearest to MADV_SEQUENTIAL.
+	const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+	                              nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw FileError("can't open " + path + ": error " + std::to_string(GetLastError()));
+	}
+	const auto close_file = gsl::finally([file] { CloseHandle(file); });
+
+	LARGE_INTEGER file_size{};
+	if (!GetFileSizeEx(file, &file_size)) {
+		throw FileError("can't stat " + path + ": error " + std::to_string(GetLastError()));
+	}
+	this->size = static_cast<std::uint64_t>(file_size.QuadPart);
+	if (this->size == 0) return;
+
+	// The view keeps the mapping, and the file, alive on its own.
+	const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) throw FileError("can't map " + path + ": error " + std::to_string(GetLastError()));
+	const auto close_mapping = gsl::finally([mapping] { CloseHandle(mapping); });
+
+	auto *raw = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (raw == nullptr) throw FileError("can't map " + path + ": error " + std::to_string(GetLastError()));
+	this->data = static_cast<const std::byte *>(raw);
+#else
+	const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) throw FileError("can't open " + path + ": " + std::strerror(errno));
+	// The mapping keeps the file alive, so we don't need the descriptor.
+	const auto close_fd = gsl::finally([fd] { close(fd); });
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0) throw FileError("can't stat " + path + ": " + std::strerror(errno));
+	this->size = static_cast<std::uint64_t>(st.st_size);
+
+	// Empty files can't be mapped, but then there's nothing to read.
+	if (this->size == 0) return;
+
+	auto raw = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (raw == MAP_FAILED) throw FileError("can't map " + path + ": " + std::strerror(errno));
+	this->data = static_cast<const std::byte *>(raw);
+
+	// Decoders mostly read straight through, so the kernel can read ahead
+	// aggressively and drop pages once we're past them.
+	madvise(raw, this->size, MADV_SEQUENTIAL);
+	this->Prefetch();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	if (this->data == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(this->data);
+#else
+	munmap(const_cast<std::byte *>(this->data), this->size);
+#endif
+}
+
+std::size_t MappedFile::Read(gsl::span<std::byte> out)
+{
+	const auto count = static_cast<std::size_t>(std::min<std::uint64_t>(out.size(), this->size - this->pos));
+	if (count == 0) return 0;
+
+	std::memcpy(out.data(), this->data + this->pos, count);
+	this->pos += count;
+	this->Prefetch();
+	return count;
+}
+
+std::optional<std::uint64_t> MappedFile::Seek(std::int64_t offset, int whence)
+{
+	std::int64_t base = 0;
+	if (whence == SEEK_CUR) base = static_cast<std::int64_t>(this->pos);
+	else if (whence == SEEK_END) base = static_cast<std::int64_t>(this->size);
+	else if (whence != SEEK_SET) return std::nullopt;
+
+	const auto target = base + offset;
+	if (target < 0 || static_cast<std::int64_t>(this->size) < target) return std::nullopt;
+
+	this->pos = static_cast<std::uint64_t>(target);
+
+	// After a jump out of the last window, that window is no use to us.
+	const auto window_start = this->prefetched_to - std::min(this->prefetched_to, PREFETCH_BYTES);
+	if (this->pos < window_start || this->prefetched_to < this->pos) this->prefetched_to = this->pos;
+	this->Prefetch();
+	return this->pos;
+}
+
+std::uint64_t MappedFile::Tell() const
+{
+	return this->pos;
+}
+
+std::uint64_t MappedFile::Size() const
+{
+	return this->size;
+}
+
+void MappedFile::Prefetch()
+{
+#ifdef _WIN32
+	// Windows reads ahead of sequential faults by itself, with the scan
+	// hint the file was opened with.
+#else
+	// Asking again for every small read would just be churn, so only ask
+	// once the cursor is halfway through the last window.
+	if (this->data == nullptr || this->pos + (PREFETCH_BYTES / 2) < this->prefetched_to) return;
+	if (this->size <= this->prefetched_to) return;
+
+	static const auto page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+	const auto start = std::max(this->pos, this->prefetched_to) / page * page;
+	const auto end = std::min(this->pos + PREFETCH_BYTES, this->size);
+	if (start < end) {
+		madvise(const_cast<std::byte *>(this->data + start), end - start, MADV_WILLNEED);
+	}
+	this->prefetched_to = end;
+#endif
+}
+
+} // namespace Playd::Audio
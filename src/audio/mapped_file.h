@@ -0,0 +1,102 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the MappedFile class.
+ * @see audio/mapped_file.cpp
+ */
+
+#ifndef PLAYD_AUDIO_MAPPED_FILE_H
+#define PLAYD_AUDIO_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd::Audio
+{
+/**
+ * A read-only, memory-mapped audio file, read through a cursor.
+ *
+ * Decoders normally read their files a few kilobytes at a time, on demand,
+ * so a slow disk (or network share) stalls the decoder whenever a read misses
+ * the page cache.  Reading through a MappedFile instead asks the kernel to
+ * fetch a large window ahead of the cursor, well before the decoder gets
+ * there; the decoder then just copies out of memory.
+ *
+ * This only does the file's half of the job; sources hook it up to their
+ * decoding libraries' callback-based I/O.
+ *
+ * As with any mapping, truncating the file while it is mapped makes reads of
+ * the lost part fault, so files shouldn't be rewritten in place while loaded.
+ */
+class MappedFile
+{
+public:
+	/// How far ahead of the cursor to have the kernel fetch, in bytes.
+	static constexpr std::uint64_t PREFETCH_BYTES = 1024 * 1024;
+
+	/**
+	 * Opens and maps a file.
+	 * @param path The path to the file.
+	 * @exception FileError if the file can't be opened or mapped.
+	 */
+	explicit MappedFile(const std::string &path);
+
+	/// Destructs a MappedFile, unmapping the file.
+	~MappedFile();
+
+	/// Deleted copy constructor.
+	MappedFile(const MappedFile &) = delete;
+
+	/// Deleted copy-assignment.
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	/**
+	 * Reads from the cursor, and moves it past what was read.
+	 * @param out Where to put the bytes read.
+	 * @return The number of bytes read, which is only short of the size of
+	 *   @a out at the end of the file.
+	 */
+	std::size_t Read(gsl::span<std::byte> out);
+
+	/**
+	 * Moves the cursor, as lseek() does.
+	 * @param offset The offset to move to, relative to @a whence.
+	 * @param whence SEEK_SET, SEEK_CUR or SEEK_END.
+	 * @return The new cursor position, or nothing if it would have been
+	 *   outside the file (in which case the cursor doesn't move).
+	 */
+	std::optional<std::uint64_t> Seek(std::int64_t offset, int whence);
+
+	/**
+	 * Gets the position of the cursor.
+	 * @return The cursor's offset from the start of the file, in bytes.
+	 */
+	[[nodiscard]] std::uint64_t Tell() const;
+
+	/**
+	 * Gets the size of the file.
+	 * @return The size of the file, in bytes.
+	 */
+	[[nodiscard]] std::uint64_t Size() const;
+
+private:
+	/// Asks the kernel to fetch the window ahead of the cursor, if the
+	/// cursor is getting near the end of what was last asked for.
+	void Prefetch();
+
+	const std::byte *data;       ///< The mapped file, or nullptr if empty.
+	std::uint64_t size;          ///< The size of the file.
+	std::uint64_t pos;           ///< The cursor.
+	std::uint64_t prefetched_to; ///< The end of the last prefetch window.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_MAPPED_FILE_H
@@ -0,0 +1,322 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the MetadataCache class.
+ * @see audio/metadata_cache.h
+ */
+
+#include "metadata_cache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../errors.h"
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/// The first bytes of every cache file; the last is the format version.
+static constexpr std::string_view MAGIC{"playdmc\x01", 8};
+
+/*
+ * Each record is laid out as follows, in native byte order:
+ *
+ *   u32 record size (including this)
+ *   u64 mtime, u64 file size
+ *   u64 length, u32 rate, u8 channels, u8 format
+ *   u16 path size, i64 index step, u32 index count
+ *   path bytes, then index count i64 offsets
+ */
+
+/// The size of a record, not counting its path or index.
+static constexpr std::size_t RECORD_HEADER = 4 + 8 + 8 + 8 + 4 + 1 + 1 + 2 + 8 + 4;
+
+/// Appends a value's bytes to a string.
+template <typename T>
+static void Put(std::string &out, T value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+/// Reads a value's bytes from raw memory, and advances past them.
+template <typename T>
+static T Get(const std::byte *&in)
+{
+	T value;
+	std::memcpy(&value, in, sizeof value);
+	in += sizeof value;
+	return value;
+}
+
+/*
+ * The CRT on Windows has the POSIX file calls under other names, but no
+ * mmap(), so the few calls the cache needs are wrapped here.
+ */
+
+/// Opens a cache file for reading and appending, creating it if need be.
+static int OpenFile(const std::string &path)
+{
+#ifdef _WIN32
+	return _open(path.c_str(), _O_RDWR | _O_APPEND | _O_CREAT | _O_BINARY | _O_NOINHERIT, _S_IREAD | _S_IWRITE);
+#else
+	return open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+#endif
+}
+
+/// Closes a file opened with OpenFile().
+static void CloseFile(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+/// @return The size of an open file, or nothing if it can't be found.
+static std::optional<std::size_t> FileSize(int fd)
+{
+#ifdef _WIN32
+	struct _stat64 st {};
+	if (_fstat64(fd, &st) != 0) return std::nullopt;
+#else
+	struct stat st {};
+	if (fstat(fd, &st) != 0) return std::nullopt;
+#endif
+	return static_cast<std::size_t>(st.st_size);
+}
+
+/// @return Whether all of @a bytes were appended to an open file.
+static bool Append(int fd, std::string_view bytes)
+{
+#ifdef _WIN32
+	return _write(fd, bytes.data(), static_cast<unsigned int>(bytes.size())) == static_cast<int>(bytes.size());
+#else
+	return write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size());
+#endif
+}
+
+/// @return Whether an open file was cut down to @a size bytes.
+static bool Truncate(int fd, std::size_t size)
+{
+#ifdef _WIN32
+	return _chsize_s(fd, static_cast<__int64>(size)) == 0;
+#else
+	return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+/**
+ * Maps the start of an open file, read-only.
+ * Windows won't shorten a file while any of it is mapped, which Load() may
+ * need to, so there the file is read in instead.
+ * @param fd The file.
+ * @param size How much of it to map.
+ * @return The mapping, or nullptr if it couldn't be made.
+ */
+static const std::byte *MapFile(int fd, std::size_t size)
+{
+#ifdef _WIN32
+	auto data = std::make_unique<std::byte[]>(size);
+	if (_lseeki64(fd, 0, SEEK_SET) != 0) return nullptr;
+	for (std::size_t done = 0; done < size;) {
+		const auto chunk = static_cast<unsigned int>(std::min<std::size_t>(size - done, INT_MAX));
+		const auto got = _read(fd, data.get() + done, chunk);
+		if (got <= 0) return nullptr;
+		done += static_cast<std::size_t>(got);
+	}
+	return data.release();
+#else
+	auto raw = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	return raw == MAP_FAILED ? nullptr : static_cast<const std::byte *>(raw);
+#endif
+}
+
+/// Undoes MapFile(), if it made a mapping.
+static void UnmapFile(const std::byte *map, std::size_t size)
+{
+	if (map == nullptr) return;
+#ifdef _WIN32
+	delete[] map;
+#else
+	munmap(const_cast<std::byte *>(map), size);
+#endif
+}
+
+MetadataCache::MetadataCache(const std::string &path) : fd{-1}, map{nullptr}, map_size{0}
+{
+	this->fd = OpenFile(path);
+	if (this->fd < 0) {
+		throw ConfigError("can't open cache " + path + ": " + std::strerror(errno));
+	}
+
+	if (!this->Load()) {
+		UnmapFile(this->map, this->map_size);
+		CloseFile(this->fd);
+		throw ConfigError("not a cache file: " + path);
+	}
+}
+
+MetadataCache::~MetadataCache()
+{
+	UnmapFile(this->map, this->map_size);
+	CloseFile(this->fd);
+}
+
+bool MetadataCache::Load()
+{
+	const auto file_size = FileSize(this->fd);
+	if (!file_size) return false;
+	const auto size = *file_size;
+
+	// A new cache just needs its magic.
+	if (size == 0) return Append(this->fd, MAGIC);
+	if (size < MAGIC.size()) return false;
+
+	this->map = MapFile(this->fd, size);
+	if (this->map == nullptr) return false;
+	this->map_size = size;
+
+	if (std::memcmp(this->map, MAGIC.data(), MAGIC.size()) != 0) return false;
+
+	auto offset = MAGIC.size();
+	while (RECORD_HEADER <= size - offset) {
+		auto p = this->map + offset;
+		const auto record_size = Get<std::uint32_t>(p);
+
+		// Without a believable size, there's no finding the record after
+		// this one; leave the rest of the file be, in case it's good.
+		if (record_size < RECORD_HEADER) {
+			Debug() << "cache: unreadable record at" << offset << std::endl;
+			return true;
+		}
+		if (size - offset < record_size) break;
+
+		// A record that doesn't add up is skipped, but the ones after it
+		// can still be found from its size.
+		p += 8 + 8 + 8 + 4 + 1 + 1;
+		const auto path_size = Get<std::uint16_t>(p);
+		p += 8;
+		const auto count = Get<std::uint32_t>(p);
+		if (record_size == RECORD_HEADER + path_size + (std::uint64_t{count} * 8)) {
+			this->mapped[std::string{reinterpret_cast<const char *>(p), path_size}] = offset;
+		} else {
+			Debug() << "cache: skipped bad record at" << offset << std::endl;
+		}
+		offset += record_size;
+	}
+	if (offset == size) return true;
+
+	// Anything after the last whole record is a write that didn't finish;
+	// cut it off, so that new records go after the good ones.  If the file
+	// has grown since, someone else is appending to it, and their records
+	// would go too, so it's left for the next opening.
+	if (FileSize(this->fd) != size) return true;
+	return Truncate(this->fd, offset);
+}
+
+/* static */ std::optional<MetadataCache::Key> MetadataCache::KeyOf(const std::string &path)
+{
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(path, ec);
+	if (ec) return std::nullopt;
+	const auto mtime = std::filesystem::last_write_time(path, ec);
+	if (ec) return std::nullopt;
+
+	return Key{static_cast<std::uint64_t>(mtime.time_since_epoch().count()), static_cast<std::uint64_t>(size)};
+}
+
+MetadataCache::Record MetadataCache::ReadMapped(std::size_t offset) const
+{
+	Record record{};
+	auto p = this->map + offset + 4;
+	record.key.mtime = Get<std::uint64_t>(p);
+	record.key.size = Get<std::uint64_t>(p);
+	record.entry.length = Get<std::uint64_t>(p);
+	record.entry.rate = Get<std::uint32_t>(p);
+	record.entry.channels = Get<std::uint8_t>(p);
+	record.entry.format = static_cast<SampleFormat>(Get<std::uint8_t>(p));
+	const auto path_size = Get<std::uint16_t>(p);
+	record.entry.index_step = Get<std::int64_t>(p);
+	const auto count = Get<std::uint32_t>(p);
+
+	p += path_size;
+	record.entry.index.resize(count);
+	std::memcpy(record.entry.index.data(), p, count * sizeof(std::int64_t));
+	return record;
+}
+
+std::optional<MetadataCache::Entry> MetadataCache::Find(const std::string &path) const
+{
+	const auto key = KeyOf(path);
+	if (!key) return std::nullopt;
+
+	std::lock_guard guard{this->lock};
+
+	std::optional<Record> record;
+	if (const auto it = this->added.find(path); it != this->added.end()) {
+		record = it->second;
+	} else if (const auto it = this->mapped.find(path); it != this->mapped.end()) {
+		record = this->ReadMapped(it->second);
+	}
+
+	// A file that has changed since may not have the same audio in it.
+	if (!record || record->key != *key) return std::nullopt;
+	if (SAMPLE_FORMAT_COUNT <= static_cast<std::size_t>(record->entry.format)) return std::nullopt;
+	return std::move(record->entry);
+}
+
+void MetadataCache::Store(const std::string &path, const Entry &entry)
+{
+	const auto count = entry.index.size();
+	const auto size = RECORD_HEADER + path.size() + (count * sizeof(std::int64_t));
+	const auto key = KeyOf(path);
+	if (!key || UINT16_MAX < path.size() || UINT32_MAX < size) return;
+
+	std::string out;
+	out.reserve(size);
+	Put(out, static_cast<std::uint32_t>(size));
+	Put(out, key->mtime);
+	Put(out, key->size);
+	Put(out, entry.length);
+	Put(out, entry.rate);
+	Put(out, entry.channels);
+	Put(out, static_cast<std::uint8_t>(entry.format));
+	Put(out, static_cast<std::uint16_t>(path.size()));
+	Put(out, entry.index_step);
+	Put(out, static_cast<std::uint32_t>(count));
+	out.append(path);
+	out.append(reinterpret_cast<const char *>(entry.index.data()), count * sizeof(std::int64_t));
+
+	std::lock_guard guard{this->lock};
+	this->added.insert_or_assign(path, Record{*key, entry});
+
+	// The file is open for appending, so whole records go on the end; a
+	// short write gets cut off when the cache is next opened.
+	if (!Append(this->fd, out)) {
+		Debug() << "cache: couldn't store" << path << std::endl;
+	}
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,138 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the MetadataCache class.
+ * @see audio/metadata_cache.cpp
+ */
+
+#ifndef PLAYD_AUDIO_METADATA_CACHE_H
+#define PLAYD_AUDIO_METADATA_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * A persistent cache of what sources find out about their files.
+ *
+ * Some sources (notably MP3Source) have to scan a whole file to find its
+ * exact length and seek points.  Once they have, they can Store() the results
+ * here, keyed by the file's path, modification time and size; the next time
+ * the file is loaded, they can Find() them again rather than scanning.
+ *
+ * The cache lives in one file, which is memory-mapped when the cache is
+ * opened; new entries are appended to it, and supersede any older entries for
+ * the same path (which stay in the file until it is deleted).  Entries are in
+ * native byte order, so the file isn't meant to move between machines.
+ */
+class MetadataCache
+{
+public:
+	/// What the cache knows about one file.
+	struct Entry {
+		std::uint64_t length;            ///< The length, in samples.
+		std::uint32_t rate;              ///< The sample rate, in Hz.
+		std::uint8_t channels;           ///< The channel count.
+		SampleFormat format;             ///< The output sample format.
+		std::int64_t index_step;         ///< Frames between index entries.
+		std::vector<std::int64_t> index; ///< File offsets of indexed frames.
+	};
+
+	/// What identifies one version of a file.
+	struct Key {
+		std::uint64_t mtime; ///< The file's modification time.
+		std::uint64_t size;  ///< The file's size, in bytes.
+
+		/// Keys are equal if all of their fields are.
+		bool operator==(const Key &) const = default;
+	};
+
+	/**
+	 * Works out the key for the current version of a file.
+	 * @param path The path to the file.
+	 * @return The key, or nothing if the file can't be looked at.
+	 */
+	static std::optional<Key> KeyOf(const std::string &path);
+
+	/**
+	 * Opens a cache file, creating it if it doesn't exist.
+	 * A file that isn't a cache is refused; a cache with damage at the end
+	 * (say, from a crash mid-write) is cut back to its last good entry.
+	 * @param path The path to the cache file.
+	 * @exception ConfigError if the file can't be opened, or isn't a cache.
+	 */
+	explicit MetadataCache(const std::string &path);
+
+	/// Destructs a MetadataCache, unmapping its file.
+	~MetadataCache();
+
+	/// Deleted copy constructor.
+	MetadataCache(const MetadataCache &) = delete;
+
+	/// Deleted copy-assignment.
+	MetadataCache &operator=(const MetadataCache &) = delete;
+
+	/**
+	 * Looks up a file.
+	 * @param path The path to the file.
+	 * @return The file's entry, if there is one and the file hasn't
+	 *   changed since it was stored.
+	 */
+	[[nodiscard]] std::optional<Entry> Find(const std::string &path) const;
+
+	/**
+	 * Stores what is known about a file, replacing any older entry.
+	 * Failing to write the cache isn't fatal; the entry just doesn't
+	 * outlive this cache.
+	 * @param path The path to the file.
+	 * @param entry What is known about it.
+	 */
+	void Store(const std::string &path, const Entry &entry);
+
+private:
+	/// An entry, and the version of the file it was made from.
+	struct Record {
+		Key key;     ///< The version of the file.
+		Entry entry; ///< What is known about it.
+	};
+
+	/**
+	 * Reads the record at an offset in the mapped file.
+	 * @param offset The offset of the record.
+	 * @return The record.
+	 */
+	[[nodiscard]] Record ReadMapped(std::size_t offset) const;
+
+	/**
+	 * Maps the file, and indexes the records in it.
+	 * @return Whether the file was a cache.
+	 */
+	bool Load();
+
+	int fd;                   ///< The cache file.
+	const std::byte *map;     ///< The mapped (on Windows, read-in) file, or nullptr if empty.
+	std::size_t map_size;     ///< The size of the mapping.
+
+	/// Offsets in the mapping of the latest record for each path.
+	std::unordered_map<std::string, std::size_t> mapped;
+
+	/// Records stored since the file was mapped, which supersede it.
+	std::unordered_map<std::string, Record> added;
+
+	/// Guards everything above, as sources may use the cache on any thread.
+	mutable std::mutex lock;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_METADATA_CACHE_H
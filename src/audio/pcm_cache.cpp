@@ -0,0 +1,95 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the PcmCache class.
+ * @see audio/pcm_cache.h
+ */
+
+#include "pcm_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace Playd::Audio
+{
+PcmCache::PcmCache(std::size_t budget, std::uint64_t max_file_size)
+    : budget{budget}, max_file_size{max_file_size}, used{0}
+{
+}
+
+std::shared_ptr<const PcmClip> PcmCache::Find(const std::string &path)
+{
+	const auto key = KeyOf(path);
+
+	std::lock_guard guard{this->lock};
+	const auto it = this->by_path.find(path);
+	if (it == this->by_path.end()) return nullptr;
+
+	// A file that has changed since may not have the same audio in it.
+	if (!key || it->second->key != *key) {
+		this->Drop(it->second);
+		return nullptr;
+	}
+
+	this->entries.splice(this->entries.begin(), this->entries, it->second);
+	return it->second->clip;
+}
+
+std::optional<PcmCache::Key> PcmCache::Admits(const std::string &path) const
+{
+	const auto key = KeyOf(path);
+	if (!key || this->max_file_size < key->size) return std::nullopt;
+	return key;
+}
+
+void PcmCache::Store(Key key, std::shared_ptr<const PcmClip> clip)
+{
+	const auto size = clip->samples.size();
+	if (this->budget < size) return;
+
+	std::lock_guard guard{this->lock};
+	if (const auto it = this->by_path.find(clip->path); it != this->by_path.end()) this->Drop(it->second);
+
+	while (this->budget - size < this->used) this->Drop(std::prev(this->entries.end()));
+
+	const auto &path = clip->path;
+	this->entries.push_front(Entry{key, clip});
+	this->by_path.emplace(path, this->entries.begin());
+	this->used += size;
+}
+
+std::size_t PcmCache::Used() const
+{
+	std::lock_guard guard{this->lock};
+	return this->used;
+}
+
+/* static */ std::optional<PcmCache::Key> PcmCache::KeyOf(const std::string &path)
+{
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(path, ec);
+	if (ec) return std::nullopt;
+	const auto mtime = std::filesystem::last_write_time(path, ec);
+	if (ec) return std::nullopt;
+
+	return Key{static_cast<std::uint64_t>(mtime.time_since_epoch().count()), static_cast<std::uint64_t>(size)};
+}
+
+void PcmCache::Drop(Entries::iterator it)
+{
+	this->used -= it->clip->samples.size();
+	this->by_path.erase(it->clip->path);
+	this->entries.erase(it);
+}
+
+} // namespace Playd::Audio
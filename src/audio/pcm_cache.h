@@ -0,0 +1,124 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the PcmClip struct and PcmCache class.
+ * @see audio/pcm_cache.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PCM_CACHE_H
+#define PLAYD_AUDIO_PCM_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/// A whole file's worth of decoded audio, held in memory.
+struct PcmClip {
+	std::string path;               ///< The file the audio came from.
+	std::uint32_t rate;             ///< The sample rate, in Hz.
+	std::uint8_t channels;          ///< The number of channels.
+	SampleFormat format;            ///< The format of each mono sample.
+	std::vector<std::byte> samples; ///< The packed, decoded samples.
+};
+
+/**
+ * A least-recently-used cache of fully decoded audio files.
+ *
+ * Short files that get loaded over and over (jingles, stings) cost a full
+ * open and decode on every load.  Keeping their decoded audio in memory means
+ * later loads just point a RamSource at it.
+ *
+ * Only files up to a size limit are taken in, and the cache drops its
+ * least recently used clips to keep within a memory budget.  Clips still being
+ * played stay alive until their sources let go of them, so the budget only
+ * bounds what the cache itself holds on to.
+ *
+ * All methods are safe to call from any thread.
+ */
+class PcmCache
+{
+public:
+	/// The version of a file a clip was decoded from.
+	struct Key {
+		std::uint64_t mtime; ///< The file's modification time, in clock ticks.
+		std::uint64_t size;  ///< The file's size, in bytes.
+
+		/// Compares two keys.
+		bool operator==(const Key &) const = default;
+	};
+
+	/**
+	 * Constructs an empty PcmCache.
+	 * @param budget The most decoded audio to hold, in bytes.
+	 * @param max_file_size The largest file, in bytes, worth decoding whole.
+	 */
+	PcmCache(std::size_t budget, std::uint64_t max_file_size);
+
+	/**
+	 * Finds a file's clip, and marks it as the most recently used.
+	 * @param path The path to the file.
+	 * @return The clip, or nullptr if there is none for the file as it is now.
+	 */
+	std::shared_ptr<const PcmClip> Find(const std::string &path);
+
+	/**
+	 * Checks whether a file is small enough to cache.
+	 * @param path The path to the file.
+	 * @return The file's current key if it should be cached, or nothing.
+	 */
+	[[nodiscard]] std::optional<Key> Admits(const std::string &path) const;
+
+	/**
+	 * Stores a clip, dropping older clips as needed to stay in budget.
+	 * Clips larger than the whole budget aren't stored.
+	 * @param key The key of the file before it was decoded, from Admits().
+	 * @param clip The clip.
+	 */
+	void Store(Key key, std::shared_ptr<const PcmClip> clip);
+
+	/**
+	 * Gets how much decoded audio the cache is holding.
+	 * @return The total size of the cached clips, in bytes.
+	 */
+	[[nodiscard]] std::size_t Used() const;
+
+private:
+	/// A cached clip, and the version of the file it came from.
+	struct Entry {
+		Key key;                             ///< The file's key when decoded.
+		std::shared_ptr<const PcmClip> clip; ///< The clip.
+	};
+
+	/// The list of entries, most recently used first.
+	using Entries = std::list<Entry>;
+
+	/// Gets the current key of a file.
+	static std::optional<Key> KeyOf(const std::string &path);
+
+	/// Drops an entry; the lock must be held.
+	void Drop(Entries::iterator it);
+
+	std::size_t budget;          ///< The most decoded audio to hold.
+	std::uint64_t max_file_size; ///< The largest file worth caching.
+
+	mutable std::mutex lock; ///< Guards everything below.
+	Entries entries;         ///< The cached clips, most recently used first.
+	std::unordered_map<std::string, Entries::iterator> by_path; ///< The clips by path.
+	std::size_t used;        ///< The total size of the cached clips.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PCM_CACHE_H
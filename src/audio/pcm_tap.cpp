@@ -0,0 +1,104 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the PcmTap class.
+ * @see audio/pcm_tap.h
+ */
+
+#include "pcm_tap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+PcmTap::PcmTap() : ring(RING_CHUNKS), head{0}, tail{0}, listening{false}, session{0}
+{
+	for (auto &slot : this->ring) {
+		slot.data.resize(CHUNK_BYTES);
+		slot.size = 0;
+		slot.format = SampleFormat::SINT16;
+		slot.channels = 0;
+		slot.rate = 0;
+		slot.session = 0;
+	}
+}
+
+void PcmTap::SetListening(bool now_listening)
+{
+	// Only we take chunks, so we can throw the old ones away; the feeder
+	// throws away its half-filled one when it sees the new session.
+	if (now_listening) {
+		this->Drain([](const Chunk &) {});
+		this->session.fetch_add(1, std::memory_order_relaxed);
+	}
+	this->listening.store(now_listening, std::memory_order_relaxed);
+}
+
+void PcmTap::Feed(const StreamFormat &format, gsl::span<const std::byte> samples)
+{
+	if (!this->listening.load(std::memory_order_relaxed)) return;
+	Expects(0 < format.bytes_per_sample);
+	Expects(samples.size() % format.bytes_per_sample == 0);
+
+	// Chunks end on whole sample frames, so that each stands alone.
+	const auto capacity = CHUNK_BYTES - CHUNK_BYTES % format.bytes_per_sample;
+	const auto session = this->session.load(std::memory_order_relaxed);
+
+	while (!samples.empty()) {
+		const auto head = this->head.load(std::memory_order_relaxed);
+		if (RING_CHUNKS <= head - this->tail.load(std::memory_order_acquire)) return;
+
+		auto &slot = this->ring[head % RING_CHUNKS];
+		if (slot.session != session) slot.size = 0;
+
+		// A chunk is all in one format, so a new file starts a new one.
+		const auto same = slot.format == format.format && slot.channels == format.channels && slot.rate == format.rate;
+		if (slot.size != 0 && !same) {
+			this->Publish(head);
+			continue;
+		}
+		if (slot.size == 0) {
+			slot.format = format.format;
+			slot.channels = format.channels;
+			slot.rate = format.rate;
+			slot.session = session;
+		}
+
+		const auto count = std::min(capacity - slot.size, samples.size());
+		std::copy_n(samples.begin(), count, slot.data.begin() + static_cast<std::ptrdiff_t>(slot.size));
+		slot.size += count;
+		samples = samples.subspan(count);
+
+		if (slot.size == capacity) this->Publish(head);
+	}
+}
+
+void PcmTap::Drain(const ChunkFn &take)
+{
+	const auto head = this->head.load(std::memory_order_acquire);
+	for (auto tail = this->tail.load(std::memory_order_relaxed); tail != head; tail++) {
+		auto &slot = this->ring[tail % RING_CHUNKS];
+		take(Chunk{slot.format, slot.channels, slot.rate, gsl::span<const std::byte>{slot.data}.first(slot.size)});
+
+		// The feeder only sees the slot again once tail has moved past it.
+		slot.size = 0;
+		this->tail.store(tail + 1, std::memory_order_release);
+	}
+}
+
+void PcmTap::Publish(std::size_t head)
+{
+	this->head.store(head + 1, std::memory_order_release);
+}
+
+} // namespace Playd::Audio
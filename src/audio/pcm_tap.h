@@ -0,0 +1,124 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the PcmTap class.
+ * @see audio/pcm_tap.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PCM_TAP_H
+#define PLAYD_AUDIO_PCM_TAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A tap on the samples the loaded file sends to its sink, for clients that
+ * monitor what playd is playing.
+ *
+ * Samples are fed in wherever decoding happens, after the gain, and gathered
+ * into chunks in a ring of buffers allocated up front, so feeding never
+ * allocates or waits.  The player's thread takes each chunk once it is full.
+ * If it falls a whole ring behind, the newest samples are dropped, rather than
+ * holding up decoding.
+ *
+ * Only one thread feeds the tap at a time: it moves from file to file through
+ * their decode locks (see BasicAudio::SetTap()), and only the player's thread
+ * takes from it.
+ */
+class PcmTap
+{
+public:
+	/// The most bytes in a chunk.
+	static constexpr std::size_t CHUNK_BYTES = 16384;
+
+	/// The chunks in the ring.
+	static constexpr std::size_t RING_CHUNKS = 32;
+
+	/// A full chunk of samples, all in one format.
+	struct Chunk {
+		SampleFormat format;                ///< The samples' format.
+		std::uint8_t channels;              ///< The number of interleaved channels.
+		std::uint32_t rate;                 ///< The sample rate, in Hz.
+		gsl::span<const std::byte> samples; ///< The samples, valid only while being taken.
+	};
+
+	/// Type of functions that take chunks.
+	using ChunkFn = std::function<void(const Chunk &)>;
+
+	/// Constructs a PcmTap, allocating its ring.
+	PcmTap();
+
+	/**
+	 * Starts or stops gathering samples.
+	 * Until this turns the tap on, Feed() drops everything, as nobody wants
+	 * it.  On starting, anything left over in the ring from before goes.
+	 * @param listening Whether anyone wants the samples.
+	 */
+	void SetListening(bool listening);
+
+	/**
+	 * Feeds samples into the tap.
+	 * * Precondition: @a samples holds a whole number of sample frames.
+	 * @param format The samples' format.
+	 * @param samples The samples.
+	 */
+	void Feed(const StreamFormat &format, gsl::span<const std::byte> samples);
+
+	/**
+	 * Takes every full chunk, oldest first.
+	 * @param take The function to give each chunk; its samples are only
+	 *   valid while it runs.
+	 */
+	void Drain(const ChunkFn &take);
+
+private:
+	/// One buffer of the ring, and what it holds.
+	struct Slot {
+		std::vector<std::byte> data; ///< The buffer, CHUNK_BYTES long.
+		std::size_t size;            ///< How much of it is filled.
+		SampleFormat format;         ///< The format of what it's filled with.
+		std::uint8_t channels;       ///< The channels of what it's filled with.
+		std::uint32_t rate;          ///< The rate of what it's filled with.
+		std::uint32_t session;       ///< Which time on the tap it's filled from.
+	};
+
+	/// The slots; the feeder fills the one at head, and the taker empties
+	/// those from tail up to it (both modulo RING_CHUNKS).
+	std::vector<Slot> ring;
+
+	/// The chunks finished by the feeder, ever.
+	std::atomic<std::size_t> head;
+
+	/// The chunks taken, ever; the full chunks are those from here to head.
+	std::atomic<std::size_t> tail;
+
+	/// Whether anyone wants the samples.
+	std::atomic<bool> listening;
+
+	/// How many times the tap has been turned on, so that the feeder can
+	/// tell a chunk left half-filled from before.
+	std::atomic<std::uint32_t> session;
+
+	/**
+	 * Finishes the chunk being filled, and moves on to the next.
+	 * @param head The chunk being filled.
+	 */
+	void Publish(std::size_t head);
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PCM_TAP_H
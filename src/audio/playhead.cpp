@@ -0,0 +1,92 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the PlayheadClock class.
+ * @see audio/playhead.h
+ */
+
+#include "playhead.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+PlayheadClock::PlayheadClock(std::uint32_t rate) : rate{rate}
+{
+}
+
+void PlayheadClock::Publish(Samples new_end, Samples new_pending, Clock::time_point new_when)
+{
+	const auto s = this->seq.load(std::memory_order_relaxed);
+	this->seq.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	this->end.store(new_end, std::memory_order_relaxed);
+	this->pending.store(new_pending, std::memory_order_relaxed);
+	this->when.store(new_when.time_since_epoch().count(), std::memory_order_relaxed);
+
+	this->seq.store(s + 2, std::memory_order_release);
+}
+
+PlayheadClock::Snapshot PlayheadClock::Load() const
+{
+	Snapshot snap{};
+	for (;;) {
+		const auto s = this->seq.load(std::memory_order_acquire);
+		// The publisher is mid-write, and will be done in a moment.
+		if (s % 2 != 0) continue;
+
+		snap.end = this->end.load(std::memory_order_relaxed);
+		snap.pending = this->pending.load(std::memory_order_relaxed);
+		snap.when = this->when.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (this->seq.load(std::memory_order_relaxed) == s) {
+			snap.seq = s;
+			return snap;
+		}
+	}
+}
+
+Samples PlayheadClock::Read(Clock::time_point now)
+{
+	const auto snap = this->Load();
+	if (snap.seq == this->held_seq) return this->last;
+	this->held_seq = UINT64_MAX;
+
+	const auto elapsed_ns = std::max<std::int64_t>(now.time_since_epoch().count() - snap.when, 0);
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::duration{elapsed_ns});
+	const auto played = static_cast<Samples>(elapsed.count()) * this->rate / 1000000;
+
+	// Until the pending samples play out, we're behind what's been handed
+	// over; after that, the device is starved, and we can't get ahead.
+	const auto start = snap.end - std::min(snap.pending, snap.end);
+	const auto estimate = start + std::min(played, snap.end - start);
+
+	// Callbacks don't run exactly on time, so a fresh snapshot can land a
+	// little behind where the last one had run on to.
+	this->last = std::max(this->last, estimate);
+	return this->last;
+}
+
+void PlayheadClock::Hold(Clock::time_point now)
+{
+	this->last = this->Read(now);
+	this->held_seq = this->seq.load(std::memory_order_acquire);
+}
+
+void PlayheadClock::Reset(Samples samples, Clock::time_point now)
+{
+	this->Publish(samples, 0, now);
+	this->last = samples;
+	this->held_seq = UINT64_MAX;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,114 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The PlayheadClock class.
+ * @see audio/playhead.cpp
+ */
+
+#ifndef PLAYD_AUDIO_PLAYHEAD_H
+#define PLAYD_AUDIO_PLAYHEAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "sample_format.h"
+
+namespace Playd::Audio
+{
+/**
+ * An estimate of which sample is coming out of the speakers right now.
+ *
+ * Counting the samples handed to the device tells us where the callback has
+ * got to, but those samples still have the device's buffers to get through
+ * before anyone hears them.  Each callback instead publishes how many samples
+ * it has handed over, how many of those are still waiting to play, and when;
+ * reading the clock then works forward from that at the sample rate, and
+ * never passes what has been handed over.
+ *
+ * Publishing goes through a sequence lock, so the callback never waits for a
+ * reader.  There must only be one publisher at a time (the callback, or
+ * whoever holds the device lock) and one reader (the loop thread).
+ */
+class PlayheadClock
+{
+public:
+	/// Type of the clock against which callbacks are timed.
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * Constructs a PlayheadClock at sample 0.
+	 * @param rate The sample rate, in Hz.
+	 */
+	explicit PlayheadClock(std::uint32_t rate);
+
+	/**
+	 * Publishes how far the callback has got.
+	 * This never blocks, and is safe to call from the callback thread.
+	 * @param end The number of samples handed to the device so far.
+	 * @param pending How many of those samples hadn't yet played at @a when.
+	 * @param when When the callback handed them over.
+	 */
+	void Publish(Samples end, Samples pending, Clock::time_point when);
+
+	/**
+	 * Reads the estimated playhead.
+	 * Readings never go backwards, except after a Reset().
+	 * @param now The current time.
+	 * @return The number of samples played by @a now.
+	 */
+	[[nodiscard]] Samples Read(Clock::time_point now);
+
+	/**
+	 * Stops the clock, at its reading at @a now, until the next Publish().
+	 * This is for when the device stops taking samples, so the clock
+	 * shouldn't keep running on from the last callback.
+	 * @param now The current time.
+	 */
+	void Hold(Clock::time_point now);
+
+	/**
+	 * Moves the clock to a new position, as if everything up to it had
+	 * played.  This publishes, so the caller must stop the callback from
+	 * publishing at the same time.
+	 * @param samples The new position.
+	 * @param now The current time.
+	 */
+	void Reset(Samples samples, Clock::time_point now);
+
+private:
+	/// A published position.
+	struct Snapshot {
+		Samples end;        ///< Samples handed over.
+		Samples pending;    ///< Samples still to play at the time.
+		std::int64_t when;  ///< When, in Clock nanoseconds.
+		std::uint64_t seq;  ///< The sequence number it was published at.
+	};
+
+	/**
+	 * Copies out the last published position.
+	 * @return The snapshot.
+	 */
+	[[nodiscard]] Snapshot Load() const;
+
+	std::uint32_t rate; ///< The sample rate, in Hz.
+
+	std::atomic<std::uint64_t> seq{0};  ///< Sequence lock; odd mid-publish.
+	std::atomic<Samples> end{0};        ///< Published samples handed over.
+	std::atomic<Samples> pending{0};    ///< Published samples still to play.
+	std::atomic<std::int64_t> when{0};  ///< Published time of handover.
+
+	/// The last reading, which later readings can't go below.
+	/// Only the reader touches this.
+	Samples last{0};
+
+	/// The sequence number of the snapshot we are holding at, if holding.
+	/// Only the reader touches this.
+	std::uint64_t held_seq{UINT64_MAX};
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_PLAYHEAD_H
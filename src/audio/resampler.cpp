@@ -0,0 +1,360 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Resampler and ResampledSource classes.
+ * @see audio/resampler.h
+ */
+
+#include "resampler.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <numbers>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLAYD_RESAMPLER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PLAYD_RESAMPLER_NEON
+#include <arm_neon.h>
+#endif
+
+#include "../errors.h"
+#include "convert.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/// Filter parameters for one Resampler::Quality.
+struct FilterSpec {
+	size_t taps;   ///< Filter length when not downsampling.
+	double beta;   ///< Kaiser window shape; higher means more stopband.
+	double cutoff; ///< Passband edge, as a fraction of the output Nyquist.
+};
+
+/// Filter parameters, by Resampler::Quality.
+static constexpr std::array<FilterSpec, 3> FILTER_SPECS{{
+        {16, 6.0, 0.90}, // LOW
+        {32, 8.0, 0.94}, // MEDIUM
+        {64, 10.0, 0.97} // HIGH
+}};
+
+/// The zeroth-order modified Bessel function, for the Kaiser window.
+static double BesselI0(double x)
+{
+	// The series converges quickly for the betas we use.
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+ * Dot product of two runs of floats.
+ * @param a The first run.
+ * @param b The second run.
+ * @param n The length of both runs; must be a multiple of 8.
+ */
+static float Dot(const float *a, const float *b, size_t n)
+{
+	assert(n % 8 == 0);
+
+#if defined(PLAYD_RESAMPLER_SSE2)
+	auto acc0 = _mm_setzero_ps();
+	auto acc1 = _mm_setzero_ps();
+	for (size_t i = 0; i < n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	auto sums = _mm_add_ps(acc0, acc1);
+	sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+	sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+	return _mm_cvtss_f32(sums);
+#elif defined(PLAYD_RESAMPLER_NEON)
+	auto acc0 = vdupq_n_f32(0.0f);
+	auto acc1 = vdupq_n_f32(0.0f);
+	for (size_t i = 0; i < n; i += 8) {
+		acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+		acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+	float sum = 0.0f;
+	for (size_t i = 0; i < n; i++) sum += a[i] * b[i];
+	return sum;
+#endif
+}
+
+//
+// Resampler
+//
+
+Resampler::Resampler(std::uint32_t in_rate, std::uint32_t out_rate, std::uint8_t channels, Quality quality)
+    : channels{channels}, step{0}, span{0}, phases{0}, taps{0}, history(channels), base{0}, frac{0}
+{
+	Expects(0 < in_rate);
+	Expects(0 < out_rate);
+	Expects(0 < channels);
+
+	const auto g = std::gcd(in_rate, out_rate);
+	this->step = in_rate / g;
+	this->span = out_rate / g;
+	this->phases = std::min(this->span, MAX_PHASES);
+
+	this->MakeFilter(quality);
+	this->Reset();
+}
+
+void Resampler::MakeFilter(Quality quality)
+{
+	const auto &spec = FILTER_SPECS[static_cast<int>(quality)];
+
+	// When downsampling, the cutoff has to drop to the output's Nyquist
+	// frequency, and the filter has to get longer to keep the same
+	// transition band.
+	const auto ratio = std::min(1.0, static_cast<double>(this->span) / this->step);
+	const auto wanted = static_cast<size_t>(std::ceil(static_cast<double>(spec.taps) / ratio));
+	this->taps = (std::min(wanted, MAX_TAPS) + 7) & ~size_t{7};
+
+	const auto cutoff = spec.cutoff * ratio;
+	const auto half = static_cast<double>(this->taps) / 2.0;
+	const auto centre = half - 1.0;
+	const auto norm = BesselI0(spec.beta);
+
+	this->filter.assign(this->phases * this->taps, 0.0f);
+	std::vector<double> coeffs(this->taps);
+	for (std::uint32_t p = 0; p < this->phases; p++) {
+		auto *row = &this->filter[p * this->taps];
+		const auto offset = static_cast<double>(p) / this->phases;
+
+		double sum = 0.0;
+		for (size_t k = 0; k < this->taps; k++) {
+			const auto d = static_cast<double>(k) - centre - offset;
+			const auto x = std::numbers::pi * cutoff * d;
+			const auto sinc = (d == 0.0) ? 1.0 : std::sin(x) / x;
+
+			const auto w = d / half;
+			const auto window = (1.0 <= std::abs(w)) ? 0.0 : BesselI0(spec.beta * std::sqrt(1.0 - w * w)) / norm;
+
+			coeffs[k] = sinc * window;
+			sum += coeffs[k];
+		}
+
+		// Normalising each phase separately keeps the gain flat at DC,
+		// whichever phase a sample lands on.
+		for (size_t k = 0; k < this->taps; k++) row[k] = static_cast<float>(coeffs[k] / sum);
+	}
+}
+
+void Resampler::Push(gsl::span<const float> in)
+{
+	Expects(in.size() % this->channels == 0);
+
+	const auto frames = in.size() / this->channels;
+	for (size_t c = 0; c < this->channels; c++) {
+		auto &plane = this->history[c];
+		const auto old_size = plane.size();
+		plane.resize(old_size + frames);
+		for (size_t i = 0; i < frames; i++) plane[old_size + i] = in[i * this->channels + c];
+	}
+}
+
+size_t Resampler::Pull(gsl::span<float> out)
+{
+	const auto available = this->history[0].size();
+	const auto want = out.size() / this->channels;
+
+	size_t produced = 0;
+	while (produced < want && this->base + this->taps <= available) {
+		const auto phase = (static_cast<std::uint64_t>(this->frac) * this->phases) / this->span;
+		const auto *row = &this->filter[phase * this->taps];
+
+		for (size_t c = 0; c < this->channels; c++) {
+			out[produced * this->channels + c] = Dot(row, &this->history[c][this->base], this->taps);
+		}
+
+		this->frac += this->step;
+		this->base += this->frac / this->span;
+		this->frac %= this->span;
+		produced++;
+	}
+
+	// Drop the input we've moved past, so the history stays short.
+	// When downsampling, base can run past the end of the input we have.
+	const auto used = std::min(this->base, available);
+	if (0 < used) {
+		for (auto &plane : this->history) plane.erase(plane.begin(), plane.begin() + used);
+		this->base -= used;
+	}
+
+	return produced;
+}
+
+void Resampler::Drain()
+{
+	// Enough silence for the last real sample to reach the filter's centre.
+	const auto silence = this->taps / 2 + 1;
+	for (auto &plane : this->history) plane.resize(plane.size() + silence, 0.0f);
+}
+
+void Resampler::Reset()
+{
+	// Priming with silence puts the first real sample at the filter's
+	// centre, so the output isn't delayed relative to the input.
+	const auto silence = this->taps / 2 - 1;
+	for (auto &plane : this->history) plane.assign(silence, 0.0f);
+
+	this->base = 0;
+	this->frac = 0;
+}
+
+size_t Resampler::Taps() const
+{
+	return this->taps;
+}
+
+size_t Resampler::ScratchBytes() const
+{
+	auto bytes = this->filter.capacity() * sizeof(float);
+	for (const auto &plane : this->history) bytes += plane.capacity() * sizeof(float);
+	return bytes;
+}
+
+//
+// ResampledSource
+//
+
+ResampledSource::ResampledSource(std::unique_ptr<Source> inner, std::uint32_t out_rate, Resampler::Quality quality)
+    : Source{inner->Path()},
+      inner{std::move(inner)},
+      out_rate{out_rate},
+      resampler{this->inner->SampleRate(), out_rate, this->inner->ChannelCount(), quality},
+      raw(this->inner->FrameBytes()),
+      floats(this->raw.size() / sample_format_bps[static_cast<int>(this->inner->OutputSampleFormat())]),
+      inner_done{false}
+{
+	if (!CanConvert(this->inner->OutputSampleFormat(), SampleFormat::FLOAT32)) {
+		throw FileError("can't resample sample format");
+	}
+}
+
+ResampledSource::DecodeSpanResult ResampledSource::Decode(gsl::span<std::byte> out)
+{
+	Expects(out.size() % this->BytesPerSample() == 0);
+	if (out.empty()) return std::make_pair(DecodeState::DECODING, 0);
+
+	// As with the sndfile source, spans of whole samples will be aligned.
+	assert(reinterpret_cast<std::uintptr_t>(out.data()) % alignof(float) == 0);
+	const gsl::span<float> dest(reinterpret_cast<float *>(out.data()), out.size() / sizeof(float));
+
+	const auto in_format = this->inner->OutputSampleFormat();
+	const auto in_bps = sample_format_bps[static_cast<int>(in_format)];
+
+	// Keep feeding the resampler until it has something to give us, so
+	// that we don't hand back empty rounds just because the filter was
+	// waiting for a few more input samples.
+	for (;;) {
+		const auto produced = this->resampler.Pull(dest);
+		if (0 < produced) return std::make_pair(DecodeState::DECODING, produced * this->BytesPerSample());
+		if (this->inner_done) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+		const auto [state, count] = this->inner->Decode(this->raw);
+		if (0 < count) {
+			const auto mono_count = count / in_bps;
+			const auto in_floats = gsl::span<float>(this->floats).first(mono_count);
+			const gsl::span<std::byte> converted(reinterpret_cast<std::byte *>(in_floats.data()),
+			                                     mono_count * sizeof(float));
+			ConvertSamples(in_format, SampleFormat::FLOAT32, gsl::span<const std::byte>(this->raw).first(count),
+			               converted);
+			this->resampler.Push(in_floats);
+		}
+
+		if (state == DecodeState::END_OF_FILE) {
+			this->resampler.Drain();
+			this->inner_done = true;
+			continue;
+		}
+
+		// The inner source didn't finish a frame this round; neither can we.
+		if (count == 0) return std::make_pair(DecodeState::DECODING, 0);
+	}
+}
+
+std::uint64_t ResampledSource::Seek(std::uint64_t position)
+{
+	const auto in_rate = this->inner->SampleRate();
+
+	const auto in_position = this->inner->Seek(Rescale(position, this->out_rate, in_rate));
+
+	// Nothing we've buffered is any use at the new position.
+	this->resampler.Reset();
+	this->inner_done = false;
+
+	return Rescale(in_position, in_rate, this->out_rate);
+}
+
+std::uint64_t ResampledSource::Length() const
+{
+	return Rescale(this->inner->Length(), this->inner->SampleRate(), this->out_rate);
+}
+
+std::uint8_t ResampledSource::ChannelCount() const
+{
+	return this->inner->ChannelCount();
+}
+
+std::uint32_t ResampledSource::SampleRate() const
+{
+	return this->out_rate;
+}
+
+SampleFormat ResampledSource::OutputSampleFormat() const
+{
+	return SampleFormat::FLOAT32;
+}
+
+std::optional<StreamStats> ResampledSource::Streaming() const
+{
+	return this->inner->Streaming();
+}
+
+std::size_t ResampledSource::ScratchBytes() const
+{
+	return this->inner->ScratchBytes() + this->resampler.ScratchBytes() + this->raw.capacity() +
+	       this->floats.capacity() * sizeof(float);
+}
+
+std::uint64_t ResampledSource::SkippedFrames() const
+{
+	return this->inner->SkippedFrames();
+}
+
+ConversionList ResampledSource::Conversions() const
+{
+	auto steps = this->inner->Conversions();
+	const auto in_format = this->inner->OutputSampleFormat();
+	if (in_format != SampleFormat::FLOAT32) steps.push_back(DescribeConversion(in_format, SampleFormat::FLOAT32));
+	steps.push_back(std::to_string(this->inner->SampleRate()) + ">" + std::to_string(this->out_rate) + "Hz");
+	return steps;
+}
+
+/* static */ std::uint64_t ResampledSource::Rescale(std::uint64_t samples, std::uint32_t from, std::uint32_t to)
+{
+	return (samples * to) / from;
+}
+
+} // namespace Playd::Audio
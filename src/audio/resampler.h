@@ -0,0 +1,179 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The Resampler and ResampledSource classes.
+ * @see audio/resampler.cpp
+ */
+
+#ifndef PLAYD_AUDIO_RESAMPLER_H
+#define PLAYD_AUDIO_RESAMPLER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "rt_memory.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A streaming polyphase resampler for packed FLOAT32 audio.
+ *
+ * This converts between any two sample rates by windowed-sinc interpolation.
+ * The filter is precomputed as a bank of phases; each output sample picks the
+ * phase nearest to where it falls between two input samples, and is one dot
+ * product of that phase against the input history.  Where the ratio between
+ * the two rates is simple enough (as with 44.1 kHz and 48 kHz), there is one
+ * phase per possible position, and the interpolation is exact.
+ *
+ * Input goes in with Push(), and output comes out with Pull(); the two don't
+ * need to line up, as the resampler keeps whatever input it has yet to use.
+ */
+class Resampler
+{
+public:
+	/// Trade-offs between resampling quality and CPU time.
+	enum class Quality : std::uint8_t {
+		LOW,    ///< Short filters; fine for speech and previews.
+		MEDIUM, ///< The default; inaudible on music for most listeners.
+		HIGH,   ///< Long filters with a sharp cutoff.
+	};
+
+	/**
+	 * Constructs a Resampler.
+	 * @param in_rate The sample rate of the input, in Hz.
+	 * @param out_rate The sample rate of the output, in Hz.
+	 * @param channels The number of interleaved channels.
+	 * @param quality The quality/CPU trade-off to make.
+	 */
+	Resampler(std::uint32_t in_rate, std::uint32_t out_rate, std::uint8_t channels, Quality quality);
+
+	/**
+	 * Adds input samples to the resampler.
+	 * @param in Packed input samples; must be a whole number of samples.
+	 */
+	void Push(gsl::span<const float> in);
+
+	/**
+	 * Produces as many output samples as the input so far allows.
+	 * @param out Space for packed output samples.
+	 * @return The number of (multi-channel) samples written into @a out.
+	 */
+	size_t Pull(gsl::span<float> out);
+
+	/**
+	 * Pushes enough silence through the filter to get the last of the real
+	 * input out of it; call this once the input has ended.
+	 */
+	void Drain();
+
+	/// Forgets all input, ready to resample from a new position.
+	void Reset();
+
+	/**
+	 * The filter's length.
+	 * @return The number of input samples that go into each output sample.
+	 */
+	[[nodiscard]] size_t Taps() const;
+
+	/// @return How much memory the filter bank and history take up, in bytes.
+	[[nodiscard]] size_t ScratchBytes() const;
+
+private:
+	/// The most filter phases we'll store, to bound the table's size.
+	static constexpr std::uint32_t MAX_PHASES = 1024;
+
+	/// The longest filter we'll use, however far we're downsampling.
+	static constexpr size_t MAX_TAPS = 256;
+
+	/// Builds the filter bank for the given quality.
+	void MakeFilter(Quality quality);
+
+	std::uint8_t channels; ///< Number of interleaved channels.
+	std::uint32_t step;    ///< Input rate, divided by gcd(input, output).
+	std::uint32_t span;    ///< Output rate, divided by gcd(input, output).
+	std::uint32_t phases;  ///< Number of filter phases.
+	size_t taps;           ///< Filter length, padded to a multiple of 8.
+
+	/// The filter bank: phases rows of taps coefficients each.
+	std::vector<float> filter;
+
+	/// Unused input, one plane per channel.
+	std::vector<std::vector<float>> history;
+
+	/// Index, into each history plane, of the next output's first tap.
+	size_t base;
+
+	/// How far, in 1/span units, the next output lies past base.
+	std::uint32_t frac;
+};
+
+/**
+ * A Source that resamples another Source to a fixed rate.
+ *
+ * This sits between the decoder and the sink, so that every file reaches the
+ * sink (and the output device) at the same rate, whatever rate it was
+ * recorded at.  Its output is always FLOAT32.
+ */
+class ResampledSource : public Source
+{
+public:
+	/**
+	 * Constructs a ResampledSource.
+	 * @param inner The Source to resample.
+	 * @param out_rate The rate at which to output samples, in Hz.
+	 * @param quality The quality/CPU trade-off to make.
+	 * @exception FileError if @a inner's samples can't be resampled.
+	 */
+	ResampledSource(std::unique_ptr<Source> inner, std::uint32_t out_rate, Resampler::Quality quality);
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+private:
+	/**
+	 * Converts a sample count from one rate to another, rounding down.
+	 * @param samples The sample count at @a from Hz.
+	 * @param from The rate of @a samples.
+	 * @param to The rate to convert to.
+	 * @return The equivalent sample count at @a to Hz.
+	 */
+	static std::uint64_t Rescale(std::uint64_t samples, std::uint32_t from, std::uint32_t to);
+
+	std::unique_ptr<Source> inner; ///< The Source being resampled.
+	std::uint32_t out_rate;        ///< The output rate, in Hz.
+	Resampler resampler;           ///< The resampler doing the work.
+	RtVector<std::byte> raw;       ///< Samples decoded by the inner Source.
+	RtVector<float> floats;        ///< The same samples, as FLOAT32.
+	bool inner_done;               ///< Whether the inner Source has ended.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_RESAMPLER_H
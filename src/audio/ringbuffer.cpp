@@ -8,11 +8,11 @@
 
 #include "ringbuffer.h"
 
+#include <algorithm>
 #include <atomic>
-#include <cassert>
+#include <bit>
 #include <cstddef>
 #include <gsl/gsl>
-#include <mutex>
 #include <vector>
 
 #include "../errors.h"
@@ -21,47 +21,66 @@ namespace Playd::Audio
 {
 /* Assumptions:
 
-   1) single producer, single consumer, enforced by locks.
-      - when reading, count can only increase (read capacity can only increase)
-      - when writing, count can only decrease (write capacity can only increase)
-      - only the reader can move the read pointer, and it may do so
-   non-atomically
-      - only the writer can move the write pointer, and it may do so
-   non-atomically 2) capacities always underestimate
-      - when reading, ATOMICALLY decrease count (increase read capacity) AFTER
-   read read capacity may be lower than actual
-      - when writing, ATOMICALLY increase count (read capacity) AFTER write
-                      write capacity may be lower than actual
-      - always atomically read capacities */
-
-RingBuffer::RingBuffer(size_t capacity) : buffer(capacity), count{0}
+   1) single producer, single consumer, by contract (no locks).
+      - write_count only ever increases, and only the producer stores to it;
+      - read_count only ever increases, and is normally only moved by the
+        consumer; the one exception is Flush(), where the producer may move
+        it forwards with a CAS, but only while the consumer isn't reading.
+   2) capacities always underestimate
+      - the producer publishes write_count with release AFTER copying in,
+        so the consumer never sees bytes before they exist;
+      - the consumer publishes read_count with release AFTER copying out,
+        so the producer never overwrites bytes still being read.
+   3) flushes are handshakes
+      - the producer publishes flush_point (the write count at the flush)
+        and bumps flush_epoch;
+      - whoever next gets hold of read_count (the consumer on its next read,
+        or the producer if the consumer is idle) moves it up to
+        flush_point.  Counters are monotonic, so moving to
+        max(read_count, flush_point) is always safe. */
+
+RingBuffer::RingBuffer(size_t capacity)
+    : buffer(std::bit_ceil(capacity)),
+      mask{buffer.size() - 1},
+      write_count{0},
+      read_count{0},
+      seen_flush_epoch{0},
+      flush_epoch{0},
+      flush_point{0}
 {
-	this->r_it = this->buffer.cbegin();
-	this->w_it = this->buffer.begin();
-
-	// Only one thread can hold this at the moment, so we're ok to
-	// do this without locks.
-	this->FlushInner();
+	Expects(0 < capacity);
 
 	Ensures(ReadCapacity() == 0);
-	Ensures(WriteCapacity() == capacity);
+	Ensures(capacity <= WriteCapacity());
+}
+
+size_t RingBuffer::Capacity() const
+{
+	return this->buffer.size();
 }
 
-inline size_t RingBuffer::ReadCapacity() const
+size_t RingBuffer::ReadCapacity() const
 {
-	/* Acquire order here means two things:
-	 *
-	 * 1) no other loads in the thread checking WriteCapacity (ie the
-	 *    producer) can be ordered before it;
-	 * 2) this load sees all 'release' writes in other threads (usually
-	 *    consumers increasing the write capacity).
+	/* Acquire order on write_count means this load sees all of the bytes
+	 * the producer wrote before publishing it.  We also account for any
+	 * flush the consumer has yet to see, so that a flush looks immediate
+	 * from the outside.
 	 */
-	return this->count.load(std::memory_order_acquire);
+	const auto written = this->write_count.load(std::memory_order_acquire);
+	const auto read = this->read_count.load(std::memory_order_acquire) & ~READING;
+	const auto flushed = this->flush_point.load(std::memory_order_acquire);
+	return written - std::max(read, flushed);
 }
 
-inline size_t RingBuffer::WriteCapacity() const
+size_t RingBuffer::WriteCapacity() const
 {
-	return this->buffer.size() - ReadCapacity();
+	/* We deliberately ignore pending flushes here: until the consumer (or
+	 * Flush()) has moved read_count, the consumer may still be copying
+	 * out of the old data, so we can't overwrite it yet.
+	 */
+	const auto written = this->write_count.load(std::memory_order_relaxed);
+	const auto read = this->read_count.load(std::memory_order_acquire) & ~READING;
+	return this->buffer.size() - (written - read);
 }
 
 size_t RingBuffer::Write(const gsl::span<const std::byte> src)
@@ -70,58 +89,59 @@ size_t RingBuffer::Write(const gsl::span<const std::byte> src)
 	const auto src_count = static_cast<size_t>(src.size());
 	Expects(0 < src_count);
 
-	/* Acquire write lock to make sure only one write can occur at a given
-	 * time, and also that we can't be flushed in the middle of writing.
-	 *
-	 * This ensures that the write capacity can only go up from when we
-	 * read it here.
-	 */
-	std::lock_guard<std::mutex> w_guard(this->w_lock);
-
 	/* Remember, this is pessimistic:
 	 * the write capacity can be increased after this point by a consumer.
 	 */
-	const auto write_capacity_estimate = WriteCapacity();
-	if (write_capacity_estimate < src_count) throw InternalError("ringbuffer overflow");
-
-	// Trim the span down to the amount we can write.
-	auto write_count = std::min(write_capacity_estimate, src_count);
-	const auto src_to_write = src.first(write_count);
+	if (WriteCapacity() < src_count) throw InternalError("ringbuffer overflow");
 
 	/* At this stage, we're the only thread that can be accessing this part
 	 * of the buffer, so we can proceed non-atomically.  The release we do
 	 * at the end makes our changes available to the consumer.
 	 */
+	const auto written = this->write_count.load(std::memory_order_relaxed);
+	const auto offset = written & this->mask;
+
 	// Ringbuffers loop, so how many bytes can we store until we have to
 	// loop?
-	const auto bytes_to_end = distance(this->w_it, this->buffer.end());
-	// Make sure we got the iterators the right way round.
-	assert(0 <= bytes_to_end);
-
-	auto write_end_count = std::min(write_count, static_cast<size_t>(bytes_to_end));
-
-	const auto src_end = src_to_write.first(write_end_count);
-	this->w_it = copy(src_end.begin(), src_end.end(), this->w_it);
+	const auto write_end_count = std::min(src_count, this->buffer.size() - offset);
+	std::copy_n(src.begin(), write_end_count, this->buffer.begin() + offset);
 
 	// Do we need to loop?  If so, do that.
-	auto write_start_count = write_count - write_end_count;
+	const auto write_start_count = src_count - write_end_count;
 	if (0 < write_start_count) {
-		Expects(this->w_it == this->buffer.end());
-		const auto src_start = src_to_write.last(write_start_count);
-		this->w_it = copy(src_start.begin(), src_start.end(), this->buffer.begin());
-		Ensures(this->w_it > this->buffer.begin());
+		std::copy_n(src.begin() + write_end_count, write_start_count, this->buffer.begin());
 	}
 
-	/* Now tell the consumer it can read some more data (this HAS to be done
-	 * here, to avoid the consumer over-reading).
-	 *
-	 * Because the other thread might have moved count since we last checked
-	 * it, this needs to be acquire-release.
-	 */
-	this->count.fetch_add(write_count, std::memory_order_acq_rel);
+	// Now tell the consumer it can read some more data.
+	this->write_count.store(written + src_count, std::memory_order_release);
+
+	Ensures(write_start_count + write_end_count == src_count);
+	return src_count;
+}
 
-	Ensures(write_start_count + write_end_count == write_count);
-	return write_count;
+gsl::span<std::byte> RingBuffer::AcquireWrite()
+{
+	const auto written = this->write_count.load(std::memory_order_relaxed);
+	const auto offset = written & this->mask;
+
+	// We can't lend out space past the end of the buffer, as the caller
+	// expects one contiguous region.
+	const auto count = std::min(WriteCapacity(), this->buffer.size() - offset);
+	return gsl::span<std::byte>{this->buffer}.subspan(offset, count);
+}
+
+void RingBuffer::CommitWrite(size_t count)
+{
+	const auto written = this->write_count.load(std::memory_order_relaxed);
+	const auto offset = written & this->mask;
+
+	// This should never be more than AcquireWrite() lent out.
+	if (WriteCapacity() < count || this->buffer.size() - offset < count) {
+		throw InternalError("ringbuffer overflow");
+	}
+
+	// As in Write(), this makes the new bytes available to the consumer.
+	this->write_count.store(written + count, std::memory_order_release);
 }
 
 size_t RingBuffer::Read(gsl::span<std::byte> dest)
@@ -129,63 +149,119 @@ size_t RingBuffer::Read(gsl::span<std::byte> dest)
 	const auto dest_count = static_cast<size_t>(dest.size());
 	Expects(0 < dest_count);
 
-	/* Acquire read lock to make sure only one read can occur at a given
-	 * time, and also that we can't be flushed in the middle of reading.
-	 *
-	 * This ensures that the read capacity can only go up from when we
-	 * read it here.
-	 */
-	std::lock_guard<std::mutex> r_guard(this->r_lock);
+	const auto from = this->ClaimRead();
+	const auto available = this->write_count.load(std::memory_order_acquire) - from;
+	if (available < dest_count) {
+		this->ReleaseRead(from);
+		throw InternalError("ringbuffer underflow");
+	}
 
-	/* Remember, this is pessimistic:
-	 * the read capacity can be increased after this point by a producer.
-	 */
-	const auto read_capacity_estimate = ReadCapacity();
-	if (read_capacity_estimate < dest_count) throw InternalError("ringbuffer underflow");
+	return this->ReadClaimed(from, dest);
+}
 
+size_t RingBuffer::ReadSome(gsl::span<std::byte> dest)
+{
+	const auto from = this->ClaimRead();
+	const auto available = this->write_count.load(std::memory_order_acquire) - from;
+	const auto read_count = std::min(available, static_cast<size_t>(dest.size()));
+	if (read_count == 0) {
+		this->ReleaseRead(from);
+		return 0;
+	}
+
+	return this->ReadClaimed(from, dest.first(read_count));
+}
+
+size_t RingBuffer::Skip(size_t count)
+{
+	const auto from = this->ClaimRead();
+	const auto available = this->write_count.load(std::memory_order_acquire) - from;
+	const auto skipped = std::min(available, count);
+
+	// This frees the skipped bytes, just as reading them would.
+	this->ReleaseRead(from + skipped);
+	return skipped;
+}
+
+size_t RingBuffer::ReadClaimed(size_t from, gsl::span<std::byte> dest)
+{
 	/* See Write() for explanatory comments on what happens here:
 	 * the two functions mirror each other almost perfectly.
 	 */
+	const auto dest_count = static_cast<size_t>(dest.size());
+	const auto offset = from & this->mask;
 
-	auto read_count = std::min(read_capacity_estimate, dest_count);
-	const auto dest_to_read = dest.first(read_count);
-
-	const auto bytes_to_end = distance(this->r_it, this->buffer.cend());
-	assert(0 <= bytes_to_end);
-
-	auto read_end_count = std::min(read_count, static_cast<size_t>(bytes_to_end));
-	auto rest = copy_n(this->r_it, read_end_count, dest_to_read.begin());
-	this->r_it += read_end_count;
+	const auto read_end_count = std::min(dest_count, this->buffer.size() - offset);
+	std::copy_n(this->buffer.cbegin() + offset, read_end_count, dest.begin());
 
-	auto read_start_count = read_count - read_end_count;
+	const auto read_start_count = dest_count - read_end_count;
 	if (0 < read_start_count) {
-		Expects(this->r_it == this->buffer.cend());
-		copy_n(this->buffer.cbegin(), read_start_count, rest);
-		this->r_it = this->buffer.cbegin() + read_start_count;
-		Ensures(this->r_it > this->buffer.cbegin());
+		std::copy_n(this->buffer.cbegin(), read_start_count, dest.begin() + read_end_count);
 	}
 
-	if (this->count.fetch_sub(read_count, std::memory_order_acq_rel) < read_count)
-		throw InternalError("capacity decreased unexpectedly");
+	this->ReleaseRead(from + dest_count);
 
-	Ensures(read_start_count + read_end_count == read_count);
-	return read_count;
+	Ensures(read_start_count + read_end_count == dest_count);
+	return dest_count;
 }
 
-void RingBuffer::Flush()
+size_t RingBuffer::ClaimRead()
 {
-	// Make sure nothing is reading or writing.
-	std::lock_guard<std::mutex> r_guard(this->r_lock);
-	std::lock_guard<std::mutex> w_guard(this->w_lock);
+	/* Setting READING stops the producer from retiring data underneath us
+	 * in Flush(); it also tells us whether the producer did so while we
+	 * weren't looking, as we get back the read count it left.
+	 */
+	const auto from = this->read_count.fetch_or(READING, std::memory_order_acquire);
+	Expects((from & READING) == 0);
 
-	FlushInner();
+	return this->ApplyPendingFlush(from);
+}
 
-	Ensures(this->ReadCapacity() == 0);
+void RingBuffer::ReleaseRead(size_t new_read_count)
+{
+	/* A flush may have arrived while we were reading; if so, we may as well
+	 * handle it now rather than wait for the next read.  If one arrives
+	 * after this check, the next ClaimRead() will pick it up.
+	 */
+	const auto to = this->ApplyPendingFlush(new_read_count);
+	Expects((to & READING) == 0);
+
+	// This clears READING, and frees the space we just read to the producer.
+	this->read_count.store(to, std::memory_order_release);
+}
+
+size_t RingBuffer::ApplyPendingFlush(size_t from)
+{
+	const auto epoch = this->flush_epoch.load(std::memory_order_acquire);
+	if (epoch == this->seen_flush_epoch) return from;
+
+	this->seen_flush_epoch = epoch;
+	return std::max(from, this->flush_point.load(std::memory_order_acquire));
 }
 
-inline void RingBuffer::FlushInner()
+void RingBuffer::Flush()
 {
-	this->count.store(0, std::memory_order_release);
+	// Everything written so far is now stale.
+	const auto written = this->write_count.load(std::memory_order_relaxed);
+
+	this->flush_point.store(written, std::memory_order_release);
+	this->flush_epoch.fetch_add(1, std::memory_order_release);
+
+	/* If the consumer isn't in the middle of a read, we can retire the
+	 * stale data ourselves; this gets the write capacity back straight
+	 * away, which matters when the sink is stopped and the consumer won't
+	 * be along for a while.  If the consumer starts reading under us, the
+	 * exchange fails and the consumer applies the flush instead.
+	 */
+	auto read = this->read_count.load(std::memory_order_acquire);
+	while ((read & READING) == 0 && read < written) {
+		if (this->read_count.compare_exchange_weak(read, written, std::memory_order_acq_rel,
+		                                           std::memory_order_acquire)) {
+			break;
+		}
+	}
+
+	Ensures(this->ReadCapacity() == 0);
 }
 
 } // namespace Playd::Audio
@@ -10,26 +10,38 @@
 #define PLAYD_RING_BUFFER_HPP
 
 #include <atomic>
-#include <mutex>
+#include <cstddef>
 #include <vector>
 
 #undef max
 #include <gsl/gsl>
 
+#include "rt_memory.h"
+
 namespace Playd::Audio
 {
 /**
- * A concurrent ring buffer.
+ * A wait-free, single-producer single-consumer ring buffer.
+ *
+ * The capacity is always a power of two, so the read and write counters can
+ * run freely and be masked down to buffer offsets.  Each counter sits on its
+ * own cache line, so the producer (the decoder) and the consumer (the audio
+ * callback) don't fight over the same line on every transfer.
  *
- * This is not particularly efficient, but does the job for playd.
- * It uses two release-acquire-atomic counters to store read and write.
+ * Neither side ever takes a lock.  In particular, Flush() is a handshake
+ * rather than a critical section: the producer publishes a new flush epoch
+ * and the point up to which data is to be discarded, and the consumer skips
+ * to that point the next time it reads.  If the consumer isn't mid-read, the
+ * producer retires the old data itself, so a flush on a stopped sink takes
+ * effect immediately.
  */
 class RingBuffer
 {
 public:
 	/**
 	 * Constructs a Ring_buffer.
-	 * @param capacity The capacity of the ring buffer, in bytes.
+	 * @param capacity The minimum capacity of the ring buffer, in bytes.
+	 *   This is rounded up to the next power of two.
 	 */
 	explicit RingBuffer(size_t capacity);
 
@@ -42,22 +54,31 @@ public:
 	/// Deleted copy-assignment.
 	RingBuffer &operator=(const RingBuffer &) = delete;
 
+	/**
+	 * The total capacity.
+	 * @return The number of bytes this ring buffer can hold when empty.
+	 */
+	[[nodiscard]] size_t Capacity() const;
+
 	/**
 	 * The current write capacity.
+	 * This is pessimistic: the consumer may free more space at any time.
 	 * @return The number of samples this ring buffer has space to store.
 	 * @see Write
 	 */
-	size_t WriteCapacity() const;
+	[[nodiscard]] size_t WriteCapacity() const;
 
 	/**
 	 * The current read capacity.
+	 * This is pessimistic: the producer may add more data at any time.
 	 * @return The number of samples available in this ring buffer.
 	 * @see Read
 	 */
-	size_t ReadCapacity() const;
+	[[nodiscard]] size_t ReadCapacity() const;
 
 	/**
 	 * Writes samples from a span into the ring buffer.
+	 * This must only be called from the producer thread.
 	 *
 	 * * Precondition: @a src is a valid span.
 	 * * Postcondition: The ringbuffer has been written to with the contents
@@ -69,8 +90,32 @@ public:
 	 */
 	size_t Write(gsl::span<const std::byte> src);
 
+	/**
+	 * Lends out the free space at the write position, for writing in place.
+	 * This must only be called from the producer thread.
+	 *
+	 * The region is contiguous, so it may be smaller than WriteCapacity()
+	 * if the free space wraps around the end of the buffer.  Nothing in
+	 * the region is visible to the consumer until CommitWrite().
+	 *
+	 * @return A span over the contiguous free space; may be empty.
+	 * @see CommitWrite
+	 */
+	gsl::span<std::byte> AcquireWrite();
+
+	/**
+	 * Publishes bytes written into the region lent by AcquireWrite().
+	 * This must only be called from the producer thread.
+	 *
+	 * @param count The number of bytes written, from the start of the
+	 *   region; must be no larger than the region.
+	 * @see AcquireWrite
+	 */
+	void CommitWrite(size_t count);
+
 	/**
 	 * Reads samples from the ring buffer into an array.
+	 * This must only be called from the consumer thread.
 	 * To read one sample, pass a count of 1 and take a pointer to the
 	 * sample variable.
 	 *
@@ -86,23 +131,88 @@ public:
 	 */
 	size_t Read(gsl::span<std::byte> dest);
 
-	/// Empties the ring buffer.
+	/**
+	 * Reads as many bytes as are available, up to the size of @a dest.
+	 * Unlike Read(), this never fails on underflow, which makes it safe to
+	 * call from a real-time callback racing against Flush().
+	 * This must only be called from the consumer thread.
+	 *
+	 * @param dest The span of bytes to fill with bytes read from the ring
+	 *  buffer.
+	 * @return The number of bytes read, which may be zero.
+	 */
+	size_t ReadSome(gsl::span<std::byte> dest);
+
+	/**
+	 * Discards bytes from the front of the ring buffer, without reading
+	 * them.  Like ReadSome(), this never fails on underflow.
+	 * This must only be called from the consumer thread.
+	 *
+	 * @param count The number of bytes to discard.
+	 * @return The number of bytes discarded, which may be fewer.
+	 */
+	size_t Skip(size_t count);
+
+	/**
+	 * Empties the ring buffer.
+	 * This must only be called from the producer thread, and never blocks.
+	 */
 	void Flush();
 
 private:
-	/// Empties the ring buffer without acquiring locks.
-	void FlushInner();
+	/// Cache line size used to keep the two sides' counters apart.
+	static constexpr size_t CACHE_LINE = 64;
+
+	/// Bit set on read_count while the consumer is copying out of the buffer.
+	static constexpr size_t READING = ~(~size_t{0} >> 1U);
+
+	/**
+	 * Marks the consumer as mid-read, and applies any pending flush.
+	 * @return The read count from which the consumer may read.
+	 */
+	size_t ClaimRead();
+
+	/**
+	 * Publishes a new read count, ending a read started by ClaimRead().
+	 * @param new_read_count The read count after the read.
+	 */
+	void ReleaseRead(size_t new_read_count);
+
+	/**
+	 * Copies bytes out of the buffer and releases the read.
+	 * @param from The read count returned by ClaimRead().
+	 * @param dest The span to fill; must not be larger than the read capacity.
+	 * @return The number of bytes read.
+	 */
+	size_t ReadClaimed(size_t from, gsl::span<std::byte> dest);
+
+	/**
+	 * Skips a read count forwards past any data discarded by a flush.
+	 * Called only by the consumer.
+	 * @param from The consumer's current read count.
+	 * @return The read count, moved forwards if a flush is pending.
+	 */
+	size_t ApplyPendingFlush(size_t from);
+
+	RtVector<std::byte> buffer; ///< The array used by the ringbuffer.
+	size_t mask;                   ///< Mask from counters to buffer offsets.
+
+	/// Total bytes ever written; only the producer stores to this.
+	alignas(CACHE_LINE) std::atomic<size_t> write_count;
 
-	std::vector<std::byte> buffer; ///< The array used by the ringbuffer.
+	/// Total bytes ever read, plus READING while a read is in progress.
+	/// Only the consumer sets READING; the producer may only change this
+	/// while READING is clear.
+	alignas(CACHE_LINE) std::atomic<size_t> read_count;
 
-	std::vector<std::byte>::const_iterator r_it; ///< The read iterator.
-	std::vector<std::byte>::iterator w_it;       ///< The write iterator.
+	/// The last flush epoch the consumer has handled (consumer-local).
+	size_t seen_flush_epoch;
 
-	std::atomic<size_t> count; ///< The current read capacity.
-	// Write capacity is the total buffer capacity minus count.
+	/// Incremented by the producer every time it flushes.
+	alignas(CACHE_LINE) std::atomic<size_t> flush_epoch;
 
-	std::mutex r_lock; ///< The read lock.
-	std::mutex w_lock; ///< The write lock.
+	/// The write count at the last flush; data before this is discarded.
+	std::atomic<size_t> flush_point;
 };
 
 } // namespace Playd::Audio
@@ -0,0 +1,179 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of memory for real-time audio buffers.
+ * @see audio/rt_memory.h
+ */
+
+#include "rt_memory.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../errors.h"
+
+namespace Playd::Audio
+{
+/// The size of a (2 MiB, x86-64 and most ARM64) huge page.
+static constexpr std::size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+/// Whether large blocks should use huge pages.
+static std::atomic<bool> use_huge_pages{false};
+
+/// Whether we've already complained about not being able to lock memory.
+static std::atomic<bool> warned_lock{false};
+
+/// How much is mapped for AllocateRt() blocks, in bytes.
+static std::atomic<std::size_t> mapped{0};
+
+/// @return The size of a normal page.
+static std::size_t PageSize()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info{};
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+/**
+ * Works out how much to map for an allocation.
+ * This only depends on the size, so FreeRt() always agrees with AllocateRt().
+ * @param bytes The size asked for.
+ * @return The size to map: whole huge pages for blocks of at least one,
+ *   and whole pages for everything else.
+ */
+static std::size_t MappedLength(std::size_t bytes)
+{
+	static const auto page = PageSize();
+	const auto unit = HUGE_PAGE <= bytes ? HUGE_PAGE : page;
+	if (bytes == 0) bytes = 1;
+	return ((bytes + unit - 1) / unit) * unit;
+}
+
+/**
+ * Maps anonymous memory.
+ * Windows only gives out large pages with a privilege playd won't have, so
+ * there it always gets normal ones.
+ * @param length The length to map.
+ * @param extra Any flags, besides the usual ones, to map with.
+ * @return The memory, or nullptr if it couldn't be mapped.
+ */
+static void *Map(std::size_t length, [[maybe_unused]] int extra)
+{
+#ifdef _WIN32
+	return VirtualAlloc(nullptr, length, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	auto flags = MAP_PRIVATE | MAP_ANONYMOUS | extra;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	auto *raw = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+	return raw == MAP_FAILED ? nullptr : raw;
+#endif
+}
+
+/**
+ * Locks mapped memory into RAM, faulting it in.
+ * @param raw The memory.
+ * @param length Its length.
+ * @return Nothing if it was locked, or else why not.
+ */
+static std::optional<std::string> Lock(void *raw, std::size_t length)
+{
+#ifdef _WIN32
+	if (VirtualLock(raw, length) != 0) return std::nullopt;
+	return "error " + std::to_string(GetLastError());
+#else
+	if (mlock(raw, length) == 0) return std::nullopt;
+	return std::strerror(errno);
+#endif
+}
+
+void *AllocateRt(std::size_t bytes)
+{
+	const auto length = MappedLength(bytes);
+	[[maybe_unused]] const auto huge = use_huge_pages.load(std::memory_order_relaxed) && HUGE_PAGE <= length;
+
+	void *raw = nullptr;
+#ifdef MAP_HUGETLB
+	// Reserved huge pages are the surest thing, but often aren't set up.
+	if (huge) raw = Map(length, MAP_HUGETLB);
+#endif
+	if (raw == nullptr) raw = Map(length, 0);
+	if (raw == nullptr) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+	// Failing that, transparent huge pages can back what we have.
+	if (huge) madvise(raw, length, MADV_HUGEPAGE);
+#endif
+
+	// Locking faults every page in, too; if we can't lock (usually because
+	// of RLIMIT_MEMLOCK, or on Windows the working set's minimum size), we
+	// at least fault the pages in ourselves, so the callback isn't the
+	// first to touch them.
+	if (const auto error = Lock(raw, length)) {
+		if (!warned_lock.exchange(true)) Debug() << "rt-memory: can't lock audio buffers:" << *error << std::endl;
+		static const auto page = PageSize();
+		auto *bytes_out = static_cast<volatile std::byte *>(raw);
+		for (std::size_t i = 0; i < length; i += page) bytes_out[i] = std::byte{0};
+	}
+
+	mapped.fetch_add(length, std::memory_order_relaxed);
+	return raw;
+}
+
+void FreeRt(void *ptr, std::size_t bytes)
+{
+	if (ptr == nullptr) return;
+
+	// Unmapping unlocks, too.
+	const auto length = MappedLength(bytes);
+#ifdef _WIN32
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, length);
+#endif
+	mapped.fetch_sub(length, std::memory_order_relaxed);
+}
+
+std::size_t MappedRtBytes()
+{
+	return mapped.load(std::memory_order_relaxed);
+}
+
+void EnableHugePages()
+{
+	use_huge_pages.store(true, std::memory_order_relaxed);
+}
+
+void LockAllMemory()
+{
+#ifdef _WIN32
+	// Windows can only lock ranges we name, which can't cover the code.
+	throw ConfigError("can't lock memory: not supported on this platform");
+#else
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		throw ConfigError(std::string{"can't lock memory: "} + std::strerror(errno));
+	}
+#endif
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,116 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of memory for real-time audio buffers.
+ * @see audio/rt_memory.cpp
+ */
+
+#ifndef PLAYD_AUDIO_RT_MEMORY_H
+#define PLAYD_AUDIO_RT_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace Playd::Audio
+{
+/**
+ * Allocates memory that the audio callback can touch without faulting.
+ *
+ * Memory comes straight from the OS, in whole pages, which are faulted in
+ * and, where the OS lets us, locked into RAM before this returns.  Large
+ * blocks may use huge pages, if EnableHugePages() has been called, so they
+ * take up fewer TLB entries.
+ *
+ * This is slower than the heap, so is for buffers made once and then used
+ * over and over, not for anything allocated in a loop.
+ *
+ * @param bytes The number of bytes to allocate.
+ * @return The memory, zeroed, aligned to at least a page.
+ * @exception std::bad_alloc if the OS has no memory to give.
+ */
+void *AllocateRt(std::size_t bytes);
+
+/**
+ * Frees memory allocated with AllocateRt().
+ * @param ptr The memory.
+ * @param bytes The number of bytes asked for when allocating it.
+ */
+void FreeRt(void *ptr, std::size_t bytes);
+
+/**
+ * How much memory AllocateRt() has mapped, and not yet freed.
+ * This counts whole pages, so can be more than was asked for.
+ * @return The size, in bytes.
+ */
+std::size_t MappedRtBytes();
+
+/**
+ * Makes large AllocateRt() blocks use huge pages from now on.
+ * This is only a request: without huge pages to hand (or, on Windows, at
+ * all), the OS gives us normal ones instead.
+ */
+void EnableHugePages();
+
+/**
+ * Locks everything playd has, or will ever have, into RAM.
+ * This keeps the OS from paging out the code and data that the audio
+ * callback uses, not just the buffers from AllocateRt().
+ * @exception ConfigError if the OS won't let us, as Windows never does.
+ */
+void LockAllMemory();
+
+/**
+ * A standard allocator over AllocateRt().
+ * @tparam T The type of object being allocated.
+ */
+template <typename T> class RtAllocator
+{
+public:
+	using value_type = T; ///< The type of object being allocated.
+
+	/// Constructs an RtAllocator.
+	RtAllocator() = default;
+
+	/// Converts an RtAllocator for another type.
+	template <typename U> RtAllocator(const RtAllocator<U> &) noexcept
+	{
+	}
+
+	/**
+	 * Allocates memory for some objects.
+	 * @param n The number of objects.
+	 * @return The memory.
+	 */
+	[[nodiscard]] T *allocate(std::size_t n)
+	{
+		if (SIZE_MAX / sizeof(T) < n) throw std::bad_array_new_length();
+		return static_cast<T *>(AllocateRt(n * sizeof(T)));
+	}
+
+	/**
+	 * Frees memory from allocate().
+	 * @param ptr The memory.
+	 * @param n The number of objects it was allocated for.
+	 */
+	void deallocate(T *ptr, std::size_t n) noexcept
+	{
+		FreeRt(ptr, n * sizeof(T));
+	}
+
+	/// RtAllocators are stateless, so any one can free another's memory.
+	template <typename U> bool operator==(const RtAllocator<U> &) const noexcept
+	{
+		return true;
+	}
+};
+
+/// A vector whose storage the audio callback can touch without faulting.
+template <typename T> using RtVector = std::vector<T, RtAllocator<T>>;
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_RT_MEMORY_H
@@ -0,0 +1,153 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the ThreadPolicy class.
+ * @see audio/rt_thread.h
+ */
+
+#include "rt_thread.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "../errors.h"
+
+namespace Playd::Audio
+{
+/// The most CPUs a policy can name; this is the size of a Linux cpu_set_t.
+static constexpr int MAX_CPU = 1024;
+
+/**
+ * Parses a non-negative whole number, which must be all of @a value.
+ * @param value The string to parse.
+ * @param what What the number is, for error messages.
+ * @return The number.
+ * @exception ConfigError if @a value isn't a whole number.
+ */
+static int ParseInt(std::string_view value, std::string_view what)
+{
+	int n = 0;
+	const auto end = value.data() + value.size();
+	const auto [p, ec] = std::from_chars(value.data(), end, n);
+	if (value.empty() || ec != std::errc{} || p != end || n < 0) {
+		throw ConfigError("not a valid " + std::string{what} + ": " + std::string{value});
+	}
+	return n;
+}
+
+bool ThreadPolicy::IsDefault() const
+{
+	return this->priority == 0 && this->cpus.empty();
+}
+
+void ThreadPolicy::ApplyToThisThread() const
+{
+#ifdef _WIN32
+	if (this->priority != 0) {
+		DWORD task = 0;
+		if (AvSetMmThreadCharacteristicsW(L"Pro Audio", &task) == nullptr) {
+			throw ConfigError("can't join the Pro Audio MMCSS task: error " + std::to_string(GetLastError()));
+		}
+	}
+	if (!this->cpus.empty()) {
+		DWORD_PTR mask = 0;
+		for (const auto cpu : this->cpus) {
+			if (static_cast<int>(sizeof(mask) * 8) <= cpu) throw ConfigError("CPU out of range: " + std::to_string(cpu));
+			mask |= DWORD_PTR{1} << cpu;
+		}
+		if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+			throw ConfigError("can't set CPU affinity: error " + std::to_string(GetLastError()));
+		}
+	}
+#else
+	if (this->priority != 0) {
+		sched_param param{};
+		param.sched_priority = this->priority;
+		if (const auto err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param); err != 0) {
+			throw ConfigError("can't set real-time priority " + std::to_string(this->priority) + ": " +
+			                  std::strerror(err));
+		}
+	}
+	if (!this->cpus.empty()) {
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (const auto cpu : this->cpus) CPU_SET(cpu, &set);
+		if (const auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); err != 0) {
+			throw ConfigError(std::string{"can't set CPU affinity: "} + std::strerror(err));
+		}
+#else
+		throw ConfigError("CPU affinity isn't supported on this platform");
+#endif
+	}
+#endif
+}
+
+void ThreadPolicy::Check() const
+{
+	if (this->IsDefault()) return;
+
+	// A throwaway thread takes the policy, so that nothing we care about
+	// ends up running with it if it only partly applies.
+	std::exception_ptr error;
+	std::thread{[&] {
+		try {
+			this->ApplyToThisThread();
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}}.join();
+	if (error) std::rethrow_exception(error);
+}
+
+/* static */ int ThreadPolicy::ParsePriority(std::string_view value)
+{
+	const auto priority = ParseInt(value, "real-time priority");
+	if (priority < 1 || 99 < priority) {
+		throw ConfigError("real-time priority must be from 1 to 99: " + std::string{value});
+	}
+	return priority;
+}
+
+/* static */ std::vector<int> ThreadPolicy::ParseCpus(std::string_view value)
+{
+	std::vector<int> cpus;
+
+	for (;;) {
+		const auto comma = value.find(',');
+		const auto item = value.substr(0, comma);
+
+		const auto dash = item.find('-');
+		const auto first = ParseInt(item.substr(0, dash), "CPU");
+		const auto last = dash == std::string_view::npos ? first : ParseInt(item.substr(dash + 1), "CPU");
+		if (last < first) throw ConfigError("CPU range is backwards: " + std::string{item});
+		if (MAX_CPU <= last) throw ConfigError("CPU out of range: " + std::string{item});
+		for (auto cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+
+		if (comma == std::string_view::npos) break;
+		value.remove_prefix(comma + 1);
+	}
+
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+	return cpus;
+}
+
+} // namespace Playd::Audio
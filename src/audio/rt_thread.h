@@ -0,0 +1,78 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the ThreadPolicy class.
+ * @see audio/rt_thread.cpp
+ */
+
+#ifndef PLAYD_AUDIO_RT_THREAD_H
+#define PLAYD_AUDIO_RT_THREAD_H
+
+#include <string_view>
+#include <vector>
+
+namespace Playd::Audio
+{
+/**
+ * How a thread doing audio work should be scheduled.
+ *
+ * On a shared server, other processes' threads can otherwise hold up the
+ * audio callback, or the decoder feeding it, for long enough to underrun.
+ * A policy can move a thread into the real-time scheduling class (SCHED_FIFO
+ * on POSIX; the "Pro Audio" MMCSS task on Windows) and pin it to some CPUs,
+ * which the rest of the server can then be kept off.
+ */
+class ThreadPolicy
+{
+public:
+	/// The real-time priority to run at, or 0 to leave the priority alone.
+	/// This is a SCHED_FIFO priority, from 1 to 99; on Windows, any
+	/// non-zero value means the "Pro Audio" task.
+	int priority{0};
+
+	/// The CPUs to run on, or empty to leave the affinity alone.
+	std::vector<int> cpus;
+
+	/**
+	 * @return Whether this policy leaves threads as they are.
+	 */
+	[[nodiscard]] bool IsDefault() const;
+
+	/**
+	 * Applies this policy to the calling thread.
+	 * @exception ConfigError if the OS won't let us; this usually means the
+	 *   user lacks the rights to real-time scheduling.
+	 */
+	void ApplyToThisThread() const;
+
+	/**
+	 * Checks that this policy can be applied, without applying it to any
+	 * thread that matters.  This lets failures show up at startup, rather
+	 * than on whichever thread first tries to apply the policy.
+	 * @exception ConfigError if the policy can't be applied.
+	 */
+	void Check() const;
+
+	/**
+	 * Parses a real-time priority.
+	 * @param value The priority, as a whole number from 1 to 99.
+	 * @return The priority.
+	 * @exception ConfigError if @a value isn't a valid priority.
+	 */
+	static int ParsePriority(std::string_view value);
+
+	/**
+	 * Parses a list of CPUs.
+	 * @param value The CPUs, as comma-separated numbers and ranges
+	 *   (for example, "0,2-3").
+	 * @return The CPUs, in ascending order, without duplicates.
+	 * @exception ConfigError if @a value isn't a valid list of CPUs.
+	 */
+	static std::vector<int> ParseCpus(std::string_view value);
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_RT_THREAD_H
@@ -11,6 +11,8 @@
 
 #include <array>
 #include <cstddef>
+#include <string>
+#include <string_view>
 
 namespace Playd::Audio
 {
@@ -22,4 +24,18 @@ const std::array<std::size_t, SAMPLE_FORMAT_COUNT> sample_format_bps{{
         4  // FLOAT32
 }};
 
+const std::array<std::string_view, SAMPLE_FORMAT_COUNT> sample_format_names{{
+        "u8",  // UINT8
+        "s8",  // SINT8
+        "s16", // SINT16
+        "s32", // SINT32
+        "f32"  // FLOAT32
+}};
+
+std::string DescribeConversion(SampleFormat from, SampleFormat to)
+{
+	return std::string{sample_format_names[static_cast<int>(from)]} + ">" +
+	       std::string{sample_format_names[static_cast<int>(to)]};
+}
+
 } // namespace Playd::Audio
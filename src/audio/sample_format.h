@@ -11,7 +11,10 @@
 #define PLAYD_SAMPLE_FORMATS_H
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <string>
+#include <string_view>
 
 namespace Playd::Audio
 {
@@ -46,6 +49,17 @@ constexpr std::size_t SAMPLE_FORMAT_COUNT = 5;
 /// Map from SampleFormats to bytes-per-mono-sample.
 extern const std::array<std::size_t, SAMPLE_FORMAT_COUNT> sample_format_bps;
 
+/// Map from SampleFormats to their short names, as in conversion reports.
+extern const std::array<std::string_view, SAMPLE_FORMAT_COUNT> sample_format_names;
+
+/**
+ * Describes a conversion from one sample format to another, for reports.
+ * @param from The format converted from.
+ * @param to The format converted to.
+ * @return The conversion, as (for example) 's16>f32'.
+ */
+std::string DescribeConversion(SampleFormat from, SampleFormat to);
+
 } // namespace Playd::Audio
 
 #endif // PLAYD_SAMPLE_FORMATS_H
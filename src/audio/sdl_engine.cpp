@@ -0,0 +1,355 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the SDLEngine class.
+ * @see audio/sdl_engine.h
+ */
+
+#include "sdl_engine.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../errors.h"
+#include "../trace.h"
+#include "convert.h"
+#include "rt_thread.h"
+#include "SDL.h"
+#include "sample_format.h"
+#include "sink.h"
+
+namespace Playd::Audio
+{
+/* static */ const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> SDLEngine::formats{{
+        AUDIO_U8,  // UINT8
+        AUDIO_S8,  // SINT8
+        AUDIO_S16, // SINT16
+        AUDIO_S32, // SINT32
+        AUDIO_F32  // FLOAT32
+}};
+
+/// The engines created so far, by device ID.
+static std::map<int, std::unique_ptr<SDLEngine>> &Engines()
+{
+	static std::map<int, std::unique_ptr<SDLEngine>> engines;
+	return engines;
+}
+
+/// How callback threads are scheduled.
+static ThreadPolicy &CallbackThreadPolicy()
+{
+	static ThreadPolicy policy;
+	return policy;
+}
+
+/**
+ * The callback used by SDL_Audio.
+ * Trampolines back into vengine, which must point to an SDLEngine.
+ */
+static void SDLCallback(void *vengine, unsigned char *data, int len)
+{
+	Expects(vengine != nullptr);
+	Expects(data != nullptr);
+
+	// SDL makes its callback threads itself, so the first callback on each
+	// is our only chance to schedule it.  main() has already checked that
+	// the policy can be applied, so failing here is unlikely.
+	static thread_local auto scheduled = false;
+	if (!scheduled) {
+		scheduled = true;
+		try {
+			CallbackThreadPolicy().ApplyToThisThread();
+		} catch (ConfigError &e) {
+			Debug() << "engine: callback thread:" << e.Message() << std::endl;
+		}
+	}
+
+	auto engine = static_cast<SDLEngine *>(vengine);
+	engine->Callback(gsl::span<std::byte>(reinterpret_cast<std::byte *>(data), len));
+}
+
+/* static */ SDLEngine &SDLEngine::ForDevice(int device_id)
+{
+	auto &engines = Engines();
+
+	auto it = engines.find(device_id);
+	if (it == engines.end()) {
+		it = engines.emplace(device_id, std::make_unique<SDLEngine>(device_id)).first;
+	}
+
+	Ensures(it->second != nullptr);
+	return *it->second;
+}
+
+/* static */ void SDLEngine::SetThreadPolicy(ThreadPolicy policy)
+{
+	CallbackThreadPolicy() = std::move(policy);
+}
+
+/* static */ void SDLEngine::CloseAll()
+{
+	Engines().clear();
+}
+
+SDLEngine::SDLEngine(int device_id) : device{0}, bytes_per_second{0}, bytes_per_frame{0}, device_samples{0}
+{
+	auto raw_name = SDL_GetAudioDeviceName(device_id, 0);
+	if (raw_name == nullptr) {
+		throw ConfigError(std::string("invalid device id: ") + std::to_string(device_id));
+	}
+	this->name = raw_name;
+
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+	SDL_AudioSpec spec;
+	SDL_zero(spec);
+	if (SDL_GetAudioDeviceSpec(device_id, 0, &spec) == 0) this->native = spec;
+#endif
+}
+
+SDLEngine::~SDLEngine()
+{
+	this->Close();
+}
+
+void SDLEngine::Prepare(const Format &format)
+{
+	if (this->open_format == format) return;
+
+	// If something is still playing in the old format, we leave it be;
+	// Enqueue() sorts it out if and when this format starts playing.
+	if (this->device != 0) {
+		this->Lock();
+		const auto busy = !this->queue.empty() || !this->voices.empty();
+		this->Unlock();
+
+		if (busy) return;
+	}
+
+	this->Open(format);
+}
+
+void SDLEngine::Enqueue(SDLSink &sink, const Format &format)
+{
+	// We can't reopen with the device locked: closing the device waits
+	// for the callback, which would be waiting for the lock.
+	if (this->open_format != format) {
+		Debug() << "sdl: reopening device for new format" << std::endl;
+		this->Open(format);
+	}
+
+	this->Lock();
+	if (std::find(this->queue.cbegin(), this->queue.cend(), &sink) == this->queue.cend()) {
+		this->queue.push_back(&sink);
+	}
+	this->Unlock();
+
+	SDL_PauseAudioDevice(this->device, 0);
+}
+
+void SDLEngine::AddVoice(MixerSink &sink, const Format &format)
+{
+	if (this->open_format != format) {
+		Debug() << "sdl: reopening device for new format" << std::endl;
+		this->Open(format);
+	}
+
+	this->Lock();
+	if (std::find(this->voices.cbegin(), this->voices.cend(), &sink) == this->voices.cend()) {
+		this->voices.push_back(&sink);
+	}
+	this->Unlock();
+
+	SDL_PauseAudioDevice(this->device, 0);
+}
+
+void SDLEngine::Dequeue(SDLSink &sink)
+{
+	std::lock_guard guard{this->device_lock};
+	if (this->device == 0) return;
+
+	this->Lock();
+	this->queue.erase(std::remove(this->queue.begin(), this->queue.end(), &sink), this->queue.end());
+	std::erase(this->voices, &sink);
+	const auto idle = this->queue.empty() && this->voices.empty();
+	this->Unlock();
+
+	// There's no point running the callback just to play silence.
+	if (idle) SDL_PauseAudioDevice(this->device, 1);
+}
+
+void SDLEngine::Lock()
+{
+	if (this->device != 0) SDL_LockAudioDevice(this->device);
+}
+
+void SDLEngine::Unlock()
+{
+	if (this->device != 0) SDL_UnlockAudioDevice(this->device);
+}
+
+CallbackStats::Snapshot SDLEngine::Stats() const
+{
+	return this->stats.Read();
+}
+
+void SDLEngine::Callback(gsl::span<std::byte> dest)
+{
+	Trace::Record(TraceKind::CALLBACK_BEGIN, dest.size());
+	const auto start = CallbackStats::Clock::now();
+	const auto rate = std::max<std::uint64_t>(this->bytes_per_second, 1);
+	const auto period = std::chrono::microseconds{(dest.size() * 1000000) / rate};
+	const auto size = dest.size();
+	auto underrun = false;
+
+	// Make sure anything not filled up with sound later is set to silence.
+	// This is slightly inefficient (two writes to sound-filled regions
+	// instead of one), but more elegant in failure cases.
+	std::fill(dest.begin(), dest.end(), std::byte{0});
+	const auto whole = dest;
+
+	while (!dest.empty() && !this->queue.empty()) {
+		auto *sink = this->queue.front();
+		this->stats.RecordFill(sink->FillPercent());
+		// Anything written before this sink's share plays before it,
+		// as does whatever is still in the device's own buffer.
+		const auto written = (size - dest.size()) / std::max<std::uint64_t>(this->bytes_per_frame, 1);
+		const auto filled = sink->Fill(dest, start, this->device_samples + written);
+		dest = dest.subspan(filled);
+
+		// If the sink has played out, carry straight on with the next
+		// one; this is what makes back-to-back playback gapless.
+		if (sink->CurrentState() != Sink::State::PLAYING) {
+			this->queue.pop_front();
+			continue;
+		}
+
+		// Otherwise, the sink is still playing, so if it didn't fill
+		// everything, it has underrun; leave the rest silent.
+		underrun = !dest.empty();
+		break;
+	}
+
+	// Voices play over the top of whatever the queue wrote, from the start
+	// of the callback's output; ones that have played out are dropped.
+	std::erase_if(this->voices, [&](MixerSink *voice) { return !this->MixVoice(*voice, whole, start, underrun); });
+
+	this->stats.RecordCallback(start, CallbackStats::Clock::now(), period, dest.size(), underrun);
+	Trace::Record(TraceKind::CALLBACK_END, dest.size());
+}
+
+bool SDLEngine::MixVoice(MixerSink &voice, gsl::span<std::byte> dest, CallbackStats::Clock::time_point when,
+                         bool &underrun)
+{
+	const auto frame = std::max<std::uint64_t>(this->bytes_per_frame, 1);
+	const auto chunk = this->mix_scratch.size() - (this->mix_scratch.size() % frame);
+	Expects(0 < chunk);
+
+	for (std::size_t done = 0; done < dest.size();) {
+		const auto want = std::min<std::size_t>(dest.size() - done, chunk);
+		const auto scratch = gsl::span{this->mix_scratch}.first(want);
+		const auto filled = voice.Fill(scratch, when, this->device_samples + (done / frame));
+		MixSamples(scratch.first(filled), dest.subspan(done, filled), voice.Gains());
+		done += filled;
+
+		// As with the queue, a voice that runs short while still playing
+		// has underrun.
+		if (filled < want) {
+			const auto playing = voice.CurrentState() == Sink::State::PLAYING;
+			underrun = underrun || playing;
+			return playing;
+		}
+	}
+
+	return voice.CurrentState() == Sink::State::PLAYING;
+}
+
+std::optional<std::uint32_t> SDLEngine::NativeRate() const
+{
+	if (!this->native || this->native->freq <= 0) return std::nullopt;
+	return static_cast<std::uint32_t>(this->native->freq);
+}
+
+std::vector<std::string> SDLEngine::Conversions() const
+{
+	if (!this->native || !this->open_format) return {};
+
+	std::vector<std::string> steps;
+	if (this->native->format != formats[static_cast<int>(DEVICE_FORMAT)]) {
+		const auto found = std::find(formats.begin(), formats.end(), this->native->format);
+		const auto to = found == formats.end()
+		                        ? std::string{"native"}
+		                        : std::string{sample_format_names[std::distance(formats.begin(), found)]};
+		steps.push_back(std::string{sample_format_names[static_cast<int>(DEVICE_FORMAT)]} + ">" + to + " (SDL)");
+	}
+	if (0 < this->native->freq && static_cast<std::uint32_t>(this->native->freq) != this->open_format->rate) {
+		steps.push_back(std::to_string(this->open_format->rate) + ">" + std::to_string(this->native->freq) +
+		                "Hz (SDL)");
+	}
+	if (0 < this->native->channels && this->native->channels != this->open_format->channels) {
+		steps.push_back(std::to_string(this->open_format->channels) + ">" +
+		                std::to_string(this->native->channels) + "ch (SDL)");
+	}
+	return steps;
+}
+
+void SDLEngine::Open(const Format &format)
+{
+	this->Close();
+
+	std::lock_guard guard{this->device_lock};
+	SDL_AudioSpec want;
+	SDL_zero(want);
+	want.freq = gsl::narrow<int>(format.rate);
+	want.format = formats[static_cast<int>(DEVICE_FORMAT)];
+	want.channels = format.channels;
+	want.callback = &SDLCallback;
+	want.userdata = static_cast<void *>(this);
+
+	SDL_AudioSpec have;
+	SDL_zero(have);
+
+	// We don't allow any changes, so SDL converts to whatever the hardware
+	// wants, and our callback always sees the format we asked for.
+	this->device = SDL_OpenAudioDevice(this->name.c_str(), 0, &want, &have, 0);
+	if (this->device == 0) {
+		throw ConfigError(std::string("couldn't open device: ") + SDL_GetError());
+	}
+	this->open_format = format;
+
+	const auto bps = sample_format_bps[static_cast<int>(DEVICE_FORMAT)];
+	this->bytes_per_frame = static_cast<std::uint64_t>(have.channels) * bps;
+	this->bytes_per_second = static_cast<std::uint64_t>(have.freq) * this->bytes_per_frame;
+	this->device_samples = have.samples;
+	this->mix_scratch.resize(this->device_samples * this->bytes_per_frame);
+}
+
+void SDLEngine::Close()
+{
+	std::lock_guard guard{this->device_lock};
+	if (this->device == 0) return;
+
+	// Silence any currently playing audio.
+	SDL_PauseAudioDevice(this->device, SDL_TRUE);
+	SDL_CloseAudioDevice(this->device);
+
+	this->device = 0;
+	this->open_format = std::nullopt;
+
+	// Nothing queued can play now, so forget about it.
+	this->queue.clear();
+	this->voices.clear();
+}
+
+} // namespace Playd::Audio
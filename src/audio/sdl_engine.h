@@ -0,0 +1,251 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The SDLEngine class.
+ * @see audio/sdl_engine.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SDL_ENGINE_H
+#define PLAYD_AUDIO_SDL_ENGINE_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "SDL.h"
+#include "rt_memory.h"
+#include "rt_thread.h"
+#include "sample_format.h"
+#include "stats.h"
+
+namespace Playd::Audio
+{
+class MixerSink;
+class SDLSink;
+
+/**
+ * A long-lived SDL output device, shared by every SDLSink playing on it.
+ *
+ * Opening and closing an SDL device is slow, and leaves an audible gap
+ * between one file and the next.  An SDLEngine instead keeps its device open
+ * for the life of the process, and plays a queue of sinks from it.  When the
+ * sink at the front of the queue plays out, the engine carries straight on
+ * with the next one within the same callback, so handing over from one file
+ * to the next is just a matter of reading from a different ring buffer.
+ *
+ * The device always takes DEVICE_FORMAT samples, whatever the decoders give
+ * out; each sink converts its own samples on the way in (see ConvertSamples).
+ * Sources are normally resampled to DEVICE_RATE, and remixed to
+ * DEVICE_CHANNELS, before they get here (see ResampledSource and
+ * RemixedSource), so the rate and layout don't change either.  A sink with a
+ * different rate or channel count still causes the device to be reopened
+ * (dropping any sinks queued in the old format).
+ *
+ * Alongside the queue, an engine can play any number of voices: MixerSinks
+ * that all play at once, over the top of the queue and each other.  Each
+ * voice is mixed in with its own per-channel gains (see MixSamples), so one
+ * device can crossfade, or duck under a voice-over, without a second one.
+ */
+class SDLEngine
+{
+public:
+	/// The sample format in which every device is opened.
+	static constexpr SampleFormat DEVICE_FORMAT = SampleFormat::FLOAT32;
+
+	/// The sample rate, in Hz, at which devices are normally opened.
+	static constexpr std::uint32_t DEVICE_RATE = 48000;
+
+	/// The number of channels in which devices are normally opened.
+	static constexpr std::uint8_t DEVICE_CHANNELS = 2;
+
+	/// The shape of the audio going into an engine.
+	struct Format {
+		std::uint32_t rate;    ///< The sample rate, in Hz.
+		std::uint8_t channels; ///< The number of channels.
+
+		/// Formats are equal if all of their fields are.
+		bool operator==(const Format &) const = default;
+	};
+
+	/**
+	 * Gets the engine for an output device, creating it if needed.
+	 * @param device_id The ID of the output device.
+	 * @return A reference to the engine, which lives until CloseAll().
+	 * @exception ConfigError if @a device_id is not a valid device.
+	 */
+	static SDLEngine &ForDevice(int device_id);
+
+	/// Closes every engine; this must happen before SDL shuts down.
+	static void CloseAll();
+
+	/**
+	 * Sets how SDL's audio callback threads are scheduled.
+	 * Each callback thread takes the policy on its first callback, so this
+	 * must happen before any device opens.
+	 * @param policy The policy.
+	 */
+	static void SetThreadPolicy(ThreadPolicy policy);
+
+	/**
+	 * Constructs an SDLEngine.
+	 * The device isn't opened until the first call to Prepare().
+	 * @param device_id The ID of the output device.
+	 * @exception ConfigError if @a device_id is not a valid device.
+	 */
+	explicit SDLEngine(int device_id);
+
+	/// Destructs an SDLEngine, closing its device.
+	~SDLEngine();
+
+	/// Deleted copy constructor.
+	SDLEngine(const SDLEngine &) = delete;
+
+	/// Deleted copy-assignment.
+	SDLEngine &operator=(const SDLEngine &) = delete;
+
+	/**
+	 * Gets the device ready for audio in the given format.
+	 * If the device is closed, or idle in a different format, this
+	 * (re)opens it now, so that the cost is paid before anything plays.
+	 * @param format The format of the audio that will be enqueued.
+	 * @exception ConfigError if the device can't be opened.
+	 */
+	void Prepare(const Format &format);
+
+	/**
+	 * Adds a sink to the back of the play queue.
+	 * The sink must stay alive until it is dequeued.
+	 * @param sink The sink to enqueue; this does nothing if it is queued.
+	 * @param format The format of the sink's audio.
+	 * @exception ConfigError if the device needs reopening, but can't be.
+	 */
+	void Enqueue(SDLSink &sink, const Format &format);
+
+	/**
+	 * Removes a sink from the play queue, if it is there.
+	 * Once this returns, the callback no longer touches @a sink.
+	 * Unlike the rest of the engine, this can be called from any thread,
+	 * so that sinks can be torn down off the player's thread.
+	 * @param sink The sink to dequeue.
+	 */
+	void Dequeue(SDLSink &sink);
+
+	/**
+	 * Adds a sink to the voices mixed over the play queue.
+	 * The sink must stay alive until it is dequeued.
+	 * @param sink The sink to add; this does nothing if it is playing.
+	 * @param format The format of the sink's audio.
+	 * @exception ConfigError if the device needs reopening, but can't be.
+	 */
+	void AddVoice(MixerSink &sink, const Format &format);
+
+	/// Stops the callback running until Unlock().
+	void Lock();
+
+	/// Lets the callback run again after Lock().
+	void Unlock();
+
+	/**
+	 * Gets the statistics gathered by this engine's callback.
+	 * @return A snapshot of the statistics so far.
+	 */
+	[[nodiscard]] CallbackStats::Snapshot Stats() const;
+
+	/**
+	 * Gets the device's own sample rate, as the system reports it.
+	 * Playing at this rate saves SDL (or the system under it) resampling.
+	 * @return The rate, in Hz, if the system says (which needs SDL 2.0.16).
+	 */
+	[[nodiscard]] std::optional<std::uint32_t> NativeRate() const;
+
+	/**
+	 * Lists the conversions SDL makes between what the device is open in
+	 * and the device's own format, each marked '(SDL)'.
+	 * @return The conversions, in order; none if the device is closed, or
+	 *   its own format is unknown.
+	 */
+	[[nodiscard]] std::vector<std::string> Conversions() const;
+
+	/**
+	 * The audio callback.
+	 * This is executed in a separate thread by SDL.
+	 * @param dest The output span to which our samples should be written.
+	 */
+	void Callback(gsl::span<std::byte> dest);
+
+private:
+	/// Mapping from SampleFormats to their equivalent SDL_AudioFormats.
+	static const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> formats;
+
+	std::string name;                  ///< The SDL name of the device.
+	SDL_AudioDeviceID device;          ///< The open device, or 0 if closed.
+	std::optional<Format> open_format; ///< The format the device is open in.
+
+	/// The device's own format, if the system says; SDL converts to this
+	/// from whatever we open the device in.
+	std::optional<SDL_AudioSpec> native;
+
+	/// Held while the device opens or closes, and by Dequeue(), so that
+	/// sinks going away on other threads never see it half-open.
+	std::mutex device_lock;
+
+	/// Bytes of device audio per second; set before the device unpauses.
+	std::uint64_t bytes_per_second;
+
+	/// Bytes of device audio per sample frame; set alongside bytes_per_second.
+	std::uint64_t bytes_per_frame;
+
+	/// Sample frames in the device's buffer, which is how much audio is
+	/// still to play in front of whatever a callback writes.
+	std::uint64_t device_samples;
+
+	/// Timings and counters recorded by the callback.
+	CallbackStats stats;
+
+	/// The sinks waiting to play, front first.
+	/// This is only touched with the device locked.
+	std::deque<SDLSink *> queue;
+
+	/// The sinks playing over the queue, in no particular order.
+	/// This is only touched with the device locked.
+	std::vector<MixerSink *> voices;
+
+	/// Where the callback has each voice fill before mixing it in;
+	/// allocated when the device opens, as the callback mustn't allocate.
+	RtVector<std::byte> mix_scratch;
+
+	/**
+	 * Mixes one voice into the device's output.
+	 * This is called by the callback, with the device lock held.
+	 * @param voice The voice to mix in.
+	 * @param dest The output span, which may already have sound in it.
+	 * @param when When the callback started.
+	 * @param underrun Set if the voice ran out while still playing.
+	 * @return Whether the voice is still playing.
+	 */
+	bool MixVoice(MixerSink &voice, gsl::span<std::byte> dest, CallbackStats::Clock::time_point when,
+	              bool &underrun);
+
+	/**
+	 * Opens the device in the given format, closing it first if needed.
+	 * Any queued sinks, and voices, are dropped.
+	 * @param format The format in which to open the device.
+	 */
+	void Open(const Format &format);
+
+	/// Closes the device, if it is open.
+	void Close();
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SDL_ENGINE_H
@@ -0,0 +1,328 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of silence detection, and the TrimmedSource and CueCache
+ * classes.
+ * @see audio/silence.h
+ */
+
+#include "silence.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "../errors.h"
+#include "convert.h"
+#include "metadata_cache.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/// The sample frames decoded and converted to floating point at a time.
+static constexpr std::size_t CHUNK_FRAMES = 4096;
+
+/// How much of the file each step of the backwards scan decodes.
+static constexpr std::chrono::seconds TAIL_WINDOW{10};
+
+/// The first bytes of every cache file; the last is the format version.
+static constexpr std::string_view MAGIC{"playdcu\x01", 8};
+
+/*
+ * Each record is laid out as follows, in native byte order:
+ *
+ *   u32 record size (including this)
+ *   u64 mtime, u64 file size, f64 threshold
+ *   i64 in, i64 out (both in microseconds), u16 path size
+ *   path bytes
+ */
+
+/// The size of a record, not counting its path.
+static constexpr std::size_t RECORD_HEADER = 4 + 8 + 8 + 8 + 8 + 8 + 2;
+
+/// Appends a value's bytes to a string.
+template <typename T>
+static void Put(std::string &out, T value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+/// Reads a value's bytes from a string, and advances past them.
+template <typename T>
+static T Get(std::string_view &in)
+{
+	T value;
+	std::memcpy(&value, in.data(), sizeof value);
+	in.remove_prefix(sizeof value);
+	return value;
+}
+
+/**
+ * Decodes a chunk of a source, as floating point.
+ * @param source The source.
+ * @param raw Space for the source's own samples, CHUNK_FRAMES long.
+ * @param floats Space for the converted samples, CHUNK_FRAMES long.
+ * @return The decoder's state, and the converted mono samples.
+ */
+static std::pair<Source::DecodeState, gsl::span<const float>> DecodeFloats(Source &source,
+                                                                           std::vector<std::byte> &raw,
+                                                                           std::vector<float> &floats)
+{
+	const auto [state, bytes] = source.Decode(raw);
+	const auto count = (bytes / source.BytesPerSample()) * source.ChannelCount();
+	ConvertSamples(source.OutputSampleFormat(), SampleFormat::FLOAT32, gsl::span<const std::byte>{raw}.first(bytes),
+	               gsl::span<std::byte>{reinterpret_cast<std::byte *>(floats.data()), count * sizeof(float)});
+	return std::make_pair(state, gsl::span<const float>{floats}.first(count));
+}
+
+CuePoints FindCuePoints(Source &source, double threshold_db)
+{
+	const auto format = source.OutputSampleFormat();
+	if (!CanConvert(format, SampleFormat::FLOAT32)) throw FileError("can't trim this sample format");
+	const std::size_t channels = source.ChannelCount();
+	const auto level = static_cast<float>(std::pow(10.0, threshold_db / 20.0));
+	const auto length = source.Length();
+
+	std::vector<std::byte> raw(CHUNK_FRAMES * source.BytesPerSample());
+	std::vector<float> floats(CHUNK_FRAMES * channels);
+
+	// Forwards, to the first loud sample...
+	std::uint64_t pos = 0;
+	std::optional<std::uint64_t> first;
+	for (auto state = Source::DecodeState::DECODING; !first && state != Source::DecodeState::END_OF_FILE;) {
+		const auto [decode_state, samples] = DecodeFloats(source, raw, floats);
+		state = decode_state;
+		if (const auto loud = FindLoud(samples, level).first; loud < samples.size()) {
+			first = pos + (loud / channels);
+		}
+		pos += samples.size() / channels;
+	}
+	if (!first) return CuePoints{std::chrono::microseconds{0}, source.MicrosFromSamples(std::max(length, pos))};
+
+	// ...then backwards, a window at a time, to the last.  Nothing past
+	// the start of the last window is decoded twice, and the window with
+	// the first loud sample in it has a loud sample, so this stops there
+	// at the latest.
+	const auto window = std::max<std::uint64_t>(source.SamplesFromMicros(TAIL_WINDOW), 1);
+	auto start = std::max(*first, window < length ? length - window : 0);
+	auto limit = UINT64_MAX;
+	for (;;) {
+		std::optional<std::uint64_t> last;
+		pos = source.Seek(start);
+		for (auto state = Source::DecodeState::DECODING;
+		     pos < limit && state != Source::DecodeState::END_OF_FILE;) {
+			const auto [decode_state, samples] = DecodeFloats(source, raw, floats);
+			state = decode_state;
+			if (const auto [loud, end] = FindLoud(samples, level); loud < samples.size()) {
+				last = std::min(pos + ((end + channels - 1) / channels), limit);
+			}
+			pos += samples.size() / channels;
+		}
+
+		if (last) return CuePoints{source.MicrosFromSamples(*first), source.MicrosFromSamples(*last)};
+
+		// Sources that seek only roughly might skip the loud sample we
+		// know is there; don't go round forever looking for it.
+		if (start <= *first) {
+			return CuePoints{source.MicrosFromSamples(*first), source.MicrosFromSamples(std::max(length, pos))};
+		}
+		limit = start;
+		start = window < start - *first ? start - window : *first;
+	}
+}
+
+//
+// TrimmedSource
+//
+
+TrimmedSource::TrimmedSource(std::unique_ptr<Source> inner, CuePoints cues)
+    : Source{inner->Path()},
+      inner{std::move(inner)},
+      cues{cues},
+      in{this->inner->SamplesFromMicros(cues.in)},
+      out{std::max(this->in, this->inner->SamplesFromMicros(cues.out))},
+      position{this->inner->Seek(this->in)}
+{
+}
+
+TrimmedSource::DecodeSpanResult TrimmedSource::Decode(gsl::span<std::byte> out_span)
+{
+	if (this->out <= this->position) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+	auto [state, bytes] = this->inner->Decode(out_span);
+	const auto bps = this->BytesPerSample();
+	const std::uint64_t frames = bytes / bps;
+	const auto start = this->position;
+	this->position += frames;
+
+	// Seeks can land a little early, so drop anything before the in
+	// point, and anything past the out point.
+	const auto skip = std::min(frames, this->in > start ? this->in - start : 0);
+	const auto keep = std::min(frames - skip, this->out - (start + skip));
+	if (skip != 0) std::memmove(out_span.data(), out_span.data() + (skip * bps), keep * bps);
+
+	if (this->out <= this->position) state = DecodeState::END_OF_FILE;
+	return std::make_pair(state, keep * bps);
+}
+
+std::uint64_t TrimmedSource::Seek(std::uint64_t new_position)
+{
+	const auto target = this->in + std::min(new_position, this->out - this->in);
+	this->position = this->inner->Seek(target);
+	return std::clamp(this->position, this->in, this->out) - this->in;
+}
+
+std::uint64_t TrimmedSource::Length() const
+{
+	return this->out - this->in;
+}
+
+std::uint8_t TrimmedSource::ChannelCount() const
+{
+	return this->inner->ChannelCount();
+}
+
+std::uint32_t TrimmedSource::SampleRate() const
+{
+	return this->inner->SampleRate();
+}
+
+SampleFormat TrimmedSource::OutputSampleFormat() const
+{
+	return this->inner->OutputSampleFormat();
+}
+
+std::optional<CuePoints> TrimmedSource::Cues() const
+{
+	return this->cues;
+}
+
+std::optional<StreamStats> TrimmedSource::Streaming() const
+{
+	return this->inner->Streaming();
+}
+
+std::size_t TrimmedSource::ScratchBytes() const
+{
+	return this->inner->ScratchBytes();
+}
+
+std::uint64_t TrimmedSource::SkippedFrames() const
+{
+	return this->inner->SkippedFrames();
+}
+
+ConversionList TrimmedSource::Conversions() const
+{
+	return this->inner->Conversions();
+}
+
+//
+// CueCache
+//
+
+CueCache::CueCache(const std::string &path) : path{path}
+{
+	std::string raw;
+	if (std::ifstream in{path, std::ios::binary}) {
+		raw.assign(std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{});
+	}
+
+	// A new cache just needs its magic.
+	if (raw.empty()) {
+		std::ofstream out{path, std::ios::binary | std::ios::trunc};
+		out.write(MAGIC.data(), MAGIC.size());
+		if (!out) throw ConfigError("can't open cue cache " + path);
+		return;
+	}
+	if (raw.size() < MAGIC.size() || std::string_view{raw}.substr(0, MAGIC.size()) != MAGIC) {
+		throw ConfigError("not a cue cache file: " + path);
+	}
+
+	std::string_view rest{raw};
+	rest.remove_prefix(MAGIC.size());
+	while (RECORD_HEADER <= rest.size()) {
+		auto record = rest;
+		const auto record_size = Get<std::uint32_t>(record);
+		if (record_size < RECORD_HEADER || rest.size() < record_size) break;
+
+		Record r{};
+		r.key.mtime = Get<std::uint64_t>(record);
+		r.key.size = Get<std::uint64_t>(record);
+		r.threshold_db = Get<double>(record);
+		r.cues.in = std::chrono::microseconds{Get<std::int64_t>(record)};
+		r.cues.out = std::chrono::microseconds{Get<std::int64_t>(record)};
+		const auto path_size = Get<std::uint16_t>(record);
+		if (record_size != RECORD_HEADER + path_size) break;
+
+		this->records.insert_or_assign(std::string{record.substr(0, path_size)}, r);
+		rest.remove_prefix(record_size);
+	}
+
+	// Anything after the last good record is a write that didn't finish;
+	// cut it off, so that new records go after the good ones.
+	if (!rest.empty()) {
+		std::error_code ec;
+		std::filesystem::resize_file(path, raw.size() - rest.size(), ec);
+		if (ec) throw ConfigError("can't repair cue cache " + path + ": " + ec.message());
+	}
+}
+
+std::optional<CuePoints> CueCache::Find(const std::string &file, double threshold_db) const
+{
+	const auto key = MetadataCache::KeyOf(file);
+	if (!key) return std::nullopt;
+
+	std::lock_guard guard{this->lock};
+	const auto it = this->records.find(file);
+	if (it == this->records.end()) return std::nullopt;
+
+	// A file that has changed since may not have the same audio in it.
+	const auto &record = it->second;
+	if (record.key != *key || record.threshold_db != threshold_db) return std::nullopt;
+	return record.cues;
+}
+
+void CueCache::Store(const std::string &file, double threshold_db, CuePoints cues)
+{
+	const auto key = MetadataCache::KeyOf(file);
+	if (!key || UINT16_MAX < file.size()) return;
+
+	std::string out;
+	out.reserve(RECORD_HEADER + file.size());
+	Put(out, static_cast<std::uint32_t>(RECORD_HEADER + file.size()));
+	Put(out, key->mtime);
+	Put(out, key->size);
+	Put(out, threshold_db);
+	Put(out, static_cast<std::int64_t>(cues.in.count()));
+	Put(out, static_cast<std::int64_t>(cues.out.count()));
+	Put(out, static_cast<std::uint16_t>(file.size()));
+	out.append(file);
+
+	std::lock_guard guard{this->lock};
+	this->records.insert_or_assign(file, Record{*key, threshold_db, cues});
+
+	// Whole records go on the end; a short write gets cut off when the
+	// cache is next opened.
+	std::ofstream stream{this->path, std::ios::binary | std::ios::app};
+	stream.write(out.data(), static_cast<std::streamsize>(out.size()));
+	if (!stream) Debug() << "cue cache: couldn't store" << file << std::endl;
+}
+
+} // namespace Playd::Audio
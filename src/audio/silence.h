@@ -0,0 +1,158 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of silence detection, and the TrimmedSource and CueCache
+ * classes.
+ * @see audio/silence.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SILENCE_H
+#define PLAYD_AUDIO_SILENCE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#undef max
+#include <gsl/gsl>
+
+#include "metadata_cache.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Finds the audible part of a source's file.
+ *
+ * The scan decodes forwards from the start until it finds a sample louder
+ * than @a threshold_db, then backwards from the end, a window at a time,
+ * until it finds another; only the silence at each end (and a window's worth
+ * of audio) is decoded, not the whole file.  Files that are silent
+ * throughout are left whole.  The source is left wherever the scan ended.
+ *
+ * @param source The source, at its start.
+ * @param threshold_db The level, in dBFS, which samples must be above to be
+ *   heard.
+ * @return The cue points, in the source's own time.
+ * @exception FileError if the source can't be decoded, or its samples can't
+ *   be converted to FLOAT32.
+ */
+CuePoints FindCuePoints(Source &source, double threshold_db);
+
+/**
+ * Audio source playing only the audible part of another.
+ *
+ * The part between the cue points looks, to everything downstream, like the
+ * whole file: it starts at position 0, seeks are relative to the in point,
+ * and the source runs out at the out point.
+ */
+class TrimmedSource : public Source
+{
+public:
+	/**
+	 * Constructs a TrimmedSource, moving the inner source to its in point.
+	 * @param inner The source to trim.
+	 * @param cues Where to trim it, in @a inner's time.
+	 */
+	TrimmedSource(std::unique_ptr<Source> inner, CuePoints cues);
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	/// @return The cue points this source was trimmed at.
+	std::optional<CuePoints> Cues() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+private:
+	std::unique_ptr<Source> inner; ///< The source being trimmed.
+	CuePoints cues;                ///< Where it was trimmed.
+	std::uint64_t in;              ///< The in point, in samples.
+	std::uint64_t out;             ///< The out point, in samples.
+	std::uint64_t position;        ///< Where the inner source is, in samples.
+};
+
+/**
+ * A persistent cache of files' cue points.
+ *
+ * Finding cue points means decoding a little of each end of a file, which is
+ * worth skipping on files loaded again and again.  As with MetadataCache,
+ * entries are keyed by the file's path, modification time and size, live in
+ * one file in native byte order, and are appended as they're stored.  Each
+ * entry also holds the threshold it was found at, so that changing the
+ * threshold finds the cue points afresh.  The cache is small enough to read
+ * into memory whole when opened.
+ */
+class CueCache
+{
+public:
+	/**
+	 * Opens a cache file, creating it if it doesn't exist.
+	 * A cache with damage at the end is cut back to its last good entry.
+	 * @param path The path to the cache file.
+	 * @exception ConfigError if the file can't be opened, or isn't a cache.
+	 */
+	explicit CueCache(const std::string &path);
+
+	/**
+	 * Looks up a file's cue points.
+	 * @param path The path to the file.
+	 * @param threshold_db The threshold the cue points were found at.
+	 * @return The cue points, if there are some for this threshold and the
+	 *   file hasn't changed since they were stored.
+	 */
+	[[nodiscard]] std::optional<CuePoints> Find(const std::string &path, double threshold_db) const;
+
+	/**
+	 * Stores a file's cue points, replacing any older ones.
+	 * Failing to write the cache isn't fatal; the cue points just don't
+	 * outlive this cache.
+	 * @param path The path to the file.
+	 * @param threshold_db The threshold the cue points were found at.
+	 * @param cues The cue points.
+	 */
+	void Store(const std::string &path, double threshold_db, CuePoints cues);
+
+private:
+	/// A file's cue points, and what they were found from.
+	struct Record {
+		MetadataCache::Key key; ///< The version of the file.
+		double threshold_db;    ///< The threshold they were found at.
+		CuePoints cues;         ///< The cue points.
+	};
+
+	std::string path; ///< The path to the cache file.
+
+	/// The latest record for each path.
+	std::unordered_map<std::string, Record> records;
+
+	/// Guards the records and the file, as players load on any thread.
+	mutable std::mutex lock;
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SILENCE_H
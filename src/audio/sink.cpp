@@ -12,11 +12,19 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
 #include <string>
+#include <utility>
 
+#include "../errors.h"
 #include "SDL.h"
+#include "convert.h"
 #include "ringbuffer.h"
 #include "sample_format.h"
+#include "sdl_engine.h"
 #include "source.h"
 
 namespace Playd::Audio
@@ -25,72 +33,133 @@ namespace Playd::Audio
 // Sink
 //
 
+bool Sink::SkipTo(Samples)
+{
+	return false;
+}
+
+void Sink::StartAt(PlayheadClock::Clock::time_point)
+{
+	this->Start();
+}
+
+void Sink::StopAt(PlayheadClock::Clock::time_point)
+{
+	this->Stop();
+}
+
 Sink::State Sink::CurrentState()
 {
 	return Sink::State::NONE;
 }
 
-//
-// SDLSink
-//
+bool Sink::Sounding()
+{
+	return this->CurrentState() == State::PLAYING;
+}
 
-/* static */ const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> SDLSink::formats{{
-        AUDIO_U8,  // UINT8
-        AUDIO_S8,  // SINT8
-        AUDIO_S16, // SINT16
-        AUDIO_S32, // SINT32
-        AUDIO_F32  // FLOAT32
-}};
+std::optional<gsl::span<std::byte>> Sink::AcquireTransfer()
+{
+	return std::nullopt;
+}
 
-/**
- * The callback used by SDL_Audio.
- * Trampolines back into vsink, which must point to an Sdl_audio_sink.
- */
-static void SDLCallback(void *vsink, unsigned char *data, int len)
+void Sink::CommitTransfer(size_t count)
 {
-	Expects(vsink != nullptr);
-	Expects(data != nullptr);
+	// We never lend anything out, so nothing should come back.
+	Expects(count == 0);
+}
 
-	auto sink = static_cast<SDLSink *>(vsink);
-	sink->Callback(gsl::span<std::byte>(reinterpret_cast<std::byte *>(data), len));
+bool Sink::WantsMore()
+{
+	return false;
 }
 
-SDLSink::SDLSink(const Audio::Source &source, int device_id)
-    : bytes_per_sample{source.BytesPerSample()},
-      ring_buf{(1U << RINGBUF_POWER) * source.BytesPerSample()},
-      position_sample_count{0},
-      source_out{false},
-      state{Sink::State::STOPPED}
+std::optional<Samples> Sink::Buffered()
 {
-	auto name = SDL_GetAudioDeviceName(device_id, 0);
-	if (name == nullptr) {
-		throw ConfigError(std::string("invalid device id: ") + std::to_string(device_id));
-	}
+	return std::nullopt;
+}
 
-	SDL_AudioSpec want;
-	SDL_zero(want);
-	want.freq = gsl::narrow<int>(source.SampleRate());
-	want.format = formats[static_cast<int>(source.OutputSampleFormat())];
-	want.channels = source.ChannelCount();
-	want.callback = &SDLCallback;
-	want.userdata = static_cast<void *>(this);
+void Sink::SetWakeHandler(WakeFn)
+{
+}
 
-	SDL_AudioSpec have;
-	SDL_zero(have);
+std::optional<CallbackStats::Snapshot> Sink::Stats()
+{
+	return std::nullopt;
+}
 
-	this->device = SDL_OpenAudioDevice(name, 0, &want, &have, 0);
-	if (this->device == 0) {
-		throw ConfigError(std::string("couldn't open device: ") + SDL_GetError());
-	}
+std::size_t Sink::BufferBytes() const
+{
+	return 0;
 }
 
-SDLSink::~SDLSink()
+ConversionList Sink::Conversions() const
 {
-	if (this->device == 0) return;
+	return {};
+}
 
-	// Silence any currently playing audio.
-	SDL_PauseAudioDevice(this->device, SDL_TRUE);
-	SDL_CloseAudioDevice(this->device);
+//
+// SDLSink
+//
+
+SDLSink::SDLSink(const Audio::Source &source, int device_id, std::shared_ptr<BufferPolicy> buffer_policy)
+    : engine{SDLEngine::ForDevice(device_id)},
+      format{source.SampleRate(), source.ChannelCount()},
+      source_format{source.OutputSampleFormat()},
+      bytes_per_sample{source.BytesPerSample()},
+      device_bytes_per_sample{sample_format_bps[static_cast<int>(SDLEngine::DEVICE_FORMAT)] *
+                              source.ChannelCount()},
+      convert{FindConverter(source_format, SDLEngine::DEVICE_FORMAT)},
+      ring_buf{buffer_policy != nullptr ? buffer_policy->Bytes(source.SampleRate(), source.BytesPerSample())
+                                        : BufferPolicy::BytesFor(BufferPolicy::DEFAULT_SIZE, source.SampleRate(),
+                                                                 source.BytesPerSample())},
+      sample_rate{source.SampleRate()},
+      // Waking up at half full gives the decoder plenty of slack, and
+      // stopping short of full leaves room for the callback to drain into
+      // while we work.
+      low_watermark{ring_buf.Capacity() / 2},
+      high_watermark{ring_buf.Capacity() - (ring_buf.Capacity() / 8)},
+      scratch(source_format == SDLEngine::DEVICE_FORMAT ? 0 : CONVERT_CHUNK_SAMPLES * bytes_per_sample),
+      seek_tail((source.SampleRate() * SEEK_FADE.count() / 1000) * source.ChannelCount()),
+      seek_tail_raw((source.SampleRate() * SEEK_FADE.count() / 1000) * bytes_per_sample),
+      tail_total{0},
+      tail_left{0},
+      refill_pending{false},
+      position_sample_count{0},
+      playhead{source.SampleRate()},
+      start_at{UNSCHEDULED},
+      stop_at{UNSCHEDULED},
+      started_at{UNSCHEDULED},
+      start_latency{UNSCHEDULED},
+      source_out{false},
+      state{Sink::State::STOPPED},
+      buffer_policy{std::move(buffer_policy)},
+      played{0},
+      since_seek{0},
+      underruns{0},
+      lowest_fill{SIZE_MAX}
+{
+	if (this->convert == nullptr) throw FileError("unsupported sample format");
+
+	// Get the device open now if we can, so that playing doesn't have to.
+	this->engine.Prepare(this->format);
+}
+
+SDLSink::~SDLSink()
+{
+	// After this, the engine's callback won't be touching us any more.
+	this->engine.Dequeue(*this);
+
+	if (this->buffer_policy == nullptr) return;
+
+	const auto millis = [this](size_t bytes) {
+		const auto samples = bytes / this->bytes_per_sample;
+		return std::chrono::milliseconds{(samples * 1000) / this->sample_rate};
+	};
+	const auto capacity = this->ring_buf.Capacity();
+	this->buffer_policy->Report(BufferPolicy::Outcome{millis(capacity), millis(std::min(this->lowest_fill, capacity)),
+	                                                  millis(this->played * this->bytes_per_sample),
+	                                                  this->underruns});
 }
 
 /* static */ void SDLSink::InitLibrary()
@@ -102,23 +171,81 @@ SDLSink::~SDLSink()
 
 /* static */ void SDLSink::CleanupLibrary()
 {
+	SDLEngine::CloseAll();
 	SDL_Quit();
 }
 
 void SDLSink::Start()
 {
-	if (this->state != Sink::State::STOPPED) return;
+	this->Play(UNSCHEDULED);
+}
+
+void SDLSink::StartAt(PlayheadClock::Clock::time_point when)
+{
+	this->Play(when.time_since_epoch().count());
+}
+
+void SDLSink::Play(std::int64_t start)
+{
+	// Playing again cancels any scheduled stop.
+	if (this->state != Sink::State::STOPPED) {
+		this->stop_at.store(UNSCHEDULED, std::memory_order_relaxed);
+		return;
+	}
 
-	SDL_PauseAudioDevice(this->device, 0);
+	// The engine lock, taken when we're queued, publishes these to the
+	// callback before it first sees us.
+	this->start_at.store(start, std::memory_order_relaxed);
+	this->stop_at.store(UNSCHEDULED, std::memory_order_relaxed);
+
+	// Scheduled starts are heard when they're meant to be, so only
+	// unscheduled ones are timed.
+	if (start == UNSCHEDULED) {
+		this->started_at.store(PlayheadClock::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+		this->start_latency.store(UNSCHEDULED, std::memory_order_relaxed);
+	}
+
+	// The callback skips over sinks that aren't playing, so we need to be
+	// playing before we're queued.
 	this->state = Sink::State::PLAYING;
+	try {
+		this->Attach();
+	} catch (...) {
+		this->state = Sink::State::STOPPED;
+		throw;
+	}
+}
+
+void SDLSink::Attach()
+{
+	this->engine.Enqueue(*this, this->format);
 }
 
 void SDLSink::Stop()
 {
-	if (this->state == Sink::State::STOPPED) return;
+	this->stop_at.store(UNSCHEDULED, std::memory_order_relaxed);
+
+	// A scheduled stop has already taken us off the engine, but if we
+	// were the last thing playing, the device still needs to idle.
+	if (this->state.exchange(Sink::State::STOPPED) == Sink::State::STOPPED) {
+		this->engine.Dequeue(*this);
+		return;
+	}
+
+	this->engine.Dequeue(*this);
 
-	SDL_PauseAudioDevice(this->device, 1);
-	this->state = Sink::State::STOPPED;
+	// The callback is done with us, so any fade can go.
+	this->tail_left = 0;
+
+	// Whatever was left in the device won't be heard now (or, if it is,
+	// it's too short to matter), so the playhead shouldn't run on.
+	this->playhead.Hold(PlayheadClock::Clock::now());
+}
+
+void SDLSink::StopAt(PlayheadClock::Clock::time_point when)
+{
+	if (this->state != Sink::State::PLAYING) return;
+	this->stop_at.store(when.time_since_epoch().count(), std::memory_order_release);
 }
 
 Sink::State SDLSink::CurrentState()
@@ -126,34 +253,80 @@ Sink::State SDLSink::CurrentState()
 	return this->state;
 }
 
+bool SDLSink::Sounding()
+{
+	// The callback clears both once it has played us.
+	if (this->state != Sink::State::PLAYING) return false;
+	return this->started_at.load(std::memory_order_relaxed) == UNSCHEDULED &&
+	       this->start_at.load(std::memory_order_relaxed) == UNSCHEDULED;
+}
+
 void SDLSink::SourceOut()
 {
 	// The sink should only be out if the source is.
 	Expects(this->source_out || this->state != Sink::State::AT_END);
 
-	this->source_out = true;
+	this->source_out.store(true, std::memory_order_release);
 }
 
 uint64_t SDLSink::Position()
 {
-	return this->position_sample_count;
+	return this->playhead.Read(PlayheadClock::Clock::now());
 }
 
 void SDLSink::SetPosition(uint64_t samples)
 {
+	// The callback publishes to the playhead, so keep it out while we do.
+	// We also need it out while we take what it would have played next,
+	// to fade out under the new position rather than cut off dead.
+	this->engine.Lock();
+	this->CaptureSeekTail(this->seek_tail.size() / this->format.channels);
 	this->position_sample_count = samples;
+	this->playhead.Reset(samples, PlayheadClock::Clock::now());
+	this->since_seek = 0;
+
+	// Flushing before the callback can run again means that it never
+	// plays old samples as if they were from the new position.
+	this->ring_buf.Flush();
+	this->engine.Unlock();
 
 	// We might have been at the end of the file previously.
 	// If so, we might not be now, so clear the out flags.
-	this->source_out = false;
+	this->source_out.store(false, std::memory_order_release);
 	if (this->state == Sink::State::AT_END) {
 		this->state = Sink::State::STOPPED;
 		this->Stop();
 	}
 
-	// The ringbuf will have been full of samples from the old
-	// position, so we need to get rid of them.
-	this->ring_buf.Flush();
+	// The ringbuf is now empty, so let the callback ask for a refill again
+	// if it needs to.
+	this->refill_pending.store(false, std::memory_order_release);
+}
+
+bool SDLSink::SkipTo(Samples samples)
+{
+	this->engine.Lock();
+
+	// What the ring buffer holds runs on from what the callback has
+	// handed over so far.  We need to keep at least one sample past the
+	// new position, or we'd be no better off than seeking.
+	const auto from = this->position_sample_count.load();
+	const auto buffered = this->ring_buf.ReadCapacity() / this->bytes_per_sample;
+	const auto inside = from <= samples && samples - from < buffered;
+	if (inside) {
+		// Anything we fade out has to come from before the new position.
+		const auto skip = samples - from;
+		this->CaptureSeekTail(std::min<Samples>(skip, this->seek_tail.size() / this->format.channels));
+		const auto rest = (skip - this->tail_total) * this->bytes_per_sample;
+		const auto skipped = this->ring_buf.Skip(rest);
+		Ensures(skipped == rest);
+
+		this->position_sample_count = samples;
+		this->playhead.Reset(samples, PlayheadClock::Clock::now());
+	}
+
+	this->engine.Unlock();
+	return inside;
 }
 
 size_t SDLSink::Transfer(const gsl::span<const std::byte> src)
@@ -179,58 +352,330 @@ size_t SDLSink::Transfer(const gsl::span<const std::byte> src)
 	// written count.
 	Ensures(written_count == count);
 	Ensures(written_count % bytes_per_sample == 0);
+
+	this->MaybeFinishRefill();
 	return written_count;
 }
 
-void SDLSink::Callback(gsl::span<std::byte> dest)
+std::optional<gsl::span<std::byte>> SDLSink::AcquireTransfer()
+{
+	// If there isn't room for even one sample, there's nothing to do
+	// until the callback frees up some space.
+	if (this->ring_buf.WriteCapacity() < this->bytes_per_sample) return gsl::span<std::byte>{};
+
+	// Only lend out whole samples.
+	auto region = this->ring_buf.AcquireWrite();
+	const auto count = region.size() - (region.size() % this->bytes_per_sample);
+
+	// If the free space wraps around the end of the ring buffer in the
+	// middle of a sample, we can't lend it out in one piece; the caller
+	// has to copy this round in via Transfer(), which can split samples.
+	if (count == 0) return std::nullopt;
+
+	return region.first(count);
+}
+
+void SDLSink::CommitTransfer(size_t count)
+{
+	Expects(count % this->bytes_per_sample == 0);
+	if (count == 0) return;
+
+	this->ring_buf.CommitWrite(count);
+	this->MaybeFinishRefill();
+}
+
+bool SDLSink::WantsMore()
+{
+	// Even below the high watermark, we might not have space for a sample
+	// if the callback hasn't caught up with a flush yet.
+	if (this->ring_buf.WriteCapacity() < this->bytes_per_sample) return false;
+
+	return this->ring_buf.ReadCapacity() < this->high_watermark;
+}
+
+std::optional<Samples> SDLSink::Buffered()
+{
+	return this->ring_buf.ReadCapacity() / this->bytes_per_sample;
+}
+
+std::size_t SDLSink::BufferBytes() const
 {
-	Expects(0 <= dest.size());
+	return this->ring_buf.Capacity() + this->scratch.capacity() + this->seek_tail.capacity() * sizeof(float) +
+	       this->seek_tail_raw.capacity();
+}
+
+ConversionList SDLSink::Conversions() const
+{
+	ConversionList steps;
+	if (this->source_format != SDLEngine::DEVICE_FORMAT) {
+		steps.push_back(DescribeConversion(this->source_format, SDLEngine::DEVICE_FORMAT));
+	}
+	for (auto &step : this->engine.Conversions()) steps.push_back(std::move(step));
+	return steps;
+}
 
-	// How many bytes do we want to pull out of the ring buffer?
-	const auto req_bytes = static_cast<size_t>(dest.size());
+void SDLSink::SetWakeHandler(WakeFn new_wake)
+{
+	// The callback calls the handler with the device lock held, so this
+	// stops us swapping it out from under the callback.
+	this->engine.Lock();
+	this->wake = std::move(new_wake);
+	this->engine.Unlock();
+}
+
+std::optional<CallbackStats::Snapshot> SDLSink::Stats()
+{
+	auto stats = this->engine.Stats();
+	if (const auto latency = this->start_latency.load(std::memory_order_relaxed); latency != UNSCHEDULED) {
+		stats.start_latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds{latency});
+	}
+	return stats;
+}
+
+std::uint64_t SDLSink::FillPercent() const
+{
+	return (this->ring_buf.ReadCapacity() * 100) / this->ring_buf.Capacity();
+}
+
+void SDLSink::Wake()
+{
+	if (this->wake) this->wake();
+}
 
-	// Make sure anything not filled up with sound later is set to silence.
-	// This is slightly inefficient (two writes to sound-filled regions
-	// instead of one), but more elegant in failure cases.
-	std::fill(dest.begin(), dest.end(), std::byte{0});
+void SDLSink::MaybeFinishRefill()
+{
+	if (this->ring_buf.ReadCapacity() < this->high_watermark) return;
+	this->refill_pending.store(false, std::memory_order_release);
+}
 
+size_t SDLSink::Fill(gsl::span<std::byte> dest, PlayheadClock::Clock::time_point when, Samples ahead)
+{
 	// If we're not supposed to be playing, don't play anything.
-	if (this->state != Sink::State::PLAYING) return;
+	if (this->state.load(std::memory_order_acquire) != Sink::State::PLAYING) return 0;
+
+	// A scheduled start plays silence up to the frame it falls on, which
+	// may be past the end of this callback altogether.  Callers don't all
+	// silence their spans first, so we do it here.
+	const auto frames = dest.size() / this->device_bytes_per_sample;
+	Samples lead = 0;
+	if (const auto start = this->start_at.load(std::memory_order_relaxed); start != UNSCHEDULED) {
+		lead = std::min<Samples>(this->FramesUntil(start, when, ahead), frames);
+		std::fill_n(dest.begin(), lead * this->device_bytes_per_sample, std::byte{0});
+		if (lead == frames) return dest.size();
+		this->start_at.store(UNSCHEDULED, std::memory_order_relaxed);
+	}
+	auto out = dest.subspan(lead * this->device_bytes_per_sample);
+
+	// Likewise, a scheduled stop cuts us off at the frame it falls on.
+	auto stopping = false;
+	if (const auto stop = this->stop_at.load(std::memory_order_acquire); stop != UNSCHEDULED) {
+		const auto until = this->FramesUntil(stop, when, ahead + lead);
+		if (until <= frames - lead) {
+			out = out.first(until * this->device_bytes_per_sample);
+			stopping = true;
+		}
+	}
 
-	// Let's find out how many bytes are available in total to give SDL.
-	//
-	// Note: Since we run concurrently with the decoder, which is also
-	// trying to modify the read capacity of the ringbuf (by adding
-	// things), this technically causes a race condition when we try to
-	// read `avail_samples` number of samples later.  Not to fear: the
-	// actual read capacity can only be greater than or equal to
-	// `avail_samples`, as this is the only place where we can *decrease*
-	// it.
-	const auto avail_bytes = this->ring_buf.ReadCapacity();
+	// Take as much as the ring buffer has, up to what SDL asked for, and
+	// fade out anything left over from before a seek underneath it.
+	const auto read_samples = this->ReadConverted(out);
+	const auto sound_samples =
+	        this->tail_left == 0 ? read_samples : std::max(read_samples, this->MixSeekTail(out, read_samples));
+
+	if (0 < sound_samples) {
+		if (const auto started = this->started_at.load(std::memory_order_relaxed); started != UNSCHEDULED) {
+			const auto latency = when.time_since_epoch().count() - started;
+			this->start_latency.store(std::max<std::int64_t>(latency, 0), std::memory_order_relaxed);
+			this->started_at.store(UNSCHEDULED, std::memory_order_relaxed);
+		}
+	}
 
 	// Have we run out of things to feed?
-	if (avail_bytes == 0) {
+	if (sound_samples == 0 && !stopping) {
 		// Is this a temporary condition, or have we genuinely played
 		// out all we can?  If the latter, we're now out too.
-		if (this->source_out) this->state = Sink::State::AT_END;
+		if (this->source_out.load(std::memory_order_acquire)) {
+			this->state.store(Sink::State::AT_END, std::memory_order_release);
+			this->Wake();
+			return lead * this->device_bytes_per_sample;
+		}
+	}
 
-		// Don't even bother reading from the ring buffer.
-		return;
+	if (!stopping) this->RecordFill(out.size() / this->device_bytes_per_sample, read_samples);
+
+	const auto old_pos = this->position_sample_count.fetch_add(read_samples, std::memory_order_relaxed);
+	const auto new_pos = old_pos + read_samples;
+	this->playhead.Publish(new_pos, ahead + lead + read_samples, when);
+
+	// Stopping here takes us off the engine, which drops sinks that
+	// aren't playing; the wake-up lets the player know.
+	if (stopping) {
+		this->stop_at.store(UNSCHEDULED, std::memory_order_relaxed);
+		this->state.store(Sink::State::STOPPED, std::memory_order_release);
+		this->Wake();
+		return (lead + sound_samples) * this->device_bytes_per_sample;
 	}
 
-	// Of the bytes available, how many do we need?  Send this amount to
-	// SDL.
-	auto bytes = std::min(req_bytes, avail_bytes);
-	// We should be asking for a whole number of samples.
-	assert(bytes % bytes_per_sample == 0);
+	// Wake the decoder when we run low, but only once per refill;
+	// MaybeFinishRefill() lets us ask again once the refill is done.
+	// If the source is out, there's nothing to refill with.
+	const auto low = this->ring_buf.ReadCapacity() < this->low_watermark;
+	const auto refill = low && !this->source_out.load(std::memory_order_acquire) &&
+	                    !this->refill_pending.exchange(true, std::memory_order_acq_rel);
+
+	// Position announcements only happen once a second, so waking up
+	// when the position ticks over a second is enough to keep them going.
+	const auto milestone = (old_pos / this->sample_rate) != (new_pos / this->sample_rate);
 
-	auto read_bytes = this->ring_buf.Read(dest.first(bytes));
+	if (refill || milestone) this->Wake();
+
+	return (lead + sound_samples) * this->device_bytes_per_sample;
+}
+
+void SDLSink::RecordFill(Samples wanted, Samples got)
+{
+	this->played += got;
+	this->since_seek += got;
+
+	// Running low is expected once the source is out, and straight after
+	// starting or seeking, before the buffer has had a chance to fill up;
+	// neither says anything about how big the buffer should be.
+	if (this->source_out.load(std::memory_order_acquire)) return;
+	if (this->since_seek * this->bytes_per_sample < this->low_watermark) return;
+
+	if (got < wanted) this->underruns++;
+	this->lowest_fill = std::min(this->lowest_fill, this->ring_buf.ReadCapacity());
+}
+
+void SDLSink::CaptureSeekTail(Samples max)
+{
+	// Nothing is being heard unless we're playing for real.
+	this->tail_total = 0;
+	this->tail_left = 0;
+	if (this->state != Sink::State::PLAYING || this->start_at.load(std::memory_order_relaxed) != UNSCHEDULED) {
+		return;
+	}
 
-	// We should have received a whole number of samples.
+	const auto raw = gsl::span{this->seek_tail_raw}.first(max * this->bytes_per_sample);
+	const auto read_bytes = this->ring_buf.ReadSome(raw);
 	assert(read_bytes % this->bytes_per_sample == 0);
-	auto read_samples = read_bytes / this->bytes_per_sample;
 
-	this->position_sample_count += read_samples;
+	const auto frames = read_bytes / this->bytes_per_sample;
+	const gsl::span<std::byte> tail(reinterpret_cast<std::byte *>(this->seek_tail.data()),
+	                                frames * this->device_bytes_per_sample);
+	this->convert(raw.data(), tail.data(), frames * this->format.channels);
+	this->tail_total = frames;
+	this->tail_left = frames;
+}
+
+/**
+ * Crossfades freshly read frames from a seek tail.
+ * Mono and stereo get their own copies, with the channel loop unrolled.
+ * @tparam Channels The number of channels, or 0 to use @a channels.
+ * @param dest The frames to fade in, as FLOAT32.
+ * @param tail The tail to fade out from, starting at its first unmixed frame.
+ * @param channels The number of channels, if @a Channels is 0.
+ * @param count The number of frames to crossfade.
+ * @param read The number of frames of @a dest read; the rest are silent.
+ * @param done The number of frames of the tail already mixed.
+ * @param total The number of frames in the tail.
+ */
+template <std::uint8_t Channels>
+static void CrossfadeTail(std::byte *dest, const float *tail, std::uint8_t channels, Samples count, Samples read,
+                          Samples done, Samples total)
+{
+	const size_t n = Channels != 0 ? Channels : channels;
+
+	// A straight-line crossfade, over however much of the old audio we
+	// managed to keep.
+	for (Samples i = 0; i < count; i++) {
+		const auto in_gain = static_cast<float>(done + i + 1) / static_cast<float>(total + 1);
+		for (size_t c = 0; c < n; c++) {
+			auto *at = dest + (((i * n) + c) * sizeof(float));
+			float sample = 0.0f;
+			if (i < read) std::memcpy(&sample, at, sizeof sample);
+			sample = (sample * in_gain) + (tail[(i * n) + c] * (1.0f - in_gain));
+			std::memcpy(at, &sample, sizeof sample);
+		}
+	}
+}
+
+Samples SDLSink::MixSeekTail(gsl::span<std::byte> dest, Samples read)
+{
+	const auto channels = this->format.channels;
+	const auto count = std::min<Samples>(this->tail_left, dest.size() / this->device_bytes_per_sample);
+	const auto done = this->tail_total - this->tail_left;
+	const auto *tail = this->seek_tail.data() + (done * channels);
+
+	switch (channels) {
+	case 1:
+		CrossfadeTail<1>(dest.data(), tail, channels, count, read, done, this->tail_total);
+		break;
+	case 2:
+		CrossfadeTail<2>(dest.data(), tail, channels, count, read, done, this->tail_total);
+		break;
+	default:
+		CrossfadeTail<0>(dest.data(), tail, channels, count, read, done, this->tail_total);
+		break;
+	}
+
+	this->tail_left -= count;
+	return count;
+}
+
+Samples SDLSink::FramesUntil(std::int64_t deadline, PlayheadClock::Clock::time_point when, Samples ahead) const
+{
+	// The first frame heard at or after the deadline is the one it falls
+	// on; splitting off whole seconds keeps far-off deadlines from
+	// overflowing.
+	constexpr auto second =
+	        std::chrono::duration_cast<PlayheadClock::Clock::duration>(std::chrono::seconds{1}).count();
+	const auto until = deadline - when.time_since_epoch().count();
+	if (until <= 0) return 0;
+
+	const auto rate = static_cast<std::uint64_t>(this->sample_rate);
+	const auto whole = static_cast<std::uint64_t>(until / second) * rate;
+	const auto part = ((static_cast<std::uint64_t>(until % second) * rate) + second - 1) / second;
+	const auto frames = whole + part;
+	return frames <= ahead ? 0 : frames - ahead;
+}
+
+size_t SDLSink::ReadConverted(gsl::span<std::byte> dest)
+{
+	// Note: Since we run concurrently with the decoder, which may be
+	// adding to (or flushing) the ring buffer as we go, we don't ask
+	// for a read capacity first: ReadSome works out what it can give us
+	// in one go, and never blocks on the decoder.  The decoder only ever
+	// commits whole samples, so that's what we get back.
+
+	// If the source already speaks the device's format, skip the copy.
+	if (this->scratch.empty()) {
+		const auto whole = dest.size() - (dest.size() % this->bytes_per_sample);
+		const auto read_bytes = this->ring_buf.ReadSome(dest.first(whole));
+		assert(read_bytes % this->bytes_per_sample == 0);
+		return read_bytes / this->bytes_per_sample;
+	}
+
+	const auto want_samples = dest.size() / this->device_bytes_per_sample;
+	size_t done_samples = 0;
+	while (done_samples < want_samples) {
+		const auto chunk = std::min(want_samples - done_samples, CONVERT_CHUNK_SAMPLES);
+		const auto in = gsl::span<std::byte>(this->scratch).first(chunk * this->bytes_per_sample);
+		const auto read_bytes = this->ring_buf.ReadSome(in);
+		if (read_bytes == 0) break;
+
+		assert(read_bytes % this->bytes_per_sample == 0);
+		const auto read_samples = read_bytes / this->bytes_per_sample;
+
+		const auto out = dest.subspan(done_samples * this->device_bytes_per_sample,
+		                              read_samples * this->device_bytes_per_sample);
+		this->convert(in.data(), out.data(), read_samples * this->format.channels);
+
+		done_samples += read_samples;
+		if (read_samples < chunk) break;
+	}
+
+	return done_samples;
 }
 
 /* static */ std::vector<std::pair<int, std::string>> SDLSink::GetDevicesInfo()
@@ -255,4 +700,44 @@ void SDLSink::Callback(gsl::span<std::byte> dest)
 	return 0 <= id && id < ids;
 }
 
+/* static */ std::optional<std::uint32_t> SDLSink::NativeRate(int id)
+{
+	if (!IsOutputDevice(id)) return std::nullopt;
+	return SDLEngine::ForDevice(id).NativeRate();
+}
+
+//
+// MixerSink
+//
+
+MixerSink::MixerSink(const Audio::Source &source, int device_id, std::shared_ptr<BufferPolicy> buffer_policy)
+    : SDLSink{source, device_id, std::move(buffer_policy)}, gains(source.ChannelCount(), 1.0f)
+{
+}
+
+MixerSink::~MixerSink()
+{
+	// The callback reads our gains, so it has to stop before they go.
+	this->engine.Dequeue(*this);
+}
+
+void MixerSink::SetGains(gsl::span<const float> new_gains)
+{
+	Expects(new_gains.size() == this->gains.size());
+
+	this->engine.Lock();
+	std::copy(new_gains.begin(), new_gains.end(), this->gains.begin());
+	this->engine.Unlock();
+}
+
+gsl::span<const float> MixerSink::Gains() const
+{
+	return this->gains;
+}
+
+void MixerSink::Attach()
+{
+	this->engine.AddVoice(*this, this->format);
+}
+
 } // namespace Playd::Audio
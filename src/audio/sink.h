@@ -11,16 +11,26 @@
 #define PLAYD_AUDIO_SINK_H
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "SDL.h"
+#include "buffer_policy.h"
+#include "convert.h"
+#include "playhead.h"
+#include "rt_memory.h"
 #include "ringbuffer.h"
 #include "sample_format.h"
+#include "sdl_engine.h"
 #include "source.h"
+#include "stats.h"
 
 namespace Playd::Audio
 {
@@ -39,6 +49,9 @@ public:
 		AT_END,  ///< The audio has ended and can't play without a seek.
 	};
 
+	/// Type of functions called when a sink needs attention.
+	using WakeFn = std::function<void()>;
+
 	/// Virtual, empty destructor for Audio_sink.
 	virtual ~Sink() = default;
 
@@ -56,6 +69,26 @@ public:
 	 */
 	virtual void Stop() = 0;
 
+	/**
+	 * Starts the audio stream at a given time.
+	 * The first sample is heard as close to @a when as the sink can
+	 * manage; until then, the sink counts as playing, but plays silence.
+	 * The default implementation starts straight away.
+	 * @param when When the first sample should be heard.
+	 * @see Start
+	 */
+	virtual void StartAt(PlayheadClock::Clock::time_point when);
+
+	/**
+	 * Stops the audio stream at a given time.
+	 * The sink plays up to the sample heard at @a when, then stops by
+	 * itself, and wakes its wake handler.  This does nothing if the sink
+	 * isn't playing.  The default implementation stops straight away.
+	 * @param when When the last sample should be heard.
+	 * @see Stop
+	 */
+	virtual void StopAt(PlayheadClock::Clock::time_point when);
+
 	/**
 	 * Gets this sink's current state (playing/stopped/at end).
 	 * @return The Audio_sink::State representing this sink's state.
@@ -63,10 +96,21 @@ public:
 	 */
 	virtual State CurrentState();
 
+	/**
+	 * Whether this sink's audio is being heard yet.
+	 * A sink can be playing for a short while before its device first asks
+	 * it for sound.  The default implementation counts playing as being
+	 * heard.
+	 * @return Whether the sink is playing, and its device has had sound
+	 *   from it since it started.
+	 * @see Start
+	 */
+	virtual bool Sounding();
+
 	/**
 	 * Gets the current played position in the song, in samples.
-	 * As this may be executing whilst the playing callback is running,
-	 * do not expect it to be highly accurate.
+	 * This should be what is being heard right now, rather than how far
+	 * the sink has got through its buffer, but is only an estimate.
 	 * @return The current position, as a count of elapsed samples.
 	 */
 	virtual Samples Position() = 0;
@@ -80,6 +124,21 @@ public:
 	 */
 	virtual void SetPosition(Samples samples) = 0;
 
+	/**
+	 * Moves to a position inside what the sink still has buffered.
+	 *
+	 * If the sink has already been given the samples at @a samples, this
+	 * discards the ones before it, so that the source doesn't need to seek
+	 * at all (and whoever is feeding the sink carries on where it was).
+	 * Otherwise, it does nothing.  The default implementation never can.
+	 *
+	 * @param samples The new position, as a count of elapsed samples.
+	 * @return Whether the sink moved; if false, the caller should seek
+	 *   the source and call SetPosition() instead.
+	 * @see SetPosition
+	 */
+	virtual bool SkipTo(Samples samples);
+
 	/**
 	 * Tells this AudioSink that the source has run out.
 	 *
@@ -100,14 +159,98 @@ public:
 	 * @return The number of bytes transferred.
 	 */
 	virtual size_t Transfer(gsl::span<const std::byte> src) = 0;
+
+	/**
+	 * Lends out space in the sink into which samples can be decoded in
+	 * place, avoiding the copy made by Transfer().
+	 *
+	 * * Postcondition: Any span returned contains a whole number of
+	 *     samples.
+	 *
+	 * The default implementation lends nothing.
+	 *
+	 * @return A span of free space in the sink, which is empty if the sink
+	 *   is full; or nothing, if the sink can't currently lend space, in
+	 *   which case the caller should use Transfer() instead.
+	 * @see CommitTransfer
+	 */
+	virtual std::optional<gsl::span<std::byte>> AcquireTransfer();
+
+	/**
+	 * Commits samples decoded into space lent out by AcquireTransfer().
+	 *
+	 * * Precondition: @a count is a whole number of samples, and no
+	 *     larger than the span last lent out.
+	 *
+	 * @param count The number of bytes written into the lent span.
+	 * @see AcquireTransfer
+	 */
+	virtual void CommitTransfer(size_t count);
+
+	/**
+	 * Asks whether the sink wants more samples transferred right now.
+	 *
+	 * Sinks with watermarks return true until they're filled past their
+	 * high watermark, so that the caller can fill them in one go and then
+	 * wait for a wake-up.  The default implementation returns false, so
+	 * callers transfer one round per update.
+	 *
+	 * @return Whether the caller should keep transferring samples.
+	 */
+	virtual bool WantsMore();
+
+	/**
+	 * Gets how many samples the sink has waiting to be played.
+	 * Decoding schedulers use this to work out how long the sink can go
+	 * before it runs dry.  The default implementation doesn't know.
+	 * @return The number of samples buffered, if known.
+	 */
+	virtual std::optional<Samples> Buffered();
+
+	/**
+	 * Sets the function called when this sink needs attention.
+	 *
+	 * The sink calls this, possibly from its own playback thread, when its
+	 * buffer drops below its low watermark (or runs dry), when its position
+	 * passes a whole second, and when it reaches the end.  The function
+	 * must therefore be cheap and safe to call from any thread.
+	 *
+	 * The default implementation never calls the function.
+	 *
+	 * @param wake The function to call, or an empty function for none.
+	 */
+	virtual void SetWakeHandler(WakeFn wake);
+
+	/**
+	 * Gets statistics about how playback is going on this sink's device.
+	 * The default implementation has none.
+	 * @return A snapshot of the statistics, if the sink keeps any.
+	 */
+	virtual std::optional<CallbackStats::Snapshot> Stats();
+
+	/**
+	 * How much memory this sink's buffers take up.
+	 * Sinks allocate their buffers up front, so this may be called from
+	 * any thread.  The default implementation has no buffers.
+	 * @return The size of the buffers, in bytes.
+	 */
+	[[nodiscard]] virtual std::size_t BufferBytes() const;
+
+	/**
+	 * Lists the conversions this sink makes to the audio it is given, on
+	 * its way to the device.  The default implementation makes none.
+	 * @return The conversions, in order.
+	 */
+	[[nodiscard]] virtual ConversionList Conversions() const;
 };
 
 /**
  * An output stream for audio, using SDL.
  *
- * An Sdl_audio_sink consists of an SDL output device and a buffer that stores
- * decoded samples from the Audio object.  While active, the Sdl_audio_sink
- * periodically transfers samples from its buffer to SDL2 in a separate thread.
+ * An Sdl_audio_sink consists of a buffer that stores decoded samples from the
+ * Audio object, and a place in the queue of an SDLEngine, which owns the SDL
+ * output device.  While active, the engine periodically transfers samples from
+ * the buffer to SDL2 in a separate thread.
  */
 class SDLSink : public Sink
 {
@@ -116,8 +259,11 @@ public:
 	 * Constructs an Sdl_audio_sink.
 	 * @param source The source from which this sink will receive audio.
 	 * @param device_id The device ID to which this sink will output.
+	 * @param buffer_policy The policy sizing our buffer, which we report
+	 *   back to when we go; if null, the buffer is
+	 *   BufferPolicy::DEFAULT_SIZE.
 	 */
-	SDLSink(const Source &source, int device_id);
+	SDLSink(const Source &source, int device_id, std::shared_ptr<BufferPolicy> buffer_policy = nullptr);
 
 	/// Destructs an Sdl_audio_sink.
 	~SDLSink() override;
@@ -126,23 +272,63 @@ public:
 
 	void Stop() override;
 
+	void StartAt(PlayheadClock::Clock::time_point when) override;
+
+	void StopAt(PlayheadClock::Clock::time_point when) override;
+
 	Sink::State CurrentState() override;
 
+	bool Sounding() override;
+
 	Samples Position() override;
 
 	void SetPosition(Samples samples) override;
 
+	bool SkipTo(Samples samples) override;
+
 	void SourceOut() override;
 
 	size_t Transfer(gsl::span<const std::byte> src) override;
 
+	std::optional<gsl::span<std::byte>> AcquireTransfer() override;
+
+	void CommitTransfer(size_t count) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	void SetWakeHandler(WakeFn wake) override;
+
+	std::optional<CallbackStats::Snapshot> Stats() override;
+
+	[[nodiscard]] std::size_t BufferBytes() const override;
+
+	/**
+	 * Lists the conversion into the device's sample format, if any, and
+	 * then whatever SDL does between that and the hardware.
+	 * @return The conversions, in order.
+	 */
+	[[nodiscard]] ConversionList Conversions() const override;
+
 	/**
-	 * The audio callback.
-	 * This is executed in a separate thread by SDL once a stream is
-	 * playing with the callback registered to it.
+	 * How full the ring buffer is right now.
+	 * @return The fill level, as a percentage of the buffer's capacity.
+	 */
+	std::uint64_t FillPercent() const;
+
+	/**
+	 * Fills part of the engine's output with our samples.
+	 * This is called by the engine in its callback thread, with the device
+	 * lock held, but only while this sink is in its queue.
 	 * @param dest The output span to which our samples should be written.
+	 * @param when When the callback started.
+	 * @param ahead How many sample frames will play, from @a when, before
+	 *   the start of @a dest does.
+	 * @return The number of bytes filled, which may be fewer than asked
+	 *   for if we have run out.
 	 */
-	void Callback(gsl::span<std::byte> dest);
+	size_t Fill(gsl::span<std::byte> dest, PlayheadClock::Clock::time_point when, Samples ahead);
 
 	/**
 	 * Gets the number and name of each output device entry in the
@@ -158,36 +344,235 @@ public:
 	 */
 	static bool IsOutputDevice(int id);
 
+	/**
+	 * Gets the sample rate a sound device runs at natively, if known.
+	 * @param id Device ID.
+	 * @return The rate, in Hz, if the system says.
+	 */
+	static std::optional<std::uint32_t> NativeRate(int id);
+
 	/// Initialises the AudioSink's libraries, if not initialised already.
 	static void InitLibrary();
 
 	/// Cleans up the AudioSink's libraries, if not cleaned up already.
 	static void CleanupLibrary();
 
+protected:
+	/// The engine, and the SDL device, on which we are outputting sound.
+	SDLEngine &engine;
+
+	/// The format of the audio we send to the engine.
+	SDLEngine::Format format;
+
+	/**
+	 * Hands this sink to the engine, to start playing it.
+	 * The default implementation adds it to the back of the play queue.
+	 * @exception ConfigError if the device needs reopening, but can't be.
+	 */
+	virtual void Attach();
+
 private:
-	/// The SDL device to which we are outputting sound.
-	SDL_AudioDeviceID device;
+	/// Number of samples converted per step when filling the device.
+	static constexpr size_t CONVERT_CHUNK_SAMPLES = 1024;
 
-	/// n, where 2^n is the capacity of the Audio ring buffer.
-	static constexpr size_t RINGBUF_POWER = 16;
+	/// How long seeks during playback crossfade from the old position.
+	static constexpr std::chrono::milliseconds SEEK_FADE{5};
 
-	/// Mapping from SampleFormats to their equivalent SDL_AudioFormats.
-	static const std::array<SDL_AudioFormat, SAMPLE_FORMAT_COUNT> formats;
+	/// The format of the samples held in the ring buffer.
+	SampleFormat source_format;
 
 	/// Number of bytes in one sample.
 	size_t bytes_per_sample;
 
+	/// Number of bytes in one sample once converted for the device.
+	size_t device_bytes_per_sample;
+
+	/// The conversion from the source's format to the device's, looked up
+	/// once here rather than on every callback.
+	ConvertFn convert;
+
 	/// The ring buffer used to transfer samples to the playing callback.
 	RingBuffer ring_buf;
 
-	/// The current position, in samples.
-	Samples position_sample_count;
+	/// The sample rate, used to spot whole-second position milestones.
+	std::uint32_t sample_rate;
+
+	/// The fill level, in bytes, below which the callback asks for a refill.
+	size_t low_watermark;
+
+	/// The fill level, in bytes, up to which WantsMore() asks for samples.
+	size_t high_watermark;
+
+	/// Called when the sink needs attention; guarded by the device lock.
+	WakeFn wake;
+
+	/// Where the callback reads samples before converting them for the
+	/// device; allocated up front, as the callback mustn't allocate.
+	RtVector<std::byte> scratch;
+
+	/**
+	 * Reads samples from the ring buffer into the device's output.
+	 * Samples stay in the source's format in the ring buffer, so 16-bit
+	 * files move half as many bytes through it; this converts them on the
+	 * way out.
+	 * @param dest The output span, in the device's format.
+	 * @return The number of samples read.
+	 */
+	size_t ReadConverted(gsl::span<std::byte> dest);
+
+	/// Where the audio from before a seek is kept to fade out, in the
+	/// device's format; allocated up front.  Guarded by the device lock.
+	RtVector<float> seek_tail;
+
+	/// Where samples are read before converting them into seek_tail.
+	RtVector<std::byte> seek_tail_raw;
+
+	/// Sample frames in the current seek_tail; guarded by the device lock.
+	Samples tail_total;
+
+	/// Sample frames of seek_tail yet to fade out; guarded likewise.
+	Samples tail_left;
+
+	/**
+	 * Takes the audio that would have played next, if we're playing, into
+	 * seek_tail, so that it fades out under the audio from a seek.
+	 * The caller must hold the device lock, which lets us stand in for the
+	 * callback as the ring buffer's consumer.
+	 * @param max The most sample frames to take.
+	 */
+	void CaptureSeekTail(Samples max);
+
+	/**
+	 * Crossfades from the seek tail into freshly read samples.
+	 * This is called in the callback, with the device lock held.
+	 * @param dest The output span, in the device's format.
+	 * @param read The number of sample frames read into @a dest.
+	 * @return The number of sample frames of @a dest now holding sound.
+	 */
+	Samples MixSeekTail(gsl::span<std::byte> dest, Samples read);
+
+	/// Whether the callback has asked for a refill that hasn't yet
+	/// happened.  This stops the callback asking over and over again.
+	std::atomic<bool> refill_pending;
+
+	/**
+	 * Calls the wake handler, if there is one.
+	 * This is called from the callback thread, with the device lock held.
+	 */
+	void Wake();
+
+	/// Marks any refill request as answered, if the buffer is full enough.
+	void MaybeFinishRefill();
+
+	/// The number of samples handed to the device, counting from the last
+	/// seek.  This is advanced by the callback thread.
+	std::atomic<Samples> position_sample_count;
+
+	/// The estimated position of what is actually being heard, published
+	/// by the callback thread and read out by Position().
+	PlayheadClock playhead;
+
+	/// The value of start_at and stop_at when nothing is scheduled.
+	static constexpr std::int64_t UNSCHEDULED = INT64_MIN;
+
+	/// When, in PlayheadClock nanoseconds, a scheduled start is to be
+	/// heard.  The callback clears this once it has started us.
+	std::atomic<std::int64_t> start_at;
+
+	/// When, in PlayheadClock nanoseconds, a scheduled stop is to be
+	/// heard.  The callback clears this once it has stopped us.
+	std::atomic<std::int64_t> stop_at;
+
+	/// When, in PlayheadClock nanoseconds, an unscheduled start was asked
+	/// for.  The callback clears this once it first plays sound after it.
+	std::atomic<std::int64_t> started_at;
+
+	/// How long, in nanoseconds, the last unscheduled start took to reach
+	/// a callback; UNSCHEDULED until one has.
+	std::atomic<std::int64_t> start_latency;
+
+	/**
+	 * Starts playing, with a scheduled start if any.
+	 * @param start The new value of start_at.
+	 */
+	void Play(std::int64_t start);
+
+	/**
+	 * Works out how many sample frames play before a deadline.
+	 * @param deadline The deadline, in PlayheadClock nanoseconds.
+	 * @param when When the callback started.
+	 * @param ahead How many sample frames play, from @a when, before the
+	 *   first of the frames being counted does.
+	 * @return The number of frames that start playing before @a deadline.
+	 */
+	[[nodiscard]] Samples FramesUntil(std::int64_t deadline, PlayheadClock::Clock::time_point when,
+	                                  Samples ahead) const;
 
 	/// Whether the source has run out of things to feed the sink.
-	bool source_out;
+	std::atomic<bool> source_out;
 
 	/// The decoder's current state.
-	Sink::State state;
+	/// The callback thread may move this from PLAYING to AT_END.
+	std::atomic<Sink::State> state;
+
+	/// The policy that sized our buffer, if any.
+	std::shared_ptr<BufferPolicy> buffer_policy;
+
+	// The callback keeps these for buffer_policy; they're guarded by the
+	// device lock, and only read once we're off the engine.
+
+	Samples played;        ///< Sample frames played in all.
+	Samples since_seek;    ///< Sample frames played since the last seek.
+	std::uint64_t underruns; ///< Times we ran dry while playing.
+	size_t lowest_fill;    ///< The fewest bytes buffered while playing.
+
+	/// Records how full we are after a callback, for buffer_policy.
+	void RecordFill(Samples wanted, Samples got);
+};
+
+/**
+ * An SDLSink that plays at the same time as the other sinks on its device.
+ *
+ * Rather than waiting in the engine's play queue, a MixerSink is mixed in over
+ * the top of it as soon as it starts, with a gain for each channel.  Any number
+ * of MixerSinks can share a device, which is enough to crossfade one file into
+ * another, or duck music under a voice-over, within one process.
+ */
+class MixerSink : public SDLSink
+{
+public:
+	/**
+	 * Constructs a MixerSink, with every channel at unity gain.
+	 * @param source The source from which this sink will receive audio.
+	 * @param device_id The device ID to which this sink will output.
+	 * @param buffer_policy The policy sizing our buffer, if any.
+	 */
+	MixerSink(const Source &source, int device_id, std::shared_ptr<BufferPolicy> buffer_policy = nullptr);
+
+	/// Destructs a MixerSink.
+	~MixerSink() override;
+
+	/**
+	 * Sets the gain of each channel.
+	 * * Precondition: @a gains has one gain for each channel.
+	 * @param gains The new gains, as linear multipliers.
+	 */
+	void SetGains(gsl::span<const float> gains);
+
+	/**
+	 * Gets the gain of each channel.
+	 * This is called by the engine in its callback thread, with the
+	 * device lock held.
+	 * @return The gains, as linear multipliers.
+	 */
+	[[nodiscard]] gsl::span<const float> Gains() const;
+
+protected:
+	void Attach() override;
+
+private:
+	/// The gain of each channel; guarded by the device lock.
+	std::vector<float> gains;
 };
 
 } // namespace Playd::Audio
@@ -0,0 +1,397 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the AlsaSink class.
+ * @see audio/sinks/alsa.h
+ */
+
+#ifdef WITH_ALSA
+
+#include "alsa.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <alsa/asoundlib.h>
+
+#include "../../errors.h"
+#include "../buffer_policy.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/// Mapping from SampleFormats to their equivalent ALSA formats.
+static const std::array<snd_pcm_format_t, SAMPLE_FORMAT_COUNT> pcm_formats{{
+        SND_PCM_FORMAT_U8,     // UINT8
+        SND_PCM_FORMAT_S8,     // SINT8
+        SND_PCM_FORMAT_S16,    // SINT16
+        SND_PCM_FORMAT_S32,    // SINT32
+        SND_PCM_FORMAT_FLOAT   // FLOAT32
+}};
+
+/// How long the playback thread waits for the device before checking on us.
+static constexpr int WAIT_MS = 100;
+
+/**
+ * Throws a ConfigError if an ALSA call failed.
+ * @param err The call's result.
+ * @param what What the call was doing, for the error message.
+ * @return @a err, if it didn't fail.
+ */
+static int Check(int err, const std::string &what)
+{
+	if (err < 0) throw ConfigError("ALSA: can't " + what + ": " + snd_strerror(err));
+	return err;
+}
+
+/**
+ * Lists the names of ALSA's output PCMs.
+ * The index of each name is its device ID.
+ * @return The names.
+ */
+static std::vector<std::pair<std::string, std::string>> OutputPcms()
+{
+	std::vector<std::pair<std::string, std::string>> pcms;
+
+	void **hints = nullptr;
+	if (snd_device_name_hint(-1, "pcm", &hints) < 0) return pcms;
+	const auto free_hints = gsl::finally([hints] { snd_device_name_free_hint(hints); });
+
+	for (auto **hint = hints; *hint != nullptr; hint++) {
+		// The hints hand us strings to free, some of which may be null.
+		const auto get = [hint](const char *id) {
+			std::unique_ptr<char, decltype(&std::free)> value{snd_device_name_get_hint(*hint, id), &std::free};
+			return value ? std::optional<std::string>{value.get()} : std::nullopt;
+		};
+
+		// No IOID means the PCM does both input and output.
+		const auto name = get("NAME");
+		const auto ioid = get("IOID");
+		if (!name || (ioid && *ioid != "Output")) continue;
+
+		// Descriptions run over several lines; the first is enough.
+		auto desc = get("DESC").value_or(*name);
+		desc = desc.substr(0, desc.find('\n'));
+		pcms.emplace_back(*name, *name + " (" + desc + ")");
+	}
+
+	return pcms;
+}
+
+AlsaSink::AlsaSink(const Audio::Source &source, int device_id, Periods periods,
+                   std::shared_ptr<BufferPolicy> buffer_policy)
+    : pcm{nullptr},
+      pcm_format{pcm_formats[static_cast<int>(source.OutputSampleFormat())]},
+      periods{periods},
+      channels{source.ChannelCount()},
+      bytes_per_sample{source.BytesPerSample()},
+      sample_rate{source.SampleRate()},
+      ring_buf{buffer_policy != nullptr ? buffer_policy->Bytes(source.SampleRate(), source.BytesPerSample())
+                                        : BufferPolicy::BytesFor(BufferPolicy::DEFAULT_SIZE, source.SampleRate(),
+                                                                 source.BytesPerSample())},
+      // As with SDLSink, waking at half full leaves the decoder plenty of
+      // slack, and stopping short of full leaves room to drain into.
+      low_watermark{ring_buf.Capacity() / 2},
+      high_watermark{ring_buf.Capacity() - (ring_buf.Capacity() / 8)},
+      position_sample_count{0},
+      state{Sink::State::STOPPED},
+      source_out{false},
+      refill_pending{false},
+      quitting{false}
+{
+	const auto pcms = OutputPcms();
+	if (device_id < 0 || static_cast<int>(pcms.size()) <= device_id) {
+		throw ConfigError("invalid ALSA device: " + std::to_string(device_id));
+	}
+
+	try {
+		this->Open(pcms[device_id].first);
+	} catch (ConfigError &) {
+		// We won't get to the destructor, so have to close up here.
+		if (this->pcm != nullptr) snd_pcm_close(this->pcm);
+		throw;
+	}
+
+	this->thread = std::thread{&AlsaSink::Run, this};
+}
+
+AlsaSink::~AlsaSink()
+{
+	{
+		std::lock_guard guard{this->lock};
+		this->quitting = true;
+	}
+	this->wakeup.notify_all();
+	this->thread.join();
+
+	snd_pcm_close(this->pcm);
+}
+
+void AlsaSink::Open(const std::string &name)
+{
+	Check(snd_pcm_open(&this->pcm, name.c_str(), SND_PCM_STREAM_PLAYBACK, 0), "open " + name);
+
+	snd_pcm_hw_params_t *hw = nullptr;
+	snd_pcm_hw_params_alloca(&hw);
+	Check(snd_pcm_hw_params_any(this->pcm, hw), "get hardware parameters");
+
+	// Writing straight into the driver's buffer saves a copy through
+	// alsa-lib, and lets us fill whole periods in place.
+	Check(snd_pcm_hw_params_set_access(this->pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED), "use mmap access");
+	Check(snd_pcm_hw_params_set_format(this->pcm, hw, this->pcm_format), "set the sample format");
+	Check(snd_pcm_hw_params_set_channels(this->pcm, hw, this->channels), "set the channel count");
+	Check(snd_pcm_hw_params_set_rate(this->pcm, hw, this->sample_rate, 0),
+	      "play at " + std::to_string(this->sample_rate) + " Hz");
+
+	snd_pcm_uframes_t size = this->periods.size;
+	Check(snd_pcm_hw_params_set_period_size_near(this->pcm, hw, &size, nullptr), "set the period size");
+	unsigned int count = this->periods.count;
+	Check(snd_pcm_hw_params_set_periods_near(this->pcm, hw, &count, nullptr), "set the period count");
+	Check(snd_pcm_hw_params(this->pcm, hw), "set hardware parameters");
+	this->periods = Periods{gsl::narrow<std::uint32_t>(size), count};
+
+	// The device starts itself once it has a period to play, and wakes us
+	// whenever there's room for another.
+	snd_pcm_sw_params_t *sw = nullptr;
+	snd_pcm_sw_params_alloca(&sw);
+	Check(snd_pcm_sw_params_current(this->pcm, sw), "get software parameters");
+	Check(snd_pcm_sw_params_set_start_threshold(this->pcm, sw, size), "set the start threshold");
+	Check(snd_pcm_sw_params_set_avail_min(this->pcm, sw, size), "set the wake-up threshold");
+	Check(snd_pcm_sw_params(this->pcm, sw), "set software parameters");
+
+	Check(snd_pcm_prepare(this->pcm), "prepare the device");
+}
+
+void AlsaSink::Start()
+{
+	{
+		std::lock_guard guard{this->lock};
+		if (this->state == Sink::State::PLAYING) return;
+		this->state = Sink::State::PLAYING;
+	}
+	this->wakeup.notify_all();
+}
+
+void AlsaSink::Stop()
+{
+	std::lock_guard guard{this->lock};
+	this->state = Sink::State::STOPPED;
+	this->Drop();
+}
+
+Sink::State AlsaSink::CurrentState()
+{
+	return this->state;
+}
+
+Samples AlsaSink::Position()
+{
+	std::lock_guard guard{this->lock};
+	const auto handed = this->position_sample_count.load();
+
+	// What's heard now is what we've handed over, less what's still
+	// queued up in the device.  Underruns pad the device with silence,
+	// so the delay can sometimes run past what we gave it.
+	snd_pcm_sframes_t delay = 0;
+	if (this->state != Sink::State::PLAYING || snd_pcm_delay(this->pcm, &delay) < 0 || delay < 0) delay = 0;
+	return handed - std::min<Samples>(handed, static_cast<Samples>(delay));
+}
+
+void AlsaSink::SetPosition(Samples samples)
+{
+	{
+		std::lock_guard guard{this->lock};
+		this->Drop();
+		this->position_sample_count = samples;
+
+		// With the thread kept out, nothing can play old samples as if
+		// they were from the new position.
+		this->ring_buf.Flush();
+	}
+
+	// We might have been at the end of the file previously.
+	// If so, we might not be now, so clear the out flags.
+	this->source_out.store(false, std::memory_order_release);
+	if (this->state == Sink::State::AT_END) this->state = Sink::State::STOPPED;
+	this->refill_pending.store(false, std::memory_order_release);
+}
+
+void AlsaSink::SourceOut()
+{
+	this->source_out.store(true, std::memory_order_release);
+}
+
+size_t AlsaSink::Transfer(gsl::span<const std::byte> src)
+{
+	if (src.empty()) return 0;
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	auto count = std::min(src.size(), this->ring_buf.WriteCapacity());
+	count -= count % this->bytes_per_sample;
+	if (count == 0) return 0;
+
+	const auto written = this->ring_buf.Write(src.first(count));
+	Ensures(written == count);
+
+	if (this->high_watermark <= this->ring_buf.ReadCapacity()) {
+		this->refill_pending.store(false, std::memory_order_release);
+	}
+	return written;
+}
+
+bool AlsaSink::WantsMore()
+{
+	if (this->ring_buf.WriteCapacity() < this->bytes_per_sample) return false;
+	return this->ring_buf.ReadCapacity() < this->high_watermark;
+}
+
+std::optional<Samples> AlsaSink::Buffered()
+{
+	return this->ring_buf.ReadCapacity() / this->bytes_per_sample;
+}
+
+std::size_t AlsaSink::BufferBytes() const
+{
+	return this->ring_buf.Capacity();
+}
+
+void AlsaSink::SetWakeHandler(WakeFn new_wake)
+{
+	std::lock_guard guard{this->lock};
+	this->wake = std::move(new_wake);
+}
+
+AlsaSink::Periods AlsaSink::DevicePeriods() const
+{
+	return this->periods;
+}
+
+/* static */ std::vector<std::pair<int, std::string>> AlsaSink::GetDevicesInfo()
+{
+	std::vector<std::pair<int, std::string>> list;
+
+	const auto pcms = OutputPcms();
+	for (std::size_t i = 0; i < pcms.size(); i++) list.emplace_back(gsl::narrow<int>(i), pcms[i].second);
+	return list;
+}
+
+/* static */ bool AlsaSink::IsOutputDevice(int id)
+{
+	return 0 <= id && static_cast<std::size_t>(id) < OutputPcms().size();
+}
+
+void AlsaSink::Run()
+{
+	std::unique_lock guard{this->lock};
+	while (!this->quitting) {
+		if (this->state != Sink::State::PLAYING) {
+			this->wakeup.wait(guard);
+			continue;
+		}
+		this->PlayPeriod(guard);
+	}
+}
+
+void AlsaSink::PlayPeriod(std::unique_lock<std::mutex> &guard)
+{
+	const auto avail = snd_pcm_avail_update(this->pcm);
+	if (avail < 0) {
+		if (!this->Recover(static_cast<int>(avail))) this->state = Sink::State::STOPPED;
+		return;
+	}
+
+	// Wait for a whole period's worth of room, letting go of the lock so
+	// that we can be stopped or moved in the meantime.
+	if (avail < static_cast<snd_pcm_sframes_t>(this->periods.size)) {
+		guard.unlock();
+		const auto err = snd_pcm_wait(this->pcm, WAIT_MS);
+		guard.lock();
+		if (err < 0 && !this->Recover(err)) this->state = Sink::State::STOPPED;
+		return;
+	}
+
+	const snd_pcm_channel_area_t *areas = nullptr;
+	snd_pcm_uframes_t offset = 0;
+	snd_pcm_uframes_t frames = this->periods.size;
+	if (const auto err = snd_pcm_mmap_begin(this->pcm, &areas, &offset, &frames); err < 0) {
+		if (!this->Recover(err)) this->state = Sink::State::STOPPED;
+		return;
+	}
+
+	// Interleaved areas all share the first channel's buffer.
+	auto *base = static_cast<std::byte *>(areas[0].addr) + (areas[0].first / 8) + (offset * this->bytes_per_sample);
+	const auto out = gsl::span<std::byte>(base, frames * this->bytes_per_sample);
+	const auto read = this->ring_buf.ReadSome(out);
+	const auto read_samples = read / this->bytes_per_sample;
+
+	// Anything we couldn't fill has to be silence, as the device plays
+	// whole periods whatever.
+	if (read_samples < frames) {
+		snd_pcm_areas_silence(areas, offset + read_samples, this->channels, frames - read_samples, this->pcm_format);
+	}
+
+	if (const auto err = snd_pcm_mmap_commit(this->pcm, offset, frames); err < 0) {
+		if (!this->Recover(static_cast<int>(err))) this->state = Sink::State::STOPPED;
+		return;
+	}
+
+	const auto old_pos = this->position_sample_count.fetch_add(read_samples);
+	const auto new_pos = old_pos + read_samples;
+
+	// Have we run out of things to feed?  If the source is out too, so
+	// are we; the silence we just wrote covers the rest of the device's
+	// buffer while it drains.
+	if (read_samples == 0 && this->source_out.load(std::memory_order_acquire)) {
+		this->state = Sink::State::AT_END;
+		this->Wake();
+		return;
+	}
+
+	// As in SDLSink, wake the decoder when low (once per refill), and
+	// once a second to keep position announcements going.
+	const auto low = this->ring_buf.ReadCapacity() < this->low_watermark;
+	const auto refill = low && !this->source_out.load(std::memory_order_acquire) &&
+	                    !this->refill_pending.exchange(true, std::memory_order_acq_rel);
+	const auto milestone = (old_pos / this->sample_rate) != (new_pos / this->sample_rate);
+	if (refill || milestone) this->Wake();
+}
+
+bool AlsaSink::Recover(int err)
+{
+	// This handles underruns (-EPIPE) and suspends (-ESTRPIPE), which is
+	// all we can sensibly do anything about.
+	if (const auto rerr = snd_pcm_recover(this->pcm, err, 1); rerr < 0) {
+		Debug() << "alsa: can't recover:" << snd_strerror(rerr) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void AlsaSink::Drop()
+{
+	snd_pcm_drop(this->pcm);
+	snd_pcm_prepare(this->pcm);
+}
+
+void AlsaSink::Wake()
+{
+	if (this->wake) this->wake();
+}
+
+} // namespace Playd::Audio
+
+#endif // WITH_ALSA
@@ -0,0 +1,188 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the AlsaSink class.
+ * @see audio/sinks/alsa.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SINKS_ALSA_H
+#define PLAYD_AUDIO_SINKS_ALSA_H
+#ifdef WITH_ALSA
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <alsa/asoundlib.h>
+
+#include "../buffer_policy.h"
+#include "../ringbuffer.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * An output stream for audio, straight to ALSA.
+ *
+ * Unlike SDLSink, there's no layer between us and the driver: the device is
+ * opened in the source's own format, with the period size and count asked
+ * for, and a playback thread copies from the ring buffer straight into the
+ * driver's memory-mapped buffer, one period at a time.  Latency is thus
+ * whatever the periods add up to, and no more.
+ *
+ * Sound servers that speak ALSA (PipeWire, and JACK through its ALSA plugin)
+ * can be played to by opening their PCM, usually "pipewire" or "jack".
+ *
+ * Each sink opens the device for itself, so sharing a device between players
+ * needs a PCM that mixes, such as "default" or "dmix".
+ */
+class AlsaSink : public Sink
+{
+public:
+	/// The shape of the device's buffer.
+	struct Periods {
+		std::uint32_t size;  ///< The frames in each period.
+		std::uint32_t count; ///< The periods in the buffer.
+	};
+
+	/// The buffer shape asked for if nothing else is.
+	static constexpr Periods DEFAULT_PERIODS{256, 3};
+
+	/**
+	 * Constructs an AlsaSink, opening its device.
+	 * @param source The source from which this sink will receive audio.
+	 * @param device_id The ID of the ALSA PCM, from GetDevicesInfo().
+	 * @param periods The buffer shape to ask the device for; the device
+	 *   may round it, see DevicePeriods().
+	 * @param buffer_policy The policy sizing our ring buffer, if any.
+	 * @exception ConfigError if the device can't be opened in the source's
+	 *   format.
+	 */
+	AlsaSink(const Source &source, int device_id, Periods periods,
+	         std::shared_ptr<BufferPolicy> buffer_policy = nullptr);
+
+	/// Destructs an AlsaSink, closing its device.
+	~AlsaSink() override;
+
+	/// Deleted copy constructor.
+	AlsaSink(const AlsaSink &) = delete;
+
+	/// Deleted copy-assignment.
+	AlsaSink &operator=(const AlsaSink &) = delete;
+
+	void Start() override;
+
+	void Stop() override;
+
+	Sink::State CurrentState() override;
+
+	Samples Position() override;
+
+	void SetPosition(Samples samples) override;
+
+	void SourceOut() override;
+
+	size_t Transfer(gsl::span<const std::byte> src) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	[[nodiscard]] std::size_t BufferBytes() const override;
+
+	void SetWakeHandler(WakeFn wake) override;
+
+	/**
+	 * The buffer shape the device actually gave us.
+	 * @return The period size and count.
+	 */
+	[[nodiscard]] Periods DevicePeriods() const;
+
+	/**
+	 * Gets the number and name of each ALSA output PCM.
+	 * @return List of output PCMs, with their IDs.
+	 */
+	static std::vector<std::pair<int, std::string>> GetDevicesInfo();
+
+	/**
+	 * Can an ALSA PCM output sound?
+	 * @param id Device ID.
+	 * @return If the PCM exists, and can handle outputting sound.
+	 */
+	static bool IsOutputDevice(int id);
+
+private:
+	/**
+	 * Opens and sets up the device, in our format.
+	 * @param name The name of the ALSA PCM.
+	 * @exception ConfigError if the device can't be set up.
+	 */
+	void Open(const std::string &name);
+
+	/// The body of the playback thread.
+	void Run();
+
+	/**
+	 * Copies one period's worth of audio into the device.
+	 * This is called on the playback thread, with lock held.
+	 * @param guard The lock guard, which is released while waiting for
+	 *   the device to have room.
+	 */
+	void PlayPeriod(std::unique_lock<std::mutex> &guard);
+
+	/**
+	 * Gets the device going again after an error (or underrun).
+	 * @param err The error.
+	 * @return Whether the device recovered.
+	 */
+	bool Recover(int err);
+
+	/// Throws away whatever the device has buffered; lock must be held.
+	void Drop();
+
+	/// Calls the wake handler, if there is one; lock must be held.
+	void Wake();
+
+	snd_pcm_t *pcm;              ///< The open device.
+	snd_pcm_format_t pcm_format; ///< The device's sample format.
+	Periods periods;             ///< The buffer shape we got.
+
+	std::uint8_t channels;        ///< The number of channels.
+	std::size_t bytes_per_sample; ///< Bytes in one sample frame.
+	std::uint32_t sample_rate;    ///< The sample rate, in Hz.
+
+	RingBuffer ring_buf;        ///< Samples waiting to go to the device.
+	std::size_t low_watermark;  ///< Below this, we wake the decoder.
+	std::size_t high_watermark; ///< Above this, we stop asking for more.
+
+	/// Sample frames handed to the device so far.
+	std::atomic<Samples> position_sample_count;
+
+	std::atomic<Sink::State> state;       ///< The sink's state.
+	std::atomic<bool> source_out;         ///< Whether the source is out.
+	std::atomic<bool> refill_pending;     ///< Whether a refill wake is out.
+
+	/// Guards pcm, wake, quitting, and the consumer side of ring_buf.
+	std::mutex lock;
+	std::condition_variable wakeup; ///< Wakes the thread when playing.
+	bool quitting;                  ///< Whether the thread should stop.
+	WakeFn wake;                    ///< Called when we need attention.
+
+	std::thread thread; ///< The playback thread.
+};
+
+} // namespace Playd::Audio
+
+#endif // WITH_ALSA
+#endif // PLAYD_AUDIO_SINKS_ALSA_H
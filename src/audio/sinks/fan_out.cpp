@@ -0,0 +1,267 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the FanOutSink class.
+ * @see audio/sinks/fan_out.h
+ */
+
+#include "fan_out.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "../../clock.h"
+#include "../../errors.h"
+#include "../convert.h"
+#include "../drift_resampler.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+FanOutSink::FanOutSink(const Source &source, std::vector<std::unique_ptr<Sink>> sinks, const Clock &clock)
+    : leader{nullptr},
+      clock{clock},
+      sample_rate{source.SampleRate()},
+      channels{source.ChannelCount()},
+      bytes_per_sample{source.BytesPerSample()},
+      format{source.OutputSampleFormat()},
+      to_float{FindConverter(format, SampleFormat::FLOAT32)},
+      from_float{FindConverter(SampleFormat::FLOAT32, format)},
+      max_pending{source.SampleRate() * source.BytesPerSample()},
+      base{0},
+      last_steer{clock.Now()}
+{
+	Expects(!sinks.empty());
+	if (1 < sinks.size() && (this->to_float == nullptr || this->from_float == nullptr)) {
+		throw FileError("can't keep mirrored devices in step in this sample format");
+	}
+
+	this->leader = std::move(sinks.front());
+	for (auto it = std::next(sinks.begin()); it != sinks.end(); it++) {
+		this->mirrors.push_back(std::unique_ptr<Mirror>(
+		        new Mirror{std::move(*it), DriftResampler{this->channels}, {}, 0.0, 0.0, false, {0}, {0.0}, {0}}));
+	}
+}
+
+void FanOutSink::Start()
+{
+	// The mirrors' devices start a little after the leader's, but the
+	// steering soon makes up for that.
+	this->leader->Start();
+	for (auto &mirror : this->mirrors) mirror->sink->Start();
+}
+
+void FanOutSink::Stop()
+{
+	this->leader->Stop();
+	for (auto &mirror : this->mirrors) mirror->sink->Stop();
+}
+
+void FanOutSink::StartAt(Clock::TimePoint when)
+{
+	this->leader->StartAt(when);
+	for (auto &mirror : this->mirrors) mirror->sink->StartAt(when);
+}
+
+void FanOutSink::StopAt(Clock::TimePoint when)
+{
+	this->leader->StopAt(when);
+	for (auto &mirror : this->mirrors) mirror->sink->StopAt(when);
+}
+
+Sink::State FanOutSink::CurrentState()
+{
+	return this->leader->CurrentState();
+}
+
+bool FanOutSink::Sounding()
+{
+	return this->leader->Sounding();
+}
+
+Samples FanOutSink::Position()
+{
+	return this->leader->Position();
+}
+
+void FanOutSink::SetPosition(Samples samples)
+{
+	this->leader->SetPosition(samples);
+	for (auto &mirror : this->mirrors) mirror->sink->SetPosition(samples);
+	this->base = samples;
+	this->ResetMirrors();
+}
+
+void FanOutSink::SourceOut()
+{
+	// Mirrors only get what they can take now; whatever they'd kept back
+	// of the very end is lost.
+	for (auto &mirror : this->mirrors) {
+		Flush(*mirror);
+		mirror->sink->SourceOut();
+	}
+	this->leader->SourceOut();
+}
+
+size_t FanOutSink::Transfer(gsl::span<const std::byte> src)
+{
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	this->Steer();
+
+	// The mirrors follow however much the leader takes.
+	const auto taken = this->leader->Transfer(src);
+	if (taken == 0) {
+		for (auto &mirror : this->mirrors) Flush(*mirror);
+		return 0;
+	}
+	for (auto &mirror : this->mirrors) this->Feed(*mirror, src.first(taken));
+	return taken;
+}
+
+bool FanOutSink::WantsMore()
+{
+	return this->leader->WantsMore();
+}
+
+std::optional<Samples> FanOutSink::Buffered()
+{
+	return this->leader->Buffered();
+}
+
+void FanOutSink::SetWakeHandler(WakeFn wake)
+{
+	// The mirrors are fed whenever the leader is, which is often enough.
+	this->leader->SetWakeHandler(std::move(wake));
+}
+
+std::optional<CallbackStats::Snapshot> FanOutSink::Stats()
+{
+	return this->leader->Stats();
+}
+
+std::size_t FanOutSink::BufferBytes() const
+{
+	auto bytes = this->leader->BufferBytes() + (this->floats_in.capacity() + this->floats_out.capacity()) * sizeof(float);
+	for (const auto &mirror : this->mirrors) {
+		bytes += mirror->sink->BufferBytes() + mirror->pending.capacity() + mirror->resampler.ScratchBytes();
+	}
+	return bytes;
+}
+
+ConversionList FanOutSink::Conversions() const
+{
+	return this->leader->Conversions();
+}
+
+std::vector<FanOutSink::MirrorStats> FanOutSink::Mirrors() const
+{
+	std::vector<MirrorStats> stats;
+	stats.reserve(this->mirrors.size());
+	for (const auto &mirror : this->mirrors) {
+		stats.push_back(MirrorStats{std::chrono::microseconds{mirror->lead_us.load(std::memory_order_relaxed)},
+		                            mirror->correction.load(std::memory_order_relaxed),
+		                            mirror->overflows.load(std::memory_order_relaxed)});
+	}
+	return stats;
+}
+
+void FanOutSink::Feed(Mirror &mirror, gsl::span<const std::byte> src)
+{
+	const auto count = src.size() / this->bytes_per_sample * this->channels;
+	this->floats_in.resize(count);
+	this->to_float(src.data(), reinterpret_cast<std::byte *>(this->floats_in.data()), count);
+
+	this->floats_out.clear();
+	mirror.resampler.Process(this->floats_in, this->floats_out);
+
+	const auto at = mirror.pending.size();
+	const auto bytes = this->floats_out.size() / this->channels * this->bytes_per_sample;
+	mirror.pending.resize(at + bytes);
+	this->from_float(reinterpret_cast<const std::byte *>(this->floats_out.data()), mirror.pending.data() + at,
+	                 this->floats_out.size());
+	Flush(mirror);
+
+	// A mirror that has stopped taking anything (its device gone, say)
+	// mustn't keep us filling up memory on its behalf.
+	if (this->max_pending < mirror.pending.size()) {
+		mirror.pending.clear();
+		mirror.overflows.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/* static */ void FanOutSink::Flush(Mirror &mirror)
+{
+	if (mirror.pending.empty()) return;
+
+	const auto taken = mirror.sink->Transfer(mirror.pending);
+	mirror.pending.erase(mirror.pending.begin(), mirror.pending.begin() + static_cast<std::ptrdiff_t>(taken));
+}
+
+void FanOutSink::Steer()
+{
+	const auto now = this->clock.Now();
+	const auto elapsed = std::chrono::duration<double>(now - this->last_steer).count();
+	if (elapsed < std::chrono::duration<double>(STEER_PERIOD).count()) return;
+	this->last_steer = now;
+
+	// Until both are heard, there's nothing to compare.
+	if (this->leader->CurrentState() != Sink::State::PLAYING || !this->leader->Sounding()) return;
+	const auto heard = static_cast<double>(this->leader->Position());
+
+	for (auto &m : this->mirrors) {
+		auto &mirror = *m;
+		if (mirror.sink->CurrentState() != Sink::State::PLAYING || !mirror.sink->Sounding()) continue;
+
+		// Whatever the mirror has been given but not yet played (whether
+		// it's in the sink, or still here) came from the input just before
+		// where the resampler has got to.
+		const auto &resampler = mirror.resampler;
+		const auto position = mirror.sink->Position();
+		const auto played = std::min<Samples>(position - std::min(position, this->base), resampler.Produced());
+		const auto unplayed = static_cast<double>(resampler.Produced() - played) * resampler.Step();
+		const auto mirror_heard = static_cast<double>(this->base) + resampler.Consumed() - unplayed;
+		const auto lead = (mirror_heard - heard) / this->sample_rate;
+
+		mirror.lead = mirror.steering ? mirror.lead + LEAD_SMOOTHING * (lead - mirror.lead) : lead;
+		mirror.steering = true;
+
+		// A mirror that is ahead needs to go through its input more
+		// slowly, so it gets more samples for each one it's given.  The
+		// integral term is what settles on the devices' actual drift, and
+		// is held within what the correction can use.
+		const auto integral_limit = MAX_CORRECTION / INTEGRAL_GAIN;
+		mirror.integral = std::clamp(mirror.integral + mirror.lead * elapsed, -integral_limit, integral_limit);
+		const auto correction = std::clamp(PROPORTIONAL_GAIN * mirror.lead + INTEGRAL_GAIN * mirror.integral,
+		                                   -MAX_CORRECTION, MAX_CORRECTION);
+		mirror.resampler.SetStep(1.0 - correction);
+
+		mirror.lead_us.store(std::llround(mirror.lead * 1e6), std::memory_order_relaxed);
+		mirror.correction.store(correction, std::memory_order_relaxed);
+	}
+}
+
+void FanOutSink::ResetMirrors()
+{
+	// The drift between the devices is the same as before the seek, so the
+	// ratio (and what it has learned) carries on.
+	for (auto &mirror : this->mirrors) {
+		mirror->resampler.Reset();
+		mirror->pending.clear();
+		mirror->steering = false;
+	}
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,174 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the FanOutSink class.
+ * @see audio/sinks/fan_out.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SINKS_FAN_OUT_H
+#define PLAYD_AUDIO_SINKS_FAN_OUT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "../../clock.h"
+#include "../convert.h"
+#include "../drift_resampler.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * An output stream for audio that plays one decode on several devices at
+ * once, kept in step with each other.
+ *
+ * The first of its sinks leads: it gets the samples as they come, and
+ * everything about the fan-out (its state, position, buffer and statistics)
+ * is the leader's.  Each of the others, the mirrors, gets the same samples
+ * through a DriftResampler.  Every so often, the fan-out compares where each
+ * mirror's device has got to in the audio with where the leader's has, by
+ * their sinks' estimates of what is being heard, and nudges the mirror's
+ * resampling ratio (by at most MAX_CORRECTION) to close the gap.  Devices on
+ * separate clocks thus stay together however long they play, rather than
+ * drifting apart by a few samples a second.
+ *
+ * Mirrors whose sinks are fuller than the leader's keep what they can't take
+ * yet, up to a second of it, to hand over next time.
+ */
+class FanOutSink : public Sink
+{
+public:
+	/// How a mirror is keeping up with the leader.
+	struct MirrorStats {
+		std::chrono::microseconds lead; ///< How far ahead of the leader it is heard (behind, if negative).
+		double correction;              ///< How far its ratio is moved from 1; positive if held back.
+		std::uint64_t overflows;        ///< Times it took so little that what it hadn't taken was dropped.
+	};
+
+	/// The most a mirror's resampling ratio is moved from 1.
+	static constexpr double MAX_CORRECTION = 0.005;
+
+	/// How often the mirrors' ratios are reconsidered, at most.
+	static constexpr std::chrono::milliseconds STEER_PERIOD{100};
+
+	/**
+	 * Constructs a FanOutSink.
+	 * * Precondition: @a sinks isn't empty, and each was made for @a source.
+	 * @param source The source from which this sink will receive audio.
+	 * @param sinks The sinks to play into; the first leads.
+	 * @param clock The clock by which steering is timed, which must outlive
+	 *   the sink.
+	 * @exception FileError if the mirrors can't be resampled in @a source's
+	 *   sample format.
+	 */
+	FanOutSink(const Source &source, std::vector<std::unique_ptr<Sink>> sinks,
+	           const Clock &clock = Clock::Steady());
+
+	void Start() override;
+
+	void Stop() override;
+
+	void StartAt(Clock::TimePoint when) override;
+
+	void StopAt(Clock::TimePoint when) override;
+
+	Sink::State CurrentState() override;
+
+	bool Sounding() override;
+
+	Samples Position() override;
+
+	void SetPosition(Samples samples) override;
+
+	void SourceOut() override;
+
+	size_t Transfer(gsl::span<const std::byte> src) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	void SetWakeHandler(WakeFn wake) override;
+
+	std::optional<CallbackStats::Snapshot> Stats() override;
+
+	[[nodiscard]] std::size_t BufferBytes() const override;
+
+	/// @return The leader's conversions, which are everything's but the mirrors' resampling.
+	[[nodiscard]] ConversionList Conversions() const override;
+
+	/// @return How each mirror, in order, is keeping up with the leader.
+	[[nodiscard]] std::vector<MirrorStats> Mirrors() const;
+
+private:
+	/// How hard a mirror's ratio is pushed for each second it is out.
+	static constexpr double PROPORTIONAL_GAIN = 0.2;
+
+	/// How hard it is pushed for each second it has been out, per second.
+	static constexpr double INTEGRAL_GAIN = 0.01;
+
+	/// How much of each new lead measurement goes into the smoothed lead.
+	static constexpr double LEAD_SMOOTHING = 0.25;
+
+	/// A sink playing a resampled copy of the leader's samples.
+	struct Mirror {
+		std::unique_ptr<Sink> sink;      ///< The sink.
+		DriftResampler resampler;        ///< Keeps the sink in step.
+		std::vector<std::byte> pending;  ///< Resampled samples the sink hasn't yet taken.
+		double lead;                     ///< The smoothed lead, in seconds.
+		double integral;                 ///< The lead, integrated over time, in seconds squared.
+		bool steering;                   ///< Whether lead has a measurement in it yet.
+		std::atomic<std::int64_t> lead_us;     ///< lead, for Mirrors().
+		std::atomic<double> correction;        ///< The correction, for Mirrors().
+		std::atomic<std::uint64_t> overflows;  ///< @see MirrorStats
+	};
+
+	/**
+	 * Hands a mirror the samples the leader took, resampled.
+	 * @param mirror The mirror.
+	 * @param src The samples.
+	 */
+	void Feed(Mirror &mirror, gsl::span<const std::byte> src);
+
+	/**
+	 * Hands a mirror as much of what it hasn't yet taken as it will take.
+	 * @param mirror The mirror.
+	 */
+	static void Flush(Mirror &mirror);
+
+	/// Reconsiders each mirror's ratio, if it has been STEER_PERIOD since last.
+	void Steer();
+
+	/// Forgets everything each mirror was doing, as after a seek.
+	void ResetMirrors();
+
+	std::unique_ptr<Sink> leader;                 ///< The leader.
+	std::vector<std::unique_ptr<Mirror>> mirrors; ///< The mirrors.
+	const Clock &clock;                           ///< The clock steering is timed by.
+
+	std::uint32_t sample_rate;    ///< The sample rate, in Hz.
+	std::uint8_t channels;        ///< Number of interleaved channels.
+	std::size_t bytes_per_sample; ///< Bytes in one sample frame.
+	SampleFormat format;          ///< The source's sample format.
+	ConvertFn to_float;           ///< Converts the source's samples for resampling.
+	ConvertFn from_float;         ///< Converts resampled samples back.
+	std::size_t max_pending;      ///< The most bytes a mirror keeps back.
+
+	Samples base;                    ///< The position set by the last seek.
+	Clock::TimePoint last_steer;     ///< When the mirrors were last steered.
+	std::vector<float> floats_in;    ///< The samples being fed, as FLOAT32.
+	std::vector<float> floats_out;   ///< The same samples, resampled.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SINKS_FAN_OUT_H
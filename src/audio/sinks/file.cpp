@@ -0,0 +1,213 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the FileSink class.
+ * @see audio/sinks/file.h
+ */
+
+#include "file.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include "../../errors.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/// The size of the stdio buffer in front of the file; renders write a lot.
+static constexpr std::size_t FILE_BUFFER_BYTES = 1024 * 1024;
+
+/// The WAV format tag for integer samples.
+static constexpr std::uint16_t WAVE_FORMAT_PCM = 1;
+
+/// The WAV format tag for floating-point samples.
+static constexpr std::uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
+/**
+ * Writes a little-endian integer into a WAV header.
+ * @param out The header.
+ * @param at The offset at which to write.
+ * @param value The value.
+ * @param bytes How many bytes of @a value to write.
+ */
+static void PutLE(gsl::span<std::byte> out, std::size_t at, std::uint32_t value, std::size_t bytes)
+{
+	for (std::size_t i = 0; i < bytes; i++) out[at + i] = static_cast<std::byte>((value >> (8 * i)) & 0xFFU);
+}
+
+/**
+ * Writes a four-character code into a WAV header.
+ * @param out The header.
+ * @param at The offset at which to write.
+ * @param code The code.
+ */
+static void PutCode(gsl::span<std::byte> out, std::size_t at, std::string_view code)
+{
+	for (std::size_t i = 0; i < 4; i++) out[at + i] = static_cast<std::byte>(code[i]);
+}
+
+FileSink::FileSink(const Audio::Source &source, const std::string &path, Container container)
+    : file{nullptr},
+      seekable{false},
+      container{container},
+      format{source.OutputSampleFormat()},
+      channels{source.ChannelCount()},
+      bytes_per_sample{source.BytesPerSample()},
+      sample_rate{source.SampleRate()},
+      written{0},
+      position_sample_count{0},
+      state{Sink::State::STOPPED},
+      source_out{false}
+{
+	if (container == Container::WAV) {
+		if constexpr (std::endian::native != std::endian::little) {
+			throw FileError("WAV files can only be written on little-endian machines");
+		}
+
+		// Check the format before we truncate anything.
+		std::array<std::byte, WAV_HEADER_BYTES> header{};
+		PackWavHeader(header, this->format, this->channels, this->sample_rate, 0);
+	}
+
+	if (path == STDOUT_PATH) {
+		this->file = stdout;
+	} else {
+		this->file = std::fopen(path.c_str(), "wb");
+		if (this->file == nullptr) throw FileError("can't open " + path + ": " + std::strerror(errno));
+	}
+	std::setvbuf(this->file, nullptr, _IOFBF, FILE_BUFFER_BYTES);
+
+	// Pipes can't go back to fix the header up, so they get one with the
+	// sizes left unknown.
+	this->seekable = std::fseek(this->file, 0, SEEK_CUR) == 0;
+	if (!this->seekable) this->written = UINT64_MAX;
+	this->WriteHeader();
+	this->written = 0;
+}
+
+FileSink::~FileSink()
+{
+	if (this->seekable && std::fseek(this->file, 0, SEEK_SET) == 0) this->WriteHeader();
+
+	const auto err = this->file == stdout ? std::fflush(this->file) : std::fclose(this->file);
+	if (err != 0) Debug() << "file sink: can't finish writing:" << std::strerror(errno) << std::endl;
+}
+
+void FileSink::WriteHeader()
+{
+	if (this->container != Container::WAV) return;
+
+	std::array<std::byte, WAV_HEADER_BYTES> header{};
+	PackWavHeader(header, this->format, this->channels, this->sample_rate, this->written);
+	if (std::fwrite(header.data(), 1, header.size(), this->file) != header.size()) {
+		Debug() << "file sink: can't write WAV header:" << std::strerror(errno) << std::endl;
+	}
+}
+
+/* static */ void FileSink::PackWavHeader(gsl::span<std::byte, WAV_HEADER_BYTES> out, SampleFormat format,
+                                          std::uint8_t channels, std::uint32_t rate, std::uint64_t data_bytes)
+{
+	// WAV's 8-bit samples are unsigned, and it has no signed ones.
+	if (format == SampleFormat::SINT8) throw FileError("WAV files can't hold signed 8-bit samples");
+
+	const auto bps = static_cast<std::uint32_t>(sample_format_bps[static_cast<std::size_t>(format)]);
+	const auto block = channels * bps;
+	const auto data = static_cast<std::uint32_t>(std::min<std::uint64_t>(data_bytes, UINT32_MAX - 36));
+	const auto riff = data_bytes < UINT32_MAX - 36 ? data + 36 : UINT32_MAX;
+
+	PutCode(out, 0, "RIFF");
+	PutLE(out, 4, riff, 4);
+	PutCode(out, 8, "WAVE");
+	PutCode(out, 12, "fmt ");
+	PutLE(out, 16, 16, 4);
+	PutLE(out, 20, format == SampleFormat::FLOAT32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2);
+	PutLE(out, 22, channels, 2);
+	PutLE(out, 24, rate, 4);
+	PutLE(out, 28, rate * block, 4);
+	PutLE(out, 32, block, 2);
+	PutLE(out, 34, bps * 8, 2);
+	PutCode(out, 36, "data");
+	PutLE(out, 40, data_bytes < UINT32_MAX - 36 ? data : UINT32_MAX, 4);
+}
+
+void FileSink::Start()
+{
+	this->state = Sink::State::PLAYING;
+}
+
+void FileSink::Stop()
+{
+	this->state = Sink::State::STOPPED;
+}
+
+Sink::State FileSink::CurrentState()
+{
+	// There's nothing buffered, so the end of the source is the end of us.
+	const auto s = this->state.load();
+	if (s == Sink::State::PLAYING && this->source_out) return Sink::State::AT_END;
+	return s;
+}
+
+Samples FileSink::Position()
+{
+	return this->position_sample_count;
+}
+
+void FileSink::SetPosition(Samples samples)
+{
+	// The file just carries on from wherever we are; seeking only moves
+	// where the samples are said to have come from.
+	this->position_sample_count = samples;
+	this->source_out = false;
+}
+
+void FileSink::SourceOut()
+{
+	this->source_out = true;
+}
+
+size_t FileSink::Transfer(gsl::span<const std::byte> src)
+{
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	if (this->state != Sink::State::PLAYING || src.empty()) return 0;
+
+	if (std::fwrite(src.data(), 1, src.size(), this->file) != src.size()) {
+		throw FileError(std::string{"can't write rendered audio: "} + std::strerror(errno));
+	}
+	this->written += src.size();
+	this->position_sample_count += src.size() / this->bytes_per_sample;
+
+	return src.size();
+}
+
+bool FileSink::WantsMore()
+{
+	// Files never fill up, so we take everything the source can decode.
+	return this->state == Sink::State::PLAYING;
+}
+
+std::optional<Samples> FileSink::Buffered()
+{
+	return 0;
+}
+
+std::uint64_t FileSink::BytesWritten() const
+{
+	return this->written;
+}
+
+} // namespace Playd::Audio
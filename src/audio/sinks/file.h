@@ -0,0 +1,135 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the FileSink class.
+ * @see audio/sinks/file.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SINKS_FILE_H
+#define PLAYD_AUDIO_SINKS_FILE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * An output stream for audio, written to a file or pipe.
+ *
+ * There's no device, and so no clock: everything transferred while playing
+ * is written out there and then, and the sink never fills up.  Driving one of
+ * these with BasicAudio::Update() thus renders a file as fast as it decodes,
+ * through the same decoding (and resampling) as it would be played with.
+ *
+ * Samples are written as they come, in the machine's byte order; WAV files
+ * are only written on little-endian machines, as that's what WAV expects.
+ */
+class FileSink : public Sink
+{
+public:
+	/// What the samples are wrapped in.
+	enum class Container : std::uint8_t {
+		WAV, ///< A canonical 44-byte WAV header, then the samples.
+		PCM  ///< Just the samples.
+	};
+
+	/// The path that means standard output.
+	static constexpr std::string_view STDOUT_PATH{"-"};
+
+	/// The size of the WAV header, in bytes.
+	static constexpr std::size_t WAV_HEADER_BYTES = 44;
+
+	/**
+	 * Constructs a FileSink, opening (and truncating) its file.
+	 * @param source The source from which this sink will receive audio.
+	 * @param path The file to write, or STDOUT_PATH for standard output.
+	 * @param container What to wrap the samples in.
+	 * @exception FileError if the file can't be opened, or the source's
+	 *   format can't go in @a container.
+	 */
+	FileSink(const Source &source, const std::string &path, Container container);
+
+	/// Destructs a FileSink, finishing off and closing its file.
+	~FileSink() override;
+
+	/// Deleted copy constructor.
+	FileSink(const FileSink &) = delete;
+
+	/// Deleted copy-assignment.
+	FileSink &operator=(const FileSink &) = delete;
+
+	void Start() override;
+
+	void Stop() override;
+
+	Sink::State CurrentState() override;
+
+	Samples Position() override;
+
+	void SetPosition(Samples samples) override;
+
+	void SourceOut() override;
+
+	/// @exception FileError if the samples can't be written.
+	size_t Transfer(gsl::span<const std::byte> src) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	/**
+	 * The number of sample bytes written so far.
+	 * @return The size of the file, less any header.
+	 */
+	[[nodiscard]] std::uint64_t BytesWritten() const;
+
+	/**
+	 * Writes a WAV header.
+	 * Sizes too large for WAV are written as the largest WAV can hold,
+	 * which is also what streamed WAVs of unknown size use.
+	 * @param out Where to write the header.
+	 * @param format The sample format.
+	 * @param channels The number of channels.
+	 * @param rate The sample rate, in Hz.
+	 * @param data_bytes The number of sample bytes after the header.
+	 * @exception FileError if @a format can't go in a WAV file.
+	 */
+	static void PackWavHeader(gsl::span<std::byte, WAV_HEADER_BYTES> out, SampleFormat format,
+	                          std::uint8_t channels, std::uint32_t rate, std::uint64_t data_bytes);
+
+private:
+	/// Writes the WAV header, if any, sized for what's been written so far.
+	void WriteHeader();
+
+	std::FILE *file; ///< The file, or stdout.
+	bool seekable;   ///< Whether the header can be rewritten at the end.
+
+	Container container;          ///< What the samples are wrapped in.
+	SampleFormat format;          ///< The format of the samples.
+	std::uint8_t channels;        ///< The number of channels.
+	std::size_t bytes_per_sample; ///< Bytes in one sample frame.
+	std::uint32_t sample_rate;    ///< The sample rate, in Hz.
+
+	std::uint64_t written; ///< Sample bytes written so far.
+
+	/// The position, in sample frames.
+	std::atomic<Samples> position_sample_count;
+
+	std::atomic<Sink::State> state; ///< Whether we're playing.
+	std::atomic<bool> source_out;   ///< Whether the source is out.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SINKS_FILE_H
@@ -0,0 +1,425 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the RtpSink class.
+ * @see audio/sinks/rtp.h
+ */
+
+#include "rtp.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../../errors.h"
+#include "../buffer_policy.h"
+#include "../convert.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/// The DiffServ code point AES67 recommends for media (AF41), as a TOS byte.
+static constexpr int MEDIA_TOS = 34 << 2;
+
+/// How far behind the playback thread can get before it gives up catching
+/// up, and skips ahead instead.
+static constexpr std::chrono::milliseconds MAX_LAG{100};
+
+RtpSink::RtpSink(const Audio::Source &source, int device_id, Config config,
+                 std::shared_ptr<BufferPolicy> buffer_policy)
+    : fd{-1},
+      source_format{source.OutputSampleFormat()},
+      channels{source.ChannelCount()},
+      bytes_per_sample{source.BytesPerSample()},
+      sample_rate{source.SampleRate()},
+      packet_samples{std::max<Samples>((source.SampleRate() * config.packet_time.count()) / 1000000, 1)},
+      packet_period{config.packet_time},
+      payload_type{config.payload_type},
+      ssrc{std::random_device{}()},
+      seq{static_cast<std::uint16_t>(std::random_device{}())},
+      timestamp{0},
+      ring_buf{buffer_policy != nullptr ? buffer_policy->Bytes(source.SampleRate(), source.BytesPerSample())
+                                        : BufferPolicy::BytesFor(BufferPolicy::DEFAULT_SIZE, source.SampleRate(),
+                                                                 source.BytesPerSample())},
+      // As with SDLSink, waking at half full leaves the decoder plenty of
+      // slack, and stopping short of full leaves room to drain into.
+      low_watermark{ring_buf.Capacity() / 2},
+      high_watermark{ring_buf.Capacity() - (ring_buf.Capacity() / 8)},
+      raw(SEND_BATCH * packet_samples * bytes_per_sample),
+      wide(SEND_BATCH * packet_samples * channels),
+      payloads(SEND_BATCH * packet_samples * channels * L24_BYTES),
+      headers{},
+      iovs{},
+      msgs{},
+      position_sample_count{0},
+      state{Sink::State::STOPPED},
+      source_out{false},
+      refill_pending{false},
+      quitting{false},
+      warned_send{false}
+{
+	if (!CanConvert(this->source_format, SampleFormat::SINT32)) throw FileError("unsupported sample format");
+	if (!IsOutputDevice(device_id)) throw ConfigError("invalid RTP stream: " + std::to_string(device_id));
+	if (UINT16_MAX < config.port + (2 * device_id)) throw ConfigError("RTP stream's port is out of range");
+
+	this->Open(config.host, static_cast<std::uint16_t>(config.port + (2 * device_id)), config.ttl);
+
+	// Each packet gathers its header and its slice of the payloads.
+	const auto payload_bytes = this->packet_samples * this->channels * L24_BYTES;
+	for (std::size_t k = 0; k < SEND_BATCH; k++) {
+		this->iovs[2 * k] = iovec{this->headers[k].data(), HEADER_BYTES};
+		this->iovs[(2 * k) + 1] = iovec{this->payloads.data() + (k * payload_bytes), payload_bytes};
+		this->msgs[k].msg_hdr.msg_iov = &this->iovs[2 * k];
+		this->msgs[k].msg_hdr.msg_iovlen = 2;
+	}
+
+	this->thread = std::thread{&RtpSink::Run, this};
+}
+
+RtpSink::~RtpSink()
+{
+	{
+		std::lock_guard guard{this->lock};
+		this->quitting = true;
+	}
+	this->wakeup.notify_all();
+	this->thread.join();
+
+	close(this->fd);
+}
+
+void RtpSink::Open(const std::string &host, std::uint16_t port, int ttl)
+{
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICSERV;
+
+	addrinfo *res = nullptr;
+	const auto port_str = std::to_string(port);
+	if (const auto err = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &res); err != 0) {
+		throw ConfigError("can't resolve RTP destination " + host + ": " + gai_strerror(err));
+	}
+	const auto free_res = gsl::finally([res] { freeaddrinfo(res); });
+
+	this->fd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (this->fd < 0) throw ConfigError(std::string{"can't open RTP socket: "} + std::strerror(errno));
+
+	// None of these are fatal: the stream still works without them, just
+	// not as far afield, or without priority on the network.
+	if (res->ai_family == AF_INET6) {
+		setsockopt(this->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl));
+		setsockopt(this->fd, IPPROTO_IPV6, IPV6_TCLASS, &MEDIA_TOS, sizeof(MEDIA_TOS));
+	} else {
+		setsockopt(this->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+		setsockopt(this->fd, IPPROTO_IP, IP_TOS, &MEDIA_TOS, sizeof(MEDIA_TOS));
+	}
+
+	// Connecting means the packets don't each need the address.
+	if (connect(this->fd, res->ai_addr, res->ai_addrlen) != 0) {
+		const auto err = errno;
+		close(this->fd);
+		throw ConfigError("can't send RTP to " + host + ":" + port_str + ": " + std::strerror(err));
+	}
+}
+
+void RtpSink::Start()
+{
+	{
+		std::lock_guard guard{this->lock};
+		if (this->state == Sink::State::PLAYING) return;
+		this->state = Sink::State::PLAYING;
+
+		// Timestamps carry on from the media clock, not from wherever we
+		// stopped, so receivers play the first packet on time.
+		this->next_send = std::chrono::steady_clock::now();
+		this->timestamp = MediaClock(this->sample_rate);
+	}
+	this->wakeup.notify_all();
+}
+
+void RtpSink::Stop()
+{
+	{
+		std::lock_guard guard{this->lock};
+		this->state = Sink::State::STOPPED;
+	}
+	this->wakeup.notify_all();
+}
+
+Sink::State RtpSink::CurrentState()
+{
+	return this->state;
+}
+
+Samples RtpSink::Position()
+{
+	return this->position_sample_count;
+}
+
+void RtpSink::SetPosition(Samples samples)
+{
+	{
+		std::lock_guard guard{this->lock};
+		this->position_sample_count = samples;
+
+		// With the thread kept out, nothing can send old samples as if
+		// they were from the new position.
+		this->ring_buf.Flush();
+	}
+
+	// We might have been at the end of the file previously.
+	// If so, we might not be now, so clear the out flags.
+	this->source_out.store(false, std::memory_order_release);
+	if (this->state == Sink::State::AT_END) this->state = Sink::State::STOPPED;
+	this->refill_pending.store(false, std::memory_order_release);
+}
+
+void RtpSink::SourceOut()
+{
+	this->source_out.store(true, std::memory_order_release);
+}
+
+size_t RtpSink::Transfer(gsl::span<const std::byte> src)
+{
+	if (src.empty()) return 0;
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	auto count = std::min(src.size(), this->ring_buf.WriteCapacity());
+	count -= count % this->bytes_per_sample;
+	if (count == 0) return 0;
+
+	const auto written = this->ring_buf.Write(src.first(count));
+	Ensures(written == count);
+
+	if (this->high_watermark <= this->ring_buf.ReadCapacity()) {
+		this->refill_pending.store(false, std::memory_order_release);
+	}
+	return written;
+}
+
+bool RtpSink::WantsMore()
+{
+	if (this->ring_buf.WriteCapacity() < this->bytes_per_sample) return false;
+	return this->ring_buf.ReadCapacity() < this->high_watermark;
+}
+
+std::optional<Samples> RtpSink::Buffered()
+{
+	return this->ring_buf.ReadCapacity() / this->bytes_per_sample;
+}
+
+std::size_t RtpSink::BufferBytes() const
+{
+	return this->ring_buf.Capacity() + this->raw.capacity() + this->wide.capacity() * sizeof(std::int32_t) +
+	       this->payloads.capacity();
+}
+
+ConversionList RtpSink::Conversions() const
+{
+	ConversionList steps;
+	if (this->source_format != SampleFormat::SINT32) {
+		steps.push_back(DescribeConversion(this->source_format, SampleFormat::SINT32));
+	}
+	steps.emplace_back("s32>L24");
+	return steps;
+}
+
+void RtpSink::SetWakeHandler(WakeFn new_wake)
+{
+	std::lock_guard guard{this->lock};
+	this->wake = std::move(new_wake);
+}
+
+/* static */ std::vector<std::pair<int, std::string>> RtpSink::GetDevicesInfo()
+{
+	return {{0, "RTP stream to --rtp-dest= (stream N, up to " + std::to_string(MAX_STREAMS - 1) +
+	                    ", goes to its port + 2N)"}};
+}
+
+/* static */ bool RtpSink::IsOutputDevice(int id)
+{
+	return 0 <= id && id < MAX_STREAMS;
+}
+
+/* static */ std::pair<std::string, std::uint16_t> RtpSink::ParseDestination(std::string_view value)
+{
+	const auto invalid = [value] { return ConfigError("not a valid RTP destination: " + std::string{value}); };
+
+	const auto colon = value.rfind(':');
+	if (colon == std::string_view::npos || colon == 0) throw invalid();
+
+	auto host = value.substr(0, colon);
+	if (host.front() == '[') {
+		if (host.size() < 3 || host.back() != ']') throw invalid();
+		host = host.substr(1, host.size() - 2);
+	} else if (host.find(':') != std::string_view::npos) {
+		// Bare IPv6 addresses are ambiguous about where the port starts.
+		throw invalid();
+	}
+
+	const auto port_str = value.substr(colon + 1);
+	std::uint16_t port = 0;
+	const auto end = port_str.data() + port_str.size();
+	const auto [p, ec] = std::from_chars(port_str.data(), end, port);
+	if (port_str.empty() || ec != std::errc{} || p != end || port == 0) throw invalid();
+
+	return std::make_pair(std::string{host}, port);
+}
+
+/* static */ std::uint32_t RtpSink::MediaClock(std::uint32_t rate)
+{
+	// A PTP daemon keeps TAI on the PTP timescale; without one (or without
+	// TAI), the realtime clock is the closest we have.
+	timespec ts{};
+#ifdef CLOCK_TAI
+	clock_gettime(CLOCK_TAI, &ts);
+#else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+	const auto samples = (static_cast<std::uint64_t>(ts.tv_sec) * rate) +
+	                     ((static_cast<std::uint64_t>(ts.tv_nsec) * rate) / 1000000000);
+	return static_cast<std::uint32_t>(samples);
+}
+
+/* static */ void RtpSink::PackHeader(gsl::span<std::byte, HEADER_BYTES> out, std::uint8_t payload_type,
+                                      std::uint16_t seq, std::uint32_t timestamp, std::uint32_t ssrc)
+{
+	// Version 2, no padding, extensions, contributors or marker.
+	out[0] = std::byte{0x80};
+	out[1] = static_cast<std::byte>(payload_type & 0x7F);
+	out[2] = static_cast<std::byte>(seq >> 8);
+	out[3] = static_cast<std::byte>(seq);
+	for (std::size_t i = 0; i < 4; i++) {
+		out[4 + i] = static_cast<std::byte>(timestamp >> (24 - (8 * i)));
+		out[8 + i] = static_cast<std::byte>(ssrc >> (24 - (8 * i)));
+	}
+}
+
+/* static */ void RtpSink::PackL24(gsl::span<const std::int32_t> in, gsl::span<std::byte> out)
+{
+	Expects(out.size() == in.size() * L24_BYTES);
+
+	for (std::size_t i = 0; i < in.size(); i++) {
+		const auto sample = static_cast<std::uint32_t>(in[i]);
+		out[(i * L24_BYTES) + 0] = static_cast<std::byte>(sample >> 24);
+		out[(i * L24_BYTES) + 1] = static_cast<std::byte>(sample >> 16);
+		out[(i * L24_BYTES) + 2] = static_cast<std::byte>(sample >> 8);
+	}
+}
+
+void RtpSink::Run()
+{
+	std::unique_lock guard{this->lock};
+	while (!this->quitting) {
+		if (this->state != Sink::State::PLAYING) {
+			this->wakeup.wait(guard);
+			continue;
+		}
+
+		// Waking for every packet would mean a thousand wake-ups a second
+		// at 1ms; instead, we wake for a batch at a time.
+		const auto due = this->next_send + (this->packet_period * (SEND_BATCH - 1));
+		if (this->wakeup.wait_until(guard, due, [this] {
+			    return this->quitting || this->state != Sink::State::PLAYING;
+		    })) {
+			continue;
+		}
+
+		// If we've fallen a long way behind (say, the machine was busy),
+		// skip the packets we missed rather than bursting them all out.
+		const auto now = std::chrono::steady_clock::now();
+		if (this->next_send + MAX_LAG < now) {
+			const auto missed = (now - this->next_send) / this->packet_period;
+			this->next_send += missed * this->packet_period;
+			this->timestamp += static_cast<std::uint32_t>(missed * this->packet_samples);
+		}
+
+		const auto owed = static_cast<std::size_t>(((now - this->next_send) / this->packet_period) + 1);
+		const auto packets = std::min(owed, SEND_BATCH);
+		this->SendBatch(packets);
+		this->next_send += packets * this->packet_period;
+	}
+}
+
+void RtpSink::SendBatch(std::size_t packets)
+{
+	Expects(0 < packets && packets <= SEND_BATCH);
+
+	// Anything the ring buffer can't fill is sent as silence, as the
+	// stream has to keep going whatever.
+	const auto samples = packets * this->packet_samples;
+	const auto src = gsl::span{this->raw}.first(samples * this->bytes_per_sample);
+	const auto read = this->ring_buf.ReadSome(src);
+	const auto read_samples = read / this->bytes_per_sample;
+	std::fill(src.begin() + (read_samples * this->bytes_per_sample), src.end(), std::byte{0});
+
+	const auto wide_span = gsl::span{this->wide}.first(samples * this->channels);
+	ConvertSamples(this->source_format, SampleFormat::SINT32, src,
+	               gsl::span<std::byte>(reinterpret_cast<std::byte *>(wide_span.data()),
+	                                    wide_span.size() * sizeof(std::int32_t)));
+	PackL24(wide_span, gsl::span{this->payloads}.first(wide_span.size() * L24_BYTES));
+
+	for (std::size_t k = 0; k < packets; k++) {
+		PackHeader(gsl::span<std::byte, HEADER_BYTES>{this->headers[k]}, this->payload_type, this->seq++,
+		           this->timestamp, this->ssrc);
+		this->timestamp += static_cast<std::uint32_t>(this->packet_samples);
+	}
+
+	// A full socket buffer drops the batch, rather than holding us up.
+	const auto sent = sendmmsg(this->fd, this->msgs.data(), static_cast<unsigned int>(packets), MSG_DONTWAIT);
+	if (sent < 0 && !this->warned_send) {
+		Debug() << "rtp: can't send:" << std::strerror(errno) << std::endl;
+		this->warned_send = true;
+	}
+
+	const auto old_pos = this->position_sample_count.fetch_add(read_samples);
+	const auto new_pos = old_pos + read_samples;
+
+	// Have we run out of things to feed?  If the source is out too, so
+	// are we.
+	if (read_samples == 0 && this->source_out.load(std::memory_order_acquire)) {
+		this->state = Sink::State::AT_END;
+		this->Wake();
+		return;
+	}
+
+	// As in SDLSink, wake the decoder when low (once per refill), and
+	// once a second to keep position announcements going.
+	const auto low = this->ring_buf.ReadCapacity() < this->low_watermark;
+	const auto refill = low && !this->source_out.load(std::memory_order_acquire) &&
+	                    !this->refill_pending.exchange(true, std::memory_order_acq_rel);
+	const auto milestone = (old_pos / this->sample_rate) != (new_pos / this->sample_rate);
+	if (refill || milestone) this->Wake();
+}
+
+void RtpSink::Wake()
+{
+	if (this->wake) this->wake();
+}
+
+} // namespace Playd::Audio
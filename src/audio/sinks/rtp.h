@@ -0,0 +1,251 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the RtpSink class.
+ * @see audio/sinks/rtp.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SINKS_RTP_H
+#define PLAYD_AUDIO_SINKS_RTP_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "../buffer_policy.h"
+#include "../ringbuffer.h"
+#include "../rt_memory.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * An output stream for audio, sent over the network as AES67 RTP.
+ *
+ * Audio goes out as 24-bit linear PCM (L24), one packet every packet time,
+ * with RTP timestamps taken from the PTP media clock: the system's TAI clock,
+ * which a PTP daemon (such as ptp4l and phc2sys) keeps in step with the
+ * network's grandmaster.  Receivers locked to the same grandmaster can thus
+ * play each sample at a fixed offset from when it was sent.
+ *
+ * A playback thread paces the packets, sending several at a time with one
+ * sendmmsg(): each packet's header and payload are gathered straight from
+ * where they were built, without being copied into a packet buffer first.
+ *
+ * AES67 streams are at 48 kHz, so sources should be resampled to that rate
+ * before they get here (which playd does by default).
+ */
+class RtpSink : public Sink
+{
+public:
+	/// Where and how to send the stream.
+	struct Config {
+		std::string host;   ///< The destination address, usually multicast.
+		std::uint16_t port; ///< The destination port of stream 0.
+
+		/// The audio in each packet; AES67 requires 1ms support.
+		std::chrono::microseconds packet_time{1000};
+
+		/// The RTP payload type, which receivers learn from SDP.
+		std::uint8_t payload_type{96};
+
+		/// How many routers multicast packets may cross.
+		int ttl{32};
+	};
+
+	/// The number of streams (and so device IDs) a destination can have.
+	static constexpr int MAX_STREAMS = 64;
+
+	/// The most packets sent in one go.
+	static constexpr std::size_t SEND_BATCH = 4;
+
+	/// The size of an RTP header with no extensions, in bytes.
+	static constexpr std::size_t HEADER_BYTES = 12;
+
+	/// The size of one L24 sample, in bytes.
+	static constexpr std::size_t L24_BYTES = 3;
+
+	/**
+	 * Constructs an RtpSink, opening its socket.
+	 * @param source The source from which this sink will receive audio.
+	 * @param device_id The stream number, which is added (doubled, as RTP
+	 *   ports are even) to the port in @a config.
+	 * @param config Where and how to send the stream.
+	 * @param buffer_policy The policy sizing our ring buffer, if any.
+	 * @exception ConfigError if the destination is no good.
+	 * @exception FileError if the source's format can't be sent.
+	 */
+	RtpSink(const Source &source, int device_id, Config config,
+	        std::shared_ptr<BufferPolicy> buffer_policy = nullptr);
+
+	/// Destructs an RtpSink, closing its socket.
+	~RtpSink() override;
+
+	/// Deleted copy constructor.
+	RtpSink(const RtpSink &) = delete;
+
+	/// Deleted copy-assignment.
+	RtpSink &operator=(const RtpSink &) = delete;
+
+	void Start() override;
+
+	void Stop() override;
+
+	Sink::State CurrentState() override;
+
+	Samples Position() override;
+
+	void SetPosition(Samples samples) override;
+
+	void SourceOut() override;
+
+	size_t Transfer(gsl::span<const std::byte> src) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	[[nodiscard]] std::size_t BufferBytes() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+	void SetWakeHandler(WakeFn wake) override;
+
+	/**
+	 * Lists the streams a destination can have, as devices.
+	 * @return List of streams, with their IDs.
+	 */
+	static std::vector<std::pair<int, std::string>> GetDevicesInfo();
+
+	/**
+	 * Is a device ID a stream number?
+	 * @param id Device ID.
+	 * @return If the ID is a stream number.
+	 */
+	static bool IsOutputDevice(int id);
+
+	/**
+	 * Parses a destination of the form HOST:PORT, or [HOST]:PORT for IPv6.
+	 * @param value The destination.
+	 * @return The host and port.
+	 * @exception ConfigError if @a value isn't a valid destination.
+	 */
+	static std::pair<std::string, std::uint16_t> ParseDestination(std::string_view value);
+
+	/**
+	 * The PTP media clock, as an RTP timestamp.
+	 * @param rate The media clock rate, in Hz.
+	 * @return The number of samples since the PTP epoch, modulo 2^32.
+	 */
+	static std::uint32_t MediaClock(std::uint32_t rate);
+
+	/**
+	 * Writes an RTP header.
+	 * @param out Where to write the header.
+	 * @param payload_type The RTP payload type.
+	 * @param seq The sequence number.
+	 * @param timestamp The timestamp of the first sample.
+	 * @param ssrc The synchronisation source.
+	 */
+	static void PackHeader(gsl::span<std::byte, HEADER_BYTES> out, std::uint8_t payload_type, std::uint16_t seq,
+	                       std::uint32_t timestamp, std::uint32_t ssrc);
+
+	/**
+	 * Packs 32-bit samples as big-endian L24, keeping their top 24 bits.
+	 * * Precondition: @a out is exactly L24_BYTES per sample in @a in.
+	 * @param in The samples.
+	 * @param out Where to write the packed samples.
+	 */
+	static void PackL24(gsl::span<const std::int32_t> in, gsl::span<std::byte> out);
+
+private:
+	/**
+	 * Opens and connects the socket.
+	 * @param host The destination address.
+	 * @param port The destination port.
+	 * @param ttl The multicast TTL.
+	 * @exception ConfigError if the destination is no good.
+	 */
+	void Open(const std::string &host, std::uint16_t port, int ttl);
+
+	/// The body of the playback thread.
+	void Run();
+
+	/**
+	 * Builds and sends some packets; lock must be held.
+	 * @param packets How many packets to send, up to SEND_BATCH.
+	 */
+	void SendBatch(std::size_t packets);
+
+	/// Calls the wake handler, if there is one; lock must be held.
+	void Wake();
+
+	int fd; ///< The connected UDP socket, or -1.
+
+	SampleFormat source_format;   ///< The format of samples we're given.
+	std::uint8_t channels;        ///< The number of channels.
+	std::size_t bytes_per_sample; ///< Bytes in one sample frame.
+	std::uint32_t sample_rate;    ///< The sample rate, in Hz.
+
+	Samples packet_samples;                 ///< Sample frames per packet.
+	std::chrono::nanoseconds packet_period; ///< The time between packets.
+	std::uint8_t payload_type;              ///< The RTP payload type.
+	std::uint32_t ssrc;                     ///< Our synchronisation source.
+	std::uint16_t seq;                      ///< The next sequence number.
+	std::uint32_t timestamp;                ///< The next RTP timestamp.
+
+	/// When the next packet is due; guarded by lock.
+	std::chrono::steady_clock::time_point next_send;
+
+	RingBuffer ring_buf;        ///< Samples waiting to be sent.
+	std::size_t low_watermark;  ///< Below this, we wake the decoder.
+	std::size_t high_watermark; ///< Above this, we stop asking for more.
+
+	RtVector<std::byte> raw;         ///< A batch, in the source's format.
+	RtVector<std::int32_t> wide;     ///< The same batch, as SINT32.
+	RtVector<std::byte> payloads;    ///< The same batch, as L24.
+
+	/// The RTP headers of a batch's packets.
+	std::array<std::array<std::byte, HEADER_BYTES>, SEND_BATCH> headers;
+	std::array<iovec, SEND_BATCH * 2> iovs; ///< Each packet's header and payload.
+	std::array<mmsghdr, SEND_BATCH> msgs;   ///< Each packet, for sendmmsg().
+
+	/// Sample frames sent so far.
+	std::atomic<Samples> position_sample_count;
+
+	std::atomic<Sink::State> state;   ///< The sink's state.
+	std::atomic<bool> source_out;     ///< Whether the source is out.
+	std::atomic<bool> refill_pending; ///< Whether a refill wake is out.
+
+	/// Guards everything the thread touches, other than the producer side
+	/// of ring_buf.
+	std::mutex lock;
+	std::condition_variable wakeup; ///< Wakes the thread when needed.
+	bool quitting;                  ///< Whether the thread should stop.
+	bool warned_send;               ///< Whether we've logged a send error.
+	WakeFn wake;                    ///< Called when we need attention.
+
+	std::thread thread; ///< The playback thread.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SINKS_RTP_H
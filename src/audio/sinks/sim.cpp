@@ -0,0 +1,177 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the SimSink class.
+ * @see audio/sinks/sim.h
+ */
+
+#include "sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include "../../clock.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+SimSink::SimSink(const Source &source, const Clock &clock, Samples capacity, double speed)
+    : clock{clock},
+      bytes_per_sample{source.BytesPerSample()},
+      samples_per_tick{speed * source.SampleRate() * Clock::Duration::period::num / Clock::Duration::period::den},
+      capacity{capacity},
+      state{Sink::State::STOPPED},
+      source_out{false},
+      position{0},
+      buffered{0},
+      owed{0.0},
+      dry{false},
+      caught_up{clock.Now()},
+      tally{0, 0, 0, 0, capacity}
+{
+	Expects(0 < capacity);
+	Expects(0.0 < speed);
+}
+
+void SimSink::Start()
+{
+	this->CatchUp();
+	if (this->state != Sink::State::STOPPED) return;
+	this->state = Sink::State::PLAYING;
+	this->start_at.reset();
+	this->stop_at.reset();
+}
+
+void SimSink::Stop()
+{
+	this->CatchUp();
+	this->state = Sink::State::STOPPED;
+	this->start_at.reset();
+	this->stop_at.reset();
+}
+
+void SimSink::StartAt(Clock::TimePoint when)
+{
+	// Until then, as with SDLSink, the device plays silence.
+	this->Start();
+	if (this->state == Sink::State::PLAYING && this->caught_up < when) this->start_at = when;
+}
+
+void SimSink::StopAt(Clock::TimePoint when)
+{
+	this->CatchUp();
+	if (this->state == Sink::State::PLAYING) this->stop_at = when;
+}
+
+Sink::State SimSink::CurrentState()
+{
+	this->CatchUp();
+	return this->state;
+}
+
+Samples SimSink::Position()
+{
+	this->CatchUp();
+	return this->position;
+}
+
+void SimSink::SetPosition(Samples samples)
+{
+	this->CatchUp();
+	this->position = samples;
+	this->buffered = 0;
+	this->owed = 0.0;
+	this->dry = false;
+	this->source_out = false;
+	if (this->state == Sink::State::AT_END) this->state = Sink::State::STOPPED;
+}
+
+void SimSink::SourceOut()
+{
+	this->source_out = true;
+}
+
+size_t SimSink::Transfer(gsl::span<const std::byte> src)
+{
+	Expects(src.size() % this->bytes_per_sample == 0);
+
+	this->CatchUp();
+	const auto count = std::min<Samples>(src.size() / this->bytes_per_sample, this->capacity - this->buffered);
+	if (count == 0) return 0;
+
+	this->buffered += count;
+	this->dry = false;
+	this->tally.refills++;
+	return count * this->bytes_per_sample;
+}
+
+bool SimSink::WantsMore()
+{
+	return this->buffered < this->capacity;
+}
+
+std::optional<Samples> SimSink::Buffered()
+{
+	return this->buffered;
+}
+
+SimSink::Tally SimSink::Fed()
+{
+	this->CatchUp();
+	return this->tally;
+}
+
+void SimSink::CatchUp()
+{
+	const auto now = this->clock.Now();
+	if (now <= this->caught_up) return;
+
+	auto from = this->caught_up;
+	this->caught_up = now;
+	if (this->state != Sink::State::PLAYING) return;
+
+	// Scheduled starts and stops land on the exact tick they were for.
+	if (this->start_at) {
+		if (now <= *this->start_at) return;
+		from = std::max(from, *this->start_at);
+		this->start_at.reset();
+	}
+	const auto stops = this->stop_at && *this->stop_at <= now;
+	this->Play((stops ? std::max(from, *this->stop_at) : now) - from);
+	if (stops && this->state == Sink::State::PLAYING) {
+		this->state = Sink::State::STOPPED;
+		this->stop_at.reset();
+	}
+}
+
+void SimSink::Play(Clock::Duration elapsed)
+{
+	const auto due = this->owed + this->samples_per_tick * static_cast<double>(elapsed.count());
+	const auto wanted = static_cast<Samples>(std::floor(due));
+	this->owed = due - static_cast<double>(wanted);
+
+	const auto played = std::min(wanted, this->buffered);
+	this->buffered -= played;
+	this->position += played;
+	this->tally.played += played;
+
+	if (played < wanted) {
+		if (this->source_out) {
+			this->state = Sink::State::AT_END;
+			return;
+		}
+		if (!std::exchange(this->dry, true)) this->tally.underruns++;
+		this->tally.starved += wanted - played;
+	}
+	if (0 < played && !this->source_out) this->tally.lowest = std::min(this->tally.lowest, this->buffered);
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,118 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the SimSink class.
+ * @see audio/sinks/sim.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SINKS_SIM_H
+#define PLAYD_AUDIO_SINKS_SIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "../../clock.h"
+#include "../sample_format.h"
+#include "../sink.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * An output stream for audio, played by a simulated device.
+ *
+ * The device drains the sink's buffer at the source's sample rate (or some
+ * multiple of it), as told by a Clock, which is usually a SimClock: nothing
+ * is heard, and nothing happens between calls, but every call first catches
+ * up with however much the device would have played since the last.  Moving
+ * the clock on and updating in turn thus plays as a real device would, only
+ * as fast as the updates go, and the same way every time.
+ *
+ * The sink keeps a Tally of how it was fed, so that tests and benchmarks can
+ * measure the decode cadence and refill margins, and spot underruns.  It never
+ * calls its wake handler, as whoever moves the clock on updates anyway.
+ * SimSinks aren't thread-safe, so they can't be decoded into by workers.
+ */
+class SimSink : public Sink
+{
+public:
+	/// How a SimSink has been fed since it was made.
+	struct Tally {
+		std::uint64_t refills;   ///< Transfers that put samples in the buffer.
+		std::uint64_t underruns; ///< Times the buffer ran dry before the source ended.
+		Samples starved;         ///< Samples the device wanted but didn't get.
+		Samples played;          ///< Samples the device played.
+		Samples lowest;          ///< The fewest samples left after the device played any.
+	};
+
+	/**
+	 * Constructs a SimSink.
+	 * @param source The source from which this sink will receive audio.
+	 * @param clock The clock that the device plays by, which must outlive
+	 *   the sink.
+	 * @param capacity How many samples the buffer holds.
+	 * @param speed How many times faster than the sample rate the device
+	 *   plays.
+	 */
+	SimSink(const Source &source, const Clock &clock, Samples capacity, double speed = 1.0);
+
+	void Start() override;
+
+	void Stop() override;
+
+	void StartAt(Clock::TimePoint when) override;
+
+	void StopAt(Clock::TimePoint when) override;
+
+	Sink::State CurrentState() override;
+
+	Samples Position() override;
+
+	void SetPosition(Samples samples) override;
+
+	void SourceOut() override;
+
+	size_t Transfer(gsl::span<const std::byte> src) override;
+
+	bool WantsMore() override;
+
+	std::optional<Samples> Buffered() override;
+
+	/// @return How the sink has been fed so far.
+	[[nodiscard]] Tally Fed();
+
+private:
+	/// Plays whatever the device would have played since the last call.
+	void CatchUp();
+
+	/**
+	 * Plays some of the buffer, as the device would over some time.
+	 * @param elapsed How long the device plays for.
+	 */
+	void Play(Clock::Duration elapsed);
+
+	const Clock &clock;           ///< The clock that the device plays by.
+	std::size_t bytes_per_sample; ///< Bytes in one sample frame.
+	double samples_per_tick;      ///< How many samples the device plays each clock tick.
+	Samples capacity;             ///< How many samples the buffer holds.
+
+	Sink::State state;  ///< Whether we're playing.
+	bool source_out;    ///< Whether the source is out.
+	Samples position;   ///< The position, in samples.
+	Samples buffered;   ///< Samples in the buffer.
+	double owed;        ///< The part of a sample the device has yet to play.
+	bool dry;           ///< Whether the buffer has run dry since the last refill.
+
+	Clock::TimePoint caught_up;                ///< When the device last played.
+	std::optional<Clock::TimePoint> start_at;  ///< When a scheduled start is heard.
+	std::optional<Clock::TimePoint> stop_at;   ///< When a scheduled stop is heard.
+
+	Tally tally; ///< How the sink has been fed.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SINKS_SIM_H
@@ -9,6 +9,12 @@
 
 #include "source.h"
 
+#include <optional>
+#include <utility>
+
+#undef max
+#include <gsl/gsl>
+
 #include "sample_format.h"
 
 namespace Playd::Audio
@@ -17,12 +23,61 @@ Source::Source(std::string_view path) : path{path}
 {
 }
 
+void Source::UseCache(MetadataCache &)
+{
+}
+
+void Source::StartScans()
+{
+}
+
+void Source::WaitForScans()
+{
+}
+
+std::optional<CuePoints> Source::Cues() const
+{
+	return std::nullopt;
+}
+
+std::optional<StreamStats> Source::Streaming() const
+{
+	return std::nullopt;
+}
+
+std::size_t Source::ScratchBytes() const
+{
+	return 0;
+}
+
+std::uint64_t Source::SkippedFrames() const
+{
+	return 0;
+}
+
 size_t Source::BytesPerSample() const
 {
 	auto sf = static_cast<uint8_t>(this->OutputSampleFormat());
 	return sample_format_bps[sf] * this->ChannelCount();
 }
 
+Source::DecodeResult Source::Decode()
+{
+	DecodeVector frame(this->FrameBytes());
+	auto [decode_state, count] = this->Decode(frame);
+	frame.resize(count);
+
+	return std::make_pair(decode_state, std::move(frame));
+}
+
+size_t Source::FrameBytes() const
+{
+	const auto bps = this->BytesPerSample();
+	Expects(0 < bps && bps <= FRAME_BYTES);
+
+	return FRAME_BYTES - (FRAME_BYTES % bps);
+}
+
 std::string_view Source::Path() const
 {
 	return this->path;
@@ -42,4 +97,34 @@ std::chrono::microseconds Source::MicrosFromSamples(Samples samples) const
 	return std::chrono::microseconds{(samples * 1000000) / this->SampleRate()};
 }
 
+StreamFormat Source::Format() const
+{
+	return {this->OutputSampleFormat(), this->ChannelCount(), this->SampleRate(), this->BytesPerSample()};
+}
+
+bool Source::PreferFormat(SampleFormat format)
+{
+	return this->OutputSampleFormat() == format;
+}
+
+ConversionList Source::Conversions() const
+{
+	return {};
+}
+
+//
+// StreamFormat
+//
+
+Samples StreamFormat::SamplesFromMicros(std::chrono::microseconds micros) const
+{
+	// As Source::SamplesFromMicros, but with the rate to hand.
+	return (micros.count() * this->rate) / 1000000;
+}
+
+std::chrono::microseconds StreamFormat::MicrosFromSamples(Samples samples) const
+{
+	return std::chrono::microseconds{(samples * 1000000) / this->rate};
+}
+
 } // namespace Playd::Audio
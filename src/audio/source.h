@@ -11,15 +11,75 @@
 #define PLAYD_SOURCE_H
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#undef max
+#include <gsl/gsl>
+
 #include "../errors.h"
 #include "sample_format.h"
 
 namespace Playd::Audio
 {
+class MetadataCache;
+
+/// Where the audible part of a file starts and ends.
+struct CuePoints {
+	std::chrono::microseconds in;  ///< The first audible sample.
+	std::chrono::microseconds out; ///< Just after the last audible sample.
+
+	/// Cue points are equal if both of their points are.
+	bool operator==(const CuePoints &) const = default;
+};
+
+/**
+ * Type of lists of the conversions audio goes through on its way out, in
+ * order, each described briefly: for example, 's16>f32' or '44100>48000Hz'.
+ */
+using ConversionList = std::vector<std::string>;
+
+/// How well a source fetching its file over the network is keeping up.
+struct StreamStats {
+	std::uint64_t requests;       ///< Requests made for the file, counting seeks.
+	std::uint64_t underruns;      ///< Times the decoder found nothing fetched.
+	std::uint64_t stall_us;       ///< How long it spent waiting, in microseconds.
+	std::uint64_t buffered_bytes; ///< Bytes fetched but not yet decoded.
+};
+
+/**
+ * The shape of a source's audio, which is fixed for as long as it is open.
+ * Taking a copy of this once, at load, lets whoever plays the source work
+ * out times and sizes without asking the source (and, through it, its
+ * decoder) each time.
+ */
+struct StreamFormat {
+	SampleFormat format;          ///< The sample format.
+	std::uint8_t channels;        ///< The number of interleaved channels.
+	std::uint32_t rate;           ///< The sample rate, in Hz.
+	std::size_t bytes_per_sample; ///< The bytes in one sample, over all channels.
+
+	/**
+	 * Converts a position in microseconds to an elapsed sample count.
+	 * This rounds just as Source::SamplesFromMicros() does.
+	 * @param micros The song position, in microseconds.
+	 * @return The corresponding number of elapsed samples.
+	 */
+	[[nodiscard]] Samples SamplesFromMicros(std::chrono::microseconds micros) const;
+
+	/**
+	 * Converts an elapsed sample count to a position in microseconds.
+	 * This rounds just as Source::MicrosFromSamples() does.
+	 * @param samples The number of elapsed samples.
+	 * @return The corresponding song position, in microseconds.
+	 */
+	[[nodiscard]] std::chrono::microseconds MicrosFromSamples(Samples samples) const;
+};
+
 /**
  * An object responsible for decoding an audio file.
  *
@@ -50,6 +110,14 @@ public:
 	/// Type of the result of Decode().
 	using DecodeResult = std::pair<DecodeState, DecodeVector>;
 
+	/// Type of the result of Decode(gsl::span<std::byte>).
+	using DecodeSpanResult = std::pair<DecodeState, size_t>;
+
+	/// The size, in bytes, of a frame decoded by Decode().
+	/// This corresponds to the minimum buffer size used by ffmpeg, so it's
+	/// probably sensible.
+	static constexpr size_t FRAME_BYTES = 16384;
+
 	/**
 	 * Constructs an Audio_source.
 	 * @param path The path to the file from which this AudioSource is
@@ -65,12 +133,22 @@ public:
 	//
 
 	/**
-	 * Performs a round of decoding.
+	 * Performs a round of decoding into a caller-provided buffer.
+	 *
+	 * This lets the caller decode straight into wherever the samples need
+	 * to end up (for example, a sink's ring buffer), without the decoder
+	 * allocating or copying anything.
+	 *
+	 * * Precondition: @a out is a whole number of samples long.
+	 * * Postcondition: The byte count returned is a whole number of
+	 *     samples, and no larger than @a out.
+	 *
+	 * @param out The span into which decoded samples are written.
 	 * @return A pair of the decoder's state upon finishing the decoding
-	 *   round and the vector of bytes decoded.  The vector may be empty,
-	 *   if the decoding round did not finish off a frame.
+	 *   round and the number of bytes decoded into @a out.  The count may
+	 *   be zero, if the decoding round did not finish off a frame.
 	 */
-	virtual DecodeResult Decode() = 0;
+	virtual DecodeSpanResult Decode(gsl::span<std::byte> out) = 0;
 
 	/**
 	 * Returns the channel count.
@@ -104,6 +182,22 @@ public:
 	// Methods provided 'for free'
 	//
 
+	/**
+	 * Performs a round of decoding into a freshly allocated vector.
+	 * This is a convenience wrapper over Decode(gsl::span<std::byte>), and
+	 * allocates on every call; prefer the span form on hot paths.
+	 * @return A pair of the decoder's state upon finishing the decoding
+	 *   round and the vector of bytes decoded.  The vector may be empty,
+	 *   if the decoding round did not finish off a frame.
+	 */
+	DecodeResult Decode();
+
+	/**
+	 * Returns the largest whole number of samples that fits in a frame.
+	 * @return The number of bytes Decode() asks for in each round.
+	 */
+	size_t FrameBytes() const;
+
 	/**
 	 * Returns the number of bytes for each sample this decoder outputs.
 	 * As the decoder returns packed samples, this includes the channel
@@ -127,6 +221,70 @@ public:
 
 	virtual std::uint64_t Length() const = 0;
 
+	/**
+	 * Lets this source use a cache of what it finds out about its file.
+	 * Sources that find out nothing worth caching ignore this, which is
+	 * what the default implementation does.
+	 * @param cache The cache, which must outlive this source.
+	 */
+	virtual void UseCache(MetadataCache &cache);
+
+	/**
+	 * Starts finding out whatever this source finds out about its file in
+	 * the background (a seek index, say).
+	 * This comes after UseCache(), which may make the scans unnecessary;
+	 * sources only opened to be looked at never start them.  The default
+	 * implementation, for sources without any, does nothing.
+	 */
+	virtual void StartScans();
+
+	/**
+	 * Waits for whatever this source is finding out about its file in the
+	 * background (a seek index, say) to be found out, so that it goes into
+	 * the cache.
+	 * Sources that find out nothing in the background (which is what the
+	 * default implementation assumes) needn't wait.
+	 */
+	virtual void WaitForScans();
+
+	/**
+	 * Where this source's audio was cut from its file, if it was.
+	 * Sources that play the whole of their files (which is what the
+	 * default implementation assumes) have no cue points.
+	 * @return The cue points, in the file's own time.
+	 * @see TrimmedSource
+	 */
+	virtual std::optional<CuePoints> Cues() const;
+
+	/**
+	 * How this source's network fetching is going, if it has any.
+	 * Sources reading local files (which is what the default
+	 * implementation assumes) have none.  This may be called from any
+	 * thread, while the source is decoding.
+	 * @return The statistics, if this source streams its file.
+	 * @see HttpStream
+	 */
+	virtual std::optional<StreamStats> Streaming() const;
+
+	/**
+	 * How much memory this source holds on to for decoding, besides what its
+	 * libraries allocate for themselves.
+	 * Sources that decode straight into the caller's buffer (which is what
+	 * the default implementation assumes) hold none.  Call this only where
+	 * Decode() could be called.
+	 * @return The size of the scratch space, in bytes.
+	 */
+	[[nodiscard]] virtual std::size_t ScratchBytes() const;
+
+	/**
+	 * How many damaged frames this source has skipped over.
+	 * Sources whose decoders give up at the first bad frame (which is what
+	 * the default implementation assumes) skip none.  This may be called
+	 * from any thread, while the source is decoding.
+	 * @return The number of frames skipped since the source was opened.
+	 */
+	[[nodiscard]] virtual std::uint64_t SkippedFrames() const;
+
 	/**
 	 * Converts an elapsed sample count to a position in microseconds.
 	 * @param samples The number of elapsed samples.
@@ -134,6 +292,34 @@ public:
 	 */
 	std::chrono::microseconds MicrosFromSamples(Samples samples) const;
 
+	/**
+	 * Captures the shape of this source's audio.
+	 * Sources can't change their format once open, so the result holds for
+	 * as long as the source does.
+	 * @return The source's format, rate and layout.
+	 */
+	[[nodiscard]] StreamFormat Format() const;
+
+	/**
+	 * Asks this source to decode into a sample format from now on.
+	 * This is for decoding straight into whatever the rest of the chain
+	 * wants, so that nothing needs converting later.  Sources only switch
+	 * if they can do so without losing precision.  The default
+	 * implementation never switches.
+	 * * Precondition: nothing has been decoded yet.
+	 * @param format The sample format wanted.
+	 * @return Whether the source now outputs @a format.
+	 */
+	virtual bool PreferFormat(SampleFormat format);
+
+	/**
+	 * Lists the conversions this source makes to its file's audio as it
+	 * decodes it.  Sources wrapping other sources list those sources'
+	 * conversions first.  The default implementation makes none.
+	 * @return The conversions, in order.
+	 */
+	[[nodiscard]] virtual ConversionList Conversions() const;
+
 protected:
 	/// The file-path of this AudioSource's audio file.
 	std::string path;
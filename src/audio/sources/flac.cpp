@@ -0,0 +1,294 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the FlacSource class.
+ * @see audio/sources/flac.h
+ */
+
+#include "flac.h"
+
+#include <FLAC/stream_decoder.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "../../errors.h"
+#include "../../messages.h"
+#include "../mapped_file.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/// Finishes and frees a libFLAC decoder.
+static void FreeDecoder(FLAC__StreamDecoder *decoder)
+{
+	FLAC__stream_decoder_finish(decoder);
+	FLAC__stream_decoder_delete(decoder);
+}
+
+/**
+ * Interleaves one block of libFLAC's samples.
+ * Samples are shifted up to fill T, so that files of fewer bits than T come
+ * out at the right level.
+ * @param out Where to put the samples; this needn't be aligned.
+ * @param frames The number of sample frames.
+ * @param channels The number of channels.
+ * @param buffer The samples, one array per channel.
+ * @param shift How far to shift each sample up.
+ */
+template <typename T>
+static void Interleave(std::byte *out, std::size_t frames, std::size_t channels, const FLAC__int32 *const buffer[],
+                       unsigned shift)
+{
+	for (std::size_t f = 0; f < frames; f++) {
+		for (std::size_t c = 0; c < channels; c++) {
+			const auto sample = static_cast<T>(static_cast<std::uint32_t>(buffer[c][f]) << shift);
+			std::memcpy(out, &sample, sizeof sample);
+			out += sizeof sample;
+		}
+	}
+}
+
+FlacSource::FlacSource(std::string_view path)
+    : Source{path},
+      input{this->path},
+      decoder{FLAC__stream_decoder_new()},
+      sample_rate{0},
+      channels{0},
+      bits{0},
+      length{0},
+      sample_format{SampleFormat::SINT32},
+      target{},
+      pending_pos{0}
+{
+	if (this->decoder == nullptr) throw FileError("flac: can't make a decoder for " + this->path);
+
+	const auto status = FLAC__stream_decoder_init_stream(this->decoder, &OnRead, &OnSeek, &OnTell, &OnLength,
+	                                                     &OnEof, &OnWrite, &OnMetadata, &OnError, this);
+	if (status != FLAC__STREAM_DECODER_INIT_STATUS_OK) {
+		FLAC__stream_decoder_delete(this->decoder);
+		throw FileError("flac: can't open " + this->path + ": " + FLAC__StreamDecoderInitStatusString[status]);
+	}
+
+	// The stream info is always the first block, so this stops there.
+	if (!FLAC__stream_decoder_process_until_end_of_metadata(this->decoder) || this->channels == 0 ||
+	    this->sample_rate == 0) {
+		FreeDecoder(this->decoder);
+		throw FileError("flac: can't read stream info of " + this->path);
+	}
+	this->sample_format = this->bits <= 16 ? SampleFormat::SINT16 : SampleFormat::SINT32;
+}
+
+FlacSource::~FlacSource()
+{
+	FreeDecoder(this->decoder);
+}
+
+FlacSource::DecodeSpanResult FlacSource::Decode(gsl::span<std::byte> out)
+{
+	this->target = out;
+	this->DrainPending();
+
+	// Blocks that fit go straight into target, so this only stops early
+	// once a block doesn't fit (and target has what it could take).
+	while (!this->target.empty() && this->pending_pos == this->pending.size()) {
+		const auto state = FLAC__stream_decoder_get_state(this->decoder);
+		if (state == FLAC__STREAM_DECODER_END_OF_STREAM) break;
+
+		if (!FLAC__stream_decoder_process_single(this->decoder)) {
+			this->target = {};
+			throw FileError("flac: can't decode " + this->path + ": " +
+			                FLAC__StreamDecoderStateString[FLAC__stream_decoder_get_state(this->decoder)]);
+		}
+		this->DrainPending();
+	}
+
+	const auto read = out.size() - this->target.size();
+	this->target = {};
+
+	if (read == 0 && FLAC__stream_decoder_get_state(this->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
+		return std::make_pair(DecodeState::END_OF_FILE, 0);
+	}
+	return std::make_pair(DecodeState::DECODING, read);
+}
+
+std::uint64_t FlacSource::Seek(std::uint64_t position)
+{
+	if (this->length != 0 && this->length < position) {
+		Debug() << "flac: seek at" << position << "past EOF at" << this->length << std::endl;
+		throw SeekError(MSG_SEEK_FAIL);
+	}
+
+	// libFLAC won't seek to the very end, so seek to the last sample and
+	// throw it away; the next decode then finds the end of the stream.
+	const auto at_end = this->length != 0 && position == this->length;
+	this->pending.clear();
+	this->pending_pos = 0;
+
+	// The seek decodes the block it lands in, from the target sample on,
+	// which WriteBlock() holds back for the next Decode().
+	if (!FLAC__stream_decoder_seek_absolute(this->decoder, at_end ? position - 1 : position)) {
+		// Failed seeks leave the decoder needing a flush to carry on.
+		if (FLAC__stream_decoder_get_state(this->decoder) == FLAC__STREAM_DECODER_SEEK_ERROR) {
+			FLAC__stream_decoder_flush(this->decoder);
+		}
+		Debug() << "flac: seek failed" << std::endl;
+		throw SeekError(MSG_SEEK_FAIL);
+	}
+
+	if (at_end) this->pending_pos = this->pending.size();
+	return position;
+}
+
+std::uint64_t FlacSource::Length() const
+{
+	return this->length;
+}
+
+std::size_t FlacSource::ScratchBytes() const
+{
+	return this->pending.capacity();
+}
+
+std::uint8_t FlacSource::ChannelCount() const
+{
+	return this->channels;
+}
+
+std::uint32_t FlacSource::SampleRate() const
+{
+	return this->sample_rate;
+}
+
+SampleFormat FlacSource::OutputSampleFormat() const
+{
+	return this->sample_format;
+}
+
+void FlacSource::WriteBlock(std::size_t frames, const FLAC__int32 *const buffer[])
+{
+	const auto bytes = frames * this->BytesPerSample();
+
+	std::byte *out = nullptr;
+	if (bytes <= this->target.size()) {
+		out = this->target.data();
+		this->target = this->target.subspan(bytes);
+	} else {
+		this->pending.resize(bytes);
+		this->pending_pos = 0;
+		out = this->pending.data();
+	}
+
+	if (this->sample_format == SampleFormat::SINT16) {
+		Interleave<std::int16_t>(out, frames, this->channels, buffer, 16 - this->bits);
+	} else {
+		Interleave<std::int32_t>(out, frames, this->channels, buffer, 32 - this->bits);
+	}
+}
+
+void FlacSource::DrainPending()
+{
+	const auto bps = this->BytesPerSample();
+	const auto left = this->pending.size() - this->pending_pos;
+	const auto count = std::min(left, this->target.size() - (this->target.size() % bps));
+
+	std::copy_n(this->pending.begin() + static_cast<std::ptrdiff_t>(this->pending_pos), count, this->target.begin());
+	this->pending_pos += count;
+	this->target = this->target.subspan(count);
+}
+
+/* static */ std::unique_ptr<FlacSource> FlacSource::MakeUnique(std::string_view path)
+{
+	return std::make_unique<FlacSource, std::string_view>(std::move(path));
+}
+
+/* static */ bool FlacSource::Probe(gsl::span<const std::byte> head)
+{
+	return 4 <= head.size() && std::memcmp(head.data(), "fLaC", 4) == 0;
+}
+
+//
+// libFLAC callbacks
+//
+
+/* static */ FLAC__StreamDecoderReadStatus FlacSource::OnRead(const FLAC__StreamDecoder *, FLAC__byte buffer[],
+                                                              size_t *bytes, void *self)
+{
+	auto &input = static_cast<FlacSource *>(self)->input;
+	*bytes = input.Read(gsl::make_span(reinterpret_cast<std::byte *>(buffer), *bytes));
+	return *bytes == 0 ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+/* static */ FLAC__StreamDecoderSeekStatus FlacSource::OnSeek(const FLAC__StreamDecoder *, FLAC__uint64 offset,
+                                                              void *self)
+{
+	auto &input = static_cast<FlacSource *>(self)->input;
+	const auto pos = input.Seek(static_cast<std::int64_t>(offset), SEEK_SET);
+	return pos ? FLAC__STREAM_DECODER_SEEK_STATUS_OK : FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+}
+
+/* static */ FLAC__StreamDecoderTellStatus FlacSource::OnTell(const FLAC__StreamDecoder *, FLAC__uint64 *offset,
+                                                              void *self)
+{
+	*offset = static_cast<FlacSource *>(self)->input.Tell();
+	return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+/* static */ FLAC__StreamDecoderLengthStatus FlacSource::OnLength(const FLAC__StreamDecoder *,
+                                                                  FLAC__uint64 *length, void *self)
+{
+	*length = static_cast<FlacSource *>(self)->input.Size();
+	return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+/* static */ FLAC__bool FlacSource::OnEof(const FLAC__StreamDecoder *, void *self)
+{
+	const auto &input = static_cast<FlacSource *>(self)->input;
+	return input.Size() <= input.Tell();
+}
+
+/* static */ FLAC__StreamDecoderWriteStatus FlacSource::OnWrite(const FLAC__StreamDecoder *, const FLAC__Frame *frame,
+                                                                const FLAC__int32 *const buffer[], void *self)
+{
+	auto &source = *static_cast<FlacSource *>(self);
+
+	// The stream info promises every block has the same layout.
+	if (frame->header.channels != source.channels || source.bits < frame->header.bits_per_sample) {
+		Debug() << "flac: block doesn't match stream info in" << source.path << std::endl;
+		return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+	}
+
+	source.WriteBlock(frame->header.blocksize, buffer);
+	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+/* static */ void FlacSource::OnMetadata(const FLAC__StreamDecoder *, const FLAC__StreamMetadata *metadata,
+                                         void *self)
+{
+	if (metadata->type != FLAC__METADATA_TYPE_STREAMINFO) return;
+
+	auto &source = *static_cast<FlacSource *>(self);
+	const auto &info = metadata->data.stream_info;
+	source.sample_rate = info.sample_rate;
+	source.channels = static_cast<std::uint8_t>(info.channels);
+	source.bits = info.bits_per_sample;
+	source.length = info.total_samples;
+}
+
+/* static */ void FlacSource::OnError(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus status, void *self)
+{
+	// These are things like lost sync, which libFLAC recovers from.
+	Debug() << "flac:" << FLAC__StreamDecoderErrorStatusString[status] << "in"
+	        << static_cast<FlacSource *>(self)->path << std::endl;
+}
+
+} // namespace Playd::Audio
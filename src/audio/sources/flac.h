@@ -0,0 +1,143 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the FlacSource class.
+ * @see audio/sources/flac.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SOURCES_FLAC_H
+#define PLAYD_AUDIO_SOURCES_FLAC_H
+#ifdef WITH_FLAC
+
+#include <FLAC/stream_decoder.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../mapped_file.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source for use on FLAC files, decoded with libFLAC.
+ *
+ * libFLAC decodes a whole block at a time; each block is interleaved
+ * straight into the caller's buffer when it fits, and only held back when it
+ * doesn't.  Samples come out at the file's own depth: SINT16 for files of up
+ * to 16 bits, SINT32 otherwise.  Seeks use the file's seek table, if it has
+ * one, and libFLAC's binary search if not.
+ *
+ * libFLAC reads the file through a MappedFile, so that reads ahead of the
+ * decoder happen in the background.
+ */
+class FlacSource : public Source
+{
+public:
+	/**
+	 * Constructs a FlacSource, reading the file's stream info.
+	 * @param path The path to the file to load and decode using this
+	 *   decoder.
+	 * @exception FileError if the file can't be opened, or isn't FLAC.
+	 */
+	explicit FlacSource(std::string_view path);
+
+	/// Destructs a FlacSource.
+	~FlacSource();
+
+	/// Deleted copy constructor.
+	FlacSource(const FlacSource &) = delete;
+
+	/// Deleted copy-assignment.
+	FlacSource &operator=(const FlacSource &) = delete;
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	/**
+	 * Constructs a FlacSource and returns a unique pointer to it.
+	 * @param path The path to the file to load and decode using this
+	 *   decoder.
+	 * @returns A unique pointer to a FlacSource.
+	 */
+	static std::unique_ptr<FlacSource> MakeUnique(std::string_view path);
+
+	/**
+	 * Checks whether the start of a file looks like native FLAC.
+	 * @param head The start of the file.
+	 * @return Whether libFLAC should be able to decode the file.
+	 */
+	static bool Probe(gsl::span<const std::byte> head);
+
+private:
+	/// The file libFLAC reads from; this must outlive decoder.
+	MappedFile input;
+
+	FLAC__StreamDecoder *decoder; ///< The libFLAC decoder.
+
+	std::uint32_t sample_rate; ///< The sample rate, from the stream info.
+	std::uint8_t channels;     ///< The channel count, from the stream info.
+	std::uint32_t bits;        ///< The bits per sample, from the stream info.
+	std::uint64_t length;      ///< The length in samples, or 0 if unknown.
+
+	/// The format samples are decoded into: SINT16 or SINT32.
+	SampleFormat sample_format;
+
+	/// Where the block being decoded goes, if it fits; what's left of
+	/// the caller's buffer during Decode(), and empty otherwise.
+	gsl::span<std::byte> target;
+
+	/// Bytes of a block that didn't fit into the caller's buffer.
+	std::vector<std::byte> pending;
+
+	/// How much of pending has been handed out already.
+	std::size_t pending_pos;
+
+	/**
+	 * Interleaves a decoded block into target, or into pending if it
+	 * doesn't fit.
+	 * @param frames The number of sample frames in the block.
+	 * @param buffer The block's samples, one array per channel.
+	 */
+	void WriteBlock(std::size_t frames, const FLAC__int32 *const buffer[]);
+
+	/// Moves as many held-back samples into target as fit.
+	void DrainPending();
+
+	// libFLAC's callbacks; the client data is the FlacSource.
+
+	static FLAC__StreamDecoderReadStatus OnRead(const FLAC__StreamDecoder *, FLAC__byte buffer[], size_t *bytes,
+	                                            void *self);
+	static FLAC__StreamDecoderSeekStatus OnSeek(const FLAC__StreamDecoder *, FLAC__uint64 offset, void *self);
+	static FLAC__StreamDecoderTellStatus OnTell(const FLAC__StreamDecoder *, FLAC__uint64 *offset, void *self);
+	static FLAC__StreamDecoderLengthStatus OnLength(const FLAC__StreamDecoder *, FLAC__uint64 *length, void *self);
+	static FLAC__bool OnEof(const FLAC__StreamDecoder *, void *self);
+	static FLAC__StreamDecoderWriteStatus OnWrite(const FLAC__StreamDecoder *, const FLAC__Frame *frame,
+	                                              const FLAC__int32 *const buffer[], void *self);
+	static void OnMetadata(const FLAC__StreamDecoder *, const FLAC__StreamMetadata *metadata, void *self);
+	static void OnError(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus status, void *self);
+};
+
+} // namespace Playd::Audio
+
+#endif // WITH_FLAC
+#endif // PLAYD_AUDIO_SOURCES_FLAC_H
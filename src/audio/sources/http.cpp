@@ -0,0 +1,216 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the HttpSource class.
+ * @see audio/sources/http.h
+ */
+
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+
+// We don't include mpg123.h directly here, because http.h does some
+// polyfills before including it.
+
+#include "../../errors.h"
+#include "../../messages.h"
+#include "../http_stream.h"
+#include "../sample_format.h"
+#include "../source.h"
+#include "http.h"
+
+namespace Playd::Audio
+{
+HttpSource::HttpSource(std::string_view url)
+    : Source{url}, stream{url, PREFETCH_BYTES}, context{nullptr}, feed_buf{}
+{
+	this->context = mpg123_new(nullptr, nullptr);
+	if (this->context == nullptr) throw FileError("http: can't make a decoder for " + this->path);
+	mpg123_format_none(this->context);
+
+	// One encoding only, so that there is one fewer thing to pin.
+	const long *rates = nullptr;
+	size_t nrates = 0;
+	mpg123_rates(&rates, &nrates);
+	for (const auto rate : gsl::make_span(rates, nrates)) {
+		mpg123_format(this->context, rate, MPG123_STEREO | MPG123_MONO, MPG123_ENC_SIGNED_16);
+	}
+
+	if (mpg123_open_feed(this->context) != MPG123_OK) {
+		const std::string error{mpg123_strerror(this->context)};
+		mpg123_delete(this->context);
+		throw FileError("http: can't open " + this->path + ": " + error);
+	}
+
+	// mpg123 can't say what the format is until it has seen a frame.
+	try {
+		const auto deadline = std::chrono::steady_clock::now() + OPEN_TIMEOUT;
+		int encoding = 0;
+		int err = MPG123_NEED_MORE;
+		while ((err = mpg123_getformat(this->context, &this->rate, &this->channels, &encoding)) ==
+		       MPG123_NEED_MORE) {
+			const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+			        deadline - std::chrono::steady_clock::now());
+			if (left.count() <= 0 || this->stream.Ended()) {
+				throw FileError("http: no MP3 audio at " + this->path);
+			}
+			this->Feed(left);
+		}
+		if (err != MPG123_OK) throw FileError("http: can't decode " + this->path + ": " + mpg123_strerror(this->context));
+
+		// A stream changing format part way is converted to its first.
+		const auto layout = this->channels == 1 ? MPG123_MONO : MPG123_STEREO;
+		if (mpg123_format_none(this->context) != MPG123_OK ||
+		    mpg123_format(this->context, this->rate, layout, MPG123_ENC_SIGNED_16) != MPG123_OK) {
+			throw FileError("http: can't fix format of " + this->path + ": " + mpg123_strerror(this->context));
+		}
+	} catch (const FileError &) {
+		mpg123_delete(this->context);
+		throw;
+	}
+
+	// With the size of the file, mpg123 can guess lengths and seek points.
+	if (const auto size = this->stream.Size()) mpg123_set_filesize(this->context, static_cast<off_t>(*size));
+}
+
+HttpSource::~HttpSource()
+{
+	mpg123_delete(this->context);
+	this->context = nullptr;
+}
+
+bool HttpSource::Feed(std::chrono::milliseconds wait)
+{
+	if (0 < wait.count()) this->stream.WaitForData(wait);
+
+	const auto count = this->stream.Read(this->feed_buf);
+	if (count == 0) return false;
+
+	const auto *in = reinterpret_cast<const unsigned char *>(this->feed_buf.data());
+	if (mpg123_feed(this->context, in, count) != MPG123_OK) {
+		throw FileError("http: can't decode " + this->path + ": " + mpg123_strerror(this->context));
+	}
+	return true;
+}
+
+HttpSource::DecodeSpanResult HttpSource::Decode(gsl::span<std::byte> out)
+{
+	assert(this->context != nullptr);
+
+	auto buf = reinterpret_cast<unsigned char *>(out.data());
+	std::size_t done = 0;
+	while (done < out.size()) {
+		size_t rbytes = 0;
+		const auto err = mpg123_read(this->context, buf + done, out.size() - done, &rbytes);
+		done += rbytes;
+
+		if (err == MPG123_NEED_MORE) {
+			// Nothing more has been fetched yet, so try again next round.
+			if (!this->Feed(std::chrono::milliseconds{0})) break;
+		} else if (err == MPG123_DONE) {
+			break;
+		} else if (err == MPG123_NEW_FORMAT) {
+			// The format is pinned, so mpg123 converts to it.
+			Debug() << "http: format changes in" << this->path << std::endl;
+		} else if (err != MPG123_OK) {
+			// mpg123 resyncs on the next good frame at the next read.
+			if (MAX_BAD_IN_A_ROW <= this->bad_in_a_row) {
+				Debug() << "http: giving up after decode error:" << mpg123_strerror(this->context) << std::endl;
+				return std::make_pair(DecodeState::END_OF_FILE, 0);
+			}
+			Debug() << "http: skipping bad frame:" << mpg123_strerror(this->context) << std::endl;
+			this->bad_in_a_row++;
+			this->skipped.fetch_add(1, std::memory_order_relaxed);
+		} else if (0 < rbytes) {
+			this->bad_in_a_row = 0;
+		}
+	}
+
+	if (done == 0 && this->stream.Ended()) return std::make_pair(DecodeState::END_OF_FILE, 0);
+	return std::make_pair(DecodeState::DECODING, done);
+}
+
+std::uint64_t HttpSource::Seek(std::uint64_t in_samples)
+{
+	assert(this->context != nullptr);
+
+	if (!this->stream.Seekable()) {
+		Debug() << "http: can't seek in" << this->path << std::endl;
+		throw SeekError{MSG_SEEK_FAIL};
+	}
+
+	if (auto clen = this->Length(); clen < in_samples) {
+		Debug() << "http: seek at" << in_samples << "past EOF at" << clen << std::endl;
+		throw SeekError{MSG_SEEK_FAIL};
+	}
+
+	// mpg123 works out where the frame is, and we fetch from there.
+	off_t input_offset = 0;
+	const auto pos = mpg123_feedseek(this->context, static_cast<off_t>(in_samples), SEEK_SET, &input_offset);
+	if (pos < 0) {
+		Debug() << "http: seek failed:" << mpg123_strerror(this->context) << std::endl;
+		throw SeekError{MSG_SEEK_FAIL};
+	}
+	this->stream.Restart(static_cast<std::uint64_t>(input_offset));
+	return static_cast<std::uint64_t>(pos);
+}
+
+std::uint64_t HttpSource::Length() const
+{
+	assert(this->context != nullptr);
+
+	// Without a size, this is a live stream, or might as well be.
+	if (!this->stream.Size()) return 0;
+	const auto length = mpg123_length(this->context);
+	return length < 0 ? 0 : static_cast<std::uint64_t>(length);
+}
+
+std::uint8_t HttpSource::ChannelCount() const
+{
+	assert(this->context != nullptr);
+
+	assert(this->channels != 0);
+	return static_cast<std::uint8_t>(this->channels);
+}
+
+std::uint32_t HttpSource::SampleRate() const
+{
+	assert(this->context != nullptr);
+
+	assert(0 < this->rate && this->rate <= INT32_MAX);
+	return static_cast<std::uint32_t>(this->rate);
+}
+
+SampleFormat HttpSource::OutputSampleFormat() const
+{
+	return SampleFormat::SINT16;
+}
+
+std::optional<StreamStats> HttpSource::Streaming() const
+{
+	return this->stream.Stats();
+}
+
+std::size_t HttpSource::ScratchBytes() const
+{
+	return this->stream.Capacity() + this->feed_buf.size();
+}
+
+std::uint64_t HttpSource::SkippedFrames() const
+{
+	return this->skipped.load(std::memory_order_relaxed);
+}
+
+/* static */ std::unique_ptr<HttpSource> HttpSource::MakeUnique(std::string_view url)
+{
+	return std::make_unique<HttpSource, std::string_view>(std::move(url));
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,143 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the HttpSource class.
+ * @see audio/sources/http.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SOURCES_HTTP_H
+#define PLAYD_AUDIO_SOURCES_HTTP_H
+#ifdef WITH_MP3
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+extern "C" {
+#include <mpg123.h>
+}
+
+#include "../http_stream.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source for use on MP3 files and streams fetched over HTTP.
+ *
+ * The file comes through an HttpStream, and goes to mpg123 through its
+ * feed API, so decoding never waits on the network: when nothing has been
+ * fetched, decoding produces nothing, and tries again next round.  Seeks
+ * ask mpg123 where in the file to feed from, and make a new range request
+ * from there; servers that don't take ranges (and live streams) can't be
+ * seeked.  Live streams have no length.
+ *
+ * As with MP3Source, damaged frames are skipped and counted, and the output
+ * format is pinned to the stream's first.
+ */
+class HttpSource : public Source
+{
+public:
+	/// How far fetching may get ahead of playback.
+	static constexpr std::chrono::milliseconds LATENCY{2000};
+
+	/// The highest MP3 bitrate, in bits per second, which sizes the
+	/// prefetch buffer to hold LATENCY of any MP3.
+	static constexpr std::size_t MAX_BITRATE = 320000;
+
+	/// The size of the prefetch buffer, in bytes.
+	static constexpr std::size_t PREFETCH_BYTES = MAX_BITRATE / 8 * LATENCY.count() / 1000;
+
+	/// How long to wait for the start of the audio before giving up.
+	static constexpr std::chrono::milliseconds OPEN_TIMEOUT{10000};
+
+	/**
+	 * Constructs an HttpSource, waiting for the start of the audio.
+	 * @param url The http:// URL of the file or stream.
+	 * @exception FileError if the URL can't be fetched, or isn't MP3.
+	 */
+	explicit HttpSource(std::string_view url);
+
+	/// Destructs an HttpSource.
+	~HttpSource();
+
+	/// Deleted copy constructor.
+	HttpSource(const HttpSource &) = delete;
+
+	/// Deleted copy-assignment.
+	HttpSource &operator=(const HttpSource &) = delete;
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	/// The length of the audio in samples, or 0 for live streams.
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	/**
+	 * Constructs an HttpSource and returns a unique pointer to it.
+	 * @param url The http:// URL of the file or stream.
+	 * @returns A unique pointer to an HttpSource.
+	 */
+	static std::unique_ptr<HttpSource> MakeUnique(std::string_view url);
+
+private:
+	/// The most bad frames in a row to skip before giving up on the stream.
+	static constexpr unsigned int MAX_BAD_IN_A_ROW = 32;
+
+	/// The fetch mpg123 is fed from.
+	HttpStream stream;
+
+	/// Pointer to the mpg123 context associated with this source.
+	mpg123_handle *context;
+
+	/// Where fetched bytes go on their way to mpg123.
+	std::array<std::byte, HttpStream::READ_BYTES> feed_buf;
+
+	/// The sample rate every frame is decoded at.
+	long rate{0};
+
+	/// The channel count every frame is decoded to.
+	int channels{0};
+
+	/// The number of bad frames skipped so far.
+	std::atomic<std::uint64_t> skipped{0};
+
+	/// The number of bad frames skipped since the last good one.
+	unsigned int bad_in_a_row{0};
+
+	/**
+	 * Feeds mpg123 what has been fetched.
+	 * @param wait How long to wait for something to be fetched.
+	 * @return Whether mpg123 was fed anything.
+	 * @exception FileError if the fetch failed.
+	 */
+	bool Feed(std::chrono::milliseconds wait);
+};
+
+} // namespace Playd::Audio
+
+#endif // WITH_MP3
+#endif // PLAYD_AUDIO_SOURCES_HTTP_H
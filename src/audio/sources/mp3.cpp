@@ -7,7 +7,10 @@
  * @see audio/sources/mp3.h
  */
 
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <gsl/gsl>
@@ -20,6 +23,8 @@
 
 #include "../../errors.h"
 #include "../../messages.h"
+#include "../mapped_file.h"
+#include "../metadata_cache.h"
 #include "../sample_format.h"
 #include "../source.h"
 #include "mp3.h"
@@ -53,7 +58,55 @@ SampleFormat SampleFormatOfMpg123(int encoding)
 	}
 }
 
-MP3Source::MP3Source(std::string_view path) : Source{path}, buffer{}, context{nullptr}
+/// The mpg123 encodings for each SampleFormat, in the order of the enum.
+constexpr std::array<int, SAMPLE_FORMAT_COUNT> mpg123_encodings{{
+        MPG123_ENC_UNSIGNED_8, // UINT8
+        MPG123_ENC_SIGNED_8,   // SINT8
+        MPG123_ENC_SIGNED_16,  // SINT16
+        MPG123_ENC_SIGNED_32,  // SINT32
+        MPG123_ENC_FLOAT_32    // FLOAT32
+}};
+
+/// What the indexer's mpg123 handle reads the file through.
+struct IndexReader {
+	std::FILE *file;               ///< The file being indexed.
+	const std::atomic<bool> *stop; ///< Set when the indexer should give up.
+};
+
+/// mpg123 read callback for the indexer, which fails once asked to stop.
+static ssize_t IndexRead(void *handle, void *buf, size_t count)
+{
+	auto *reader = static_cast<IndexReader *>(handle);
+	if (reader->stop->load(std::memory_order_relaxed)) return -1;
+
+	const auto read = std::fread(buf, 1, count, reader->file);
+	if (read < count && std::ferror(reader->file)) return -1;
+	return static_cast<ssize_t>(read);
+}
+
+/// mpg123 seek callback for the indexer.
+static off_t IndexSeek(void *handle, off_t offset, int whence)
+{
+	auto *reader = static_cast<IndexReader *>(handle);
+	if (std::fseek(reader->file, static_cast<long>(offset), whence) != 0) return -1;
+	return static_cast<off_t>(std::ftell(reader->file));
+}
+
+/// mpg123 read callback for the main handle, which reads a MappedFile.
+static ssize_t MappedRead(void *handle, void *buf, size_t count)
+{
+	const auto span = gsl::make_span(static_cast<std::byte *>(buf), count);
+	return static_cast<ssize_t>(static_cast<MappedFile *>(handle)->Read(span));
+}
+
+/// mpg123 seek callback for the main handle.
+static off_t MappedSeek(void *handle, off_t offset, int whence)
+{
+	const auto pos = static_cast<MappedFile *>(handle)->Seek(offset, whence);
+	return pos ? static_cast<off_t>(*pos) : -1;
+}
+
+MP3Source::MP3Source(std::string_view path) : Source{path}, input{this->path}, context{nullptr}
 {
 	this->context = mpg123_new(nullptr, nullptr);
 	mpg123_format_none(this->context);
@@ -61,13 +114,36 @@ MP3Source::MP3Source(std::string_view path) : Source{path}, buffer{}, context{nu
 	auto rates = AvailableRates();
 	std::for_each(std::begin(rates), std::end(rates), std::bind(&MP3Source::AddFormat, this, std::placeholders::_1));
 
-	if (mpg123_open(this->context, this->path.c_str()) == MPG123_ERR) {
+	// By default mpg123 gives up looking for the next frame after 1 KiB of
+	// rubbish; it may as well keep looking, as there's nothing else to play.
+	if (mpg123_param(this->context, MPG123_RESYNC_LIMIT, -1, 0) == MPG123_ERR) {
+		Debug() << "mp3: can't lift resync limit:" << mpg123_strerror(this->context) << std::endl;
+	}
+
+	if (mpg123_replace_reader_handle(this->context, &MappedRead, &MappedSeek, nullptr) == MPG123_ERR ||
+	    mpg123_open_handle(this->context, &this->input) == MPG123_ERR ||
+	    mpg123_getformat(this->context, &this->rate, &this->channels, &this->encoding) == MPG123_ERR) {
 		throw FileError("mp3: can't open " + this->path + ": " + mpg123_strerror(this->context));
 	}
+	this->PinFormat();
+
+	// The indexer waits for StartScans(), so that probes don't start it.
 }
 
 MP3Source::~MP3Source()
 {
+	// The indexer checks this on every read, so it won't keep us long.
+	this->index_stop.store(true, std::memory_order_relaxed);
+	if (this->indexer.joinable()) this->indexer.join();
+
+	// Now that nothing else is touching the index, we can save it for
+	// next time.  The format is checked on the way back out of the cache.
+	if (this->cache != nullptr && !this->index_cached && this->index_ready.load(std::memory_order_acquire)) {
+		this->cache->Store(this->path, {this->index_length, this->SampleRate(), this->ChannelCount(),
+		                                this->OutputSampleFormat(), this->index_step,
+		                                {this->index_offsets.begin(), this->index_offsets.end()}});
+	}
+
 	mpg123_delete(this->context);
 	this->context = nullptr;
 }
@@ -76,9 +152,124 @@ std::uint64_t MP3Source::Length() const
 {
 	assert(this->context != nullptr);
 
+	if (this->index_ready.load(std::memory_order_acquire)) return this->index_length;
 	return mpg123_length(this->context);
 }
 
+std::size_t MP3Source::ScratchBytes() const
+{
+	// The seek index is the indexer's until it's ready.
+	if (!this->index_ready.load(std::memory_order_acquire)) return 0;
+	return this->index_offsets.capacity() * sizeof(off_t);
+}
+
+std::uint64_t MP3Source::SkippedFrames() const
+{
+	return this->skipped.load(std::memory_order_relaxed);
+}
+
+bool MP3Source::PreferFormat(SampleFormat format)
+{
+	const auto current = this->OutputSampleFormat();
+	if (current == format) return true;
+	if (sample_format_bps[static_cast<int>(format)] < sample_format_bps[static_cast<int>(current)]) return false;
+
+	const auto old_encoding = this->encoding;
+	this->encoding = mpg123_encodings[static_cast<int>(format)];
+	try {
+		this->PinFormat();
+	} catch (FileError &e) {
+		// This mpg123 can't make that encoding; carry on as we were.
+		Debug() << "mp3: can't decode" << this->path << "as" << sample_format_names[static_cast<int>(format)]
+		        << std::endl;
+		this->encoding = old_encoding;
+		this->PinFormat();
+		return false;
+	}
+	return true;
+}
+
+void MP3Source::UseCache(MetadataCache &new_cache)
+{
+	this->cache = &new_cache;
+
+	const auto entry = new_cache.Find(this->path);
+	if (!entry || entry->rate != this->SampleRate() || entry->channels != this->ChannelCount() ||
+	    entry->format != this->OutputSampleFormat()) {
+		return;
+	}
+
+	// The cache already has everything the indexer would find out, so it
+	// needn't start, or carry on if it has.
+	this->index_stop.store(true, std::memory_order_relaxed);
+	if (this->indexer.joinable()) this->indexer.join();
+	if (this->index_ready.load(std::memory_order_acquire)) return;
+
+	this->index_offsets.assign(entry->index.begin(), entry->index.end());
+	this->index_step = static_cast<off_t>(entry->index_step);
+	this->index_length = entry->length;
+	this->index_cached = true;
+	this->index_ready.store(true, std::memory_order_release);
+}
+
+void MP3Source::StartScans()
+{
+	if (this->indexer.joinable() || this->index_ready.load(std::memory_order_acquire)) return;
+	this->indexer = std::thread(&MP3Source::BuildIndex, this);
+}
+
+void MP3Source::WaitForScans()
+{
+	// The index is stored when we're destroyed, as long as it's ready.
+	if (this->indexer.joinable()) this->indexer.join();
+}
+
+void MP3Source::BuildIndex()
+{
+	auto scanner = mpg123_new(nullptr, nullptr);
+	if (scanner == nullptr) return;
+	const auto delete_scanner = gsl::finally([scanner] { mpg123_delete(scanner); });
+
+	auto file = std::fopen(this->path.c_str(), "rb");
+	if (file == nullptr) return;
+	const auto close_file = gsl::finally([file] { std::fclose(file); });
+
+	// A negative index size lets the index grow to cover the whole file.
+	IndexReader reader{file, &this->index_stop};
+	if (mpg123_param(scanner, MPG123_INDEX_SIZE, -1, 0) != MPG123_OK ||
+	    mpg123_replace_reader_handle(scanner, &IndexRead, &IndexSeek, nullptr) != MPG123_OK ||
+	    mpg123_open_handle(scanner, &reader) != MPG123_OK || mpg123_scan(scanner) != MPG123_OK) {
+		if (!this->index_stop.load(std::memory_order_relaxed)) {
+			Debug() << "mp3: couldn't index" << this->path << std::endl;
+		}
+		return;
+	}
+
+	off_t *offsets = nullptr;
+	off_t step = 0;
+	size_t fill = 0;
+	if (mpg123_index(scanner, &offsets, &step, &fill) != MPG123_OK) return;
+	const auto length = mpg123_length(scanner);
+	if (length < 0) return;
+
+	this->index_offsets.assign(offsets, offsets + fill);
+	this->index_step = step;
+	this->index_length = static_cast<std::uint64_t>(length);
+	this->index_ready.store(true, std::memory_order_release);
+}
+
+void MP3Source::InstallIndex()
+{
+	if (this->index_installed || !this->index_ready.load(std::memory_order_acquire)) return;
+
+	// If this fails, we've lost nothing; mpg123 just carries on guessing.
+	if (mpg123_set_index(this->context, this->index_offsets.data(), this->index_step, this->index_offsets.size()) !=
+	    MPG123_OK) {
+		Debug() << "mp3: couldn't use index:" << mpg123_strerror(this->context) << std::endl;
+	}
+	this->index_installed = true;
+}
+
 /* static */ gsl::span<const long> MP3Source::AvailableRates()
 {
 	const long *rawrates = nullptr;
@@ -101,37 +292,46 @@ void MP3Source::AddFormat(long rate)
 	};
 }
 
+void MP3Source::PinFormat()
+{
+	const auto layout = this->channels == 1 ? MPG123_MONO : MPG123_STEREO;
+	if (mpg123_format_none(this->context) == MPG123_ERR ||
+	    mpg123_format(this->context, this->rate, layout, this->encoding) == MPG123_ERR) {
+		throw FileError("mp3: can't fix format of " + this->path + ": " + mpg123_strerror(this->context));
+	}
+}
+
 std::uint8_t MP3Source::ChannelCount() const
 {
 	assert(this->context != nullptr);
 
-	int chans = 0;
-	mpg123_getformat(this->context, nullptr, &chans, nullptr);
-	assert(chans != 0);
-	return static_cast<std::uint8_t>(chans);
+	// This is pinned, so mpg123 needn't be asked.
+	assert(this->channels != 0);
+	return static_cast<std::uint8_t>(this->channels);
 }
 
 std::uint32_t MP3Source::SampleRate() const
 {
 	assert(this->context != nullptr);
 
-	long rate = 0;
-	mpg123_getformat(this->context, &rate, nullptr, nullptr);
-
-	assert(0 < rate);
+	assert(0 < this->rate);
 	// INT32_MAX isn't a typo; if we compare against UINT32_MAX, we'll
 	// set off sign-compare errors, and the sample rate shouldn't be above
 	// INT32_MAX anyroad.
-	assert(rate <= INT32_MAX);
-	return static_cast<std::uint32_t>(rate);
+	assert(this->rate <= INT32_MAX);
+	return static_cast<std::uint32_t>(this->rate);
 }
 
 std::uint64_t MP3Source::Seek(std::uint64_t in_samples)
 {
 	assert(this->context != nullptr);
 
+	// With an index, mpg123 can jump straight to the right frame, rather
+	// than guessing or scanning.
+	this->InstallIndex();
+
 	// Have we tried to seek past the end of the file?
-	if (auto clen = static_cast<unsigned long>(mpg123_length(this->context)); clen < in_samples) {
+	if (auto clen = this->Length(); clen < in_samples) {
 		Debug() << "mp3: seek at" << in_samples << "past EOF at" << clen << std::endl;
 		throw SeekError{MSG_SEEK_FAIL};
 	}
@@ -147,39 +347,72 @@ std::uint64_t MP3Source::Seek(std::uint64_t in_samples)
 	return mpg123_tell(this->context);
 }
 
-MP3Source::DecodeResult MP3Source::Decode()
+MP3Source::DecodeSpanResult MP3Source::Decode(gsl::span<std::byte> out)
 {
 	assert(this->context != nullptr);
 
-	auto buf = reinterpret_cast<unsigned char *>(&this->buffer.front());
-	size_t rbytes = 0;
-	const auto err = mpg123_read(this->context, buf, this->buffer.size(), &rbytes);
-
-	DecodeVector decoded;
-	DecodeState decode_state = DecodeState::DECODING;
-
-	if (err == MPG123_DONE) {
-		decode_state = DecodeState::END_OF_FILE;
-	} else if (err != MPG123_OK && err != MPG123_NEW_FORMAT) {
-		Debug() << "mp3: decode error:" << mpg123_strerror(this->context) << std::endl;
-		decode_state = DecodeState::END_OF_FILE;
-	} else {
-		// Copy only the bit of the buffer occupied by decoded data
-		auto front = this->buffer.begin();
-		decoded = DecodeVector{front, front + rbytes};
+	auto buf = reinterpret_cast<unsigned char *>(out.data());
+
+	// Bad frames are skipped here, rather than handed back as empty reads,
+	// so that the good frame after them follows on without a gap.
+	for (;;) {
+		size_t rbytes = 0;
+		const auto err = mpg123_read(this->context, buf, out.size(), &rbytes);
+
+		if (err == MPG123_DONE) return std::make_pair(DecodeState::END_OF_FILE, 0);
+		const auto held = err != MPG123_NEW_FORMAT || this->HoldFormat();
+		if (held && (err == MPG123_OK || err == MPG123_NEW_FORMAT)) {
+			this->bad_in_a_row = 0;
+			return std::make_pair(DecodeState::DECODING, rbytes);
+		}
+
+		if (!this->Skip()) return std::make_pair(DecodeState::END_OF_FILE, 0);
+		// Bytes decoded before an error are good; ones in the wrong
+		// format aren't.
+		if (held && 0 < rbytes) return std::make_pair(DecodeState::DECODING, rbytes);
+	}
+}
+
+bool MP3Source::HoldFormat()
+{
+	// The stream's format changed, but the output's is pinned; all being
+	// well, mpg123 is converting to it.
+	long new_rate = 0;
+	int new_channels = 0;
+	int new_encoding = 0;
+	mpg123_getformat(this->context, &new_rate, &new_channels, &new_encoding);
+	if (new_rate == this->rate && new_channels == this->channels && new_encoding == this->encoding) return true;
+
+	// Pinning again makes mpg123 look at its conversions afresh; what it
+	// decoded in the wrong format is skipped.
+	Debug() << "mp3: repinning format after change to" << new_rate << "Hz" << std::endl;
+	this->PinFormat();
+	return false;
+}
+
+bool MP3Source::Skip()
+{
+	// Errors on our end, rather than the file's, won't go away.  (A format
+	// we couldn't hold has no error code.)
+	const auto code = mpg123_errcode(this->context);
+	const auto fatal = code == MPG123_OUT_OF_MEM || code == MPG123_ERR_READER || code == MPG123_NO_READER;
+	if (fatal || MAX_BAD_IN_A_ROW <= this->bad_in_a_row) {
+		Debug() << "mp3: giving up after decode error:" << mpg123_plain_strerror(code) << std::endl;
+		return false;
 	}
 
-	return std::make_pair(decode_state, decoded);
+	// mpg123 resyncs on the next good frame at the next read.
+	Debug() << "mp3: skipping bad frame:" << mpg123_plain_strerror(code) << std::endl;
+	this->bad_in_a_row++;
+	this->skipped.fetch_add(1, std::memory_order_relaxed);
+	return true;
 }
 
 SampleFormat MP3Source::OutputSampleFormat() const
 {
 	assert(this->context != nullptr);
 
-	int encoding = 0;
-	mpg123_getformat(this->context, nullptr, nullptr, &encoding);
-
-	return SampleFormatOfMpg123(encoding);
+	return SampleFormatOfMpg123(this->encoding);
 }
 
 std::unique_ptr<MP3Source> MP3Source::MakeUnique(std::string_view path)
@@ -188,4 +421,20 @@ std::unique_ptr<MP3Source> MP3Source::MakeUnique(std::string_view path)
 	return std::make_unique<MP3Source, std::string_view>(std::move(path));
 }
 
+/* static */ bool MP3Source::Probe(gsl::span<const std::byte> head)
+{
+	const auto at = [&head](std::size_t i) { return std::to_integer<std::uint8_t>(head[i]); };
+	if (head.size() < 4) return false;
+	if (at(0) == 'I' && at(1) == 'D' && at(2) == '3') return true;
+
+	// An 11-bit frame sync, then a version, layer, bitrate and sample
+	// rate that aren't reserved.  ADTS has a layer of 0.
+	if (at(0) != 0xFF || (at(1) & 0xE0) != 0xE0) return false;
+	const auto version = (at(1) >> 3) & 0x3;
+	const auto layer = (at(1) >> 1) & 0x3;
+	const auto bitrate = at(2) >> 4;
+	const auto rate = (at(2) >> 2) & 0x3;
+	return version != 1 && layer != 0 && bitrate != 0xF && rate != 0x3;
+}
+
 } // namespace Playd::Audio
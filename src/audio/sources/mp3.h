@@ -11,21 +11,41 @@
 #define PLAYD_AUDIO_SOURCES_MP3_H
 #ifdef WITH_MP3
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 extern "C" {
 #include <mpg123.h>
 }
 
+#include "../mapped_file.h"
 #include "../sample_format.h"
 #include "../source.h"
 
 namespace Playd::Audio
 {
-/// Audio source for use on MP3 files.
+/**
+ * Audio source for use on MP3 files.
+ *
+ * Without a table of contents (which VBR files often lack), mpg123 can only
+ * seek accurately, or say how long a file is, by scanning the whole file.
+ * Doing that on the loop thread would stall everything for as long as the
+ * scan takes, so we instead scan a second handle on a background thread as
+ * soon as the file is opened, and hand its frame index over once it is done.
+ * Until then, seeks and lengths are mpg123's best guesses.
+ *
+ * mpg123 reads the file through a MappedFile, so that reads ahead of the
+ * decoder happen in the background.
+ *
+ * Damaged frames are skipped, and counted, rather than ending the file:
+ * mpg123 resyncs on the next good frame, which plays straight after the last.
+ * The output format is pinned to the file's first, so that a stream whose
+ * format changes partway is converted to what the sink was set up for.
+ */
 class MP3Source : public Source
 {
 public:
@@ -39,13 +59,42 @@ public:
 	/// Destructs an Mp3AudioSource.
 	~MP3Source();
 
-	DecodeResult Decode() override;
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
 
 	std::uint64_t Seek(std::uint64_t position) override;
 
 	/// The length of the audio, in samples.
 	std::uint64_t Length() const override;
 
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	/**
+	 * Asks mpg123 to decode into a sample format from now on.
+	 * As this only changes the encoding mpg123 converts its own output to,
+	 * any format at least as wide as the file's first is fine.
+	 * @param format The sample format wanted.
+	 * @return Whether the source now outputs @a format.
+	 */
+	bool PreferFormat(SampleFormat format) override;
+
+	/**
+	 * Lets this source use a cache of seek indices.
+	 * If the cache has an index for this file, the indexer needn't run,
+	 * and the cached index is used instead; otherwise, the indexer's
+	 * index is stored in the cache once this source is done with.
+	 * @param cache The cache, which must outlive this source.
+	 */
+	void UseCache(MetadataCache &cache) override;
+
+	/// Starts the indexer, unless the cache already had an index.
+	void StartScans() override;
+
+	void WaitForScans() override;
+
 	std::uint8_t ChannelCount() const override;
 
 	std::uint32_t SampleRate() const override;
@@ -60,16 +109,77 @@ public:
 	 */
 	static std::unique_ptr<MP3Source> MakeUnique(std::string_view path);
 
+	/**
+	 * Checks whether the start of a file looks like MP3.
+	 * This takes files starting with an ID3v2 tag, or with an MPEG audio
+	 * frame header; ADTS (AAC) headers, which look much the same, don't
+	 * count.
+	 * @param head The start of the file.
+	 * @return Whether mpg123 should be able to decode the file.
+	 */
+	static bool Probe(gsl::span<const std::byte> head);
+
 private:
-	// This value is somewhat arbitrary, but corresponds to the minimum
-	// buffer size used by ffmpeg, so it's probably sensible.
-	static constexpr size_t buffer_size = 16384;
+	/// The most bad frames in a row to skip before giving up on the file.
+	static constexpr unsigned int MAX_BAD_IN_A_ROW = 32;
 
-	std::array<std::byte, buffer_size> buffer; ///< The decoding buffer.
+	/// The file mpg123 reads from; this must outlive context.
+	MappedFile input;
 
 	/// Pointer to the mpg123 context associated with this source.
 	mpg123_handle *context;
 
+	/// The thread scanning the file for its seek index.
+	std::thread indexer;
+
+	/// Set to ask the indexer to give up early.
+	std::atomic<bool> index_stop{false};
+
+	/// Set by the indexer once the index_ fields below are filled in.
+	std::atomic<bool> index_ready{false};
+
+	/// File offsets of every index_step-th frame, from the indexer.
+	std::vector<off_t> index_offsets;
+
+	/// The number of frames between entries in index_offsets.
+	off_t index_step{0};
+
+	/// The exact length of the file, in samples, from the indexer.
+	std::uint64_t index_length{0};
+
+	/// Whether the indexer's index has been given to context yet.
+	bool index_installed{false};
+
+	/// The cache in which to store the index, if any.
+	MetadataCache *cache{nullptr};
+
+	/// Whether the index came from the cache, so needn't go back into it.
+	bool index_cached{false};
+
+	/// The sample rate every frame is decoded at.
+	long rate{0};
+
+	/// The channel count every frame is decoded to.
+	int channels{0};
+
+	/// The mpg123 encoding every frame is decoded to.
+	int encoding{0};
+
+	/// The number of bad frames skipped so far.
+	std::atomic<std::uint64_t> skipped{0};
+
+	/// The number of bad frames skipped since the last good one.
+	unsigned int bad_in_a_row{0};
+
+	/**
+	 * Scans the file, on a separate handle, for its seek index.
+	 * This runs on the indexer thread.
+	 */
+	void BuildIndex();
+
+	/// Gives the indexer's index to context, if it's ready and hasn't been.
+	void InstallIndex();
+
 	/**
 	 * @returns A span containing the available sample rates.
 	 */
@@ -80,6 +190,26 @@ private:
 	 * @param rate The sample rate to add.
 	 */
 	void AddFormat(long rate);
+
+	/**
+	 * Restricts mpg123 to the format of the file's first frame.
+	 * mpg123 then converts any later frames in other formats to it.
+	 */
+	void PinFormat();
+
+	/**
+	 * Checks that a new format in the stream is still decoding to the
+	 * pinned format, pinning it again if not.
+	 * @return Whether mpg123 is converting to the pinned format.
+	 */
+	[[nodiscard]] bool HoldFormat();
+
+	/**
+	 * Decides what to do about an error from mpg123_read, counting the
+	 * frame as skipped if decoding can carry on past it.
+	 * @return Whether to carry on decoding.
+	 */
+	[[nodiscard]] bool Skip();
 };
 
 } // namespace Playd::Audio
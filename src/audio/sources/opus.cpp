@@ -0,0 +1,157 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the OpusSource class.
+ * @see audio/sources/opus.h
+ */
+
+#include "opus.h"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "../../errors.h"
+#include "../../messages.h"
+#include "../mapped_file.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+//
+// libopusfile I/O over a MappedFile; the stream is the MappedFile.
+//
+
+static int MappedRead(void *input, unsigned char *out, int count)
+{
+	const auto span = gsl::make_span(reinterpret_cast<std::byte *>(out), static_cast<size_t>(count));
+	return static_cast<int>(static_cast<MappedFile *>(input)->Read(span));
+}
+
+static int MappedSeek(void *input, opus_int64 offset, int whence)
+{
+	return static_cast<MappedFile *>(input)->Seek(offset, whence) ? 0 : -1;
+}
+
+static opus_int64 MappedTell(void *input)
+{
+	return static_cast<opus_int64>(static_cast<MappedFile *>(input)->Tell());
+}
+
+/// The I/O table for MappedFiles; the MappedFile closes itself.
+static const OpusFileCallbacks mapped_io{&MappedRead, &MappedSeek, &MappedTell, nullptr};
+
+OpusSource::OpusSource(std::string_view path)
+    : Source{path}, input{this->path}, file{nullptr}, channels{0}, length{0}
+{
+	int error = 0;
+	this->file = op_open_callbacks(&this->input, &mapped_io, nullptr, 0, &error);
+	if (this->file == nullptr) {
+		throw FileError("opus: can't open " + this->path + ": error " + std::to_string(error));
+	}
+
+	// Unseekable files have no total, but MappedFiles are always seekable.
+	const auto total = op_pcm_total(this->file, -1);
+	const auto count = op_channel_count(this->file, -1);
+	if (total < 0 || count <= 0 || UINT8_MAX < count) {
+		op_free(this->file);
+		throw FileError("opus: can't read the layout of " + this->path);
+	}
+	this->length = static_cast<std::uint64_t>(total);
+	this->channels = static_cast<std::uint8_t>(count);
+}
+
+OpusSource::~OpusSource()
+{
+	op_free(this->file);
+}
+
+OpusSource::DecodeSpanResult OpusSource::Decode(gsl::span<std::byte> out)
+{
+	// op_read_float wants aligned floats, which spans of whole samples at
+	// whole sample offsets into a buffer are.
+	assert(reinterpret_cast<std::uintptr_t>(out.data()) % alignof(float) == 0);
+	auto *floats = reinterpret_cast<float *>(out.data());
+	const auto capacity = std::min<std::size_t>(out.size() / sizeof(float), INT_MAX);
+
+	// Each read gives at most one packet, so keep going until the buffer
+	// is full; a packet that doesn't fit is kept for next time.
+	std::size_t done = 0;
+	while (this->channels <= capacity - done) {
+		int link = 0;
+		const auto read = op_read_float(this->file, floats + done, static_cast<int>(capacity - done), &link);
+		if (read == OP_HOLE) continue; // A gap in the data, which is then skipped.
+		if (read < 0) throw FileError("opus: can't decode " + this->path + ": error " + std::to_string(read));
+		if (read == 0) break;
+
+		if (op_channel_count(this->file, link) != this->channels) {
+			Debug() << "opus: channel count changes in" << this->path << std::endl;
+			break;
+		}
+		done += static_cast<std::size_t>(read) * this->channels;
+	}
+
+	if (done == 0) return std::make_pair(DecodeState::END_OF_FILE, 0);
+	return std::make_pair(DecodeState::DECODING, done * sizeof(float));
+}
+
+std::uint64_t OpusSource::Seek(std::uint64_t position)
+{
+	if (this->length < position) {
+		Debug() << "opus: seek at" << position << "past EOF at" << this->length << std::endl;
+		throw SeekError(MSG_SEEK_FAIL);
+	}
+
+	if (op_pcm_seek(this->file, static_cast<ogg_int64_t>(position)) != 0) {
+		Debug() << "opus: seek failed" << std::endl;
+		throw SeekError(MSG_SEEK_FAIL);
+	}
+	return position;
+}
+
+std::uint64_t OpusSource::Length() const
+{
+	return this->length;
+}
+
+std::uint8_t OpusSource::ChannelCount() const
+{
+	return this->channels;
+}
+
+std::uint32_t OpusSource::SampleRate() const
+{
+	return RATE;
+}
+
+SampleFormat OpusSource::OutputSampleFormat() const
+{
+	return SampleFormat::FLOAT32;
+}
+
+/* static */ std::unique_ptr<OpusSource> OpusSource::MakeUnique(std::string_view path)
+{
+	return std::make_unique<OpusSource, std::string_view>(std::move(path));
+}
+
+/* static */ bool OpusSource::Probe(gsl::span<const std::byte> head)
+{
+	// The first page holds just the header packet, so its segment table is
+	// one byte long, and the packet starts right after it.
+	constexpr std::size_t PACKET = 27 + 1;
+	if (head.size() < PACKET + 8) return false;
+	return std::memcmp(head.data(), "OggS", 4) == 0 && std::memcmp(head.data() + PACKET, "OpusHead", 8) == 0;
+}
+
+} // namespace Playd::Audio
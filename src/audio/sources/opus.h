@@ -0,0 +1,103 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the OpusSource class.
+ * @see audio/sources/opus.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SOURCES_OPUS_H
+#define PLAYD_AUDIO_SOURCES_OPUS_H
+#ifdef WITH_OPUS
+
+#include <opusfile.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "../mapped_file.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source for use on Ogg Opus files, decoded with libopusfile.
+ *
+ * Opus always decodes at 48kHz, as floats, which is what the device wants
+ * anyway.  Seeks bisect the file by page granule positions, as Ogg has no
+ * seek table, and libopusfile handles the pre-roll Opus needs after a seek.
+ * Chained files play until a link with a different channel count, which
+ * (as the sink can't change layout mid-file) is where they end.
+ *
+ * libopusfile reads the file through a MappedFile, so that reads ahead of
+ * the decoder happen in the background.
+ */
+class OpusSource : public Source
+{
+public:
+	/// The sample rate Opus always decodes at.
+	static constexpr std::uint32_t RATE = 48000;
+
+	/**
+	 * Constructs an OpusSource.
+	 * @param path The path to the file to load and decode using this
+	 *   decoder.
+	 * @exception FileError if the file can't be opened, or isn't Opus.
+	 */
+	explicit OpusSource(std::string_view path);
+
+	/// Destructs an OpusSource.
+	~OpusSource();
+
+	/// Deleted copy constructor.
+	OpusSource(const OpusSource &) = delete;
+
+	/// Deleted copy-assignment.
+	OpusSource &operator=(const OpusSource &) = delete;
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	/**
+	 * Constructs an OpusSource and returns a unique pointer to it.
+	 * @param path The path to the file to load and decode using this
+	 *   decoder.
+	 * @returns A unique pointer to an OpusSource.
+	 */
+	static std::unique_ptr<OpusSource> MakeUnique(std::string_view path);
+
+	/**
+	 * Checks whether the start of a file looks like Ogg Opus: an Ogg page
+	 * whose first packet is an Opus header.
+	 * @param head The start of the file.
+	 * @return Whether libopusfile should be able to decode the file.
+	 */
+	static bool Probe(gsl::span<const std::byte> head);
+
+private:
+	/// The file libopusfile reads from; this must outlive file.
+	MappedFile input;
+
+	OggOpusFile *file;     ///< The libopusfile handle.
+	std::uint8_t channels; ///< The channel count of the first link.
+	std::uint64_t length;  ///< The length in samples.
+};
+
+} // namespace Playd::Audio
+
+#endif // WITH_OPUS
+#endif // PLAYD_AUDIO_SOURCES_OPUS_H
@@ -0,0 +1,98 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the RamSource class.
+ * @see audio/sources/ram.h
+ */
+
+#include "ram.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "../../errors.h"
+#include "../../messages.h"
+#include "../pcm_cache.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+RamSource::RamSource(std::shared_ptr<const PcmClip> clip) : Source{clip->path}, clip{std::move(clip)}, pos{0}
+{
+}
+
+Source::DecodeSpanResult RamSource::Decode(gsl::span<std::byte> out)
+{
+	const auto &samples = this->clip->samples;
+	const auto count = std::min(out.size(), samples.size() - this->pos);
+	if (count == 0) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+	std::memcpy(out.data(), samples.data() + this->pos, count);
+	this->pos += count;
+	return std::make_pair(DecodeState::DECODING, count);
+}
+
+std::uint64_t RamSource::Seek(std::uint64_t position)
+{
+	if (this->Length() < position) {
+		Debug() << "ram: seek at" << position << "past EOF at" << this->Length() << std::endl;
+		throw SeekError(MSG_SEEK_FAIL);
+	}
+
+	this->pos = position * this->BytesPerSample();
+	return position;
+}
+
+std::uint64_t RamSource::Length() const
+{
+	return this->clip->samples.size() / this->BytesPerSample();
+}
+
+std::uint8_t RamSource::ChannelCount() const
+{
+	return this->clip->channels;
+}
+
+std::uint32_t RamSource::SampleRate() const
+{
+	return this->clip->rate;
+}
+
+SampleFormat RamSource::OutputSampleFormat() const
+{
+	return this->clip->format;
+}
+
+/* static */ std::shared_ptr<const PcmClip> RamSource::DecodeAll(Source &source)
+{
+	auto clip = std::make_shared<PcmClip>();
+	clip->path = std::string{source.Path()};
+	clip->rate = source.SampleRate();
+	clip->channels = source.ChannelCount();
+	clip->format = source.OutputSampleFormat();
+	if (const auto length = source.Length(); length != 0) {
+		clip->samples.reserve(length * source.BytesPerSample());
+	}
+
+	const auto frame = source.FrameBytes();
+	auto state = DecodeState::DECODING;
+	while (state != DecodeState::END_OF_FILE) {
+		const auto start = clip->samples.size();
+		clip->samples.resize(start + frame);
+		const auto [decode_state, count] = source.Decode(gsl::span{clip->samples}.subspan(start, frame));
+		clip->samples.resize(start + count);
+		state = decode_state;
+	}
+
+	clip->samples.shrink_to_fit();
+	return clip;
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,66 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the RamSource class.
+ * @see audio/sources/ram.cpp
+ */
+
+#ifndef PLAYD_AUDIO_SOURCES_RAM_H
+#define PLAYD_AUDIO_SOURCES_RAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "../pcm_cache.h"
+#include "../sample_format.h"
+#include "../source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Audio source playing a clip that has already been decoded into memory.
+ * Decoding is a copy out of the clip, and seeking just moves a cursor, so
+ * neither touches the disk or a decoder.
+ * @see PcmCache
+ */
+class RamSource : public Source
+{
+public:
+	/**
+	 * Constructs a RamSource.
+	 * @param clip The clip to play, which may be shared with other sources.
+	 */
+	explicit RamSource(std::shared_ptr<const PcmClip> clip);
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	/**
+	 * Decodes everything left in a source into a clip.
+	 * @param source The source, which is left at its end.
+	 * @return The clip.
+	 */
+	static std::shared_ptr<const PcmClip> DecodeAll(Source &source);
+
+private:
+	std::shared_ptr<const PcmClip> clip; ///< The clip being played.
+	std::size_t pos;                     ///< The cursor into the clip, in bytes.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_SOURCES_RAM_H
@@ -12,33 +12,69 @@
 #include <sndfile.h>
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include "../../errors.h"
 #include "../../messages.h"
+#include "../mapped_file.h"
 #include "../sample_format.h"
 #include "../source.h"
 
 namespace Playd::Audio
 {
-SndfileSource::SndfileSource(std::string_view path) : Source{path}, file{nullptr}, buffer{}
+//
+// libsndfile virtual I/O over a MappedFile; the user data is the MappedFile.
+//
+
+static sf_count_t MappedLength(void *input)
+{
+	return static_cast<sf_count_t>(static_cast<MappedFile *>(input)->Size());
+}
+
+static sf_count_t MappedSeek(sf_count_t offset, int whence, void *input)
+{
+	const auto pos = static_cast<MappedFile *>(input)->Seek(offset, whence);
+	return pos ? static_cast<sf_count_t>(*pos) : -1;
+}
+
+static sf_count_t MappedRead(void *out, sf_count_t count, void *input)
+{
+	const auto span = gsl::make_span(static_cast<std::byte *>(out), static_cast<size_t>(count));
+	return static_cast<sf_count_t>(static_cast<MappedFile *>(input)->Read(span));
+}
+
+static sf_count_t MappedWrite(const void *, sf_count_t, void *)
+{
+	// We only ever open files for reading.
+	return 0;
+}
+
+static sf_count_t MappedTell(void *input)
+{
+	return static_cast<sf_count_t>(static_cast<MappedFile *>(input)->Tell());
+}
+
+/// The virtual I/O table for MappedFiles.
+static SF_VIRTUAL_IO mapped_io{&MappedLength, &MappedSeek, &MappedRead, &MappedWrite, &MappedTell};
+
+SndfileSource::SndfileSource(std::string_view path)
+    : Source{path}, input{this->path}, file{nullptr}, sample_format{SampleFormat::SINT32}
 {
 	this->info.format = 0;
 
-	this->file = sf_open(this->path.c_str(), SFM_READ, &this->info);
+	this->file = sf_open_virtual(&mapped_io, SFM_READ, &this->info, &this->input);
 	if (this->file == nullptr) {
 		throw FileError("sndfile: can't open " + this->path + ": " + sf_strerror(nullptr));
 	}
 
-	// Reserve enough space for a given number of frames.
-	// (Frames being what libsndfile calls multi-channel samples, for some
-	// reason; incidentally, it calls mono-samples items.)
 	assert(0 < this->info.channels);
-	this->buffer.clear();
-	this->buffer.insert(this->buffer.begin(), 4096 * this->info.channels, 0);
+	this->sample_format = this->ChooseSampleFormat();
 }
 
 SndfileSource::~SndfileSource()
@@ -84,40 +120,87 @@ std::uint64_t SndfileSource::Length() const
 	return (this->info.frames);
 }
 
-SndfileSource::DecodeResult SndfileSource::Decode()
+/**
+ * Reads items of type T from a sndfile into a byte span.
+ * @return The number of bytes read.
+ */
+template <typename T, typename Reader> static size_t ReadInto(Reader reader, SNDFILE *file, gsl::span<std::byte> out)
 {
-	auto read = sf_read_int(this->file, &*this->buffer.begin(), this->buffer.size());
+	// The span on our side is addressed as bytes, as the sample length
+	// could vary between files and decoders.  We reinterpret the decoded
+	// bits as bytes; the Sink interprets them in the exact same way once
+	// we tell it how long the samples really are.
+	//
+	// The span had better be suitably aligned for T; spans of whole
+	// samples starting at whole sample offsets into a buffer will be.
+	assert(reinterpret_cast<std::uintptr_t>(out.data()) % alignof(T) == 0);
+	auto *items = reinterpret_cast<T *>(out.data());
 
-	// Have we hit the end of the file?
-	if (read == 0) {
-		return std::make_pair(DecodeState::END_OF_FILE, DecodeVector());
-	}
+	const auto read = reader(file, items, out.size() / sizeof(T));
+	return static_cast<size_t>(read) * sizeof(T);
+}
 
-	// Else, we're good to go (hopefully).
-	//
-	// The buffer on our side is addressed as ints (32-bit), because this is
-	// easier for sndfile.  However, the DecodeVector is addressed as bytes
-	// (8-bit) as the sample length could vary between files and decoders
-	// (from 8-bit up to 32-bit, and maybe even 32-bit float)!
-	//
-	// So, we reinterpret the decoded bits as a vector of bytes, which is
-	// relatively safe--they'll be interpreted by the Sink in the
-	// exact same way once we tell it how long the samples really are.
-	auto *begin = reinterpret_cast<std::byte *>(&*this->buffer.begin());
+SndfileSource::DecodeSpanResult SndfileSource::Decode(gsl::span<std::byte> out)
+{
+	size_t read = 0;
+	switch (this->sample_format) {
+	case SampleFormat::SINT16:
+		read = ReadInto<short>(sf_read_short, this->file, out);
+		break;
+	case SampleFormat::FLOAT32:
+		read = ReadInto<float>(sf_read_float, this->file, out);
+		break;
+	default:
+		read = ReadInto<int>(sf_read_int, this->file, out);
+		break;
+	}
 
-	// The end is 'read' 32-bit items--read*4 bytes--after.
-	auto *end = begin + (read * 4);
+	// Have we hit the end of the file?
+	if (read == 0) return std::make_pair(DecodeState::END_OF_FILE, 0);
 
-	return std::make_pair(DecodeState::DECODING, DecodeVector{begin, end});
+	// Else, we're good to go (hopefully).
+	return std::make_pair(DecodeState::DECODING, read);
 }
 
 SampleFormat SndfileSource::OutputSampleFormat() const
 {
-	// Because we use int-sized reads, assume this corresponds to 32-bit
-	// signed int.
-	// Really, we shouldn't assume int is 32-bit!
+	return this->sample_format;
+}
+
+SampleFormat SndfileSource::ChooseSampleFormat() const
+{
+	// Really, we shouldn't assume short is 16-bit and int is 32-bit!
+	static_assert(sizeof(short) == 2, "sndfile outputs short, which we need to be 2 bytes");
 	static_assert(sizeof(int) == 4, "sndfile outputs int, which we need to be 4 bytes");
-	return SampleFormat::SINT32;
+	static_assert(sizeof(float) == 4, "sndfile outputs float, which we need to be 4 bytes");
+
+	// Reading 16-bit files as shorts halves the bytes we push through the
+	// ring buffer, and float files may as well stay float, as that's what
+	// the device wants anyway.  Anything else goes through ints, which
+	// holds 24-bit PCM without loss.
+	switch (this->info.format & SF_FORMAT_SUBMASK) {
+	case SF_FORMAT_PCM_S8:
+	case SF_FORMAT_PCM_U8:
+	case SF_FORMAT_PCM_16:
+		return SampleFormat::SINT16;
+	case SF_FORMAT_FLOAT:
+	case SF_FORMAT_DOUBLE:
+	case SF_FORMAT_VORBIS:
+		return SampleFormat::FLOAT32;
+	default:
+		return SampleFormat::SINT32;
+	}
+}
+
+bool SndfileSource::PreferFormat(SampleFormat format)
+{
+	if (format == this->sample_format) return true;
+	if (format != SampleFormat::FLOAT32 || this->sample_format != SampleFormat::SINT32) return false;
+
+	// Floats hold 24 bits exactly, but not 32.
+	if ((this->info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_PCM_32) return false;
+	this->sample_format = format;
+	return true;
 }
 
 std::unique_ptr<SndfileSource> SndfileSource::MakeUnique(std::string_view path)
@@ -125,4 +208,19 @@ std::unique_ptr<SndfileSource> SndfileSource::MakeUnique(std::string_view path)
 	return std::make_unique<SndfileSource, std::string_view>(std::move(path));
 }
 
+/* static */ bool SndfileSource::Probe(gsl::span<const std::byte> head)
+{
+	const auto has = [&head](std::size_t offset, std::string_view magic) {
+		if (head.size() < offset + magic.size()) return false;
+		return std::memcmp(head.data() + offset, magic.data(), magic.size()) == 0;
+	};
+
+	// The WAVE and AIFF containers put their size between the two magics.
+	for (const auto riff : {"RIFF", "RIFX", "RF64", "BW64"}) {
+		if (has(0, riff) && has(8, "WAVE")) return true;
+	}
+	if (has(0, "FORM") && (has(8, "AIFF") || has(8, "AIFC"))) return true;
+	return has(0, "fLaC") || has(0, "OggS");
+}
+
 } // namespace Playd::Audio
@@ -18,12 +18,17 @@
 #include <string>
 #include <vector>
 
+#include "../mapped_file.h"
 #include "../sample_format.h"
 #include "../source.h"
 
 namespace Playd::Audio
 {
-/// Audio source for use on files supported by libsndfile.
+/**
+ * Audio source for use on files supported by libsndfile.
+ * libsndfile reads the file through a MappedFile, so that reads ahead of the
+ * decoder happen in the background.
+ */
 class SndfileSource : public Source
 {
 public:
@@ -38,7 +43,9 @@ public:
 	/// Destructs a Sndfile_audio_source.
 	~SndfileSource();
 
-	DecodeResult Decode() override;
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
 
 	std::uint64_t Seek(std::uint64_t position) override;
 
@@ -50,6 +57,16 @@ public:
 
 	SampleFormat OutputSampleFormat() const override;
 
+	/**
+	 * Asks libsndfile to read the file in a sample format from now on.
+	 * This only takes FLOAT32, and only for files that would otherwise be
+	 * read through ints without needing all 32 bits: 16-bit files stay as
+	 * shorts, for the reasons in ChooseSampleFormat().
+	 * @param format The sample format wanted.
+	 * @return Whether the source now outputs @a format.
+	 */
+	bool PreferFormat(SampleFormat format) override;
+
 	/**
 	 * Constructs an Sndfile_audio_source and returns a unique pointer to it.
 	 * @param path The path to the file to load and decode using this
@@ -58,11 +75,25 @@ public:
 	 */
 	static std::unique_ptr<SndfileSource> MakeUnique(std::string_view path);
 
+	/**
+	 * Checks whether the start of a file looks like something libsndfile
+	 * decodes: RIFF, RIFX, RF64 or BW64 WAVE, AIFF, FLAC, or Ogg.
+	 * @param head The start of the file.
+	 * @return Whether libsndfile should be able to decode the file.
+	 */
+	static bool Probe(gsl::span<const std::byte> head);
+
 private:
-	SF_INFO info;  ///< The libsndfile info structure.
-	SNDFILE *file; ///< The libsndfile file structure.
+	MappedFile input;           ///< The file libsndfile reads from.
+	SF_INFO info;               ///< The libsndfile info structure.
+	SNDFILE *file;              ///< The libsndfile file structure.
+	SampleFormat sample_format; ///< The format we ask libsndfile for.
 
-	std::vector<int32_t> buffer; ///< The decoding buffer.
+	/**
+	 * Picks the narrowest output format that loses nothing from the file.
+	 * @return The sample format to read in.
+	 */
+	SampleFormat ChooseSampleFormat() const;
 };
 
 } // namespace Playd::Audio
@@ -0,0 +1,116 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Histogram and CallbackStats classes.
+ * @see audio/stats.h
+ */
+
+#include "stats.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+namespace Playd::Audio
+{
+//
+// Histogram
+//
+
+void Histogram::Record(std::uint64_t value)
+{
+	// Bucket n holds values of bit width n: [2^(n-1), 2^n).
+	const auto bucket = static_cast<std::size_t>(std::bit_width(value));
+	this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	this->sum.fetch_add(value, std::memory_order_relaxed);
+
+	auto old_max = this->max.load(std::memory_order_relaxed);
+	while (old_max < value && !this->max.compare_exchange_weak(old_max, value, std::memory_order_relaxed)) {
+	}
+}
+
+Histogram::Summary Histogram::Summarise() const
+{
+	std::array<std::uint64_t, BUCKETS> counts{};
+	std::uint64_t total = 0;
+	for (std::size_t i = 0; i < BUCKETS; i++) {
+		counts[i] = this->buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	const auto max_value = this->max.load(std::memory_order_relaxed);
+
+	// Bucket bounds can overshoot the real maximum; don't let them.
+	return Summary{total,
+	               std::min(Percentile(counts, total, 50), max_value),
+	               std::min(Percentile(counts, total, 99), max_value),
+	               max_value,
+	               this->sum.load(std::memory_order_relaxed),
+	               counts};
+}
+
+/* static */ std::uint64_t Histogram::Percentile(const std::array<std::uint64_t, BUCKETS> &counts,
+                                                 std::uint64_t total, std::uint64_t percentile)
+{
+	if (total == 0) return 0;
+
+	// The rank of the value we want, rounding up so p100 is the last one.
+	const auto rank = (total * percentile + 99) / 100;
+
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < BUCKETS; i++) {
+		seen += counts[i];
+		if (rank <= seen) return UpperBound(i);
+	}
+	return UINT64_MAX;
+}
+
+//
+// CallbackStats
+//
+
+void CallbackStats::RecordCallback(Clock::time_point start, Clock::time_point end, std::chrono::microseconds period,
+                                   std::size_t silent, bool underrun)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+
+	// The callback should come round once per buffer's worth of audio;
+	// jitter is how far each one strays from that.
+	if (this->last_start != Clock::time_point{}) {
+		const auto interval = duration_cast<microseconds>(start - this->last_start);
+		this->jitter.Record(static_cast<std::uint64_t>(std::chrono::abs(interval - this->last_period).count()));
+	}
+	this->last_start = start;
+	this->last_period = period;
+
+	this->exec.Record(static_cast<std::uint64_t>(duration_cast<microseconds>(end - start).count()));
+
+	this->callbacks.fetch_add(1, std::memory_order_relaxed);
+	this->silent_bytes.fetch_add(silent, std::memory_order_relaxed);
+	if (underrun) this->underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CallbackStats::RecordFill(std::uint64_t percent)
+{
+	this->fill.Record(percent);
+}
+
+CallbackStats::Snapshot CallbackStats::Read() const
+{
+	return Snapshot{this->callbacks.load(std::memory_order_relaxed),
+	                this->underruns.load(std::memory_order_relaxed),
+	                this->silent_bytes.load(std::memory_order_relaxed),
+	                this->jitter.Summarise(),
+	                this->exec.Summarise(),
+	                this->fill.Summarise(),
+	                std::nullopt};
+}
+
+} // namespace Playd::Audio
@@ -0,0 +1,172 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The Histogram and CallbackStats classes.
+ * @see audio/stats.cpp
+ */
+
+#ifndef PLAYD_AUDIO_STATS_H
+#define PLAYD_AUDIO_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace Playd::Audio
+{
+/**
+ * A lock-free histogram of non-negative integers.
+ *
+ * Values fall into power-of-two buckets, so Record() is one count-leading-
+ * zeros and one relaxed increment, and is safe to call from a real-time
+ * thread while another thread reads a Summary.
+ */
+class Histogram
+{
+public:
+	/// One bucket per possible bit width of a value.
+	static constexpr std::size_t BUCKETS = 65;
+
+	/// A point-in-time summary of a Histogram.
+	struct Summary {
+		std::uint64_t count; ///< The number of values recorded.
+		std::uint64_t p50;   ///< Upper bound of the median value.
+		std::uint64_t p99;   ///< Upper bound of the 99th percentile.
+		std::uint64_t max;   ///< The largest value recorded.
+		std::uint64_t sum;   ///< The sum of the values recorded.
+
+		/// The number of values in each bucket; bucket n holds values of
+		/// bit width n, and so of at most UpperBound(n).
+		std::array<std::uint64_t, BUCKETS> buckets;
+	};
+
+	/**
+	 * @param bucket The index of a bucket.
+	 * @return The largest value that falls into the bucket.
+	 */
+	static constexpr std::uint64_t UpperBound(std::size_t bucket)
+	{
+		return (bucket == 0) ? 0 : (UINT64_MAX >> (64 - bucket));
+	}
+
+	/**
+	 * Records one value.
+	 * @param value The value to record.
+	 */
+	void Record(std::uint64_t value);
+
+	/**
+	 * Summarises the values recorded so far.
+	 * The summary is approximate if values are recorded while this runs.
+	 * @return The summary.
+	 */
+	[[nodiscard]] Summary Summarise() const;
+
+private:
+	/**
+	 * Finds the smallest bucket bound below which a percentile falls.
+	 * @param counts The bucket counts.
+	 * @param total The sum of @a counts.
+	 * @param percentile The percentile, from 0 to 100.
+	 * @return The upper bound of the bucket containing the percentile.
+	 */
+	static std::uint64_t Percentile(const std::array<std::uint64_t, BUCKETS> &counts, std::uint64_t total,
+	                                std::uint64_t percentile);
+
+	std::array<std::atomic<std::uint64_t>, BUCKETS> buckets{}; ///< Counts per bucket.
+	std::atomic<std::uint64_t> max{0};                         ///< The largest value.
+	std::atomic<std::uint64_t> sum{0};                         ///< The sum of the values.
+};
+
+/**
+ * Instrumentation for an audio callback.
+ *
+ * The callback records into this as it runs, without locking or allocating;
+ * anyone else can Read() a Snapshot at any time.
+ */
+class CallbackStats
+{
+public:
+	/// A point-in-time copy of a CallbackStats.
+	struct Snapshot {
+		std::uint64_t callbacks;    ///< Number of callbacks so far.
+		std::uint64_t underruns;    ///< Callbacks that ran out of audio.
+		std::uint64_t silent_bytes; ///< Bytes of silence sent to the device.
+		Histogram::Summary jitter;  ///< Callback lateness, in microseconds.
+		Histogram::Summary exec;    ///< Callback run time, in microseconds.
+		Histogram::Summary fill;    ///< Buffer fill at callback, in percent.
+
+		/// How long the last start took to be heard (from the sink being
+		/// started to the first callback with its sound in), once it has
+		/// been; sinks fill this in for themselves.
+		std::optional<std::chrono::microseconds> start_latency;
+	};
+
+	/// Type of the clock used for callback timings.
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * Records one callback.
+	 * This must only be called from the callback thread.
+	 * @param start When the callback started.
+	 * @param end When the callback finished.
+	 * @param period How long the audio the callback produced lasts.
+	 * @param silent_bytes How many of the callback's bytes were silence.
+	 * @param underrun Whether silence was sent while audio was playing.
+	 */
+	void RecordCallback(Clock::time_point start, Clock::time_point end, std::chrono::microseconds period,
+	                    std::size_t silent_bytes, bool underrun);
+
+	/**
+	 * Records the fill level of a buffer the callback read from.
+	 * @param percent How full the buffer was, from 0 to 100.
+	 */
+	void RecordFill(std::uint64_t percent);
+
+	/**
+	 * Copies out the statistics so far.
+	 * @return The snapshot.
+	 */
+	[[nodiscard]] Snapshot Read() const;
+
+private:
+	std::atomic<std::uint64_t> callbacks{0};    ///< Number of callbacks.
+	std::atomic<std::uint64_t> underruns{0};    ///< Number of underruns.
+	std::atomic<std::uint64_t> silent_bytes{0}; ///< Bytes of silence.
+	Histogram jitter;                           ///< Callback lateness.
+	Histogram exec;                             ///< Callback run time.
+	Histogram fill;                             ///< Buffer fill levels.
+
+	/// When the last callback started; only the callback touches this.
+	Clock::time_point last_start{};
+
+	/// How long the last callback's audio lasts; callback-only, too.
+	std::chrono::microseconds last_period{0};
+};
+
+/// How much memory an audio file's buffers take up, as found when asked.
+struct MemoryUse {
+	std::size_t buffers; ///< Bytes in its sink's buffers, between the decoder and the device.
+	std::size_t scratch; ///< Bytes its decoding holds on to, besides what libraries allocate.
+
+	/**
+	 * Adds another file's memory to this one's.
+	 * @param other The other file's memory.
+	 * @return This MemoryUse.
+	 */
+	MemoryUse &operator+=(const MemoryUse &other)
+	{
+		this->buffers += other.buffers;
+		this->scratch += other.scratch;
+		return *this;
+	}
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_STATS_H
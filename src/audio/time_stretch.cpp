@@ -0,0 +1,479 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the TimeStretch and StretchedSource classes.
+ * @see audio/time_stretch.h
+ */
+
+#include "time_stretch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLAYD_STRETCH_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PLAYD_STRETCH_NEON
+#include <arm_neon.h>
+#endif
+
+#include "../errors.h"
+#include "convert.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * Dot product of two runs of floats.
+ * This is most of the stretcher's work, as it matches each block.
+ * @param a The first run.
+ * @param b The second run.
+ * @param n The length of both runs.
+ */
+static float Dot(const float *a, const float *b, std::size_t n)
+{
+	std::size_t i = 0;
+	float sum = 0.0f;
+
+#if defined(PLAYD_STRETCH_SSE2)
+	auto acc0 = _mm_setzero_ps();
+	auto acc1 = _mm_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	auto sums = _mm_add_ps(acc0, acc1);
+	sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+	sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+	sum = _mm_cvtss_f32(sums);
+#elif defined(PLAYD_STRETCH_NEON)
+	auto acc0 = vdupq_n_f32(0.0f);
+	auto acc1 = vdupq_n_f32(0.0f);
+	for (; i + 8 <= n; i += 8) {
+		acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+		acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#endif
+
+	for (; i < n; i++) sum += a[i] * b[i];
+	return sum;
+}
+
+//
+// TimeStretch
+//
+
+TimeStretch::TimeStretch(std::uint8_t channels, std::uint32_t rate)
+    : channels{channels},
+      hop{std::max<std::int64_t>(1, (static_cast<std::int64_t>(rate) * BLOCK_MS) / 2000)},
+      search{hop / 2},
+      speed{1.0},
+      base{0},
+      pending_at{0},
+      prev{0},
+      next{0.0},
+      end{-1},
+      primed{false},
+      made{0}
+{
+	Expects(0 < channels);
+	Expects(0 < rate);
+
+	// A periodic Hann window: each sample's weight and that of the sample
+	// half a block on add up to 1, so blocks that carry straight on from
+	// each other give back their input.
+	const auto block = 2 * this->hop;
+	this->window.resize(static_cast<std::size_t>(block) * channels);
+	for (std::int64_t i = 0; i < block; i++) {
+		const auto w = 0.5 - 0.5 * std::cos(2.0 * std::numbers::pi * static_cast<double>(i) / static_cast<double>(block));
+		std::fill_n(this->window.begin() + i * channels, channels, static_cast<float>(w));
+	}
+
+	this->overlap.resize(static_cast<std::size_t>(this->hop) * channels);
+	this->Reset();
+}
+
+void TimeStretch::SetSpeed(double new_speed)
+{
+	Expects(MIN_SPEED <= new_speed && new_speed <= MAX_SPEED);
+	this->speed = new_speed;
+}
+
+double TimeStretch::Speed() const
+{
+	return this->speed;
+}
+
+void TimeStretch::Push(gsl::span<const float> in)
+{
+	Expects(in.size() % this->channels == 0);
+
+	this->input.insert(this->input.end(), in.begin(), in.end());
+	for (std::size_t i = 0; i < in.size(); i += this->channels) {
+		float sum = 0.0f;
+		for (std::uint8_t c = 0; c < this->channels; c++) sum += in[i + c];
+		this->mono.push_back(sum);
+	}
+}
+
+std::size_t TimeStretch::Pull(gsl::span<float> out)
+{
+	Expects(out.size() % this->channels == 0);
+
+	std::size_t written = 0;
+	while (written < out.size()) {
+		if (this->pending_at == this->pending.size() && !this->Step()) break;
+
+		const auto count = std::min(out.size() - written, this->pending.size() - this->pending_at);
+		std::copy_n(this->pending.begin() + static_cast<std::ptrdiff_t>(this->pending_at), count,
+		            out.begin() + static_cast<std::ptrdiff_t>(written));
+		this->pending_at += count;
+		written += count;
+	}
+	return written / this->channels;
+}
+
+void TimeStretch::Drain()
+{
+	if (0 <= this->end) return;
+	this->end = this->base + static_cast<std::int64_t>(this->mono.size());
+
+	// The last blocks look past the end of the input, so give them
+	// silence to look at.
+	const auto pad = static_cast<std::size_t>(3 * this->hop + 2 * this->search + 1);
+	this->input.resize(this->input.size() + pad * this->channels, 0.0f);
+	this->mono.resize(this->mono.size() + pad, 0.0f);
+}
+
+bool TimeStretch::Done() const
+{
+	if (this->end < 0 || this->pending_at != this->pending.size()) return false;
+	return this->end == 0 || (this->primed && static_cast<double>(this->end) <= this->next);
+}
+
+void TimeStretch::Reset()
+{
+	this->input.clear();
+	this->mono.clear();
+	this->base = 0;
+	this->pending.clear();
+	this->pending_at = 0;
+	this->prev = 0;
+	this->next = 0.0;
+	this->end = -1;
+	this->primed = false;
+	this->made = 0;
+	this->segments.clear();
+	this->segments.push_back({0, 0.0, this->speed});
+}
+
+std::uint64_t TimeStretch::InputAt(std::uint64_t out) const
+{
+	// The first segment always starts at 0, so this never finds the start.
+	const auto after = std::upper_bound(this->segments.begin(), this->segments.end(), out,
+	                                    [](std::uint64_t o, const Segment &s) { return o < s.out; });
+	const auto &s = *std::prev(after);
+	const auto in = s.in + static_cast<double>(out - s.out) * s.speed;
+	return static_cast<std::uint64_t>(std::max(0.0, std::round(in)));
+}
+
+std::size_t TimeStretch::ScratchBytes() const
+{
+	const auto floats = this->window.capacity() + this->input.capacity() + this->mono.capacity() +
+	                    this->overlap.capacity() + this->pending.capacity();
+	return floats * sizeof(float) + this->segments.capacity() * sizeof(Segment);
+}
+
+bool TimeStretch::Step()
+{
+	if (0 <= this->end && static_cast<double>(this->end) <= this->next) return false;
+
+	const auto available = this->base + static_cast<std::int64_t>(this->mono.size());
+	const auto ch = static_cast<std::size_t>(this->channels);
+	const auto half = static_cast<std::size_t>(this->hop) * ch;
+
+	// The first block carries on from a made-up one before it, whose
+	// second half is the start of the input, so the output starts exactly
+	// as the input does.
+	if (!this->primed) {
+		if (available < this->hop) return false;
+		for (std::size_t i = 0; i < half; i++) this->overlap[i] = this->input[i] * this->window[half + i];
+		this->prev = -this->hop;
+		this->primed = true;
+	}
+
+	// At normal speed, blocks carry straight on, and output is input.
+	const auto natural = this->prev + this->hop;
+	const auto straight = this->speed == 1.0;
+	const auto centre = straight ? natural : static_cast<std::int64_t>(std::llround(this->next));
+	const auto lo = straight ? natural : std::max(centre - this->search, this->base);
+	const auto hi = straight ? natural : centre + this->search;
+	if (available < std::max(hi + 2 * this->hop, natural + this->hop)) return false;
+
+	// A change of speed, or catching up with the input after going back
+	// to normal, starts a new stretch of output for InputAt() to follow.
+	const auto at = straight ? static_cast<double>(natural) : this->next;
+	const auto &last = this->segments.back();
+	if (last.speed != this->speed || (straight && this->next != at)) {
+		this->segments.push_back({this->made, at, this->speed});
+	}
+	this->next = at;
+
+	const auto start = lo == hi ? lo : this->BestMatch(natural, lo, hi);
+
+	// Overlap-add the first half of the block onto the second half of
+	// the last one, and keep this one's second half for the next.
+	this->pending.resize(half);
+	const auto *x = this->input.data() + static_cast<std::size_t>(start - this->base) * ch;
+	const auto *w = this->window.data();
+	for (std::size_t i = 0; i < half; i++) this->pending[i] = this->overlap[i] + x[i] * w[i];
+	for (std::size_t i = 0; i < half; i++) this->overlap[i] = x[half + i] * w[half + i];
+	this->pending_at = 0;
+
+	this->prev = start;
+	this->next += static_cast<double>(this->hop) * this->speed;
+	this->made += static_cast<std::uint64_t>(this->hop);
+	this->Compact();
+	return true;
+}
+
+std::int64_t TimeStretch::BestMatch(std::int64_t natural, std::int64_t lo, std::int64_t hi) const
+{
+	const auto n = static_cast<std::size_t>(this->hop);
+	const auto *m = this->mono.data();
+	const auto *want = m + (natural - this->base);
+
+	// The energy under each candidate slides along with it, so only the
+	// correlation needs a full dot product each time.
+	const auto *first = m + (lo - this->base);
+	double energy = Dot(first, first, n);
+	auto best = lo;
+	auto best_score = -std::numeric_limits<double>::infinity();
+	for (auto c = lo; c <= hi; c++) {
+		const auto *candidate = m + (c - this->base);
+		const double corr = Dot(want, candidate, n);
+		const auto score = corr / std::sqrt(std::max(energy, 1e-12));
+		if (best_score < score) {
+			best = c;
+			best_score = score;
+		}
+		const double leaving = candidate[0];
+		const double arriving = candidate[n];
+		energy += arriving * arriving - leaving * leaving;
+	}
+	return best;
+}
+
+void TimeStretch::Compact()
+{
+	// Nothing before the last block's second half, or the earliest place
+	// the next block might start, will be looked at again.
+	const auto earliest = static_cast<std::int64_t>(std::llround(this->next)) - this->search;
+	const auto keep = std::min(this->prev + this->hop, earliest) - this->base;
+
+	// Moving the input down costs, so only do it once a few blocks' worth
+	// has built up.
+	if (keep < 4 * this->hop) return;
+	const auto frames = static_cast<std::ptrdiff_t>(keep);
+	this->input.erase(this->input.begin(), this->input.begin() + frames * this->channels);
+	this->mono.erase(this->mono.begin(), this->mono.begin() + frames);
+	this->base += keep;
+}
+
+//
+// StretchedSource
+//
+
+/* static */ bool StretchedSource::CanStretch(const Source &inner)
+{
+	const auto format = inner.OutputSampleFormat();
+	return CanConvert(format, SampleFormat::FLOAT32) && CanConvert(SampleFormat::FLOAT32, format);
+}
+
+StretchedSource::StretchedSource(std::unique_ptr<Source> inner)
+    : Source{inner->Path()},
+      inner{std::move(inner)},
+      stretch{this->inner->ChannelCount(), this->inner->SampleRate()},
+      stretching{false},
+      position{0},
+      from{0},
+      inner_done{false}
+{
+}
+
+void StretchedSource::SetSpeed(double speed)
+{
+	if (speed != 1.0 && !CanStretch(*this->inner)) throw FileError("can't change the speed of this sample format");
+
+	this->stretch.SetSpeed(speed);
+	if (this->stretching || speed == 1.0) return;
+
+	// Stretching starts from wherever passing through got to, so there's
+	// no jump in the output.
+	this->stretching = true;
+	this->from = this->position;
+	this->stretch.Reset();
+	if (this->inner_done) this->stretch.Drain();
+
+	// The buffers are only needed once stretching, so most sources never
+	// allocate them.
+	this->raw.resize(this->inner->FrameBytes());
+	const auto in_bps = sample_format_bps[static_cast<int>(this->inner->OutputSampleFormat())];
+	this->floats.resize(this->raw.size() / in_bps);
+}
+
+double StretchedSource::Speed() const
+{
+	return this->stretch.Speed();
+}
+
+bool StretchedSource::Stretching() const
+{
+	return this->stretching;
+}
+
+std::uint64_t StretchedSource::InnerPosition(std::uint64_t samples) const
+{
+	if (!this->stretching || samples < this->from) return samples;
+
+	const auto inner_position = this->from + this->stretch.InputAt(samples - this->from);
+	const auto length = this->inner->Length();
+	return length == 0 ? inner_position : std::min(inner_position, length);
+}
+
+StretchedSource::DecodeSpanResult StretchedSource::Decode(gsl::span<std::byte> out)
+{
+	const auto bps = this->BytesPerSample();
+	Expects(out.size() % bps == 0);
+
+	if (!this->stretching) {
+		const auto result = this->inner->Decode(out);
+		this->position += result.second / bps;
+		if (result.first == DecodeState::END_OF_FILE) this->inner_done = true;
+		return result;
+	}
+	if (out.empty()) return std::make_pair(DecodeState::DECODING, 0);
+
+	const auto format = this->inner->OutputSampleFormat();
+	const auto in_bps = sample_format_bps[static_cast<int>(format)];
+	const auto channels = this->ChannelCount();
+	const auto wanted = (out.size() / bps) * channels;
+	if (this->floats.size() < wanted) this->floats.resize(wanted);
+
+	// As with the resampler, keep feeding the stretcher until it has
+	// something to give us.
+	for (;;) {
+		const auto produced = this->stretch.Pull(gsl::span<float>{this->floats}.first(wanted));
+		if (0 < produced) {
+			const auto floats = produced * channels;
+			const gsl::span<const std::byte> converted(reinterpret_cast<const std::byte *>(this->floats.data()),
+			                                           floats * sizeof(float));
+			ConvertSamples(SampleFormat::FLOAT32, format, converted, out.first(produced * bps));
+			return std::make_pair(DecodeState::DECODING, produced * bps);
+		}
+		if (this->inner_done) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+		const auto [state, count] = this->inner->Decode(this->raw);
+		if (0 < count) {
+			const auto mono_count = count / in_bps;
+			const auto in_floats = gsl::span<float>{this->floats}.first(mono_count);
+			const gsl::span<std::byte> converted(reinterpret_cast<std::byte *>(in_floats.data()),
+			                                     mono_count * sizeof(float));
+			ConvertSamples(format, SampleFormat::FLOAT32, gsl::span<const std::byte>{this->raw}.first(count),
+			               converted);
+			this->stretch.Push(in_floats);
+		}
+
+		if (state == DecodeState::END_OF_FILE) {
+			this->stretch.Drain();
+			this->inner_done = true;
+			continue;
+		}
+
+		// The inner source didn't finish a frame this round; neither can we.
+		if (count == 0) return std::make_pair(DecodeState::DECODING, 0);
+	}
+}
+
+std::uint64_t StretchedSource::Seek(std::uint64_t new_position)
+{
+	const auto landed = this->inner->Seek(new_position);
+	this->position = landed;
+	this->inner_done = false;
+
+	// Nothing stretched so far is any use at the new position.  Back at
+	// normal speed, we can go back to passing the source straight through.
+	this->stretching = this->stretch.Speed() != 1.0;
+	this->from = landed;
+	this->stretch.Reset();
+
+	return landed;
+}
+
+std::uint64_t StretchedSource::Length() const
+{
+	return this->inner->Length();
+}
+
+std::uint8_t StretchedSource::ChannelCount() const
+{
+	return this->inner->ChannelCount();
+}
+
+std::uint32_t StretchedSource::SampleRate() const
+{
+	return this->inner->SampleRate();
+}
+
+SampleFormat StretchedSource::OutputSampleFormat() const
+{
+	return this->inner->OutputSampleFormat();
+}
+
+std::optional<CuePoints> StretchedSource::Cues() const
+{
+	return this->inner->Cues();
+}
+
+std::optional<StreamStats> StretchedSource::Streaming() const
+{
+	return this->inner->Streaming();
+}
+
+std::size_t StretchedSource::ScratchBytes() const
+{
+	return this->inner->ScratchBytes() + this->stretch.ScratchBytes() + this->raw.capacity() +
+	       this->floats.capacity() * sizeof(float);
+}
+
+std::uint64_t StretchedSource::SkippedFrames() const
+{
+	return this->inner->SkippedFrames();
+}
+
+ConversionList StretchedSource::Conversions() const
+{
+	auto steps = this->inner->Conversions();
+	if (!this->stretching) return steps;
+
+	const auto format = this->inner->OutputSampleFormat();
+	if (format != SampleFormat::FLOAT32) steps.push_back(DescribeConversion(format, SampleFormat::FLOAT32));
+	steps.emplace_back("stretch");
+	if (format != SampleFormat::FLOAT32) steps.push_back(DescribeConversion(SampleFormat::FLOAT32, format));
+	return steps;
+}
+
+} // namespace Playd::Audio
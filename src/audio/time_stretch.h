@@ -0,0 +1,250 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The TimeStretch and StretchedSource classes.
+ * @see audio/time_stretch.cpp
+ */
+
+#ifndef PLAYD_AUDIO_TIME_STRETCH_H
+#define PLAYD_AUDIO_TIME_STRETCH_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "rt_memory.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * A streaming WSOLA time-stretcher for packed FLOAT32 audio.
+ *
+ * This plays audio faster or slower without changing its pitch.  Output is
+ * built from overlapping, Hann-windowed blocks of input, BLOCK long and half
+ * a block apart; each block is taken from around where the speed says it
+ * should be, nudged by up to half a block of its own either way to wherever
+ * best carries on the waveform of the block before (by normalised
+ * cross-correlation of the channels' sum), so that the blocks add up without
+ * phasing.  At a speed of 1, blocks always carry straight on, and the output
+ * is the input.
+ *
+ * Input goes in with Push(), and output comes out with Pull(); as with the
+ * Resampler, the two don't need to line up.
+ */
+class TimeStretch
+{
+public:
+	/// The slowest speed a TimeStretch can play at.
+	static constexpr double MIN_SPEED = 0.5;
+
+	/// The fastest speed a TimeStretch can play at.
+	static constexpr double MAX_SPEED = 2.0;
+
+	/// How long each block of input is, in milliseconds.
+	static constexpr std::uint32_t BLOCK_MS = 20;
+
+	/**
+	 * Constructs a TimeStretch, at a speed of 1.
+	 * @param channels The number of interleaved channels.
+	 * @param rate The sample rate, in Hz.
+	 */
+	TimeStretch(std::uint8_t channels, std::uint32_t rate);
+
+	/**
+	 * Changes the speed, from the next block on.
+	 * * Precondition: @a speed is between MIN_SPEED and MAX_SPEED.
+	 * @param speed How much faster than normal to play; 1 is normal.
+	 */
+	void SetSpeed(double speed);
+
+	/// @return How much faster than normal the TimeStretch is playing.
+	[[nodiscard]] double Speed() const;
+
+	/**
+	 * Adds input samples to the stretcher.
+	 * @param in Packed input samples; must be a whole number of samples.
+	 */
+	void Push(gsl::span<const float> in);
+
+	/**
+	 * Produces as many output samples as the input so far allows.
+	 * @param out Space for packed output samples.
+	 * @return The number of (multi-channel) samples written into @a out.
+	 */
+	std::size_t Pull(gsl::span<float> out);
+
+	/**
+	 * Lets the last of the input out of the stretcher; call this once the
+	 * input has ended.
+	 */
+	void Drain();
+
+	/// @return Whether the stretcher has been drained and has nothing left.
+	[[nodiscard]] bool Done() const;
+
+	/// Forgets all input, ready to stretch from a new position.
+	void Reset();
+
+	/**
+	 * Works out which input sample an output sample came from.
+	 * This is exact at a speed of 1, and otherwise within a block.
+	 * @param out How many samples since the last Reset() the output sample
+	 *   is.
+	 * @return How many samples since the last Reset() its input sample is.
+	 */
+	[[nodiscard]] std::uint64_t InputAt(std::uint64_t out) const;
+
+	/// @return How much memory the stretcher's buffers take up, in bytes.
+	[[nodiscard]] std::size_t ScratchBytes() const;
+
+private:
+	/// Where the output starts following the input at a new speed.
+	struct Segment {
+		std::uint64_t out; ///< The first output sample of the segment.
+		double in;         ///< The input sample it came from.
+		double speed;      ///< How fast the input goes by.
+	};
+
+	/**
+	 * Works out one block of output into the pending buffer, if there is
+	 * enough input to.
+	 * @return Whether there was.
+	 */
+	bool Step();
+
+	/**
+	 * Finds the block of input that best carries on the one before.
+	 * @param natural Where the block before would carry straight on.
+	 * @param lo The earliest block to consider.
+	 * @param hi The latest block to consider.
+	 * @return Where the best block starts.
+	 */
+	[[nodiscard]] std::int64_t BestMatch(std::int64_t natural, std::int64_t lo, std::int64_t hi) const;
+
+	/// Drops input that no block will need again.
+	void Compact();
+
+	std::uint8_t channels; ///< The number of interleaved channels.
+	std::int64_t hop;      ///< How far apart output blocks are: half a block.
+	std::int64_t search;   ///< How far a block may move to match the one before.
+	double speed;          ///< How much faster than normal to play.
+
+	RtVector<float> window; ///< The Hann window, over a block of interleaved samples.
+	RtVector<float> input;  ///< Unused input, interleaved.
+	RtVector<float> mono;   ///< The same input, summed across channels.
+	std::int64_t base;      ///< Which input sample input[0] is.
+
+	RtVector<float> overlap; ///< The second half of the last block, windowed.
+	RtVector<float> pending; ///< Output worked out but not yet pulled.
+	std::size_t pending_at;  ///< How much of pending has been pulled, in floats.
+
+	std::int64_t prev;   ///< Where the last block started.
+	double next;         ///< Where the next block should start, at this speed.
+	std::int64_t end;    ///< How long the input is, once drained; -1 before.
+	bool primed;         ///< Whether the first block has been set up.
+	std::uint64_t made;  ///< How many samples have been output since Reset().
+
+	std::vector<Segment> segments; ///< The speeds the output has followed.
+};
+
+/**
+ * A Source that can play another Source faster or slower.
+ *
+ * Every BasicAudio wraps its source in one of these.  At a speed of 1, until
+ * the speed first changes, it passes the source straight through, costing
+ * nothing; from then until the next seek, its output goes through a
+ * TimeStretch (at FLOAT32, converting either way) and is in samples of its
+ * own, which InnerPosition() maps back to the file's.
+ */
+class StretchedSource : public Source
+{
+public:
+	/**
+	 * Whether a source can be stretched.
+	 * Its format needs to convert to and from FLOAT32, in which the
+	 * stretching is done.
+	 * @param inner The source.
+	 * @return Whether StretchedSource can stretch it.
+	 */
+	static bool CanStretch(const Source &inner);
+
+	/**
+	 * Constructs a StretchedSource, at a speed of 1.
+	 * @param inner The source to stretch.
+	 */
+	explicit StretchedSource(std::unique_ptr<Source> inner);
+
+	/**
+	 * Changes the speed, from the next sample decoded on.
+	 * * Precondition: @a speed is between TimeStretch::MIN_SPEED and
+	 *     TimeStretch::MAX_SPEED.
+	 * @param speed How much faster than normal to play; 1 is normal.
+	 * @exception FileError if the speed isn't 1, and the source can't be
+	 *   stretched.
+	 */
+	void SetSpeed(double speed);
+
+	/// @return How much faster than normal the source is playing.
+	[[nodiscard]] double Speed() const;
+
+	/**
+	 * Whether this source's samples are its own, rather than the inner
+	 * source's.
+	 * @return True if the source has been stretched since the last seek.
+	 */
+	[[nodiscard]] bool Stretching() const;
+
+	/**
+	 * Works out where in the inner source one of this source's samples was.
+	 * @param samples The position, in this source's samples (which, as with
+	 *   any source, count on from wherever the last seek landed).
+	 * @return The position, in the inner source's samples.
+	 */
+	[[nodiscard]] std::uint64_t InnerPosition(std::uint64_t samples) const;
+
+	using Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override;
+
+	std::uint64_t Seek(std::uint64_t position) override;
+
+	std::uint64_t Length() const override;
+
+	std::uint8_t ChannelCount() const override;
+
+	std::uint32_t SampleRate() const override;
+
+	SampleFormat OutputSampleFormat() const override;
+
+	std::optional<CuePoints> Cues() const override;
+
+	std::optional<StreamStats> Streaming() const override;
+
+	[[nodiscard]] std::size_t ScratchBytes() const override;
+
+	[[nodiscard]] std::uint64_t SkippedFrames() const override;
+
+	[[nodiscard]] ConversionList Conversions() const override;
+
+private:
+	std::unique_ptr<Source> inner; ///< The source being stretched.
+	TimeStretch stretch;           ///< The stretcher doing the work.
+	bool stretching;               ///< Whether output goes through the stretcher.
+	std::uint64_t position;        ///< Where the inner source is, if not stretching.
+	std::uint64_t from;            ///< Where stretching started, in both sources' samples.
+	RtVector<std::byte> raw;       ///< Samples decoded by the inner source.
+	RtVector<float> floats;        ///< Samples on their way into or out of the stretcher.
+	bool inner_done;               ///< Whether the inner source has ended.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_TIME_STRETCH_H
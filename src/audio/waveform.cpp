@@ -0,0 +1,333 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of waveform overviews, and the WaveformCache class.
+ * @see audio/waveform.h
+ */
+
+#include "waveform.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "../errors.h"
+#include "convert.h"
+#include "metadata_cache.h"
+#include "sample_format.h"
+#include "source.h"
+
+namespace Playd::Audio
+{
+static_assert(sizeof(WaveformBucket) == WAVEFORM_BUCKET_BYTES, "buckets are cached as they are in memory");
+
+/// The first bytes of every cache entry; the last is the format version.
+static constexpr std::string_view MAGIC{"playdwf\x01", 8};
+
+/*
+ * Each cache entry is laid out as follows, in native byte order:
+ *
+ *   magic
+ *   u64 mtime, u64 file size, u32 bucket count, u16 path size
+ *   path bytes, then bucket count (i16 min, i16 max, i16 rms)
+ */
+
+/// The size of an entry, not counting its path or buckets.
+static constexpr std::size_t ENTRY_HEADER = MAGIC.size() + 8 + 8 + 4 + 2;
+
+/// The fewest sample frames worth starting another thread for.
+static constexpr std::uint64_t MIN_THREAD_FRAMES = 1U << 20U;
+
+/// The sample frames converted to floating point at a time.
+static constexpr std::size_t CHUNK_FRAMES = 4096;
+
+/// Appends a value's bytes to a string.
+template <typename T>
+static void Put(std::string &out, T value)
+{
+	out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+/// Reads a value's bytes from a string, and advances past them.
+template <typename T>
+static T Get(std::string_view &in)
+{
+	T value;
+	std::memcpy(&value, in.data(), sizeof value);
+	in.remove_prefix(sizeof value);
+	return value;
+}
+
+/**
+ * Converts a level to a bucket's fixed point.
+ * @param level The level, full scale at 1.
+ * @return The level, full scale at 32767.
+ */
+static std::int16_t FixLevel(double level)
+{
+	return static_cast<std::int16_t>(std::lround(std::clamp(level, -1.0, 1.0) * INT16_MAX));
+}
+
+/**
+ * Adds one sample frame to a bucket's totals.
+ * @param totals The totals.
+ * @param frame The frame's samples, one per channel.
+ */
+static void Accumulate(WaveformBuilder::Totals &totals, gsl::span<const float> frame)
+{
+	for (const auto v : frame) {
+		totals.min = std::min(totals.min, v);
+		totals.max = std::max(totals.max, v);
+		totals.power += static_cast<double>(v) * v;
+	}
+	totals.n += frame.size();
+}
+
+/**
+ * Finishes a bucket.
+ * @param totals The bucket's totals.
+ * @return The bucket, or silence if it had no samples.
+ */
+static WaveformBucket ToBucket(const WaveformBuilder::Totals &totals)
+{
+	if (totals.n == 0) return WaveformBucket{};
+	const auto rms = std::sqrt(totals.power / static_cast<double>(totals.n));
+	return WaveformBucket{FixLevel(totals.min), FixLevel(totals.max), FixLevel(rms)};
+}
+
+/**
+ * Decodes one run of buckets of a waveform overview.
+ * Bucket b holds the samples s for which s * total / length is b.
+ * @param source The source, which is moved to the start of the run.
+ * @param length The length of the file, in samples.
+ * @param total The number of buckets in the whole overview.
+ * @param first The first bucket of the run.
+ * @param out The buckets of the run, all of which are filled in.
+ */
+static void DecodeRun(Source &source, std::uint64_t length, std::uint64_t total, std::uint64_t first,
+                      gsl::span<WaveformBucket> out)
+{
+	const auto format = source.OutputSampleFormat();
+	if (!CanConvert(format, SampleFormat::FLOAT32)) throw FileError("can't overview this sample format");
+	const std::size_t channels = source.ChannelCount();
+	const auto bps = source.BytesPerSample();
+
+	const auto start_of = [length, total](std::uint64_t bucket) { return ((bucket * length) + total - 1) / total; };
+	const auto begin = start_of(first);
+	const auto end = start_of(first + out.size());
+	auto bucket = std::size_t{0};
+	auto next = start_of(first + 1);
+
+	// Seeks needn't land exactly; anything before the run is skipped.
+	auto pos = first == 0 ? 0 : source.Seek(begin);
+
+	std::vector<WaveformBuilder::Totals> acc(out.size());
+	std::vector<std::byte> raw(CHUNK_FRAMES * bps);
+	std::vector<float> floats(CHUNK_FRAMES * channels);
+	while (pos < end) {
+		const auto [state, bytes] = source.Decode(raw);
+		const auto frames = bytes / bps;
+		ConvertSamples(format, SampleFormat::FLOAT32, gsl::span<const std::byte>{raw}.first(bytes),
+		               gsl::span<std::byte>{reinterpret_cast<std::byte *>(floats.data()),
+		                                    frames * channels * sizeof(float)});
+
+		for (std::size_t f = 0; f < frames && pos < end; f++, pos++) {
+			if (pos < begin) continue;
+			while (next <= pos) {
+				bucket++;
+				next = start_of(first + bucket + 1);
+			}
+
+			Accumulate(acc[bucket], gsl::span<const float>{floats}.subspan(f * channels, channels));
+		}
+		if (state == Source::DecodeState::END_OF_FILE) break;
+	}
+
+	for (std::size_t i = 0; i < out.size(); i++) {
+		if (acc[i].n != 0) out[i] = ToBucket(acc[i]);
+	}
+}
+
+Waveform ComputeWaveform(const SourceOpenFn &open, std::uint32_t buckets, unsigned threads)
+{
+	Expects(0 < buckets && buckets <= MAX_WAVEFORM_BUCKETS);
+
+	// The first run decodes from the source we find the length with.
+	auto probe = open();
+	const auto length = probe->Length();
+	Waveform waveform(buckets);
+	if (length == 0) return waveform;
+
+	// Short files aren't worth the threads.
+	const auto most = std::min<std::uint64_t>({threads, buckets, length / MIN_THREAD_FRAMES});
+	const auto runs = std::max<std::uint64_t>(most, 1);
+
+	std::vector<std::exception_ptr> errors(runs);
+	auto run = [&](std::uint64_t r, std::unique_ptr<Source> source) {
+		try {
+			if (source == nullptr) source = open();
+			const auto from = r * buckets / runs;
+			const auto to = (r + 1) * buckets / runs;
+			DecodeRun(*source, length, buckets, from, gsl::span{waveform}.subspan(from, to - from));
+		} catch (...) {
+			// We can't throw across threads, so throw again when joined.
+			errors[r] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(runs - 1);
+	for (std::uint64_t r = 1; r < runs; r++) workers.emplace_back(run, r, nullptr);
+	run(0, std::move(probe));
+	for (auto &worker : workers) worker.join();
+
+	for (const auto &error : errors) {
+		if (error) std::rethrow_exception(error);
+	}
+	return waveform;
+}
+
+//
+// WaveformBuilder
+//
+
+WaveformBuilder::WaveformBuilder(std::uint64_t length, std::uint32_t buckets)
+    : length{length}, position{0}, totals(buckets)
+{
+	Expects(0 < buckets && buckets <= MAX_WAVEFORM_BUCKETS);
+}
+
+void WaveformBuilder::Add(gsl::span<const float> samples, std::uint8_t channels)
+{
+	Expects(0 < channels && samples.size() % channels == 0);
+	if (this->length == 0) return;
+
+	// Sample s goes in the last bucket starting at or before it, which is
+	// bucket s * buckets / length.
+	const auto buckets = this->totals.size();
+	for (std::size_t f = 0; f < samples.size(); f += channels, this->position++) {
+		const auto bucket = std::min<std::uint64_t>(this->position * buckets / this->length, buckets - 1);
+		Accumulate(this->totals[bucket], samples.subspan(f, channels));
+	}
+}
+
+Waveform WaveformBuilder::Finish() const
+{
+	Waveform waveform;
+	waveform.reserve(this->totals.size());
+	for (const auto &totals : this->totals) waveform.push_back(ToBucket(totals));
+	return waveform;
+}
+
+std::string PackWaveform(const Waveform &waveform)
+{
+	std::string out;
+	out.reserve(waveform.size() * WAVEFORM_BUCKET_BYTES);
+	for (const auto &bucket : waveform) {
+		for (const auto level : {bucket.min, bucket.max, bucket.rms}) {
+			const auto bits = static_cast<std::uint16_t>(level);
+			out.push_back(static_cast<char>(bits >> 8U));
+			out.push_back(static_cast<char>(bits & 0xFFU));
+		}
+	}
+	return out;
+}
+
+//
+// WaveformCache
+//
+
+WaveformCache::WaveformCache(const std::string &dir) : dir{dir}
+{
+	std::error_code ec;
+	std::filesystem::create_directories(this->dir, ec);
+	if (ec) throw ConfigError("can't make waveform cache " + dir + ": " + ec.message());
+}
+
+std::filesystem::path WaveformCache::EntryPath(const std::string &path, std::uint32_t buckets) const
+{
+	std::array<char, 17> hash{};
+	const auto [end, ec] = std::to_chars(hash.begin(), hash.end(), std::hash<std::string>{}(path), 16);
+	return this->dir / (std::string{hash.data(), end} + "-" + std::to_string(buckets) + ".wf");
+}
+
+std::optional<Waveform> WaveformCache::Find(const std::string &path, std::uint32_t buckets) const
+{
+	const auto key = MetadataCache::KeyOf(path);
+	if (!key) return std::nullopt;
+
+	std::ifstream in{this->EntryPath(path, buckets), std::ios::binary};
+	if (!in) return std::nullopt;
+	const std::string raw{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+
+	std::string_view rest{raw};
+	if (rest.size() < ENTRY_HEADER || rest.substr(0, MAGIC.size()) != MAGIC) return std::nullopt;
+	rest.remove_prefix(MAGIC.size());
+
+	// A file that has changed since may not have the same audio in it.
+	const MetadataCache::Key stored{Get<std::uint64_t>(rest), Get<std::uint64_t>(rest)};
+	const auto count = Get<std::uint32_t>(rest);
+	const auto path_size = Get<std::uint16_t>(rest);
+	if (stored != *key || count != buckets) return std::nullopt;
+	if (rest.size() != path_size + (std::size_t{count} * WAVEFORM_BUCKET_BYTES)) return std::nullopt;
+	if (rest.substr(0, path_size) != path) return std::nullopt;
+	rest.remove_prefix(path_size);
+
+	Waveform waveform(count);
+	std::memcpy(waveform.data(), rest.data(), rest.size());
+	return waveform;
+}
+
+void WaveformCache::Store(const std::string &path, const Waveform &waveform) const
+{
+	const auto key = MetadataCache::KeyOf(path);
+	if (!key || UINT16_MAX < path.size()) return;
+
+	std::string out;
+	out.reserve(ENTRY_HEADER + path.size() + (waveform.size() * WAVEFORM_BUCKET_BYTES));
+	out.append(MAGIC);
+	Put(out, key->mtime);
+	Put(out, key->size);
+	Put(out, static_cast<std::uint32_t>(waveform.size()));
+	Put(out, static_cast<std::uint16_t>(path.size()));
+	out.append(path);
+	out.append(reinterpret_cast<const char *>(waveform.data()), waveform.size() * WAVEFORM_BUCKET_BYTES);
+
+	// Write the entry beside the old one, then swap it in, so that nobody
+	// ever reads half of an entry.
+	const auto entry = this->EntryPath(path, static_cast<std::uint32_t>(waveform.size()));
+	auto temp = entry;
+	temp += ".new";
+	{
+		std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+		file.write(out.data(), static_cast<std::streamsize>(out.size()));
+		if (!file) {
+			Debug() << "waveform cache: couldn't store" << path << std::endl;
+			return;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(temp, entry, ec);
+	if (ec) Debug() << "waveform cache: couldn't store" << path << std::endl;
+}
+
+} // namespace Playd::Audio
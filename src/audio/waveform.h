@@ -0,0 +1,178 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of waveform overviews, and the WaveformCache class.
+ * @see audio/waveform.cpp
+ */
+
+#ifndef PLAYD_AUDIO_WAVEFORM_H
+#define PLAYD_AUDIO_WAVEFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "source.h"
+
+namespace Playd::Audio
+{
+/**
+ * The peaks of one stretch of a waveform overview.
+ * Levels are full scale at 32767, across all channels.
+ */
+struct WaveformBucket {
+	std::int16_t min; ///< The lowest sample.
+	std::int16_t max; ///< The highest sample.
+	std::int16_t rms; ///< The root-mean-square level.
+
+	/// Buckets are equal if all of their fields are.
+	bool operator==(const WaveformBucket &) const = default;
+};
+
+/// A waveform overview: the whole of a file, cut into equal buckets.
+using Waveform = std::vector<WaveformBucket>;
+
+/// The most buckets a waveform overview can have.
+/// This keeps a packed overview well inside one 64 KiB binary frame.
+constexpr std::uint32_t MAX_WAVEFORM_BUCKETS = 8192;
+
+/// The size of a packed WaveformBucket, in bytes.
+constexpr std::size_t WAVEFORM_BUCKET_BYTES = 6;
+
+/// Type of functions opening a fresh source over the file to overview.
+using SourceOpenFn = std::function<std::unique_ptr<Source>()>;
+
+/**
+ * Works out a file's waveform overview, in one pass over the whole file.
+ *
+ * The file is split into as many runs of buckets as there are threads, and
+ * each thread decodes its run from a source of its own; the sources are
+ * only used here, so whatever is playing the file carries on undisturbed.
+ *
+ * * Precondition: 0 < @a buckets <= MAX_WAVEFORM_BUCKETS.
+ *
+ * @param open Opens the file; this is called once per thread, and must be
+ *   safe to call from any thread.
+ * @param buckets The number of buckets.
+ * @param threads The most threads to decode with.
+ * @return The overview.
+ * @exception FileError if the file can't be opened or decoded.
+ */
+Waveform ComputeWaveform(const SourceOpenFn &open, std::uint32_t buckets, unsigned threads);
+
+/**
+ * Works out a waveform overview from samples decoded for something else.
+ *
+ * This is for callers that decode a whole file anyway (to analyse it, say),
+ * and can find the overview on the way, rather than in a pass of its own.
+ * Buckets are cut just as ComputeWaveform() cuts them.
+ */
+class WaveformBuilder
+{
+public:
+	/// Running totals for one bucket, as it's decoded.
+	struct Totals {
+		float min = std::numeric_limits<float>::max();    ///< The lowest sample so far.
+		float max = std::numeric_limits<float>::lowest(); ///< The highest sample so far.
+		double power = 0.0;                               ///< The sum of squares so far.
+		std::uint64_t n = 0;                              ///< The samples so far.
+	};
+
+	/**
+	 * Constructs a WaveformBuilder.
+	 * * Precondition: 0 < @a buckets <= MAX_WAVEFORM_BUCKETS.
+	 * @param length The length of the file, in samples; anything decoded
+	 *   past it goes in the last bucket.
+	 * @param buckets The number of buckets.
+	 */
+	WaveformBuilder(std::uint64_t length, std::uint32_t buckets);
+
+	/**
+	 * Adds the next samples of the file.
+	 * @param samples Packed FLOAT32 samples; a whole number of samples.
+	 * @param channels The number of interleaved channels.
+	 */
+	void Add(gsl::span<const float> samples, std::uint8_t channels);
+
+	/// @return The overview of everything added so far.
+	[[nodiscard]] Waveform Finish() const;
+
+private:
+	std::uint64_t length;       ///< The length of the file, in samples.
+	std::uint64_t position;     ///< The samples added so far.
+	std::vector<Totals> totals; ///< The totals for each bucket.
+};
+
+/**
+ * Packs a waveform overview for sending to clients.
+ * Each bucket is its minimum, maximum and RMS level, each a big-endian
+ * signed 16-bit integer.
+ * @param waveform The overview.
+ * @return The packed overview, WAVEFORM_BUCKET_BYTES per bucket.
+ */
+std::string PackWaveform(const Waveform &waveform);
+
+/**
+ * A persistent cache of waveform overviews.
+ *
+ * Overviews take a full pass over a file to work out, but never change
+ * unless the file does, so they are kept in a directory, one file for each
+ * path and bucket count.  As with MetadataCache, entries are keyed by the
+ * file's modification time and size, and are in native byte order.
+ */
+class WaveformCache
+{
+public:
+	/**
+	 * Opens a cache directory, creating it if it doesn't exist.
+	 * @param dir The path to the directory.
+	 * @exception ConfigError if the directory can't be made.
+	 */
+	explicit WaveformCache(const std::string &dir);
+
+	/**
+	 * Looks up an overview.
+	 * @param path The path to the file.
+	 * @param buckets The number of buckets.
+	 * @return The overview, if there is one and the file hasn't changed
+	 *   since it was stored.
+	 */
+	[[nodiscard]] std::optional<Waveform> Find(const std::string &path, std::uint32_t buckets) const;
+
+	/**
+	 * Stores an overview, replacing any older one.
+	 * Failing to write the cache isn't fatal; the overview just needs
+	 * working out again next time.
+	 * @param path The path to the file.
+	 * @param waveform The overview.
+	 */
+	void Store(const std::string &path, const Waveform &waveform) const;
+
+private:
+	/**
+	 * Works out where an overview lives in the cache.
+	 * Different paths may share an entry; entries hold their paths, so
+	 * that they can tell.
+	 * @param path The path to the file.
+	 * @param buckets The number of buckets.
+	 * @return The path to the entry.
+	 */
+	[[nodiscard]] std::filesystem::path EntryPath(const std::string &path, std::uint32_t buckets) const;
+
+	std::filesystem::path dir; ///< The cache directory.
+};
+
+} // namespace Playd::Audio
+
+#endif // PLAYD_AUDIO_WAVEFORM_H
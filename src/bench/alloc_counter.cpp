@@ -0,0 +1,79 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of the heap allocation counter, and the operator new and delete
+ * it counts through.
+ * @see bench/alloc_counter.h
+ */
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// GCC can't see that our operator new is malloc underneath, and warns about
+// every new/delete pair it inlines.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+/// Room at the start of each allocation for its size, which keeps the rest
+/// as aligned as malloc's.
+constexpr std::size_t ALLOCATION_HEADER = alignof(std::max_align_t);
+
+std::atomic<std::uint64_t> allocations{0};     ///< Allocations since startup.
+std::atomic<std::uint64_t> allocated_bytes{0}; ///< Bytes allocated since startup.
+std::atomic<std::uint64_t> heap_bytes{0};      ///< Bytes allocated and not freed.
+} // namespace
+
+void *operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	heap_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (auto *p = static_cast<std::byte *>(std::malloc(ALLOCATION_HEADER + size))) {
+		*reinterpret_cast<std::size_t *>(p) = size;
+		return p + ALLOCATION_HEADER;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	if (p == nullptr) return;
+
+	auto *base = static_cast<std::byte *>(p) - ALLOCATION_HEADER;
+	heap_bytes.fetch_sub(*reinterpret_cast<std::size_t *>(base), std::memory_order_relaxed);
+	std::free(base);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+namespace Playd::Bench
+{
+std::uint64_t Allocations() noexcept
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+std::uint64_t AllocatedBytes() noexcept
+{
+	return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+std::uint64_t HeapBytes() noexcept
+{
+	return heap_bytes.load(std::memory_order_relaxed);
+}
+
+} // namespace Playd::Bench
@@ -0,0 +1,34 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the heap allocation counter.
+ *
+ * Linking alloc_counter.cpp into a program replaces its operator new and
+ * delete with ones that count every allocation and free; the functions here
+ * read the counts.  The benchmarks all link it, as does playd itself when
+ * built WITH_ALLOCATION_COUNTS.
+ *
+ * @see bench/alloc_counter.cpp
+ */
+
+#ifndef PLAYD_BENCH_ALLOC_COUNTER_H
+#define PLAYD_BENCH_ALLOC_COUNTER_H
+
+#include <cstdint>
+
+namespace Playd::Bench
+{
+/// @return The heap allocations made through operator new since startup.
+std::uint64_t Allocations() noexcept;
+
+/// @return The bytes allocated through operator new since startup.
+std::uint64_t AllocatedBytes() noexcept;
+
+/// @return The bytes allocated through operator new, and not yet freed.
+std::uint64_t HeapBytes() noexcept;
+
+} // namespace Playd::Bench
+
+#endif // PLAYD_BENCH_ALLOC_COUNTER_H
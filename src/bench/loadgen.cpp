@@ -0,0 +1,793 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Network load generator for playd.
+ *
+ * This opens many client connections to a running playd, waits for each to
+ * have its initial responses, then sends a weighted mix of `pos`, `dump`,
+ * `play` and `stop` commands at a fixed total rate, spread round-robin over
+ * the clients.  It reports how long each command took to be acknowledged,
+ * and how far apart the clients heard each broadcast (the time from the
+ * first client hearing it to the last), as percentiles.  Given playd's
+ * metrics port, it also reports how many heap allocations playd made while
+ * under load, if playd was built to count them.
+ *
+ * Everything runs on one libuv loop, so the load generator needs to run on
+ * a different machine (or at least a different core) from playd to measure
+ * anything but itself.
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <uv.h>
+
+#include "percentile.h"
+
+namespace Playd::Bench
+{
+/// Type of the clock used for all timings.
+using Clock = std::chrono::steady_clock;
+
+/// The option that sets how many clients connect.
+constexpr std::string_view CLIENTS_OPTION{"--clients="};
+
+/// The option that sets how many commands are sent each second, in total.
+constexpr std::string_view RATE_OPTION{"--rate="};
+
+/// The option that sets how long commands are sent for.
+constexpr std::string_view SECONDS_OPTION{"--seconds="};
+
+/// The option that sets the weights of the command mix.
+constexpr std::string_view MIX_OPTION{"--mix="};
+
+/// The option that loads a file before the load starts.
+constexpr std::string_view LOAD_OPTION{"--load="};
+
+/// The option that scrapes playd's metrics for its allocation counts.
+constexpr std::string_view METRICS_OPTION{"--metrics="};
+
+/// The commands in the mix, in the order --mix weights them.
+constexpr std::string_view COMMANDS[]{"pos 0", "dump", "play", "stop"};
+
+/// How many clients start connecting on each tick, so playd's accept
+/// backlog isn't swamped.
+constexpr std::size_t CONNECTS_PER_TICK = 64;
+
+/// How often the load generator sends, in milliseconds.
+constexpr std::uint64_t TICK_MS = 1;
+
+/// How long to wait for the last acknowledgements once sending has stopped.
+constexpr std::chrono::seconds DRAIN_TIMEOUT{5};
+
+/// How the load generator was asked to run.
+struct Options {
+	std::string host;                               ///< playd's host.
+	std::string port;                               ///< playd's port.
+	std::size_t clients = 1000;                     ///< How many clients connect.
+	std::uint64_t rate = 10000;                     ///< How many commands are sent each second.
+	std::uint64_t seconds = 10;                     ///< How long commands are sent for.
+	std::vector<std::uint32_t> mix{70, 10, 10, 10}; ///< Weights of COMMANDS.
+	std::optional<std::string> load;                ///< A file to load first, if any.
+	std::optional<std::string> metrics;             ///< playd's metrics port, if scraping.
+};
+
+/// How far a run has got.
+enum class Phase : std::uint8_t {
+	CONNECTING, ///< Clients are connecting, and getting their initial responses.
+	LOADING,    ///< The first client is loading a file.
+	SENDING,    ///< Commands are being sent.
+	DRAINING,   ///< Waiting for the last acknowledgements.
+	DONE,       ///< Closing down.
+};
+
+/// A broadcast, as heard by every client.
+struct Broadcast {
+	std::string line;        ///< The broadcast, as the first client heard it.
+	Clock::time_point first; ///< When the first client heard it.
+	Clock::time_point last;  ///< When the last client (so far) heard it.
+	std::size_t heard;       ///< How many clients have heard it.
+};
+
+class LoadGen;
+
+/// One client connection, and what it's waiting to hear.
+struct Client {
+	LoadGen *gen;                          ///< The load generator.
+	std::size_t index;                     ///< The client's index, from 0.
+	uv_tcp_t tcp;                          ///< The connection.
+	uv_connect_t connector;                ///< The connection request.
+	bool open = false;                     ///< Whether tcp needs closing.
+	bool ready = false;                    ///< Whether the initial responses are in.
+	std::string partial;                   ///< The start of a line not yet finished.
+	std::deque<Clock::time_point> waiting; ///< When each unacknowledged command was sent.
+	std::size_t broadcasts = 0;            ///< How many broadcasts this client has heard.
+};
+
+/// A command on its way to playd; freed once written.
+struct Write {
+	uv_write_t req;   ///< The write request.
+	std::string text; ///< The command, which must live until written.
+};
+
+/// A connection scraping playd's metrics.
+struct Scrape {
+	uv_getaddrinfo_t resolver; ///< Resolves the host, synchronously.
+	uv_tcp_t tcp;              ///< The connection.
+	uv_connect_t connector;    ///< The connection request.
+	uv_write_t writer;         ///< The request's write.
+	std::string request;       ///< The HTTP request.
+	std::string response;      ///< The HTTP response, so far.
+	std::string read_buf;      ///< Where libuv reads into.
+	bool failed = false;       ///< Whether the scrape went wrong.
+};
+
+/// The results of a run.
+struct Result {
+	std::vector<Clock::duration> acks;  ///< Latency from sending a command to its ACK.
+	std::vector<Clock::duration> skews; ///< Spread of each broadcast across clients.
+	std::uint64_t sent = 0;             ///< Commands sent.
+	std::uint64_t ok = 0;               ///< Commands acknowledged with OK.
+	std::uint64_t failed = 0;           ///< Commands acknowledged with FAIL or WHAT.
+	std::uint64_t misheard = 0;         ///< Broadcasts heard differently by different clients.
+	std::uint64_t unheard = 0;          ///< Broadcasts some clients never heard.
+	std::uint64_t dropped = 0;          ///< Clients disconnected by playd, or that couldn't connect.
+	Clock::duration sending{};          ///< How long commands were sent for.
+};
+
+/**
+ * Quotes a word for playd's tokeniser.
+ * @param word The word.
+ * @return The word in double quotes, with backslashes and quotes escaped.
+ */
+std::string Quote(std::string_view word)
+{
+	std::string quoted{"\""};
+	for (const auto c : word) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+/**
+ * Resolves a host and port, synchronously.
+ * @param loop The loop to resolve on.
+ * @param req The request to resolve with.
+ * @param host The host.
+ * @param port The port.
+ * @return The first address found, which must be freed with
+ *   uv_freeaddrinfo(), or nullptr if there was none.
+ */
+addrinfo *Resolve(uv_loop_t *loop, uv_getaddrinfo_t &req, const std::string &host, const std::string &port)
+{
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	// Without a callback, libuv resolves there and then.
+	if (const auto err = uv_getaddrinfo(loop, &req, nullptr, host.c_str(), port.c_str(), &hints); err != 0) {
+		std::cerr << "can't resolve " << host << ": " << uv_strerror(err) << std::endl;
+		return nullptr;
+	}
+	return req.addrinfo;
+}
+
+/**
+ * Scrapes playd's metrics, and picks out a counter.
+ * @param loop The loop to scrape on; nothing else may be running on it.
+ * @param host playd's host.
+ * @param port playd's metrics port.
+ * @param name The counter's name, without its _total.
+ * @return The counter's value, or nothing if it isn't there.
+ */
+std::optional<std::uint64_t> ScrapeCounter(uv_loop_t *loop, const std::string &host, const std::string &port,
+                                          std::string_view name)
+{
+	Scrape scrape;
+	scrape.request = "GET /metrics HTTP/1.0\r\nHost: " + host + "\r\n\r\n";
+	scrape.read_buf.resize(65536);
+	scrape.tcp.data = &scrape;
+	scrape.connector.data = &scrape;
+	scrape.writer.data = &scrape;
+
+	auto *res = Resolve(loop, scrape.resolver, host, port);
+	if (res == nullptr) return std::nullopt;
+
+	uv_tcp_init(loop, &scrape.tcp);
+	const auto err = uv_tcp_connect(&scrape.connector, &scrape.tcp, res->ai_addr, [](uv_connect_t *req, int status) {
+		auto *s = static_cast<Scrape *>(req->data);
+		auto *stream = reinterpret_cast<uv_stream_t *>(&s->tcp);
+		if (status < 0) {
+			s->failed = true;
+			uv_close(reinterpret_cast<uv_handle_t *>(&s->tcp), nullptr);
+			return;
+		}
+
+		auto buf = uv_buf_init(s->request.data(), static_cast<unsigned int>(s->request.size()));
+		uv_write(&s->writer, stream, &buf, 1, nullptr);
+		uv_read_start(
+		        stream,
+		        [](uv_handle_t *handle, size_t, uv_buf_t *buf) {
+			        auto *s = static_cast<Scrape *>(handle->data);
+			        buf->base = s->read_buf.data();
+			        buf->len = s->read_buf.size();
+		        },
+		        [](uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf) {
+			        auto *s = static_cast<Scrape *>(handle->data);
+			        if (0 < nread) {
+				        s->response.append(buf->base, static_cast<std::size_t>(nread));
+				        return;
+			        }
+			        if (nread != UV_EOF) s->failed = true;
+			        uv_close(reinterpret_cast<uv_handle_t *>(handle), nullptr);
+		        });
+	});
+	uv_freeaddrinfo(res);
+	if (err != 0) {
+		uv_close(reinterpret_cast<uv_handle_t *>(&scrape.tcp), nullptr);
+		scrape.failed = true;
+	}
+	uv_run(loop, UV_RUN_DEFAULT);
+	if (scrape.failed) {
+		std::cerr << "can't scrape metrics from " << host << ":" << port << std::endl;
+		return std::nullopt;
+	}
+
+	const auto line = "\n" + std::string{name} + "_total ";
+	const auto at = scrape.response.find(line);
+	if (at == std::string::npos) return std::nullopt;
+
+	const auto *begin = scrape.response.data() + at + line.size();
+	std::uint64_t value = 0;
+	if (std::from_chars(begin, scrape.response.data() + scrape.response.size(), value).ec != std::errc{}) {
+		return std::nullopt;
+	}
+	return value;
+}
+
+/// The load generator itself.
+class LoadGen
+{
+public:
+	/**
+	 * Constructs a LoadGen.
+	 * @param loop The loop to run on.
+	 * @param options How to run.
+	 */
+	LoadGen(uv_loop_t *loop, const Options &options)
+	    : loop{loop},
+	      options{options},
+	      mix{options.mix.begin(), options.mix.end()},
+	      read_buf(65536),
+	      phase{Phase::CONNECTING},
+	      connecting{0},
+	      ready{0},
+	      next_client{0}
+	{
+		this->clients.reserve(options.clients);
+		for (std::size_t i = 0; i < options.clients; i++) {
+			this->clients.push_back(std::make_unique<Client>());
+			this->clients.back()->gen = this;
+			this->clients.back()->index = i;
+		}
+
+		// Reserving up front keeps our own bookkeeping from stalling the
+		// loop mid-run.
+		this->result.acks.reserve(options.rate * options.seconds + 1024);
+	}
+
+	/**
+	 * Runs the load, returning when it's over.
+	 * @return Whether every client connected.
+	 */
+	bool Run()
+	{
+		uv_getaddrinfo_t resolver;
+		this->address = Resolve(this->loop, resolver, this->options.host, this->options.port);
+		if (this->address == nullptr) return false;
+
+		this->timer.data = this;
+		uv_timer_init(this->loop, &this->timer);
+		uv_timer_start(&this->timer, &OnTick, 0, TICK_MS);
+		uv_run(this->loop, UV_RUN_DEFAULT);
+
+		uv_freeaddrinfo(this->address);
+		return this->result.dropped == 0;
+	}
+
+	/// @return The results of the run.
+	[[nodiscard]] Result &Results()
+	{
+		return this->result;
+	}
+
+private:
+	/// Moves the run on; called every tick.
+	void Tick()
+	{
+		switch (this->phase) {
+			case Phase::CONNECTING:
+				this->ConnectSome();
+				break;
+			case Phase::LOADING:
+				break;
+			case Phase::SENDING:
+				this->SendDue();
+				break;
+			case Phase::DRAINING:
+				if (this->Drained() || DRAIN_TIMEOUT < Clock::now() - this->stopped_sending) this->Finish();
+				break;
+			case Phase::DONE:
+				break;
+		}
+	}
+
+	/// Starts the next few clients connecting.
+	void ConnectSome()
+	{
+		for (std::size_t i = 0; i < CONNECTS_PER_TICK && this->connecting < this->clients.size(); i++) {
+			auto &client = *this->clients[this->connecting++];
+			client.tcp.data = &client;
+			client.connector.data = &client;
+			uv_tcp_init(this->loop, &client.tcp);
+			uv_tcp_nodelay(&client.tcp, 1);
+			client.open = true;
+			if (const auto err = uv_tcp_connect(&client.connector, &client.tcp, this->address->ai_addr, &OnConnected);
+			    err != 0) {
+				this->Drop(client, uv_strerror(err));
+			}
+		}
+	}
+
+	/// Sends however many commands are due by now.
+	void SendDue()
+	{
+		const auto elapsed = Clock::now() - this->started_sending;
+		if (std::chrono::seconds{this->options.seconds} <= elapsed) {
+			this->result.sending = elapsed;
+			this->stopped_sending = Clock::now();
+			this->phase = Phase::DRAINING;
+			return;
+		}
+
+		const auto secs = std::chrono::duration<double>(elapsed).count();
+		const auto due = static_cast<std::uint64_t>(secs * static_cast<double>(this->options.rate));
+		while (this->result.sent < due) {
+			auto &client = *this->clients[this->next_client];
+			this->next_client = (this->next_client + 1) % this->clients.size();
+			if (!client.open) continue;
+
+			this->Send(client, COMMANDS[this->mix(this->random)]);
+		}
+	}
+
+	/**
+	 * Sends one command.
+	 * @param client The client to send it from.
+	 * @param command The command, without its tag.
+	 */
+	void Send(Client &client, std::string_view command)
+	{
+		auto *write = new Write{};
+		write->req.data = write;
+		write->text = "t" + std::to_string(this->result.sent++) + " " + std::string{command} + "\n";
+
+		auto buf = uv_buf_init(write->text.data(), static_cast<unsigned int>(write->text.size()));
+		client.waiting.push_back(Clock::now());
+		if (const auto err = uv_write(&write->req, reinterpret_cast<uv_stream_t *>(&client.tcp), &buf, 1, &OnWritten);
+		    err != 0) {
+			delete write;
+			this->Drop(client, uv_strerror(err));
+		}
+	}
+
+	/**
+	 * Handles some bytes read from a client.
+	 * @param client The client.
+	 * @param bytes The bytes.
+	 */
+	void Receive(Client &client, std::string_view bytes)
+	{
+		const auto now = Clock::now();
+		client.partial.append(bytes);
+
+		std::size_t start = 0;
+		for (auto end = client.partial.find('\n'); end != std::string::npos;
+		     end = client.partial.find('\n', start)) {
+			this->Hear(client, std::string_view{client.partial}.substr(start, end - start), now);
+			start = end + 1;
+		}
+		client.partial.erase(0, start);
+	}
+
+	/**
+	 * Handles one line heard by a client.
+	 * @param client The client.
+	 * @param line The line, without its newline.
+	 * @param now When it was heard.
+	 */
+	void Hear(Client &client, std::string_view line, Clock::time_point now)
+	{
+		const auto space = line.find(' ');
+		const auto tag = line.substr(0, space);
+		const auto rest = space == std::string_view::npos ? std::string_view{} : line.substr(space + 1);
+
+		if (tag != "!") {
+			if (rest.substr(0, 4) == "ACK ") this->Acknowledged(client, rest.substr(4), now);
+			return;
+		}
+
+		// The initial responses end with a DUMP.
+		if (!client.ready) {
+			if (rest == "DUMP") this->Ready(client);
+			return;
+		}
+
+		// Position updates go out on each client's own schedule, so only
+		// the others are heard by every client at (nearly) the same time.
+		if (rest.substr(0, 4) == "POS ") return;
+
+		const auto index = client.broadcasts++;
+		if (this->broadcasts.size() <= index) this->broadcasts.push_back(Broadcast{std::string{rest}, now, now, 0});
+
+		auto &broadcast = this->broadcasts[index];
+		if (broadcast.line != rest) this->result.misheard++;
+		broadcast.last = std::max(broadcast.last, now);
+		if (++broadcast.heard == this->ready) this->result.skews.push_back(broadcast.last - broadcast.first);
+	}
+
+	/**
+	 * Handles an acknowledgement.
+	 * @param client The client that was acknowledged.
+	 * @param status The status, and the rest of the ACK.
+	 * @param now When it was heard.
+	 */
+	void Acknowledged(Client &client, std::string_view status, Clock::time_point now)
+	{
+		if (client.waiting.empty()) return;
+
+		const auto took = now - client.waiting.front();
+		client.waiting.pop_front();
+
+		if (this->phase == Phase::LOADING) {
+			if (status.substr(0, 3) != "OK ") std::cerr << "can't load: " << status << std::endl;
+			this->StartSending();
+			return;
+		}
+
+		if (this->result.acks.size() < this->result.acks.capacity()) this->result.acks.push_back(took);
+		if (status.substr(0, 3) == "OK ") {
+			this->result.ok++;
+		} else {
+			this->result.failed++;
+		}
+	}
+
+	/**
+	 * Marks a client as having its initial responses.
+	 * @param client The client.
+	 */
+	void Ready(Client &client)
+	{
+		client.ready = true;
+		this->ready++;
+		this->CheckConnected();
+	}
+
+	/// Moves on from connecting, once every client is ready or dropped.
+	void CheckConnected()
+	{
+		if (this->ready + this->result.dropped < this->clients.size()) return;
+
+		std::cerr << this->ready << " clients connected" << std::endl;
+		if (this->ready == 0) {
+			this->Finish();
+			return;
+		}
+
+		// Loading is a command like any other, but isn't part of the load.
+		if (this->options.load) {
+			this->phase = Phase::LOADING;
+			auto &first = *std::find_if(this->clients.begin(), this->clients.end(),
+			                            [](const auto &c) { return c->ready; });
+			this->Send(*first, "fload " + Quote(*this->options.load));
+			this->result.sent = 0;
+			return;
+		}
+		this->StartSending();
+	}
+
+	/// Starts sending the load.
+	void StartSending()
+	{
+		this->phase = Phase::SENDING;
+		this->started_sending = Clock::now();
+	}
+
+	/// @return Whether every command sent has been acknowledged.
+	[[nodiscard]] bool Drained() const
+	{
+		return std::all_of(this->clients.begin(), this->clients.end(),
+		                   [](const auto &c) { return !c->open || c->waiting.empty(); });
+	}
+
+	/**
+	 * Gives up on a client.
+	 * @param client The client.
+	 * @param why Why it was given up on.
+	 */
+	void Drop(Client &client, std::string_view why)
+	{
+		if (!client.open) return;
+		if (this->phase != Phase::DONE) {
+			std::cerr << "client " << client.index << ": " << why << std::endl;
+			this->result.dropped++;
+		}
+		this->Close(client);
+
+		// A client going before it's ready might be the last one we were
+		// waiting for.
+		if (this->phase == Phase::CONNECTING) this->CheckConnected();
+	}
+
+	/**
+	 * Closes a client's connection.
+	 * @param client The client.
+	 */
+	void Close(Client &client)
+	{
+		client.open = false;
+		uv_close(reinterpret_cast<uv_handle_t *>(&client.tcp), nullptr);
+	}
+
+	/// Closes everything down, ending the run.
+	void Finish()
+	{
+		this->phase = Phase::DONE;
+		for (auto &broadcast : this->broadcasts) {
+			if (broadcast.heard < this->ready) this->result.unheard++;
+		}
+		for (auto &client : this->clients) {
+			if (client->open) this->Close(*client);
+		}
+		uv_timer_stop(&this->timer);
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->timer), nullptr);
+	}
+
+	//
+	// libuv callbacks
+	//
+
+	/// Called every tick.
+	static void OnTick(uv_timer_t *timer)
+	{
+		static_cast<LoadGen *>(timer->data)->Tick();
+	}
+
+	/// Called when a client has connected, or failed to.
+	static void OnConnected(uv_connect_t *req, int status)
+	{
+		auto &client = *static_cast<Client *>(req->data);
+		if (status < 0) {
+			client.gen->Drop(client, uv_strerror(status));
+			return;
+		}
+		uv_read_start(reinterpret_cast<uv_stream_t *>(&client.tcp), &OnAlloc, &OnRead);
+	}
+
+	/// Called when libuv wants somewhere to read into.
+	static void OnAlloc(uv_handle_t *handle, size_t, uv_buf_t *buf)
+	{
+		// Reads are handled as soon as they happen, so every client can
+		// share one buffer.
+		auto &gen = *static_cast<Client *>(handle->data)->gen;
+		buf->base = gen.read_buf.data();
+		buf->len = gen.read_buf.size();
+	}
+
+	/// Called when a client has read something.
+	static void OnRead(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
+	{
+		auto &client = *static_cast<Client *>(handle->data);
+		if (nread == UV_EOF) {
+			client.gen->Drop(client, "disconnected by playd");
+		} else if (nread < 0) {
+			client.gen->Drop(client, uv_strerror(static_cast<int>(nread)));
+		} else {
+			client.gen->Receive(client, std::string_view{buf->base, static_cast<std::size_t>(nread)});
+		}
+	}
+
+	/// Called when a command has been written.
+	static void OnWritten(uv_write_t *req, int)
+	{
+		delete static_cast<Write *>(req->data);
+	}
+
+	uv_loop_t *loop;             ///< The loop the load runs on.
+	const Options &options;      ///< How to run.
+	addrinfo *address = nullptr; ///< playd's address.
+	uv_timer_t timer;            ///< Ticks every TICK_MS.
+
+	std::vector<std::unique_ptr<Client>> clients; ///< Every client.
+	std::discrete_distribution<std::size_t> mix;  ///< Picks commands by weight.
+	std::minstd_rand random;                      ///< Drives mix, the same way every run.
+	std::vector<char> read_buf;                   ///< Where every client reads into.
+
+	Phase phase;                       ///< How far the run has got.
+	std::size_t connecting;            ///< How many clients have started connecting.
+	std::size_t ready;                 ///< How many clients have their initial responses.
+	std::size_t next_client;           ///< Which client sends the next command.
+	Clock::time_point started_sending; ///< When the load started.
+	Clock::time_point stopped_sending; ///< When the load stopped.
+
+	std::vector<Broadcast> broadcasts; ///< Every broadcast, in the order playd sent them.
+	Result result;                     ///< The results so far.
+};
+
+/**
+ * Prints the results.
+ * @param options How the run was asked to go.
+ * @param result The results.
+ */
+void Report(const Options &options, Result &result)
+{
+	std::sort(result.acks.begin(), result.acks.end());
+	std::sort(result.skews.begin(), result.skews.end());
+
+	const auto secs = std::max(std::chrono::duration<double>(result.sending).count(), 1e-9);
+	std::cout << std::fixed << std::setprecision(0) << options.clients << " clients: "
+	          << static_cast<double>(result.sent) / secs << " commands/s sent, " << result.ok << " OK and "
+	          << result.failed << " failed, " << result.dropped << " clients dropped" << std::endl;
+	std::cout << std::setprecision(1) << "ACK p50 " << Percentile(result.acks, 50) << "us p99 "
+	          << Percentile(result.acks, 99) << "us p99.9 " << Percentile(result.acks, 99.9) << "us max "
+	          << Percentile(result.acks, 100) << "us (" << result.acks.size() << " ACKs)" << std::endl;
+	std::cout << "broadcast skew p50 " << Percentile(result.skews, 50) << "us p99 " << Percentile(result.skews, 99)
+	          << "us max " << Percentile(result.skews, 100) << "us (" << result.skews.size() << " broadcasts, "
+	          << result.unheard << " not heard by all, " << result.misheard << " heard out of order)" << std::endl;
+}
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " [" << CLIENTS_OPTION << "N] [" << RATE_OPTION << "N] [" << SECONDS_OPTION
+	          << "N] [" << MIX_OPTION << "POS,DUMP,PLAY,STOP] [" << LOAD_OPTION << "FILE] [" << METRICS_OPTION
+	          << "PORT] HOST PORT\n";
+	std::cerr << CLIENTS_OPTION << "N: connect N clients (default 1000)\n";
+	std::cerr << RATE_OPTION << "N: send N commands per second across all clients (default 10000)\n";
+	std::cerr << SECONDS_OPTION << "N: send for N seconds (default 10)\n";
+	std::cerr << MIX_OPTION << "POS,DUMP,PLAY,STOP: weight the commands sent (default 70,10,10,10)\n";
+	std::cerr << LOAD_OPTION << "FILE: fload FILE before sending, so that play and stop do something\n";
+	std::cerr << METRICS_OPTION << "PORT: count playd's allocations through its metrics on PORT\n";
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Parses a count, or exits.
+ * @param value The count's text.
+ * @param progname The name of the program as executed, for the usage.
+ * @return The count, which is never zero.
+ */
+std::uint64_t ParseCount(std::string_view value, std::string_view progname)
+{
+	std::uint64_t count = 0;
+	const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), count);
+	if (ec != std::errc{} || end != value.data() + value.size() || count == 0) ExitWithUsage(progname);
+	return count;
+}
+
+/**
+ * Parses the command mix's weights, or exits.
+ * @param value The weights, separated by commas.
+ * @param progname The name of the program as executed, for the usage.
+ * @return One weight per command.
+ */
+std::vector<std::uint32_t> ParseMix(std::string_view value, std::string_view progname)
+{
+	std::vector<std::uint32_t> weights;
+	std::uint64_t total = 0;
+	while (weights.size() < std::size(COMMANDS)) {
+		const auto comma = value.find(',');
+		std::uint32_t weight = 0;
+		const auto word = value.substr(0, comma);
+		const auto [end, ec] = std::from_chars(word.data(), word.data() + word.size(), weight);
+		if (ec != std::errc{} || end != word.data() + word.size()) ExitWithUsage(progname);
+
+		weights.push_back(weight);
+		total += weight;
+		if (comma == std::string_view::npos) break;
+		value.remove_prefix(comma + 1);
+	}
+	if (weights.size() != std::size(COMMANDS) || total == 0) ExitWithUsage(progname);
+	return weights;
+}
+
+} // namespace Playd::Bench
+
+/**
+ * The load generator's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code (zero if every client connected and stayed
+ *   connected; non-zero otherwise).
+ */
+int main(int argc, char *argv[])
+{
+	using namespace Playd::Bench;
+
+	Options options;
+	std::vector<std::string_view> positional;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{argv[i]};
+		const auto value = [&arg](std::string_view option) { return arg.substr(option.size()); };
+		if (arg.starts_with(CLIENTS_OPTION)) {
+			options.clients = ParseCount(value(CLIENTS_OPTION), argv[0]);
+		} else if (arg.starts_with(RATE_OPTION)) {
+			options.rate = ParseCount(value(RATE_OPTION), argv[0]);
+		} else if (arg.starts_with(SECONDS_OPTION)) {
+			options.seconds = ParseCount(value(SECONDS_OPTION), argv[0]);
+		} else if (arg.starts_with(MIX_OPTION)) {
+			options.mix = ParseMix(value(MIX_OPTION), argv[0]);
+		} else if (arg.starts_with(LOAD_OPTION)) {
+			options.load = std::string{value(LOAD_OPTION)};
+		} else if (arg.starts_with(METRICS_OPTION)) {
+			options.metrics = std::string{value(METRICS_OPTION)};
+		} else {
+			positional.push_back(arg);
+		}
+	}
+	if (positional.size() != 2) ExitWithUsage(argv[0]);
+	options.host = positional[0];
+	options.port = positional[1];
+
+	auto *loop = uv_default_loop();
+	const auto count = [&](std::string_view name) -> std::optional<std::uint64_t> {
+		if (!options.metrics) return std::nullopt;
+		return ScrapeCounter(loop, options.host, *options.metrics, name);
+	};
+
+	const auto allocations_before = count("playd_allocations");
+	const auto bytes_before = count("playd_allocated_bytes");
+
+	LoadGen gen{loop, options};
+	const auto connected = gen.Run();
+	auto &result = gen.Results();
+	Report(options, result);
+
+	if (options.metrics) {
+		const auto allocations_after = count("playd_allocations");
+		const auto bytes_after = count("playd_allocated_bytes");
+		if (allocations_before && allocations_after && bytes_before && bytes_after) {
+			const auto allocations = *allocations_after - *allocations_before;
+			const auto commands = static_cast<double>(std::max<std::uint64_t>(result.sent, 1));
+			std::cout << std::setprecision(1) << "playd allocated " << allocations << " times ("
+			          << *bytes_after - *bytes_before << " bytes), "
+			          << static_cast<double>(allocations) / commands << " per command" << std::endl;
+		} else {
+			std::cout << "playd's allocations aren't counted; build it with -DWITH_ALLOCATION_COUNTS=ON"
+			          << std::endl;
+		}
+	}
+
+	uv_loop_close(loop);
+	return connected ? EXIT_SUCCESS : EXIT_FAILURE;
+}
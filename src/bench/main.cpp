@@ -0,0 +1,384 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Decoding benchmark for playd's audio sources.
+ *
+ * This decodes a corpus of files with every source playd was built with, and
+ * reports how fast each one decodes compared to real time, how much it
+ * allocates while doing so, and how long individual Decode() calls take.
+ * Each file is decoded twice: once straight out of the Source, and once
+ * through a BasicAudio feeding a sink that throws everything away, so that
+ * the pipeline's own overhead shows up too.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../audio/audio.h"
+#include "../audio/resampler.h"
+#include "../audio/sdl_engine.h"
+#include "../audio/sink.h"
+#include "../audio/source.h"
+#include "../errors.h"
+#include "../sources.h"
+#include "alloc_counter.h"
+#include "percentile.h"
+
+namespace Playd::Bench
+{
+/// The option that makes the benchmark resample to the device rate.
+constexpr std::string_view RESAMPLE_OPTION{"--resample="};
+
+/// Type of the clock used for all timings.
+using Clock = std::chrono::steady_clock;
+
+/// A Source that times every Decode() call of another Source.
+class TimingSource : public Audio::Source
+{
+public:
+	/**
+	 * Constructs a TimingSource.
+	 * @param inner The Source to time.
+	 */
+	explicit TimingSource(std::unique_ptr<Audio::Source> inner) : Audio::Source{inner->Path()}, inner{std::move(inner)}
+	{
+		// Reserving up front keeps our own bookkeeping out of the
+		// allocation counts; the estimate allows for plenty of short
+		// rounds.
+		const auto bytes = this->inner->Length() * this->inner->BytesPerSample();
+		this->latencies.reserve(4 * (bytes / this->inner->FrameBytes()) + 1024);
+	}
+
+	using Audio::Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		const auto start = Clock::now();
+		const auto result = this->inner->Decode(out);
+		const auto took = Clock::now() - start;
+
+		if (this->latencies.size() < this->latencies.capacity()) this->latencies.push_back(took);
+		this->decoded_bytes += result.second;
+		return result;
+	}
+
+	std::uint64_t Seek(std::uint64_t position) override
+	{
+		return this->inner->Seek(position);
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->inner->Length();
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return this->inner->ChannelCount();
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return this->inner->SampleRate();
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return this->inner->OutputSampleFormat();
+	}
+
+	/// The time taken by each Decode() call so far.
+	std::vector<Clock::duration> latencies;
+
+	/// The total number of bytes decoded so far.
+	std::uint64_t decoded_bytes = 0;
+
+private:
+	std::unique_ptr<Audio::Source> inner; ///< The Source being timed.
+};
+
+/// A Sink that takes everything it's given, and plays none of it.
+class NullSink : public Audio::Sink
+{
+public:
+	/**
+	 * Constructs a NullSink.
+	 * @param source The source from which this sink will receive audio.
+	 */
+	explicit NullSink(const Audio::Source &source)
+	    : bytes_per_sample{source.BytesPerSample()}, scratch(source.FrameBytes())
+	{
+	}
+
+	void Start() override
+	{
+		if (this->state == State::STOPPED) this->state = this->source_out ? State::AT_END : State::PLAYING;
+	}
+
+	void Stop() override
+	{
+		if (this->state == State::PLAYING) this->state = State::STOPPED;
+	}
+
+	State CurrentState() override
+	{
+		return this->state;
+	}
+
+	Audio::Samples Position() override
+	{
+		return this->position;
+	}
+
+	void SetPosition(Audio::Samples samples) override
+	{
+		this->position = samples;
+		this->source_out = false;
+	}
+
+	void SourceOut() override
+	{
+		this->source_out = true;
+		if (this->state == State::PLAYING) this->state = State::AT_END;
+	}
+
+	size_t Transfer(gsl::span<const std::byte> src) override
+	{
+		this->position += src.size() / this->bytes_per_sample;
+		return src.size();
+	}
+
+	std::optional<gsl::span<std::byte>> AcquireTransfer() override
+	{
+		return gsl::span<std::byte>{this->scratch};
+	}
+
+	void CommitTransfer(size_t count) override
+	{
+		this->position += count / this->bytes_per_sample;
+	}
+
+	bool WantsMore() override
+	{
+		return true;
+	}
+
+private:
+	size_t bytes_per_sample;        ///< Number of bytes in one sample.
+	std::vector<std::byte> scratch; ///< Where lent-out samples end up.
+	State state = State::STOPPED;   ///< The sink's current state.
+	Audio::Samples position = 0;    ///< The position, in samples.
+	bool source_out = false;        ///< Whether the source has run out.
+};
+
+/// The results of benchmarking one file in one mode.
+struct Result {
+	double audio_seconds;              ///< Length of audio decoded.
+	double wall_seconds;               ///< Time taken to decode it.
+	std::uint64_t allocated;           ///< Bytes allocated while decoding.
+	std::vector<Clock::duration> laps; ///< Latency of each Decode().
+};
+
+/// Options affecting how each source is built.
+struct Options {
+	std::optional<Audio::Resampler::Quality> resample; ///< Resampling, if any.
+};
+
+/**
+ * Opens a file with the decoder playd would pick for it.
+ * @param path The file to open.
+ * @param options How to build the source.
+ * @return The source, wrapped in a TimingSource.
+ * @exception FileError if no source handles the file, or it can't be opened.
+ */
+std::unique_ptr<TimingSource> OpenSource(const std::string &path, const Options &options)
+{
+	const auto decoder = Player::FindDecoder(SOURCES, path);
+	if (decoder == nullptr) throw FileError("Unknown file format: " + path);
+
+	auto source = decoder->open(path);
+	if (options.resample && source->SampleRate() != Audio::SDLEngine::DEVICE_RATE) {
+		source = std::make_unique<Audio::ResampledSource>(std::move(source), Audio::SDLEngine::DEVICE_RATE,
+		                                                  *options.resample);
+	}
+	return std::make_unique<TimingSource>(std::move(source));
+}
+
+/**
+ * Makes a Result out of a finished TimingSource.
+ * @param source The source, after decoding has finished.
+ * @param start When decoding started.
+ * @param allocated_at_start The allocation count when decoding started.
+ * @return The Result.
+ */
+Result Finish(TimingSource &source, Clock::time_point start, std::uint64_t allocated_at_start)
+{
+	const auto wall = std::chrono::duration<double>(Clock::now() - start).count();
+	const auto allocated = AllocatedBytes() - allocated_at_start;
+
+	const auto samples = source.decoded_bytes / source.BytesPerSample();
+	const auto audio = static_cast<double>(samples) / source.SampleRate();
+	return Result{audio, wall, allocated, std::move(source.latencies)};
+}
+
+/**
+ * Decodes a file straight out of its Source.
+ * @param path The file to decode.
+ * @param options How to build the source.
+ * @return The benchmark results.
+ */
+Result RunDecode(const std::string &path, const Options &options)
+{
+	auto source = OpenSource(path, options);
+	std::vector<std::byte> frame(source->FrameBytes());
+
+	const auto allocated_at_start = AllocatedBytes();
+	const auto start = Clock::now();
+	while (source->Decode(frame).first != Audio::Source::DecodeState::END_OF_FILE) {
+	}
+
+	return Finish(*source, start, allocated_at_start);
+}
+
+/**
+ * Decodes a file through a BasicAudio and a NullSink.
+ * @param path The file to decode.
+ * @param options How to build the source.
+ * @return The benchmark results.
+ */
+Result RunPipeline(const std::string &path, const Options &options)
+{
+	auto source = OpenSource(path, options);
+	auto &timing = *source;
+	auto sink = std::make_unique<NullSink>(timing);
+	Audio::BasicAudio audio{std::move(source), std::move(sink)};
+	audio.SetPlaying(true);
+
+	const auto allocated_at_start = AllocatedBytes();
+	const auto start = Clock::now();
+	while (audio.Update() != Audio::Audio::State::AT_END) {
+	}
+
+	return Finish(timing, start, allocated_at_start);
+}
+
+/**
+ * Prints one result line.
+ * @param path The file benchmarked.
+ * @param mode The name of the benchmark mode.
+ * @param result The results to print.
+ */
+void Report(const std::string &path, std::string_view mode, Result &result)
+{
+	std::sort(result.laps.begin(), result.laps.end());
+
+	const auto realtime = result.audio_seconds / std::max(result.wall_seconds, 1e-9);
+	const auto alloc_rate = static_cast<double>(result.allocated) / std::max(result.wall_seconds, 1e-9);
+
+	std::cout << std::fixed << std::setprecision(1) << path << " " << mode << ": " << realtime << "x realtime, "
+	          << std::setprecision(0) << alloc_rate << " B/s allocated, decode p50 " << std::setprecision(1)
+	          << Percentile(result.laps, 50) << "us p99 " << Percentile(result.laps, 99) << "us max "
+	          << Percentile(result.laps, 100) << "us (" << result.laps.size() << " calls)" << std::endl;
+}
+
+/**
+ * Adds a path to the corpus, expanding directories into the files in them
+ * that some source can decode.
+ * @param path The path given on the command line.
+ * @param corpus The corpus to add to.
+ */
+void AddToCorpus(const std::filesystem::path &path, std::vector<std::string> &corpus)
+{
+	if (!std::filesystem::is_directory(path)) {
+		corpus.push_back(path.string());
+		return;
+	}
+
+	for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+		if (!entry.is_regular_file()) continue;
+
+		if (Player::FindDecoder(SOURCES, entry.path().string()) != nullptr) corpus.push_back(entry.path().string());
+	}
+}
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " [" << RESAMPLE_OPTION << "QUALITY] FILE-OR-DIR...\n";
+	std::cerr << "decodes each file with the decoder that recognises it, or takes its extension:\n";
+	for (const auto &decoder : SOURCES) {
+		std::cerr << "\t" << decoder.name << ":";
+		for (const auto &ext : decoder.extensions) std::cerr << " " << ext;
+		std::cerr << "\n";
+	}
+	std::cerr << RESAMPLE_OPTION << "QUALITY: also resample to " << Audio::SDLEngine::DEVICE_RATE
+	          << " Hz at low, medium or high quality\n";
+	exit(EXIT_FAILURE);
+}
+
+} // namespace Playd::Bench
+
+/**
+ * The benchmark's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code (zero if every file decoded; non-zero otherwise).
+ */
+int main(int argc, char *argv[])
+{
+	using namespace Playd::Bench;
+
+	Playd::InitSourceLibraries();
+
+	Options options;
+	std::vector<std::string> corpus;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{argv[i]};
+		if (arg.substr(0, RESAMPLE_OPTION.size()) == RESAMPLE_OPTION) {
+			const auto value = arg.substr(RESAMPLE_OPTION.size());
+			if (value == "low") {
+				options.resample = Playd::Audio::Resampler::Quality::LOW;
+			} else if (value == "medium") {
+				options.resample = Playd::Audio::Resampler::Quality::MEDIUM;
+			} else if (value == "high") {
+				options.resample = Playd::Audio::Resampler::Quality::HIGH;
+			} else {
+				ExitWithUsage(argv[0]);
+			}
+			continue;
+		}
+		AddToCorpus(std::filesystem::path{arg}, corpus);
+	}
+	if (corpus.empty()) ExitWithUsage(argv[0]);
+
+	auto status = EXIT_SUCCESS;
+	for (const auto &path : corpus) {
+		try {
+			auto decode = RunDecode(path, options);
+			Report(path, "decode", decode);
+
+			auto pipeline = RunPipeline(path, options);
+			Report(path, "pipeline", pipeline);
+		} catch (Error &e) {
+			std::cerr << path << ": " << e.Message() << std::endl;
+			status = EXIT_FAILURE;
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,34 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The latency percentiles the benchmarks report.
+ */
+
+#ifndef PLAYD_BENCH_PERCENTILE_H
+#define PLAYD_BENCH_PERCENTILE_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace Playd::Bench
+{
+/**
+ * Gets a percentile of a set of latencies, in microseconds.
+ * @param laps The latencies, sorted in ascending order.
+ * @param percentile The percentile, from 0 to 100.
+ * @return The latency at that percentile.
+ */
+inline double Percentile(const std::vector<std::chrono::steady_clock::duration> &laps, double percentile)
+{
+	if (laps.empty()) return 0.0;
+
+	const auto index = static_cast<std::size_t>((percentile / 100.0) * static_cast<double>(laps.size() - 1));
+	return std::chrono::duration<double, std::micro>(laps[index]).count();
+}
+
+} // namespace Playd::Bench
+
+#endif // PLAYD_BENCH_PERCENTILE_H
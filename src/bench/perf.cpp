@@ -0,0 +1,768 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Performance regression suite for playd's hot paths.
+ *
+ * This runs small, fixed-seed versions of the other benchmarks: tokenising
+ * commands, packing a POS broadcast, moving bytes through a ring buffer,
+ * decoding into a sink, and a player playing on a simulated clock with a POS
+ * every update.  Each reports how long one operation took, and how many heap
+ * allocations it made, as JSON; with a baseline, each figure is checked
+ * against the baseline's, within the baseline's tolerances.
+ *
+ * Allocation counts are the same on every run of the same build, but not
+ * across standard libraries, so only the paths that shouldn't allocate at all
+ * (those with a baseline of none) are always checked: an allocation per ring
+ * buffer transfer, or per decode round, fails the suite.  The other counts, as
+ * well as timings, which depend on the machine and the build, are only checked
+ * when asked.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "../audio/audio.h"
+#include "../audio/ringbuffer.h"
+#include "../audio/sinks/sim.h"
+#include "../audio/source.h"
+#include "../clock.h"
+#include "../errors.h"
+#include "../io.h"
+#include "../player.h"
+#include "../response.h"
+#include "../tokeniser.h"
+#include "alloc_counter.h"
+
+namespace Playd::Bench
+{
+/// Type of the clock used for all timings.
+using Clock = std::chrono::steady_clock;
+
+/// The option that names the baseline to check against.
+constexpr std::string_view BASELINE_OPTION{"--baseline="};
+
+/// The option that names where to write the results.
+constexpr std::string_view JSON_OPTION{"--json="};
+
+/// The option that checks timings, as well as allocations.
+constexpr std::string_view GATE_TIMINGS_OPTION{"--gate-timings"};
+
+/// The option that checks every allocation count, not just those of the paths
+/// the baseline has as allocation-free.
+constexpr std::string_view GATE_ALLOCATIONS_OPTION{"--gate-allocations"};
+
+/// The option that rewrites the baseline with this run's figures.
+constexpr std::string_view UPDATE_BASELINE_OPTION{"--update-baseline"};
+
+/// The seed for everything random, so every run does the same work.
+constexpr std::uint32_t SEED = 1350;
+
+/// How many operations of each benchmark run before measuring, so that
+/// buffers have grown and caches warmed.
+constexpr std::uint64_t WARM_UP_DIVISOR = 10;
+
+/// The rate of the decoded audio, in Hz.
+constexpr std::uint32_t RATE = 48000;
+
+/// How often the simulated device is caught up with.
+constexpr std::chrono::milliseconds UPDATE_PERIOD{10};
+
+/// The figures of one benchmark.
+struct Result {
+	std::string name;      ///< The benchmark's name.
+	std::uint64_t ops;     ///< Operations measured.
+	double ns_per_op;      ///< Wall-clock time per operation.
+	double allocs_per_op;  ///< Heap allocations per operation.
+};
+
+/**
+ * Times a benchmark, and counts its allocations.
+ * @param name The benchmark's name.
+ * @param ops How many operations to measure, after a tenth as many again
+ *   to warm up.
+ * @param op Runs operation n.
+ * @return The figures.
+ */
+template <typename OpFn> Result Measure(std::string_view name, std::uint64_t ops, OpFn op)
+{
+	for (std::uint64_t n = 0; n < ops / WARM_UP_DIVISOR; n++) op(n);
+
+	const auto allocations_at_start = Allocations();
+	const auto start = Clock::now();
+	for (std::uint64_t n = 0; n < ops; n++) op(n);
+	const auto wall = Clock::now() - start;
+	const auto allocated = Allocations() - allocations_at_start;
+
+	const auto count = static_cast<double>(ops);
+	return Result{std::string{name}, ops, std::chrono::duration<double, std::nano>(wall).count() / count,
+	              static_cast<double>(allocated) / count};
+}
+
+//
+// Benchmarks
+//
+
+/**
+ * Generates a mix of commands, as clients send them.
+ * @param lines How many lines to generate.
+ * @return The lines, each ending in a newline.
+ */
+std::string CommandCorpus(std::uint64_t lines)
+{
+	std::mt19937 random{SEED};
+	std::uniform_int_distribution<int> pick{0, 9};
+	std::uniform_int_distribution<std::uint32_t> number{0, 3600000};
+
+	std::string text;
+	for (std::uint64_t n = 0; n < lines; n++) {
+		text += "t" + std::to_string(n);
+		switch (pick(random)) {
+			case 0:
+				text += " fload '/srv/music/Artist " + std::to_string(number(random)) + "/Track One.mp3'\n";
+				break;
+			case 1:
+				text += " play\n";
+				break;
+			case 2:
+				text += " stop\n";
+				break;
+			case 3:
+				text += " fade 2000 -6 power\n";
+				break;
+			default:
+				text += " pos " + std::to_string(number(random)) + "\n";
+				break;
+		}
+	}
+	return text;
+}
+
+/// @return The figures for tokenising a line of commands, fed in 64 KiB reads.
+Result BenchTokeniser()
+{
+	constexpr std::uint64_t LINES = 50000;
+	constexpr std::uint64_t PASSES = 20;
+	constexpr std::size_t READ_BYTES = 65536;
+	const std::string text = CommandCorpus(LINES);
+
+	// Operations here are passes over the corpus, which are divided back
+	// into lines below.
+	Tokeniser tokeniser;
+	std::uint64_t lines = 0;
+	const Tokeniser::LineHandler on_line = [&lines](Tokeniser::Line) { lines++; };
+	auto result = Measure("tokeniser", PASSES, [&](std::uint64_t) {
+		for (std::size_t at = 0; at < text.size(); at += READ_BYTES) {
+			std::ignore = tokeniser.Feed(std::string_view{text}.substr(at, READ_BYTES), on_line);
+		}
+	});
+	if (lines != LINES * (PASSES + PASSES / WARM_UP_DIVISOR)) std::cerr << "missed lines!" << std::endl;
+
+	result.ops *= LINES;
+	result.ns_per_op /= LINES;
+	result.allocs_per_op /= LINES;
+	return result;
+}
+
+/// @return The figures for packing one POS broadcast, in text and as a frame.
+Result BenchPosBroadcast()
+{
+	std::uint64_t bytes = 0;
+	auto result = Measure("pos-broadcast", 500000, [&bytes](std::uint64_t n) {
+		Response rs{Response::NOREQUEST, Response::Code::POS};
+		rs.AddArg(static_cast<std::int64_t>(n * 10000));
+		bytes += IO::PackResponse(rs)->size() + IO::PackResponseFrame(rs)->size();
+	});
+	if (bytes == 0) std::cerr << "packed nothing!" << std::endl;
+	return result;
+}
+
+/// @return The figures for writing one decoded frame into a ring buffer, and
+///   reading it out in callback-sized pieces.
+Result BenchRingBuffer()
+{
+	constexpr std::size_t WRITE_BYTES = 4608;
+	constexpr std::size_t READ_BYTES = 1024;
+
+	Audio::RingBuffer rb{1U << 16U};
+	std::vector<std::byte> in(WRITE_BYTES);
+	std::vector<std::byte> out(READ_BYTES);
+	std::mt19937 random{SEED};
+	std::generate(in.begin(), in.end(), [&random] { return static_cast<std::byte>(random() & 0xFFU); });
+
+	return Measure("ringbuffer", 500000, [&](std::uint64_t) {
+		std::ignore = rb.Write(in);
+		while (READ_BYTES <= rb.ReadCapacity()) std::ignore = rb.Read(out);
+	});
+}
+
+/// A stereo SINT16 source of noise, which decodes about as fast as a copy.
+class NoiseSource : public Audio::Source
+{
+public:
+	/**
+	 * Constructs a NoiseSource.
+	 * @param path The path of the file it stands for.
+	 * @param length How long it is, in samples.
+	 */
+	NoiseSource(std::string_view path, std::uint64_t length)
+	    : Audio::Source{path}, length{length}, position{0}, noise(RATE * 4)
+	{
+		std::mt19937 random{SEED};
+		std::generate(this->noise.begin(), this->noise.end(), [&random] {
+			return static_cast<std::byte>(random() & 0xFFU);
+		});
+	}
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		if (this->position == this->length) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+		// A second of noise, over and over.
+		const auto count = std::min<std::uint64_t>({out.size() / 4, this->length - this->position,
+		                                            RATE - this->position % RATE});
+		const auto from = static_cast<std::ptrdiff_t>((this->position % RATE) * 4);
+		std::copy_n(this->noise.begin() + from, count * 4, out.begin());
+		this->position += count;
+		return std::make_pair(DecodeState::DECODING, count * 4);
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return 2;
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return RATE;
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return Audio::SampleFormat::SINT16;
+	}
+
+	std::uint64_t Seek(std::uint64_t new_position) override
+	{
+		this->position = std::min(new_position, this->length);
+		return this->position;
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->length;
+	}
+
+private:
+	std::uint64_t length;         ///< How long the source is, in samples.
+	std::uint64_t position;       ///< Where the source is, in samples.
+	std::vector<std::byte> noise; ///< A second of noise.
+};
+
+/// @return The figures for one update of a BasicAudio playing into a
+///   simulated device, which is one decode round.
+Result BenchDecode()
+{
+	constexpr std::uint64_t UPDATES = 60000;
+	const auto length = RATE * (UPDATES + UPDATES / WARM_UP_DIVISOR + 100) / 100;
+
+	SimClock clock;
+	auto source = std::make_unique<NoiseSource>("noise.sim", length);
+	auto sink = std::make_unique<Audio::SimSink>(*source, clock, RATE / 2);
+	Audio::BasicAudio audio{std::move(source), std::move(sink)};
+	std::ignore = audio.Update();
+	audio.SetPlaying(true);
+
+	auto result = Measure("decode", UPDATES, [&](std::uint64_t) {
+		clock.Advance(UPDATE_PERIOD);
+		std::ignore = audio.Update();
+	});
+	if (audio.Position() < UPDATE_PERIOD * UPDATES) std::cerr << "decoding fell behind!" << std::endl;
+	return result;
+}
+
+/// A ResponseSink that packs every response into the same string, as a
+/// connection's outbox would, without holding on to any of them.
+class PackingSink : public ResponseSink
+{
+public:
+	void Respond(ClientId, const Response &response) const override
+	{
+		this->packed.clear();
+		response.PackInto(this->packed);
+		this->count++;
+	}
+
+	/// @return How many responses have been packed.
+	[[nodiscard]] std::uint64_t Count() const
+	{
+		return this->count;
+	}
+
+private:
+	mutable std::string packed;    ///< The last response, packed.
+	mutable std::uint64_t count{0}; ///< How many responses have been packed.
+};
+
+/// @return The figures for one update of a player on a simulated clock, with
+///   a client getting a POS on each.
+Result BenchPlayer()
+{
+	constexpr std::uint64_t UPDATES = 60000;
+	const auto length = RATE * (UPDATES + UPDATES / WARM_UP_DIVISOR + 100) / 100;
+
+	SimClock clock;
+	const std::vector<Player::Decoder> decoders{
+	        {"sim", {"sim"}, nullptr, [length](std::string_view path) -> std::unique_ptr<Audio::Source> {
+		         return std::make_unique<NoiseSource>(path, length);
+	         }}};
+	Player player{0,
+	              [&clock](const Audio::Source &source, int) -> std::unique_ptr<Audio::Sink> {
+		              return std::make_unique<Audio::SimSink>(source, clock, RATE / 2);
+	              },
+	              decoders};
+	player.UseClock(clock);
+
+	PackingSink sink;
+	player.SetIo(sink);
+	player.AddClient(static_cast<ClientId>(1));
+	std::ignore = player.PosRate(static_cast<ClientId>(1), "perf", std::to_string(UPDATE_PERIOD.count()));
+	std::ignore = player.Load("perf", "noise.sim");
+	std::ignore = player.Update();
+	std::ignore = player.SetPlaying("perf", true);
+
+	auto result = Measure("player", UPDATES, [&](std::uint64_t) {
+		clock.Advance(UPDATE_PERIOD);
+		std::ignore = player.Update();
+	});
+	if (sink.Count() < UPDATES) std::cerr << "missed POS broadcasts!" << std::endl;
+	return result;
+}
+
+//
+// JSON
+//
+
+/// Just enough of a JSON value to hold results and baselines.
+struct Json {
+	/// The kinds of value.
+	enum class Kind : std::uint8_t { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Kind kind{Kind::NUL};                             ///< The kind of value.
+	double number{0};                                 ///< The value, if a number or boolean.
+	std::string string;                               ///< The value, if a string.
+	std::vector<Json> items;                          ///< The items, if an array.
+	std::vector<std::pair<std::string, Json>> fields; ///< The fields, if an object.
+
+	/**
+	 * Looks up a field of an object.
+	 * @param key The field's name.
+	 * @return The field, or nullptr if it isn't there (or this isn't an object).
+	 */
+	[[nodiscard]] const Json *Find(std::string_view key) const
+	{
+		for (const auto &[name, value] : this->fields) {
+			if (name == key) return &value;
+		}
+		return nullptr;
+	}
+};
+
+/// Reads JSON, throwing ConfigError on anything it doesn't understand.
+class JsonReader
+{
+public:
+	/**
+	 * Constructs a JsonReader.
+	 * @param text The JSON, which must outlive the reader.
+	 */
+	explicit JsonReader(std::string_view text) : text{text}, at{0}
+	{
+	}
+
+	/// @return The one value in the text.
+	Json ReadAll()
+	{
+		auto value = this->Read();
+		this->SkipSpace();
+		if (this->at != this->text.size()) this->Fail("trailing characters");
+		return value;
+	}
+
+private:
+	std::string_view text; ///< The JSON.
+	std::size_t at;        ///< Where in it we've read up to.
+
+	/**
+	 * Throws a ConfigError for a malformed file.
+	 * @param why What's wrong with it.
+	 */
+	[[noreturn]] void Fail(std::string_view why) const
+	{
+		throw ConfigError("baseline: " + std::string{why} + " at byte " + std::to_string(this->at));
+	}
+
+	/// Skips any whitespace.
+	void SkipSpace()
+	{
+		while (this->at < this->text.size() && std::strchr(" \t\r\n", this->text[this->at]) != nullptr) {
+			this->at++;
+		}
+	}
+
+	/**
+	 * Reads a character that must be next, after any whitespace.
+	 * @param c The character.
+	 */
+	void Expect(char c)
+	{
+		this->SkipSpace();
+		if (this->at == this->text.size() || this->text[this->at] != c) this->Fail(std::string{"expected "} + c);
+		this->at++;
+	}
+
+	/**
+	 * Reads a character if it's next, after any whitespace.
+	 * @param c The character.
+	 * @return Whether it was.
+	 */
+	bool Accept(char c)
+	{
+		this->SkipSpace();
+		if (this->at == this->text.size() || this->text[this->at] != c) return false;
+		this->at++;
+		return true;
+	}
+
+	/// @return The next value.
+	Json Read()
+	{
+		this->SkipSpace();
+		if (this->at == this->text.size()) this->Fail("unexpected end");
+
+		Json value;
+		const auto c = this->text[this->at];
+		if (c == '{') {
+			value.kind = Json::Kind::OBJECT;
+			this->at++;
+			if (this->Accept('}')) return value;
+			do {
+				this->SkipSpace();
+				auto key = this->ReadString();
+				this->Expect(':');
+				value.fields.emplace_back(std::move(key), this->Read());
+			} while (this->Accept(','));
+			this->Expect('}');
+		} else if (c == '[') {
+			value.kind = Json::Kind::ARRAY;
+			this->at++;
+			if (this->Accept(']')) return value;
+			do {
+				value.items.push_back(this->Read());
+			} while (this->Accept(','));
+			this->Expect(']');
+		} else if (c == '"') {
+			value.kind = Json::Kind::STRING;
+			value.string = this->ReadString();
+		} else if (this->ReadWord("true")) {
+			value.kind = Json::Kind::BOOLEAN;
+			value.number = 1;
+		} else if (this->ReadWord("false")) {
+			value.kind = Json::Kind::BOOLEAN;
+		} else if (this->ReadWord("null")) {
+			value.kind = Json::Kind::NUL;
+		} else {
+			value.kind = Json::Kind::NUMBER;
+			value.number = this->ReadNumber();
+		}
+		return value;
+	}
+
+	/**
+	 * Reads a keyword, if it's next.
+	 * @param word The keyword.
+	 * @return Whether it was.
+	 */
+	bool ReadWord(std::string_view word)
+	{
+		if (this->text.substr(this->at, word.size()) != word) return false;
+		this->at += word.size();
+		return true;
+	}
+
+	/// @return The string next in the text, unescaped.
+	std::string ReadString()
+	{
+		if (this->at == this->text.size() || this->text[this->at] != '"') this->Fail("expected a string");
+		this->at++;
+
+		std::string out;
+		while (this->at < this->text.size() && this->text[this->at] != '"') {
+			auto c = this->text[this->at++];
+			if (c == '\\') {
+				if (this->at == this->text.size()) break;
+				c = this->text[this->at++];
+				if (c == 'n') c = '\n';
+				if (c == 't') c = '\t';
+				if (std::strchr("\"\\/\n\t", c) == nullptr) this->Fail("unsupported escape");
+			}
+			out += c;
+		}
+		if (this->at == this->text.size()) this->Fail("unterminated string");
+		this->at++;
+		return out;
+	}
+
+	/// @return The number next in the text.
+	double ReadNumber()
+	{
+		const auto start = this->at;
+		while (this->at < this->text.size() && std::strchr("+-.0123456789eE", this->text[this->at]) != nullptr) {
+			this->at++;
+		}
+		if (start == this->at) this->Fail("expected a value");
+
+		const std::string number{this->text.substr(start, this->at - start)};
+		char *end = nullptr;
+		const auto value = std::strtod(number.c_str(), &end);
+		if (*end != '\0') this->Fail("malformed number");
+		return value;
+	}
+};
+
+/**
+ * Reads a JSON file.
+ * @param path The file's path.
+ * @return Its value.
+ */
+Json ReadJsonFile(const std::string &path)
+{
+	std::ifstream in{path};
+	if (!in) throw ConfigError("can't read baseline: " + path);
+	std::ostringstream text;
+	text << in.rdbuf();
+	return JsonReader{text.str()}.ReadAll();
+}
+
+/**
+ * Escapes a string for JSON.
+ * Benchmark names need nothing more than quotes and backslashes escaping.
+ * @param s The string.
+ * @return The string, quoted and escaped.
+ */
+std::string Quote(std::string_view s)
+{
+	std::string out = "\"";
+	for (const auto c : s) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+/**
+ * Writes results as JSON.
+ * @param out The stream to write to.
+ * @param results The results.
+ * @param tolerances The tolerances to write alongside them, for baselines.
+ */
+void WriteJson(std::ostream &out, const std::vector<Result> &results, const std::optional<Json> &tolerances)
+{
+	out << std::setprecision(6) << "{\n  \"seed\": " << SEED << ",\n";
+	if (tolerances) {
+		out << "  \"tolerances\": {";
+		auto first = true;
+		for (const auto &[name, value] : tolerances->fields) {
+			out << (first ? "" : ", ") << Quote(name) << ": " << value.number;
+			first = false;
+		}
+		out << "},\n";
+	}
+
+	out << "  \"results\": [\n";
+	for (std::size_t i = 0; i < results.size(); i++) {
+		const auto &r = results[i];
+		out << "    {\"name\": " << Quote(r.name) << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns_per_op
+		    << ", \"allocs_per_op\": " << r.allocs_per_op << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+//
+// Checking
+//
+
+/// The default tolerances, for baselines that don't give their own.
+/// Allocations may go up by this many per operation; see Check().
+constexpr double DEFAULT_ALLOCS_TOLERANCE = 0.05;
+
+/// Timings may go up by this many times; see Check().
+constexpr double DEFAULT_NS_TOLERANCE = 2.0;
+
+/**
+ * Reads one of a baseline's tolerances.
+ * @param baseline The baseline.
+ * @param name The figure's name.
+ * @param fallback The tolerance if the baseline doesn't give one.
+ * @return The tolerance.
+ */
+double Tolerance(const Json &baseline, std::string_view name, double fallback)
+{
+	const auto *tolerances = baseline.Find("tolerances");
+	if (tolerances == nullptr) return fallback;
+	const auto *value = tolerances->Find(name);
+	return value == nullptr ? fallback : value->number;
+}
+
+/**
+ * Checks results against a baseline.
+ * Allocations fail if they go over the baseline's by more than the
+ * `allocs_per_op` tolerance, per operation; timings fail if they go over it
+ * by more than `ns_per_op` times.  Allocations are always checked where the
+ * baseline has none, as those paths should allocate nothing with any standard
+ * library; everything else is only checked if asked.
+ * @param results The results.
+ * @param baseline The baseline.
+ * @param gate_timings Whether slower timings fail, rather than just being
+ *   reported.
+ * @param gate_allocations Whether more allocations fail on paths the baseline
+ *   has as allocating, rather than just being reported.
+ * @return Whether everything checked is within tolerance.
+ */
+bool Check(const std::vector<Result> &results, const Json &baseline, bool gate_timings, bool gate_allocations)
+{
+	const auto allocs_tolerance = Tolerance(baseline, "allocs_per_op", DEFAULT_ALLOCS_TOLERANCE);
+	const auto ns_tolerance = Tolerance(baseline, "ns_per_op", DEFAULT_NS_TOLERANCE);
+	const auto *expected = baseline.Find("results");
+	if (expected == nullptr) throw ConfigError("baseline: no results");
+
+	auto ok = true;
+	for (const auto &r : results) {
+		const auto found = std::find_if(expected->items.begin(), expected->items.end(), [&r](const Json &item) {
+			const auto *name = item.Find("name");
+			return name != nullptr && name->string == r.name;
+		});
+		if (found == expected->items.end()) {
+			std::cout << r.name << ": not in the baseline" << std::endl;
+			continue;
+		}
+
+		const auto *allocs = found->Find("allocs_per_op");
+		const auto *ns = found->Find("ns_per_op");
+		if (allocs == nullptr || ns == nullptr) throw ConfigError("baseline: incomplete result for " + r.name);
+
+		const auto allocs_ok = r.allocs_per_op <= allocs->number + allocs_tolerance;
+		const auto allocs_gated = gate_allocations || allocs->number == 0.0;
+		const auto ns_ok = r.ns_per_op <= ns->number * ns_tolerance;
+		std::cout << std::fixed << std::setprecision(2) << r.name << ": " << r.allocs_per_op
+		          << " allocations/op (baseline " << allocs->number << ")"
+		          << (allocs_ok ? "" : allocs_gated ? " REGRESSED" : " more") << ", " << r.ns_per_op
+		          << " ns/op (baseline " << ns->number << ")"
+		          << (ns_ok ? "" : gate_timings ? " REGRESSED" : " slower") << std::endl;
+
+		ok = ok && (allocs_ok || !allocs_gated) && (ns_ok || !gate_timings);
+	}
+	return ok;
+}
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " [" << BASELINE_OPTION << "PATH [" << GATE_TIMINGS_OPTION << "] ["
+	          << GATE_ALLOCATIONS_OPTION << "] [" << UPDATE_BASELINE_OPTION << "]] [" << JSON_OPTION << "PATH]\n";
+	std::cerr << BASELINE_OPTION << "PATH: fail if paths PATH has as allocation-free allocate (or, with "
+	          << GATE_ALLOCATIONS_OPTION << ", if any allocations regress, and with " << GATE_TIMINGS_OPTION
+	          << ", if timings regress)\n";
+	std::cerr << UPDATE_BASELINE_OPTION << ": rewrite PATH with this run's figures, keeping its tolerances\n";
+	std::cerr << JSON_OPTION << "PATH: write the results to PATH, rather than to stdout\n";
+	exit(EXIT_FAILURE);
+}
+
+} // namespace Playd::Bench
+
+/**
+ * The suite's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code: failure if anything regressed.
+ */
+int main(int argc, char *argv[])
+{
+	using namespace Playd::Bench;
+
+	std::optional<std::string> baseline_path;
+	std::optional<std::string> json_path;
+	auto gate_timings = false;
+	auto gate_allocations = false;
+	auto update_baseline = false;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{argv[i]};
+		if (arg.substr(0, BASELINE_OPTION.size()) == BASELINE_OPTION) {
+			baseline_path = std::string{arg.substr(BASELINE_OPTION.size())};
+		} else if (arg.substr(0, JSON_OPTION.size()) == JSON_OPTION) {
+			json_path = std::string{arg.substr(JSON_OPTION.size())};
+		} else if (arg == GATE_TIMINGS_OPTION) {
+			gate_timings = true;
+		} else if (arg == GATE_ALLOCATIONS_OPTION) {
+			gate_allocations = true;
+		} else if (arg == UPDATE_BASELINE_OPTION) {
+			update_baseline = true;
+		} else {
+			ExitWithUsage(argv[0]);
+		}
+	}
+	if ((gate_timings || gate_allocations || update_baseline) && !baseline_path) ExitWithUsage(argv[0]);
+
+	try {
+		const auto baseline = baseline_path ? std::optional<Json>{ReadJsonFile(*baseline_path)} : std::nullopt;
+
+		std::vector<Result> results;
+		results.push_back(BenchTokeniser());
+		results.push_back(BenchPosBroadcast());
+		results.push_back(BenchRingBuffer());
+		results.push_back(BenchDecode());
+		results.push_back(BenchPlayer());
+
+		if (json_path) {
+			std::ofstream out{*json_path};
+			WriteJson(out, results, std::nullopt);
+		} else {
+			WriteJson(std::cout, results, std::nullopt);
+		}
+
+		if (!baseline) return EXIT_SUCCESS;
+		if (update_baseline) {
+			const auto *tolerances = baseline->Find("tolerances");
+			std::ofstream out{*baseline_path};
+			WriteJson(out, results, tolerances == nullptr ? std::nullopt : std::optional<Json>{*tolerances});
+			return EXIT_SUCCESS;
+		}
+		return Check(results, *baseline, gate_timings, gate_allocations) ? EXIT_SUCCESS : EXIT_FAILURE;
+	} catch (Error &e) {
+		std::cerr << e.Message() << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,252 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Throughput and contention benchmark for the RingBuffer class.
+ *
+ * This runs a producer thread (standing in for the decoder) against a
+ * consumer thread (standing in for the audio callback) over a ring buffer
+ * sized as SDLSink sizes its own, reading in each callback size from 64 to
+ * 8192 frames.  Each size runs twice: steadily, and with the producer
+ * flushing every 100us, as a storm of seeks would.  For each run it
+ * reports the cost per byte moved, the p50, p99 and maximum Read() latency,
+ * and how often the consumer stalled or came up short, so that any change to
+ * the buffer's synchronisation can be measured against the last.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
+#include "../audio/buffer_policy.h"
+#include "../audio/ringbuffer.h"
+#include "percentile.h"
+
+namespace Playd::Bench
+{
+/// Type of the clock used for all timings.
+using Clock = std::chrono::steady_clock;
+
+/// The option that sets how many bytes each run moves.
+constexpr std::string_view MEGABYTES_OPTION{"--megabytes="};
+
+/// The callback sizes tried, in sample frames.
+constexpr std::size_t CHUNK_FRAMES[]{64, 128, 256, 512, 1024, 2048, 4096, 8192};
+
+/// The size of one sample frame: 16-bit stereo.
+constexpr std::size_t FRAME_BYTES = 4;
+
+/// The sample rate the ring buffer is sized for.
+constexpr std::uint32_t RATE = 48000;
+
+/// How much the producer writes at once, in bytes: a typical decoded frame.
+constexpr std::size_t WRITE_BYTES = 4608;
+
+/// How often the producer flushes, in a flush storm: far more often than
+/// anyone could seek.
+constexpr std::chrono::microseconds FLUSH_PERIOD{100};
+
+/// Reads taking longer than this count as the consumer having stalled.
+constexpr std::chrono::microseconds STALL{20};
+
+/// The results of one run.
+struct Result {
+	std::uint64_t bytes;               ///< Bytes the consumer read.
+	Clock::duration wall;              ///< Time taken to read them.
+	std::vector<Clock::duration> laps; ///< Latency of each read.
+	std::uint64_t short_reads;         ///< Reads that got some, but not all, of what they asked for.
+	std::uint64_t empty_reads;         ///< Reads that got nothing.
+	std::uint64_t flushes;             ///< Flushes the producer made.
+	std::uint64_t corrupt;             ///< Reads whose bytes were out of order.
+};
+
+/**
+ * Runs the producer, until told to stop.
+ * Bytes are written as a running count, modulo 256, so the consumer can
+ * check that they come out in order.
+ * @param rb The ring buffer to write into.
+ * @param storm Whether to flush every FLUSH_PERIOD.
+ * @param stop Set when the consumer has read enough.
+ * @return The number of flushes made.
+ */
+std::uint64_t Produce(Audio::RingBuffer &rb, bool storm, const std::atomic<bool> &stop)
+{
+	// Any run of the pattern starts somewhere in the first 256 bytes.
+	std::vector<std::byte> pattern(WRITE_BYTES + 256);
+	for (std::size_t i = 0; i < pattern.size(); i++) pattern[i] = static_cast<std::byte>(i & 0xFFU);
+
+	std::uint64_t written = 0;
+	std::uint64_t flushes = 0;
+	auto next_flush = Clock::now() + FLUSH_PERIOD;
+	while (!stop.load(std::memory_order_relaxed)) {
+		// The decoder would wait for a wake-up here, rather than spin.
+		const auto count = std::min(WRITE_BYTES, rb.WriteCapacity());
+		if (count == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		written += rb.Write(gsl::span<const std::byte>{pattern}.subspan(written & 0xFFU, count));
+
+		if (storm && next_flush <= Clock::now()) {
+			rb.Flush();
+			flushes++;
+			next_flush += FLUSH_PERIOD;
+		}
+	}
+	return flushes;
+}
+
+/**
+ * Runs the consumer, until it has read enough.
+ * @param rb The ring buffer to read from.
+ * @param chunk The number of bytes to read at a time.
+ * @param target The number of bytes to read in total.
+ * @param check Whether to check that the bytes come out in order (they
+ *   don't across flushes).
+ * @param result Where the consumer's results go.
+ * @param stop Set once the consumer has read enough.
+ */
+void Consume(Audio::RingBuffer &rb, std::size_t chunk, std::uint64_t target, bool check, Result &result,
+             std::atomic<bool> &stop)
+{
+	std::vector<std::byte> dest(chunk);
+
+	const auto start = Clock::now();
+	while (result.bytes < target) {
+		const auto lap_start = Clock::now();
+		const auto count = rb.ReadSome(dest);
+		const auto lap = Clock::now() - lap_start;
+
+		// An empty buffer is the producer's fault, not the buffer's, so
+		// the consumer gives way as a callback would, and isn't timed.
+		if (count == 0) {
+			result.empty_reads++;
+			std::this_thread::yield();
+			continue;
+		}
+		if (result.laps.size() < result.laps.capacity()) result.laps.push_back(lap);
+		if (count < chunk) result.short_reads++;
+
+		// Checking the ends of each read is enough to catch tearing
+		// without making the consumer much slower than a callback.
+		if (check) {
+			const auto first = static_cast<std::byte>(result.bytes & 0xFFU);
+			const auto last = static_cast<std::byte>((result.bytes + count - 1) & 0xFFU);
+			if (dest[0] != first || dest[count - 1] != last) result.corrupt++;
+		}
+		result.bytes += count;
+	}
+	result.wall = Clock::now() - start;
+	stop.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Runs one producer against one consumer.
+ * @param chunk_frames The consumer's callback size, in sample frames.
+ * @param storm Whether the producer flushes as it goes.
+ * @param target The number of bytes to read in total.
+ * @return The results.
+ */
+Result Run(std::size_t chunk_frames, bool storm, std::uint64_t target)
+{
+	Audio::RingBuffer rb{Audio::BufferPolicy::BytesFor(Audio::BufferPolicy::DEFAULT_SIZE, RATE, FRAME_BYTES)};
+	const auto chunk = chunk_frames * FRAME_BYTES;
+
+	// Reserving up front keeps allocation out of the consumer's laps; the
+	// estimate allows for plenty of short reads.
+	Result result{0, {}, {}, 0, 0, 0, 0};
+	result.laps.reserve(4 * (target / chunk) + 1024);
+
+	std::atomic<bool> stop{false};
+	std::thread consumer{[&] { Consume(rb, chunk, target, !storm, result, stop); }};
+	result.flushes = Produce(rb, storm, stop);
+	consumer.join();
+	return result;
+}
+
+/**
+ * Prints one result line.
+ * @param chunk_frames The consumer's callback size, in sample frames.
+ * @param mode The name of the run's mode.
+ * @param result The results to print.
+ */
+void Report(std::size_t chunk_frames, std::string_view mode, Result &result)
+{
+	std::sort(result.laps.begin(), result.laps.end());
+
+	const auto ns = std::chrono::duration<double, std::nano>(result.wall).count();
+	const auto per_byte = ns / static_cast<double>(std::max<std::uint64_t>(result.bytes, 1));
+	const auto stalls = result.laps.end() - std::upper_bound(result.laps.begin(), result.laps.end(),
+	                                                         Clock::duration{STALL});
+
+	std::cout << std::fixed << std::setw(4) << chunk_frames << " frames " << mode << ": " << std::setprecision(3)
+	          << per_byte << " ns/byte, read p50 " << std::setprecision(2) << Percentile(result.laps, 50)
+	          << "us p99 " << Percentile(result.laps, 99) << "us max " << Percentile(result.laps, 100) << "us, "
+	          << stalls << " stalls over " << STALL.count() << "us, " << result.short_reads << " short and "
+	          << result.empty_reads << " empty of " << result.laps.size() + result.empty_reads << " reads";
+	if (0 < result.flushes) std::cout << ", " << result.flushes << " flushes";
+	if (0 < result.corrupt) std::cout << ", " << result.corrupt << " OUT OF ORDER";
+	std::cout << std::endl;
+}
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " [" << MEGABYTES_OPTION << "N]\n";
+	std::cerr << MEGABYTES_OPTION << "N: move N MiB through the buffer in each run (default 256)\n";
+	exit(EXIT_FAILURE);
+}
+
+} // namespace Playd::Bench
+
+/**
+ * The benchmark's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code (zero if every byte came out in order; non-zero
+ *   otherwise).
+ */
+int main(int argc, char *argv[])
+{
+	using namespace Playd::Bench;
+
+	std::uint64_t megabytes = 256;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{argv[i]};
+		if (arg.substr(0, MEGABYTES_OPTION.size()) != MEGABYTES_OPTION) ExitWithUsage(argv[0]);
+
+		const std::string value{arg.substr(MEGABYTES_OPTION.size())};
+		char *end = nullptr;
+		megabytes = std::strtoull(value.c_str(), &end, 10);
+		if (value.empty() || *end != '\0' || megabytes == 0) ExitWithUsage(argv[0]);
+	}
+	const auto target = megabytes << 20U;
+
+	auto status = EXIT_SUCCESS;
+	for (const auto frames : CHUNK_FRAMES) {
+		auto steady = Run(frames, false, target);
+		Report(frames, "steady", steady);
+		if (0 < steady.corrupt) status = EXIT_FAILURE;
+
+		auto storm = Run(frames, true, target);
+		Report(frames, "flush storm", storm);
+	}
+
+	return status;
+}
@@ -0,0 +1,237 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Throughput benchmark for the Tokeniser class.
+ *
+ * This feeds corpora of command lines through a Tokeniser: a realistic mix
+ * of commands, long quoted paths, heavily escaped words, and huge lines.
+ * Each corpus is fed in the 64 KiB reads libuv usually hands over, and again
+ * a byte at a time, as from a client trickling its commands out.  For each
+ * run it reports how fast the tokeniser went, and how often it allocated, so
+ * that a faster tokeniser (proven equivalent by the fuzz target in
+ * src/fuzz/tokeniser.cpp) can be measured against this one.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../tokeniser.h"
+#include "alloc_counter.h"
+
+namespace Playd::Bench
+{
+/// Type of the clock used for all timings.
+using Clock = std::chrono::steady_clock;
+
+/// The option that sets how many bytes each run feeds.
+constexpr std::string_view MEGABYTES_OPTION{"--megabytes="};
+
+/// The size of the reads libuv usually hands the tokeniser.
+constexpr std::size_t READ_BYTES = 65536;
+
+/// How many times smaller the corpora fed a byte at a time are.
+constexpr std::size_t TRICKLE_DIVISOR = 16;
+
+/// A path of the sort playd is asked to load.
+constexpr std::string_view PATH{"/srv/music/Peter Gabriel/Peter Gabriel 3 (Melt)/07 - Games Without Frontiers.mp3"};
+
+/// A named corpus of command lines.
+struct Corpus {
+	std::string_view name; ///< What the corpus is.
+	std::string text;      ///< The lines, each ending in a newline.
+};
+
+/// The results of one run.
+struct Result {
+	std::uint64_t bytes;       ///< Bytes fed.
+	std::uint64_t lines;       ///< Lines tokenised.
+	std::uint64_t allocations; ///< Allocations made while tokenising.
+	Clock::duration wall;      ///< Time taken.
+};
+
+/**
+ * Generates one line of the realistic corpus.
+ * Most commands are short and unquoted; loads quote their paths.
+ * @param n The line's number.
+ * @return The line.
+ */
+std::string RealisticLine(std::uint64_t n)
+{
+	const auto tag = "t" + std::to_string(n);
+	switch (n % 10) {
+		case 0:
+			return tag + " fload '" + std::string{PATH} + "'\n";
+		case 1:
+			return tag + " play\n";
+		case 2:
+			return tag + " stop\n";
+		case 3:
+			return tag + " dump\n";
+		case 4:
+			return tag + " fade 2000 -6 power\n";
+		default:
+			return tag + " pos " + std::to_string(n * 1000) + "\n";
+	}
+}
+
+/**
+ * Generates one heavily escaped line: every space in the path escaped, and
+ * its quotes and backslashes too, as an unwary client library would.
+ * @param n The line's number.
+ * @return The line.
+ */
+std::string EscapedLine(std::uint64_t n)
+{
+	std::string line = "t" + std::to_string(n) + " fload \"";
+	for (const auto c : PATH) {
+		if (c == ' ' || c == '"' || c == '\\' || c == '(' || c == ')') line += '\\';
+		line += c;
+	}
+	return line + "\\\\\\\"\"\n";
+}
+
+/**
+ * Repeats lines until a corpus is big enough.
+ * @param name The corpus's name.
+ * @param bytes How big the corpus should be.
+ * @param line Generates line number n.
+ * @return The corpus.
+ */
+template <typename LineFn> Corpus Generate(std::string_view name, std::size_t bytes, LineFn line)
+{
+	Corpus corpus{name, {}};
+	corpus.text.reserve(bytes + 1024);
+	for (std::uint64_t n = 0; corpus.text.size() < bytes; n++) corpus.text += line(n);
+	return corpus;
+}
+
+/**
+ * Generates every corpus.
+ * @param bytes How big each corpus should be.
+ * @return The corpora.
+ */
+std::vector<Corpus> Corpora(std::size_t bytes)
+{
+	std::vector<Corpus> corpora;
+	corpora.push_back(Generate("realistic", bytes, RealisticLine));
+	corpora.push_back(Generate("unquoted", bytes, [](std::uint64_t n) {
+		return "t" + std::to_string(n) + " pos " + std::to_string(n * 1000) + "\n";
+	}));
+	corpora.push_back(Generate("quoted paths", bytes, [](std::uint64_t n) {
+		return "t" + std::to_string(n) + " fload '" + std::string{PATH} + std::string{PATH} + "'\n";
+	}));
+	corpora.push_back(Generate("escaped", bytes, EscapedLine));
+
+	// A megabyte-long line of words, as from a confused or hostile client.
+	corpora.push_back(Generate("huge lines", bytes, [](std::uint64_t n) {
+		std::string line = "t" + std::to_string(n);
+		line.reserve(1U << 20U);
+		while (line.size() < (1U << 20U)) line += " word";
+		return line + "\n";
+	}));
+	return corpora;
+}
+
+/**
+ * Feeds a corpus through a fresh Tokeniser.
+ * @param text The corpus.
+ * @param read_size How many bytes to feed at a time.
+ * @return The results.
+ */
+Result Run(std::string_view text, std::size_t read_size)
+{
+	// The huge lines are there to measure copying, not rejection.
+	Tokeniser tokeniser{{std::numeric_limits<std::size_t>::max(), std::numeric_limits<std::size_t>::max()}};
+	std::uint64_t lines = 0;
+	std::uint64_t words = 0;
+	const Tokeniser::LineHandler on_line = [&lines, &words](Tokeniser::Line line) {
+		lines++;
+		words += line.size();
+	};
+
+	const auto allocations_at_start = Allocations();
+	const auto start = Clock::now();
+	for (std::size_t at = 0; at < text.size(); at += read_size) {
+		if (!tokeniser.Feed(text.substr(at, read_size), on_line)) std::cerr << "rejected a line!" << std::endl;
+	}
+	const auto wall = Clock::now() - start;
+
+	// Every line has at least a tag and a command.
+	if (words < 2 * lines) std::cerr << "lost words!" << std::endl;
+	return Result{text.size(), lines, Allocations() - allocations_at_start, wall};
+}
+
+/**
+ * Prints one result line.
+ * @param corpus The corpus's name.
+ * @param mode The name of the run's mode.
+ * @param result The results to print.
+ */
+void Report(std::string_view corpus, std::string_view mode, const Result &result)
+{
+	const auto secs = std::max(std::chrono::duration<double>(result.wall).count(), 1e-9);
+	const auto bytes = static_cast<double>(std::max<std::uint64_t>(result.bytes, 1));
+	const auto lines = static_cast<double>(std::max<std::uint64_t>(result.lines, 1));
+
+	std::cout << std::fixed << corpus << " " << mode << ": " << std::setprecision(1) << bytes / secs / (1U << 20U)
+	          << " MiB/s, " << std::setprecision(2) << secs * 1e9 / bytes << " ns/byte, " << std::setprecision(0)
+	          << lines / secs << " lines/s, " << std::setprecision(2)
+	          << static_cast<double>(result.allocations) / lines << " allocations/line (" << result.lines
+	          << " lines)" << std::endl;
+}
+
+/**
+ * Reports usage information and exits.
+ * @param progname The name of the program as executed.
+ */
+[[noreturn]] void ExitWithUsage(std::string_view progname)
+{
+	std::cerr << "usage: " << progname << " [" << MEGABYTES_OPTION << "N]\n";
+	std::cerr << MEGABYTES_OPTION << "N: feed N MiB of each corpus in each run (default 64), and 1/"
+	          << TRICKLE_DIVISOR << " of that a byte at a time\n";
+	exit(EXIT_FAILURE);
+}
+
+} // namespace Playd::Bench
+
+/**
+ * The benchmark's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code.
+ */
+int main(int argc, char *argv[])
+{
+	using namespace Playd::Bench;
+
+	std::uint64_t megabytes = 64;
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{argv[i]};
+		if (arg.substr(0, MEGABYTES_OPTION.size()) != MEGABYTES_OPTION) ExitWithUsage(argv[0]);
+
+		const std::string value{arg.substr(MEGABYTES_OPTION.size())};
+		char *end = nullptr;
+		megabytes = std::strtoull(value.c_str(), &end, 10);
+		if (value.empty() || *end != '\0' || megabytes == 0) ExitWithUsage(argv[0]);
+	}
+
+	for (const auto &corpus : Corpora(megabytes << 20U)) {
+		Report(corpus.name, "64 KiB reads", Run(corpus.text, READ_BYTES));
+
+		const auto trickle = std::string_view{corpus.text}.substr(0, corpus.text.size() / TRICKLE_DIVISOR);
+		Report(corpus.name, "1-byte reads", Run(trickle, 1));
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Clock and SimClock classes.
+ * @see clock.h
+ */
+
+#include "clock.h"
+
+#include <chrono>
+
+#undef max
+#include <gsl/gsl>
+
+namespace Playd
+{
+/// The real steady clock.
+class SteadyClock : public Clock
+{
+public:
+	[[nodiscard]] TimePoint Now() const override
+	{
+		return std::chrono::steady_clock::now();
+	}
+};
+
+/* static */ const Clock &Clock::Steady()
+{
+	static const SteadyClock steady;
+	return steady;
+}
+
+SimClock::SimClock(TimePoint start) : now{start.time_since_epoch().count()}
+{
+}
+
+Clock::TimePoint SimClock::Now() const
+{
+	return TimePoint{TimePoint::duration{this->now.load(std::memory_order_acquire)}};
+}
+
+void SimClock::Advance(std::chrono::nanoseconds by)
+{
+	Expects(0 <= by.count());
+	const auto ticks = std::chrono::duration_cast<TimePoint::duration>(by).count();
+	this->now.fetch_add(ticks, std::memory_order_acq_rel);
+}
+
+} // namespace Playd
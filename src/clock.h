@@ -0,0 +1,80 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Clock and SimClock classes.
+ * @see clock.cpp
+ */
+
+#ifndef PLAYD_CLOCK_H
+#define PLAYD_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+
+namespace Playd
+{
+/**
+ * A source of the current time, on the steady clock's timeline.
+ *
+ * Things that time themselves (the player's broadcasts and schedules, and
+ * simulated sinks) ask one of these rather than the steady clock, so that
+ * tests and benchmarks can swap in a SimClock and run hours of playback in
+ * moments, exactly the same way every time.
+ */
+class Clock
+{
+public:
+	/// Type of the times a Clock tells.
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	/// Type of the durations between a Clock's times.
+	using Duration = std::chrono::steady_clock::duration;
+
+	/// Virtual, empty destructor for Clock.
+	virtual ~Clock() = default;
+
+	/**
+	 * The current time.
+	 * This may be called from any thread.
+	 * @return The time now.
+	 */
+	[[nodiscard]] virtual TimePoint Now() const = 0;
+
+	/**
+	 * The real steady clock, which is what playd runs on.
+	 * @return A clock that tells std::chrono::steady_clock's time.
+	 */
+	static const Clock &Steady();
+};
+
+/**
+ * A clock whose time only moves when it is told to.
+ */
+class SimClock : public Clock
+{
+public:
+	/**
+	 * Constructs a SimClock.
+	 * @param start The time the clock starts at.
+	 */
+	explicit SimClock(TimePoint start = TimePoint{});
+
+	[[nodiscard]] TimePoint Now() const override;
+
+	/**
+	 * Moves the clock on.
+	 * * Precondition: @a by isn't negative.
+	 * @param by How far to move it.
+	 */
+	void Advance(std::chrono::nanoseconds by);
+
+private:
+	/// The time, in steady-clock ticks, so that any thread can read it.
+	std::atomic<TimePoint::rep> now;
+};
+
+} // namespace Playd
+
+#endif // PLAYD_CLOCK_H
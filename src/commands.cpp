@@ -0,0 +1,166 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of the command table.
+ * @see commands.h
+ */
+
+#include "commands.h"
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "player.h"
+#include "response.h"
+#include "tokeniser.h"
+
+namespace Playd
+{
+/**
+ * The commands playd understands.
+ *
+ * To add a command, add a line here; the dispatch table is rebuilt at compile
+ * time.  Commands that open files or start the device go through
+ * Player::WhenReady, so that they wait for the audio systems in fast starts.
+ */
+static constexpr std::array<Command, 26> COMMANDS{{
+        {"play", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}]() -> Command::Result {
+		         return p.SetPlaying(tag, true);
+	         });
+         }},
+        {"stop", 0,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.SetPlaying(tag, false);
+         }},
+        {"end", 0,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line) -> Command::Result { return p.End(tag); }},
+        {"eject", 0,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line) -> Command::Result { return p.Eject(tag); }},
+        {"dump", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.Dump(id, tag);
+         }},
+        {"take", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}]() -> Command::Result { return p.Take(tag); });
+         }},
+        {"next", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}]() -> Command::Result { return p.Next(tag); });
+         }},
+        {"stats", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.Stats(id, tag);
+         }},
+        {"loudness", 0,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line) -> Command::Result {
+	         return p.Loudness(id, tag);
+         }},
+        {"fload", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) {
+	         return p.WhenReady(id, [&p, id, tag = std::string{tag}, path = std::string{args[0]}] {
+		         return p.LoadInBackground(id, tag, path);
+	         });
+         }},
+        {"enqueue", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}, path = std::string{args[0]}]() -> Command::Result {
+		         return p.Enqueue(tag, path);
+	         });
+         }},
+        {"dequeue", 1,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Dequeue(tag, args[0]);
+         }},
+        {"pos", 1,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Pos(tag, args[0]);
+         }},
+        {"cue", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) {
+	         return p.WhenReady(id, [&p, id, tag = std::string{tag}, path = std::string{args[0]}] {
+		         return p.CueInBackground(id, tag, path);
+	         });
+         }},
+        {"play-at", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}, time = std::string{args[0]}]() -> Command::Result {
+		         return p.SetPlayingAt(tag, true, time);
+	         });
+         }},
+        {"stop-at", 1,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.SetPlayingAt(tag, false, args[0]);
+         }},
+        {"posrate", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.PosRate(id, tag, args[0]);
+         }},
+        {"loudrate", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.LoudRate(id, tag, args[0]);
+         }},
+        {"tap", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Tap(id, tag, args[0]);
+         }},
+        {"enqueue", 2,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.WhenReady(id, [&p, tag = std::string{tag}, path = std::string{args[0]},
+	                                 overlap = std::string{args[1]}]() -> Command::Result {
+		         return p.Enqueue(tag, path, overlap);
+	         });
+         }},
+        {"fade", 2,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Fade(tag, args[0], args[1]);
+         }},
+        {"fade", 3,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Fade(tag, args[0], args[1], args[2]);
+         }},
+        {"rate", 1,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Rate(tag, args[0]);
+         }},
+        {"set", 2,
+         [](Player &p, ClientId, Response::Tag tag, Tokeniser::Line args) -> Command::Result {
+	         return p.Set(tag, args[0], args[1]);
+         }},
+        {"probe", Command::VARIADIC,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) {
+	         return p.WhenReady(id, [&p, id, tag = std::string{tag}, paths = std::vector<std::string>{
+	                                                                          args.begin(), args.end()}] {
+		         return p.Probe(id, tag, paths);
+	         });
+         }},
+        {"waveform", 1,
+         [](Player &p, ClientId id, Response::Tag tag, Tokeniser::Line args) {
+	         return p.WhenReady(id, [&p, id, tag = std::string{tag}, buckets = std::string{args[0]}] {
+		         return p.Waveform(id, tag, buckets);
+	         });
+         }},
+}};
+
+/// The dispatch table for COMMANDS.
+static constexpr CommandTable<COMMANDS.size()> COMMAND_TABLE{COMMANDS};
+
+const Command *FindCommand(std::string_view verb, std::size_t arity)
+{
+	if (const auto *command = COMMAND_TABLE.Find(verb, arity)) return command;
+	return arity == 0 ? nullptr : COMMAND_TABLE.Find(verb, Command::VARIADIC);
+}
+
+gsl::span<const Command> AllCommands()
+{
+	return COMMAND_TABLE.Commands();
+}
+
+} // namespace Playd
@@ -0,0 +1,175 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the command table, and the perfect hash behind it.
+ * @see commands.cpp
+ */
+
+#ifndef PLAYD_COMMANDS_H
+#define PLAYD_COMMANDS_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#undef max
+#include <gsl/gsl>
+
+#include "player.h"
+#include "response.h"
+#include "tokeniser.h"
+
+namespace Playd
+{
+/**
+ * A command that clients can send to playd.
+ *
+ * Commands are looked up by both their verb and their arity, so the same verb
+ * can mean different things with different numbers of arguments.  Commands
+ * with the arity VARIADIC take any number of arguments from one up.
+ */
+struct Command {
+	/// The arity of commands taking one or more arguments.
+	static constexpr std::size_t VARIADIC = SIZE_MAX;
+
+	/**
+	 * Type of command results: the final response, or nothing if the
+	 * command finishes later and responds by itself.
+	 */
+	using Result = std::optional<Response>;
+
+	/**
+	 * Type of command handlers.
+	 * Handlers receive the player, the ID of the client sending the
+	 * command, the command's tag, and its arguments (not including the tag
+	 * or the verb).  They return the command's Result.
+	 */
+	using Handler = Result (*)(Player &, ClientId, Response::Tag, Tokeniser::Line);
+
+	std::string_view verb; ///< The command word, eg 'fload'.
+	std::size_t arity;     ///< The number of arguments the command takes, or VARIADIC.
+	Handler handler;       ///< The function that runs the command.
+};
+
+/**
+ * A table of commands, indexed by a perfect hash of their verbs and arities.
+ *
+ * Both the table and the hash seed are worked out at compile time, so looking
+ * up a command is one hash, one array load and one comparison, however many
+ * commands there are.
+ *
+ * @tparam N The number of commands in the table.
+ */
+template <std::size_t N>
+class CommandTable
+{
+public:
+	/// The number of hash slots; twice the commands, so a seed is easy to find.
+	static constexpr std::size_t SLOTS = std::bit_ceil(N * 2);
+
+	/**
+	 * Constructs a CommandTable.
+	 * This fails to compile if no perfect hash can be found, or if two
+	 * commands share a verb and arity.
+	 * @param commands The commands in the table.
+	 */
+	consteval explicit CommandTable(const std::array<Command, N> &commands) : commands{commands}, seed{0}, slots{}
+	{
+		for (; this->seed < MAX_SEED; this->seed++) {
+			if (this->TryFill()) return;
+		}
+		// Deliberately not a constant expression, so this can't compile.
+		throw "no perfect hash for the command table; is a command duplicated?";
+	}
+
+	/**
+	 * Finds a command.
+	 * @param verb The command word.
+	 * @param arity The number of arguments given with it.
+	 * @return A pointer to the command, or nullptr if there isn't one.
+	 */
+	[[nodiscard]] constexpr const Command *Find(std::string_view verb, std::size_t arity) const
+	{
+		const auto slot = this->slots[Hash(verb, arity, this->seed) % SLOTS];
+		if (slot == EMPTY) return nullptr;
+
+		const auto &command = this->commands[slot];
+		if (command.arity != arity || command.verb != verb) return nullptr;
+		return &command;
+	}
+
+	/// @return The commands, which Find() returns pointers into.
+	[[nodiscard]] gsl::span<const Command> Commands() const
+	{
+		return this->commands;
+	}
+
+private:
+	/// The number of seeds to try before giving up.
+	static constexpr std::uint32_t MAX_SEED = 100000;
+
+	/// Marks a slot with no command in it.
+	static constexpr std::uint8_t EMPTY = UINT8_MAX;
+	static_assert(N < EMPTY, "too many commands for the slot type");
+
+	/**
+	 * Hashes a verb and arity (32-bit FNV-1a, with a seed mixed in).
+	 * @param verb The command word.
+	 * @param arity The number of arguments.
+	 * @param seed The seed.
+	 * @return The hash.
+	 */
+	static constexpr std::uint32_t Hash(std::string_view verb, std::size_t arity, std::uint32_t seed)
+	{
+		auto h = 2166136261u ^ (seed * 0x9E3779B9u);
+		for (const auto c : verb) h = (h ^ static_cast<std::uint8_t>(c)) * 16777619u;
+		h = (h ^ static_cast<std::uint32_t>(arity)) * 16777619u;
+		return h ^ (h >> 16);
+	}
+
+	/**
+	 * Tries to fill the slots using the current seed.
+	 * @return Whether every command got a slot of its own.
+	 */
+	constexpr bool TryFill()
+	{
+		this->slots.fill(EMPTY);
+		for (std::size_t i = 0; i < N; i++) {
+			auto &slot = this->slots[Hash(this->commands[i].verb, this->commands[i].arity, this->seed) % SLOTS];
+			if (slot != EMPTY) return false;
+			slot = static_cast<std::uint8_t>(i);
+		}
+		return true;
+	}
+
+	std::array<Command, N> commands;          ///< The commands.
+	std::uint32_t seed;                       ///< The seed making the hash perfect.
+	std::array<std::uint8_t, SLOTS> slots;    ///< Indices into commands, by hash.
+};
+
+/**
+ * Finds one of playd's commands.
+ * A command taking exactly @a arity arguments wins over a variadic command
+ * with the same verb.
+ * @param verb The command word.
+ * @param arity The number of arguments given with it.
+ * @return A pointer to the command, or nullptr if there isn't one.
+ */
+const Command *FindCommand(std::string_view verb, std::size_t arity);
+
+/**
+ * Lists playd's commands.
+ * FindCommand() returns pointers into this list, so a command's offset in it
+ * can index per-command data.
+ * @return The commands.
+ */
+gsl::span<const Command> AllCommands();
+
+} // namespace Playd
+
+#endif // PLAYD_COMMANDS_H
@@ -0,0 +1,111 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the ConfigFile class.
+ * @see config_file.h
+ */
+
+#include "config_file.h"
+
+#include <algorithm>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "errors.h"
+
+namespace Playd
+{
+/**
+ * Strips spaces and tabs from both ends of a string.
+ * @param s The string.
+ * @return The string, without them.
+ */
+static std::string_view Trim(std::string_view s)
+{
+	const auto first = s.find_first_not_of(" \t\r");
+	if (first == std::string_view::npos) return {};
+	const auto last = s.find_last_not_of(" \t\r");
+	return s.substr(first, last - first + 1);
+}
+
+ConfigFile::ConfigFile(const std::string &path)
+{
+	std::ifstream in{path};
+	if (!in) throw ConfigError("can't read config file: " + path);
+	this->Read(in, path);
+}
+
+ConfigFile::ConfigFile(std::istream &in, std::string_view name)
+{
+	this->Read(in, name);
+}
+
+void ConfigFile::AddOptionsTo(std::vector<std::string_view> &args) const
+{
+	const auto given = [&args](std::string_view option) {
+		const auto name = option.substr(0, option.find('='));
+		return std::any_of(std::next(args.begin()), args.end(), [name](std::string_view arg) {
+			return arg.substr(0, arg.find('=')) == name;
+		});
+	};
+
+	for (const auto &option : this->options) {
+		if (!given(option)) args.emplace_back(option);
+	}
+}
+
+std::optional<std::string_view> ConfigFile::Positional(std::string_view name) const
+{
+	const auto it = std::find_if(this->positionals.begin(), this->positionals.end(),
+	                             [name](const auto &positional) { return positional.first == name; });
+	if (it == this->positionals.end()) return std::nullopt;
+	return it->second;
+}
+
+void ConfigFile::Read(std::istream &in, std::string_view name)
+{
+	std::vector<std::string> seen;
+	std::string line;
+	for (auto number = 1; std::getline(in, line); number++) {
+		const auto invalid = [name, number](std::string_view why) {
+			return ConfigError(std::string{name} + ":" + std::to_string(number) + ": " + std::string{why});
+		};
+
+		const auto text = Trim(line);
+		if (text.empty() || text.front() == '#') continue;
+
+		const auto equals = text.find('=');
+		const auto key = Trim(text.substr(0, equals));
+		const auto has_value = equals != std::string_view::npos;
+		const auto value = has_value ? Trim(text.substr(equals + 1)) : std::string_view{};
+
+		const auto bad_char = [](char c) { return !(('a' <= c && c <= 'z') || ('0' <= c && c <= '9') || c == '-'); };
+		if (key.empty() || key.front() == '-' || std::any_of(key.begin(), key.end(), bad_char)) {
+			throw invalid("not an option name: " + std::string{key});
+		}
+		if (has_value && value.empty()) throw invalid(std::string{key} + " has no value");
+		if (std::find(seen.begin(), seen.end(), key) != seen.end()) {
+			throw invalid(std::string{key} + " is set twice");
+		}
+		seen.emplace_back(key);
+
+		if (std::find(std::begin(POSITIONALS), std::end(POSITIONALS), key) != std::end(POSITIONALS)) {
+			if (!has_value) throw invalid(std::string{key} + " has no value");
+			this->positionals.emplace_back(key, value);
+			continue;
+		}
+
+		auto option = "--" + std::string{key};
+		if (has_value) option += "=" + std::string{value};
+		this->options.push_back(std::move(option));
+	}
+}
+
+} // namespace Playd
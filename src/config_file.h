@@ -0,0 +1,90 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the ConfigFile class.
+ * @see config_file.cpp
+ */
+
+#ifndef PLAYD_CONFIG_FILE_H
+#define PLAYD_CONFIG_FILE_H
+
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Playd
+{
+/**
+ * playd's options, read from a file rather than the command line.
+ *
+ * Each line names a command-line option, without its dashes, and gives its
+ * value after an '=': `buffer = 250-2000` is `--buffer=250-2000`, and a
+ * line of just `fast-start` is `--fast-start`.  Space around the name and
+ * value is ignored, as are blank lines, and lines starting with '#'.  The
+ * positional arguments are named `devices`, `host` and `port`.
+ *
+ * Options on the command line win over the file's, so one file can serve a
+ * host's playds, with each changing what it needs to.
+ */
+class ConfigFile
+{
+public:
+	/// The names of the positional arguments, which aren't options.
+	static constexpr std::string_view POSITIONALS[] = {"devices", "host", "port"};
+
+	/**
+	 * Reads a configuration file.
+	 * @param path The file's path.
+	 * @exception ConfigError if the file can't be read, or a line of it
+	 *   isn't valid.
+	 */
+	explicit ConfigFile(const std::string &path);
+
+	/**
+	 * Reads a configuration from a stream.
+	 * @param in The stream, read to its end.
+	 * @param name What to call the stream in error messages.
+	 * @exception ConfigError if a line of the stream isn't valid.
+	 */
+	ConfigFile(std::istream &in, std::string_view name);
+
+	/**
+	 * Adds the file's options to the program arguments.
+	 * Options already in @a args are left as they are, and the file's
+	 * versions of them skipped.  The arguments point into this ConfigFile,
+	 * so it must outlive them.
+	 * @param args The program argument vector, which is modified in place.
+	 */
+	void AddOptionsTo(std::vector<std::string_view> &args) const;
+
+	/**
+	 * Looks up one of the positional arguments.
+	 * @param name One of POSITIONALS.
+	 * @return The argument, if the file gives it.
+	 */
+	[[nodiscard]] std::optional<std::string_view> Positional(std::string_view name) const;
+
+private:
+	/// The options, as they'd be given on the command line.
+	std::vector<std::string> options;
+
+	/// The positional arguments given, by name.
+	std::vector<std::pair<std::string, std::string>> positionals;
+
+	/**
+	 * Reads the lines of a configuration.
+	 * @param in The stream, read to its end.
+	 * @param name What to call the stream in error messages.
+	 * @exception ConfigError if a line isn't valid.
+	 */
+	void Read(std::istream &in, std::string_view name);
+};
+
+} // namespace Playd
+
+#endif // PLAYD_CONFIG_FILE_H
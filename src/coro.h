@@ -0,0 +1,141 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * The coroutine types used to wait on work off the loop.
+ * @see io.h, for awaitables on the loop itself.
+ */
+
+#ifndef PLAYD_CORO_H
+#define PLAYD_CORO_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace Playd::Coro
+{
+/**
+ * A coroutine run for what it does, rather than for a result.
+ *
+ * It starts as soon as it is called, runs up to its first co_await, and then
+ * carries on wherever that resumes it (for everything here, on the loop's
+ * thread), freeing itself once it finishes.  Nothing waits for it, so it has
+ * to deliver whatever it finds out itself, and handle its own errors: as with
+ * an exception escaping a libuv callback, one escaping a Task ends the process.
+ */
+class Task
+{
+public:
+	/// The promise type, which the compiler builds each Task around.
+	struct promise_type {
+		/// @return The Task, which is just a token.
+		Task get_return_object() noexcept
+		{
+			return {};
+		}
+
+		/// @return An awaitable that runs the coroutine straight away.
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		/// @return An awaitable that frees the coroutine once it ends.
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		/// Does nothing, as Tasks return nothing.
+		void return_void() noexcept
+		{
+		}
+
+		/// Ends the process, as nothing can catch what a Task throws.
+		[[noreturn]] void unhandled_exception() noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+/**
+ * Type for functions that run work in the background.
+ * The first function is the work, which may run on any thread; the second is
+ * called on the loop's thread once the work is done.  This is the shape of
+ * Player::BackgroundFn, and of IO::Core::RunInBackground(), both of which run
+ * the work with uv_queue_work.
+ */
+using RunFn = std::function<void(std::function<void()>, std::function<void()>)>;
+
+/**
+ * An awaitable that runs work with a background runner.
+ * Awaiting it suspends the coroutine until the work is done, then resumes it
+ * on the loop's thread with the work's result, or throws what the work threw.
+ *
+ * Await these from a variable, rather than as temporaries: GCC before 13 can
+ * destroy the temporaries in a co_await expression twice.
+ *
+ * @tparam T The type of the work's result, which can't be void.
+ */
+template <typename T> class InBackground
+{
+	static_assert(!std::is_void_v<T>, "background work must return something to resume with");
+
+public:
+	/**
+	 * Constructs an InBackground.
+	 * @param run The background runner, which must outlive the await.
+	 * @param work The work.
+	 */
+	InBackground(const RunFn &run, std::function<T()> work) : run{run}, work{std::move(work)}
+	{
+	}
+
+	/// @return False, as the work hasn't run yet.
+	[[nodiscard]] bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	/**
+	 * Hands the work to the runner, to resume @a handle when done.
+	 * As the runner may finish everything before it returns, this touches
+	 * nothing of its own once it has called the runner.
+	 * @param handle The awaiting coroutine.
+	 */
+	void await_suspend(std::coroutine_handle<> handle)
+	{
+		auto body = [this] {
+			try {
+				this->result.emplace(this->work());
+			} catch (...) {
+				// We can't throw across threads, so throw again on resuming.
+				this->error = std::current_exception();
+			}
+		};
+		this->run(std::move(body), [handle] { handle.resume(); });
+	}
+
+	/// @return The work's result.
+	T await_resume()
+	{
+		if (this->error) std::rethrow_exception(this->error);
+		return std::move(*this->result);
+	}
+
+private:
+	const RunFn &run;          ///< The background runner.
+	std::function<T()> work;   ///< The work.
+	std::optional<T> result;   ///< The work's result, once it has one.
+	std::exception_ptr error;  ///< What the work threw, if anything.
+};
+
+} // namespace Playd::Coro
+
+#endif // PLAYD_CORO_H
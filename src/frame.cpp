@@ -0,0 +1,97 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of the FrameReader class.
+ * @see frame.h
+ */
+
+#include "frame.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "tokeniser.h"
+
+namespace Playd
+{
+/// The size of a request frame's word count.
+static constexpr std::size_t COUNT_BYTES = 1;
+
+/// The size of the length prefixing each word in a request frame.
+static constexpr std::size_t WORD_LENGTH_BYTES = 4;
+
+bool FrameReader::Feed(std::string_view raw, const Tokeniser::LineHandler &on_line)
+{
+	// Finish off any frame left over from last time.  We only take as
+	// much of raw as we need, so any later frames can be read in place.
+	if (!this->partial.empty()) {
+		if (this->partial.size() < LENGTH_BYTES) {
+			const auto take = std::min(LENGTH_BYTES - this->partial.size(), raw.size());
+			this->partial.append(raw.substr(0, take));
+			raw.remove_prefix(take);
+			if (this->partial.size() < LENGTH_BYTES) return true;
+		}
+
+		const auto length = GetBigEndian(this->partial.data(), LENGTH_BYTES);
+		if (MAX_FRAME < length) return false;
+
+		const auto total = LENGTH_BYTES + length;
+		const auto take = std::min(total - this->partial.size(), raw.size());
+		this->partial.append(raw.substr(0, take));
+		raw.remove_prefix(take);
+		if (this->partial.size() < total) return true;
+
+		const auto ok = this->Decode(std::string_view{this->partial}.substr(LENGTH_BYTES), on_line);
+		this->partial.clear();
+		if (!ok) return false;
+	}
+
+	while (LENGTH_BYTES <= raw.size()) {
+		const auto length = GetBigEndian(raw.data(), LENGTH_BYTES);
+		if (MAX_FRAME < length) return false;
+		if (raw.size() < LENGTH_BYTES + length) break;
+
+		if (!this->Decode(raw.substr(LENGTH_BYTES, length), on_line)) return false;
+		raw.remove_prefix(LENGTH_BYTES + length);
+	}
+
+	// Whatever is left is the start of a frame that finishes later.
+	this->partial.assign(raw);
+	return true;
+}
+
+std::size_t FrameReader::HeldBytes() const
+{
+	return this->partial.capacity() + this->views.capacity() * sizeof(std::string_view);
+}
+
+bool FrameReader::Decode(std::string_view frame, const Tokeniser::LineHandler &on_line)
+{
+	if (frame.size() < COUNT_BYTES) return false;
+	const auto count = GetBigEndian(frame.data(), COUNT_BYTES);
+	frame.remove_prefix(COUNT_BYTES);
+
+	this->views.clear();
+	for (std::uint64_t i = 0; i < count; i++) {
+		if (frame.size() < WORD_LENGTH_BYTES) return false;
+		const auto length = GetBigEndian(frame.data(), WORD_LENGTH_BYTES);
+		frame.remove_prefix(WORD_LENGTH_BYTES);
+
+		if (frame.size() < length) return false;
+		this->views.push_back(frame.substr(0, length));
+		frame.remove_prefix(length);
+	}
+
+	// Trailing junk means the client and we disagree about the format.
+	if (!frame.empty()) return false;
+
+	on_line(this->views);
+	return true;
+}
+
+} // namespace Playd
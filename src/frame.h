@@ -0,0 +1,101 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the FrameReader class, and helpers for binary frames.
+ * @see frame.cpp
+ * @see README.commands.md
+ */
+
+#ifndef PLAYD_FRAME_H
+#define PLAYD_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tokeniser.h"
+
+namespace Playd
+{
+/**
+ * Appends an unsigned integer, big-endian, to a string.
+ * @param out The string to append to.
+ * @param value The integer to append.
+ * @param bytes How many of the integer's low bytes to append.
+ */
+inline void PutBigEndian(std::string &out, std::uint64_t value, std::size_t bytes)
+{
+	for (auto shift = bytes * 8; shift != 0; shift -= 8) out.push_back(static_cast<char>(value >> (shift - 8)));
+}
+
+/**
+ * Reads a big-endian unsigned integer from raw bytes.
+ * @param in The bytes to read; there must be at least @a bytes of them.
+ * @param bytes How many bytes the integer takes up.
+ * @return The integer.
+ */
+inline std::uint64_t GetBigEndian(const char *in, std::size_t bytes)
+{
+	std::uint64_t value = 0;
+	for (std::size_t i = 0; i < bytes; i++) value = (value << 8) | static_cast<std::uint8_t>(in[i]);
+	return value;
+}
+
+/**
+ * A reader for binary-framed requests.
+ *
+ * This is the binary protocol's equivalent of a Tokeniser.  Each frame is a
+ * 32-bit length, then a word count, then that many length-prefixed words; the
+ * words come out as a Tokeniser::Line, so the same command handling serves
+ * both protocols.  Words are views into the fed data where a frame arrives in
+ * one piece, and into a buffer otherwise.
+ */
+class FrameReader
+{
+public:
+	/// The largest frame, not counting its length prefix, that we accept.
+	static constexpr std::size_t MAX_FRAME = 64 * 1024;
+
+	/// The size of a frame's length prefix.
+	static constexpr std::size_t LENGTH_BYTES = 4;
+
+	/**
+	 * Feeds a chunk of data into the FrameReader.
+	 * @param raw The raw data to feed.  This only needs to live until Feed
+	 *   returns, and need not contain whole frames.
+	 * @param on_line The function to call with each frame completed by this
+	 *   chunk, in order.
+	 * @return False if the data contained a malformed or oversized frame;
+	 *   the FrameReader can't be used after this.
+	 */
+	[[nodiscard]] bool Feed(std::string_view raw, const Tokeniser::LineHandler &on_line);
+
+	/**
+	 * How much memory the FrameReader holds on to between chunks.
+	 * @return The size of its buffers, in bytes.
+	 */
+	[[nodiscard]] std::size_t HeldBytes() const;
+
+private:
+	/**
+	 * Decodes one whole frame, and sends its words off.
+	 * @param frame The frame, without its length prefix.
+	 * @param on_line The function to send the frame's words to.
+	 * @return Whether the frame was well-formed.
+	 */
+	bool Decode(std::string_view frame, const Tokeniser::LineHandler &on_line);
+
+	/// Part of a frame left over from a previous Feed.
+	std::string partial;
+
+	/// Where views of the current frame's words are built up.
+	std::vector<std::string_view> views;
+};
+
+} // namespace Playd
+
+#endif // PLAYD_FRAME_H
@@ -0,0 +1,81 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Runs a fuzz target over files, without libFuzzer.
+ *
+ * This stands in for libFuzzer's own main() when the fuzz targets are built
+ * without it, so that their corpora can still be run as regression tests
+ * with any compiler.  Each argument is a file, or a directory of files, to
+ * run the target on once each; options meant for libFuzzer (such as the
+ * -runs=0 that makes it only run the corpus) are ignored.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size);
+
+namespace
+{
+/**
+ * Runs the fuzz target on one file.
+ * @param path The file.
+ * @return Whether the file could be read.
+ */
+bool RunFile(const std::filesystem::path &path)
+{
+	std::ifstream in{path, std::ios::binary};
+	if (!in) {
+		std::cerr << path.string() << ": can't open" << std::endl;
+		return false;
+	}
+
+	const std::vector<char> bytes{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+	LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t *>(bytes.data()), bytes.size());
+	return true;
+}
+
+} // namespace
+
+/**
+ * The driver's entry point.
+ * @param argc Program argument count.
+ * @param argv Program argument vector.
+ * @return The exit code (zero if every file was run; non-zero otherwise).
+ */
+int main(int argc, char *argv[])
+{
+	auto status = EXIT_SUCCESS;
+	std::size_t runs = 0;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-') continue;
+
+		const std::filesystem::path path{argv[i]};
+		if (!std::filesystem::is_directory(path)) {
+			if (!RunFile(path)) status = EXIT_FAILURE;
+			runs++;
+			continue;
+		}
+
+		for (const auto &entry : std::filesystem::directory_iterator(path)) {
+			if (!entry.is_regular_file()) continue;
+			if (!RunFile(entry.path())) status = EXIT_FAILURE;
+			runs++;
+		}
+	}
+
+	if (runs == 0) {
+		std::cerr << "usage: " << argv[0] << " FILE-OR-DIR..." << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cerr << "ran " << runs << " inputs" << std::endl;
+	return status;
+}
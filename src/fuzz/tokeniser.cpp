@@ -0,0 +1,104 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Fuzz target for the Tokeniser class.
+ *
+ * However a stream of bytes is cut into reads, a Tokeniser should find the
+ * same lines in it.  This feeds each input three ways: in one read (so that
+ * whole lines take the in-place path where they can), a byte at a time (so
+ * that every line takes the character-by-character path), and in reads cut
+ * where the input's own bytes say, and aborts if any two disagree.  It then
+ * does the same with tight limits, which every way of feeding should reject
+ * at the same line.  Anything replacing the tokeniser has to agree with this
+ * one in the same way.
+ *
+ * Built with Clang and WITH_FUZZERS, this is a libFuzzer target; otherwise,
+ * src/fuzz/standalone.cpp runs it over files, which is how the inputs in
+ * src/fuzz/corpus/tokeniser are checked as regression tests.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../tokeniser.h"
+
+namespace
+{
+/// Type of the lines a Tokeniser finds, copied out.
+using Lines = std::vector<std::vector<std::string>>;
+
+/// Limits tight enough for the fuzzer's inputs to go over them often.
+constexpr Playd::Tokeniser::Limits TIGHT{64, 8};
+
+/// What feeding an input found.
+struct Outcome {
+	Lines lines;   ///< The lines found.
+	bool rejected; ///< Whether a line went over the limits.
+
+	bool operator==(const Outcome &) const = default;
+};
+
+/**
+ * Feeds an input through a fresh Tokeniser, cut into reads.
+ * @param input The input.
+ * @param limits The Tokeniser's limits.
+ * @param next_size Gives the size of the read starting at an offset.
+ * @return What was found.
+ */
+template <typename SizeFn> Outcome Feed(std::string_view input, Playd::Tokeniser::Limits limits, SizeFn next_size)
+{
+	Playd::Tokeniser tokeniser{limits};
+	Outcome outcome{{}, false};
+	const Playd::Tokeniser::LineHandler on_line = [&outcome](Playd::Tokeniser::Line line) {
+		outcome.lines.emplace_back(line.begin(), line.end());
+	};
+
+	for (std::size_t at = 0; at < input.size() && !outcome.rejected;) {
+		const auto size = next_size(at);
+		outcome.rejected = !tokeniser.Feed(input.substr(at, size), on_line);
+		at += size;
+	}
+	return outcome;
+}
+
+/**
+ * Aborts because two ways of feeding an input disagreed.
+ * @param how The way that disagreed with feeding in one read.
+ */
+[[noreturn]] void Disagree(const char *how)
+{
+	std::fprintf(stderr, "tokeniser: feeding %s disagrees with feeding in one read\n", how);
+	std::abort();
+}
+
+} // namespace
+
+/**
+ * Checks one input.
+ * @param data The input.
+ * @param size Its size, in bytes.
+ * @return 0, always; disagreements abort.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size)
+{
+	const std::string_view input{reinterpret_cast<const char *>(data), size};
+
+	// Cutting where the input says lets the fuzzer steer cuts into the
+	// middle of quotes, escapes and newlines.
+	const auto cut = [input](std::size_t at) { return std::size_t{1} + static_cast<std::uint8_t>(input[at]) % 16; };
+
+	for (const auto limits : {Playd::Tokeniser::Limits{}, TIGHT}) {
+		const auto whole = Feed(input, limits, [size](std::size_t) { return size; });
+		if (Feed(input, limits, [](std::size_t) { return 1; }) != whole) Disagree("a byte at a time");
+		if (Feed(input, limits, cut) != whole) Disagree("in uneven reads");
+	}
+
+	return 0;
+}
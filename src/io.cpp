@@ -15,9 +15,25 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
 #include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 // If UNICODE is defined on Windows, it'll select the wide-char gai_strerror.
 // We don't want this.
@@ -30,36 +46,211 @@ typedef ptrdiff_t ssize_t;
 #endif
 #include <uv.h>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "audio/rt_memory.h"
+#include "commands.h"
+#include "coro.h"
 #include "errors.h"
 #include "io.h"
 #include "messages.h"
+#include "metrics.h"
 #include "player.h"
 #include "response.h"
+#include "trace.h"
 
 namespace Playd::IO
 {
 static_assert(BROADCAST == 0, "current Core logic assumes BROADCAST=0");
 
-const std::uint16_t Core::PLAYER_UPDATE_PERIOD = 5; // ms
-
 //
 // libuv callbacks
 //
 // These should generally trampoline back into class methods.
 //
 
-/// The function used to allocate and initialise buffers for client reading.
-void UvAlloc(uv_handle_t *, size_t suggested_size, uv_buf_t *buf)
+/**
+ * A write of several responses at once.
+ *
+ * This owns the responses' bytes until libuv has finished writing them.
+ */
+struct WriteRequest {
+	uv_write_t req;                    ///< The libuv write request.
+	std::vector<PackedResponse> lines; ///< The responses being written.
+	std::vector<Connection::Arrival> replies; ///< The commands those responses reply to.
+};
+
+/**
+ * A client's socket, on the shard whose listener accepted it.
+ *
+ * The core's Connection decides what happens to it, but only the shard
+ * touches the handle.  The handle closes once the core has released it
+ * and any shutdown has finished, and the stream goes with it.
+ */
+struct ShardStream {
+	uv_tcp_t tcp{};              ///< The libuv handle, on the shard's loop.
+	Shard *shard{nullptr};       ///< The shard.
+	Channel *channel{nullptr};   ///< The channel, which only the core touches.
+	ClientId id{BROADCAST};      ///< The connection's ID, once adopted.
+	std::string peer;            ///< The client's host and port.
+	std::atomic<size_t> queued{0}; ///< The bytes handed over to write, but not yet written.
+
+	/// What the client may do.
+	ListenerPolicy policy{ListenerPolicy::CONTROL};
+
+	bool shutting_down{false}; ///< Whether a shutdown is going (shard only).
+	bool released{false};      ///< Whether the core is done with it (shard only).
+};
+
+/// A shard's listener for one channel's clients.
+struct ShardListener {
+	uv_tcp_t tcp{};            ///< The libuv handle, on the shard's loop.
+	Shard *shard{nullptr};     ///< The shard.
+	Channel *channel{nullptr}; ///< The channel whose clients it accepts.
+
+	/// What its clients may do.
+	ListenerPolicy policy{ListenerPolicy::CONTROL};
+};
+
+/// A channel's listener, on the main loop.
+struct ChannelListener {
+	uv_tcp_t tcp{};            ///< The libuv handle.
+	Channel *channel{nullptr}; ///< The channel whose clients it accepts.
+
+	/// What its clients may do.
+	ListenerPolicy policy{ListenerPolicy::CONTROL};
+};
+
+/**
+ * Works out the socket address to bind a listener to.
+ * @param host The IPv4 or IPv6 host.
+ * @param port The TCP port.
+ * @return The address, of whichever family @a host is in.
+ * @exception NetError Thrown if @a host or @a port isn't valid.
+ */
+sockaddr_storage BindAddress(std::string_view host, std::string_view port)
+{
+	std::uint16_t port_num = 0;
+	const auto end = port.data() + port.size();
+	const auto [p, ec] = std::from_chars(port.data(), end, port_num);
+	if (port.empty() || ec != std::errc{} || p != end) throw NetError("not a valid port: " + std::string{port});
+
+	// IPv6 addresses are the only ones with colons in.
+	const std::string host_str{host};
+	sockaddr_storage addr{};
+	const auto r = host_str.find(':') == std::string::npos
+	                       ? uv_ip4_addr(host_str.c_str(), port_num, reinterpret_cast<sockaddr_in *>(&addr))
+	                       : uv_ip6_addr(host_str.c_str(), port_num, reinterpret_cast<sockaddr_in6 *>(&addr));
+	if (r) throw NetError("not a valid address: " + host_str + " (" + uv_err_name(r) + ")");
+	return addr;
+}
+
+/**
+ * Gets a client's host and port.
+ * @param tcp The client's libuv handle.
+ * @return The client's name, in the form "HOST:PORT", unless errors occur.
+ */
+std::string PeerName(uv_tcp_t *tcp)
+{
+	// Warning: fairly low-level Berkeley sockets code ahead!
+	// (Thankfully, libuv makes sure the appropriate headers are included.)
+
+	// Using this instead of struct sockaddr is advised by the libuv docs,
+	// for IPv6 compatibility.
+	struct sockaddr_storage s {
+	};
+	auto sp = (struct sockaddr *)&s;
+
+	// Turns out if you don't do this, Windows (and only Windows?) is upset.
+	socklen_t namelen = sizeof(s);
+
+	const auto pe = uv_tcp_getpeername(tcp, sp, (int *)&namelen);
+	// These std::string()s are needed as, otherwise, the compiler would
+	// think we're trying to add const char*s together.  We need AT LEAST
+	// ONE of the sides of the first + to be a std::string.
+	if (pe) return "<error@peer: " + std::string(uv_strerror(pe)) + ">";
+
+	// Now, split the sockaddr into host and service.
+	char host[NI_MAXHOST];
+	char serv[NI_MAXSERV];
+
+	// We use NI_NUMERICSERV to ensure a port number comes out.
+	// Otherwise, we could get a (likely erroneous) string description of
+	// what the network stack *thinks* the port is used for.
+	const auto ne = getnameinfo(sp, namelen, host, sizeof(host), serv, sizeof(serv), NI_NUMERICSERV);
+	// See comment for above error.
+	if (ne) return "<error@name: " + std::string(gai_strerror(ne)) + ">";
+
+	return host + std::string(":") + serv;
+}
+
+/**
+ * Makes the buffers for a write, one per response.
+ * This saves copying them all into one string.
+ * @param write The write.
+ * @return The buffers, which libuv copies, so they can live on the stack.
+ */
+std::vector<uv_buf_t> WriteBuffers(const WriteRequest &write)
+{
+	// libuv never writes into the buffers, so casting away const is safe.
+	std::vector<uv_buf_t> bufs;
+	bufs.reserve(write.lines.size());
+	for (const auto &line : write.lines) {
+		bufs.push_back(uv_buf_init(const_cast<char *>(line->data()), line->size()));
+	}
+	return bufs;
+}
+
+/**
+ * Traces a finished write, and times the replies in it.
+ * @param write The write.
+ * @return The bytes written.
+ */
+std::size_t RecordWrite(const WriteRequest &write)
+{
+	std::size_t bytes = 0;
+	for (const auto &line : write.lines) bytes += line->size();
+	Trace::Record(TraceKind::WRITE_DONE, bytes);
+
+	const auto now = std::chrono::steady_clock::now();
+	for (const auto &[command, arrived] : write.replies) {
+		Metrics::RecordCommand(*command, Metrics::CommandStage::REPLIED,
+		                       std::chrono::duration_cast<std::chrono::microseconds>(now - arrived));
+	}
+	return bytes;
+}
+
+/// The function used to allocate buffers for client reading.
+void UvAlloc(uv_handle_t *handle, size_t, uv_buf_t *buf)
+{
+	assert(handle != nullptr);
+
+	auto *io = static_cast<Core *>(handle->loop->data);
+	assert(io != nullptr);
+
+	// UvReadCallback gives this back to the pool when the read is done.
+	*buf = io->ReadBuffers().Acquire();
+}
+
+/// The callback fired when one of a channel's TCP servers closes.
+void UvChannelListenerCloseCallback(uv_handle_t *handle)
 {
-	// Since we used new here, we need to use delete when we finish reading.
-	*buf = uv_buf_init(new char[suggested_size](), suggested_size);
+	assert(handle != nullptr);
+	delete static_cast<ChannelListener *>(handle->data);
 }
 
 /// The callback fired when a client connection closes.
 void UvCloseCallback(uv_handle_t *handle)
 {
 	assert(handle != nullptr);
-	delete handle;
+	if (handle->type == UV_NAMED_PIPE) {
+		delete reinterpret_cast<uv_pipe_t *>(handle);
+	} else {
+		delete reinterpret_cast<uv_tcp_t *>(handle);
+	}
 }
 
 /// The callback fired when some bytes are read from a client connection.
@@ -70,9 +261,17 @@ void UvReadCallback(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
 	auto *tcp = static_cast<Connection *>(stream->data);
 	assert(tcp != nullptr);
 
-	// NB: Read delete[]s buf->base, so we don't.
+	// Read can de-pool the connection, destroying it, so get at the
+	// buffer pool through the loop rather than through the connection.
+	auto *io = static_cast<Core *>(stream->loop->data);
+	assert(io != nullptr);
+
 	tcp->Read(nread, buf);
 
+	// libuv can call us without a buffer (on errors, for instance), and
+	// Release copes with that.
+	io->ReadBuffers().Release(buf->base);
+
 	// We don't delete the handle.
 	// It will be used for future reads on this client!
 }
@@ -83,10 +282,130 @@ void UvListenCallback(uv_stream_t *server, int status)
 	assert(server != nullptr);
 	if (status < 0) return;
 
+	auto *listener = static_cast<ChannelListener *>(server->data);
+	assert(listener != nullptr);
+
+	listener->channel->Accept(server, listener->policy);
+}
+
+/// The callback fired when a client connects to a Unix socket server.
+void UvLocalListenCallback(uv_stream_t *server, int status)
+{
+	assert(server != nullptr);
+	if (status < 0) return;
+
+	auto *channel = static_cast<Channel *>(server->data);
+	assert(channel != nullptr);
+
+	// Only this host can reach the socket, so its clients are trusted.
+	channel->Accept(server, ListenerPolicy::CONTROL);
+}
+
+/**
+ * A scrape of the metrics listener, from connection to reply.
+ * Scrapes are tiny and rare, so each gets a buffer of its own.
+ */
+struct Scrape {
+	uv_tcp_t tcp;                 ///< The scraper's connection.
+	std::array<char, 1024> read;  ///< Where reads go.
+	std::string request;          ///< The request, so far.
+	std::string reply;            ///< The reply, kept until written.
+};
+
+/// The longest metrics request read before answering anyway.
+constexpr std::size_t MAX_SCRAPE_REQUEST = 8192;
+
+/// A running Sleep's timer, which has to outlive the Sleep until it closes.
+struct SleepTimer {
+	uv_timer_t timer;                ///< The libuv timer.
+	std::coroutine_handle<> waiting; ///< The coroutine to resume.
+};
+
+/// The callback fired when a Sleep's timer has closed.
+void UvSleepCloseCallback(uv_handle_t *handle)
+{
+	assert(handle != nullptr);
+	delete static_cast<SleepTimer *>(handle->data);
+}
+
+/// The callback fired when a Sleep's timer goes off.
+void UvSleepCallback(uv_timer_t *handle)
+{
+	assert(handle != nullptr);
+	auto *timer = static_cast<SleepTimer *>(handle->data);
+	assert(timer != nullptr);
+
+	// The coroutine may be gone by the time the timer closes.
+	const auto waiting = timer->waiting;
+	uv_close(reinterpret_cast<uv_handle_t *>(handle), UvSleepCloseCallback);
+	waiting.resume();
+}
+
+/// The callback fired when a scrape's connection closes.
+void UvScrapeCloseCallback(uv_handle_t *handle)
+{
+	assert(handle != nullptr);
+	delete static_cast<Scrape *>(handle->data);
+}
+
+/// Closes a scrape's connection, and frees the scrape.
+void CloseScrape(Scrape *scrape)
+{
+	uv_close(reinterpret_cast<uv_handle_t *>(&scrape->tcp), UvScrapeCloseCallback);
+}
+
+/// The function used to allocate buffers for scrape reading.
+void UvScrapeAlloc(uv_handle_t *handle, size_t, uv_buf_t *buf)
+{
+	assert(handle != nullptr);
+	auto *scrape = static_cast<Scrape *>(handle->data);
+	*buf = uv_buf_init(scrape->read.data(), scrape->read.size());
+}
+
+/// Sends a scrape's reply, then closes its connection, written or not.
+Coro::Task SendScrapeReply(Scrape *scrape)
+{
+	Write write{reinterpret_cast<uv_stream_t *>(&scrape->tcp), scrape->reply};
+	std::ignore = co_await write;
+	CloseScrape(scrape);
+}
+
+/// The callback fired when some of a scrape's request arrives.
+void UvScrapeReadCallback(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+	assert(stream != nullptr);
+	auto *scrape = static_cast<Scrape *>(stream->data);
+	assert(scrape != nullptr);
+
+	if (nread < 0) {
+		CloseScrape(scrape);
+		return;
+	}
+	scrape->request.append(buf->base, static_cast<std::size_t>(nread));
+
+	// Only the request line matters, but the scraper expects us to wait
+	// for the rest of the head.
+	const auto &request = scrape->request;
+	const auto whole = request.find("\r\n\r\n") != std::string::npos || request.find("\n\n") != std::string::npos;
+	if (!whole && request.size() < MAX_SCRAPE_REQUEST) return;
+	uv_read_stop(stream);
+
+	auto *io = static_cast<Core *>(stream->loop->data);
+	assert(io != nullptr);
+	scrape->reply = Metrics::Serve(request, io->SampleChannels(), io->SampleProcess());
+	SendScrapeReply(scrape);
+}
+
+/// The callback fired when a scraper connects to the metrics listener.
+void UvScrapeListenCallback(uv_stream_t *server, int status)
+{
+	assert(server != nullptr);
+	if (status < 0) return;
+
 	auto *io = static_cast<Core *>(server->data);
 	assert(io != nullptr);
 
-	io->Accept(server);
+	io->AcceptScrape(server);
 }
 
 /// The callback fired when a response has been sent to a client.
@@ -98,121 +417,1080 @@ void UvWriteCallback(uv_write_t *req, int status)
 		Debug() << "UvRespondCallback: got status:" << status << std::endl;
 	}
 
-	// We receive the write buffer as the write_t's data pointer.
-	// This is because something has to delete[] it,
-	// and we drew the short straw.
-	auto *buf = static_cast<char *>(req->data);
-	assert(buf != nullptr);
+	// We receive the write request, and the buffers it points into, as
+	// the write_t's data pointer.  Something has to delete them, and we
+	// drew the short straw.
+	auto *write = static_cast<WriteRequest *>(req->data);
+	assert(write != nullptr);
+
+	// The connection clears its handle's data as it goes, so writes
+	// cancelled by its closing don't reach it.
+	if (auto *conn = static_cast<Connection *>(req->handle->data)) conn->WriteDone();
+
+	std::ignore = RecordWrite(*write);
+	delete write;
+}
+
+//
+// Shard callbacks
+//
+// These run on the shards' threads.  Anything that needs a Connection is
+// posted to the core, which looks the connection up by ID, in case it has
+// gone in the meantime.
+//
+
+/// The callback fired when a shard's client connection closes.
+void UvShardCloseCallback(uv_handle_t *handle)
+{
+	assert(handle != nullptr);
+	delete static_cast<ShardStream *>(handle->data);
+}
+
+/**
+ * Closes a shard's client connection, unless a shutdown is still going;
+ * the shutdown closes it, once it's done, if the core has released it.
+ * @param stream The client connection.
+ */
+void CloseShardStream(ShardStream *stream)
+{
+	auto *handle = reinterpret_cast<uv_handle_t *>(&stream->tcp);
+	if (stream->shutting_down || uv_is_closing(handle)) return;
+	uv_close(handle, UvShardCloseCallback);
+}
+
+/**
+ * Lets go of a shard's client connection, once the core has.
+ * @param stream The client connection.
+ */
+void ReleaseShardStream(ShardStream *stream)
+{
+	stream->released = true;
+	CloseShardStream(stream);
+}
+
+/**
+ * Posts a task to the core for a shard's client connection.
+ * @param stream The client connection.
+ * @param task The task, given the connection if it still exists.
+ */
+template <typename F>
+void PostToConnection(ShardStream *stream, F task)
+{
+	auto *channel = stream->channel;
+	const auto id = stream->id;
+	stream->shard->Owner().Post([channel, id, task = std::move(task)]() mutable {
+		if (auto *conn = channel->Find(id)) task(*conn);
+	});
+}
+
+/// The function used to allocate buffers for client reading on a shard.
+void UvShardAlloc(uv_handle_t *handle, size_t, uv_buf_t *buf)
+{
+	assert(handle != nullptr);
+
+	auto *stream = static_cast<ShardStream *>(handle->data);
+	assert(stream != nullptr);
+
+	*buf = stream->shard->ReadBuffers().Acquire();
+}
+
+/// The callback fired when some bytes are read from a client on a shard.
+void UvShardReadCallback(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
+{
+	assert(handle != nullptr);
+
+	auto *stream = static_cast<ShardStream *>(handle->data);
+	assert(stream != nullptr);
+
+	// As with local connections, the core decides when a connection goes.
+	if (nread < 0) {
+		if (nread != UV_EOF) Debug() << "Error on" << stream->peer << "-" << uv_err_name(nread) << std::endl;
+		uv_read_stop(handle);
+		PostToConnection(stream, [](Connection &conn) { conn.Depool(); });
+	} else if (0 < nread && stream->policy != ListenerPolicy::READ_ONLY) {
+		// The bytes are copied out so that the buffer can go back now.
+		std::string bytes{buf->base, static_cast<size_t>(nread)};
+		PostToConnection(stream, [bytes = std::move(bytes), arrived = std::chrono::steady_clock::now()](
+		                                 Connection &conn) { conn.Feed(bytes, arrived); });
+	}
+
+	stream->shard->ReadBuffers().Release(buf->base);
+}
+
+/// The callback fired when a write to a client on a shard finishes.
+void UvShardWriteCallback(uv_write_t *req, int status)
+{
+	assert(req != nullptr);
+
+	if (status) {
+		Debug() << "UvShardWriteCallback: got status:" << status << std::endl;
+	}
+
+	std::unique_ptr<WriteRequest> write{static_cast<WriteRequest *>(req->data)};
+	auto *stream = static_cast<ShardStream *>(req->handle->data);
+	assert(stream != nullptr);
+
+	// The core only needs to hear once everything it handed over is out.
+	const auto bytes = RecordWrite(*write);
+	if (stream->queued.fetch_sub(bytes, std::memory_order_acq_rel) == bytes) {
+		PostToConnection(stream, [](Connection &conn) { conn.WriteDone(); });
+	}
+}
+
+/**
+ * Starts writing responses, handed over by the core, to a client on a shard.
+ * @param stream The client connection.
+ * @param write The write, which the shard now owns.
+ */
+void StartShardWrite(ShardStream *stream, WriteRequest *write)
+{
+	write->req.data = static_cast<void *>(write);
+	auto bufs = WriteBuffers(*write);
+	const auto count = static_cast<unsigned int>(bufs.size());
+	const auto r = uv_write(&write->req, reinterpret_cast<uv_stream_t *>(&stream->tcp), bufs.data(), count,
+	                        UvShardWriteCallback);
+	if (r == 0) return;
+
+	// The client has probably gone; the read callback will tell the core.
+	std::size_t bytes = 0;
+	for (const auto &line : write->lines) bytes += line->size();
+	stream->queued.fetch_sub(bytes, std::memory_order_acq_rel);
+	delete write;
+}
+
+/// The callback fired when a client on a shard is shut down.
+void UvShardShutdownCallback(uv_shutdown_t *req, int status)
+{
+	assert(req != nullptr);
+
+	if (status) {
+		Debug() << "UvShardShutdownCallback: got status:" << status << std::endl;
+	}
+
+	auto *stream = static_cast<ShardStream *>(req->handle->data);
+	assert(stream != nullptr);
+	delete req;
+
+	stream->shutting_down = false;
+	PostToConnection(stream, [](Connection &conn) { conn.Depool(); });
+	if (stream->released) CloseShardStream(stream);
+}
+
+/**
+ * Starts shutting down a client on a shard.
+ * @param stream The client connection.
+ */
+void StartShardShutdown(ShardStream *stream)
+{
+	auto *req = new uv_shutdown_t;
+	if (uv_shutdown(req, reinterpret_cast<uv_stream_t *>(&stream->tcp), UvShardShutdownCallback)) {
+		// There's nothing left to shut down, so the client can go now.
+		delete req;
+		PostToConnection(stream, [](Connection &conn) { conn.Depool(); });
+		return;
+	}
+	stream->shutting_down = true;
+}
+
+/// The callback fired when a shard's listener closes.
+void UvShardListenerCloseCallback(uv_handle_t *handle)
+{
+	assert(handle != nullptr);
+	delete static_cast<ShardListener *>(handle->data);
+}
+
+/// The callback fired when a shard's listener gets a new client.
+void UvShardListenCallback(uv_stream_t *server, int status)
+{
+	assert(server != nullptr);
+	if (status < 0) return;
+
+	auto *listener = static_cast<ShardListener *>(server->data);
+	assert(listener != nullptr);
+
+	listener->shard->Accept(*listener);
+}
+
+/// The callback fired when the core posts tasks to a shard.
+void UvShardWakeCallback(uv_async_t *handle)
+{
+	assert(handle != nullptr);
+
+	auto *shard = static_cast<Shard *>(handle->data);
+	assert(shard != nullptr);
+
+	shard->RunPosted();
+}
+
+/// The callback fired when a shard posts tasks to the core.
+void UvInboxCallback(uv_async_t *handle)
+{
+	assert(handle != nullptr);
+
+	auto *io = static_cast<Core *>(handle->data);
+	assert(io != nullptr);
+
+	io->RunPosted();
+}
+
+/// The callback fired when the update timer fires.
+void UvUpdateTimerCallback(uv_timer_t *handle)
+{
+	assert(handle != nullptr);
+
+	auto *channel = static_cast<Channel *>(handle->data);
+	assert(channel != nullptr);
+
+	channel->UpdatePlayer();
+
+	// We don't delete the handle.
+	// It is being used for other timer fires.
+}
+
+/// The callback fired when something asks for a player update.
+void UvPlayerWakeCallback(uv_async_t *handle)
+{
+	assert(handle != nullptr);
+
+	auto *channel = static_cast<Channel *>(handle->data);
+	assert(channel != nullptr);
+
+	channel->UpdatePlayer();
+}
+
+/// The callback fired when SIGINT occurs.
+void UvSigintCallback(uv_signal_t *handle, int signum)
+{
+	assert(handle != nullptr);
+
+	auto *io = static_cast<Core *>(handle->data);
+	assert(io != nullptr);
+
+	if (signum != SIGINT) return;
+
+	Debug() << "Caught SIGINT, closing..." << std::endl;
+	io->Quit();
+
+	// We don't delete the handle.
+	// It is being used for other signals.
+}
+
+/// The callback fired when SIGUSR1 occurs, which asks for a trace dump.
+void UvSigusr1Callback(uv_signal_t *handle, int)
+{
+	assert(handle != nullptr);
+
+	Trace::Dump();
+}
+
+/// The callback fired when a client is shut down.
+void UvShutdownCallback(uv_shutdown_t *handle, int status)
+{
+	assert(handle != nullptr);
+
+	if (status) {
+		Debug() << "UvShutdownCallback: got status:" << status << std::endl;
+	}
+
+	auto *conn = static_cast<Connection *>(handle->data);
+	assert(conn != nullptr);
+
+	// Now actually tell the client to die off.
+	conn->Depool();
+
+	// This handle was created specifically for this shutdown.
+	// We thus have to delete it.
+	delete handle;
+}
+
+/// Work queued on the libuv threadpool by Channel::RunInBackground (or,
+/// with no channel, Core::RunInBackground).
+struct BackgroundWork {
+	uv_work_t req;              ///< The libuv request.
+	Channel *channel;           ///< The channel whose player queued it, if any.
+	std::function<void()> work; ///< What to do on the threadpool.
+	std::function<void()> done; ///< What to do on the loop afterwards.
+};
+
+/// The callback fired on a threadpool thread to do background work.
+void UvWorkCallback(uv_work_t *req)
+{
+	assert(req != nullptr);
+
+	static_cast<BackgroundWork *>(req->data)->work();
+}
+
+/// The callback fired on the loop thread when background work is done.
+void UvAfterWorkCallback(uv_work_t *req, int status)
+{
+	assert(req != nullptr);
+
+	if (status) {
+		Debug() << "UvAfterWorkCallback: got status:" << status << std::endl;
+	}
+
+	// This request was created specifically for this work, so we own it.
+	std::unique_ptr<BackgroundWork> bg{static_cast<BackgroundWork *>(req->data)};
+	bg->done();
+
+	if (bg->channel != nullptr) bg->channel->UpdatePlayer();
+}
+
+PackedResponse PackResponse(const Response &response)
+{
+	// PackInto provides us the response's wire format, except the newline.
+	// We can provide that here.
+	std::string string;
+	response.PackInto(string);
+	string.push_back('\n');
+	return std::make_shared<const std::string>(std::move(string));
+}
+
+PackedResponse PackResponseFrame(const Response &response)
+{
+	std::string frame;
+	response.PackFrame(frame);
+	return std::make_shared<const std::string>(std::move(frame));
+}
+
+//
+// Sleep
+//
+
+Sleep::Sleep(uv_loop_t *loop, std::chrono::milliseconds delay) : loop{loop}, delay{delay}
+{
+}
+
+bool Sleep::await_ready() const noexcept
+{
+	return false;
+}
+
+void Sleep::await_suspend(std::coroutine_handle<> handle)
+{
+	auto *timer = new SleepTimer{{}, handle};
+	if (uv_timer_init(this->loop, &timer->timer)) {
+		delete timer;
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+	timer->timer.data = static_cast<void *>(timer);
+
+	if (uv_timer_start(&timer->timer, UvSleepCallback, static_cast<std::uint64_t>(this->delay.count()), 0)) {
+		// The timer is a handle now, so it has to be closed to go.
+		uv_close(reinterpret_cast<uv_handle_t *>(&timer->timer), UvSleepCloseCallback);
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+}
+
+void Sleep::await_resume() const noexcept
+{
+}
+
+//
+// Write
+//
+
+Write::Write(uv_stream_t *stream, std::string_view data)
+    : stream{stream}, data{data}, req{}, waiting{nullptr}, status{0}
+{
+}
+
+bool Write::await_ready() const noexcept
+{
+	return false;
+}
+
+bool Write::await_suspend(std::coroutine_handle<> handle)
+{
+	// We live in the coroutine's frame, which stays put until the write is
+	// done, so the request can live here too.
+	this->waiting = handle;
+	this->req.data = static_cast<void *>(this);
+
+	// libuv only reads from the buffer, whatever its type says.
+	auto buf = uv_buf_init(const_cast<char *>(this->data.data()), static_cast<unsigned int>(this->data.size()));
+	this->status = uv_write(&this->req, this->stream, &buf, 1, &Write::Done);
+	return this->status == 0;
+}
+
+int Write::await_resume() const noexcept
+{
+	return this->status;
+}
+
+/* static */ void Write::Done(uv_write_t *req, int status)
+{
+	assert(req != nullptr);
+	auto *write = static_cast<Write *>(req->data);
+	assert(write != nullptr);
+
+	write->status = status;
+	write->waiting.resume();
+}
+
+//
+// Flusher
+//
+
+void Flusher::Init(uv_loop_t *loop, std::function<void()> flush)
+{
+	assert(loop != nullptr);
+
+	this->flush = std::move(flush);
+	if (uv_check_init(loop, &this->check) || uv_idle_init(loop, &this->idle)) {
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+	this->check.data = static_cast<void *>(this);
+}
+
+void Flusher::Arm()
+{
+	if (this->Armed()) return;
+
+	// The idle handle only has to exist to keep the poll short; the check
+	// handle does the work.
+	uv_check_start(&this->check, &Flusher::Check);
+	uv_idle_start(&this->idle, [](uv_idle_t *) {});
+}
+
+bool Flusher::Armed() const
+{
+	return uv_is_active(reinterpret_cast<const uv_handle_t *>(&this->check));
+}
+
+void Flusher::Close()
+{
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->check), nullptr);
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->idle), nullptr);
+}
+
+/* static */ void Flusher::Check(uv_check_t *handle)
+{
+	assert(handle != nullptr);
+	auto *flusher = static_cast<Flusher *>(handle->data);
+	assert(flusher != nullptr);
+
+	// There's no need to run every iteration when nobody is waiting.  We
+	// disarm first, so that anything the callback asks for runs next time.
+	uv_check_stop(&flusher->check);
+	uv_idle_stop(&flusher->idle);
+	flusher->flush();
+}
+
+//
+// ReadBufferPool
+//
+
+uv_buf_t ReadBufferPool::Acquire()
+{
+	std::unique_ptr<char[]> buffer;
+	if (this->free.empty()) {
+		buffer = std::make_unique_for_overwrite<char[]>(BUFFER_SIZE);
+		this->held.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		buffer = std::move(this->free.back());
+		this->free.pop_back();
+	}
+
+	// Ownership passes to libuv until Release().
+	this->in_flight.fetch_add(1, std::memory_order_relaxed);
+	return uv_buf_init(buffer.release(), BUFFER_SIZE);
+}
+
+void ReadBufferPool::Release(char *base)
+{
+	if (base == nullptr) return;
+
+	std::unique_ptr<char[]> buffer{base};
+	this->in_flight.fetch_sub(1, std::memory_order_relaxed);
+	if (this->free.size() < MAX_FREE) {
+		this->free.push_back(std::move(buffer));
+	} else {
+		this->held.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+size_t ReadBufferPool::FreeCount() const
+{
+	return this->free.size();
+}
+
+size_t ReadBufferPool::InFlightCount() const
+{
+	return this->in_flight.load(std::memory_order_relaxed);
+}
+
+size_t ReadBufferPool::HeldCount() const
+{
+	return this->held.load(std::memory_order_relaxed);
+}
+
+//
+// Core
+//
+
+Core::Core() : loop{uv_default_loop()}
+{
+	if (this->loop == nullptr) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	this->loop->data = static_cast<void *>(this);
+
+	this->InitSignals();
+	this->InitFlusher();
+}
+
+Core::~Core() = default;
+
+Channel &Core::AddChannel(Player &player, std::string_view host, std::string_view port)
+{
+	auto &channel = *this->channels.emplace_back(std::make_unique<Channel>(*this, player, host, port));
+	this->open_channels++;
+	return channel;
+}
+
+void Core::AddShards(std::size_t count)
+{
+	Expects(this->channels.empty() && this->shards.empty());
+
+#ifdef SO_REUSEPORT
+	if (uv_async_init(this->loop, &this->inbox_wake, UvInboxCallback)) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	this->inbox_wake.data = static_cast<void *>(this);
+
+	// The shards' posts alone shouldn't keep the loop going; whatever
+	// they're about (a client, say) has a handle of its own.
+	uv_unref(reinterpret_cast<uv_handle_t *>(&this->inbox_wake));
+
+	for (std::size_t i = 0; i < count; i++) this->shards.push_back(std::make_unique<Shard>(*this));
+#else
+	throw ConfigError("this platform can't share a port between I/O threads");
+#endif // SO_REUSEPORT
+}
+
+const std::vector<std::unique_ptr<Shard>> &Core::Shards() const
+{
+	return this->shards;
+}
+
+void Core::Post(Task task)
+{
+	this->inbox.Push(std::move(task));
+	uv_async_send(&this->inbox_wake);
+}
+
+void Core::RunPosted()
+{
+	while (auto task = this->inbox.Pop()) (*task)();
+}
+
+void Core::RequestSubmit(Shard &shard)
+{
+	// Once every channel has shut down, there's no flusher to wait for.
+	if (this->open_channels == 0) {
+		shard.Submit();
+		return;
+	}
+
+	this->dirty_shards.push_back(&shard);
+	this->flusher.Arm();
+}
+
+void Core::SubmitShards()
+{
+	for (auto *shard : this->dirty_shards) shard->Submit();
+	this->dirty_shards.clear();
+}
+
+void Core::StopShards()
+{
+	if (this->shards.empty()) return;
+
+	// The shards can't stop until their clients are released, and those
+	// shutting down have finished.
+	for (const auto &channel : this->channels) channel->ReleaseConnections();
+	for (const auto &shard : this->shards) shard->Stop();
+
+	// Nothing can post to us now, so the inbox can close.
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->inbox_wake), nullptr);
+	uv_run(this->loop, UV_RUN_NOWAIT);
+	this->RunPosted();
+}
+
+void Core::AddMetricsListener(std::string_view host, std::string_view port)
+{
+	assert(this->metrics_server == nullptr);
+
+	const auto bind_addr = BindAddress(host, port);
+
+	auto server = std::make_unique<uv_tcp_t>();
+	if (uv_tcp_init(this->loop, server.get())) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	server->data = static_cast<void *>(this);
+
+	// From here on, the handle is libuv's until it's closed.
+	this->metrics_server = std::move(server);
+
+	auto r = uv_tcp_bind(this->metrics_server.get(), reinterpret_cast<const sockaddr *>(&bind_addr), 0);
+	if (r == 0) r = uv_listen(reinterpret_cast<uv_stream_t *>(this->metrics_server.get()), 16, UvScrapeListenCallback);
+	if (r) {
+		std::ostringstream error;
+		error << "Could not listen for metrics on " << host << ":" << port << " (" << uv_err_name(r) << ")";
+		throw NetError(error.str());
+	}
+
+	Debug() << "Serving metrics at" << host << "on" << port << std::endl;
+}
+
+void Core::AcceptScrape(uv_stream_t *server)
+{
+	assert(server != nullptr);
+
+	auto *scrape = new Scrape{};
+	uv_tcp_init(this->loop, &scrape->tcp);
+	scrape->tcp.data = static_cast<void *>(scrape);
+
+	if (uv_accept(server, reinterpret_cast<uv_stream_t *>(&scrape->tcp))) {
+		CloseScrape(scrape);
+		return;
+	}
+	uv_read_start(reinterpret_cast<uv_stream_t *>(&scrape->tcp), UvScrapeAlloc, UvScrapeReadCallback);
+}
+
+std::vector<Metrics::PlayerSample> Core::SampleChannels() const
+{
+	std::vector<Metrics::PlayerSample> samples;
+	samples.reserve(this->channels.size());
+	for (std::size_t i = 0; i < this->channels.size(); i++) samples.push_back(this->channels[i]->Sample(i));
+	return samples;
+}
+
+Metrics::ProcessSample Core::SampleProcess() const
+{
+	auto in_flight = this->read_buffers.InFlightCount();
+	auto held = this->read_buffers.HeldCount();
+	for (const auto &shard : this->shards) {
+		in_flight += shard->ReadBuffers().InFlightCount();
+		held += shard->ReadBuffers().HeldCount();
+	}
+
+	constexpr auto size = ReadBufferPool::BUFFER_SIZE;
+	return {in_flight * size, (held - std::min(held, in_flight)) * size, Audio::MappedRtBytes()};
+}
+
+void Core::Run()
+{
+	for (const auto &shard : this->shards) shard->Start();
+
+	uv_run(this->loop, UV_RUN_DEFAULT);
+	this->StopShards();
+
+	// We presume all open handles have been closed in Shutdown().
+	// We need only close the loop.
+	uv_loop_close(this->loop);
+}
+
+void Core::Quit()
+{
+	for (const auto &channel : this->channels) channel->Quit();
+}
+
+void Core::RunInBackground(std::function<void()> work, std::function<void()> done)
+{
+	auto after = [this, done = std::move(done)] {
+		done();
+		for (const auto &channel : this->channels) channel->UpdatePlayer();
+	};
+	auto bg = new BackgroundWork{{}, nullptr, std::move(work), std::move(after)};
+	bg->req.data = static_cast<void *>(bg);
+
+	if (uv_queue_work(this->loop, &bg->req, UvWorkCallback, UvAfterWorkCallback)) {
+		delete bg;
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+}
+
+ReadBufferPool &Core::ReadBuffers()
+{
+	return this->read_buffers;
+}
+
+void Core::RequestFlush(Channel &channel)
+{
+	this->dirty.push_back(&channel);
+	this->flusher.Arm();
+}
+
+void Core::FlushChannels()
+{
+	// A channel can be here more than once, but only flushes once.
+	for (auto *channel : this->dirty) channel->FlushConnections();
+	this->dirty.clear();
+
+	// Whatever the channels handed to shards goes to each in one batch.
+	this->SubmitShards();
+}
+
+void Core::ChannelClosed()
+{
+	assert(0 < this->open_channels);
+	if (--this->open_channels == 0) this->Shutdown();
+}
+
+uv_loop_t *Core::Loop() const
+{
+	return this->loop;
+}
+
+void Core::SetMaxBacklog(std::size_t bytes)
+{
+	this->max_backlog = bytes;
+}
+
+std::size_t Core::MaxBacklog() const
+{
+	return this->max_backlog;
+}
+
+void Core::SetLineLimits(Tokeniser::Limits limits)
+{
+	this->line_limits = limits;
+}
+
+Tokeniser::Limits Core::LineLimits() const
+{
+	return this->line_limits;
+}
+
+void Core::SetListenBacklog(int count)
+{
+	this->listen_backlog = count;
+}
+
+int Core::ListenBacklog() const
+{
+	return this->listen_backlog;
+}
+
+void Core::Shutdown()
+{
+	// The channels flush themselves as they close, so nothing is left
+	// for the flusher, except what they've handed to shards.
+	this->SubmitShards();
+	this->flusher.Close();
+	this->dirty.clear();
+
+	// Finally, unregister signal processing.
+	uv_signal_stop(&this->sigint);
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->sigint), nullptr);
+	uv_signal_stop(&this->sigusr1);
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->sigusr1), nullptr);
+
+	// Scrapes already going finish by themselves.
+	if (this->metrics_server) {
+		uv_close(reinterpret_cast<uv_handle_t *>(this->metrics_server.release()),
+		         [](uv_handle_t *handle) { delete reinterpret_cast<uv_tcp_t *>(handle); });
+	}
+}
+
+void Core::InitFlusher()
+{
+	assert(this->loop != nullptr);
+
+	// The flusher runs just after the loop has polled for I/O, so any
+	// responses from this iteration's reads and wake-ups are in; responses
+	// from timers, which run before the poll, stop it from blocking.
+	this->flusher.Init(this->loop, [this] { this->FlushChannels(); });
+
+	// It isn't armed yet: RequestFlush() does that when needed.
+}
+
+void Core::InitSignals()
+{
+	const auto r = uv_signal_init(this->loop, &this->sigint);
+	if (r) {
+		auto error = std::string{MSG_IO_CANNOT_ALLOC} + ": " + uv_err_name(r);
+		throw InternalError{error};
+	}
+
+	// The SIGINT handler tells the players to quit, and then asks for
+	// updates so the channels notice and shut down.
+	this->sigint.data = static_cast<void *>(this);
+	assert(this->sigint.data != nullptr);
+	uv_signal_start(&this->sigint, UvSigintCallback, SIGINT);
+
+	// SIGUSR1 dumps the trace, if there is one, without stopping playd.
+	if (const auto r = uv_signal_init(this->loop, &this->sigusr1)) {
+		auto error = std::string{MSG_IO_CANNOT_ALLOC} + ": " + uv_err_name(r);
+		throw InternalError{error};
+	}
+#ifdef SIGUSR1
+	uv_signal_start(&this->sigusr1, UvSigusr1Callback, SIGUSR1);
+#endif // SIGUSR1
+}
+
+//
+// Shard
+//
+
+Shard::Shard(Core &core) : core{core}
+{
+	if (uv_loop_init(&this->loop)) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	this->loop.data = static_cast<void *>(this);
+
+	if (uv_async_init(&this->loop, &this->wake, UvShardWakeCallback)) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	this->wake.data = static_cast<void *>(this);
+}
+
+Shard::~Shard()
+{
+	assert(!this->thread.joinable());
+	uv_loop_close(&this->loop);
+}
+
+void Shard::Listen(Channel &channel, std::string_view host, std::string_view port, ListenerPolicy policy)
+{
+	assert(!this->thread.joinable());
 
-	delete[] buf;
+	const auto bind_addr = BindAddress(host, port);
 
-	// This handle was created specifically for this shutdown.
-	// We thus have to delete it.
-	delete req;
+	auto *listener = new ShardListener{{}, this, &channel, policy};
+	if (uv_tcp_init(&this->loop, &listener->tcp)) {
+		delete listener;
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+	listener->tcp.data = static_cast<void *>(listener);
+
+	// From here on, the listener is libuv's until it's closed.
+	this->listeners.push_back(listener);
+
+	// Every shard binds its own socket to the port, and the kernel
+	// balances new clients between them.
+	auto r = 0;
+#ifdef SO_REUSEPORT
+	const auto fd = socket(bind_addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0) r = uv_translate_sys_error(errno);
+	int on = 1;
+	if (r == 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+	               setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)))) {
+		r = uv_translate_sys_error(errno);
+		close(fd);
+	}
+	if (r == 0 && (r = uv_tcp_open(&listener->tcp, fd))) close(fd);
+#endif // SO_REUSEPORT
+	if (r == 0) r = uv_tcp_bind(&listener->tcp, reinterpret_cast<const sockaddr *>(&bind_addr), 0);
+	if (r == 0) r = uv_listen(reinterpret_cast<uv_stream_t *>(&listener->tcp), this->core.ListenBacklog(),
+	                            UvShardListenCallback);
+	if (r) {
+		std::ostringstream error;
+		error << "Could not listen on " << host << ":" << port << " (" << uv_err_name(r) << ")";
+		throw NetError(error.str());
+	}
 }
 
-/// The callback fired when the update timer fires.
-void UvUpdateTimerCallback(uv_timer_t *handle)
+void Shard::Start()
 {
-	assert(handle != nullptr);
+	assert(!this->thread.joinable());
+	this->thread = std::thread([this] { uv_run(&this->loop, UV_RUN_DEFAULT); });
+}
 
-	auto *io = static_cast<Core *>(handle->data);
-	assert(io != nullptr);
+void Shard::Defer(Task task)
+{
+	if (this->pending.empty()) this->core.RequestSubmit(*this);
+	this->pending.push_back(std::move(task));
+}
 
-	io->UpdatePlayer();
+void Shard::Submit()
+{
+	if (this->pending.empty()) return;
 
-	// We don't delete the handle.
-	// It is being used for other timer fires.
+	this->tasks.Push([batch = std::move(this->pending)] {
+		for (const auto &task : batch) task();
+	});
+	this->pending.clear();
+	uv_async_send(&this->wake);
 }
 
-/// The callback fired when SIGINT occurs.
-void UvSigintCallback(uv_signal_t *handle, int signum)
+void Shard::Stop()
 {
-	assert(handle != nullptr);
+	this->Submit();
 
-	auto *player = static_cast<Player *>(handle->data);
-	assert(player != nullptr);
-
-	if (signum != SIGINT) return;
+	// Once the listeners and the wake-up handle have gone, the loop runs
+	// only until the last client closes.
+	this->tasks.Push([this] {
+		this->CloseListeners(nullptr);
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->wake), nullptr);
+	});
+	uv_async_send(&this->wake);
 
-	Debug() << "Caught SIGINT, closing..." << std::endl;
-	player->Quit(Response::NOREQUEST);
+	if (!this->thread.joinable()) this->Start();
+	this->thread.join();
+}
 
-	// We don't delete the handle.
-	// It is being used for other signals.
+void Shard::RunPosted()
+{
+	while (auto task = this->tasks.Pop()) (*task)();
 }
 
-/// The callback fired when a client is shut down.
-void UvShutdownCallback(uv_shutdown_t *handle, int status)
+void Shard::CloseListeners(const Channel *channel)
 {
-	assert(handle != nullptr);
+	std::erase_if(this->listeners, [channel](ShardListener *listener) {
+		if (channel != nullptr && listener->channel != channel) return false;
+		uv_close(reinterpret_cast<uv_handle_t *>(&listener->tcp), UvShardListenerCloseCallback);
+		return true;
+	});
+}
 
-	if (status) {
-		Debug() << "UvShutdownCallback: got status:" << status << std::endl;
+void Shard::Accept(ShardListener &listener)
+{
+	auto *stream = new ShardStream{};
+	stream->shard = this;
+	stream->channel = listener.channel;
+	stream->policy = listener.policy;
+	uv_tcp_init(&this->loop, &stream->tcp);
+	stream->tcp.data = static_cast<void *>(stream);
+
+	if (uv_accept(reinterpret_cast<uv_stream_t *>(&listener.tcp), reinterpret_cast<uv_stream_t *>(&stream->tcp))) {
+		uv_close(reinterpret_cast<uv_handle_t *>(&stream->tcp), UvShardCloseCallback);
+		return;
 	}
 
-	auto *conn = static_cast<Connection *>(handle->data);
-	assert(conn != nullptr);
+	// The name is worked out here, as only this thread may touch the
+	// handle; the channel starts reading once it has given out an ID.
+	stream->peer = PeerName(&stream->tcp);
+	auto *channel = listener.channel;
+	this->core.Post([channel, stream] { channel->Adopt(stream); });
+}
 
-	// Now actually tell the client to die off.
-	conn->Depool();
+Core &Shard::Owner() const
+{
+	return this->core;
+}
 
-	// This handle was created specifically for this shutdown.
-	// We thus have to delete it.
-	delete handle;
+ReadBufferPool &Shard::ReadBuffers()
+{
+	return this->read_buffers;
 }
 
 //
-// Core
+// Channel
 //
 
-Core::Core(Player &player) : loop{nullptr}, player{player}
+Channel::Channel(Core &core, Player &player, std::string_view host, std::string_view port)
+    : core{core}, sharded{!core.Shards().empty()}, player{player}
 {
+	this->AddListener(host, port, ListenerPolicy::CONTROL);
+	this->InitUpdateTimer();
+	this->InitPlayerWake();
+	this->player.SetIo(*this);
+	this->player.SetBackgroundRunner(
+	        [this](std::function<void()> work, std::function<void()> done) {
+		        this->RunInBackground(std::move(work), std::move(done));
+	        });
 }
 
-void Core::Run(std::string_view host, std::string_view port)
+void Channel::AddListener(std::string_view host, std::string_view port, ListenerPolicy policy)
 {
-	this->loop = uv_default_loop();
-	if (this->loop == nullptr) throw InternalError(MSG_IO_CANNOT_ALLOC);
-
-	this->InitAcceptor(host, port);
-	this->InitSignals();
-	this->InitUpdateTimer();
+	const auto *kind = policy == ListenerPolicy::READ_ONLY ? "(read-only)" : "(control)";
+	if (this->sharded) {
+		for (const auto &shard : this->core.Shards()) shard->Listen(*this, host, port, policy);
+		Debug() << "Listening at" << host << "on" << port << kind << "with" << this->core.Shards().size()
+		        << "I/O threads" << std::endl;
+	} else {
+		this->InitAcceptor(host, port, policy);
+		Debug() << "Listening at" << host << "on" << port << kind << std::endl;
+	}
+}
 
-	uv_run(this->loop, UV_RUN_DEFAULT);
+void Channel::RunInBackground(std::function<void()> work, std::function<void()> done)
+{
+	auto bg = new BackgroundWork{{}, this, std::move(work), std::move(done)};
+	bg->req.data = static_cast<void *>(bg);
 
-	// We presume all open handles have been closed in Shutdown().
-	// We need only close the loop.
-	uv_loop_close(this->loop);
+	if (uv_queue_work(this->core.Loop(), &bg->req, UvWorkCallback, UvAfterWorkCallback)) {
+		delete bg;
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
 }
 
-void Core::Accept(uv_stream_t *server)
+void Channel::Accept(uv_stream_t *server, ListenerPolicy policy)
 {
 	assert(server != nullptr);
-	assert(this->loop != nullptr);
 
-	auto client = new uv_tcp_t();
-	uv_tcp_init(this->loop, client);
+	// Clients come in through the TCP server or the Unix socket one, and
+	// their handles must be of the same kind.
+	uv_stream_t *client = nullptr;
+	if (server->type == UV_NAMED_PIPE) {
+		auto pipe = new uv_pipe_t();
+		uv_pipe_init(this->core.Loop(), pipe, 0);
+		client = reinterpret_cast<uv_stream_t *>(pipe);
+	} else {
+		auto tcp = new uv_tcp_t();
+		uv_tcp_init(this->core.Loop(), tcp);
+		client = reinterpret_cast<uv_stream_t *>(tcp);
+	}
 
 	// libuv does the 'nonzero is error' thing here
-	if (uv_accept(server, reinterpret_cast<uv_stream_t *>(client))) {
+	if (uv_accept(server, client)) {
 		uv_close(reinterpret_cast<uv_handle_t *>(client), UvCloseCallback);
 		return;
 	}
 
-	auto id = this->NextConnectionID();
-	auto conn = std::make_shared<Connection>(*this, client, this->player, id);
+	ClientId id;
+	try {
+		id = this->pool.NextId();
+	} catch (InternalError &e) {
+		Debug() << "Refusing connection:" << e.Message() << std::endl;
+		uv_close(reinterpret_cast<uv_handle_t *>(client), UvCloseCallback);
+		return;
+	}
+	auto conn = std::make_unique<Connection>(*this, client, this->player, id, policy);
 	client->data = static_cast<void *>(conn.get());
-	this->pool[id - 1] = std::move(conn);
+	this->pool.Add(id, std::move(conn));
+	this->player.AddClient(id);
+	SendInitialResponses(id);
+
+	uv_read_start(client, UvAlloc, UvReadCallback);
+}
+
+void Channel::Adopt(ShardStream *stream)
+{
+	assert(stream != nullptr);
+	auto &shard = *stream->shard;
+
+	ClientId id = BROADCAST;
+	if (!this->shutting_down) {
+		try {
+			id = this->pool.NextId();
+		} catch (InternalError &e) {
+			Debug() << "Refusing connection:" << e.Message() << std::endl;
+		}
+	}
+	if (id == BROADCAST) {
+		shard.Defer([stream] { ReleaseShardStream(stream); });
+		return;
+	}
+
+	stream->id = id;
+	this->pool.Add(id, std::make_unique<Connection>(*this, stream, this->player, id, stream->policy));
+	this->player.AddClient(id);
 	SendInitialResponses(id);
 
-	uv_read_start(reinterpret_cast<uv_stream_t *>(client), UvAlloc, UvReadCallback);
+	shard.Defer([stream] {
+		uv_read_start(reinterpret_cast<uv_stream_t *>(&stream->tcp), UvShardAlloc, UvShardReadCallback);
+	});
+}
+
+Connection *Channel::Find(ClientId id) const
+{
+	return this->pool.Find(id);
+}
+
+void Channel::ReleaseConnections()
+{
+	while (!this->pool.Empty()) this->Remove(this->pool.begin()->id);
 }
 
-void Core::SendInitialResponses(ClientId id) const
+void Channel::SendInitialResponses(ClientId id) const
 {
 	Respond(id, Response(Response::NOREQUEST, Response::Code::OHAI)
-	                    .AddArg(std::to_string(id))
+	                    .AddArg(static_cast<std::size_t>(id))
 	                    .AddArg(MSG_OHAI_BIFROST)
 	                    .AddArg(MSG_OHAI_PLAYD));
 	Respond(id, Response(Response::NOREQUEST, Response::Code::IAMA).AddArg("player/file"));
@@ -220,92 +1498,121 @@ void Core::SendInitialResponses(ClientId id) const
 	Respond(id, Response::Success(Response::NOREQUEST));
 }
 
-ClientId Core::NextConnectionID()
+void Channel::Remove(ClientId id)
 {
-	// We'll want to try and use an existing, empty ID in the connection
-	// pool.  If there aren't any (we've exceeded the maximum-so-far number
-	// of simultaneous connections), we expand the pool.
-	if (this->free_list.empty()) this->ExpandPool();
-	assert(!this->free_list.empty());
+	Expects(id != BROADCAST);
 
-	// Acquire some free ID, and ensure that the ID cannot be re-used until
-	// replaced onto the free list by the connection's removal.
-	ClientId id = this->free_list.back();
-	this->free_list.pop_back();
+	// The connection goes away at the end of this, once the player has
+	// forgotten it.  Removing one that's already gone does nothing.
+	if (const auto conn = this->pool.Remove(id)) this->player.RemoveClient(id);
 
-	Ensures(id != BROADCAST);
-	Ensures(id <= this->pool.size());
-
-	return id;
+	Ensures(this->pool.Find(id) == nullptr);
 }
 
-void Core::ExpandPool()
+void Channel::UpdatePlayer()
 {
-	// If we already have SIZE_MAX-1 simultaneous connections, we bail out.
-	// Since this is at least 65,534, and likely to be 2^32-2 or 2^64-2,
-	// this is incredibly unlikely to happen and probably means someone's
-	// trying to denial-of-service an audio player.
-	//
-	// Why -1?  Because slot 0 in the connection pool is reserved for
-	// broadcasts.
-	const auto full = this->pool.size() == (SIZE_MAX - 1);
-	if (full) throw InternalError(MSG_TOO_MANY_CONNS);
+	// Requests can still be in flight as we shut down.
+	if (this->shutting_down) return;
+
+	const auto running = this->player.Update();
+	if (!running) {
+		this->Shutdown();
+		return;
+	}
 
-	this->pool.emplace_back(nullptr);
-	// This isn't an off-by-one error; slots index from 1.
-	auto new_id = static_cast<ClientId>(this->pool.size());
-	this->free_list.push_back(new_id);
+	// Only a playing (or standby) player needs polling; everything else it
+	// does happens in response to commands or wake-ups.
+	const auto polling = uv_is_active(reinterpret_cast<uv_handle_t *>(&this->updater)) != 0;
+	const auto wants_polling = this->player.IsPlaying() || this->player.IsStandingBy();
+	const auto period = static_cast<std::uint64_t>(this->player.UpdatePeriod().count());
+	if (wants_polling && !polling) {
+		uv_timer_start(&this->updater, UvUpdateTimerCallback, period, period);
+	} else if (!wants_polling && polling) {
+		uv_timer_stop(&this->updater);
+	} else if (polling && uv_timer_get_repeat(&this->updater) != period) {
+		// The period was set while we were polling; it takes from the next tick.
+		uv_timer_set_repeat(&this->updater, period);
+	}
 }
 
-void Core::Remove(ClientId slot)
+void Channel::RequestUpdate()
 {
-	Expects(0 < slot);
-	Expects(slot <= this->pool.size());
+	uv_async_send(&this->player_wake);
+}
 
-	// Don't remove if it's already a nullptr, because we'd end up with the
-	// slot on the free list twice.
-	if (this->pool.at(slot - 1)) {
-		this->pool[slot - 1] = nullptr;
-		this->free_list.push_back(slot);
+Metrics::PlayerSample Channel::Sample(std::size_t index) const
+{
+	Metrics::PlayerSample sample{index, this->player.AudioStats(), 0, 0, 0};
+	sample.memory = this->player.Memory();
+	sample.ram_cache_bytes = this->player.RamCacheBytes();
+	sample.connections = this->pool.Size();
+	for (const auto &[id, conn] : this->pool) {
+		const auto input = conn->InputBytes();
+		const auto outbox = conn->OutboxBytes();
+		const auto queued = conn->WriteQueueBytes();
+		sample.queued_responses += conn->QueuedResponses();
+		sample.write_queue_bytes += queued;
+		sample.input_bytes += input;
+		sample.outbox_bytes += outbox;
+		sample.largest_client = std::max(sample.largest_client, input + outbox + queued);
 	}
-
-	Ensures(!this->pool.at(slot - 1));
+	return sample;
 }
 
-void Core::UpdatePlayer()
+void Channel::Quit()
 {
-	const auto running = this->player.Update();
-	if (!running) this->Shutdown();
+	// Channels whose players have already quit have nothing to wake.
+	if (this->shutting_down) return;
+
+	std::ignore = this->player.Quit(Response::NOREQUEST);
+	this->RequestUpdate();
 }
 
-void Core::Shutdown()
+void Channel::Shutdown()
 {
-	Debug() << "Shutting down..." << std::endl;
+	Debug() << "Shutting down channel..." << std::endl;
+	this->shutting_down = true;
 
-	// If the player is ready to terminate, we need to kill the event loop
-	// in order to disconnect clients and stop the updating.
-	// We do this by stopping everything using the loop.
+	// If the player is ready to terminate, we need to stop everything
+	// this channel has on the loop, to disconnect clients and stop the
+	// updating.  Other channels keep going.
 
 	// First, the update timer:
 	uv_timer_stop(&this->updater);
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->updater), nullptr);
+
+	// Then, the TCP servers (as far as we can tell, this does *not* close
+	// down the connections), or its shards' listeners:
+	if (this->sharded) {
+		for (const auto &shard : this->core.Shards()) {
+			shard->Defer([shard = shard.get(), this] { shard->CloseListeners(this); });
+		}
+	}
+	for (auto *listener : this->listeners) {
+		uv_close(reinterpret_cast<uv_handle_t *>(&listener->tcp), UvChannelListenerCloseCallback);
+	}
+	this->listeners.clear();
+	if (!this->local_path.empty()) {
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->local), nullptr);
+		std::error_code ec;
+		std::filesystem::remove(this->local_path, ec);
+	}
 
-	// Then, the TCP server (as far as we can tell, this does *not* close
-	// down the connections):
-	uv_close(reinterpret_cast<uv_handle_t *>(&this->server), nullptr);
+	// Next, ask each connection to stop.  This writes out anything
+	// pending, so the connections will still see the quit.
+	for (const auto &[id, conn] : this->pool) conn->Shutdown();
+	this->dirty.clear();
 
-	// Next, ask each connection to stop.
-	for (const auto &conn : this->pool) {
-		if (conn) conn->Shutdown();
-	}
+	// Nothing can wake us up any more, either.  By now, the player has
+	// ejected, so there are no sinks or decoding threads left to try.
+	uv_close(reinterpret_cast<uv_handle_t *>(&this->player_wake), nullptr);
 
-	// Finally, unregister signal processing.
-	uv_signal_stop(&this->sigint);
-	uv_close(reinterpret_cast<uv_handle_t *>(&this->sigint), nullptr);
+	this->core.ChannelClosed();
 }
 
-void Core::Respond(ClientId id, const Response &response) const
+void Channel::Respond(ClientId id, const Response &response) const
 {
-	if (this->pool.empty()) return;
+	if (this->pool.Empty()) return;
 
 	if (id == BROADCAST) {
 		this->Broadcast(response);
@@ -314,153 +1621,364 @@ void Core::Respond(ClientId id, const Response &response) const
 	}
 }
 
-void Core::Broadcast(const Response &response) const
+void Channel::Multicast(const std::vector<ClientId> &ids, const Response &response) const
 {
-	Debug() << "broadcast:" << response.Pack() << std::endl;
+	// As with Broadcast, pack once per protocol in use.
+	PackedResponse text;
+	PackedResponse frame;
+	const auto delivery = Connection::DeliveryOf(response.GetCode());
+
+	for (const auto id : ids) {
+		auto *c = this->pool.Find(id);
+		if (c == nullptr) continue;
+
+		auto &packed = c->IsBinary() ? frame : text;
+		if (!packed) packed = c->IsBinary() ? PackResponseFrame(response) : PackResponse(response);
+		c->Respond(packed, delivery);
+	}
+}
 
-	// Copy the connection by value, so that there's at least one
-	// active reference to it throughout.
-	std::for_each(this->pool.cbegin(), this->pool.cend(), [=](auto c) {
-		if (c) c->Respond(response);
-	});
+void Channel::Complete(ClientId id, const Response &response) const
+{
+	if (id == BROADCAST) {
+		this->Respond(id, response);
+		return;
+	}
+	// As with Unicast, the client may have gone while it waited.
+	if (auto *c = this->pool.Find(id)) c->Complete(response);
 }
 
-void Core::Unicast(ClientId id, const Response &response) const
+void Channel::RequestFlush(ClientId id)
 {
-	assert(0 < id && id <= this->pool.size());
+	// After shutdown, the connections flush themselves as they close.
+	if (this->shutting_down) return;
 
-	Debug() << "unicast @" << std::to_string(id) << ":" << response.Pack() << std::endl;
+	if (this->dirty.empty()) this->core.RequestFlush(*this);
+	this->dirty.push_back(id);
+}
 
-	auto c = this->pool.at(id - 1);
-	if (c) c->Respond(response);
+void Channel::FlushConnections()
+{
+	for (const auto id : this->dirty) {
+		// The connection may have gone away since it asked.
+		if (auto *c = this->pool.Find(id)) c->Flush();
+	}
+	this->dirty.clear();
 }
 
-void Core::InitUpdateTimer()
+std::size_t Channel::MaxBacklog() const
 {
-	assert(this->loop != nullptr);
+	return this->core.MaxBacklog();
+}
 
-	uv_timer_init(this->loop, &this->updater);
-	this->updater.data = static_cast<void *>(this);
+Tokeniser::Limits Channel::LineLimits() const
+{
+	return this->core.LineLimits();
+}
+
+void Channel::Broadcast(const Response &response) const
+{
+	// However many connections this goes to, we only pack it once in
+	// each protocol anyone is using.
+	PackedResponse text;
+	PackedResponse frame;
+	const auto delivery = Connection::DeliveryOf(response.GetCode());
+
+	// Responding never removes connections, so the pool holds still
+	// while we go through it.
+	for (const auto &[id, c] : this->pool) {
+		auto &packed = c->IsBinary() ? frame : text;
+		if (!packed) packed = c->IsBinary() ? PackResponseFrame(response) : PackResponse(response);
+		c->Respond(packed, delivery);
+	}
 
-	uv_timer_start(&this->updater, UvUpdateTimerCallback, 0, PLAYER_UPDATE_PERIOD);
+	// Responses go out far too often to log each one; they're traced,
+	// with the rest of the hot path, by Connection::Respond.
 }
 
-void Core::InitAcceptor(std::string_view address, std::string_view port)
+void Channel::Unicast(ClientId id, const Response &response) const
 {
-	assert(this->loop != nullptr);
+	// Replies can outlive the connections they were meant for.
+	if (auto *c = this->pool.Find(id)) c->Respond(response);
+}
 
-	if (uv_tcp_init(this->loop, &this->server)) {
-		throw InternalError(MSG_IO_CANNOT_ALLOC);
+void Channel::InitUpdateTimer()
+{
+	uv_timer_init(this->core.Loop(), &this->updater);
+	this->updater.data = static_cast<void *>(this);
+
+	// We don't start the timer yet: the player starts out with nothing
+	// loaded, so UpdatePlayer() starts it once something is playing.
+	// Standbys are the exception, as they have a snapshot to follow.
+	if (this->player.IsStandingBy()) {
+		const auto period = static_cast<std::uint64_t>(this->player.UpdatePeriod().count());
+		uv_timer_start(&this->updater, UvUpdateTimerCallback, period, period);
 	}
-	this->server.data = static_cast<void *>(this);
-	assert(this->server.data != nullptr);
+}
+
+void Channel::InitPlayerWake()
+{
+	uv_async_init(this->core.Loop(), &this->player_wake, UvPlayerWakeCallback);
+	this->player_wake.data = static_cast<void *>(this);
+
+	// uv_async_send is the only libuv call that is safe to make from
+	// other threads, which is why the player's audio goes through it.
+	this->player.SetWakeHandler([this] { this->RequestUpdate(); });
+}
 
-	std::string address_str{address};
-	std::string port_str{port};
+void Channel::InitAcceptor(std::string_view address, std::string_view port, ListenerPolicy policy)
+{
+	const auto bind_addr = BindAddress(address, port);
 
-	struct sockaddr_in bind_addr;
-	uv_ip4_addr(address_str.c_str(), stoi(port_str), &bind_addr);
-	uv_tcp_bind(&this->server, reinterpret_cast<const sockaddr *>(&bind_addr), 0);
+	auto *listener = new ChannelListener{{}, this, policy};
+	if (uv_tcp_init(this->core.Loop(), &listener->tcp)) {
+		delete listener;
+		throw InternalError(MSG_IO_CANNOT_ALLOC);
+	}
+	listener->tcp.data = static_cast<void *>(listener);
 
-	const auto r = uv_listen(reinterpret_cast<uv_stream_t *>(&this->server), 128, UvListenCallback);
+	auto r = uv_tcp_bind(&listener->tcp, reinterpret_cast<const sockaddr *>(&bind_addr), 0);
+	if (r == 0) r = uv_listen(reinterpret_cast<uv_stream_t *>(&listener->tcp), this->core.ListenBacklog(),
+	                            UvListenCallback);
 	if (r) {
-		std::ostringstream error{"Could not listen on "};
-		error << address << ":" << port << " (" << uv_err_name(r) << ")";
+		uv_close(reinterpret_cast<uv_handle_t *>(&listener->tcp), UvChannelListenerCloseCallback);
+		std::ostringstream error;
+		error << "Could not listen on " << address << ":" << port << " (" << uv_err_name(r) << ")";
 		throw NetError(error.str());
 	}
 
-	Debug() << "Listening at" << address << "on" << port << std::endl;
+	// From here on, the listener is libuv's until it's closed.
+	this->listeners.push_back(listener);
 }
 
-void Core::InitSignals()
+void Channel::ListenLocally(const std::string &path)
 {
-	const auto r = uv_signal_init(this->loop, &this->sigint);
+	Expects(this->local_path.empty());
+
+	// A playd that didn't shut down cleanly leaves its socket behind, and
+	// binding fails until it's gone.
+	std::error_code ec;
+	if (std::filesystem::is_socket(path, ec)) std::filesystem::remove(path, ec);
+
+	if (uv_pipe_init(this->core.Loop(), &this->local, 0)) throw InternalError(MSG_IO_CANNOT_ALLOC);
+	this->local.data = static_cast<void *>(this);
+
+	auto r = uv_pipe_bind(&this->local, path.c_str());
+	if (r == 0) r = uv_listen(reinterpret_cast<uv_stream_t *>(&this->local), this->core.ListenBacklog(),
+	                            UvLocalListenCallback);
 	if (r) {
-		auto error = std::string{MSG_IO_CANNOT_ALLOC} + ": " + uv_err_name(r);
-		throw InternalError{error};
+		uv_close(reinterpret_cast<uv_handle_t *>(&this->local), nullptr);
+		throw NetError("Could not listen on " + path + " (" + uv_err_name(r) + ")");
 	}
+	this->local_path = path;
 
-	// We pass the player, not the IoCore.
-	// This is so the SIGINT handler can tell the player to quit,
-	// which then tells us to shutdown
-	this->sigint.data = static_cast<void *>(&this->player);
-	assert(this->sigint.data != nullptr);
-	uv_signal_start(&this->sigint, UvSigintCallback, SIGINT);
+	Debug() << "Listening at" << path << std::endl;
 }
 
 //
 // Connection
 //
 
-Connection::Connection(Core &parent, uv_tcp_t *tcp, Player &player, ClientId id)
-    : parent(parent), tcp(tcp), tokeniser(), player(player), id(id)
+Connection::Connection(Channel &parent, uv_stream_t *stream, Player &player, ClientId id, ListenerPolicy policy)
+    : parent(parent),
+      stream(stream),
+      remote(nullptr),
+      tokeniser(parent.LineLimits()),
+      player(player),
+      id(id),
+      outbox_bytes(0),
+      flush_requested(false),
+      binary(false),
+      reading_frames(false),
+      binary_requested(false),
+      timing(false),
+      read_only(policy == ListenerPolicy::READ_ONLY),
+      held_overflow(false),
+      rejected(false)
 {
-	Debug() << "Opening connection from" << Name() << std::endl;
+	Debug() << "Opening connection from" << Name() << (this->read_only ? "(read-only)" : "") << std::endl;
+}
+
+Connection::Connection(Channel &parent, ShardStream *remote, Player &player, ClientId id,
+                       ListenerPolicy policy)
+    : parent(parent),
+      stream(nullptr),
+      remote(remote),
+      tokeniser(parent.LineLimits()),
+      player(player),
+      id(id),
+      outbox_bytes(0),
+      flush_requested(false),
+      binary(false),
+      reading_frames(false),
+      binary_requested(false),
+      timing(false),
+      read_only(policy == ListenerPolicy::READ_ONLY),
+      held_overflow(false),
+      rejected(false)
+{
+	Debug() << "Opening connection from" << Name() << (this->read_only ? "(read-only)" : "") << std::endl;
 }
 
 Connection::~Connection()
 {
 	Debug() << "Closing connection from" << Name() << std::endl;
-	uv_close(reinterpret_cast<uv_handle_t *>(this->tcp), UvCloseCallback);
+	if (this->remote != nullptr) {
+		this->remote->shard->Defer([stream = this->remote] { ReleaseShardStream(stream); });
+		return;
+	}
+	this->stream->data = nullptr;
+	uv_close(reinterpret_cast<uv_handle_t *>(this->stream), UvCloseCallback);
 }
 
 void Connection::Respond(const Response &response)
 {
-	// Pack provides us the response's wire format, except the newline.
-	// We can provide that here.
-	auto string = response.Pack();
-	string.push_back('\n');
+	// Replies to this client's own commands are never stale.
+	this->Respond(this->binary ? PackResponseFrame(response) : PackResponse(response));
+}
+
+bool Connection::IsBinary() const
+{
+	return this->binary;
+}
+
+/* static */ Connection::Delivery Connection::DeliveryOf(Response::Code code)
+{
+	switch (code) {
+		case Response::Code::POS:
+			return Delivery::REPLACEABLE;
+		case Response::Code::TAP:
+			return Delivery::DROPPABLE;
+		default:
+			return Delivery::RELIABLE;
+	}
+}
+
+void Connection::Respond(PackedResponse response, Delivery delivery)
+{
+	assert(response != nullptr);
+
+	// Monitoring audio that can't keep up is better with gaps than late,
+	// and mustn't get the client evicted, so it stops well short of that.
+	if (delivery == Delivery::DROPPABLE) {
+		const auto unwritten = this->WriteQueueBytes() + this->outbox_bytes + response->size();
+		if (this->parent.MaxBacklog() / 4 < unwritten) {
+			Metrics::AddDropped();
+			return;
+		}
+	}
 
-	const auto l = string.length();
+	Trace::Record(TraceKind::RESPOND, response->size());
 
-	// Make a libuv buffer and pour the request into it.
-	// The onus is on UvRespondCallback to free buf.base.
-	auto buf = uv_buf_init(new char[l], l);
-	assert(buf.base != nullptr);
-	string.copy(buf.base, l);
+	const auto replaceable = delivery == Delivery::REPLACEABLE;
 
-	// Make a write request.
-	// Since the callback must free the buffer, pass it through as data.
-	// The callback will also free req.
-	auto req = new uv_write_t;
-	req->data = static_cast<void *>(buf.base);
+	// A client that's behind only needs the latest position, so the
+	// stale one goes; the newer one goes to the back, after anything
+	// that happened in between.
+	if (replaceable && this->replaceable_at) {
+		const auto stale = this->outbox.begin() + static_cast<std::ptrdiff_t>(*this->replaceable_at);
+		this->outbox_bytes -= (*stale)->size();
+		this->outbox.erase(stale);
+		Metrics::AddCoalesced();
+	}
+	if (replaceable) this->replaceable_at = this->outbox.size();
 
-	uv_write((uv_write_t *)req, (uv_stream_t *)this->tcp, &buf, 1, UvWriteCallback);
+	this->AskForFlush();
+	this->outbox_bytes += response->size();
+	this->outbox.push_back(std::move(response));
 }
 
-std::string Connection::Name()
+void Connection::AskForFlush()
 {
-	// Warning: fairly low-level Berkeley sockets code ahead!
-	// (Thankfully, libuv makes sure the appropriate headers are included.)
+	if (this->flush_requested) return;
+	this->flush_requested = true;
+	this->parent.RequestFlush(this->id);
+}
 
-	// Using this instead of struct sockaddr is advised by the libuv docs,
-	// for IPv6 compatibility.
-	struct sockaddr_storage s {
-	};
-	auto sp = (struct sockaddr *)&s;
+void Connection::Flush()
+{
+	this->flush_requested = false;
+	if (this->outbox.empty()) return;
+
+	// libuv queues whatever it can't write straight away, so a client
+	// that isn't reading shows up as a write queue that never drains.
+	const auto queued = this->WriteQueueBytes();
+	if (this->parent.MaxBacklog() < queued + this->outbox_bytes) {
+		Debug() << "Evicting" << Name() << "with" << queued + this->outbox_bytes << "bytes unwritten" << std::endl;
+		Metrics::AddEviction();
+		this->Depool();
+		return;
+	}
 
-	// Turns out if you don't do this, Windows (and only Windows?) is upset.
-	socklen_t namelen = sizeof(s);
+	// Hold everything back until libuv catches up, so that stale
+	// responses can still be replaced; WriteDone() flushes them.
+	if (0 < queued) return;
 
-	const auto pe = uv_tcp_getpeername(this->tcp, sp, (int *)&namelen);
-	// These std::string()s are needed as, otherwise, the compiler would
-	// think we're trying to add const char*s together.  We need AT LEAST
-	// ONE of the sides of the first + to be a std::string.
-	if (pe) return "<error@peer: " + std::string(uv_strerror(pe)) + ">";
+	this->Write();
+}
 
-	// Now, split the sockaddr into host and service.
-	char host[NI_MAXHOST];
-	char serv[NI_MAXSERV];
+void Connection::WriteDone()
+{
+	if (!this->outbox.empty() && this->WriteQueueBytes() == 0) this->AskForFlush();
+}
 
-	// We use NI_NUMERICSERV to ensure a port number comes out.
-	// Otherwise, we could get a (likely erroneous) string description of
-	// what the network stack *thinks* the port is used for.
-	const auto ne = getnameinfo(sp, namelen, host, sizeof(host), serv, sizeof(serv), NI_NUMERICSERV);
-	// See comment for above error.
-	if (ne) return "<error@name: " + std::string(gai_strerror(ne)) + ">";
+void Connection::Write()
+{
+	this->outbox_bytes = 0;
+	this->replaceable_at.reset();
+
+	// The write request takes our references to the responses, so that
+	// they outlive the write; the onus is on UvWriteCallback to free it.
+	auto write = new WriteRequest;
+	write->lines.swap(this->outbox);
+	write->replies.swap(this->unreplied);
+
+	// A shard writes with everything else it's given this iteration.
+	if (this->remote != nullptr) {
+		std::size_t bytes = 0;
+		for (const auto &line : write->lines) bytes += line->size();
+		this->remote->queued.fetch_add(bytes, std::memory_order_acq_rel);
+		this->remote->shard->Defer([stream = this->remote, write] { StartShardWrite(stream, write); });
+		return;
+	}
+
+	write->req.data = static_cast<void *>(write);
+	auto bufs = WriteBuffers(*write);
+	const auto count = static_cast<unsigned int>(bufs.size());
+	uv_write(&write->req, this->stream, bufs.data(), count, UvWriteCallback);
+}
+
+std::size_t Connection::QueuedResponses() const
+{
+	return this->outbox.size();
+}
+
+std::size_t Connection::WriteQueueBytes() const
+{
+	if (this->remote != nullptr) return this->remote->queued.load(std::memory_order_acquire);
+	return uv_stream_get_write_queue_size(this->stream);
+}
+
+std::size_t Connection::OutboxBytes() const
+{
+	return this->outbox_bytes;
+}
+
+std::size_t Connection::InputBytes() const
+{
+	auto bytes = this->tokeniser.HeldBytes() + this->frames.HeldBytes();
+	for (const auto &command : this->held) {
+		for (const auto &word : command.words) bytes += word.capacity();
+	}
+	return bytes;
+}
 
-	auto id = std::to_string(this->id);
-	return id + std::string("!") + host + std::string(":") + serv;
+std::string Connection::Name()
+{
+	if (this->remote != nullptr) return std::to_string(this->id) + "!" + this->remote->peer;
+	// Unix socket clients are nameless, and all on this host anyway.
+	if (this->stream->type == UV_NAMED_PIPE) return std::to_string(this->id) + "!local";
+	return std::to_string(this->id) + "!" + PeerName(reinterpret_cast<uv_tcp_t *>(this->stream));
 }
 
 void Connection::Read(ssize_t nread, const uv_buf_t *buf)
@@ -485,38 +2003,154 @@ void Connection::Read(ssize_t nread, const uv_buf_t *buf)
 	// Make sure we actually have some data to read!
 	if (buf->base == nullptr) return;
 
-	// Everything looks okay for reading.
-	auto cmds = this->tokeniser.Feed(std::string(buf->base, nread));
-	for (const auto &cmd : cmds) {
-		if (cmd.empty()) continue;
+	this->Feed({buf->base, static_cast<size_t>(nread)}, std::chrono::steady_clock::now());
+}
+
+void Connection::Feed(std::string_view raw, std::chrono::steady_clock::time_point arrived)
+{
+	// Read-only clients' bytes never reach the tokeniser, and nor do
+	// those of clients already being disconnected.
+	if (this->read_only || this->rejected) return;
+
+	// The commands are views into the bytes (or the tokeniser), so we
+	// must run (or copy) them before the bytes go.
+	auto ran_any = false;
+	const auto run = [this, &ran_any, arrived](Tokeniser::Line cmd) {
+		if (cmd.empty() || this->held_overflow) return;
+
+		// What the client sends after 'binary' is in frames, even if
+		// the command itself is held back.
+		if (cmd.size() == 2 && cmd[1] == "binary") this->reading_frames = true;
+
+		// Replies go out in the order their commands came, so nothing
+		// can overtake a command that is waiting (on a load, say).
+		if (this->awaited || !this->held.empty()) {
+			if (MAX_HELD_COMMANDS <= this->held.size()) {
+				this->held_overflow = true;
+				return;
+			}
+			this->held.push_back({{cmd.begin(), cmd.end()}, arrived});
+			return;
+		}
+
+		this->Dispatch(cmd, arrived);
+		ran_any = true;
+	};
+
+	if (this->reading_frames) {
+		if (!this->frames.Feed(raw, run)) {
+			Debug() << "Bad frame on" << Name() << std::endl;
+			this->Depool();
+			return;
+		}
+	} else if (!this->tokeniser.Feed(raw, run)) {
+		// The client hears why before it goes, once what it's already
+		// owed has been written.
+		Debug() << "Line over the limits on" << Name() << std::endl;
+		this->rejected = true;
+		this->Respond(Response::Invalid(Response::NOREQUEST, MSG_CMD_TOO_LONG));
+		this->Shutdown();
+		return;
+	}
+	if (this->held_overflow) {
+		Debug() << "Dropping" << Name() << "with" << this->held.size() << "commands held back" << std::endl;
+		this->Depool();
+		return;
+	}
+
+	// Commands can change what the player needs to do (a load needs
+	// filling, a play needs polling, and so on), so give it an update.
+	if (ran_any) this->parent.RequestUpdate();
+}
+
+void Connection::Dispatch(Tokeniser::Line cmd, std::chrono::steady_clock::time_point arrived)
+{
+	if (auto response = RunCommand(cmd, arrived)) this->Respond(*response);
+
+	// The acknowledgement of 'binary' goes out as text, and
+	// everything after it in binary.
+	if (this->binary_requested) {
+		this->binary_requested = false;
+		this->binary = true;
+	}
+}
 
-		Response res = RunCommand(cmd);
-		this->Respond(res);
+void Connection::Complete(const Response &response)
+{
+	auto reply = response;
+	if (this->awaited) {
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		const auto [command, arrived] = *this->awaited;
+		this->awaited.reset();
+		this->unreplied.emplace_back(command, arrived);
+		const auto took = duration_cast<microseconds>(std::chrono::steady_clock::now() - arrived);
+		if (this->timing) reply.AddArg(static_cast<std::uint64_t>(took.count()));
 	}
+	this->Respond(reply);
 
-	delete[] buf->base;
+	if (this->RunHeld()) this->parent.RequestUpdate();
+}
+
+bool Connection::RunHeld()
+{
+	auto ran_any = false;
+	while (!this->awaited && !this->held.empty()) {
+		const auto next = std::move(this->held.front());
+		this->held.pop_front();
+
+		const std::vector<std::string_view> words{next.words.begin(), next.words.end()};
+		this->Dispatch(words, next.arrived);
+		ran_any = true;
+	}
+	return ran_any;
 }
 
-Response Connection::RunCommand(const std::vector<std::string> &cmd)
+std::optional<Response> Connection::RunCommand(Tokeniser::Line cmd, std::chrono::steady_clock::time_point arrived)
 {
+	Trace::Record(TraceKind::COMMAND, this->id);
+
 	// First of all, figure out what the tag of this command is.
 	// The first word is always the tag.
-	auto tag = cmd[0];
+	const auto tag = cmd[0];
 	if (cmd.size() <= 1) return Response::Invalid(tag, MSG_CMD_SHORT);
 
 	// The next words are the actual command, and any other arguments.
 	const auto &word = cmd[1];
-	const auto nargs = cmd.size() - 2;
+	const auto args = cmd.subspan(2);
+
+	// Switching protocols is up to the connection, not the player.
+	if ("binary" == word && args.empty()) {
+		this->binary_requested = true;
+		return Response::Success(tag);
+	}
+	// So is timing the connection's commands.
+	if ("timing" == word && args.empty()) {
+		this->timing = true;
+		return Response::Success(tag);
+	}
 
-	if (nargs == 0) {
-		if ("play" == word) return this->player.SetPlaying(tag, true);
-		if ("stop" == word) return this->player.SetPlaying(tag, false);
-		if ("end" == word) return this->player.End(tag);
-		if ("eject" == word) return this->player.Eject(tag);
-		if ("dump" == word) return this->player.Dump(id, tag);
-	} else if (nargs == 1) {
-		if ("fload" == word) return this->player.Load(tag, cmd[2]);
-		if ("pos" == word) return this->player.Pos(tag, cmd[2]);
+	const auto *command = FindCommand(word, args.size());
+	if (command != nullptr) {
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		const auto start = std::chrono::steady_clock::now();
+		auto result = command->handler(this->player, this->id, tag, args);
+		const auto end = std::chrono::steady_clock::now();
+		Metrics::RecordCommand(*command, Metrics::CommandStage::WAITED, duration_cast<microseconds>(start - arrived));
+		Metrics::RecordCommand(*command, Metrics::CommandStage::RAN, duration_cast<microseconds>(end - start));
+
+		// Commands that reply later are timed once they do, in Complete().
+		if (result) {
+			this->unreplied.emplace_back(command, arrived);
+			const auto took = duration_cast<microseconds>(end - arrived);
+			if (this->timing) result->AddArg(static_cast<std::uint64_t>(took.count()));
+		} else {
+			this->awaited = Arrival{command, arrived};
+		}
+		return result;
 	}
 
 	return Response::Invalid(tag, MSG_CMD_INVALID);
@@ -524,12 +2158,21 @@ Response Connection::RunCommand(const std::vector<std::string> &cmd)
 
 void Connection::Shutdown()
 {
+	// libuv only shuts down once the writes before it have finished.
+	// Anything held back goes now, as the client won't be told more.
+	if (!this->outbox.empty()) this->Write();
+
+	if (this->remote != nullptr) {
+		this->remote->shard->Defer([stream = this->remote] { StartShardShutdown(stream); });
+		return;
+	}
+
 	auto req = new uv_shutdown_t;
 	assert(req != nullptr);
 
 	req->data = this;
 
-	uv_shutdown(req, reinterpret_cast<uv_stream_t *>(this->tcp), UvShutdownCallback);
+	uv_shutdown(req, this->stream, UvShutdownCallback);
 }
 
 void Connection::Depool()
@@ -10,8 +10,22 @@
 #ifndef PLAYD_IO_CORE_H
 #define PLAYD_IO_CORE_H
 
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 // Use the same ssize_t as libmpg123 on Windows.
 #ifdef _MSC_VER
@@ -21,14 +35,19 @@ typedef ptrdiff_t ssize_t;
 #endif
 #include <uv.h>
 
+#include "frame.h"
+#include "metrics.h"
+#include "mpsc_queue.h"
 #include "player.h"
 #include "response.h"
+#include "slot_table.h"
 #include "tokeniser.h"
 
-// Forward declaration needed because of cyclic dependency between playd::io::Core and playd::Player.
+// Forward declaration needed because of cyclic dependency between playd::io::Channel and playd::Player.
 namespace Playd
 {
 class Player;
+struct Command;
 }
 
 namespace Playd::IO
@@ -37,22 +56,238 @@ namespace Playd::IO
 class Connection;
 
 /**
- * The IO core, which services input, routes responses, and executes the
- * Player update routine periodically.
+ * A response in wire format, newline included, that can't be changed.
  *
- * The IO core also maintains a pool of connections which can be sent responses
- * via their IDs inside the pool.  It ensures that each connection is given an
- * ID that is unique up until the removal of said connection.
+ * Many connections can share one of these, so a broadcast is only packed
+ * once; it goes away once the last write of it has finished.
  */
-class Core : public ResponseSink
+using PackedResponse = std::shared_ptr<const std::string>;
+
+/**
+ * Packs a Response into a PackedResponse.
+ * @param response The response to pack.
+ * @return The packed response.
+ */
+PackedResponse PackResponse(const Response &response);
+
+/**
+ * Packs a Response into a PackedResponse, as a binary frame.
+ * @param response The response to pack.
+ * @return The packed response.
+ */
+PackedResponse PackResponseFrame(const Response &response);
+
+/**
+ * A free list of buffers for libuv to read into.
+ *
+ * Buffers are allocated without being zeroed, and go back onto the free list
+ * when a read is done with them, so a busy connection doesn't allocate per
+ * read.  The list is capped, so a burst of reads doesn't pin memory forever.
+ */
+class ReadBufferPool
 {
 public:
+	/// The size of each buffer; libuv suggests this size for TCP reads.
+	static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+	/// The most free buffers the pool will hold on to.
+	static constexpr size_t MAX_FREE = 8;
+
 	/**
-	 * Constructs an IO core.
-	 * @param player The player to which update requests, commands, and new
-	 *   connection state dump requests shall be sent.
+	 * Hands out a buffer, reusing a free one if there is one.
+	 * @return A libuv buffer of BUFFER_SIZE bytes, not zeroed.
+	 */
+	uv_buf_t Acquire();
+
+	/**
+	 * Takes back a buffer handed out by Acquire().
+	 * @param base The buffer's base pointer; may be nullptr, for no buffer.
+	 */
+	void Release(char *base);
+
+	/**
+	 * @return The number of free buffers the pool is holding.
+	 */
+	[[nodiscard]] size_t FreeCount() const;
+
+	/**
+	 * @return The number of buffers handed out, and not yet taken back.
+	 *   Unlike FreeCount(), this can be called from any thread.
+	 */
+	[[nodiscard]] size_t InFlightCount() const;
+
+	/**
+	 * @return The number of buffers the pool has, whether free or handed
+	 *   out.  This can also be called from any thread.
+	 */
+	[[nodiscard]] size_t HeldCount() const;
+
+private:
+	std::vector<std::unique_ptr<char[]>> free; ///< Buffers ready for reuse.
+	std::atomic<size_t> in_flight{0};          ///< Buffers handed out.
+	std::atomic<size_t> held{0};               ///< Buffers not yet deleted.
+};
+
+/**
+ * An awaitable that resumes its coroutine after a delay, with a libuv timer.
+ * @see Coro::Task
+ */
+class Sleep
+{
+public:
+	/**
+	 * Constructs a Sleep.
+	 * @param loop The loop whose thread the coroutine resumes on.
+	 * @param delay How long to wait.
+	 */
+	Sleep(uv_loop_t *loop, std::chrono::milliseconds delay);
+
+	/// @return False, as not even a zero delay resumes straight away.
+	[[nodiscard]] bool await_ready() const noexcept;
+
+	/**
+	 * Starts the timer, to resume @a handle when it fires.
+	 * @param handle The awaiting coroutine.
+	 * @exception InternalError if the timer can't be started.
+	 */
+	void await_suspend(std::coroutine_handle<> handle);
+
+	/// Does nothing, as sleeping has no result.
+	void await_resume() const noexcept;
+
+private:
+	uv_loop_t *loop;                 ///< The loop the timer runs on.
+	std::chrono::milliseconds delay; ///< How long to wait.
+};
+
+/**
+ * An awaitable that writes to a libuv stream.
+ * Awaiting it suspends the coroutine until the write is done, then resumes it
+ * with the write's status.
+ * @see Coro::Task
+ */
+class Write
+{
+public:
+	/**
+	 * Constructs a Write.
+	 * @param stream The stream to write to.
+	 * @param data The data to write, which must outlive the await.
 	 */
-	explicit Core(Player &player);
+	Write(uv_stream_t *stream, std::string_view data);
+
+	/// @return False, as the write hasn't started yet.
+	[[nodiscard]] bool await_ready() const noexcept;
+
+	/**
+	 * Starts the write, to resume @a handle when it is done.
+	 * @param handle The awaiting coroutine.
+	 * @return False, so as to resume straight away, if the write couldn't
+	 *   start.
+	 */
+	bool await_suspend(std::coroutine_handle<> handle);
+
+	/// @return 0 if the write succeeded, or else a libuv error code.
+	[[nodiscard]] int await_resume() const noexcept;
+
+private:
+	uv_stream_t *stream;             ///< The stream to write to.
+	std::string_view data;           ///< The data to write.
+	uv_write_t req;                  ///< The libuv write request.
+	std::coroutine_handle<> waiting; ///< The coroutine to resume.
+	int status;                      ///< The write's status, once done.
+
+	/// The callback fired when the write is done.
+	static void Done(uv_write_t *req, int status);
+};
+
+/**
+ * Runs a callback once, at the end of the loop iteration it's asked in.
+ *
+ * A check handle runs just after the loop polls for I/O, which is where we
+ * want end-of-iteration work to happen; but libuv doesn't shorten the poll
+ * for check handles, so anything asked for from a timer, or any other
+ * callback that runs before the poll, would wait out the poll as well.  While
+ * armed, the flusher therefore also runs an idle handle, which makes the poll
+ * return straight away.
+ */
+class Flusher
+{
+public:
+	Flusher() = default;
+	Flusher(const Flusher &) = delete;
+	Flusher &operator=(const Flusher &) = delete;
+
+	/**
+	 * Sets up the flusher's handles.
+	 * The flusher mustn't move afterwards, as libuv points to its handles.
+	 * @param loop The loop to run on.
+	 * @param flush The callback to run at the end of each iteration armed.
+	 */
+	void Init(uv_loop_t *loop, std::function<void()> flush);
+
+	/// Asks for the callback to run at the end of this loop iteration.
+	void Arm();
+
+	/// @return Whether the callback will run at the end of this iteration.
+	[[nodiscard]] bool Armed() const;
+
+	/// Closes the flusher's handles; the loop frees them as it goes round.
+	void Close();
+
+private:
+	uv_check_t check{};          ///< Runs the callback after the poll.
+	uv_idle_t idle{};            ///< Stops the poll from blocking while armed.
+	std::function<void()> flush; ///< The callback.
+
+	/// The callback fired, once armed, just after the loop polls.
+	static void Check(uv_check_t *handle);
+};
+
+class Channel;
+class Shard;
+struct ChannelListener;
+struct ShardListener;
+struct ShardStream;
+
+/// What clients accepted by a listener may do.
+enum class ListenerPolicy : std::uint8_t {
+	CONTROL,  ///< Clients may send commands, and get every response.
+	READ_ONLY ///< Clients only get the initial dump and broadcasts; what they send is ignored.
+};
+
+/// Work handed from one loop's thread to another's.
+using Task = std::function<void()>;
+
+/**
+ * The IO core, which owns the event loop and everything on it that isn't
+ * specific to one player.
+ *
+ * Each player runs on its own Channel, with its own listener, connections and
+ * timers, but all of the channels share the core's loop, signal handling, read
+ * buffers, and the libuv threadpool that players load files on.  One process
+ * can thus drive several output devices without any of them seeing the
+ * others' clients or responses.
+ *
+ * The core can also hand its clients' sockets to Shards, each running a
+ * loop of its own on its own thread.  The players, and everything the
+ * channels and connections decide, stay on the core's loop; only the
+ * reading and writing moves.
+ */
+class Core
+{
+public:
+	/// How far behind, in bytes, a client may fall by default.
+	static constexpr std::size_t DEFAULT_MAX_BACKLOG = 4 * 1024 * 1024;
+
+	/// How many connections each listener lets wait to be accepted by default.
+	static constexpr int DEFAULT_LISTEN_BACKLOG = 128;
+
+	/**
+	 * Constructs an IO core, setting up its loop.
+	 * @exception InternalError if the loop can't be set up.
+	 */
+	Core();
 
 	/// Deleted copy constructor.
 	Core(const Core &) = delete;
@@ -60,15 +295,353 @@ public:
 	/// Deleted copy-assignment.
 	Core &operator=(const Core &) = delete;
 
+	/// Destructs an IO core.
+	~Core();
+
+	/**
+	 * Adds a channel for a player, listening for its clients.
+	 * The player sends its responses to the new channel from now on.
+	 * @param player The player to which update requests, commands, and new
+	 *   connection state dump requests shall be sent.
+	 * @param host The IP host to which the channel will bind.
+	 * @param port The TCP port to which the channel will bind.
+	 * @return The channel, for adding more listeners to.
+	 * @exception NetError Thrown if the channel cannot bind to @a host or
+	 *   @a port.
+	 */
+	Channel &AddChannel(Player &player, std::string_view host, std::string_view port);
+
+	/**
+	 * Moves client I/O onto threads of its own.
+	 *
+	 * Each shard listens on every channel's port, with SO_REUSEPORT, so
+	 * the kernel spreads new clients across them.  This must be called
+	 * before any channels are added.
+	 *
+	 * @param count The number of I/O threads to run.
+	 * @exception ConfigError Thrown if this platform can't share a port
+	 *   between listeners.
+	 * @exception InternalError Thrown if a shard's loop can't be set up.
+	 */
+	void AddShards(std::size_t count);
+
+	/// @return The shards, which are empty unless AddShards() was called.
+	[[nodiscard]] const std::vector<std::unique_ptr<Shard>> &Shards() const;
+
+	/**
+	 * Runs a task on this core's loop, as soon as it can.
+	 * This is safe to call from any thread, once AddShards() has been.
+	 * @param task The task.
+	 */
+	void Post(Task task);
+
+	/// Runs every task posted so far; only the loop calls this.
+	void RunPosted();
+
+	/**
+	 * Asks for a shard's deferred tasks to be posted to it, once this
+	 * loop iteration's responses are in.
+	 * @param shard The shard with deferred tasks.
+	 * @see Shard::Defer
+	 */
+	void RequestSubmit(Shard &shard);
+
+	/**
+	 * Serves metrics over HTTP, for Prometheus (or anything else reading
+	 * OpenMetrics) to scrape.
+	 * Scrapes are answered on the loop, between everything else on it.
+	 * @param host The IP host to which the metrics listener will bind.
+	 * @param port The TCP port to which the metrics listener will bind.
+	 * @exception NetError Thrown if the listener cannot bind to @a host or
+	 *   @a port.
+	 */
+	void AddMetricsListener(std::string_view host, std::string_view port);
+
+	/**
+	 * Accepts a scrape from the metrics listener.
+	 * @param server Pointer to the metrics listener.
+	 */
+	void AcceptScrape(uv_stream_t *server);
+
+	/// @return Every channel's figures for the metrics, in player order.
+	[[nodiscard]] std::vector<Metrics::PlayerSample> SampleChannels() const;
+
+	/**
+	 * Gathers the process-wide figures for a metrics scrape.
+	 * @return The figures.
+	 */
+	[[nodiscard]] Metrics::ProcessSample SampleProcess() const;
+
 	/**
 	 * Runs the reactor.
-	 * It will block until it terminates.
-	 * @param host The IP host to which the IO core will bind.
-	 * @param port The TCP port to which the IO core will bind.
-	 * @exception Net_error Thrown if the IO core cannot bind to @a host or @a
-	 *   port.
+	 * It will block until every channel has shut down, and any shards
+	 * have finished with their clients.
+	 */
+	void Run();
+
+	/**
+	 * Asks every player to quit, and arranges for the channels to notice.
+	 */
+	void Quit();
+
+	/**
+	 * Runs some work on the libuv threadpool, for every channel at once.
+	 * @param work The work, which runs on a threadpool thread.
+	 * @param done Called on the loop thread once the work is done; every
+	 *   player gets an update straight afterwards.
+	 */
+	void RunInBackground(std::function<void()> work, std::function<void()> done);
+
+	/**
+	 * @return The pool from which connections' read buffers come.
 	 */
-	void Run(std::string_view host, std::string_view port);
+	ReadBufferPool &ReadBuffers();
+
+	/**
+	 * Asks for a channel's pending responses to be written out.
+	 *
+	 * The write happens once per loop iteration, after all of that
+	 * iteration's callbacks have run, so that every response they
+	 * produced goes out in one write.
+	 *
+	 * @param channel The channel with pending responses.
+	 */
+	void RequestFlush(Channel &channel);
+
+	/// Writes out the pending responses of every channel that asked.
+	void FlushChannels();
+
+	/**
+	 * Notes that a channel has shut down.
+	 * Once every channel has, the core closes its own handles, so that the
+	 * loop can end.
+	 */
+	void ChannelClosed();
+
+	/// @return The loop this core is using.
+	[[nodiscard]] uv_loop_t *Loop() const;
+
+	/**
+	 * Sets how far behind a client may fall before it is disconnected.
+	 * @param bytes The most bytes of responses a client may have waiting
+	 *   to be written to it.
+	 */
+	void SetMaxBacklog(std::size_t bytes);
+
+	/// @return How far behind, in bytes, a client may fall.
+	[[nodiscard]] std::size_t MaxBacklog() const;
+
+	/**
+	 * Sets how long, and how many words, clients' command lines may be.
+	 * Clients sending longer lines are told so, then disconnected.  This
+	 * only affects clients connecting afterwards.
+	 * @param limits The limits.
+	 */
+	void SetLineLimits(Tokeniser::Limits limits);
+
+	/// @return How long, and how many words, clients' command lines may be.
+	[[nodiscard]] Tokeniser::Limits LineLimits() const;
+
+	/**
+	 * Sets how many connections each listener lets wait to be accepted.
+	 * This only affects listeners added afterwards.
+	 * @param count The backlog given to listen(); the kernel may cap it.
+	 */
+	void SetListenBacklog(int count);
+
+	/// @return How many connections each listener lets wait to be accepted.
+	[[nodiscard]] int ListenBacklog() const;
+
+private:
+	uv_loop_t *loop;      ///< The loop this core is using.
+	uv_signal_t sigint{}; ///< The libuv handle for the Ctrl-C signal.
+	uv_signal_t sigusr1{}; ///< The libuv handle for the trace-dumping signal.
+	Flusher flusher;      ///< Does the end-of-iteration writes.
+
+	/// The metrics listener, if metrics are being served.
+	std::unique_ptr<uv_tcp_t> metrics_server;
+
+	ReadBufferPool read_buffers; ///< Buffers for reading from clients.
+
+	/// The channels, one per player.
+	std::vector<std::unique_ptr<Channel>> channels;
+
+	/// The channels with responses waiting for FlushChannels().
+	std::vector<Channel *> dirty;
+
+	/// The threads doing client I/O, if any.
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	/// The shards with tasks waiting for FlushChannels().
+	std::vector<Shard *> dirty_shards;
+
+	MpscQueue<Task> inbox; ///< Tasks posted from the shards.
+	uv_async_t inbox_wake{}; ///< The libuv handle that wakes us for them.
+
+	std::size_t open_channels{0}; ///< How many channels haven't shut down.
+
+	/// How far behind, in bytes, a client may fall.
+	std::size_t max_backlog{DEFAULT_MAX_BACKLOG};
+
+	/// How long, and how many words, clients' command lines may be.
+	Tokeniser::Limits line_limits;
+
+	/// How many connections each listener lets wait to be accepted.
+	int listen_backlog{DEFAULT_LISTEN_BACKLOG};
+
+	/// Sets up the flusher, which writes responses at the end of each iteration.
+	void InitFlusher();
+
+	/**
+	 * Initialises playd's signal handling.
+	 *
+	 * We trap SIGINT, and the equivalent emulated signal on Windows, to
+	 * make playd close gracefully when Ctrl-C is sent.
+	 */
+	void InitSignals();
+
+	/// Closes the core's own handles, once every channel has shut down.
+	void Shutdown();
+
+	/// Posts every dirty shard its deferred tasks.
+	void SubmitShards();
+
+	/**
+	 * Stops the shards, once the loop has finished, letting them close
+	 * down their clients first.
+	 */
+	void StopShards();
+};
+
+/**
+ * A thread doing client I/O for the core.
+ *
+ * Each shard has its own loop, listening on every channel's port and
+ * holding the sockets of the clients the kernel gave it.  What it reads,
+ * it posts to the core; what the core wants written, the core defers to the
+ * shard, which gets one batch of tasks per core loop iteration however many
+ * clients a broadcast reaches.  Tasks go both ways through MpscQueues, with
+ * uv_async_send to wake the other side.
+ */
+class Shard
+{
+public:
+	/**
+	 * Constructs a shard, setting up its loop but not starting its thread.
+	 * @param core The core for which this shard does I/O.
+	 * @exception InternalError if the loop can't be set up.
+	 */
+	explicit Shard(Core &core);
+
+	/// Deleted copy constructor.
+	Shard(const Shard &) = delete;
+
+	/// Deleted copy-assignment.
+	Shard &operator=(const Shard &) = delete;
+
+	/// Destructs a shard, which must have stopped.
+	~Shard();
+
+	/**
+	 * Starts listening, on the shard's loop, for a channel's clients.
+	 * This must happen before Start().
+	 * @param channel The channel to which clients are handed.
+	 * @param host The IPv4 or IPv6 host to which the listener will bind.
+	 * @param port The TCP port to which the listener will bind.
+	 * @param policy What the listener's clients may do.
+	 * @exception NetError Thrown if the listener cannot bind to @a host or
+	 *   @a port.
+	 */
+	void Listen(Channel &channel, std::string_view host, std::string_view port, ListenerPolicy policy);
+
+	/// Starts the shard's thread.
+	void Start();
+
+	/**
+	 * Queues a task for the shard, to be posted to it with the others
+	 * queued in the same core loop iteration.
+	 * Only the core's loop thread may call this; tasks run in order.
+	 * @param task The task, which runs on the shard's thread.
+	 */
+	void Defer(Task task);
+
+	/// Posts the shard every task deferred so far, in one go.
+	void Submit();
+
+	/**
+	 * Stops listening, and waits for the shard to finish closing its
+	 * clients, which the core must have released.
+	 */
+	void Stop();
+
+	/// Runs every task posted so far; only the shard's loop calls this.
+	void RunPosted();
+
+	/**
+	 * Stops listening for a channel's clients.
+	 * Only tasks on the shard's thread may call this.
+	 * @param channel The channel, or nullptr for every channel.
+	 */
+	void CloseListeners(const Channel *channel);
+
+	/**
+	 * Hands a client, newly accepted by one of this shard's listeners,
+	 * to the core.
+	 * @param listener The listener that accepted it.
+	 */
+	void Accept(ShardListener &listener);
+
+	/// @return The core for which this shard does I/O.
+	[[nodiscard]] Core &Owner() const;
+
+	/// @return The pool from which this shard's read buffers come.
+	ReadBufferPool &ReadBuffers();
+
+private:
+	Core &core;        ///< The core for which this shard does I/O.
+	uv_loop_t loop{};  ///< The shard's own loop.
+	uv_async_t wake{}; ///< The libuv handle that wakes the loop for tasks.
+
+	MpscQueue<Task> tasks;     ///< Tasks posted by the core.
+	std::vector<Task> pending; ///< Tasks deferred, but not yet posted.
+	std::thread thread;        ///< The thread running the loop.
+
+	ReadBufferPool read_buffers; ///< Buffers for reading from clients.
+
+	/// The listeners, one per channel, until they close.
+	std::vector<ShardListener *> listeners;
+};
+
+/**
+ * One player's part of the IO core, which services its clients' input,
+ * routes its responses, and executes its update routine when it asks for it
+ * (and periodically, while it is playing).
+ *
+ * The channel also maintains a pool of connections which can be sent
+ * responses via their IDs inside the pool.  Each connection's ID is unique
+ * among every connection the channel has had, so responses meant for a
+ * connection that has gone don't reach whichever one took its place.
+ */
+class Channel : public ResponseSink
+{
+public:
+	/**
+	 * Constructs a channel, and starts it listening.
+	 * @param core The core whose loop the channel runs on.
+	 * @param player The player to which update requests, commands, and new
+	 *   connection state dump requests shall be sent.
+	 * @param host The IP host to which the channel will bind.
+	 * @param port The TCP port to which the channel will bind.
+	 * @exception NetError Thrown if the channel cannot bind to @a host or
+	 *   @a port.
+	 */
+	Channel(Core &core, Player &player, std::string_view host, std::string_view port);
+
+	/// Deleted copy constructor.
+	Channel(const Channel &) = delete;
+
+	/// Deleted copy-assignment.
+	Channel &operator=(const Channel &) = delete;
 
 	//
 	// Connection API
@@ -77,19 +650,40 @@ public:
 	/**
 	 * Accepts a new connection.
 	 *
-	 * This accepts the connection, and adds it to this IoCore's
+	 * This accepts the connection, and adds it to this channel's
 	 * connection pool.
 	 *
 	 * This should be called with a server that has just received a new
 	 * connection.
 	 *
 	 * @param server Pointer to the libuv server accepting connections.
+	 * @param policy What the server's clients may do.
+	 */
+	void Accept(uv_stream_t *server, ListenerPolicy policy);
+
+	/**
+	 * Takes on a client accepted by a shard.
+	 * If the channel has shut down, the client is released at once.
+	 * @param stream The client's socket, on its shard.
+	 */
+	void Adopt(ShardStream *stream);
+
+	/**
+	 * Looks up a connection.
+	 * @param id The connection's ID.
+	 * @return The connection, or nullptr if it has gone.
 	 */
-	void Accept(uv_stream_t *server);
+	[[nodiscard]] Connection *Find(ClientId id) const;
+
+	/**
+	 * Removes every connection left, once the loop has finished.
+	 * Shards need their clients released before they can stop.
+	 */
+	void ReleaseConnections();
 
 	/**
 	 * Removes a connection.
-	 * As the IoCore owns the Connection, it will be destroyed by this
+	 * As the channel owns the Connection, it will be destroyed by this
 	 * operation.
 	 * @param id The ID of the connection to remove.
 	 */
@@ -97,74 +691,135 @@ public:
 
 	/**
 	 * Performs a player update cycle.
-	 * If the player is closing, IoCore will announce this fact to
-	 * all current connections, close them, and end the I/O loop.
+	 * If the player is closing, the channel will announce this fact to
+	 * all current connections, close them, and stop listening.
+	 *
+	 * This also starts the update timer if the player is playing, and
+	 * stops it otherwise; idle players are only updated on request.
 	 */
 	void UpdatePlayer();
 
-	void Respond(ClientId id, const Response &response) const override;
+	/**
+	 * Asks for a player update cycle on the next loop iteration.
+	 * Unlike UpdatePlayer(), this is safe to call from any thread.
+	 */
+	void RequestUpdate();
 
-	/// Shuts down the IoCore by terminating all IO loop tasks.
-	void Shutdown();
+	/**
+	 * Asks the player to quit, and arranges for the channel to notice.
+	 */
+	void Quit();
 
-private:
-	/// The period between player updates.
-	static const uint16_t PLAYER_UPDATE_PERIOD;
+	/**
+	 * Gathers this channel's figures for the metrics.
+	 * @param index The channel's player's index.
+	 * @return The figures.
+	 */
+	[[nodiscard]] Metrics::PlayerSample Sample(std::size_t index) const;
 
-	uv_loop_t *loop;      ///< The loop this IoCore is using.
-	uv_signal_t sigint{}; ///< The libuv handle for the Ctrl-C signal.
-	uv_tcp_t server{};    ///< The libuv handle for the TCP server.
-	uv_timer_t updater{}; ///< The libuv handle for the update timer.
+	/**
+	 * Runs some work on the libuv threadpool.
+	 * @param work The work, which runs on a threadpool thread.
+	 * @param done Called on the loop thread once the work is done; the
+	 *   player gets an update straight afterwards.
+	 */
+	void RunInBackground(std::function<void()> work, std::function<void()> done);
 
-	Player &player; ///< The player.
+	void Respond(ClientId id, const Response &response) const override;
 
-	/// The set of connections inside this IoCore.
-	std::vector<std::shared_ptr<Connection>> pool;
+	void Multicast(const std::vector<ClientId> &ids, const Response &response) const override;
 
-	/// A list of free 1-indexed slots inside pool.
-	/// These slots may be re-used instead of creating a new slot.
-	std::vector<ClientId> free_list;
+	void Complete(ClientId id, const Response &response) const override;
 
 	/**
-	 * Initialises a TCP acceptor on the given address and port.
-	 *
-	 * @param address The IPv4 address on which the TCP server should
-	 *   listen.
-	 * @param port The TCP port on which the TCP server should listen.
+	 * Asks for a connection's pending responses to be written out.
+	 * @param id The ID of the connection with pending responses.
+	 * @see Core::RequestFlush
 	 */
-	void InitAcceptor(std::string_view address, std::string_view port);
+	void RequestFlush(ClientId id);
 
-	/// Sets up a periodic timer to run the playd update loop.
-	void InitUpdateTimer();
+	/// Writes out the pending responses of every connection that asked.
+	void FlushConnections();
+
+	/// @return How far behind, in bytes, a client may fall.
+	/// @see Core::MaxBacklog
+	[[nodiscard]] std::size_t MaxBacklog() const;
+
+	/// @return How long, and how many words, clients' command lines may be.
+	/// @see Core::LineLimits
+	[[nodiscard]] Tokeniser::Limits LineLimits() const;
 
 	/**
-	 * Initialises playd's signal handling.
+	 * Also listens for clients on another address.
 	 *
-	 * We trap SIGINT, and the equivalent emulated signal on Windows, to
-	 * make playd close gracefully when Ctrl-C is sent.
+	 * Each listener has a policy of its own, so (say) a monitoring network
+	 * can be given read-only access while the control network has full
+	 * access.  With I/O threads, each shard listens here too.
+	 *
+	 * @param host The IPv4 or IPv6 host to which the listener will bind.
+	 *   An IPv6 wildcard (::) takes IPv4 clients too, unless the OS has
+	 *   been told otherwise.
+	 * @param port The TCP port to which the listener will bind.
+	 * @param policy What the listener's clients may do.
+	 * @exception NetError Thrown if the channel cannot bind to @a host or
+	 *   @a port.
 	 */
-	void InitSignals();
-
-	//
-	// Connection pool handling
-	//
+	void AddListener(std::string_view host, std::string_view port, ListenerPolicy policy);
 
 	/**
-	 * Acquires the next available connection ID.
-	 * This ID may have been assigned to a connection in the past, but is
-	 * guaranteed not to match any currently assigned IDs.
-	 * @return size_t A fresh ID for use.
+	 * Also listens for clients on a Unix domain socket.
+	 *
+	 * Clients on the same host can connect here instead of through TCP,
+	 * skipping the loopback network stack; they speak the same protocol.
+	 * Their connections stay on the main loop, even with I/O threads.
+	 *
+	 * @param path The socket's path.  A stale socket already there is
+	 *   removed first; anything else there is left alone.
+	 * @exception NetError Thrown if the channel cannot listen at @a path.
 	 */
-	ClientId NextConnectionID();
+	void ListenLocally(const std::string &path);
+
+	/// Shuts down the channel by terminating all of its IO loop tasks.
+	void Shutdown();
+
+private:
+	Core &core;             ///< The core whose loop this channel runs on.
+	uv_pipe_t local{};      ///< The libuv handle for the Unix socket server.
+	std::string local_path; ///< Where the Unix socket server is, if anywhere.
+	uv_timer_t updater{};   ///< The libuv handle for the update timer.
+
+	/// The libuv handle through which other threads ask for updates.
+	uv_async_t player_wake{};
+
+	bool shutting_down{false}; ///< Whether Shutdown() has been called.
+	bool sharded{false};       ///< Whether the shards listen, rather than us.
+
+	Player &player; ///< The player.
+
+	/// The TCP servers on the main loop, which libuv frees as they close.
+	std::vector<ChannelListener *> listeners;
+
+	/// The connections inside this channel.
+	SlotTable<Connection> pool;
+
+	/// The IDs of connections with responses waiting for FlushConnections().
+	std::vector<ClientId> dirty;
 
 	/**
-	 * Adds a new connection slot to the connection pool.
-	 * This is called by NextConnectionID when the number of currently
-	 * running connections is larger than the number of existing pool
-	 * slots, and will eventually fail (when the number of simultaneous
-	 * connections reaches absurd proportions).
+	 * Initialises a TCP acceptor on the given address and port.
+	 *
+	 * @param address The IPv4 or IPv6 address on which the TCP server
+	 *   should listen.
+	 * @param port The TCP port on which the TCP server should listen.
+	 * @param policy What the server's clients may do.
 	 */
-	void ExpandPool();
+	void InitAcceptor(std::string_view address, std::string_view port, ListenerPolicy policy);
+
+	/// Sets up a periodic timer to run the playd update loop.
+	void InitUpdateTimer();
+
+	/// Sets up the handle through which player updates are requested.
+	void InitPlayerWake();
 
 	//
 	// Response dispatch
@@ -191,27 +846,42 @@ private:
 };
 
 /**
- * A TCP connection from a client.
+ * A connection from a client, over TCP or a Unix domain socket.
  *
- * This class wraps a libuv TCP stream representing a client connection,
+ * This class wraps a libuv stream representing a client connection,
  * allowing it to be sent responses (directly, or via a broadcast), removed
- * from its IoCore, and queried for its name.
+ * from its Channel, and queried for its name.
  */
 class Connection
 {
 public:
+	/// A command whose reply is on its way, and when the command arrived.
+	using Arrival = std::pair<const Command *, std::chrono::steady_clock::time_point>;
+
 	/**
 	 * Constructs a Connection.
-	 * @param parent The connection pool to which this Connection belongs.
-	 * @param tcp The underlying libuv TCP stream.
+	 * @param parent The channel to which this Connection belongs.
+	 * @param stream The underlying libuv TCP or pipe stream.
 	 * @param player The player to which read commands should be sent.
-	 * @param id The ID of this Connection in the IoCore.
+	 * @param id The ID of this Connection in the channel.
+	 * @param policy What the client may do.
 	 */
-	Connection(Core &parent, uv_tcp_t *tcp, Player &player, ClientId id);
+	Connection(Channel &parent, uv_stream_t *stream, Player &player, ClientId id, ListenerPolicy policy);
+
+	/**
+	 * Constructs a Connection whose socket is on a shard.
+	 * @param parent The channel to which this Connection belongs.
+	 * @param remote The socket, on its shard.
+	 * @param player The player to which read commands should be sent.
+	 * @param id The ID of this Connection in the channel.
+	 * @param policy What the client may do.
+	 */
+	Connection(Channel &parent, ShardStream *remote, Player &player, ClientId id, ListenerPolicy policy);
 
 	/**
 	 * Destructs a Connection.
-	 * This causes libuv to close and free the libuv TCP stream.
+	 * This causes libuv to close and free the libuv TCP stream (on its
+	 * shard, if it has one).
 	 */
 	~Connection();
 
@@ -223,10 +893,72 @@ public:
 
 	/**
 	 * Emits a Response via this Connection.
+	 *
+	 * The response is queued, and goes out with any others queued in the
+	 * same loop iteration when the Channel next calls Flush().
+	 *
 	 * @param response The response to send.
 	 */
 	void Respond(const Response &response);
 
+	/// What can happen to a shared response if the client is behind.
+	enum class Delivery : std::uint8_t {
+		RELIABLE,    ///< It is sent, however far behind the client is.
+		REPLACEABLE, ///< A newer one of the same kind makes it stale (as with position updates).
+		DROPPABLE,   ///< It is dropped, rather than add to a backlog (as with tapped audio).
+	};
+
+	/**
+	 * Works out how a response going to many clients can be delivered.
+	 * @param code The response's code.
+	 * @return How it can be delivered.
+	 */
+	[[nodiscard]] static Delivery DeliveryOf(Response::Code code);
+
+	/**
+	 * Emits an already-packed response via this Connection.
+	 *
+	 * If the client is behind, a replaceable response replaces the last
+	 * one still waiting, rather than queueing behind it, and a droppable
+	 * one is dropped once the client has a quarter of MaxBacklog() waiting,
+	 * so that it's never evicted for them.
+	 *
+	 * @param response The packed response to send.
+	 * @param delivery What can happen to it if the client is behind.
+	 * @see Respond(const Response &)
+	 */
+	void Respond(PackedResponse response, Delivery delivery = Delivery::RELIABLE);
+
+	/**
+	 * Emits the reply to the command this Connection is waiting on, then
+	 * runs the commands held back behind it, until one of them has to
+	 * wait too.
+	 * @param response The reply.
+	 */
+	void Complete(const Response &response);
+
+	/**
+	 * @return Whether this Connection has switched to binary frames.
+	 */
+	[[nodiscard]] bool IsBinary() const;
+
+	/**
+	 * Writes out all queued responses, in one write.
+	 *
+	 * This does nothing if there are no queued responses.  If libuv is
+	 * still writing earlier responses, the queued ones are held until it
+	 * finishes; if the client has fallen further behind than the channel
+	 * allows, it is disconnected (which may destruct this Connection).
+	 */
+	void Flush();
+
+	/**
+	 * Notes that a write to the client has finished.
+	 * If responses were held back while it was going, this asks for them
+	 * to be flushed.
+	 */
+	void WriteDone();
+
 	/**
 	 * Processes a data read on this connection.
 	 * @param nread The number of bytes read.
@@ -234,6 +966,13 @@ public:
 	 */
 	void Read(ssize_t nread, const uv_buf_t *buf);
 
+	/**
+	 * Processes bytes read from the client.
+	 * @param raw The bytes.
+	 * @param arrived When they were read.
+	 */
+	void Feed(std::string_view raw, std::chrono::steady_clock::time_point arrived);
+
 	/**
 	 * Gracefully shuts this connection down.
 	 *
@@ -244,8 +983,8 @@ public:
 
 	/**
 	 * Removes this connection from its connection pool.
-	 * Since the pool may contain a shared reference to this connection,
-	 * calling this can result in the connection being destructed.
+	 * As the pool owns this connection, calling this destructs it; nothing
+	 * may touch the connection afterwards.
 	 */
 	void Depool();
 
@@ -256,28 +995,124 @@ public:
 	 */
 	std::string Name();
 
+	/// @return How many responses are waiting for Flush().
+	[[nodiscard]] std::size_t QueuedResponses() const;
+
+	/// @return How many bytes libuv has yet to write to the client.
+	[[nodiscard]] std::size_t WriteQueueBytes() const;
+
+	/// @return How many bytes of responses are waiting for Flush().
+	[[nodiscard]] std::size_t OutboxBytes() const;
+
+	/**
+	 * @return How much memory the connection holds for commands it has
+	 *   read but not yet run: its tokeniser or frame reader's buffers, and
+	 *   any commands held back, in bytes.
+	 */
+	[[nodiscard]] std::size_t InputBytes() const;
+
 private:
-	/// The pool on which this connection is running.
-	Core &parent;
+	/// The channel on which this connection is running.
+	Channel &parent;
+
+	/// The libuv handle for the connection, unless it's on a shard.
+	uv_stream_t *stream;
 
-	/// The libuv handle for the TCP connection.
-	uv_tcp_t *tcp;
+	/// The TCP connection on its shard, if it has one.
+	ShardStream *remote;
 
 	/// The Tokeniser to which data read on this connection should be sent.
 	Tokeniser tokeniser;
 
+	/// The FrameReader used instead of the Tokeniser in binary mode.
+	FrameReader frames;
+
 	/// The Player to which finished commands should be sent.
 	Player &player;
 
 	/// The Connection's ID in the connection pool.
 	ClientId id;
 
+	/// Packed responses waiting for Flush().
+	std::vector<PackedResponse> outbox;
+
+	/// The total size of the responses in outbox.
+	std::size_t outbox_bytes;
+
+	/// Where in outbox the last replaceable response is, if there is one.
+	std::optional<std::size_t> replaceable_at;
+
+	/// Whether this connection has asked its channel for a Flush().
+	bool flush_requested;
+
+	/// Whether this connection is sending binary frames.
+	bool binary;
+
+	/// Whether this connection is reading binary frames.
+	bool reading_frames;
+
+	/// Whether to switch to binary once the current command is answered.
+	bool binary_requested;
+
+	/// Whether replies carry how long their commands took.
+	bool timing;
+
+	/// Whether the client is read-only, so what it sends is ignored.
+	bool read_only;
+
+	/// The commands whose replies are in outbox, for timing their writes.
+	std::vector<Arrival> unreplied;
+
+	/// A command line held back until earlier commands have replied.
+	struct HeldCommand {
+		std::vector<std::string> words;                ///< The command's words, copied.
+		std::chrono::steady_clock::time_point arrived; ///< When it was read.
+	};
+
+	/// The most commands a client may have held back before it is dropped.
+	static constexpr std::size_t MAX_HELD_COMMANDS = 256;
+
+	/// The command that will reply later, if there is one.
+	std::optional<Arrival> awaited;
+
+	/// Commands that arrived while awaited was waiting, in order.
+	std::deque<HeldCommand> held;
+
+	/// Whether the client sent more than MAX_HELD_COMMANDS.
+	bool held_overflow;
+
+	/// Whether the client sent a line over the limits, and is being
+	/// disconnected.
+	bool rejected;
+
+	/**
+	 * Runs a command line, and sends its reply if it has one now.
+	 * @param cmd The command words making up a command line.
+	 * @param arrived When the bytes holding the command line were read.
+	 */
+	void Dispatch(Tokeniser::Line cmd, std::chrono::steady_clock::time_point arrived);
+
+	/**
+	 * Runs held commands, until none are left or one has to wait.
+	 * @return Whether any commands ran.
+	 */
+	bool RunHeld();
+
 	/**
 	 * Handles a tokenised command line.
-	 * @param msg A vector of command words representing a command line.
-	 * @return A final response returning whether the command succeeded.
+	 * @param cmd The command words making up a command line.
+	 * @param arrived When the bytes holding the command line were read.
+	 * @return A final response returning whether the command succeeded,
+	 *   or nothing if the command will respond by itself later (through
+	 *   Complete()), in which case it becomes the awaited command.
 	 */
-	Response RunCommand(const std::vector<std::string> &msg);
+	std::optional<Response> RunCommand(Tokeniser::Line cmd, std::chrono::steady_clock::time_point arrived);
+
+	/// Asks the channel for a Flush(), unless this connection already has.
+	void AskForFlush();
+
+	/// Hands everything in outbox to libuv, in one write.
+	void Write();
 };
 
 } // namespace Playd::IO
@@ -8,20 +8,45 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
+#include "config_file.h"
 #include "io.h"
 #include "messages.h"
 #include "player.h"
 #include "response.h"
+#include "shared_playhead.h"
+#include "state_snapshot.h"
+#include "audio/analysis.h"
+#include "audio/channel_matrix.h"
+#include "audio/sinks/fan_out.h"
+#include "audio/sinks/file.h"
+#include "sinks.h"
+#include "sources.h"
+#include "trace.h"
 
-#ifdef WITH_MP3
-#include "audio/sources/mp3.h"
-#endif // WITH_MP3
-#ifdef WITH_SNDFILE
-#include "audio/sources/sndfile.h"
-#endif // WITH_SNDFILE
+#ifdef WITH_ALSA
+#include "audio/sinks/alsa.h"
+#endif // WITH_ALSA
+
+#ifdef WITH_RTP
+#include "audio/sinks/rtp.h"
+#endif // WITH_RTP
 
 namespace Playd
 {
@@ -32,19 +57,188 @@ constexpr std::string_view DEFAULT_HOST{"0.0.0.0"};
 /// The default TCP port on which playd will bind.
 constexpr std::string_view DEFAULT_PORT{"1350"};
 
-/// Map from file extensions to Audio_source builder functions.
-static const std::map<std::string, Player::SourceFn> SOURCES{
-#ifdef WITH_MP3
-        {"mp3", Audio::MP3Source::MakeUnique},
-#endif // WITH_MP3
-
-#ifdef WITH_SNDFILE
-        {"flac", Audio::SndfileSource::MakeUnique},
-        {"ogg", Audio::SndfileSource::MakeUnique},
-        {"wav", Audio::SndfileSource::MakeUnique},
-#endif // WITH_SNDFILE
+/// The option that reads more options from a file.
+constexpr std::string_view CONFIG_OPTION{"--config="};
+
+/// The flag that makes playd listen before starting up the audio systems.
+constexpr std::string_view FAST_START_FLAG{"--fast-start"};
+
+/// The flag that makes playd decode on a dedicated thread.
+constexpr std::string_view DECODE_THREAD_FLAG{"--decode-thread"};
+
+/// The flag that locks all of playd's memory into RAM.
+constexpr std::string_view LOCK_MEMORY_FLAG{"--lock-memory"};
+
+/// The flag that puts large audio buffers on huge pages.
+constexpr std::string_view HUGE_PAGES_FLAG{"--huge-pages"};
+
+/// The flag that meters the loudness of every file as it decodes.
+constexpr std::string_view LOUDNESS_FLAG{"--loudness"};
+
+/// The flag that makes playd follow, and take over, another's snapshots.
+constexpr std::string_view STANDBY_FLAG{"--standby"};
+
+/// The option that sets the audio callback threads' real-time priority.
+constexpr std::string_view AUDIO_PRIORITY_OPTION{"--audio-priority="};
+
+/// The option that pins the audio callback threads to some CPUs.
+constexpr std::string_view AUDIO_CPUS_OPTION{"--audio-cpus="};
+
+/// The option that sets the decoding threads' real-time priority.
+constexpr std::string_view DECODE_PRIORITY_OPTION{"--decode-priority="};
+
+/// The option that pins the decoding threads to some CPUs.
+constexpr std::string_view DECODE_CPUS_OPTION{"--decode-cpus="};
+
+/// The option that sets the resampling quality (or turns it off).
+constexpr std::string_view RESAMPLE_OPTION{"--resample="};
+
+/// The option that sets the channel count to remix to (or turns it off).
+constexpr std::string_view CHANNELS_OPTION{"--channels="};
+
+/// The option that sets where the metadata cache lives.
+constexpr std::string_view CACHE_OPTION{"--cache="};
+
+/// What goes on the end of the metadata cache's path to get the waveform cache's.
+constexpr std::string_view WAVEFORM_CACHE_SUFFIX{".waveforms"};
+
+/// What goes on the end of the metadata cache's path to get the cue cache's.
+constexpr std::string_view CUE_CACHE_SUFFIX{".cues"};
+
+/// The option that trims silence off each file, below some level.
+constexpr std::string_view TRIM_OPTION{"--trim="};
+
+/// The option that sets how much decoded audio to keep in memory.
+constexpr std::string_view RAM_CACHE_OPTION{"--ram-cache="};
+
+/// The option that picks the audio output backend.
+constexpr std::string_view BACKEND_OPTION{"--backend="};
+
+/// The option that sets the frames in each device period, where the backend
+/// lets us choose.
+constexpr std::string_view PERIOD_OPTION{"--period="};
+
+/// The option that sets how many periods the device buffers.
+constexpr std::string_view PERIODS_OPTION{"--periods="};
+
+/// The option that sets where the RTP backend sends its streams.
+constexpr std::string_view RTP_DEST_OPTION{"--rtp-dest="};
+
+/// The option that sets the RTP backend's packet time, in microseconds.
+constexpr std::string_view RTP_PTIME_OPTION{"--rtp-ptime="};
+
+/// The option that sets how much audio each player buffers.
+constexpr std::string_view BUFFER_OPTION{"--buffer="};
+
+/// The option that makes `play` wait for some audio to be buffered.
+constexpr std::string_view PRE_ROLL_OPTION{"--pre-roll="};
+
+/// The option that sets how often playing players are updated.
+constexpr std::string_view UPDATE_PERIOD_OPTION{"--update-period="};
+
+/// The option that sets how many new clients may wait to be accepted.
+constexpr std::string_view LISTEN_BACKLOG_OPTION{"--listen-backlog="};
+
+/// The option that renders a file to another file, rather than playing.
+constexpr std::string_view RENDER_OPTION{"--render="};
+
+/// The option that analyses a directory of files into the caches, rather than playing.
+constexpr std::string_view ANALYSE_OPTION{"--analyse="};
+
+/// The option that sets which waveforms an analysis finds.
+constexpr std::string_view WAVEFORMS_OPTION{"--waveforms="};
+
+/// The option that sets what rendered audio is written as.
+constexpr std::string_view RENDER_FORMAT_OPTION{"--render-format="};
+
+/// The option that serves metrics over HTTP, on a port of the players' host.
+constexpr std::string_view METRICS_OPTION{"--metrics="};
+
+/// The option that sets how far behind a client may fall before it is dropped.
+constexpr std::string_view MAX_BACKLOG_OPTION{"--max-backlog="};
+
+/// The option that sets how long a client's command lines may be.
+constexpr std::string_view MAX_LINE_OPTION{"--max-line="};
+
+/// The option that sets how many words a client's command lines may have.
+constexpr std::string_view MAX_WORDS_OPTION{"--max-words="};
+
+/// The option that moves client I/O onto threads of its own.
+constexpr std::string_view IO_THREADS_OPTION{"--io-threads="};
+
+/// The option that also listens for clients on other addresses.
+constexpr std::string_view LISTEN_OPTION{"--listen="};
+
+/// The suffix on a listener that makes its clients read-only.
+constexpr std::string_view READ_ONLY_SUFFIX{"/ro"};
+
+/// The option that also listens for clients on a Unix domain socket.
+constexpr std::string_view SOCKET_OPTION{"--socket="};
+
+/// The option that publishes each player's playhead in shared memory.
+constexpr std::string_view SHM_OPTION{"--shm="};
+
+/// The option that snapshots each player's state for a standby playd.
+constexpr std::string_view SNAPSHOT_OPTION{"--snapshot="};
+
+/// The option that traces the hot paths, for dumping to a file.
+constexpr std::string_view TRACE_OPTION{"--trace="};
+
+/// The largest file, in bytes, that the RAM cache keeps.
+constexpr std::uint64_t RAM_CACHE_MAX_FILE{4 * 1024 * 1024};
+
+/// Times each stage of startup, for the debug output.
+class StartupTimer
+{
+public:
+	/// The clock startup is timed on.
+	using Clock = std::chrono::steady_clock;
+
+	/// Constructs a StartupTimer, starting it now.
+	StartupTimer() : start{Clock::now()}, last{start}
+	{
+	}
+
+	/**
+	 * Reports how long a stage took, and how long startup has taken so far.
+	 * @param stage The name of the stage that has just finished.
+	 */
+	void Mark(std::string_view stage)
+	{
+		const auto now = Clock::now();
+		const auto us = [](Clock::duration d) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+		};
+		Debug() << "startup:" << stage << "took" << us(now - this->last) << "us," << us(now - this->start)
+		        << "us in" << std::endl;
+		this->last = now;
+	}
+
+private:
+	Clock::time_point start; ///< When startup started.
+	Clock::time_point last;  ///< When the last stage finished.
 };
 
+/**
+ * Initialises SDL and the decoding libraries, if they haven't been already.
+ * This can happen on any thread, and on more than one at once.
+ * @exception ConfigError if SDL won't initialise.
+ */
+void InitAudioLibraries()
+{
+	static std::once_flag once;
+	std::call_once(once, [] {
+		// SDL requires some cleanup and teardown.  This needs to happen
+		// before any device IDs are checked, otherwise none will be
+		// recognised.
+		Audio::SDLSink::InitLibrary();
+		atexit(Audio::SDLSink::CleanupLibrary);
+
+		// Some decoders need the same treatment.
+		InitSourceLibraries();
+	});
+}
+
 /**
  * Creates a vector of strings from a C-style argument vector.
  * @param argc Program argument count.
@@ -58,7 +252,229 @@ std::vector<std::string_view> MakeArgVector(int argc, char *argv[])
 	return args;
 }
 
-int GetDeviceIDFromArg(const std::string_view arg)
+/**
+ * Removes a flag from the program arguments, if it is present.
+ * Flags can appear anywhere after the program name, so removing them first
+ * lets the positional arguments be read as if they were never there.
+ * @param args The program argument vector, which is modified in place.
+ * @param flag The flag to look for.
+ * @return Whether the flag was present.
+ */
+bool TakeFlag(std::vector<std::string_view> &args, std::string_view flag)
+{
+	const auto it = std::find(std::next(args.begin()), args.end(), flag);
+	if (it == args.end()) return false;
+
+	args.erase(it);
+	return true;
+}
+
+/**
+ * Removes an option of the form PREFIXvalue from the program arguments.
+ * @param args The program argument vector, which is modified in place.
+ * @param prefix The option's prefix, including any '='.
+ * @return The option's value, if the option was present.
+ */
+std::optional<std::string_view> TakeOption(std::vector<std::string_view> &args, std::string_view prefix)
+{
+	const auto it = std::find_if(std::next(args.begin()), args.end(),
+	                             [prefix](std::string_view arg) { return arg.substr(0, prefix.size()) == prefix; });
+	if (it == args.end()) return std::nullopt;
+
+	const auto value = it->substr(prefix.size());
+	args.erase(it);
+	return value;
+}
+
+/**
+ * Takes a thread policy's options from the program arguments, and checks it.
+ * @param args The program argument vector, which is modified in place.
+ * @param priority_option The option setting the policy's priority.
+ * @param cpus_option The option setting the policy's CPUs.
+ * @param what What the policy is for, for error messages.
+ * @return The policy.
+ */
+Audio::ThreadPolicy TakeThreadPolicy(std::vector<std::string_view> &args, std::string_view priority_option,
+                                     std::string_view cpus_option, std::string_view what)
+{
+	Audio::ThreadPolicy policy;
+	try {
+		if (const auto value = TakeOption(args, priority_option)) {
+			policy.priority = Audio::ThreadPolicy::ParsePriority(*value);
+		}
+		if (const auto value = TakeOption(args, cpus_option)) policy.cpus = Audio::ThreadPolicy::ParseCpus(*value);
+		policy.Check();
+	} catch (ConfigError &e) {
+		std::cerr << "can't schedule " << what << " threads as asked: " << e.Message() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return policy;
+}
+
+/**
+ * Parses the resampling quality given on the command line.
+ * @param value The value of the resampling option.
+ * @return The quality, or nothing if resampling should be off.
+ * @exception ConfigError if the value isn't a known quality.
+ */
+std::optional<Audio::Resampler::Quality> ParseResampleQuality(std::string_view value)
+{
+	if (value == "off") return std::nullopt;
+	if (value == "low") return Audio::Resampler::Quality::LOW;
+	if (value == "medium") return Audio::Resampler::Quality::MEDIUM;
+	if (value == "high") return Audio::Resampler::Quality::HIGH;
+	throw ConfigError("unknown resampling quality: " + std::string{value});
+}
+
+/**
+ * Parses the RAM cache budget given on the command line.
+ * @param value The value of the RAM cache option, in mebibytes.
+ * @return The budget, in bytes.
+ * @exception ConfigError if the value isn't a positive whole number.
+ */
+std::size_t ParseRamCacheBudget(std::string_view value)
+{
+	std::size_t mib = 0;
+	const auto end = value.data() + value.size();
+	const auto [p, ec] = std::from_chars(value.data(), end, mib);
+	if (ec != std::errc{} || p != end || mib == 0 || SIZE_MAX / (1024 * 1024) < mib) {
+		throw ConfigError("not a valid RAM cache size: " + std::string{value});
+	}
+	return mib * 1024 * 1024;
+}
+
+/**
+ * Parses the silence threshold given on the command line.
+ * @param value The value of the trim option, in dBFS.
+ * @return The threshold, in dBFS.
+ * @exception ConfigError if the value isn't a negative number.
+ */
+double ParseTrimThreshold(std::string_view value)
+{
+	double db = 0.0;
+	const auto end = value.data() + value.size();
+	const auto [p, ec] = std::from_chars(value.data(), end, db);
+	if (ec != std::errc{} || p != end || !std::isfinite(db) || 0.0 <= db) {
+		throw ConfigError("not a valid trim threshold: " + std::string{value});
+	}
+	return db;
+}
+
+/**
+ * Parses a positive count given on the command line.
+ * @param value The value of the option.
+ * @param what What the count is of, for error messages.
+ * @return The count.
+ * @exception ConfigError if the value isn't a positive whole number.
+ */
+std::uint32_t ParseCount(std::string_view value, std::string_view what)
+{
+	std::uint32_t count = 0;
+	const auto end = value.data() + value.size();
+	const auto [p, ec] = std::from_chars(value.data(), end, count);
+	if (ec != std::errc{} || p != end || count == 0) {
+		throw ConfigError("not a valid " + std::string{what} + ": " + std::string{value});
+	}
+	return count;
+}
+
+/**
+ * Parses the channel count to remix to given on the command line.
+ * @param value The value of the channels option.
+ * @return The channel count, or nothing if remixing should be off.
+ * @exception ConfigError if the value isn't a channel count SDL has a layout for.
+ */
+std::optional<std::uint8_t> ParseChannels(std::string_view value)
+{
+	if (value == "off") return std::nullopt;
+	const auto count = ParseCount(value, "channel count");
+	if (Audio::ChannelMatrix::MAX_CHANNELS < count) {
+		throw ConfigError("not a valid channel count: " + std::string{value});
+	}
+	return static_cast<std::uint8_t>(count);
+}
+
+/**
+ * Parses the waveform bucket counts for an analysis given on the command line.
+ * @param value The value of the waveforms option: counts, separated by commas.
+ * @return The bucket counts.
+ * @exception ConfigError if any count isn't valid.
+ */
+std::vector<std::uint32_t> ParseWaveformBuckets(std::string_view value)
+{
+	std::vector<std::uint32_t> buckets;
+	for (std::size_t start = 0; start <= value.size();) {
+		const auto end = std::min(value.find(',', start), value.size());
+		const auto item = value.substr(start, end - start);
+		const auto count = ParseCount(item, "bucket count");
+		if (Audio::MAX_WAVEFORM_BUCKETS < count) throw ConfigError("not a valid bucket count: " + std::string{item});
+		buckets.push_back(count);
+		start = end + 1;
+	}
+	return buckets;
+}
+
+/// A listener given on the command line, besides the main one.
+struct ListenerSpec {
+	std::string host;            ///< The IPv4 or IPv6 host.
+	std::string port;            ///< The first player's port.
+	IO::ListenerPolicy policy;   ///< What its clients may do.
+};
+
+/**
+ * Parses the extra listeners given on the command line.
+ * Each is HOST:PORT, or [HOST]:PORT for IPv6, and may end in /ro to make
+ * its clients read-only; commas separate them.
+ * @param value The value of the listen option.
+ * @return The listeners.
+ * @exception ConfigError if any listener isn't valid.
+ */
+std::vector<ListenerSpec> ParseListeners(std::string_view value)
+{
+	std::vector<ListenerSpec> listeners;
+	while (!value.empty()) {
+		const auto comma = value.find(',');
+		auto spec = value.substr(0, comma);
+		value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+
+		const auto invalid = ConfigError("not a valid listener: " + std::string{spec});
+
+		auto policy = IO::ListenerPolicy::CONTROL;
+		if (spec.ends_with(READ_ONLY_SUFFIX)) {
+			policy = IO::ListenerPolicy::READ_ONLY;
+			spec.remove_suffix(READ_ONLY_SUFFIX.size());
+		}
+
+		const auto colon = spec.rfind(':');
+		if (colon == std::string_view::npos || colon == 0 || colon + 1 == spec.size()) throw invalid;
+		auto host = spec.substr(0, colon);
+		if (host.front() == '[') {
+			if (host.size() < 3 || host.back() != ']') throw invalid;
+			host = host.substr(1, host.size() - 2);
+		} else if (host.find(':') != std::string_view::npos) {
+			// Bare IPv6 addresses are ambiguous about where the port starts.
+			throw invalid;
+		}
+
+		listeners.push_back({std::string{host}, std::string{spec.substr(colon + 1)}, policy});
+	}
+	return listeners;
+}
+
+/**
+ * Parses the render container given on the command line.
+ * @param value The value of the render format option.
+ * @return The container.
+ * @exception ConfigError if the value isn't a known container.
+ */
+Audio::FileSink::Container ParseRenderContainer(std::string_view value)
+{
+	if (value == "wav") return Audio::FileSink::Container::WAV;
+	if (value == "pcm") return Audio::FileSink::Container::PCM;
+	throw ConfigError("unknown render format: " + std::string{value});
+}
+
+int GetDeviceIDFromArg(const std::string_view arg, const SinkBackend *backend)
 {
 	auto id = -1;
 
@@ -77,22 +493,122 @@ int GetDeviceIDFromArg(const std::string_view arg)
 	}
 
 	// Only allow valid, outputtable devices; reject input-only devices.
-	if (!Audio::SDLSink::IsOutputDevice(id)) return -1;
+	if (backend != nullptr && !backend->is_output(id)) return -1;
 
 	return id;
 }
 
 /**
- * Tries to get the output device ID from program arguments.
+ * Tries to get the output device IDs from program arguments.
+ * Several devices can be given, separated by commas, to run one player on
+ * each; any mirrors after a device's ID are left to GetMirrorIDs.
  * @param args The program argument vector.
- * @return The device ID, -1 if invalid selection (or none).
+ * @param backend The backend the devices belong to, or nullptr to take any
+ *   number, and leave checking the devices until the backend is up.
+ * @return The device IDs, or nothing if any selection is invalid (or there
+ *   are none).
  */
-int GetDeviceID(const std::vector<std::string_view> &args)
+std::vector<int> GetDeviceIDs(const std::vector<std::string_view> &args, const SinkBackend *backend)
 {
 	// Did the user provide an ID at all?
-	if (args.size() < 2) return -1;
+	if (args.size() < 2) return {};
 
-	return GetDeviceIDFromArg(args.at(1));
+	std::vector<int> ids;
+	for (auto rest = args.at(1);;) {
+		const auto comma = rest.find(',');
+		const auto player = rest.substr(0, comma);
+		const auto id = GetDeviceIDFromArg(player.substr(0, player.find('+')), backend);
+		if (id < 0) return {};
+
+		ids.push_back(id);
+		if (comma == std::string_view::npos) return ids;
+		rest.remove_prefix(comma + 1);
+	}
+}
+
+/**
+ * Tries to get the mirrored device IDs from program arguments.
+ * Each player's device ID can be followed by more, separated by pluses, on
+ * which the player plays the same audio, kept in step; these devices can't
+ * be used for anything else.
+ * * Precondition: GetDeviceIDs accepted @a args.
+ * @param args The program argument vector.
+ * @param backend The backend the devices belong to, or nullptr to take any
+ *   number, and leave checking the devices until the backend is up.
+ * @return Each player's mirrored device IDs, in order, or nothing if any
+ *   are invalid, or used twice.
+ */
+std::optional<std::vector<std::vector<int>>> GetMirrorIDs(const std::vector<std::string_view> &args,
+                                                          const SinkBackend *backend)
+{
+	std::vector<std::vector<int>> mirrors;
+	std::vector<int> main_ids;
+	for (auto rest = args.at(1);;) {
+		const auto comma = rest.find(',');
+		auto player = rest.substr(0, comma);
+		auto plus = player.find('+');
+		main_ids.push_back(GetDeviceIDFromArg(player.substr(0, plus), nullptr));
+
+		auto &ids = mirrors.emplace_back();
+		while (plus != std::string_view::npos) {
+			player.remove_prefix(plus + 1);
+			plus = player.find('+');
+			const auto id = GetDeviceIDFromArg(player.substr(0, plus), backend);
+			if (id < 0) return std::nullopt;
+			ids.push_back(id);
+		}
+
+		if (comma == std::string_view::npos) break;
+		rest.remove_prefix(comma + 1);
+	}
+
+	// Mirrors are opened for themselves, so they can't share a device with
+	// a player (or another mirror).
+	std::vector<int> all_mirrors;
+	for (const auto &ids : mirrors) all_mirrors.insert(all_mirrors.end(), ids.begin(), ids.end());
+	std::sort(all_mirrors.begin(), all_mirrors.end());
+	for (auto it = all_mirrors.begin(); it != all_mirrors.end(); it++) {
+		const auto used = std::next(it) != all_mirrors.end() && *std::next(it) == *it;
+		if (used || std::find(main_ids.begin(), main_ids.end(), *it) != main_ids.end()) {
+			std::cerr << "mirrored device already in use: " << *it << std::endl;
+			return std::nullopt;
+		}
+	}
+	return mirrors;
+}
+
+/**
+ * Works out the port of one of several players.
+ * Each player after the first listens on the port after the last one's.
+ * @param port The port of the first player.
+ * @param n The index of the player.
+ * @return The port of the @a n th player.
+ * @exception ConfigError if @a port isn't a port number, or the player's port
+ *   would be past the last one.
+ */
+std::string NthPort(std::string_view port, std::size_t n)
+{
+	std::uint32_t first = 0;
+	const auto end = port.data() + port.size();
+	const auto [p, ec] = std::from_chars(port.data(), end, first);
+	if (ec != std::errc{} || p != end || UINT16_MAX < first + n) {
+		throw ConfigError("not a valid port for " + std::to_string(n + 1) + " players: " + std::string{port});
+	}
+	return std::to_string(first + n);
+}
+
+/**
+ * Works out the path of one of several players' files (sockets, say).
+ * The first player uses the path as given; the others add ".N" to it.
+ * @param path The path of the first player's file.
+ * @param n The index of the player.
+ * @return The path of the @a n th player's file.
+ */
+std::string NthPath(std::string_view path, std::size_t n)
+{
+	std::string nth{path};
+	if (0 < n) nth += "." + std::to_string(n);
+	return nth;
 }
 
 /**
@@ -101,31 +617,120 @@ int GetDeviceID(const std::vector<std::string_view> &args)
  */
 void ExitWithUsage(std::string_view progname)
 {
-	std::cerr << "usage: " << progname << " ID [HOST] [PORT]\n";
-	std::cerr << "where ID is one of the following numbers:\n";
+	// The device list needs the backends up, even in fast starts.
+	InitAudioLibraries();
+
+	std::cerr << "usage: " << progname << " [" << CONFIG_OPTION << "PATH] [" << FAST_START_FLAG << "] [" << DECODE_THREAD_FLAG << "] [" << LOCK_MEMORY_FLAG << "] ["
+	          << HUGE_PAGES_FLAG << "] [" << LOUDNESS_FLAG << "] [" << AUDIO_PRIORITY_OPTION << "PRIO] [" << AUDIO_CPUS_OPTION << "CPUS] ["
+	          << DECODE_PRIORITY_OPTION << "PRIO] [" << DECODE_CPUS_OPTION << "CPUS] [" << RESAMPLE_OPTION << "QUALITY] ["
+	          << CHANNELS_OPTION << "COUNT] ["
+	          << CACHE_OPTION << "PATH] [" << RAM_CACHE_OPTION << "MIB] [" << TRIM_OPTION << "DB] ["
+	          << BUFFER_OPTION << "MS[-MS]] [" << PRE_ROLL_OPTION << "MS] [" << UPDATE_PERIOD_OPTION << "MS] ["
+	          << BACKEND_OPTION << "NAME] [" << PERIOD_OPTION << "FRAMES] [" << PERIODS_OPTION
+	          << "COUNT] [" << RTP_DEST_OPTION << "HOST:PORT] [" << RTP_PTIME_OPTION
+	          << "US] [" << METRICS_OPTION << "PORT] [" << MAX_BACKLOG_OPTION << "KIB] [" << LISTEN_BACKLOG_OPTION
+	          << "COUNT] [" << MAX_LINE_OPTION
+	          << "KIB] [" << MAX_WORDS_OPTION << "COUNT] ["
+	          << IO_THREADS_OPTION << "COUNT] [" << LISTEN_OPTION << "HOST:PORT[/ro][,...]] [" << SOCKET_OPTION << "PATH] [" << SHM_OPTION << "PATH] ["
+	          << SNAPSHOT_OPTION << "PATH [" << STANDBY_FLAG << "]] [" << TRACE_OPTION << "PATH] ID[+ID...][,ID[+ID...]...] [HOST] [PORT]\n";
+	std::cerr << "   or: " << progname << " [OPTIONS] " << RENDER_OPTION << "OUT [" << RENDER_FORMAT_OPTION
+	          << "FORMAT] FILE\n";
+	std::cerr << "   or: " << progname << " [OPTIONS] " << CACHE_OPTION << "PATH " << ANALYSE_OPTION << "DIR ["
+	          << WAVEFORMS_OPTION << "BUCKETS[,BUCKETS...]]\n";
+	std::cerr << "where each ID is one of the following numbers, for the backend chosen:\n";
 
 	// Show the user the valid device IDs they can use.
-	auto device_list = Audio::SDLSink::GetDevicesInfo();
-	for (const auto &device : device_list) {
-		std::cerr << "\t" << device.first << ": " << device.second << "\n";
+	for (const auto &[name, backend] : SINK_BACKENDS) {
+		std::cerr << BACKEND_OPTION << name << (name == DEFAULT_SINK_BACKEND ? " (default)" : "") << ":\n";
+		for (const auto &device : backend.devices()) {
+			std::cerr << "\t" << device.first << ": " << device.second << "\n";
+		}
 	}
 
 	std::cerr << "default HOST: " << DEFAULT_HOST << "\n";
-	std::cerr << "default PORT: " << DEFAULT_PORT << "\n";
+	std::cerr << "default PORT: " << DEFAULT_PORT << " (each ID after the first uses the next port up)\n";
+	std::cerr << "ID+ID: play on both devices, kept in step, as one player (the first leads)\n";
+	std::cerr << CONFIG_OPTION << "PATH: read options from PATH, one NAME[=VALUE] per line (devices=, host= and "
+	          << "port= for the rest); the command line wins\n";
+	std::cerr << FAST_START_FLAG
+	          << ": listen straight away, and start audio in the background (loads and plays wait for it)\n";
+	std::cerr << DECODE_THREAD_FLAG << ": decode on a shared pool of threads, not the network loop\n";
+	std::cerr << LOCK_MEMORY_FLAG << ": lock all memory into RAM, so audio never waits on paging\n";
+	std::cerr << HUGE_PAGES_FLAG << ": put large audio buffers on huge pages, where available\n";
+	std::cerr << LOUDNESS_FLAG << ": meter loudness (EBU R128) and true peak as files decode\n";
+	std::cerr << AUDIO_PRIORITY_OPTION << "PRIO, " << DECODE_PRIORITY_OPTION
+	          << "PRIO: run audio output or decoding at real-time priority PRIO (1-99)\n";
+	std::cerr << AUDIO_CPUS_OPTION << "CPUS, " << DECODE_CPUS_OPTION
+	          << "CPUS: run audio output or decoding only on CPUS (for example, 0,2-3)\n";
+	std::cerr << PERIOD_OPTION << "FRAMES, " << PERIODS_OPTION
+	          << "COUNT: ask the device for COUNT periods of FRAMES frames (alsa only)\n";
+	std::cerr << RTP_DEST_OPTION << "HOST:PORT: where " << BACKEND_OPTION << "rtp sends AES67 streams\n";
+	std::cerr << RTP_PTIME_OPTION << "US: put US microseconds of audio in each RTP packet (default 1000)\n";
+	std::cerr << RENDER_OPTION << "OUT: decode FILE into OUT (- for stdout) as fast as possible, then exit\n";
+	std::cerr << METRICS_OPTION << "PORT: serve Prometheus (OpenMetrics) metrics at http://HOST:PORT/metrics\n";
+	std::cerr << MAX_BACKLOG_OPTION << "KIB: disconnect clients with more than KIB kibibytes of responses unwritten "
+	          << "(default " << Playd::IO::Core::DEFAULT_MAX_BACKLOG / 1024 << ")\n";
+	std::cerr << LISTEN_BACKLOG_OPTION << "COUNT: let COUNT new clients wait to be accepted on each listener (default "
+	          << Playd::IO::Core::DEFAULT_LISTEN_BACKLOG << ")\n";
+	std::cerr << MAX_LINE_OPTION << "KIB, " << MAX_WORDS_OPTION
+	          << "COUNT: disconnect clients sending a line longer than KIB kibibytes (default "
+	          << Playd::Tokeniser::DEFAULT_MAX_LINE / 1024 << "), or with more than COUNT words (default "
+	          << Playd::Tokeniser::DEFAULT_MAX_WORDS << ")\n";
+	std::cerr << IO_THREADS_OPTION << "COUNT: read from and write to clients on COUNT threads, sharing each port\n";
+	std::cerr << LISTEN_OPTION << "HOST:PORT[/ro][,...]: also listen at each HOST:PORT ([HOST]:PORT for IPv6; "
+	          << "the port goes up per ID, as for PORT); /ro clients only hear broadcasts\n";
+	std::cerr << SOCKET_OPTION << "PATH: also listen for clients on a Unix socket at PATH (PATH.1 for the second ID, and "
+	          << "so on)\n";
+	std::cerr << SHM_OPTION << "PATH: publish state and position in shared memory at PATH (say, /dev/shm/playd), "
+	          << "likewise\n";
+	std::cerr << SNAPSHOT_OPTION << "PATH: snapshot files, position and queue at PATH (likewise) for a standby to "
+	          << "take over from\n";
+	std::cerr << STANDBY_FLAG << ": follow the snapshots at PATH instead, and take over if their playd dies\n";
+	std::cerr << TRACE_OPTION
+	          << "PATH: trace decoding, audio callbacks and commands, and write a Chrome trace to PATH on SIGUSR1 "
+	             "and at exit\n";
+	std::cerr << ANALYSE_OPTION << "DIR: analyse every file under DIR into the caches, on every CPU, then exit; "
+	          << "cue points need " << TRIM_OPTION << "DB\n";
+	std::cerr << WAVEFORMS_OPTION << "BUCKETS[,BUCKETS...]: also cache waveforms of each BUCKETS buckets (1-"
+	          << Audio::MAX_WAVEFORM_BUCKETS << ") when analysing\n";
+	std::cerr << RENDER_FORMAT_OPTION << "FORMAT: render as wav (default) or raw pcm, in the machine's byte order\n";
+	std::cerr << RESAMPLE_OPTION << "QUALITY: resample everything to the device's own rate (or "
+	          << Audio::SDLEngine::DEVICE_RATE << " Hz) at low, medium (default) or high quality, or off\n";
+	std::cerr << CHANNELS_OPTION << "COUNT: remix everything to COUNT channels (1-"
+	          << +Audio::ChannelMatrix::MAX_CHANNELS << ", default " << +Audio::SDLEngine::DEVICE_CHANNELS << "), or off\n";
+	std::cerr << CACHE_OPTION
+	          << "PATH: cache file lengths and seek points at PATH, and waveforms and cue points beside it\n";
+	std::cerr << RAM_CACHE_OPTION << "MIB: keep up to MIB mebibytes of small files decoded in memory\n";
+	std::cerr << TRIM_OPTION << "DB: skip silence (below DB dBFS, for example -60) at each end of every file\n";
+	std::cerr << BUFFER_OPTION << "MS[-MS]: buffer MS milliseconds of audio (default "
+	          << Audio::BufferPolicy::DEFAULT_SIZE.count() << "), or adapt between MIN-MAX\n";
+	std::cerr << PRE_ROLL_OPTION << "MS: have play wait until MS milliseconds of audio are buffered, and announce PLAY "
+	          << "once it is heard\n";
+	std::cerr << UPDATE_PERIOD_OPTION << "MS: update playing players every MS milliseconds (1-"
+	          << Player::MAX_UPDATE_PERIOD.count() << ", default " << Player::DEFAULT_UPDATE_PERIOD.count() << ")\n";
+	std::cerr << "the set command changes " << BUFFER_OPTION << ", " << PRE_ROLL_OPTION << " and "
+	          << UPDATE_PERIOD_OPTION << " while playd runs\n";
 
 	exit(EXIT_FAILURE);
 }
 
 /**
  * Gets the host and port from the program arguments.
- * The default arguments are used if the host and/or port are not supplied.
+ * The config file's, then the default arguments are used if the host and/or
+ * port are not supplied.
  * @param args The program argument vector.
+ * @param config The config file, if any.
  * @return A pair of strings representing the hostname and port.
  */
-std::pair<std::string_view, std::string_view> GetHostAndPort(const std::vector<std::string_view> &args)
+std::pair<std::string_view, std::string_view> GetHostAndPort(const std::vector<std::string_view> &args,
+                                                             const std::optional<ConfigFile> &config)
 {
 	const auto size = args.size();
-	return std::make_pair(size > 2 ? args.at(2) : DEFAULT_HOST, size > 3 ? args.at(3) : DEFAULT_PORT);
+	const auto fallback = [&config](std::string_view name, std::string_view value) {
+		return config ? config->Positional(name).value_or(value) : value;
+	};
+	return std::make_pair(size > 2 ? args.at(2) : fallback("host", DEFAULT_HOST),
+	                      size > 3 ? args.at(3) : fallback("port", DEFAULT_PORT));
 }
 
 /**
@@ -141,6 +746,98 @@ void ExitWithNetError(std::string_view host, std::string_view port, std::string_
 	exit(EXIT_FAILURE);
 }
 
+/**
+ * Plays a file through a player, as fast as it decodes, until it ends.
+ * The player's sinks should be FileSinks, or this plays in real time.
+ * @param player The player.
+ * @param path The file to play.
+ * @return The exit code (zero for success; non-zero otherwise).
+ */
+int Render(Player &player, std::string_view path)
+{
+	const auto load = player.Load(Response::NOREQUEST, path);
+	std::ignore = player.SetPlaying(Response::NOREQUEST, true);
+	if (!player.IsPlaying()) {
+		std::cerr << "can't render " << path << ": " << load.Pack() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Each update decodes as much as the sink takes, which, for a file,
+	// is everything; the player then ends the file, and stops.
+	try {
+		while (player.IsPlaying()) player.Update();
+	} catch (Error &e) {
+		std::cerr << "can't render " << path << ": " << e.Message() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Analyses every file under a directory into the caches.
+ * Files are analysed in parallel, one per hardware thread, and each is
+ * reported on standard output as it finishes.
+ * @param dir The directory; files are cached under their paths within it,
+ *   so it should be given as the players will be given those files.
+ * @param plan What to find out about each file.
+ * @param cache The cache for lengths and seek points.
+ * @param waveforms The cache for waveforms.
+ * @param cues The cache for cue points.
+ * @return The exit code (zero if every file was analysed; non-zero otherwise).
+ */
+int AnalyseLibrary(std::string_view dir, const Audio::AnalysisPlan &plan, Audio::MetadataCache &cache,
+                   const Audio::WaveformCache &waveforms, Audio::CueCache &cues)
+{
+	std::vector<std::string> paths;
+	try {
+		for (const auto &entry : std::filesystem::recursive_directory_iterator{dir}) {
+			if (!entry.is_regular_file()) continue;
+			auto path = entry.path().string();
+			if (Player::FindDecoder(SOURCES, path) != nullptr) paths.push_back(std::move(path));
+		}
+	} catch (std::filesystem::filesystem_error &e) {
+		std::cerr << "can't analyse " << dir << ": " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::sort(paths.begin(), paths.end());
+
+	std::atomic<std::size_t> next{0};
+	std::atomic<bool> failed{false};
+	std::mutex output;
+	const auto work = [&] {
+		for (auto i = next++; i < paths.size(); i = next++) {
+			const auto &path = paths[i];
+			try {
+				auto source = Player::FindDecoder(SOURCES, path)->open(path);
+				source->UseCache(cache);
+				source->StartScans();
+				const auto analysis = Audio::Analyse(*source, plan);
+				for (const auto &waveform : analysis.waveforms) waveforms.Store(path, waveform);
+				if (analysis.cues) cues.Store(path, *plan.trim_db, *analysis.cues);
+
+				std::lock_guard lock{output};
+				std::cout << path << ": " << source->MicrosFromSamples(analysis.length).count() << " us";
+				if (const auto &loudness = analysis.loudness) {
+					std::cout << ", " << loudness->integrated << " LUFS, " << loudness->true_peak << " dBTP";
+				}
+				std::cout << std::endl;
+			} catch (Error &e) {
+				failed = true;
+				std::lock_guard lock{output};
+				std::cerr << "can't analyse " << path << ": " << e.Message() << std::endl;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	const auto cpus = std::max(std::thread::hardware_concurrency(), 1U);
+	const auto count = std::min<std::size_t>(cpus, std::max<std::size_t>(paths.size(), 1));
+	for (std::size_t i = 1; i < count; i++) workers.emplace_back(work);
+	work();
+	for (auto &worker : workers) worker.join();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 /**
  * Exits with an error message for an unhandled exception.
  * @param msg The exception's error message.
@@ -167,38 +864,558 @@ int main(int argc, char *argv[])
 	signal(SIGPIPE, SIG_IGN);
 #endif
 
-	// SDL requires some cleanup and teardown.
-	// This call needs to happen before GetDeviceID, otherwise no device
-	// IDs will be recognised.  (This is why it's here, and not in
-	// SetupAudioSystem.)
-	Playd::Audio::SDLSink::InitLibrary();
-	atexit(Playd::Audio::SDLSink::CleanupLibrary);
+	Playd::StartupTimer timer;
+	auto args = Playd::MakeArgVector(argc, argv);
 
-#ifdef WITH_MP3
-	// mpg123 insists on us running its init and exit functions, too.
-	mpg123_init();
-	atexit(mpg123_exit);
-#endif // WITH_MP3
+	// The config file's options go in behind the command line's, so that
+	// everything from here on reads them as if they had been given there.
+	std::optional<Playd::ConfigFile> config;
+	if (const auto value = Playd::TakeOption(args, Playd::CONFIG_OPTION)) {
+		try {
+			config.emplace(std::string{*value});
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		config->AddOptionsTo(args);
+	}
 
-	auto args = Playd::MakeArgVector(argc, argv);
+	// Tracing starts first, so that it covers startup.  The trace is
+	// dumped on SIGUSR1, and once more however playd exits.
+	if (const auto value = Playd::TakeOption(args, Playd::TRACE_OPTION)) {
+		Playd::Trace::Start(*value);
+		std::atexit(Playd::Trace::Dump);
+	}
+
+	// Fast starts put the audio systems off until the listeners are up, so
+	// that clients (and whatever is watching for the port) get answers as
+	// soon as possible.  Otherwise, they come first, so that the devices
+	// can be checked along with everything else.
+	const auto fast_start = Playd::TakeFlag(args, Playd::FAST_START_FLAG);
+	if (!fast_start) {
+		Playd::InitAudioLibraries();
+		timer.Mark("audio libraries");
+	}
+
+	const auto decode_thread = Playd::TakeFlag(args, Playd::DECODE_THREAD_FLAG);
+	const auto loudness = Playd::TakeFlag(args, Playd::LOUDNESS_FLAG);
+	if (Playd::TakeFlag(args, Playd::HUGE_PAGES_FLAG)) Playd::Audio::EnableHugePages();
+	if (Playd::TakeFlag(args, Playd::LOCK_MEMORY_FLAG)) {
+		try {
+			Playd::Audio::LockAllMemory();
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Scheduling problems are much easier to diagnose at startup than as
+	// underruns later on, so the policies are checked as they're read.
+	Playd::Audio::SDLEngine::SetThreadPolicy(
+	        Playd::TakeThreadPolicy(args, Playd::AUDIO_PRIORITY_OPTION, Playd::AUDIO_CPUS_OPTION, "audio"));
+	auto decode_policy =
+	        Playd::TakeThreadPolicy(args, Playd::DECODE_PRIORITY_OPTION, Playd::DECODE_CPUS_OPTION, "decoding");
+
+	std::optional<Playd::Audio::Resampler::Quality> resample_quality{Playd::Audio::Resampler::Quality::MEDIUM};
+	if (const auto value = Playd::TakeOption(args, Playd::RESAMPLE_OPTION)) {
+		try {
+			resample_quality = Playd::ParseResampleQuality(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::optional<std::uint8_t> channels{Playd::Audio::SDLEngine::DEVICE_CHANNELS};
+	if (const auto value = Playd::TakeOption(args, Playd::CHANNELS_OPTION)) {
+		try {
+			channels = Playd::ParseChannels(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	const auto cache_path = Playd::TakeOption(args, Playd::CACHE_OPTION);
+
+	std::optional<std::size_t> ram_budget;
+	if (const auto value = Playd::TakeOption(args, Playd::RAM_CACHE_OPTION)) {
+		try {
+			ram_budget = Playd::ParseRamCacheBudget(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::optional<double> trim_db;
+	if (const auto value = Playd::TakeOption(args, Playd::TRIM_OPTION)) {
+		try {
+			trim_db = Playd::ParseTrimThreshold(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
 
-	auto device_id = Playd::GetDeviceID(args);
-	if (device_id < 0) Playd::ExitWithUsage(args.at(0));
+	std::pair buffer_size{Playd::Audio::BufferPolicy::DEFAULT_SIZE, Playd::Audio::BufferPolicy::DEFAULT_SIZE};
+	if (const auto value = Playd::TakeOption(args, Playd::BUFFER_OPTION)) {
+		try {
+			buffer_size = Playd::Audio::BufferPolicy::ParseRange(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::chrono::milliseconds pre_roll{0};
+	if (const auto value = Playd::TakeOption(args, Playd::PRE_ROLL_OPTION)) {
+		try {
+			pre_roll = std::chrono::milliseconds{Playd::ParseCount(*value, "pre-roll")};
+			if (buffer_size.second < pre_roll) throw ConfigError("pre-roll is longer than the buffer");
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	auto update_period = Playd::Player::DEFAULT_UPDATE_PERIOD;
+	if (const auto value = Playd::TakeOption(args, Playd::UPDATE_PERIOD_OPTION)) {
+		try {
+			update_period = std::chrono::milliseconds{Playd::ParseCount(*value, "update period")};
+			if (Playd::Player::MAX_UPDATE_PERIOD < update_period) {
+				throw ConfigError("not a valid update period: " + std::string{*value});
+			}
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	const auto backend_name =
+	        std::string{Playd::TakeOption(args, Playd::BACKEND_OPTION).value_or(Playd::DEFAULT_SINK_BACKEND)};
+	const auto backend = Playd::SINK_BACKENDS.find(backend_name);
+	if (backend == Playd::SINK_BACKENDS.end()) {
+		std::cerr << "unknown audio backend: " << backend_name << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
 
-	Playd::Player player{device_id, &std::make_unique<Playd::Audio::SDLSink, const Playd::Audio::Source &, int>,
-	                     Playd::SOURCES};
+#ifdef WITH_ALSA
+	auto periods = Playd::Audio::AlsaSink::DEFAULT_PERIODS;
+#endif // WITH_ALSA
+	try {
+		const auto period = Playd::TakeOption(args, Playd::PERIOD_OPTION);
+		const auto count = Playd::TakeOption(args, Playd::PERIODS_OPTION);
+#ifdef WITH_ALSA
+		if (period) periods.size = Playd::ParseCount(*period, "period size");
+		if (count) periods.count = Playd::ParseCount(*count, "period count");
+#else
+		if (period || count) throw ConfigError("period options need a backend that has periods");
+#endif // WITH_ALSA
+	} catch (ConfigError &e) {
+		std::cerr << e.Message() << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
+
+#ifdef WITH_RTP
+	std::optional<Playd::Audio::RtpSink::Config> rtp;
+#endif // WITH_RTP
+	try {
+		const auto dest = Playd::TakeOption(args, Playd::RTP_DEST_OPTION);
+		const auto ptime = Playd::TakeOption(args, Playd::RTP_PTIME_OPTION);
+#ifdef WITH_RTP
+		if (backend_name == "rtp") {
+			if (!dest) throw ConfigError("the rtp backend needs a destination");
+			auto [host, port] = Playd::Audio::RtpSink::ParseDestination(*dest);
+			rtp = Playd::Audio::RtpSink::Config{std::move(host), port};
+			if (ptime) rtp->packet_time = std::chrono::microseconds{Playd::ParseCount(*ptime, "packet time")};
+		}
+#else
+		if (dest || ptime) throw ConfigError("rtp options need a build with the rtp backend");
+#endif // WITH_RTP
+	} catch (ConfigError &e) {
+		std::cerr << e.Message() << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
+
+	const auto metrics_port = Playd::TakeOption(args, Playd::METRICS_OPTION);
+	if (metrics_port) {
+		try {
+			if (UINT16_MAX < Playd::ParseCount(*metrics_port, "metrics port")) {
+				throw ConfigError("not a valid metrics port: " + std::string{*metrics_port});
+			}
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::optional<std::size_t> max_backlog;
+	if (const auto value = Playd::TakeOption(args, Playd::MAX_BACKLOG_OPTION)) {
+		try {
+			max_backlog = std::size_t{Playd::ParseCount(*value, "backlog")} * 1024;
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	Playd::Tokeniser::Limits line_limits;
+	try {
+		if (const auto value = Playd::TakeOption(args, Playd::MAX_LINE_OPTION)) {
+			line_limits.line = std::size_t{Playd::ParseCount(*value, "line length")} * 1024;
+		}
+		if (const auto value = Playd::TakeOption(args, Playd::MAX_WORDS_OPTION)) {
+			line_limits.words = Playd::ParseCount(*value, "word count");
+		}
+	} catch (ConfigError &e) {
+		std::cerr << e.Message() << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
+
+	auto listen_backlog = Playd::IO::Core::DEFAULT_LISTEN_BACKLOG;
+	if (const auto value = Playd::TakeOption(args, Playd::LISTEN_BACKLOG_OPTION)) {
+		try {
+			const auto count = Playd::ParseCount(*value, "listen backlog");
+			if (INT32_MAX < count) throw ConfigError("not a valid listen backlog: " + std::string{*value});
+			listen_backlog = static_cast<int>(count);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::uint32_t io_threads = 0;
+	if (const auto value = Playd::TakeOption(args, Playd::IO_THREADS_OPTION)) {
+		try {
+			io_threads = Playd::ParseCount(*value, "I/O thread count");
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	std::vector<Playd::ListenerSpec> listeners;
+	if (const auto value = Playd::TakeOption(args, Playd::LISTEN_OPTION)) {
+		try {
+			listeners = Playd::ParseListeners(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	const auto socket_path = Playd::TakeOption(args, Playd::SOCKET_OPTION);
+	const auto shm_path = Playd::TakeOption(args, Playd::SHM_OPTION);
+	const auto snapshot_path = Playd::TakeOption(args, Playd::SNAPSHOT_OPTION);
+	const auto standby = Playd::TakeFlag(args, Playd::STANDBY_FLAG);
+	if (standby && !snapshot_path) {
+		std::cerr << Playd::STANDBY_FLAG << " needs " << Playd::SNAPSHOT_OPTION << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
+
+	const auto render_path = Playd::TakeOption(args, Playd::RENDER_OPTION);
+	const auto analyse_dir = Playd::TakeOption(args, Playd::ANALYSE_OPTION);
+	Playd::Audio::AnalysisPlan plan{trim_db, {}};
+	if (const auto value = Playd::TakeOption(args, Playd::WAVEFORMS_OPTION)) {
+		try {
+			plan.waveforms = Playd::ParseWaveformBuckets(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+	auto render_container = Playd::Audio::FileSink::Container::WAV;
+	if (const auto value = Playd::TakeOption(args, Playd::RENDER_FORMAT_OPTION)) {
+		try {
+			render_container = Playd::ParseRenderContainer(*value);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		}
+	}
+
+	// Everything left should be positional; anything else is a typo,
+	// which is better caught here than taken for a device.
+	const auto unknown = std::find_if(std::next(args.begin()), args.end(),
+	                                  [](std::string_view arg) { return arg.starts_with("--"); });
+	if (unknown != args.end()) {
+		std::cerr << "unknown option: " << *unknown << std::endl;
+		Playd::ExitWithUsage(args.at(0));
+	}
+
+	// Renders take a file instead of devices, and analyses a cache.
+	std::vector<int> device_ids;
+	std::vector<std::vector<int>> mirror_ids;
+	if (analyse_dir) {
+		if (!cache_path || args.size() != 1) Playd::ExitWithUsage(args.at(0));
+	} else if (render_path) {
+		if (args.size() != 2) Playd::ExitWithUsage(args.at(0));
+	} else {
+		if (args.size() == 1 && config) {
+			if (const auto devices = config->Positional("devices")) args.push_back(*devices);
+		}
+		device_ids = Playd::GetDeviceIDs(args, fast_start ? nullptr : &backend->second);
+		if (device_ids.empty()) Playd::ExitWithUsage(args.at(0));
+		auto mirrors = Playd::GetMirrorIDs(args, fast_start ? nullptr : &backend->second);
+		if (!mirrors) Playd::ExitWithUsage(args.at(0));
+		mirror_ids = std::move(*mirrors);
+	}
+	timer.Mark("options");
+
+	// The players all share the same caches.
+	std::shared_ptr<Playd::Audio::MetadataCache> cache;
+	std::shared_ptr<Playd::Audio::WaveformCache> waveforms;
+	std::shared_ptr<Playd::Audio::CueCache> cues;
+	if (cache_path) {
+		try {
+			cache = std::make_shared<Playd::Audio::MetadataCache>(std::string{*cache_path});
+			auto waveform_path = std::string{*cache_path} + std::string{Playd::WAVEFORM_CACHE_SUFFIX};
+			waveforms = std::make_shared<Playd::Audio::WaveformCache>(waveform_path);
+			auto cue_path = std::string{*cache_path} + std::string{Playd::CUE_CACHE_SUFFIX};
+			cues = std::make_shared<Playd::Audio::CueCache>(cue_path);
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	std::shared_ptr<Playd::Audio::PcmCache> ram_cache;
+	if (ram_budget) ram_cache = std::make_shared<Playd::Audio::PcmCache>(*ram_budget, Playd::RAM_CACHE_MAX_FILE);
+
+	// Analyses fill the caches and go; they use every CPU, but no players.
+	if (analyse_dir) {
+		Playd::InitAudioLibraries();
+		return Playd::AnalyseLibrary(*analyse_dir, plan, *cache, *waveforms, *cues);
+	}
+
+	// Renders go as fast as this thread can decode, so they don't need
+	// (or want) decoding threads, or any of the networking.
+	if (render_path) {
+		Playd::InitAudioLibraries();
+		Playd::Player player{0,
+		                     [path = std::string{*render_path}, render_container](
+		                             const Playd::Audio::Source &source, int) -> std::unique_ptr<Playd::Audio::Sink> {
+			                     return std::make_unique<Playd::Audio::FileSink>(source, path, render_container);
+		                     },
+		                     Playd::SOURCES};
+		if (resample_quality) player.EnableResampling(Playd::Audio::SDLEngine::DEVICE_RATE, *resample_quality);
+		if (channels) player.EnableRemixing(*channels);
+		if (cache) player.EnableMetadataCache(cache);
+		if (ram_cache) player.EnableRamCache(ram_cache);
+		if (loudness) player.EnableLoudnessMeters();
+		if (trim_db) player.EnableTrimming(*trim_db, cues);
+		return Playd::Render(player, args.at(1));
+	}
+
+	// The players also share the decoding threads, if they're wanted.
+	// Otherwise, decoding happens on this thread, alongside the network.
+	std::shared_ptr<Playd::Audio::DecodeScheduler> scheduler;
+	if (decode_thread) {
+		scheduler = std::make_shared<Playd::Audio::DecodeScheduler>(0, std::move(decode_policy));
+	} else {
+		try {
+			decode_policy.ApplyToThisThread();
+		} catch (ConfigError &e) {
+			std::cerr << "can't schedule decoding as asked: " << e.Message() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// The first player on each device has it to itself, save for any later
+	// players on the same device, which mix in over the top of it.
+	// Each player sizes its buffers by how its own files have decoded.
+	std::vector<std::unique_ptr<Playd::Player>> players;
+	for (std::size_t i = 0; i < device_ids.size(); i++) {
+		const auto device_id = device_ids[i];
+		const auto first = std::find(device_ids.begin(), device_ids.end(), device_id) == device_ids.begin() + i;
+		auto policy = std::make_shared<Playd::Audio::BufferPolicy>(buffer_size.first, buffer_size.second);
+		const auto device_sink = [&](bool alone) -> Playd::Player::SinkFn {
+			Playd::Player::SinkFn sink;
+			if (alone) {
+				sink = [policy](const Playd::Audio::Source &source, int id) -> std::unique_ptr<Playd::Audio::Sink> {
+					return std::make_unique<Playd::Audio::SDLSink>(source, id, policy);
+				};
+			} else {
+				sink = [policy](const Playd::Audio::Source &source, int id) -> std::unique_ptr<Playd::Audio::Sink> {
+					return std::make_unique<Playd::Audio::MixerSink>(source, id, policy);
+				};
+			}
+#ifdef WITH_RTP
+			if (rtp) {
+				sink = [policy, config = *rtp](const Playd::Audio::Source &source,
+				                               int id) -> std::unique_ptr<Playd::Audio::Sink> {
+					return std::make_unique<Playd::Audio::RtpSink>(source, id, config, policy);
+				};
+			}
+#endif // WITH_RTP
+#ifdef WITH_ALSA
+			// ALSA sinks open their devices for themselves, so any sharing
+			// of a device is up to ALSA.
+			if (backend_name == "alsa") {
+				sink = [policy, periods](const Playd::Audio::Source &source,
+				                         int id) -> std::unique_ptr<Playd::Audio::Sink> {
+					return std::make_unique<Playd::Audio::AlsaSink>(source, id, periods, policy);
+				};
+			}
+#endif // WITH_ALSA
+			return sink;
+		};
+
+		// Mirrors have their devices to themselves, and follow the
+		// player's own device through a fan-out.
+		auto sink = device_sink(first);
+		if (!mirror_ids[i].empty()) {
+			sink = [lead = sink, mirror = device_sink(true), ids = mirror_ids[i]](
+			               const Playd::Audio::Source &source, int id) -> std::unique_ptr<Playd::Audio::Sink> {
+				std::vector<std::unique_ptr<Playd::Audio::Sink>> sinks;
+				sinks.push_back(lead(source, id));
+				for (const auto mirror_id : ids) sinks.push_back(mirror(source, mirror_id));
+				return std::make_unique<Playd::Audio::FanOutSink>(source, std::move(sinks));
+			};
+		}
+
+		// Resampling to the device's own rate saves SDL resampling again
+		// behind us.  Fast starts can't ask, as the audio isn't up yet.
+		const auto &native_rate = backend->second.native_rate;
+		const auto rate = fast_start || native_rate == nullptr ? std::nullopt : native_rate(device_id);
+
+		auto &player = *players.emplace_back(std::make_unique<Playd::Player>(device_id, sink, Playd::SOURCES));
+		if (scheduler) player.EnableDecodeThreads(scheduler);
+		if (resample_quality) {
+			player.EnableResampling(rate.value_or(Playd::Audio::SDLEngine::DEVICE_RATE), *resample_quality);
+		}
+		if (backend_name == "rtp") {
+			// RTP sinks widen everything to 32 bits before packing L24.
+			player.EnableFormatNegotiation(Playd::Audio::SampleFormat::SINT32);
+		} else if (backend_name == "sdl") {
+			player.EnableFormatNegotiation(Playd::Audio::SDLEngine::DEVICE_FORMAT);
+		}
+		if (channels) player.EnableRemixing(*channels);
+		if (cache) player.EnableMetadataCache(cache);
+		if (ram_cache) player.EnableRamCache(ram_cache);
+		if (waveforms) player.EnableWaveformCache(waveforms);
+		if (loudness) player.EnableLoudnessMeters();
+		if (trim_db) player.EnableTrimming(*trim_db, cues);
+		if (0 < pre_roll.count()) player.EnablePreRoll(pre_roll);
+		player.EnableBufferTuning(policy);
+		player.SetUpdatePeriod(update_period);
+		player.AddFixedSetting("listen-backlog", std::to_string(listen_backlog));
+		player.AddFixedSetting("max-backlog",
+		                       std::to_string(max_backlog.value_or(Playd::IO::Core::DEFAULT_MAX_BACKLOG) / 1024));
+		if (shm_path) {
+			try {
+				player.EnableSharedPlayhead(
+				        std::make_unique<Playd::SharedPlayhead>(Playd::NthPath(*shm_path, players.size() - 1)));
+			} catch (Error &e) {
+				Playd::ExitWithError(e.Message());
+			}
+		}
+		if (snapshot_path) {
+			try {
+				const auto path = Playd::NthPath(*snapshot_path, players.size() - 1);
+				auto snapshot = std::make_unique<Playd::StateSnapshot>(path);
+				if (standby) {
+					player.StandBy(std::move(snapshot));
+				} else if (snapshot->TryOwn()) {
+					player.EnableSnapshot(std::move(snapshot));
+				} else {
+					throw ConfigError("another playd is snapshotting to " + path + "; use " +
+					                  std::string{Playd::STANDBY_FLAG} + " to stand by for it");
+				}
+			} catch (Error &e) {
+				Playd::ExitWithError(e.Message());
+			}
+		}
+		if (fast_start) player.HoldUntilReady();
+	}
+	timer.Mark("players");
 
 	// Set up the IO now (to avoid a circular dependency).
-	// Make sure the player broadcasts its responses back to the IoCore.
-	Playd::IO::Core io{player};
-	player.SetIo(io);
+	// Each player gets its own channel, which it broadcasts its responses to.
+	auto [host, port] = Playd::GetHostAndPort(args, config);
+	Playd::IO::Core io;
+	if (max_backlog) io.SetMaxBacklog(*max_backlog);
+	io.SetListenBacklog(listen_backlog);
+	io.SetLineLimits(line_limits);
+	if (0 < io_threads) {
+		try {
+			io.AddShards(io_threads);
+		} catch (Error &e) {
+			Playd::ExitWithError(e.Message());
+		}
+	}
+	for (std::size_t i = 0; i < players.size(); i++) {
+		std::string_view player_host = host;
+		std::string player_port;
+		try {
+			player_port = Playd::NthPort(port, i);
+			auto &channel = io.AddChannel(*players[i], host, player_port);
+			for (const auto &listener : listeners) {
+				player_host = listener.host;
+				player_port = Playd::NthPort(listener.port, i);
+				channel.AddListener(listener.host, player_port, listener.policy);
+			}
+			if (socket_path) {
+				try {
+					channel.ListenLocally(Playd::NthPath(*socket_path, i));
+				} catch (NetError &e) {
+					Playd::ExitWithError(e.Message());
+				}
+			}
+		} catch (ConfigError &e) {
+			std::cerr << e.Message() << std::endl;
+			Playd::ExitWithUsage(args.at(0));
+		} catch (NetError &e) {
+			Playd::ExitWithNetError(player_host, player_port, e.Message());
+		} catch (Error &e) {
+			Playd::ExitWithError(e.Message());
+		}
+	}
+	if (metrics_port) {
+		try {
+			io.AddMetricsListener(host, *metrics_port);
+		} catch (NetError &e) {
+			Playd::ExitWithNetError(host, *metrics_port, e.Message());
+		} catch (Error &e) {
+			Playd::ExitWithError(e.Message());
+		}
+	}
+	timer.Mark("listeners");
+
+	// The players answer clients from here on, but hold back loads and
+	// plays until the audio systems are up.  SDL's audio subsystem (unlike
+	// its video one) doesn't mind starting off the main thread.
+	if (fast_start) {
+		auto error = std::make_shared<std::optional<std::string>>();
+		io.RunInBackground(
+		        [error, bg_timer = timer, &backend = backend->second, &device_ids, &mirror_ids]() mutable {
+			        try {
+				        Playd::InitAudioLibraries();
+				        bg_timer.Mark("audio libraries");
+			        } catch (ConfigError &e) {
+				        *error = std::string{e.Message()};
+				        return;
+			        }
+
+			        auto all_ids = device_ids;
+			        for (const auto &ids : mirror_ids) all_ids.insert(all_ids.end(), ids.begin(), ids.end());
+			        const auto bad = std::find_if_not(all_ids.begin(), all_ids.end(), backend.is_output);
+			        if (bad != all_ids.end()) *error = "not an output device: " + std::to_string(*bad);
+			        bg_timer.Mark("devices");
+		        },
+		        [error, &timer, &players, &args] {
+			        if (*error) {
+				        std::cerr << **error << std::endl;
+				        Playd::ExitWithUsage(args.at(0));
+			        }
+			        for (auto &player : players) player->MarkReady();
+			        timer.Mark("ready");
+		        });
+	}
 
 	// Now, actually run the IO loop.
-	auto [host, port] = Playd::GetHostAndPort(args);
 	try {
-		io.Run(host, port);
-	} catch (NetError &e) {
-		Playd::ExitWithNetError(host, port, e.Message());
+		io.Run();
 	} catch (Error &e) {
 		Playd::ExitWithError(e.Message());
 	}
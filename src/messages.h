@@ -35,15 +35,33 @@ constexpr std::string_view MSG_CMD_SHORT{"Command must contain at least a tag an
 /// Message shown when the CommandHandler receives an invalid command.
 constexpr std::string_view MSG_CMD_INVALID{"Bad command or file name"};
 
+/// Message shown when a client sends a line that is too long, or has too many words.
+constexpr std::string_view MSG_CMD_TOO_LONG{"Command too long: closing connection"};
+
 /**
  * Message shown when a command that works only when a file is loaded is fired
  * when there isn't anything loaded.
  */
 constexpr std::string_view MSG_CMD_NEEDS_LOADED{"Command requires a loaded file"};
 
+/// Message shown when a command that needs a cued file is fired without one.
+constexpr std::string_view MSG_CMD_NEEDS_CUED{"Command requires a cued file"};
+
+/// Message shown when a command that needs a queued file is fired without one.
+constexpr std::string_view MSG_CMD_NEEDS_QUEUED{"Command requires a queued file"};
+
+/// Message shown when a standby is asked to play before it has taken over.
+constexpr std::string_view MSG_CMD_STANDING_BY{"Standing by: the owner of the snapshot is still playing"};
+
 /// Message shown when a command is sent to a closing Player.
 constexpr std::string_view MSG_CMD_PLAYER_CLOSING{"Server is closing"};
 
+/// Message shown when statistics are asked for, but the output keeps none.
+constexpr std::string_view MSG_STATS_UNAVAILABLE{"No playback statistics available"};
+
+/// Message shown when loudness is asked for, but nothing is being metered.
+constexpr std::string_view MSG_LOUDNESS_OFF{"Loudness metering is off"};
+
 //
 // Load failures
 //
@@ -51,6 +69,18 @@ constexpr std::string_view MSG_CMD_PLAYER_CLOSING{"Server is closing"};
 /// Message shown when one tries to Load an empty path.
 constexpr std::string_view MSG_LOAD_EMPTY_PATH{"Empty file path given"};
 
+/// Message shown when none of the queued files could be opened.
+constexpr std::string_view MSG_QUEUE_UNPLAYABLE{"No queued file could be opened"};
+
+/// Message shown when an enqueue command has an invalid overlap.
+constexpr std::string_view MSG_QUEUE_INVALID_OVERLAP{"Invalid overlap: try integer milliseconds up to 30000"};
+
+/// Message shown when a dequeue command has an invalid index.
+constexpr std::string_view MSG_QUEUE_INVALID_INDEX{"Invalid queue index: try integer below queue length"};
+
+/// Message shown when a load is overtaken by another load, or an eject.
+constexpr std::string_view MSG_LOAD_SUPERSEDED{"Load superseded before it finished"};
+
 //
 // Seek failures
 //
@@ -61,6 +91,42 @@ constexpr std::string_view MSG_SEEK_FAIL{"Seek failed"};
 /// Message shown when a seek command has an invalid time value.
 constexpr std::string_view MSG_SEEK_INVALID_VALUE{"Invalid time: try integer"};
 
+/// Message shown when a play-at or stop-at command has an invalid time.
+constexpr std::string_view MSG_AT_INVALID_VALUE{"Invalid time: try integer microseconds since the epoch"};
+
+/// Message shown when a posrate command has an invalid period.
+constexpr std::string_view MSG_POSRATE_INVALID_VALUE{"Invalid period: try integer milliseconds"};
+
+/// Message shown when a fade command has an invalid duration or level.
+constexpr std::string_view MSG_FADE_INVALID_VALUE{"Invalid fade: try integer milliseconds, and decibels up to 24"};
+
+/// Message shown when a rate command has an invalid speed.
+constexpr std::string_view MSG_RATE_INVALID_VALUE{"Invalid rate: try a number from 0.5 to 2"};
+
+/// Message shown when a fade command has an unknown shape.
+constexpr std::string_view MSG_FADE_INVALID_SHAPE{"Invalid fade shape: try log or linear"};
+
+/// Message shown when a waveform command has an invalid resolution.
+constexpr std::string_view MSG_WAVEFORM_INVALID_VALUE{"Invalid resolution: try an integer from 1 to 8192"};
+
+/// Message shown when a set command names a setting that doesn't exist.
+constexpr std::string_view MSG_SET_UNKNOWN{"Unknown setting: dump lists them"};
+
+/// Message shown when a set command names a setting only startup can change.
+constexpr std::string_view MSG_SET_FIXED{"Setting can only be changed at startup"};
+
+/// Message shown when a set command has an invalid update period.
+constexpr std::string_view MSG_SET_INVALID_PERIOD{"Invalid update period: try integer milliseconds from 1 to 1000"};
+
+/// Message shown when a set command has an invalid pre-roll.
+constexpr std::string_view MSG_SET_INVALID_PRE_ROLL{"Invalid pre-roll: try integer milliseconds, within the buffer"};
+
+/// Message shown when a set command has an invalid buffer size.
+constexpr std::string_view MSG_SET_INVALID_BUFFER{"Invalid buffer: try MS or MIN-MAX milliseconds, above the pre-roll"};
+
+/// Message shown when a tap command asks for neither on nor off.
+constexpr std::string_view MSG_TAP_INVALID_VALUE{"Invalid tap: try 1 (on) or 0 (off)"};
+
 //
 // IO failures
 //
@@ -0,0 +1,300 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Metrics class.
+ * @see metrics.h
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audio/stats.h"
+#include "commands.h"
+#include "metrics.h"
+
+#ifdef WITH_ALLOCATION_COUNTS
+#include "bench/alloc_counter.h"
+#endif // WITH_ALLOCATION_COUNTS
+
+namespace Playd
+{
+namespace
+{
+/// The biggest bucket exported for timings in microseconds (~16s).
+constexpr std::size_t TIME_BUCKETS = 24;
+
+/// The biggest bucket exported for percentages.
+constexpr std::size_t PERCENT_BUCKETS = 7;
+
+/**
+ * Writes a metric family's header.
+ * @param out The stream to write to.
+ * @param name The family's name.
+ * @param type Its OpenMetrics type.
+ * @param help What it measures.
+ */
+void WriteFamily(std::ostream &out, std::string_view name, std::string_view type, std::string_view help)
+{
+	out << "# TYPE " << name << " " << type << "\n";
+	out << "# HELP " << name << " " << help << "\n";
+}
+
+/**
+ * Writes one histogram, with buckets up to a limit and the rest in +Inf.
+ * @param out The stream to write to.
+ * @param name The family's name.
+ * @param labels The histogram's labels, without braces.
+ * @param summary The histogram's values.
+ * @param buckets The index of the last bucket to write out.
+ */
+void WriteHistogram(std::ostream &out, std::string_view name, const std::string &labels,
+                    const Audio::Histogram::Summary &summary, std::size_t buckets)
+{
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i <= buckets; i++) {
+		seen += summary.buckets[i];
+		out << name << "_bucket{" << labels << ",le=\"" << Audio::Histogram::UpperBound(i) << "\"} " << seen
+		    << "\n";
+	}
+	out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << summary.count << "\n";
+	out << name << "_sum{" << labels << "} " << summary.sum << "\n";
+	out << name << "_count{" << labels << "} " << summary.count << "\n";
+}
+
+/**
+ * Adds one histogram's values to another's.
+ * @param into The histogram summary to add to.
+ * @param from The histogram summary to add.
+ */
+void Merge(Audio::Histogram::Summary &into, const Audio::Histogram::Summary &from)
+{
+	into.count += from.count;
+	into.sum += from.sum;
+	into.max = std::max(into.max, from.max);
+	for (std::size_t i = 0; i < into.buckets.size(); i++) into.buckets[i] += from.buckets[i];
+}
+
+/// @return The labels for one player's figures.
+std::string PlayerLabel(const Metrics::PlayerSample &player)
+{
+	return "player=\"" + std::to_string(player.player) + "\"";
+}
+
+/**
+ * Writes what each player, and the process as a whole, takes up in memory.
+ * @param out The stream to write to.
+ * @param players The players' figures.
+ * @param process The process-wide figures.
+ */
+void WriteMemory(std::ostream &out, const std::vector<Metrics::PlayerSample> &players,
+                 const Metrics::ProcessSample &process)
+{
+	WriteFamily(out, "playd_memory_bytes", "gauge", "Bytes of memory held, by player (if any) and use.");
+	std::size_t ram_cache = 0;
+	for (const auto &player : players) {
+		const auto label = PlayerLabel(player);
+		out << "playd_memory_bytes{" << label << ",use=\"audio_buffers\"} " << player.memory.buffers << "\n";
+		out << "playd_memory_bytes{" << label << ",use=\"decoder_scratch\"} " << player.memory.scratch << "\n";
+		out << "playd_memory_bytes{" << label << ",use=\"client_input\"} " << player.input_bytes << "\n";
+		out << "playd_memory_bytes{" << label << ",use=\"client_output\"} "
+		    << player.outbox_bytes + player.write_queue_bytes << "\n";
+		ram_cache = std::max(ram_cache, player.ram_cache_bytes);
+	}
+
+	// The players all share the one cache (or none have one).
+	out << "playd_memory_bytes{use=\"ram_cache\"} " << ram_cache << "\n";
+	out << "playd_memory_bytes{use=\"read_buffers_in_flight\"} " << process.read_buffers_in_flight << "\n";
+	out << "playd_memory_bytes{use=\"read_buffers_free\"} " << process.read_buffers_free << "\n";
+	out << "playd_memory_bytes{use=\"rt_mapped\"} " << process.rt_bytes << "\n";
+
+	WriteFamily(out, "playd_largest_client_memory_bytes", "gauge",
+	            "The most bytes of input and output any one client of each player holds.");
+	for (const auto &player : players) {
+		out << "playd_largest_client_memory_bytes{" << PlayerLabel(player) << "} " << player.largest_client << "\n";
+	}
+}
+
+} // namespace
+
+/* static */ std::atomic<std::uint64_t> Metrics::decoded_bytes{0};
+/* static */ std::atomic<std::uint64_t> Metrics::evictions{0};
+/* static */ std::atomic<std::uint64_t> Metrics::coalesced{0};
+/* static */ std::atomic<std::uint64_t> Metrics::dropped{0};
+
+/* static */ std::vector<Audio::Histogram> &Metrics::CommandLatencies(CommandStage stage)
+{
+	static std::array<std::vector<Audio::Histogram>, 3> latencies{std::vector<Audio::Histogram>(AllCommands().size()),
+	                                                              std::vector<Audio::Histogram>(AllCommands().size()),
+	                                                              std::vector<Audio::Histogram>(AllCommands().size())};
+	return latencies.at(static_cast<std::size_t>(stage));
+}
+
+/* static */ void Metrics::RecordCommand(const Command &command, CommandStage stage, std::chrono::microseconds took)
+{
+	const auto index = static_cast<std::size_t>(&command - AllCommands().data());
+	const auto value = static_cast<std::uint64_t>(std::max<std::int64_t>(took.count(), 0));
+	CommandLatencies(stage).at(index).Record(value);
+}
+
+/* static */ void Metrics::WriteOpenMetrics(std::ostream &out, const std::vector<PlayerSample> &players,
+                                           const ProcessSample &process)
+{
+	WriteFamily(out, "playd_decoded_bytes", "counter", "Bytes of audio decoded, by every player.");
+	out << "playd_decoded_bytes_total " << decoded_bytes.load(std::memory_order_relaxed) << "\n";
+
+	WriteFamily(out, "playd_connections", "gauge", "Clients connected to each player.");
+	for (const auto &player : players) {
+		out << "playd_connections{" << PlayerLabel(player) << "} " << player.connections << "\n";
+	}
+
+	WriteFamily(out, "playd_queued_responses", "gauge", "Responses waiting to be written, per player.");
+	for (const auto &player : players) {
+		out << "playd_queued_responses{" << PlayerLabel(player) << "} " << player.queued_responses << "\n";
+	}
+
+	WriteFamily(out, "playd_write_queue_bytes", "gauge", "Bytes queued in libuv for each player's clients.");
+	for (const auto &player : players) {
+		out << "playd_write_queue_bytes{" << PlayerLabel(player) << "} " << player.write_queue_bytes << "\n";
+	}
+
+	WriteFamily(out, "playd_evicted_clients", "counter", "Clients disconnected for falling too far behind.");
+	out << "playd_evicted_clients_total " << evictions.load(std::memory_order_relaxed) << "\n";
+
+	WriteFamily(out, "playd_coalesced_responses", "counter",
+	            "Position updates dropped for slow clients, in favour of newer ones.");
+	out << "playd_coalesced_responses_total " << coalesced.load(std::memory_order_relaxed) << "\n";
+
+	WriteFamily(out, "playd_dropped_responses", "counter",
+	            "Tapped audio dropped for clients too far behind to take it.");
+	out << "playd_dropped_responses_total " << dropped.load(std::memory_order_relaxed) << "\n";
+
+#ifdef WITH_ALLOCATION_COUNTS
+	// These are counted by the same operator new that the benchmarks use.
+	WriteFamily(out, "playd_allocations", "counter", "Heap allocations made by playd.");
+	out << "playd_allocations_total " << Bench::Allocations() << "\n";
+
+	WriteFamily(out, "playd_allocated_bytes", "counter", "Bytes allocated on the heap by playd.");
+	out << "playd_allocated_bytes_total " << Bench::AllocatedBytes() << "\n";
+
+	WriteFamily(out, "playd_heap_bytes", "gauge", "Bytes allocated on the heap by playd, and not yet freed.");
+	out << "playd_heap_bytes " << Bench::HeapBytes() << "\n";
+#endif // WITH_ALLOCATION_COUNTS
+
+	WriteMemory(out, players, process);
+
+	// The audio figures are only there for players that have a file loaded.
+	WriteFamily(out, "playd_callbacks", "counter", "Audio callbacks for the loaded file.");
+	for (const auto &player : players) {
+		if (player.audio) {
+			out << "playd_callbacks_total{" << PlayerLabel(player) << "} " << player.audio->callbacks << "\n";
+		}
+	}
+
+	WriteFamily(out, "playd_underruns", "counter", "Audio callbacks that ran out of audio, for the loaded file.");
+	for (const auto &player : players) {
+		if (player.audio) {
+			out << "playd_underruns_total{" << PlayerLabel(player) << "} " << player.audio->underruns << "\n";
+		}
+	}
+
+	WriteFamily(out, "playd_silent_bytes", "counter", "Bytes of silence sent to the device, for the loaded file.");
+	for (const auto &player : players) {
+		if (player.audio) {
+			out << "playd_silent_bytes_total{" << PlayerLabel(player) << "} " << player.audio->silent_bytes << "\n";
+		}
+	}
+
+	WriteFamily(out, "playd_callback_jitter_microseconds", "histogram", "How late audio callbacks were.");
+	for (const auto &player : players) {
+		if (!player.audio) continue;
+		WriteHistogram(out, "playd_callback_jitter_microseconds", PlayerLabel(player), player.audio->jitter,
+		               TIME_BUCKETS);
+	}
+
+	WriteFamily(out, "playd_callback_run_microseconds", "histogram", "How long audio callbacks took to run.");
+	for (const auto &player : players) {
+		if (!player.audio) continue;
+		WriteHistogram(out, "playd_callback_run_microseconds", PlayerLabel(player), player.audio->exec,
+		               TIME_BUCKETS);
+	}
+
+	WriteFamily(out, "playd_buffer_fill_percent", "histogram", "How full the audio buffers were at each callback.");
+	for (const auto &player : players) {
+		if (!player.audio) continue;
+		WriteHistogram(out, "playd_buffer_fill_percent", PlayerLabel(player), player.audio->fill, PERCENT_BUCKETS);
+	}
+
+	WriteFamily(out, "playd_start_microseconds", "gauge",
+	            "How long the last unscheduled play took to reach the device, once it has.");
+	for (const auto &player : players) {
+		if (player.audio && player.audio->start_latency) {
+			out << "playd_start_microseconds{" << PlayerLabel(player) << "} " << player.audio->start_latency->count()
+			    << "\n";
+		}
+	}
+
+	WriteCommandLatencies(out, "playd_command_wait_microseconds", "How long commands waited to be run, by verb.",
+	                      CommandStage::WAITED);
+	WriteCommandLatencies(out, "playd_command_microseconds", "How long commands took to run, by verb.",
+	                      CommandStage::RAN);
+	WriteCommandLatencies(out, "playd_command_reply_microseconds",
+	                      "How long commands took from arriving to their replies being written, by verb.",
+	                      CommandStage::REPLIED);
+
+	out << "# EOF\n";
+}
+
+/* static */ void Metrics::WriteCommandLatencies(std::ostream &out, std::string_view name, std::string_view help,
+                                                CommandStage stage)
+{
+	// Commands with the same verb and different arities count as one.
+	std::map<std::string_view, Audio::Histogram::Summary> by_verb;
+	const auto commands = AllCommands();
+	const auto &latencies = CommandLatencies(stage);
+	for (std::size_t i = 0; i < commands.size(); i++) {
+		const auto [it, added] = by_verb.try_emplace(commands[i].verb, Audio::Histogram::Summary{});
+		Merge(it->second, latencies[i].Summarise());
+	}
+
+	WriteFamily(out, name, "histogram", help);
+	for (const auto &[verb, summary] : by_verb) {
+		WriteHistogram(out, name, "verb=\"" + std::string{verb} + "\"", summary, TIME_BUCKETS);
+	}
+}
+
+/* static */ std::string Metrics::Serve(std::string_view request, const std::vector<PlayerSample> &players,
+                                       const ProcessSample &process)
+{
+	const auto line = request.substr(0, request.find_first_of("\r\n"));
+	const auto wanted = line.starts_with("GET /metrics ") || line.starts_with("GET / ");
+
+	std::ostringstream body;
+	if (wanted) {
+		WriteOpenMetrics(body, players, process);
+	} else {
+		body << "Not found; try /metrics.\n";
+	}
+	const auto text = body.str();
+
+	std::ostringstream reply;
+	reply << (wanted ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n");
+	reply << "Content-Type: " << (wanted ? CONTENT_TYPE : "text/plain; charset=utf-8") << "\r\n";
+	reply << "Content-Length: " << text.size() << "\r\n";
+	reply << "Connection: close\r\n\r\n";
+	reply << text;
+	return reply.str();
+}
+
+} // namespace Playd
@@ -0,0 +1,160 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Metrics class.
+ * @see metrics.cpp
+ */
+
+#ifndef PLAYD_METRICS_H
+#define PLAYD_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "audio/stats.h"
+
+namespace Playd
+{
+struct Command;
+
+/**
+ * playd's metrics, for scraping by Prometheus and anything else that reads
+ * OpenMetrics.
+ *
+ * Process-wide figures are kept here, and recorded into with relaxed atomics
+ * wherever they happen; per-player figures stay where they already are (the
+ * audio callback's statistics, the channels' connections) and are gathered
+ * into PlayerSamples only when scraped.
+ */
+class Metrics
+{
+public:
+	/// One player's figures, as gathered at scrape time.
+	struct PlayerSample {
+		std::size_t player;                                   ///< The player's index, from 0.
+		std::optional<Audio::CallbackStats::Snapshot> audio; ///< Its callback stats, if it's playing.
+		std::size_t connections;                              ///< How many clients it has.
+		std::size_t queued_responses; ///< Responses waiting for the end of the loop iteration.
+		std::size_t write_queue_bytes; ///< Bytes libuv has yet to write to its clients.
+
+		// What it takes up in memory; see MemoryUse, Connection::InputBytes().
+		Audio::MemoryUse memory{0, 0};   ///< Its files' buffers and decoders.
+		std::size_t ram_cache_bytes{0};  ///< What the RAM cache it shares holds.
+		std::size_t input_bytes{0};      ///< Its clients' commands, read but not yet run.
+		std::size_t outbox_bytes{0};     ///< Its clients' responses, waiting for the end of the loop iteration.
+		std::size_t largest_client{0};   ///< The most any one client takes up, of all of the above.
+	};
+
+	/// Process-wide figures, as gathered at scrape time.
+	struct ProcessSample {
+		std::size_t read_buffers_in_flight; ///< Bytes of read buffers lent to libuv.
+		std::size_t read_buffers_free;      ///< Bytes of read buffers kept for reuse.
+		std::size_t rt_bytes;               ///< Bytes mapped for real-time audio buffers.
+	};
+
+	/// The parts of a command's life that are timed.
+	enum class CommandStage : std::uint8_t {
+		WAITED,  ///< From its arrival to its dispatch, behind the commands read with it.
+		RAN,     ///< From its dispatch to its handler returning.
+		REPLIED, ///< From its arrival to its reply having been written.
+	};
+
+	/// The MIME type of WriteOpenMetrics()'s output.
+	static constexpr std::string_view CONTENT_TYPE{"application/openmetrics-text; version=1.0.0; charset=utf-8"};
+
+	/**
+	 * Counts decoded audio.
+	 * @param bytes The number of bytes decoded.
+	 */
+	static void AddDecoded(std::uint64_t bytes)
+	{
+		decoded_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	/// Counts a client disconnected for falling too far behind.
+	static void AddEviction()
+	{
+		evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Counts a response dropped because a newer one replaced it.
+	static void AddCoalesced()
+	{
+		coalesced.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Counts a response dropped because its client was too far behind.
+	static void AddDropped()
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Records how long part of a command's life took.
+	 * @param command The command, as returned by FindCommand().
+	 * @param stage The part of its life.
+	 * @param took How long it took.
+	 */
+	static void RecordCommand(const Command &command, CommandStage stage, std::chrono::microseconds took);
+
+	/**
+	 * Writes every metric, in the OpenMetrics text format.
+	 * @param out The stream to write to.
+	 * @param players The players' figures.
+	 * @param process The process-wide figures.
+	 */
+	static void WriteOpenMetrics(std::ostream &out, const std::vector<PlayerSample> &players,
+	                             const ProcessSample &process = {});
+
+	/**
+	 * Answers an HTTP request for the metrics.
+	 * @param request The request's head.
+	 * @param players The players' figures.
+	 * @param process The process-wide figures.
+	 * @return The whole HTTP response.
+	 */
+	static std::string Serve(std::string_view request, const std::vector<PlayerSample> &players,
+	                         const ProcessSample &process = {});
+
+private:
+	/**
+	 * @param stage The part of commands' lives timed.
+	 * @return The histograms for that stage, one per command.
+	 */
+	static std::vector<Audio::Histogram> &CommandLatencies(CommandStage stage);
+
+	/**
+	 * Writes one stage's command latency histograms.
+	 * @param out The stream to write to.
+	 * @param name The histograms' family name.
+	 * @param help What they measure.
+	 * @param stage The part of commands' lives timed.
+	 */
+	static void WriteCommandLatencies(std::ostream &out, std::string_view name, std::string_view help,
+	                                  CommandStage stage);
+
+	/// The bytes decoded, by every player.
+	static std::atomic<std::uint64_t> decoded_bytes;
+
+	/// The clients disconnected for falling too far behind.
+	static std::atomic<std::uint64_t> evictions;
+
+	/// The responses dropped because newer ones replaced them.
+	static std::atomic<std::uint64_t> coalesced;
+
+	/// The responses dropped because their clients were too far behind.
+	static std::atomic<std::uint64_t> dropped;
+};
+
+} // namespace Playd
+
+#endif // PLAYD_METRICS_H
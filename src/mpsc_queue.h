@@ -0,0 +1,97 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration and implementation of the MpscQueue class template.
+ */
+
+#ifndef PLAYD_MPSC_QUEUE_H
+#define PLAYD_MPSC_QUEUE_H
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace Playd
+{
+/**
+ * An unbounded, lock-free queue with many producers and one consumer.
+ *
+ * This is Dmitry Vyukov's intrusive MPSC queue: pushing is one exchange
+ * and one store, whichever thread does it, and popping never blocks.  A
+ * push that is halfway done looks, to the consumer, like the end of the
+ * queue, so a consumer woken by each push (as with uv_async_send) must
+ * drain the queue on every wake-up, and will see the half-done push on
+ * the wake-up that it causes.
+ *
+ * @tparam T The type of value queued.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+	/// Constructs an empty queue.
+	MpscQueue() : head{&stub}, tail{&stub}
+	{
+	}
+
+	/// MpscQueue cannot be copied.
+	MpscQueue(const MpscQueue &) = delete;
+
+	/// MpscQueue cannot be copy-assigned.
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	/// Destructs the queue, and anything still in it.
+	~MpscQueue()
+	{
+		while (this->Pop()) {
+		}
+		if (this->tail != &this->stub) delete this->tail;
+	}
+
+	/**
+	 * Adds a value to the back of the queue.
+	 * This is safe to call from any thread.
+	 * @param value The value to add.
+	 */
+	void Push(T value)
+	{
+		auto *node = new Node{std::move(value), nullptr};
+		auto *prev = this->head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	/**
+	 * Takes the value at the front of the queue.
+	 * Only the consumer thread may call this.
+	 * @return The value, or nothing if the queue is (or looks) empty.
+	 */
+	std::optional<T> Pop()
+	{
+		auto *next = this->tail->next.load(std::memory_order_acquire);
+		if (next == nullptr) return std::nullopt;
+
+		// The front node becomes the new stub, so its value moves out.
+		std::optional<T> value{std::move(*next->value)};
+		next->value.reset();
+		if (this->tail != &this->stub) delete this->tail;
+		this->tail = next;
+		return value;
+	}
+
+private:
+	/// One link in the queue.
+	struct Node {
+		std::optional<T> value;   ///< The value, until it is popped.
+		std::atomic<Node *> next; ///< The next node back, once linked.
+	};
+
+	Node stub{std::nullopt, nullptr}; ///< The node the queue starts out with.
+	std::atomic<Node *> head;           ///< The most recently pushed node.
+	Node *tail;                         ///< The node before the front, which the consumer owns.
+};
+
+} // namespace Playd
+
+#endif // PLAYD_MPSC_QUEUE_H
@@ -9,14 +9,37 @@
 
 #include "player.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "audio/audio.h"
+#include "audio/channel_matrix.h"
+#include "audio/crossfade.h"
+#include "audio/mapped_file.h"
+#include "audio/pcm_cache.h"
+#include "audio/pcm_tap.h"
+#include "audio/resampler.h"
+#include "audio/sample_format.h"
+#include "audio/silence.h"
 #include "audio/sink.h"
 #include "audio/source.h"
+#include "audio/sources/ram.h"
+#include "audio/time_stretch.h"
+#include "audio/waveform.h"
 #include "errors.h"
 #include "messages.h"
 #include "response.h"
@@ -33,14 +56,41 @@ Response PlayerDead(std::string_view tag)
 // Player
 //
 
-Player::Player(int device_id, SinkFn sink, std::map<std::string, SourceFn> sources)
+Player::Player(int device_id, SinkFn sink, std::vector<Decoder> decoders)
     : device_id{device_id},
       sink{std::move(sink)},
-      sources{std::move(sources)},
+      decoders{std::move(decoders)},
+      cache{nullptr},
+      ram_cache{nullptr},
+      waveforms{nullptr},
+      cues{nullptr},
+      scheduler{nullptr},
       file{std::make_unique<Audio::NullAudio>()},
+      cued{nullptr},
       dead{false},
       io{nullptr},
-      last_pos{0}
+      clock{&Clock::Steady()},
+      last_stats{Clock::Steady().Now()},
+      warned_skips{0},
+      playhead{nullptr},
+      snapshot{nullptr},
+      standing_by{false},
+      meter_loudness{false},
+      load_generation{0},
+      cue_generation{0},
+      output_rate{0},
+      output_channels{0},
+      sink_format{std::nullopt},
+      resample_quality{Audio::Resampler::Quality::MEDIUM},
+      stop_scheduled{false},
+      next_queue_key{0},
+      advance_scheduled{false},
+      crossfade_scheduled{false},
+      ready{true},
+      pre_roll{0},
+      pre_roll_state{PreRoll::NONE},
+      update_period{DEFAULT_UPDATE_PERIOD},
+      buffer_policy{nullptr}
 {
 }
 
@@ -49,22 +99,244 @@ void Player::SetIo(const ResponseSink &new_io)
 	this->io = &new_io;
 }
 
+void Player::UseClock(const Clock &new_clock)
+{
+	this->clock = &new_clock;
+	this->last_stats = new_clock.Now();
+}
+
+void Player::SetWakeHandler(std::function<void()> new_wake)
+{
+	this->wake = std::move(new_wake);
+}
+
+void Player::SetBackgroundRunner(BackgroundFn new_background)
+{
+	this->background = std::move(new_background);
+}
+
+void Player::HoldUntilReady()
+{
+	this->ready = false;
+}
+
+void Player::MarkReady()
+{
+	this->ready = true;
+
+	// Commands can't be held any more, so nothing joins held as it runs.
+	auto commands = std::move(this->held);
+	this->held.clear();
+	for (auto &[id, command] : commands) {
+		if (const auto rs = command()) this->Complete(id, *rs);
+	}
+}
+
+std::optional<Response> Player::WhenReady(ClientId id, HeldFn command)
+{
+	if (this->ready) return command();
+
+	this->held.emplace_back(id, std::move(command));
+	return std::nullopt;
+}
+
+void Player::EnableDecodeThreads(std::shared_ptr<Audio::DecodeScheduler> new_scheduler)
+{
+	this->scheduler = std::move(new_scheduler);
+}
+
+void Player::EnableResampling(std::uint32_t rate, Audio::Resampler::Quality quality)
+{
+	Expects(0 < rate);
+
+	this->output_rate = rate;
+	this->resample_quality = quality;
+}
+
+void Player::EnableRemixing(std::uint8_t channels)
+{
+	Expects(0 < channels && channels <= Audio::ChannelMatrix::MAX_CHANNELS);
+
+	this->output_channels = channels;
+}
+
+void Player::EnableFormatNegotiation(Audio::SampleFormat format)
+{
+	this->sink_format = format;
+}
+
+void Player::EnableMetadataCache(std::shared_ptr<Audio::MetadataCache> cache)
+{
+	this->cache = std::move(cache);
+}
+
+void Player::EnableRamCache(std::shared_ptr<Audio::PcmCache> cache)
+{
+	this->ram_cache = std::move(cache);
+}
+
+void Player::EnableLoudnessMeters()
+{
+	this->meter_loudness = true;
+}
+
+void Player::EnableWaveformCache(std::shared_ptr<Audio::WaveformCache> cache)
+{
+	this->waveforms = std::move(cache);
+}
+
+void Player::EnableTrimming(double threshold_db, std::shared_ptr<Audio::CueCache> cache)
+{
+	this->trim_db = threshold_db;
+	this->cues = std::move(cache);
+}
+
+void Player::EnablePreRoll(std::chrono::milliseconds amount)
+{
+	this->pre_roll = amount;
+}
+
+void Player::EnableBufferTuning(std::shared_ptr<Audio::BufferPolicy> policy)
+{
+	this->buffer_policy = std::move(policy);
+}
+
+void Player::SetUpdatePeriod(std::chrono::milliseconds period)
+{
+	Expects(0 < period.count() && period <= MAX_UPDATE_PERIOD);
+	this->update_period = period;
+}
+
+std::chrono::milliseconds Player::UpdatePeriod() const
+{
+	return this->update_period;
+}
+
+void Player::AddFixedSetting(std::string key, std::string value)
+{
+	this->fixed_settings.emplace_back(std::move(key), std::move(value));
+}
+
+void Player::EnableSharedPlayhead(std::unique_ptr<SharedPlayhead> new_playhead)
+{
+	this->playhead = std::move(new_playhead);
+	this->PublishPlayhead();
+}
+
+void Player::EnableSnapshot(std::unique_ptr<StateSnapshot> new_snapshot)
+{
+	Expects(new_snapshot != nullptr && new_snapshot->Owned());
+
+	this->snapshot = std::move(new_snapshot);
+	this->standing_by = false;
+	this->PublishSnapshot();
+}
+
+void Player::StandBy(std::unique_ptr<StateSnapshot> new_snapshot)
+{
+	Expects(new_snapshot != nullptr && !new_snapshot->Owned());
+
+	this->snapshot = std::move(new_snapshot);
+	this->standing_by = true;
+	this->followed_file.clear();
+	this->followed_cue.clear();
+}
+
+bool Player::IsStandingBy() const
+{
+	return this->standing_by;
+}
+
+bool Player::IsPlaying() const
+{
+	// A pre-rolling file needs updates to get it started.
+	if (this->pre_roll_state != PreRoll::NONE) return true;
+	return this->file->CurrentState() == Audio::Audio::State::PLAYING;
+}
+
+std::optional<Audio::CallbackStats::Snapshot> Player::AudioStats() const
+{
+	if (this->dead) return std::nullopt;
+	return this->file->Stats();
+}
+
+Audio::MemoryUse Player::Memory() const
+{
+	Audio::MemoryUse use{0, 0};
+	if (this->dead) return use;
+
+	use += this->file->Memory();
+	if (this->cued != nullptr) use += this->cued->Memory();
+	for (const auto &item : this->queue) {
+		if (item.audio != nullptr) use += item.audio->Memory();
+	}
+	return use;
+}
+
+std::size_t Player::RamCacheBytes() const
+{
+	return this->ram_cache == nullptr ? 0 : this->ram_cache->Used();
+}
+
 bool Player::Update()
 {
 	assert(this->file != nullptr);
-	const auto as = this->file->Update();
+	if (this->standing_by) this->FollowSnapshot();
 
-	if (as == Audio::Audio::State::AT_END) this->End(Response::NOREQUEST);
+	const auto as = this->file->Update();
+	this->WarnOfSkippedFrames();
+	this->SendTapped();
+	this->ContinuePreRoll();
+
+	// A crossfade stops the file where the next takes over, which is as
+	// good as its end.
+	const auto crossfaded = as == Audio::Audio::State::STOPPED && this->crossfade_scheduled;
+	if (as == Audio::Audio::State::AT_END || crossfaded) {
+		// The file's integrated loudness is final now.
+		this->AnnounceLoudnessIfDue(true);
+
+		// By now, the next file has probably started; ending this one
+		// mustn't cancel that.
+		const auto started = std::exchange(this->advance_scheduled, false);
+		this->crossfade_scheduled = false;
+		this->End(Response::NOREQUEST);
+		if (!this->queue.empty()) this->Advance(true, started);
+	}
+	// Scheduled stops happen in the sink, so we only find out here.
+	if (as == Audio::Audio::State::STOPPED && this->stop_scheduled) this->SetPlaying(Response::NOREQUEST, false);
 	if (as == Audio::Audio::State::PLAYING) {
 		// Since the audio is currently playing, the position may have
 		// advanced since last update.  So we need to update it.
 		auto pos = this->file->Position();
-		if (this->CanBroadcastPos(pos)) this->BroadcastPos(Response::NOREQUEST, pos);
+		this->AnnouncePosToBuckets(pos);
+
+		this->BroadcastStatsIfDue();
+		this->AnnounceLoudnessIfDue(false);
+		this->ScheduleAdvance();
 	}
+	// Once started, the next file needs topping up like the loaded one.
+	if (this->advance_scheduled) this->queue.front().audio->Update();
+
+	// Commands and loads wake us too, so this also catches every change.
+	this->PublishPlayhead();
+	this->PublishSnapshot();
 
 	return !this->dead;
 }
 
+void Player::AddClient(ClientId id)
+{
+	this->SetPosPeriod(id, DEFAULT_POS_PERIOD);
+}
+
+void Player::RemoveClient(ClientId id)
+{
+	this->SetPosPeriod(id, std::chrono::milliseconds{0});
+	this->pos_periods.erase(id);
+	this->loud_subscriptions.erase(id);
+	this->Untap(id);
+}
+
 //
 // Commands
 //
@@ -73,12 +345,74 @@ Response Player::Dump(ClientId id, Response::Tag tag) const
 {
 	if (this->dead) return PlayerDead(tag);
 
-	this->DumpState(id, tag);
-	this->DumpFileInfo(id, tag);
+	this->DumpPlayback(id, tag);
+	for (const auto &[key, value] : this->Settings()) {
+		Respond(id, Response(tag, Response::Code::SET).AddArg(key).AddArg(value));
+	}
+
+	return Response::Success(tag);
+}
+
+Response Player::Set(Response::Tag tag, std::string_view key, std::string_view value)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	const auto parse_ms = [value]() -> std::optional<std::chrono::milliseconds> {
+		std::uint32_t ms = 0;
+		const auto *end = value.data() + value.size();
+		const auto [ptr, ec] = std::from_chars(value.data(), end, ms);
+		if (value.empty() || ec != std::errc{} || ptr != end) return std::nullopt;
+		return std::chrono::milliseconds{ms};
+	};
+
+	if (key == "update-period") {
+		const auto period = parse_ms();
+		if (!period || period->count() == 0 || MAX_UPDATE_PERIOD < *period) {
+			return Response::Invalid(tag, MSG_SET_INVALID_PERIOD);
+		}
+		// The IO channel picks this up on its next update.
+		this->SetUpdatePeriod(*period);
+	} else if (key == "pre-roll") {
+		const auto amount = parse_ms();
+		if (!amount || (this->buffer_policy != nullptr && this->buffer_policy->Sizes().second < *amount)) {
+			return Response::Invalid(tag, MSG_SET_INVALID_PRE_ROLL);
+		}
+		// A `play` already pre-rolling carries on waiting for the old amount.
+		this->EnablePreRoll(*amount);
+	} else if (key == "buffer" && this->buffer_policy != nullptr) {
+		Audio::BufferPolicy::Range sizes;
+		try {
+			sizes = Audio::BufferPolicy::ParseRange(value);
+		} catch (ConfigError &) {
+			return Response::Invalid(tag, MSG_SET_INVALID_BUFFER);
+		}
+		if (sizes.second < this->pre_roll) return Response::Invalid(tag, MSG_SET_INVALID_BUFFER);
+		this->buffer_policy->SetSizes(sizes.first, sizes.second);
+	} else {
+		const auto fixed = std::any_of(this->fixed_settings.begin(), this->fixed_settings.end(),
+		                               [key](const auto &setting) { return setting.first == key; });
+		return Response::Invalid(tag, fixed ? MSG_SET_FIXED : MSG_SET_UNKNOWN);
+	}
 
+	// Values go back out as dumps report them, which needn't be as given.
+	for (const auto &[name, now] : this->Settings()) {
+		if (name == key) Respond(BROADCAST, Response(tag, Response::Code::SET).AddArg(name).AddArg(now));
+	}
 	return Response::Success(tag);
 }
 
+void Player::DumpPlayback(ClientId id, Response::Tag tag) const
+{
+	this->DumpState(id, tag);
+	this->DumpFileInfo(id, tag);
+	if (this->cued != nullptr) Respond(id, Response(tag, Response::Code::CUE).AddArg(this->cued->File()));
+	if (!this->queue.empty()) {
+		Response rs{tag, Response::Code::QUEUE};
+		for (const auto &item : this->queue) rs.AddArg(item.path);
+		Respond(id, rs);
+	}
+}
+
 void Player::DumpFileInfo(ClientId id, Response::Tag tag) const
 {
 	// This information won't exist if there is no file.
@@ -90,144 +424,937 @@ void Player::DumpFileInfo(ClientId id, Response::Tag tag) const
 	auto pos = this->file->Position();
 	AnnounceTimestamp(Response::Code::POS, id, tag, pos);
 
-	auto len = this->file->Length();
-	AnnounceTimestamp(Response::Code::LEN, id, tag, len);
+	auto len = this->file->Length();
+	AnnounceTimestamp(Response::Code::LEN, id, tag, len);
+
+	if (const auto cues = this->file->Cues()) {
+		Respond(id, Response(tag, Response::Code::TRIM).AddArg(cues->in.count()).AddArg(cues->out.count()));
+	}
+}
+
+std::vector<std::pair<std::string, std::string>> Player::Settings() const
+{
+	std::vector<std::pair<std::string, std::string>> settings;
+	settings.emplace_back("update-period", std::to_string(this->update_period.count()));
+	if (this->buffer_policy != nullptr) {
+		settings.emplace_back("buffer", Audio::BufferPolicy::FormatRange(this->buffer_policy->Sizes()));
+	}
+	settings.emplace_back("pre-roll", std::to_string(this->pre_roll.count()));
+	settings.insert(settings.end(), this->fixed_settings.begin(), this->fixed_settings.end());
+	return settings;
+}
+
+Response Player::Eject(Response::Tag tag)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	// Any load still opening in the background is now out of date.
+	this->load_generation++;
+	this->stop_scheduled = false;
+	this->CancelAdvance();
+
+	// Silently ignore ejects on ejected files.
+	// Concurrently speaking, this should be fine, as we are the only
+	// thread that can eject or un-eject files.
+	if (this->file->CurrentState() == Audio::Audio::State::NONE) {
+		return Response::Success(tag);
+	}
+
+	assert(this->file != nullptr);
+	this->Reap(std::exchange(this->file, std::make_unique<Audio::NullAudio>()));
+	this->warned_skips = 0;
+	this->pre_roll_state = PreRoll::NONE;
+
+	this->DumpState(BROADCAST, tag);
+
+	return Response::Success(tag);
+}
+
+Response Player::End(Response::Tag tag)
+{
+	if (this->dead) return PlayerDead(tag);
+	if (this->file->CurrentState() == Audio::Sink::State::NONE) return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+
+	// Let upstream know that the file ended by itself.
+	// This is needed for auto-advancing playlists, etc.
+	this->Respond(BROADCAST, Response(Response::NOREQUEST, Response::Code::END));
+
+	this->SetPlaying(tag, false);
+
+	// Rewind the file back to the start.  We can't use Player::Pos() here
+	// in case End() is called from Pos(); a seek failure could start an
+	// infinite loop.
+	try {
+		this->PosRaw(Response::NOREQUEST, std::chrono::microseconds{0});
+	} catch (NullAudioError &) {
+		return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+	}
+
+	return Response::Success(tag);
+}
+
+Response Player::Load(Response::Tag tag, std::string_view path)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+	assert(this->file != nullptr);
+
+	// Bin the current file as soon as possible.
+	// This ensures that we don't have any situations where two files are
+	// contending over resources, or the current file spends a second or
+	// two flushing its remaining audio.
+	this->Eject(Response::NOREQUEST);
+
+	try {
+		this->InstallFile(this->LoadRaw(path));
+	} catch (FileError &e) {
+		// File errors aren't fatal, so catch them here.
+		return Response::Failure(tag, e.Message());
+	}
+
+	return Response::Success(tag);
+}
+
+std::optional<Response> Player::LoadInBackground(ClientId id, Response::Tag tag, std::string_view path)
+{
+	if (!this->background) return this->Load(tag, path);
+	if (this->dead) return PlayerDead(tag);
+
+	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+	// As with Load(), bin the current file straight away; this also
+	// supersedes any load already in the background.
+	this->Eject(Response::NOREQUEST);
+	const auto generation = this->load_generation;
+
+	auto finish = [this, generation](Response::Tag tag, auto source) {
+		if (generation != this->load_generation) return Response::Failure(tag, MSG_LOAD_SUPERSEDED);
+
+		this->InstallFile(this->MakeAudio(std::move(source)));
+		return Response::Success(tag);
+	};
+	this->OpenInBackground(id, std::string{tag}, std::string{path}, std::move(finish));
+	return std::nullopt;
+}
+
+void Player::InstallFile(std::unique_ptr<Audio::Audio> audio)
+{
+	assert(audio != nullptr);
+	this->file = std::move(audio);
+	this->PassTap(nullptr);
+	this->warned_skips = 0;
+	this->pre_roll_state = PreRoll::NONE;
+	this->ResetPosBuckets(std::chrono::microseconds{0});
+
+	// A load will change all the player's state in one go,
+	// so just send a Dump() instead of writing out all the responses
+	// here.
+	// Don't take the response from here, though, because it has the wrong
+	// tag.
+	this->DumpPlayback(ClientId::BROADCAST, Response::NOREQUEST);
+
+	// Any crossfade into the queue now needs to be from this file.
+	this->PreloadQueue();
+}
+
+void Player::Reap(std::unique_ptr<Audio::Audio> audio)
+{
+	// Whatever the old file still decodes is never heard.
+	if (audio != nullptr) audio->SetTap(nullptr);
+	if (audio == nullptr || !this->background) return;
+	if (audio->CurrentState() == Audio::Audio::State::NONE) return;
+
+	// Stopping only takes the sink off the device's queue, which is quick.
+	if (audio->CurrentState() == Audio::Audio::State::PLAYING) audio->SetPlaying(false);
+
+	// The work must let go of the audio itself, or it would be torn down
+	// back here, along with the work.
+	std::shared_ptr<Audio::Audio> doomed{std::move(audio)};
+	this->background([doomed]() mutable { doomed = nullptr; }, [] {});
+}
+
+Response Player::Cue(Response::Tag tag, std::string_view path)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+	// As with Load(), bin the old cue first so the two don't contend.
+	this->Reap(std::move(this->cued));
+	this->cue_generation++;
+
+	try {
+		this->InstallCue(this->LoadRaw(path), path);
+	} catch (FileError &e) {
+		return Response::Failure(tag, e.Message());
+	}
+
+	return Response::Success(tag);
+}
+
+std::optional<Response> Player::CueInBackground(ClientId id, Response::Tag tag, std::string_view path)
+{
+	if (!this->background) return this->Cue(tag, path);
+	if (this->dead) return PlayerDead(tag);
+
+	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+	this->Reap(std::move(this->cued));
+	const auto generation = ++this->cue_generation;
+
+	auto finish = [this, generation, path = std::string{path}](Response::Tag tag, auto source) {
+		if (generation != this->cue_generation) return Response::Failure(tag, MSG_LOAD_SUPERSEDED);
+
+		this->InstallCue(this->MakeAudio(std::move(source)), path);
+		return Response::Success(tag);
+	};
+	this->OpenInBackground(id, std::string{tag}, std::string{path}, std::move(finish));
+	return std::nullopt;
+}
+
+void Player::InstallCue(std::unique_ptr<Audio::Audio> audio, std::string_view path)
+{
+	assert(audio != nullptr);
+	this->cued = std::move(audio);
+
+	// Get the cued file's sink as full as it'll go now, so that it has
+	// plenty to play the moment it's taken.
+	this->cued->Update();
+
+	this->Respond(BROADCAST, Response(Response::NOREQUEST, Response::Code::CUE).AddArg(path));
+}
+
+Coro::Task Player::OpenInBackground(ClientId id, std::string tag, std::string path, FinishFn finish)
+{
+	std::unique_ptr<Audio::Source> source;
+	std::exception_ptr error;
+	auto opening = this->OpenSourceInBackground([this, path] { return this->OpenSource(path); });
+	try {
+		source = co_await opening;
+	} catch (...) {
+		// This is thrown again below, once we know someone is listening.
+		error = std::current_exception();
+	}
+
+	// If we're closing, nobody is listening for the result.
+	if (this->dead) co_return;
+
+	Response response = Response::Success(tag);
+	try {
+		if (error) std::rethrow_exception(error);
+		response = finish(tag, std::move(source));
+	} catch (FileError &e) {
+		// As with Load(), file errors aren't fatal.
+		response = Response::Failure(tag, e.Message());
+	}
+	this->Complete(id, response);
+}
+
+Coro::InBackground<std::unique_ptr<Audio::Source>> Player::OpenSourceInBackground(OpenFn open) const
+{
+	return {this->background, std::move(open)};
+}
+
+void Player::BroadcastQueue() const
+{
+	Response rs{Response::NOREQUEST, Response::Code::QUEUE};
+	for (const auto &item : this->queue) rs.AddArg(item.path);
+	this->Respond(BROADCAST, rs);
+}
+
+void Player::PreloadQueue()
+{
+	for (std::size_t i = 0; i < this->queue.size() && i < QUEUE_PRELOAD;) {
+		auto &item = this->queue[i];
+
+		// Crossfades are made against whatever is loaded when they open.
+		const auto overlaps = item.overlap.count() != 0;
+		if (overlaps && item.audio != nullptr && item.opened_for != this->load_generation) item.audio = nullptr;
+		if (item.audio != nullptr || item.opening || (overlaps && i != 0)) {
+			i++;
+			continue;
+		}
+
+		// Files too short to overlap, and live streams, just follow on.
+		std::string from;
+		std::chrono::microseconds at{0};
+		if (overlaps && this->file->CurrentState() != Audio::Audio::State::NONE) {
+			const auto length = this->file->Length();
+			if (item.overlap < length) {
+				from = this->file->File();
+				at = length - item.overlap;
+			}
+		}
+
+		if (this->background) {
+			item.opening = true;
+			auto crossfades = std::make_shared<bool>(false);
+			auto open = [this, path = item.path, overlap = item.overlap, from, at, crossfades] {
+				return this->OpenQueued(path, overlap, from, at, *crossfades);
+			};
+			this->PreloadInBackground(item.key, std::move(open), std::move(crossfades));
+			i++;
+			continue;
+		}
+
+		// As with InstallCue(), fill the sink now, ready to start.
+		try {
+			auto crossfades = false;
+			item.audio = this->MakeAudio(this->OpenQueued(item.path, item.overlap, from, at, crossfades));
+			item.crossfades = crossfades;
+			item.opened_for = this->load_generation;
+			item.audio->Update();
+			i++;
+		} catch (FileError &e) {
+			this->DropQueued(i, e.Message());
+		}
+	}
+}
+
+Coro::Task Player::PreloadInBackground(std::uint64_t key, OpenFn open, std::shared_ptr<bool> crossfades)
+{
+	const auto generation = this->load_generation;
+	std::unique_ptr<Audio::Source> source;
+	std::exception_ptr error;
+	auto opening = this->OpenSourceInBackground(std::move(open));
+	try {
+		source = co_await opening;
+	} catch (...) {
+		error = std::current_exception();
+	}
+	if (this->dead) co_return;
+
+	// The file may have been dequeued, or moved on to, since.
+	const auto found = std::find_if(this->queue.begin(), this->queue.end(),
+	                                [key](const QueueItem &it) { return it.key == key; });
+	if (found == this->queue.end() || !found->opening) co_return;
+	found->opening = false;
+
+	// Crossfades from a file that has since gone are no good.
+	if (found->overlap.count() != 0 && generation != this->load_generation) {
+		this->PreloadQueue();
+		co_return;
+	}
+
+	try {
+		if (error) std::rethrow_exception(error);
+		found->audio = this->MakeAudio(std::move(source));
+		found->crossfades = *crossfades;
+		found->opened_for = generation;
+		found->audio->Update();
+	} catch (FileError &e) {
+		this->DropQueued(found - this->queue.begin(), e.Message());
+		this->PreloadQueue();
+	}
+}
+
+void Player::DropQueued(std::size_t index, std::string_view message)
+{
+	Expects(index < this->queue.size());
+
+	Debug() << "dropping" << this->queue[index].path << "from the queue -" << message << std::endl;
+	this->queue.erase(this->queue.begin() + static_cast<std::ptrdiff_t>(index));
+	this->BroadcastQueue();
+}
+
+void Player::ScheduleAdvance()
+{
+	if (this->advance_scheduled || this->stop_scheduled || this->queue.empty()) return;
+	auto &next = this->queue.front();
+
+	// Crossfades opened against another file wait to open again.
+	if (next.audio == nullptr || (next.overlap.count() != 0 && next.opened_for != this->load_generation)) return;
+
+	// Live streams don't end, so nothing follows them by itself.
+	const auto length = this->file->Length();
+	if (length.count() == 0) return;
+	const auto overlap = next.crossfades ? std::chrono::microseconds{next.overlap} : std::chrono::microseconds{0};
+	// A stretched file takes longer, or shorter, to get there than it says.
+	const auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+	        (length - overlap - this->file->Position()) / this->file->Speed());
+	if (ADVANCE_LEAD < remaining) return;
+
+	// Past the crossfade (after a seek into it, say), the tail would play
+	// twice, so the next file opens again to just follow on.
+	if (next.crossfades && remaining.count() < 0) {
+		Debug() << "too late to crossfade into" << next.path << std::endl;
+		next.overlap = std::chrono::milliseconds{0};
+		next.audio = nullptr;
+		this->PreloadQueue();
+		return;
+	}
+
+	// The sinks share one clock, so this lands on the sample after the
+	// loaded file's last (or the crossfade's first), however late the
+	// next update is.
+	const auto when = this->clock->Now() +
+	                  std::chrono::duration_cast<Clock::Duration>(std::max(remaining, std::chrono::microseconds{0}));
+	next.audio->SetPlayingAt(true, when);
+
+	// The next file plays the rest of this one, mixed in, from there.
+	if (next.crossfades) this->file->SetPlayingAt(false, when);
+	this->advance_scheduled = true;
+	this->crossfade_scheduled = next.crossfades;
+}
+
+void Player::CancelAdvance()
+{
+	if (!std::exchange(this->advance_scheduled, false)) return;
+
+	// Playing again cancels the loaded file's stop at the crossfade.
+	if (std::exchange(this->crossfade_scheduled, false) && this->IsPlaying()) this->file->SetPlaying(true);
+
+	auto &item = this->queue.front();
+	item.audio->SetPlaying(false);
+	try {
+		item.audio->SetPosition(std::chrono::microseconds{0});
+	} catch (SeekError &e) {
+		// It'll have to open again when it's moved on to.
+		Debug() << "can't rewind queued file" << item.path << "-" << e.Message() << std::endl;
+		item.audio = nullptr;
+	}
+}
+
+bool Player::Advance(bool play, bool started)
+{
+	std::unique_ptr<Audio::Audio> audio;
+	while (audio == nullptr && !this->queue.empty()) {
+		auto item = std::move(this->queue.front());
+		this->queue.pop_front();
+
+		// Crossfades only make sense at the end of the file before.
+		if (item.crossfades && !started) item.audio = nullptr;
+		if (item.audio != nullptr) {
+			audio = std::move(item.audio);
+			continue;
+		}
+
+		// Files the preloader hasn't got to yet open here and now.
+		started = false;
+		try {
+			audio = this->LoadRaw(item.path);
+		} catch (FileError &e) {
+			Debug() << "skipping queued file" << item.path << "-" << e.Message() << std::endl;
+		}
+	}
+	if (audio == nullptr) {
+		this->BroadcastQueue();
+		return false;
+	}
+
+	// Moving on replaces the loaded file, just as taking would.
+	this->load_generation++;
+	this->stop_scheduled = false;
+
+	auto old_file = std::exchange(this->file, std::move(audio));
+	this->PassTap(old_file.get());
+	if (play && !started) this->file->SetPlaying(true);
+	this->Reap(std::move(old_file));
+
+	this->ResetPosBuckets(this->file->Position());
+
+	// The dump has the queue in it, unless the queue is now empty.
+	this->DumpPlayback(ClientId::BROADCAST, Response::NOREQUEST);
+	if (this->queue.empty()) this->BroadcastQueue();
+
+	this->PreloadQueue();
+	return true;
+}
+
+Response Player::Take(Response::Tag tag)
+{
+	if (this->dead) return PlayerDead(tag);
+	if (this->cued == nullptr) return Response::Invalid(tag, MSG_CMD_NEEDS_CUED);
+
+	const auto was_playing = this->IsPlaying();
+
+	// Taking replaces the loaded file, just as loading would.
+	this->load_generation++;
+	this->stop_scheduled = false;
+	this->CancelAdvance();
+
+	// Start the new file before getting rid of the old one, so that
+	// there's as little silence between the two as we can manage.
+	auto old_file = std::exchange(this->file, std::move(this->cued));
+	this->PassTap(old_file.get());
+	if (was_playing) this->file->SetPlaying(true);
+	this->Reap(std::move(old_file));
+
+	this->ResetPosBuckets(this->file->Position());
+
+	// As with Load(), this changes everything, so send a full dump.
+	this->DumpPlayback(ClientId::BROADCAST, Response::NOREQUEST);
+	this->PreloadQueue();
+
+	return Response::Success(tag);
+}
+
+Response Player::Enqueue(Response::Tag tag, std::string_view path, std::string_view overlap_str)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+
+	std::uint32_t overlap = 0;
+	const auto *end = overlap_str.data() + overlap_str.size();
+	const auto [ptr, ec] = std::from_chars(overlap_str.data(), end, overlap);
+	if (overlap_str.empty() || ec != std::errc{} || ptr != end || MAX_OVERLAP < std::chrono::milliseconds{overlap}) {
+		return Response::Invalid(tag, MSG_QUEUE_INVALID_OVERLAP);
+	}
+
+	this->queue.push_back(QueueItem{this->next_queue_key++, std::string{path}, std::chrono::milliseconds{overlap},
+	                                nullptr, false, false, 0});
+	this->BroadcastQueue();
+	this->PreloadQueue();
+	return Response::Success(tag);
+}
+
+Response Player::Dequeue(Response::Tag tag, std::string_view index_str)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	std::size_t index = 0;
+	const auto *end = index_str.data() + index_str.size();
+	const auto [ptr, ec] = std::from_chars(index_str.data(), end, index);
+	if (index_str.empty() || ec != std::errc{} || ptr != end || this->queue.size() <= index) {
+		return Response::Invalid(tag, MSG_QUEUE_INVALID_INDEX);
+	}
+
+	if (index == 0) this->CancelAdvance();
+	this->queue.erase(this->queue.begin() + static_cast<std::ptrdiff_t>(index));
+	this->BroadcastQueue();
+
+	// Something else may have moved up into the preloaded files.
+	this->PreloadQueue();
+	return Response::Success(tag);
+}
+
+Response Player::Next(Response::Tag tag)
+{
+	if (this->dead) return PlayerDead(tag);
+	if (this->queue.empty()) return Response::Invalid(tag, MSG_CMD_NEEDS_QUEUED);
+
+	// The next file starts now, not whenever it was scheduled to.
+	this->CancelAdvance();
+	if (!this->Advance(this->IsPlaying(), false)) return Response::Failure(tag, MSG_QUEUE_UNPLAYABLE);
+	return Response::Success(tag);
+}
+
+Response Player::Pos(Response::Tag tag, std::string_view pos_str)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	std::chrono::microseconds pos{0};
+	try {
+		pos = PosParse(pos_str);
+	} catch (SeekError &e) {
+		// Seek errors here are a result of clients sending weird times.
+		// Thus, we tell them off.
+		return Response::Invalid(tag, e.Message());
+	}
+
+	try {
+		this->PosRaw(tag, pos);
+	} catch (NullAudioError &) {
+		return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+	} catch (SeekError &) {
+		// Seek failures here are a result of the decoder not liking the
+		// seek position (usually because it's outside the audio file!).
+		// Thus, unlike above, we try to recover.
+
+		Debug() << "Seek failure" << std::endl;
+
+		// Make it look to the client as if the seek ran off the end of
+		// the file.
+		this->End(tag);
+	}
+
+	// If we've made it all the way down here, we deserve to succeed.
+	return Response::Success(tag);
+}
+
+Response Player::SetPlaying(Response::Tag tag, bool playing)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	// Two of us playing at once would be worse than one going away.
+	if (playing && this->standing_by) return Response::Failure(tag, MSG_CMD_STANDING_BY);
+
+	// Why is SetPlaying not split between Start() and Stop()?, I hear the
+	// best practices purists amongst you say.  Quite simply, there is a
+	// large amount of fiddly exception boilerplate here that would
+	// otherwise be duplicated between the two methods.
+
+	assert(this->file != nullptr);
+
+	this->CancelAdvance();
+
+	// Pre-rolled plays wait for the next updates to start them, and count
+	// as stopped until then; playing again doesn't hurry them.
+	if (playing && this->pre_roll_state != PreRoll::NONE) return Response::Success(tag);
+	const auto pre_rolling = std::exchange(this->pre_roll_state, PreRoll::NONE) != PreRoll::NONE;
+	if (playing && std::chrono::milliseconds{0} < this->pre_roll &&
+	    this->file->CurrentState() == Audio::Audio::State::STOPPED) {
+		this->stop_scheduled = false;
+		this->pre_roll_state = PreRoll::FILLING;
+		this->ContinuePreRoll();
+		return Response::Success(tag);
+	}
+
+	try {
+		this->file->SetPlaying(playing);
+	} catch (NullAudioError &e) {
+		return Response::Invalid(tag, e.Message());
+	}
+	this->stop_scheduled = false;
+
+	// Nobody was told that a pre-rolled play had started, so nobody needs
+	// telling that it stopped.
+	if (pre_rolling) return Response::Success(tag);
+
+	this->DumpState(BROADCAST, Response::NOREQUEST);
+
+	// It can be helpful to know precisely where the player changed its
+	// playing state, and it doesn't really harm us if we're overly chatty
+	// in announcing it.
+	this->BroadcastPos(Response::NOREQUEST, this->file->Position());
+
+	return Response::Success(tag);
+}
+
+Response Player::SetPlayingAt(Response::Tag tag, bool playing, std::string_view time_str)
+{
+	if (this->dead) return PlayerDead(tag);
+	if (playing && this->standing_by) return Response::Failure(tag, MSG_CMD_STANDING_BY);
+
+	std::uint64_t micros = 0;
+	const auto *end = time_str.data() + time_str.size();
+	const auto [ptr, ec] = std::from_chars(time_str.data(), end, micros);
+	if (time_str.empty() || ec != std::errc{} || ptr != end || INT64_MAX / 1000 < micros) {
+		return Response::Invalid(tag, MSG_AT_INVALID_VALUE);
+	}
+
+	// Sinks time themselves on the steady clock, which doesn't line up
+	// between machines; the system clock does, so we translate.
+	const std::chrono::system_clock::time_point at{std::chrono::microseconds{micros}};
+	const auto until = at - std::chrono::system_clock::now();
+	const auto when = this->clock->Now() + std::chrono::duration_cast<Clock::Duration>(until);
+
+	assert(this->file != nullptr);
+	const auto was_playing = this->file->CurrentState() == Audio::Audio::State::PLAYING;
+	this->CancelAdvance();
+	this->pre_roll_state = PreRoll::NONE;
+	try {
+		this->file->SetPlayingAt(playing, when);
+	} catch (NullAudioError &e) {
+		return Response::Invalid(tag, e.Message());
+	}
+
+	if (!playing) {
+		this->stop_scheduled = was_playing;
+		return Response::Success(tag);
+	}
+
+	// As with SetPlaying(), announce the new state, which is playing as
+	// soon as the start is scheduled.
+	this->stop_scheduled = false;
+	if (!was_playing) {
+		this->DumpState(BROADCAST, Response::NOREQUEST);
+		this->BroadcastPos(Response::NOREQUEST, this->file->Position());
+	}
+	return Response::Success(tag);
+}
+
+Response Player::PosRate(ClientId id, Response::Tag tag, std::string_view period_str)
+{
+	if (this->dead) return PlayerDead(tag);
+
+	std::uint32_t period = 0;
+	const auto *end = period_str.data() + period_str.size();
+	const auto [ptr, ec] = std::from_chars(period_str.data(), end, period);
+	if (period_str.empty() || ec != std::errc{} || ptr != end) {
+		return Response::Invalid(tag, MSG_POSRATE_INVALID_VALUE);
+	}
+
+	this->SetPosPeriod(id, std::chrono::milliseconds{period});
+	return Response::Success(tag);
+}
+
+Response Player::Loudness(ClientId id, Response::Tag tag) const
+{
+	if (this->dead) return PlayerDead(tag);
+	if (!this->meter_loudness) return Response::Invalid(tag, MSG_LOUDNESS_OFF);
+
+	const auto rs = this->LoudnessResponse(tag);
+	if (!rs) return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+
+	this->Respond(id, *rs);
+	return Response::Success(tag);
+}
+
+Response Player::LoudRate(ClientId id, Response::Tag tag, std::string_view period_str)
+{
+	if (this->dead) return PlayerDead(tag);
+	if (!this->meter_loudness) return Response::Invalid(tag, MSG_LOUDNESS_OFF);
+
+	std::uint32_t period = 0;
+	const auto *end = period_str.data() + period_str.size();
+	const auto [ptr, ec] = std::from_chars(period_str.data(), end, period);
+	if (period_str.empty() || ec != std::errc{} || ptr != end) {
+		return Response::Invalid(tag, MSG_POSRATE_INVALID_VALUE);
+	}
+
+	if (period == 0) {
+		this->loud_subscriptions.erase(id);
+	} else {
+		const std::chrono::milliseconds ms{period};
+		this->loud_subscriptions[id] = LoudSubscription{ms, this->clock->Now() + ms};
+	}
+	return Response::Success(tag);
 }
 
-Response Player::Eject(Response::Tag tag)
+Response Player::Tap(ClientId id, Response::Tag tag, std::string_view on_str)
 {
 	if (this->dead) return PlayerDead(tag);
+	if (on_str != "1" && on_str != "0") return Response::Invalid(tag, MSG_TAP_INVALID_VALUE);
 
-	// Silently ignore ejects on ejected files.
-	// Concurrently speaking, this should be fine, as we are the only
-	// thread that can eject or un-eject files.
-	if (this->file->CurrentState() == Audio::Audio::State::NONE) {
+	if (on_str == "0") {
+		this->Untap(id);
+		return Response::Success(tag);
+	}
+	if (std::find(this->tap_clients.begin(), this->tap_clients.end(), id) != this->tap_clients.end()) {
 		return Response::Success(tag);
 	}
 
-	assert(this->file != nullptr);
-	this->file = std::make_unique<Audio::NullAudio>();
-
-	this->DumpState(BROADCAST, tag);
-
+	// Most playds are never tapped, so they never pay for the ring.
+	if (this->tap == nullptr) {
+		this->tap = std::make_shared<Audio::PcmTap>();
+		this->file->SetTap(this->tap);
+	}
+	if (this->tap_clients.empty()) this->tap->SetListening(true);
+	this->tap_clients.push_back(id);
 	return Response::Success(tag);
 }
 
-Response Player::End(Response::Tag tag)
+Response Player::Fade(Response::Tag tag, std::string_view duration_str, std::string_view db_str,
+                      std::string_view shape_str)
 {
 	if (this->dead) return PlayerDead(tag);
-	if (this->file->CurrentState() == Audio::Sink::State::NONE) return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
 
-	// Let upstream know that the file ended by itself.
-	// This is needed for auto-advancing playlists, etc.
-	this->Respond(BROADCAST, Response(Response::NOREQUEST, Response::Code::END));
+	std::uint32_t duration = 0;
+	const auto *duration_end = duration_str.data() + duration_str.size();
+	const auto duration_result = std::from_chars(duration_str.data(), duration_end, duration);
 
-	this->SetPlaying(tag, false);
+	double db = 0.0;
+	const auto *db_end = db_str.data() + db_str.size();
+	const auto db_result = std::from_chars(db_str.data(), db_end, db);
+
+	if (duration_str.empty() || duration_result.ec != std::errc{} || duration_result.ptr != duration_end ||
+	    db_str.empty() || db_result.ec != std::errc{} || db_result.ptr != db_end || std::isnan(db) ||
+	    Audio::Gain::MAX_DB < db) {
+		return Response::Invalid(tag, MSG_FADE_INVALID_VALUE);
+	}
+
+	Audio::Gain::Shape shape{};
+	if (shape_str == "log") {
+		shape = Audio::Gain::Shape::LOG;
+	} else if (shape_str == "linear") {
+		shape = Audio::Gain::Shape::LINEAR;
+	} else if (shape_str == "power") {
+		shape = Audio::Gain::Shape::EQUAL_POWER;
+	} else {
+		return Response::Invalid(tag, MSG_FADE_INVALID_SHAPE);
+	}
 
-	// Rewind the file back to the start.  We can't use Player::Pos() here
-	// in case End() is called from Pos(); a seek failure could start an
-	// infinite loop.
 	try {
-		this->PosRaw(Response::NOREQUEST, std::chrono::microseconds{0});
+		this->file->Fade(std::chrono::milliseconds{duration}, db, shape);
 	} catch (NullAudioError &) {
 		return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
 	}
-
 	return Response::Success(tag);
 }
 
-Response Player::Load(Response::Tag tag, std::string_view path)
+Response Player::Rate(Response::Tag tag, std::string_view speed_str)
 {
 	if (this->dead) return PlayerDead(tag);
 
-	if (path.empty()) return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
-
-	assert(this->file != nullptr);
-
-	// Bin the current file as soon as possible.
-	// This ensures that we don't have any situations where two files are
-	// contending over resources, or the current file spends a second or
-	// two flushing its remaining audio.
-	this->Eject(Response::NOREQUEST);
+	double speed = 0.0;
+	const auto *end = speed_str.data() + speed_str.size();
+	const auto [ptr, ec] = std::from_chars(speed_str.data(), end, speed);
+	if (speed_str.empty() || ec != std::errc{} || ptr != end || !(Audio::TimeStretch::MIN_SPEED <= speed) ||
+	    Audio::TimeStretch::MAX_SPEED < speed) {
+		return Response::Invalid(tag, MSG_RATE_INVALID_VALUE);
+	}
 
+	// Any hand-over to the queue was timed for the old speed.
+	this->CancelAdvance();
 	try {
-		this->file = this->LoadRaw(path);
+		this->file->SetSpeed(speed);
+	} catch (NullAudioError &) {
+		return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
 	} catch (FileError &e) {
-		// File errors aren't fatal, so catch them here.
-		return Response::Failure(tag, e.Message());
+		return Response::Invalid(tag, e.Message());
 	}
-
-	assert(this->file != nullptr);
-	this->last_pos = std::chrono::seconds{0};
-
-	// A load will change all the player's state in one go,
-	// so just send a Dump() instead of writing out all the responses
-	// here.
-	// Don't take the response from here, though, because it has the wrong
-	// tag.
-	std::ignore = this->Dump(ClientId::BROADCAST, Response::NOREQUEST);
-
 	return Response::Success(tag);
 }
 
-Response Player::Pos(Response::Tag tag, std::string_view pos_str)
+std::optional<Response> Player::Waveform(ClientId id, Response::Tag tag, std::string_view buckets_str)
 {
 	if (this->dead) return PlayerDead(tag);
 
-	std::chrono::microseconds pos{0};
+	std::uint32_t buckets = 0;
+	const auto *end = buckets_str.data() + buckets_str.size();
+	const auto [ptr, ec] = std::from_chars(buckets_str.data(), end, buckets);
+	if (buckets_str.empty() || ec != std::errc{} || ptr != end || buckets == 0 ||
+	    Audio::MAX_WAVEFORM_BUCKETS < buckets) {
+		return Response::Invalid(tag, MSG_WAVEFORM_INVALID_VALUE);
+	}
+	if (this->file->CurrentState() == Audio::Sink::State::NONE) return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
+
+	std::string path{this->file->File()};
+	if (this->waveforms != nullptr) {
+		if (const auto waveform = this->waveforms->Find(path, buckets)) {
+			return this->SendOverview(id, tag, path, buckets, *waveform);
+		}
+	}
+
+	if (this->background) {
+		this->OverviewInBackground(id, std::string{tag}, std::move(path), buckets);
+		return std::nullopt;
+	}
+
 	try {
-		pos = PosParse(pos_str);
+		return this->SendOverview(id, tag, path, buckets, this->ComputeOverview(path, buckets));
+	} catch (FileError &e) {
+		return Response::Failure(tag, e.Message());
 	} catch (SeekError &e) {
-		// Seek errors here are a result of clients sending weird times.
-		// Thus, we tell them off.
-		return Response::Invalid(tag, e.Message());
+		return Response::Failure(tag, e.Message());
 	}
+}
+
+Audio::Waveform Player::ComputeOverview(const std::string &path, std::uint32_t buckets) const
+{
+	// The overview gets its own sources, so the loaded file never notices.
+	// The cache is written here too, to keep the disk off our thread.
+	auto open = [this, &path] { return this->LoadSource(path); };
+	auto waveform = Audio::ComputeWaveform(open, buckets, std::thread::hardware_concurrency());
+	if (this->waveforms != nullptr) this->waveforms->Store(path, waveform);
+	return waveform;
+}
 
+Coro::Task Player::OverviewInBackground(ClientId id, std::string tag, std::string path, std::uint32_t buckets)
+{
+	std::optional<Audio::Waveform> waveform;
+	std::optional<std::string> failure;
+	Coro::InBackground<Audio::Waveform> computing{
+	        this->background, [this, &path, buckets] { return this->ComputeOverview(path, buckets); }};
 	try {
-		this->PosRaw(tag, pos);
-	} catch (NullAudioError &) {
-		return Response::Invalid(tag, MSG_CMD_NEEDS_LOADED);
-	} catch (SeekError &) {
-		// Seek failures here are a result of the decoder not liking the
-		// seek position (usually because it's outside the audio file!).
-		// Thus, unlike above, we try to recover.
+		waveform = co_await computing;
+	} catch (FileError &e) {
+		failure = std::string{e.Message()};
+	} catch (SeekError &e) {
+		failure = std::string{e.Message()};
+	}
 
-		Debug() << "Seek failure" << std::endl;
+	// If we're closing, nobody is listening for the result.
+	if (this->dead) co_return;
 
-		// Make it look to the client as if the seek ran off the end of
-		// the file.
-		this->End(tag);
+	if (failure) {
+		this->Complete(id, Response::Failure(tag, *failure));
+	} else {
+		this->Complete(id, this->SendOverview(id, tag, path, buckets, *waveform));
 	}
+}
 
-	// If we've made it all the way down here, we deserve to succeed.
+Response Player::SendOverview(ClientId id, Response::Tag tag, std::string_view path, std::uint32_t buckets,
+                              const Audio::Waveform &waveform) const
+{
+	Response rs{tag, Response::Code::WAVE};
+	rs.AddArg(path).AddArg(buckets).AddBytes(Audio::PackWaveform(waveform));
+	this->Respond(id, rs);
 	return Response::Success(tag);
 }
 
-Response Player::SetPlaying(Response::Tag tag, bool playing)
+std::optional<Response> Player::Probe(ClientId id, Response::Tag tag, const std::vector<std::string> &paths)
 {
 	if (this->dead) return PlayerDead(tag);
 
-	// Why is SetPlaying not split between Start() and Stop()?, I hear the
-	// best practices purists amongst you say.  Quite simply, there is a
-	// large amount of fiddly exception boilerplate here that would
-	// otherwise be duplicated between the two methods.
+	if (std::any_of(paths.begin(), paths.end(), [](const std::string &path) { return path.empty(); })) {
+		return Response::Invalid(tag, MSG_LOAD_EMPTY_PATH);
+	}
 
-	assert(this->file != nullptr);
+	if (!this->background) {
+		std::vector<Probed> probed;
+		probed.reserve(paths.size());
+		for (const auto &path : paths) probed.push_back(this->ProbeFile(path));
+		return this->SendProbes(id, tag, paths, probed);
+	}
 
+	// The runner gets every file at once, so they open in parallel.
+	auto batch = std::make_shared<ProbeBatch>(ProbeBatch{std::string{tag}, paths, {}, paths.size()});
+	batch->probed.resize(paths.size());
+	for (std::size_t i = 0; i < paths.size(); i++) this->ProbeInBackground(id, batch, i);
+	return std::nullopt;
+}
+
+Player::Probed Player::ProbeFile(const std::string &path) const
+{
+	// This skips OpenSource(), which could decode the whole file into the
+	// RAM cache, and reports the file as it is before resampling.  Nor do
+	// we start the source's scans, as we only need what opening found out.
+	Probed probed;
 	try {
-		this->file->SetPlaying(playing);
-	} catch (NullAudioError &e) {
-		return Response::Invalid(tag, e.Message());
+		const auto source = this->InspectSource(path);
+		probed.length = source->MicrosFromSamples(source->Length());
+		probed.rate = source->SampleRate();
+		probed.channels = source->ChannelCount();
+		probed.format = source->OutputSampleFormat();
+	} catch (Error &e) {
+		// Whatever went wrong, it went wrong for this file only; and this
+		// may be running in a coroutine, which mustn't throw.
+		probed.failure = std::string{e.Message()};
 	}
+	return probed;
+}
 
-	this->DumpState(BROADCAST, Response::NOREQUEST);
+Coro::Task Player::ProbeInBackground(ClientId id, std::shared_ptr<ProbeBatch> batch, std::size_t index)
+{
+	Coro::InBackground<Probed> probing{this->background,
+	                                   [this, path = batch->paths[index]] { return this->ProbeFile(path); }};
+	auto probed = co_await probing;
 
-	// It can be helpful to know precisely where the player changed its
-	// playing state, and it doesn't really harm us if we're overly chatty
-	// in announcing it.
-	this->BroadcastPos(Response::NOREQUEST, this->file->Position());
+	// If we're closing, nobody is listening for the result.
+	if (this->dead) co_return;
 
-	return Response::Success(tag);
+	// The files finish in any order, but only ever on our thread.
+	batch->probed[index] = std::move(probed);
+	if (--batch->pending != 0) co_return;
+	this->Complete(id, this->SendProbes(id, batch->tag, batch->paths, batch->probed));
+}
+
+Response Player::SendProbes(ClientId id, Response::Tag tag, const std::vector<std::string> &paths,
+                            const std::vector<Probed> &probed) const
+{
+	Expects(paths.size() == probed.size());
+
+	std::optional<std::size_t> first_failure;
+	for (std::size_t i = 0; i < paths.size(); i++) {
+		const auto &file = probed[i];
+		if (!file.failure.empty()) {
+			if (!first_failure) first_failure = i;
+			continue;
+		}
+
+		Response rs{tag, Response::Code::PROBE};
+		rs.AddArg(paths[i]).AddArg(file.length.count()).AddArg(file.rate).AddArg(file.channels);
+		rs.AddArg(Audio::sample_format_names[static_cast<std::size_t>(file.format)]);
+		this->Respond(id, rs);
+	}
+
+	if (!first_failure) return Response::Success(tag);
+	return Response::Failure(tag, paths[*first_failure] + ": " + probed[*first_failure].failure);
 }
 
 Response Player::Quit(Response::Tag tag)
@@ -235,10 +1362,58 @@ Response Player::Quit(Response::Tag tag)
 	if (this->dead) return PlayerDead(tag);
 
 	this->Eject(tag);
+	this->cued = nullptr;
+	this->queue.clear();
 	this->dead = true;
 	return Response::Success(tag);
 }
 
+Response Player::Stats(ClientId id, Response::Tag tag) const
+{
+	if (this->dead) return PlayerDead(tag);
+
+	const auto stats = this->AudioStats();
+	if (!stats) return Response::Invalid(tag, MSG_STATS_UNAVAILABLE);
+
+	Response rs{tag, Response::Code::STATS};
+	rs.AddArg("callbacks").AddArg(stats->callbacks);
+	rs.AddArg("underruns").AddArg(stats->underruns);
+	rs.AddArg("silent-bytes").AddArg(stats->silent_bytes);
+
+	const auto add_summary = [&rs](std::string_view name, const Audio::Histogram::Summary &summary) {
+		const std::string prefix{name};
+		rs.AddArg(prefix + "-p50").AddArg(summary.p50);
+		rs.AddArg(prefix + "-p99").AddArg(summary.p99);
+		rs.AddArg(prefix + "-max").AddArg(summary.max);
+	};
+	add_summary("jitter-us", stats->jitter);
+	add_summary("exec-us", stats->exec);
+	add_summary("fill-pct", stats->fill);
+	if (stats->start_latency) rs.AddArg("start-us").AddArg(static_cast<std::uint64_t>(stats->start_latency->count()));
+
+	if (const auto stream = this->file->Streaming()) {
+		rs.AddArg("stream-requests").AddArg(stream->requests);
+		rs.AddArg("stream-underruns").AddArg(stream->underruns);
+		rs.AddArg("stream-stall-us").AddArg(stream->stall_us);
+		rs.AddArg("stream-buffered-bytes").AddArg(stream->buffered_bytes);
+	}
+
+	const auto memory = this->Memory();
+	rs.AddArg("buffer-bytes").AddArg(memory.buffers);
+	rs.AddArg("scratch-bytes").AddArg(memory.scratch);
+	rs.AddArg("ram-cache-bytes").AddArg(this->RamCacheBytes());
+	rs.AddArg("skipped-frames").AddArg(this->file->SkippedFrames());
+
+	const auto conversions = this->file->Conversions();
+	std::string path;
+	for (const auto &step : conversions) path += (path.empty() ? "" : ",") + step;
+	rs.AddArg("conversions").AddArg(conversions.size());
+	rs.AddArg("conversion-path").AddArg(path.empty() ? "none" : path);
+
+	this->Respond(id, rs);
+	return Response::Success(tag);
+}
+
 //
 // Command implementations
 //
@@ -276,6 +1451,7 @@ void Player::PosRaw(Response::Tag tag, std::chrono::microseconds pos)
 	Expects(this->file != nullptr);
 
 	this->file->SetPosition(pos);
+	this->CancelAdvance();
 	this->BroadcastPos(tag, pos);
 }
 
@@ -288,6 +1464,10 @@ void Player::DumpState(ClientId id, Response::Tag tag) const
 
 Response::Code Player::StateResponseCode() const
 {
+	// A pre-rolling file isn't heard yet, so hasn't started as far as
+	// anyone else is concerned.
+	if (this->pre_roll_state != PreRoll::NONE) return Response::Code::STOP;
+
 	switch (file->CurrentState()) {
 		case Audio::Audio::State::AT_END:
 			return Response::Code::END;
@@ -301,52 +1481,472 @@ Response::Code Player::StateResponseCode() const
 	return Response::Code::EJECT;
 }
 
+void Player::PublishSnapshot() const
+{
+	if (this->snapshot == nullptr || this->standing_by) return;
+
+	StateSnapshot::State state{this->StateResponseCode(), std::chrono::microseconds{0}, {}, {}, {}, {}};
+	if (this->file->CurrentState() != Audio::Audio::State::NONE) {
+		state.position = this->file->Position();
+		state.file = this->file->File();
+	}
+	if (this->cued != nullptr) state.cued = this->cued->File();
+	state.queue.reserve(this->queue.size());
+	for (const auto &item : this->queue) state.queue.push_back(StateSnapshot::QueuedFile{item.path, item.overlap});
+	this->snapshot->Publish(state);
+}
+
+void Player::FollowSnapshot()
+{
+	// Fast starts can't open files until the audio systems are up.
+	if (!this->ready) return;
+
+	// Until an owner has published, there's nothing to take over; after
+	// that, its lock only comes free when it dies.
+	const auto state = this->snapshot->Read();
+	if (!state) return;
+	if (this->snapshot->TryOwn()) {
+		this->TakeOver(*state);
+		return;
+	}
+
+	this->FollowFiles(*state);
+
+	// Seeking whenever the owner moves on would keep the file flushing;
+	// within the slack, takeover's own seek stays short.
+	if (this->file->CurrentState() == Audio::Audio::State::NONE) return;
+	const auto at = StateSnapshot::PositionNow(*state);
+	const auto drift = at < this->file->Position() ? this->file->Position() - at : at - this->file->Position();
+	if (drift <= FOLLOW_SLACK) return;
+	try {
+		this->file->SetPosition(at);
+	} catch (SeekError &) {
+		// The owner is probably at the very end, which is no loss.
+	}
+}
+
+void Player::FollowFiles(const StateSnapshot::State &state)
+{
+	if (state.file != this->followed_file) {
+		this->followed_file = state.file;
+
+		// Taking and moving on in the owner can do the same here, with the
+		// files we already opened.
+		if (state.file.empty()) {
+			this->Eject(Response::NOREQUEST);
+		} else if (this->cued != nullptr && this->followed_cue == state.file) {
+			std::ignore = this->Take(Response::NOREQUEST);
+			this->followed_cue.clear();
+		} else if (!this->queue.empty() && this->queue.front().path == state.file) {
+			this->Advance(false, false);
+		} else {
+			std::ignore = this->Load(Response::NOREQUEST, state.file);
+		}
+	}
+
+	if (state.cued != this->followed_cue) {
+		this->followed_cue = state.cued;
+		if (state.cued.empty()) {
+			this->cued = nullptr;
+			this->cue_generation++;
+		} else {
+			std::ignore = this->Cue(Response::NOREQUEST, state.cued);
+		}
+	}
+
+	this->FollowQueue(state.queue);
+}
+
+void Player::FollowQueue(const std::vector<StateSnapshot::QueuedFile> &queued)
+{
+	// Whatever the two queues agree on at the front stays, preloaded.
+	std::size_t kept = 0;
+	while (kept < this->queue.size() && kept < queued.size() && this->queue[kept].path == queued[kept].path &&
+	       this->queue[kept].overlap == queued[kept].overlap) {
+		kept++;
+	}
+	if (kept == this->queue.size() && kept == queued.size()) return;
+
+	if (kept == 0) this->CancelAdvance();
+	this->queue.erase(this->queue.begin() + static_cast<std::ptrdiff_t>(kept), this->queue.end());
+	for (auto it = queued.begin() + static_cast<std::ptrdiff_t>(kept); it != queued.end(); it++) {
+		this->queue.push_back(QueueItem{this->next_queue_key++, it->path, it->overlap, nullptr, false, false, 0});
+	}
+	this->BroadcastQueue();
+	this->PreloadQueue();
+}
+
+void Player::TakeOver(const StateSnapshot::State &state)
+{
+	this->standing_by = false;
+	Debug() << "taking over from a dead playd, at" << state.file << std::endl;
+
+	// The owner may have changed things since we last followed it.
+	this->FollowFiles(state);
+
+	if (this->file->CurrentState() != Audio::Audio::State::NONE) {
+		try {
+			this->PosRaw(Response::NOREQUEST, StateSnapshot::PositionNow(state));
+		} catch (SeekError &e) {
+			Debug() << "can't seek to where the dead playd was -" << e.Message() << std::endl;
+		}
+		if (state.state == Response::Code::PLAY) std::ignore = this->SetPlaying(Response::NOREQUEST, true);
+	}
+	this->Respond(BROADCAST, Response(Response::NOREQUEST, Response::Code::WARN).AddArg("took-over").AddArg("1"));
+
+	// Now that it's ours, keep it up to date for the next standby.
+	this->PublishSnapshot();
+}
+
+void Player::PublishPlayhead() const
+{
+	if (this->playhead == nullptr) return;
+
+	SharedPlayhead::Snapshot snapshot{this->StateResponseCode(), std::chrono::microseconds{0},
+	                                  std::chrono::microseconds{0}, this->load_generation, {}};
+	// Ejected players have no position or length to give.
+	if (this->file->CurrentState() != Audio::Audio::State::NONE) {
+		snapshot.position = this->file->Position();
+		snapshot.length = this->file->Length();
+	}
+	this->playhead->Publish(snapshot);
+}
+
 void Player::Respond(ClientId id, const Response &rs) const
 {
 	if (this->io != nullptr) this->io->Respond(id, rs);
 }
 
+void Player::Complete(ClientId id, const Response &rs) const
+{
+	if (this->io != nullptr) this->io->Complete(id, rs);
+}
+
 void Player::AnnounceTimestamp(Response::Code code, ClientId id, Response::Tag tag, std::chrono::microseconds ts) const
 {
-	this->Respond(id, Response(tag, code).AddArg(std::to_string(ts.count())));
+	this->Respond(id, Response(tag, code).AddArg(ts.count()));
+}
+
+void Player::AnnouncePosToBuckets(std::chrono::microseconds pos)
+{
+	// This costs one division per distinct period, however many clients
+	// there are; clients that want no updates aren't in any bucket.
+	std::optional<Response> rs;
+	for (auto &[period, bucket] : this->pos_buckets) {
+		const auto tick = pos / period;
+		if (tick <= bucket.last_tick) continue;
+		bucket.last_tick = tick;
+
+		if (!rs) rs.emplace(Response(Response::NOREQUEST, Response::Code::POS).AddArg(pos.count()));
+		if (this->io != nullptr) this->io->Multicast(bucket.clients, *rs);
+	}
 }
 
-bool Player::CanBroadcastPos(std::chrono::microseconds pos) const
+void Player::ResetPosBuckets(std::chrono::microseconds pos)
 {
-	// Because last_pos is counted in seconds, this condition becomes
-	// true whenever pos 'ticks over' to a different second from last_pos.
-	// The result is that we broadcast at most roughly once a second.
-	return this->last_pos < std::chrono::duration_cast<std::chrono::seconds>(pos);
+	for (auto &[period, bucket] : this->pos_buckets) bucket.last_tick = pos / period;
 }
 
 void Player::BroadcastPos(Response::Tag tag, std::chrono::microseconds pos)
 {
-	// This ensures we don't broadcast too often:
-	// see CanBroadcastPos.
-	this->last_pos = std::chrono::duration_cast<std::chrono::seconds>(pos);
+	// This ensures we don't send regular updates too soon after this.
+	this->ResetPosBuckets(pos);
 	this->AnnounceTimestamp(Response::Code::POS, BROADCAST, tag, pos);
 }
 
+void Player::SetPosPeriod(ClientId id, std::chrono::milliseconds period)
+{
+	auto &old_period = this->pos_periods[id];
+	if (old_period == period) return;
+
+	if (old_period != std::chrono::milliseconds{0}) {
+		auto bucket = this->pos_buckets.find(old_period);
+		assert(bucket != this->pos_buckets.end());
+
+		auto &clients = bucket->second.clients;
+		clients.erase(std::remove(clients.begin(), clients.end(), id), clients.end());
+		if (clients.empty()) this->pos_buckets.erase(bucket);
+	}
+
+	old_period = period;
+	if (period == std::chrono::milliseconds{0}) return;
+
+	// New buckets start counting from where we are now, so they don't all
+	// fire at once.
+	auto [bucket, added] = this->pos_buckets.try_emplace(period);
+	if (added) {
+		const auto loaded = this->file->CurrentState() != Audio::Audio::State::NONE;
+		bucket->second.last_tick = loaded ? this->file->Position() / period : 0;
+	}
+	bucket->second.clients.push_back(id);
+}
+
+void Player::BroadcastStatsIfDue()
+{
+	const auto now = this->clock->Now();
+	if (now - this->last_stats < STATS_PERIOD) return;
+	this->last_stats = now;
+
+	// Outputs that keep no statistics just don't get broadcasts.
+	std::ignore = this->Stats(BROADCAST, Response::NOREQUEST);
+}
+
+void Player::ContinuePreRoll()
+{
+	if (this->pre_roll_state == PreRoll::FILLING && this->file->PreRolled(this->pre_roll)) {
+		try {
+			this->file->SetPlaying(true);
+		} catch (Error &e) {
+			// As far as anyone knows, the file never started.
+			Debug() << "can't start pre-rolled file:" << e.Message() << std::endl;
+			this->pre_roll_state = PreRoll::NONE;
+			return;
+		}
+		this->pre_roll_state = PreRoll::STARTING;
+	}
+	if (this->pre_roll_state != PreRoll::STARTING || !this->file->Sounding()) return;
+
+	// As with an unrolled play, announce where the file started.
+	this->pre_roll_state = PreRoll::NONE;
+	this->DumpState(BROADCAST, Response::NOREQUEST);
+	this->BroadcastPos(Response::NOREQUEST, this->file->Position());
+}
+
+void Player::WarnOfSkippedFrames()
+{
+	// A burst of damage between updates gets one warning.
+	const auto skipped = this->file->SkippedFrames();
+	if (skipped <= this->warned_skips) return;
+	this->warned_skips = skipped;
+
+	Response rs{Response::NOREQUEST, Response::Code::WARN};
+	this->Respond(BROADCAST, rs.AddArg("skipped-frames").AddArg(skipped));
+}
+
+std::optional<Response> Player::LoudnessResponse(Response::Tag tag) const
+{
+	const auto reading = this->file->Loudness();
+	if (!reading) return std::nullopt;
+
+	Response rs{tag, Response::Code::LOUD};
+	const auto add = [&rs](std::string_view name, double value) {
+		if (value == Audio::LoudnessMeter::SILENCE) return;
+		rs.AddArg(name).AddArg(std::llround(value * 1000.0));
+	};
+	add("momentary-mlufs", reading->momentary);
+	add("short-term-mlufs", reading->short_term);
+	add("integrated-mlufs", reading->integrated);
+	add("true-peak-mdbtp", reading->true_peak);
+	return rs;
+}
+
+void Player::AnnounceLoudnessIfDue(bool all)
+{
+	if (this->loud_subscriptions.empty() || this->io == nullptr) return;
+
+	const auto now = this->clock->Now();
+	std::vector<ClientId> due;
+	for (auto &[id, sub] : this->loud_subscriptions) {
+		if (!all && now < sub.next) continue;
+		sub.next = now + sub.period;
+		due.push_back(id);
+	}
+	if (due.empty()) return;
+
+	if (const auto rs = this->LoudnessResponse(Response::NOREQUEST)) this->io->Multicast(due, *rs);
+}
+
+void Player::SendTapped()
+{
+	if (this->tap_clients.empty() || this->io == nullptr) return;
+
+	// The chunk is copied once, into the response; Multicast then packs
+	// that once per protocol, and every client shares the packed copy.
+	this->tap->Drain([this](const Audio::PcmTap::Chunk &chunk) {
+		const std::string_view samples{reinterpret_cast<const char *>(chunk.samples.data()), chunk.samples.size()};
+
+		Response rs{Response::NOREQUEST, Response::Code::TAP};
+		rs.AddArg(Audio::sample_format_names[static_cast<std::size_t>(chunk.format)]);
+		rs.AddArg(chunk.channels).AddArg(chunk.rate).AddBytes(samples);
+		this->io->Multicast(this->tap_clients, rs);
+	});
+}
+
+void Player::Untap(ClientId id)
+{
+	const auto it = std::find(this->tap_clients.begin(), this->tap_clients.end(), id);
+	if (it == this->tap_clients.end()) return;
+
+	this->tap_clients.erase(it);
+	if (this->tap_clients.empty()) this->tap->SetListening(false);
+}
+
+void Player::PassTap(Audio::Audio *old_file)
+{
+	if (this->tap == nullptr) return;
+	if (old_file != nullptr) old_file->SetTap(nullptr);
+	this->file->SetTap(this->tap);
+}
+
 std::unique_ptr<Audio::Audio> Player::LoadRaw(std::string_view path) const
 {
+	return this->MakeAudio(this->OpenSource(path));
+}
+
+std::unique_ptr<Audio::Source> Player::OpenSource(std::string_view path) const
+{
+	const std::string spath{path};
+	std::optional<Audio::PcmCache::Key> key;
+	if (this->ram_cache != nullptr) {
+		auto clip = this->ram_cache->Find(spath);
+		if (clip) return this->TrimSource(std::make_unique<Audio::RamSource>(std::move(clip)));
+		key = this->ram_cache->Admits(spath);
+	}
+
 	auto source = this->LoadSource(path);
 	assert(source != nullptr);
 
+	// Remixing goes on whichever side of resampling has fewer channels.
+	const auto remix = this->output_channels != 0 && source->ChannelCount() != this->output_channels;
+	const auto remix_first = remix && this->output_channels < source->ChannelCount();
+	if (remix_first) source = std::make_unique<Audio::RemixedSource>(std::move(source), this->output_channels);
+	if (this->output_rate != 0 && source->SampleRate() != this->output_rate) {
+		source = std::make_unique<Audio::ResampledSource>(std::move(source), this->output_rate,
+		                                                  this->resample_quality);
+	}
+	if (remix && !remix_first) {
+		source = std::make_unique<Audio::RemixedSource>(std::move(source), this->output_channels);
+	}
+	if (!key) return this->TrimSource(std::move(source));
+
+	// The clip is cached after resampling, so that loading it again is
+	// nothing but a copy.  It's cached whole, so that trimming it at
+	// another threshold later needn't load it again.
+	auto clip = Audio::RamSource::DecodeAll(*source);
+	this->ram_cache->Store(*key, clip);
+	return this->TrimSource(std::make_unique<Audio::RamSource>(std::move(clip)));
+}
+
+std::unique_ptr<Audio::Source> Player::OpenQueued(std::string_view path, std::chrono::microseconds overlap,
+                                                  std::string_view from, std::chrono::microseconds at,
+                                                  bool &crossfades) const
+{
+	auto source = this->OpenSource(path);
+	if (from.empty()) return source;
+
+	auto tail = this->OpenSource(from);
+	if (!Audio::CrossfadeSource::CanMix(*tail, *source)) {
+		Debug() << "can't crossfade" << from << "into" << path << "- their rates or channels differ" << std::endl;
+		return source;
+	}
+	crossfades = true;
+	return std::make_unique<Audio::CrossfadeSource>(std::move(source), std::move(tail), at, overlap);
+}
+
+std::unique_ptr<Audio::Source> Player::TrimSource(std::unique_ptr<Audio::Source> source) const
+{
+	// Live streams have no end to find, and no start worth scanning.
+	if (!this->trim_db || source->Length() == 0) return source;
+
+	const std::string path{source->Path()};
+	auto cues = this->cues != nullptr ? this->cues->Find(path, *this->trim_db) : std::nullopt;
+	if (!cues) {
+		cues = Audio::FindCuePoints(*source, *this->trim_db);
+		if (this->cues != nullptr) this->cues->Store(path, *this->trim_db, *cues);
+	}
+
+	// Files with nothing to trim play as they are.
+	const auto length = source->MicrosFromSamples(source->Length());
+	if (cues->in.count() == 0 && length <= cues->out) {
+		source->Seek(0);
+		return source;
+	}
+	return std::make_unique<Audio::TrimmedSource>(std::move(source), *cues);
+}
+
+std::unique_ptr<Audio::Audio> Player::MakeAudio(std::unique_ptr<Audio::Source> source) const
+{
+	// The sink stays on the player's thread: making one can reopen the
+	// output device, which the playing file's sink may be using.
 	auto sink = this->sink(*source, this->device_id);
-	return std::make_unique<Audio::BasicAudio>(std::move(source), std::move(sink));
+	auto audio = std::make_unique<Audio::BasicAudio>(std::move(source), std::move(sink));
+	if (this->meter_loudness) audio->EnableLoudnessMeter();
+	if (this->wake) audio->SetWakeHandler(this->wake);
+	if (this->scheduler != nullptr) {
+		// The workers can't tell anyone about state changes otherwise.
+		Expects(this->wake);
+		audio->StartWorker(*this->scheduler, this->wake);
+	}
+	return audio;
 }
 
 std::unique_ptr<Audio::Source> Player::LoadSource(std::string_view path) const
 {
-	size_t extpoint = path.find_last_of('.');
-	auto ext = std::string{path.substr(extpoint + 1)};
+	auto source = this->InspectSource(path);
+	source->StartScans();
+	return source;
+}
+
+std::unique_ptr<Audio::Source> Player::InspectSource(std::string_view path) const
+{
+	const auto decoder = FindDecoder(this->decoders, path);
+	if (decoder == nullptr) throw FileError("Unknown file format: " + std::string{path});
+
+	auto source = decoder->open(path);
+
+	// This has to come before the cache, which only matches entries in the
+	// format the source ends up decoding in.
+	if (const auto format = this->DecodeFormat(*source)) source->PreferFormat(*format);
+	if (this->cache != nullptr) source->UseCache(*this->cache);
+	return source;
+}
+
+std::optional<Audio::SampleFormat> Player::DecodeFormat(const Audio::Source &source) const
+{
+	if (!this->sink_format) return std::nullopt;
+
+	const auto remix = this->output_channels != 0 && source.ChannelCount() != this->output_channels;
+	const auto resample = this->output_rate != 0 && source.SampleRate() != this->output_rate;
+	return remix || resample ? Audio::SampleFormat::FLOAT32 : *this->sink_format;
+}
+
+/* static */ const Player::Decoder *Player::FindDecoder(const std::vector<Decoder> &decoders, std::string_view path)
+{
+	if (const auto colon = path.find("://"); colon != std::string_view::npos) {
+		const auto scheme = path.substr(0, colon);
+		for (const auto &decoder : decoders) {
+			const auto &schemes = decoder.schemes;
+			if (std::find(schemes.begin(), schemes.end(), scheme) != schemes.end()) return &decoder;
+		}
+		return nullptr;
+	}
 
-	auto ibuilder = this->sources.find(ext);
-	if (ibuilder == this->sources.end()) {
-		throw FileError("Unknown file format: " + ext);
+	const auto has_probe = [](const Decoder &decoder) { return static_cast<bool>(decoder.probe); };
+	if (std::any_of(decoders.begin(), decoders.end(), has_probe)) {
+		std::array<std::byte, PROBE_BYTES> head{};
+		std::optional<gsl::span<const std::byte>> read;
+		try {
+			Audio::MappedFile file{std::string{path}};
+			read = gsl::span<const std::byte>{head}.first(file.Read(head));
+		} catch (const FileError &) {
+			// Fall through to the extension, and let the decoder report it.
+		}
+
+		if (read) {
+			for (const auto &decoder : decoders) {
+				if (decoder.probe && decoder.probe(*read)) return &decoder;
+			}
+		}
 	}
 
-	return (ibuilder->second)(path);
+	const auto extpoint = path.find_last_of('.');
+	if (extpoint == std::string_view::npos) return nullptr;
+	const auto ext = path.substr(extpoint + 1);
+	for (const auto &decoder : decoders) {
+		const auto &exts = decoder.extensions;
+		if (std::find(exts.begin(), exts.end(), ext) != exts.end()) return &decoder;
+	}
+	return nullptr;
 }
 
 } // namespace Playd
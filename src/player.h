@@ -11,18 +11,34 @@
 #define PLAYD_PLAYER_H
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "audio/audio.h"
+#include "audio/decode_scheduler.h"
+#include "audio/metadata_cache.h"
+#include "audio/pcm_cache.h"
+#include "audio/pcm_tap.h"
+#include "audio/resampler.h"
+#include "audio/sample_format.h"
+#include "audio/silence.h"
 #include "audio/sink.h"
 #include "audio/source.h"
+#include "audio/waveform.h"
+#include "clock.h"
+#include "coro.h"
 #include "response.h"
+#include "shared_playhead.h"
+#include "state_snapshot.h"
 
 namespace Playd
 {
@@ -40,14 +56,56 @@ public:
 	/// Type for functions that construct sources.
 	using SourceFn = std::function<std::unique_ptr<Audio::Source>(std::string_view)>;
 
+	/// Type for functions that check whether the start of a file looks like
+	/// a decoder's format.
+	using ProbeFn = std::function<bool(gsl::span<const std::byte>)>;
+
+	/**
+	 * A decoder that sources can be built with, and how to pick it.
+	 *
+	 * Files go to the first decoder whose probe recognises them, whatever
+	 * their extension; only files no probe recognises go by extension.
+	 * URLs go by their scheme alone, as probing them would mean fetching
+	 * them twice.
+	 */
+	struct Decoder {
+		std::string name;                    ///< The decoder's name, for messages.
+		std::vector<std::string> extensions; ///< The extensions it is picked by.
+		ProbeFn probe;                       ///< The probe, or empty if it has none.
+		SourceFn open;                       ///< Builds a source for a file.
+		std::vector<std::string> schemes{};  ///< The URL schemes it is picked by.
+	};
+
+	/// How much of the start of a file probes get to look at, in bytes.
+	static constexpr std::size_t PROBE_BYTES = 4096;
+
+	/// How often the player wants updating while it plays, unless set otherwise.
+	static constexpr std::chrono::milliseconds DEFAULT_UPDATE_PERIOD{5};
+
+	/// The longest time between updates that can be set.
+	static constexpr std::chrono::milliseconds MAX_UPDATE_PERIOD{1000};
+
+	/**
+	 * Type for functions that run work in the background.
+	 * The first function is the work, which may run on any thread; the
+	 * second is called on the player's thread once the work is done.
+	 */
+	using BackgroundFn = std::function<void(std::function<void()>, std::function<void()>)>;
+
+	/**
+	 * Type for commands held back until the player is ready.
+	 * They return their final response, or nothing if they respond later
+	 * by themselves.
+	 */
+	using HeldFn = std::function<std::optional<Response>()>;
+
 	/**
 	 * Constructs a Player.
 	 * @param device_id The device ID to which sinks shall output.
 	 * @param sink The function to be used for building sinks.
-	 * @param sources The map of file extensions to functions used for
-	 * building sources.
+	 * @param decoders The decoders used for building sources.
 	 */
-	Player(int device_id, SinkFn sink, std::map<std::string, SourceFn> sources);
+	Player(int device_id, SinkFn sink, std::vector<Decoder> decoders);
 
 	/// Deleted copy constructor.
 	Player(const Player &) = delete;
@@ -55,6 +113,22 @@ public:
 	/// Deleted copy-assignment constructor.
 	Player &operator=(const Player &) = delete;
 
+	/**
+	 * Picks the decoder for a file.
+	 *
+	 * URLs ('scheme://...') go to the first decoder taking their scheme,
+	 * or to none.  Otherwise, if any decoder has a probe, the first
+	 * PROBE_BYTES of the file are read once, through a MappedFile, and
+	 * shown to each probe in turn; failing that (or if the file can't be
+	 * read, which the decoder can then complain about), the file's
+	 * extension decides.
+	 *
+	 * @param decoders The decoders to pick from.
+	 * @param path The path to the file.
+	 * @return The decoder, or nullptr if none will take the file.
+	 */
+	static const Decoder *FindDecoder(const std::vector<Decoder> &decoders, std::string_view path);
+
 	/**
 	 * Sets the response sink to which this Player shall send responses.
 	 * This sink shall be the target for WelcomeClient, as well as
@@ -63,6 +137,255 @@ public:
 	 */
 	void SetIo(const ResponseSink &io);
 
+	/**
+	 * Sets the clock by which this Player times its broadcasts and
+	 * schedules; it starts out on Clock::Steady().
+	 * Tests and benchmarks use a SimClock here, with sinks on the same
+	 * clock, to play for hours in moments.
+	 * @param clock The clock, which must outlive the Player.
+	 * @see Audio::SimSink
+	 */
+	void UseClock(const Clock &clock);
+
+	/**
+	 * Sets the function each file loaded from now on calls when it wants
+	 * an Update(): for example, when its sink needs a refill.
+	 * @param wake The function to call.  This must be safe to call from
+	 *   any thread.
+	 */
+	void SetWakeHandler(std::function<void()> wake);
+
+	/**
+	 * Sets the function used to open files in the background.
+	 * Until this is set, LoadInBackground() and CueInBackground() open
+	 * files there and then.
+	 * @param background The function to use.
+	 */
+	void SetBackgroundRunner(BackgroundFn background);
+
+	/**
+	 * Holds back commands that need the audio systems, until MarkReady().
+	 *
+	 * This lets playd answer clients while those systems are still
+	 * starting up.  Held commands run in the order they came, so a 'play'
+	 * after an 'fload' still plays the file.
+	 * @see WhenReady
+	 */
+	void HoldUntilReady();
+
+	/**
+	 * Runs the commands held back since HoldUntilReady(), and stops
+	 * holding any more.  Each sends its final response to the client that
+	 * sent it.
+	 */
+	void MarkReady();
+
+	/**
+	 * Runs a command that needs the audio systems, or holds it back until
+	 * they're ready.
+	 * @param id The ID of the client sending the command.
+	 * @param command The command, which must own anything it refers to.
+	 * @return The command's final response, or nothing if it was held (or
+	 *   responds later by itself).
+	 * @see HoldUntilReady
+	 */
+	std::optional<Response> WhenReady(ClientId id, HeldFn command);
+
+	/**
+	 * Makes each file loaded from now on decode on a scheduler's threads.
+	 * The decoding threads use the wake handler to ask for an Update()
+	 * when the audio changes state.
+	 * @param scheduler The scheduler, which other players may share.
+	 * @see SetWakeHandler
+	 * @see Audio::DecodeScheduler
+	 */
+	void EnableDecodeThreads(std::shared_ptr<Audio::DecodeScheduler> scheduler);
+
+	/**
+	 * Makes each file loaded from now on reach its sink at a fixed rate.
+	 * Files at any other rate are resampled on the way, so that the output
+	 * device never has to change rate between files.
+	 * @param rate The rate at which sinks receive audio, in Hz.
+	 * @param quality The resampling quality/CPU trade-off to make.
+	 */
+	void EnableResampling(std::uint32_t rate, Audio::Resampler::Quality quality);
+
+	/**
+	 * Makes each file loaded from now on reach its sink in a fixed number
+	 * of channels.
+	 * Files with any other number are remixed on the way (see
+	 * Audio::ChannelMatrix), so that the output device never has to change
+	 * layout between files.
+	 * @param channels The number of channels sinks receive.
+	 */
+	void EnableRemixing(std::uint8_t channels);
+
+	/**
+	 * Makes each file loaded from now on decode straight into the sample
+	 * format its sink wants, where its decoder can do so without loss.
+	 * Files that are to be resampled or remixed decode into FLOAT32 instead,
+	 * as that is what both work in.  Either way, the conversion that would
+	 * otherwise happen later happens inside the decoder, which can often
+	 * skip it altogether (mpg123, for one, synthesises in float).
+	 * @param format The sample format the sinks take.
+	 * @see Audio::Source::PreferFormat
+	 */
+	void EnableFormatNegotiation(Audio::SampleFormat format);
+
+	/**
+	 * Makes each file loaded from now on use a metadata cache.
+	 * Sources that have to scan their files to find out their lengths
+	 * and seek points keep what they find out there, so that loading the
+	 * same file again doesn't need another scan.
+	 * @param cache The cache, which other players may share.
+	 * @see Audio::MetadataCache
+	 */
+	void EnableMetadataCache(std::shared_ptr<Audio::MetadataCache> cache);
+
+	/**
+	 * Makes small files loaded from now on stay decoded in memory.
+	 * Loading a file again while it's still cached skips opening and
+	 * decoding it, which matters for short files fired over and over.
+	 * @param cache The cache, which other players may share.
+	 * @see Audio::PcmCache
+	 */
+	void EnableRamCache(std::shared_ptr<Audio::PcmCache> cache);
+
+	/**
+	 * Makes each file loaded from now on meter its loudness as it decodes.
+	 * Until this is called, Loudness() and LoudRate() fail.
+	 * @see Audio::LoudnessMeter
+	 */
+	void EnableLoudnessMeters();
+
+	/**
+	 * Makes waveform overviews outlive the player.
+	 * Each overview asked for with Waveform() is kept there, and asking
+	 * for it again (of the same file and resolution) skips working it out.
+	 * @param cache The cache, which other players may share.
+	 * @see Audio::WaveformCache
+	 */
+	void EnableWaveformCache(std::shared_ptr<Audio::WaveformCache> cache);
+
+	/**
+	 * Makes each file loaded from now on skip its leading and trailing
+	 * silence.
+	 *
+	 * Files play from their first audible sample, and end at their last;
+	 * positions and lengths are counted from the first, and the dump says
+	 * where in the file the two were found.  Finding them decodes a little
+	 * of each end of the file as it opens, unless the cue cache already
+	 * knows them.
+	 *
+	 * @param threshold_db The level, in dBFS, above which samples count as
+	 *   audible.
+	 * @param cache The cue cache, if any, which other players may share.
+	 * @see Audio::FindCuePoints
+	 * @see Audio::CueCache
+	 */
+	void EnableTrimming(double threshold_db, std::shared_ptr<Audio::CueCache> cache);
+
+	/**
+	 * Makes `play` wait for the loaded file to buffer some audio first.
+	 *
+	 * Until the file's sink holds @a amount of audio (or all it can, or
+	 * all the file has left), playing is put off, and the player counts as
+	 * stopped; then the sink starts, and PLAY is broadcast once the device
+	 * is hearing it.  Files that have been cued, or preloaded in the
+	 * queue, are usually buffered already, and so start straight away.
+	 * Scheduled starts (`play-at`) don't wait.
+	 *
+	 * @param amount How much audio to buffer; 0 turns pre-rolling off.
+	 */
+	void EnablePreRoll(std::chrono::milliseconds amount);
+
+	/**
+	 * Makes the buffer sizes of the player's sinks a setting, which `set`
+	 * can change, and dumps report.
+	 * @param policy The policy sizing the player's sinks.
+	 */
+	void EnableBufferTuning(std::shared_ptr<Audio::BufferPolicy> policy);
+
+	/**
+	 * Sets how often the player wants updating while it plays.
+	 * @param period The time between updates, from 1ms to MAX_UPDATE_PERIOD.
+	 */
+	void SetUpdatePeriod(std::chrono::milliseconds period);
+
+	/// @return How often the player wants updating while it plays.
+	[[nodiscard]] std::chrono::milliseconds UpdatePeriod() const;
+
+	/**
+	 * Adds a setting that only startup can change, for dumps to report.
+	 * `set` refuses to change it.
+	 * @param key The setting's name, which is its option's.
+	 * @param value The setting's value, as its option took it.
+	 */
+	void AddFixedSetting(std::string key, std::string value);
+
+	/**
+	 * Makes the player publish its state and position in shared memory,
+	 * from now on, each time it updates.
+	 * @param playhead The shared-memory snapshot to publish into.
+	 * @see SharedPlayhead
+	 */
+	void EnableSharedPlayhead(std::unique_ptr<SharedPlayhead> playhead);
+
+	/**
+	 * Makes the player publish a snapshot of its state, from now on, each
+	 * time it updates, for a standby to take over from.
+	 * @param snapshot The snapshot to publish into, which must be owned.
+	 * @see StateSnapshot
+	 */
+	void EnableSnapshot(std::unique_ptr<StateSnapshot> snapshot);
+
+	/**
+	 * Makes the player a standby for whichever playd owns a snapshot.
+	 *
+	 * Until the owner goes away, the player follows its snapshot: it loads,
+	 * cues and queues the same files, and keeps the loaded file seeked to
+	 * within FOLLOW_SLACK of the owner's position, but refuses to play.
+	 * Once the owner has gone (without withdrawing its snapshot), the player
+	 * takes the snapshot over: it seeks to where the owner had got to,
+	 * plays if the owner was playing, broadcasts `WARN took-over 1`, and
+	 * publishes snapshots of its own from then on.
+	 *
+	 * @param snapshot The snapshot to follow, which mustn't be owned yet.
+	 */
+	void StandBy(std::unique_ptr<StateSnapshot> snapshot);
+
+	/**
+	 * Whether the player is standing by to take over another's snapshot.
+	 * While it is, it needs regular updates to follow it.
+	 * @return True if standing by; false otherwise.
+	 */
+	[[nodiscard]] bool IsStandingBy() const;
+
+	/**
+	 * Whether the player is currently playing audio.
+	 * While it is, it needs regular updates to keep its position current.
+	 * @return True if audio is playing; false otherwise.
+	 */
+	[[nodiscard]] bool IsPlaying() const;
+
+	/**
+	 * @return The audio callback's statistics for the loaded file, or
+	 *   nothing if there is no file, or its sink doesn't keep any.
+	 */
+	[[nodiscard]] std::optional<Audio::CallbackStats::Snapshot> AudioStats() const;
+
+	/**
+	 * @return How much memory this player's files take up: the loaded
+	 *   file, and any cued or queued files opened ahead of time.
+	 */
+	[[nodiscard]] Audio::MemoryUse Memory() const;
+
+	/**
+	 * @return How much decoded audio the RAM cache holds, in bytes, or 0
+	 *   without one.  Every player shares the one cache.
+	 */
+	[[nodiscard]] std::size_t RamCacheBytes() const;
+
 	/**
 	 * Instructs the Player to perform a cycle of work.
 	 * This includes decoding the next frame and responding to commands.
@@ -70,6 +393,19 @@ public:
 	 */
 	bool Update();
 
+	/**
+	 * Tells the Player about a new client.
+	 * New clients get position updates every DEFAULT_POS_PERIOD.
+	 * @param id The ID of the client.
+	 */
+	void AddClient(ClientId id);
+
+	/**
+	 * Tells the Player that a client has gone away.
+	 * @param id The ID of the client.
+	 */
+	void RemoveClient(ClientId id);
+
 	//
 	// Commands
 	//
@@ -84,6 +420,27 @@ public:
 	 */
 	Response SetPlaying(Response::Tag tag, bool playing);
 
+	/**
+	 * Tells the audio file to start or stop playing at a given time.
+	 *
+	 * The time is in microseconds since the Unix epoch, on the system
+	 * clock; players on machines whose clocks are kept in step (by PTP or
+	 * NTP) can thus start or stop together, whatever the network latency.
+	 * The change happens at the sample heard at that time, not when the
+	 * command arrives; times already past take effect straight away.
+	 *
+	 * A scheduled start changes the state to playing at once, though
+	 * nothing is heard until the time comes.  A scheduled stop is
+	 * announced when it happens.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 * @param playing True if playing; false otherwise.
+	 * @param time_str A string containing the time, as above.
+	 * @return Whether the change was scheduled.
+	 * @see SetPlaying
+	 */
+	Response SetPlayingAt(Response::Tag tag, bool playing, std::string_view time_str);
+
 	/**
 	 * Dumps the current player state to the given ID.
 	 *
@@ -95,6 +452,21 @@ public:
 	 */
 	[[nodiscard]] Response Dump(ClientId id, Response::Tag tag) const;
 
+	/**
+	 * Changes one of the player's settings while it runs.
+	 *
+	 * The settings are `update-period` (integer milliseconds), `pre-roll`
+	 * (integer milliseconds, 0 for off) and, with EnableBufferTuning(),
+	 * `buffer` (MS or MIN-MAX milliseconds, for sinks made from now on).
+	 * The new value is broadcast as a SET response.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 * @param key The setting's name.
+	 * @param value The setting's new value.
+	 * @return Whether the setting changed.
+	 */
+	Response Set(Response::Tag tag, std::string_view key, std::string_view value);
+
 	/**
 	 * Ejects the current loaded song, if any.
 	 * @param tag The tag of the request calling this command.
@@ -120,6 +492,108 @@ public:
 	 */
 	Response Load(Response::Tag tag, std::string_view path);
 
+	/**
+	 * Loads a file, opening it in the background.
+	 *
+	 * The current file is ejected straight away, but the new file is
+	 * opened and probed by the background runner, so that a slow disk
+	 * doesn't hold up everything else.  The final response (and, on
+	 * success, the state dump) goes out once it is done.  Loading or
+	 * ejecting again in the meantime supersedes this load.
+	 *
+	 * @param id The ID of the client to send the final response to.
+	 * @param tag The tag of the request calling this command.
+	 * @param path The absolute path to a track to load.
+	 * @return The final response, if the load finished (or failed)
+	 *   straight away; otherwise, nothing.
+	 * @see SetBackgroundRunner
+	 */
+	std::optional<Response> LoadInBackground(ClientId id, Response::Tag tag, std::string_view path);
+
+	/**
+	 * Cues a file, ready to be swapped in by Take().
+	 *
+	 * This does all of the work of loading up front, including filling
+	 * the new file's sink, so that taking it is nearly instant.  Any
+	 * previously cued file is discarded.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 *   For unsolicited cues, use Response::NOREQUEST.
+	 * @param path The absolute path to a track to cue.
+	 * @return Whether the cue succeeded.
+	 */
+	Response Cue(Response::Tag tag, std::string_view path);
+
+	/**
+	 * Cues a file, opening it in the background.
+	 * This is to Cue() as LoadInBackground() is to Load(); cueing again
+	 * in the meantime supersedes this cue.
+	 * @param id The ID of the client to send the final response to.
+	 * @param tag The tag of the request calling this command.
+	 * @param path The absolute path to a track to cue.
+	 * @return The final response, if the cue finished (or failed)
+	 *   straight away; otherwise, nothing.
+	 */
+	std::optional<Response> CueInBackground(ClientId id, Response::Tag tag, std::string_view path);
+
+	/**
+	 * Swaps the cued file in as the loaded file.
+	 *
+	 * If the loaded file was playing, the cued file starts playing in its
+	 * place; otherwise, it is loaded stopped.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 *   For unsolicited takes, use Response::NOREQUEST.
+	 * @return Whether the take succeeded.
+	 */
+	Response Take(Response::Tag tag);
+
+	/**
+	 * Adds a file to the end of the queue.
+	 *
+	 * The first QUEUE_PRELOAD files in the queue are opened (with the
+	 * background runner, if any) and have their sinks filled ahead of
+	 * time, so that moving on to them is nearly instant.  Files that can't
+	 * be opened are dropped from the queue.  Each change to the queue is
+	 * broadcast as a QUEUE response.
+	 *
+	 * A file with an overlap crossfades in from the end of the file before
+	 * it, rather than following it; as the crossfade is mixed into the
+	 * file as it decodes, it is only opened once it reaches the front.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 * @param path The absolute path to a track to queue.
+	 * @param overlap_str A string containing how long the file overlaps
+	 *   the one before it, in milliseconds, up to MAX_OVERLAP; 0 follows
+	 *   on without a crossfade.
+	 * @return Whether the file was queued.
+	 * @see Next
+	 * @see Audio::CrossfadeSource
+	 */
+	Response Enqueue(Response::Tag tag, std::string_view path, std::string_view overlap_str = "0");
+
+	/**
+	 * Removes a file from the queue.
+	 * @param tag The tag of the request calling this command.
+	 * @param index_str A string containing the file's index in the queue,
+	 *   counting from 0 at the front.
+	 * @return Whether the file was removed.
+	 */
+	Response Dequeue(Response::Tag tag, std::string_view index_str);
+
+	/**
+	 * Moves on to the file at the front of the queue straight away.
+	 *
+	 * As with Take(), the new file starts playing if the loaded file was
+	 * playing.  Files also move on by themselves when the loaded file ends:
+	 * the front file's start is scheduled, in its sink, for the sample
+	 * after the loaded file's last, so that there's no gap between them.
+	 *
+	 * @param tag The tag of the request calling this command.
+	 * @return Whether the player moved on.
+	 */
+	Response Next(Response::Tag tag);
+
 	/**
 	 * Seeks to a given position in the current file.
 	 * @param tag The tag of the request calling this command.
@@ -129,6 +603,120 @@ public:
 	 */
 	Response Pos(Response::Tag tag, std::string_view pos_str);
 
+	/**
+	 * Fades the loaded file to another level.
+	 * The fade applies from the next sample decoded, and lasts until the
+	 * file is ejected; new files start at unity gain.
+	 * @param tag The tag of the request calling this command.
+	 * @param duration_str A string containing how long the fade takes, in
+	 *   milliseconds; 0 jumps straight to the new level.
+	 * @param db_str A string containing the level to fade to, in decibels:
+	 *   0 is unity, and -inf (or anything at or below the floor) is silence.
+	 * @param shape_str "log" to fade evenly in decibels, "linear" to fade
+	 *   evenly in amplitude, or "power" to fade evenly in power.
+	 * @return Whether the fade started.
+	 * @see Audio::Gain
+	 */
+	Response Fade(Response::Tag tag, std::string_view duration_str, std::string_view db_str,
+	              std::string_view shape_str = "log");
+
+	/**
+	 * Plays the loaded file faster or slower, without changing its pitch.
+	 * As with Fade(), this applies from the next sample decoded, and lasts
+	 * until the file is ejected; new files start at normal speed.
+	 * Positions and lengths stay in the file's own time.
+	 * @param tag The tag of the request calling this command.
+	 * @param speed_str A string containing how much faster than normal to
+	 *   play, from 0.5 to 2; 1 is normal.
+	 * @return Whether the speed changed.
+	 * @see Audio::TimeStretch
+	 */
+	Response Rate(Response::Tag tag, std::string_view speed_str);
+
+	/**
+	 * Sets how often a client gets position updates while a file plays.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request calling this command.
+	 * @param period_str A string containing the period between updates,
+	 *   in milliseconds; 0 means no regular updates at all.
+	 * @return Whether the change succeeded.
+	 */
+	Response PosRate(ClientId id, Response::Tag tag, std::string_view period_str);
+
+	/**
+	 * Sends the loaded file's loudness readings, as a LOUD response.
+	 *
+	 * The arguments are alternating names and values, in thousandths of
+	 * a LUFS (or dBTP): momentary, short-term and integrated loudness,
+	 * then true peak.  Readings of silence are left out.
+	 *
+	 * @param id The ID of the connection to which the Player should
+	 *   route any responses.  For broadcasts, use 0.
+	 * @param tag The tag of the request calling this command.
+	 *   For unsolicited readings, use Response::NOREQUEST.
+	 * @return Whether there were any readings to send.
+	 */
+	[[nodiscard]] Response Loudness(ClientId id, Response::Tag tag) const;
+
+	/**
+	 * Sets how often a client gets loudness readings while a file plays.
+	 * Clients getting readings also get a last one when a file ends.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request calling this command.
+	 * @param period_str A string containing the period between readings,
+	 *   in milliseconds; 0 means no readings at all.
+	 * @return Whether the change succeeded.
+	 */
+	Response LoudRate(ClientId id, Response::Tag tag, std::string_view period_str);
+
+	/**
+	 * Starts or stops sending a client the loaded file's audio, as TAP
+	 * responses, as it goes to the sink.
+	 * Each chunk is packed once for all of the clients tapping it, and
+	 * dropped for any client too far behind to take it.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request calling this command.
+	 * @param on_str `1` to start, or `0` to stop.
+	 * @return Whether the change succeeded.
+	 * @see Audio::PcmTap
+	 */
+	Response Tap(ClientId id, Response::Tag tag, std::string_view on_str);
+
+	/**
+	 * Sends a waveform overview of the loaded file, as a WAVE response.
+	 *
+	 * Working out an overview means decoding the whole file, which is done
+	 * with the background runner (if any), from sources of its own, so
+	 * playback carries on undisturbed; the WAVE and the final response come
+	 * once it's done.  Overviews in the waveform cache come back at once.
+	 *
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request calling this command.
+	 * @param buckets_str A string containing the number of buckets to cut
+	 *   the file into, up to Audio::MAX_WAVEFORM_BUCKETS.
+	 * @return The final response, or nothing if it will be sent later.
+	 */
+	std::optional<Response> Waveform(ClientId id, Response::Tag tag, std::string_view buckets_str);
+
+	/**
+	 * Sends the length, sample rate, channel count and sample format of
+	 * each of some files, as PROBE responses, without loading any of them.
+	 *
+	 * Each file gets a source of its own, which reads no more than its
+	 * headers (and the metadata cache, if any), so playback carries on
+	 * undisturbed.  With the background runner (if any), the files open all
+	 * at once, off the player's thread; either way, the PROBEs go together,
+	 * in the order the files were given, once every file has opened.
+	 *
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request calling this command.
+	 * @param paths The paths of the files.
+	 * @return The final response, or nothing if it will be sent later.  It
+	 *   fails, naming the first of them, if any files couldn't be opened;
+	 *   those get no PROBE.
+	 */
+	std::optional<Response> Probe(ClientId id, Response::Tag tag, const std::vector<std::string> &paths);
+
 	/**
 	 * Quits playd.
 	 * @param tag The tag of the request calling this command.
@@ -137,14 +725,191 @@ public:
 	 */
 	Response Quit(Response::Tag tag);
 
+	/**
+	 * Sends playback statistics for the loaded file's output.
+	 *
+	 * These are Response::Code::STATS responses, whose arguments are
+	 * alternating names and values: callback, underrun and silence
+	 * counts, then the 50th and 99th percentiles and maximum of callback
+	 * jitter, callback run time, and buffer fill.
+	 *
+	 * @param id The ID of the connection to which the Player should
+	 *   route any responses.  For broadcasts, use 0.
+	 * @param tag The tag of the request calling this command.
+	 *   For unsolicited statistics, use Response::NOREQUEST.
+	 * @return Whether there were any statistics to send.
+	 */
+	[[nodiscard]] Response Stats(ClientId id, Response::Tag tag) const;
+
 private:
+	/// How often the statistics are broadcast during playback.
+	static constexpr std::chrono::seconds STATS_PERIOD{10};
+
+	/// How often clients get position updates until they ask otherwise.
+	static constexpr std::chrono::milliseconds DEFAULT_POS_PERIOD{1000};
+
+	/// How far a pre-rolled `play` has got.
+	enum class PreRoll : std::uint8_t {
+		NONE,     ///< Nothing is waiting to play.
+		FILLING,  ///< Waiting for the sink to buffer enough.
+		STARTING, ///< The sink is started, but not yet heard.
+	};
+
+	/// A client wanting regular loudness readings.
+	struct LoudSubscription {
+		std::chrono::milliseconds period; ///< Time between readings.
+		Clock::TimePoint next;            ///< When the next is due.
+	};
+
+	/// How far a standby lets its loaded file's position drift from the
+	/// snapshot's before seeking it again.
+	static constexpr std::chrono::milliseconds FOLLOW_SLACK{1000};
+
+	/// How many files at the front of the queue are opened ahead of time.
+	static constexpr std::size_t QUEUE_PRELOAD = 2;
+
+	/// How long before the loaded file ends (or the next file's crossfade
+	/// starts) the next file's start is scheduled; this needs to be a good
+	/// few updates' worth.
+	static constexpr std::chrono::milliseconds ADVANCE_LEAD{500};
+
+	/// The longest a queued file can overlap the one before it.
+	static constexpr std::chrono::seconds MAX_OVERLAP{30};
+
+	/// A file in the queue.
+	struct QueueItem {
+		std::uint64_t key;                   ///< Tells the item apart from others with its path.
+		std::string path;                    ///< The path it was queued from.
+		std::chrono::milliseconds overlap;   ///< How long it crossfades in over the file before.
+		std::unique_ptr<Audio::Audio> audio; ///< The file, once opened.
+		bool opening;                        ///< Whether it is opening in the background.
+		bool crossfades;                     ///< Whether audio has the file before's end mixed in.
+		std::uint64_t opened_for;            ///< The load_generation audio was opened under.
+	};
+
+	/// A group of clients wanting position updates at the same rate.
+	struct PosBucket {
+		std::vector<ClientId> clients; ///< The clients in the bucket.
+		std::int64_t last_tick;        ///< Position over period, when last sent.
+	};
+
 	int device_id;                           ///< The sink's device ID.
 	SinkFn sink;                             ///< The sink create function.
-	std::map<std::string, SourceFn> sources; ///< The file formats map.
+	std::vector<Decoder> decoders;           ///< The decoders, in probing order.
+
+	/// The metadata cache, if any; this must outlive file and cued.
+	std::shared_ptr<Audio::MetadataCache> cache;
+
+	/// The decoded audio cache, if any.
+	std::shared_ptr<Audio::PcmCache> ram_cache;
+
+	/// The waveform overview cache, if any.
+	std::shared_ptr<Audio::WaveformCache> waveforms;
+
+	/// The cue point cache, if any.
+	std::shared_ptr<Audio::CueCache> cues;
+
+	/// The level files are trimmed to, in dBFS, if they're trimmed.
+	std::optional<double> trim_db;
+
+	/// The decoding scheduler, if any; this must outlive file and cued.
+	std::shared_ptr<Audio::DecodeScheduler> scheduler;
+
 	std::unique_ptr<Audio::Audio> file;      ///< The loaded audio file.
+	std::unique_ptr<Audio::Audio> cued;      ///< The cued audio file, if any.
 	bool dead;                               ///< Whether the Player is closing.
 	const ResponseSink *io;                  ///< The sink for responses.
-	std::chrono::seconds last_pos;           ///< The last-sent position.
+
+	/// Clients wanting position updates, bucketed by update period.
+	std::map<std::chrono::milliseconds, PosBucket> pos_buckets;
+
+	/// The update period of each client, or 0 if it wants none.
+	std::map<ClientId, std::chrono::milliseconds> pos_periods;
+
+	/// The clock by which broadcasts and schedules are timed.
+	const Clock *clock;
+
+	/// When statistics were last broadcast.
+	Clock::TimePoint last_stats;
+
+	/// How many of the loaded file's skipped frames have been warned of.
+	std::uint64_t warned_skips;
+
+	/// The shared-memory snapshot to publish into, if any.
+	std::unique_ptr<SharedPlayhead> playhead;
+
+	/// The state snapshot to publish into (or follow, if standing by), if any.
+	std::unique_ptr<StateSnapshot> snapshot;
+
+	/// Whether the player is following snapshot, rather than publishing it.
+	bool standing_by;
+
+	/// The loaded and cued paths last followed from snapshot, while
+	/// standing by; these are what the owner had, even if opening failed.
+	std::string followed_file;
+	std::string followed_cue; ///< @see followed_file
+
+	/// Whether files are loudness-metered.
+	bool meter_loudness;
+
+	/// Clients wanting regular loudness readings.
+	std::map<ClientId, LoudSubscription> loud_subscriptions;
+
+	/// The tap on the loaded file, made when the first client asks for it.
+	std::shared_ptr<Audio::PcmTap> tap;
+
+	/// Clients wanting the tapped audio.
+	std::vector<ClientId> tap_clients;
+
+	std::function<void()> wake;              ///< Asks for an update, if set.
+	BackgroundFn background;                 ///< Runs loads, if set.
+	std::uint64_t load_generation;           ///< Bumped by each load/eject.
+	std::uint64_t cue_generation;            ///< Bumped by each cue.
+	std::uint32_t output_rate;               ///< Rate to resample to, or 0.
+	std::uint8_t output_channels;            ///< Channel count to remix to, or 0.
+
+	/// The sample format sinks take, if files are to decode straight into it.
+	std::optional<Audio::SampleFormat> sink_format;
+
+	/// The quality/CPU trade-off to make when resampling.
+	Audio::Resampler::Quality resample_quality;
+
+	/// Whether the loaded file has a scheduled stop yet to announce.
+	bool stop_scheduled;
+
+	/// The files to move on to, front first.
+	std::deque<QueueItem> queue;
+
+	/// The key the next queued file gets.
+	std::uint64_t next_queue_key;
+
+	/// Whether the front queued file's start is scheduled in its sink.
+	bool advance_scheduled;
+
+	/// Whether that start is a crossfade, and the loaded file's sink is
+	/// scheduled to stop when it happens.
+	bool crossfade_scheduled;
+
+	/// Whether commands needing the audio systems can run yet.
+	bool ready;
+
+	/// How much audio `play` waits to have buffered, or 0 not to wait.
+	std::chrono::milliseconds pre_roll;
+
+	/// How far the current pre-rolled `play`, if any, has got.
+	PreRoll pre_roll_state;
+
+	/// How often the player wants updating while it plays.
+	std::chrono::milliseconds update_period;
+
+	/// The policy sizing the player's sinks, if `set` can change it.
+	std::shared_ptr<Audio::BufferPolicy> buffer_policy;
+
+	/// The settings only startup can change, by name, in the order added.
+	std::vector<std::pair<std::string, std::string>> fixed_settings;
+
+	/// Commands waiting for the audio systems, and who sent them.
+	std::vector<std::pair<ClientId, HeldFn>> held;
 
 	/**
 	 * Parses pos_str as a seek timestamp.
@@ -195,11 +960,59 @@ private:
 	 */
 	void DumpFileInfo(ClientId id, Response::Tag tag) const;
 
+	/**
+	 * Dumps everything about what the player is playing, but not its
+	 * settings: the state, the file, and the cued and queued files.
+	 *
+	 * @param id The ID of the connection to which the Player should
+	 *   route any responses.  For broadcasts, use 0.
+	 * @param tag The tag of the request calling this command.
+	 *   For unsolicited dumps, use Response::NOREQUEST.
+	 */
+	void DumpPlayback(ClientId id, Response::Tag tag) const;
+
+	/**
+	 * Lists the player's settings, and their current values.
+	 * @return The settings, by name, changeable ones first.
+	 */
+	[[nodiscard]] std::vector<std::pair<std::string, std::string>> Settings() const;
+
 	/**
 	 * @return The player's current state as a response code.
 	 */
 	[[nodiscard]] Response::Code StateResponseCode() const;
 
+	/// Publishes the state, files and queue to the state snapshot, if any
+	/// (and this player owns it).
+	void PublishSnapshot() const;
+
+	/**
+	 * Follows the snapshot this player is standing by for, taking it over
+	 * if its owner has gone.
+	 */
+	void FollowSnapshot();
+
+	/**
+	 * Loads, cues and queues whatever a snapshot has that this player doesn't.
+	 * @param state The snapshot to follow.
+	 */
+	void FollowFiles(const StateSnapshot::State &state);
+
+	/**
+	 * Changes the queue to match a snapshot's.
+	 * @param queued The snapshot's queue.
+	 */
+	void FollowQueue(const std::vector<StateSnapshot::QueuedFile> &queued);
+
+	/**
+	 * Takes over from a snapshot's dead owner.
+	 * @param state The owner's last snapshot.
+	 */
+	void TakeOver(const StateSnapshot::State &state);
+
+	/// Publishes the state and position to the shared playhead, if any.
+	void PublishPlayhead() const;
+
 	/**
 	 * Outputs a response, if there is a ResponseSink attached.
 	 *
@@ -210,6 +1023,15 @@ private:
 	 */
 	void Respond(ClientId id, const Response &rs) const;
 
+	/**
+	 * Outputs the reply to a command that replied later, if there is a
+	 * ResponseSink attached.
+	 * @param id The ID of the client that sent the command.
+	 * @param rs The reply.
+	 * @see ResponseSink::Complete
+	 */
+	void Complete(ClientId id, const Response &rs) const;
+
 	/**
 	 * Sends a timestamp response.
 	 *
@@ -221,30 +1043,90 @@ private:
 	void AnnounceTimestamp(Response::Code code, ClientId id, Response::Tag tag, std::chrono::microseconds ts) const;
 
 	/**
-	 * Determines whether we can broadcast a POS response.
+	 * Sends regular POS responses to each bucket that is due one.
 	 *
-	 * To prevent spewing massive amounts of POS responses, we only send a
-	 * broadcast if the current position, truncated to the last second,
-	 * is higher than the last one stored with a broadcast AnnouncePos().
+	 * A bucket is due an update whenever the position, counted in the
+	 * bucket's period, 'ticks over' past the count at its last update.  The
+	 * response is packed once per bucket, however many clients are in it.
 	 *
-	 * @param pos The value of the POS response, in microseconds.
-	 * @return Whether it is polite to broadcast POS.
+	 * @param pos The current position, in microseconds.
+	 */
+	void AnnouncePosToBuckets(std::chrono::microseconds pos);
+
+	/**
+	 * Makes every bucket count its next update from a position.
+	 * @param pos The position, in microseconds.
 	 */
-	[[nodiscard]] bool CanBroadcastPos(std::chrono::microseconds pos) const;
+	void ResetPosBuckets(std::chrono::microseconds pos);
 
 	/**
 	 * Broadcasts a POS response.
 	 *
-	 * This updates the last broadcast time, so that CanBroadcastPos()
-	 * prevents further broadcasts from happening too soon after this one.
+	 * This resets the buckets' update counts, so that regular updates
+	 * don't follow too soon after this one.
 	 *
 	 * @param tag The tag of the request that changed the position, if any.
 	 *   For regularly scheduled position updates, use Response::NOREQUEST.
-	 * @param pos The new position, in microseconds.
 	 * @param pos The value of the POS response, in microseconds.
 	 */
 	void BroadcastPos(Response::Tag tag, std::chrono::microseconds pos);
 
+	/**
+	 * Moves a client between position update buckets.
+	 * @param id The ID of the client.
+	 * @param period The new update period; 0 takes it out of all buckets.
+	 */
+	void SetPosPeriod(ClientId id, std::chrono::milliseconds period);
+
+	/**
+	 * Broadcasts statistics, if it has been STATS_PERIOD since the last time.
+	 */
+	void BroadcastStatsIfDue();
+
+	/**
+	 * Warns everyone if the loaded file has skipped damaged frames since
+	 * the last warning.
+	 */
+	void WarnOfSkippedFrames();
+
+	/**
+	 * Moves a pre-rolled `play` on: starting the sink once it has buffered
+	 * enough, and announcing PLAY once it is heard.
+	 */
+	void ContinuePreRoll();
+
+	/**
+	 * Sends loudness readings to each subscribed client that is due one.
+	 * The response is packed once, however many clients are due.
+	 * @param all Whether every subscribed client is due, regardless of
+	 *   when they last got a reading.
+	 */
+	void AnnounceLoudnessIfDue(bool all);
+
+	/// Sends every full chunk of tapped audio to the clients tapping it.
+	void SendTapped();
+
+	/**
+	 * Stops sending a client tapped audio, if it was getting any.
+	 * @param id The client's ID.
+	 */
+	void Untap(ClientId id);
+
+	/**
+	 * Moves the tap, if there is one, onto the loaded file.
+	 * @param old_file The file that was loaded before, which stops feeding
+	 *   the tap before the new one starts, or nullptr if it has gone.
+	 */
+	void PassTap(Audio::Audio *old_file);
+
+	/**
+	 * Makes a LOUD response from the loaded file's loudness readings.
+	 * @param tag The tag of the response.
+	 * @return The response, or nothing if the file isn't being metered.
+	 * @see Loudness
+	 */
+	[[nodiscard]] std::optional<Response> LoudnessResponse(Response::Tag tag) const;
+
 	//
 	// Audio subsystem
 	//
@@ -256,6 +1138,236 @@ private:
 	 */
 	[[nodiscard]] std::unique_ptr<Audio::Audio> LoadRaw(std::string_view path) const;
 
+	/**
+	 * Opens a file's source, resampling and remixing it if need be.
+	 * This is the part of loading that touches the file, and is safe to
+	 * run off the player's thread.  With the RAM cache on, small files are
+	 * decoded whole here, and come back as sources over memory.
+	 * @param path The path to a file.
+	 * @return The source, ready to go into MakeAudio().
+	 */
+	[[nodiscard]] std::unique_ptr<Audio::Source> OpenSource(std::string_view path) const;
+
+	/**
+	 * Trims an opened source's silence off, if files are being trimmed.
+	 * Like OpenSource(), this is safe to run off the player's thread.
+	 * @param source The source.
+	 * @return The source, trimmed if need be.
+	 * @see EnableTrimming
+	 */
+	[[nodiscard]] std::unique_ptr<Audio::Source> TrimSource(std::unique_ptr<Audio::Source> source) const;
+
+	/**
+	 * Makes an Audio, with a sink, out of an opened source.
+	 * @param source The source, from OpenSource().
+	 * @return The Audio.
+	 */
+	[[nodiscard]] std::unique_ptr<Audio::Audio> MakeAudio(std::unique_ptr<Audio::Source> source) const;
+
+	/// Type of functions finishing off a load from OpenInBackground().
+	using FinishFn = std::function<Response(Response::Tag, std::unique_ptr<Audio::Source>)>;
+
+	/**
+	 * Opens a file's source with the background runner.
+	 * This is a coroutine, which carries on back on the player's thread
+	 * once the source opens, and then sends the final response.
+	 * @param id The ID of the client to send the final response to.
+	 * @param tag The tag of the request.
+	 * @param path The path to the file.
+	 * @param finish Called on the player's thread with the opened source,
+	 *   if the file opened; it returns the final response.
+	 */
+	Coro::Task OpenInBackground(ClientId id, std::string tag, std::string path, FinishFn finish);
+
+	/**
+	 * Makes an Audio the loaded file, and tells everyone.
+	 * @param audio The new file.
+	 */
+	void InstallFile(std::unique_ptr<Audio::Audio> audio);
+
+	/**
+	 * Gets rid of an Audio nobody wants any more.
+	 *
+	 * The Audio stops straight away, so it is never heard after this.
+	 * Tearing it down (closing its decoder, and taking its sink off the
+	 * device, both of which can wait on other threads) is left to the
+	 * background runner, if there is one, so that whatever replaces it
+	 * needn't wait.
+	 *
+	 * @param audio The Audio, which may be null.
+	 */
+	void Reap(std::unique_ptr<Audio::Audio> audio);
+
+	/**
+	 * Makes an Audio the cued file, fills it, and tells everyone.
+	 * @param audio The new cued file.
+	 * @param path The path it was cued from.
+	 */
+	void InstallCue(std::unique_ptr<Audio::Audio> audio, std::string_view path);
+
+	/// Type of functions opening sources for OpenSourceInBackground().
+	using OpenFn = std::function<std::unique_ptr<Audio::Source>()>;
+
+	/**
+	 * Opens a source with the background runner, when awaited.
+	 * The awaiting coroutine carries on back on the player's thread, with
+	 * the source, or with whatever opening it threw; it should check the
+	 * player isn't closing before doing anything else.
+	 * @param open Opens the source; this runs off the player's thread.
+	 * @return The awaitable.
+	 */
+	[[nodiscard]] Coro::InBackground<std::unique_ptr<Audio::Source>> OpenSourceInBackground(OpenFn open) const;
+
+	/**
+	 * Opens a queued file's source, crossfading from the end of another
+	 * file into it if there is one and the two can be mixed.
+	 * Like OpenSource(), this is safe to run off the player's thread.
+	 * @param path The path to the queued file.
+	 * @param overlap How long the crossfade lasts.
+	 * @param from The path of the file to crossfade from, or empty for none.
+	 * @param at Where, in that file, the crossfade starts.
+	 * @param crossfades Set to whether the source crossfades.
+	 * @return The source.
+	 */
+	[[nodiscard]] std::unique_ptr<Audio::Source> OpenQueued(std::string_view path, std::chrono::microseconds overlap,
+	                                                        std::string_view from, std::chrono::microseconds at,
+	                                                        bool &crossfades) const;
+
+	/// Broadcasts the queue, as a QUEUE response.
+	void BroadcastQueue() const;
+
+	/**
+	 * Opens the first QUEUE_PRELOAD queued files, if they aren't already
+	 * open (or opening), and fills their sinks.
+	 * Files with overlaps only open at the front, and open again whenever
+	 * the loaded file changes, as they crossfade from it.
+	 */
+	void PreloadQueue();
+
+	/**
+	 * Opens a queued file with the background runner, as PreloadQueue()
+	 * does, and fills its sink once it does.
+	 * This is a coroutine, which carries on back on the player's thread.
+	 * @param key The queue item's key.
+	 * @param open Opens the file's source, with any crossfade.
+	 * @param crossfades Set by @a open if it crossfades.
+	 */
+	Coro::Task PreloadInBackground(std::uint64_t key, OpenFn open, std::shared_ptr<bool> crossfades);
+
+	/**
+	 * Works out a file's waveform overview, from sources of its own, and
+	 * stores it in the waveform cache, if there is one.
+	 * This is safe to run off the player's thread.
+	 * @param path The file's path.
+	 * @param buckets The number of buckets to cut the file into.
+	 * @return The overview.
+	 * @exception FileError if the file can't be opened.
+	 * @exception SeekError if it can't be sought through.
+	 */
+	[[nodiscard]] Audio::Waveform ComputeOverview(const std::string &path, std::uint32_t buckets) const;
+
+	/**
+	 * Works out a waveform overview with the background runner, then
+	 * sends it and the final response.
+	 * This is a coroutine, which carries on back on the player's thread.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request.
+	 * @param path The file's path.
+	 * @param buckets The number of buckets to cut the file into.
+	 */
+	Coro::Task OverviewInBackground(ClientId id, std::string tag, std::string path, std::uint32_t buckets);
+
+	/**
+	 * Sends a waveform overview, as a WAVE response.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request.
+	 * @param path The file's path.
+	 * @param buckets The number of buckets the file was cut into.
+	 * @param waveform The overview.
+	 * @return The final response.
+	 */
+	Response SendOverview(ClientId id, Response::Tag tag, std::string_view path, std::uint32_t buckets,
+	                      const Audio::Waveform &waveform) const;
+
+	/// What Probe() found out about a file.
+	struct Probed {
+		std::chrono::microseconds length{0}; ///< The file's length, or 0 for a live stream.
+		std::uint32_t rate{0};               ///< The file's sample rate, in Hz.
+		std::uint8_t channels{0};            ///< The file's channel count.
+		Audio::SampleFormat format{};        ///< The format the file would decode in.
+		std::string failure{};               ///< Why the file didn't open, or empty if it did.
+	};
+
+	/// A Probe() whose files are opening in the background.
+	struct ProbeBatch {
+		std::string tag;                ///< The tag of the request.
+		std::vector<std::string> paths; ///< The files' paths.
+		std::vector<Probed> probed;     ///< What was found out, by file.
+		std::size_t pending;            ///< How many files are still opening.
+	};
+
+	/**
+	 * Opens a file for Probe(), and reads what it holds.
+	 * This is safe to run off the player's thread, and never throws.
+	 * @param path The file's path.
+	 * @return What the file holds, or why it couldn't be opened.
+	 */
+	[[nodiscard]] Probed ProbeFile(const std::string &path) const;
+
+	/**
+	 * Opens one of a Probe()'s files with the background runner, then, if
+	 * it is the last to open, sends the PROBEs and the final response.
+	 * This is a coroutine, which carries on back on the player's thread.
+	 * @param id The ID of the client asking.
+	 * @param batch The probe.
+	 * @param index The file's index in the probe.
+	 */
+	Coro::Task ProbeInBackground(ClientId id, std::shared_ptr<ProbeBatch> batch, std::size_t index);
+
+	/**
+	 * Sends what Probe() found out, as PROBE responses.
+	 * @param id The ID of the client asking.
+	 * @param tag The tag of the request.
+	 * @param paths The files' paths.
+	 * @param probed What was found out, by file.
+	 * @return The final response.
+	 */
+	Response SendProbes(ClientId id, Response::Tag tag, const std::vector<std::string> &paths,
+	                    const std::vector<Probed> &probed) const;
+
+	/**
+	 * Drops a file that can't be opened from the queue, and says so.
+	 * @param index The file's index in the queue.
+	 * @param message Why it couldn't be opened.
+	 */
+	void DropQueued(std::size_t index, std::string_view message);
+
+	/**
+	 * Schedules the front queued file to start when the loaded file ends
+	 * (or, if it crossfades, when the loaded file reaches the crossfade,
+	 * which it then stops at), if that is within ADVANCE_LEAD and nothing
+	 * else is scheduled.
+	 */
+	void ScheduleAdvance();
+
+	/**
+	 * Cancels the front queued file's scheduled start, if any, and rewinds
+	 * it, as the loaded file will no longer end when expected.
+	 * This also cancels the loaded file's stop at a crossfade, which
+	 * callers changing the loaded file's playing state must do first.
+	 */
+	void CancelAdvance();
+
+	/**
+	 * Swaps the front queued file in as the loaded file.
+	 * Files at the front that can't be opened are dropped on the way.
+	 * @param play Whether the new file should play.
+	 * @param started Whether the front file's start was scheduled, and
+	 *   has happened (or is about to).
+	 * @return Whether there was a file to swap in.
+	 */
+	bool Advance(bool play, bool started);
+
 	/**
 	 * Loads a file, creating an AudioSource.
 	 * @param path The path to the file to load.
@@ -264,6 +1376,23 @@ private:
 	 * @see Load
 	 */
 	[[nodiscard]] std::unique_ptr<Audio::Source> LoadSource(std::string_view path) const;
+
+	/**
+	 * Opens a file as LoadSource() does, but without starting the source's
+	 * background scans, for when the file is only being looked at.
+	 * @param path The path to the file to open.
+	 * @return The source, which isn't scanning its file.
+	 * @see Audio::Source::StartScans
+	 */
+	[[nodiscard]] std::unique_ptr<Audio::Source> InspectSource(std::string_view path) const;
+
+	/**
+	 * Works out which sample format a freshly opened source should decode
+	 * into, given what OpenSource() will then do with it.
+	 * @param source The source.
+	 * @return The format, if format negotiation is on.
+	 */
+	[[nodiscard]] std::optional<Audio::SampleFormat> DecodeFormat(const Audio::Source &source) const;
 };
 
 } // namespace Playd
@@ -10,8 +10,28 @@
 #include "response.h"
 
 #include <array>
+#include <cassert>
 #include <cctype>
+#include <charconv>
+#include <cstdint>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#undef max
+#include <gsl/gsl>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define PLAYD_RESPONSE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define PLAYD_RESPONSE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "frame.h"
 
 namespace Playd
 {
@@ -26,23 +46,140 @@ namespace Playd
         "PLAY",  // Code::PLAY
         "STOP",  // Code::STOP
         "ACK",   // Code::ACK
-        "LEN"    // Code::LEN
+        "LEN",   // Code::LEN
+        "CUE",   // Code::CUE
+        "STATS", // Code::STATS
+        "LOUD",  // Code::LOUD
+        "WAVE",  // Code::WAVE
+        "TRIM",  // Code::TRIM
+        "QUEUE", // Code::QUEUE
+        "WARN",  // Code::WARN
+        "SET",   // Code::SET
+        "TAP",   // Code::TAP
+        "PROBE"  // Code::PROBE
 }};
 
-Response::Response(std::string_view tag, Response::Code code)
+/// The size of a binary frame's length prefix.
+static constexpr std::size_t FRAME_LENGTH_BYTES = 4;
+
+/// The size of a text or binary field's length prefix.
+static constexpr std::size_t TEXT_LENGTH_BYTES = 4;
+
+/// The size of an integer field.
+static constexpr std::size_t INTEGER_BYTES = 8;
+
+Response::Response(std::string_view tag, Response::Code code) : code{code}, field_count{0}
 {
-	this->string = Response::EscapeArg(tag) + " " + std::string{CODE_STRINGS[static_cast<uint8_t>(code)]};
+	// No reserving up front: the commonest responses, such as POS, fit in
+	// the string's own small buffer, and so never allocate at all.
+	this->AddText(tag);
 }
 
 Response &Response::AddArg(std::string_view arg)
 {
-	this->string += " " + Response::EscapeArg(arg);
+	this->AddText(arg);
+	return *this;
+}
+
+Response &Response::AddBytes(std::string_view bytes)
+{
+	this->AddSized(FieldType::BYTES, bytes);
 	return *this;
 }
 
+Response::Code Response::GetCode() const
+{
+	return this->code;
+}
+
+void Response::AddText(std::string_view text)
+{
+	this->AddSized(FieldType::TEXT, text);
+}
+
+void Response::AddSized(FieldType type, std::string_view data)
+{
+	Expects(this->field_count < UINT8_MAX);
+	Expects(data.size() <= UINT32_MAX);
+
+	this->fields.push_back(static_cast<char>(type));
+	PutBigEndian(this->fields, data.size(), TEXT_LENGTH_BYTES);
+	this->fields.append(data);
+	this->field_count++;
+}
+
+void Response::AddInteger(FieldType type, std::uint64_t bits)
+{
+	Expects(this->field_count < UINT8_MAX);
+
+	this->fields.push_back(static_cast<char>(type));
+	PutBigEndian(this->fields, bits, INTEGER_BYTES);
+	this->field_count++;
+}
+
 std::string Response::Pack() const
 {
-	return this->string;
+	std::string out;
+	this->PackInto(out);
+	return out;
+}
+
+void Response::PackInto(std::string &out) const
+{
+	// The text form is never longer than the fields plus quoting, and
+	// usually shorter, so this is almost always the only allocation.
+	out.reserve(out.size() + this->fields.size() + 16);
+
+	std::string_view rest{this->fields};
+	for (std::uint8_t i = 0; i < this->field_count; i++) {
+		if (i != 0) out.push_back(' ');
+
+		const auto type = static_cast<FieldType>(rest[0]);
+		rest.remove_prefix(1);
+
+		if (type == FieldType::TEXT || type == FieldType::BYTES) {
+			const auto length = GetBigEndian(rest.data(), TEXT_LENGTH_BYTES);
+			rest.remove_prefix(TEXT_LENGTH_BYTES);
+			if (type == FieldType::TEXT) {
+				AppendEscaped(out, rest.substr(0, length));
+			} else {
+				AppendBase64(out, rest.substr(0, length));
+			}
+			rest.remove_prefix(length);
+		} else {
+			const auto bits = GetBigEndian(rest.data(), INTEGER_BYTES);
+			rest.remove_prefix(INTEGER_BYTES);
+
+			// Enough for any 64-bit integer, and its sign.  Numbers
+			// never need escaping.
+			std::array<char, 21> digits{};
+			const auto [end, ec] =
+			        (type == FieldType::INT)
+			                ? std::to_chars(digits.begin(), digits.end(), static_cast<std::int64_t>(bits))
+			                : std::to_chars(digits.begin(), digits.end(), bits);
+			assert(ec == std::errc{});
+			out.append(digits.data(), end);
+		}
+
+		// The code goes after the tag.
+		if (i == 0) {
+			out.push_back(' ');
+			out.append(CODE_STRINGS[static_cast<std::uint8_t>(this->code)]);
+		}
+	}
+}
+
+void Response::PackFrame(std::string &out) const
+{
+	// Code and field count, then the fields as they are.
+	const auto length = 2 + this->fields.size();
+	Expects(length <= UINT32_MAX);
+
+	out.reserve(out.size() + FRAME_LENGTH_BYTES + length);
+	PutBigEndian(out, length, FRAME_LENGTH_BYTES);
+	out.push_back(static_cast<char>(this->code));
+	out.push_back(static_cast<char>(this->field_count));
+	out.append(this->fields);
 }
 
 /* static */ Response Response::Success(Response::Tag tag)
@@ -60,29 +197,105 @@ std::string Response::Pack() const
 	return Response(tag, Response::Code::ACK).AddArg("FAIL").AddArg(msg);
 }
 
-/* static */ std::string Response::EscapeArg(std::string_view arg)
+/// Scalar version of Response::NeedsEscaping, for the ends of arguments.
+static bool NeedsEscapingScalar(const char *begin, const char *end)
+{
+	for (auto *c = begin; c != end; c++) {
+		// This is the classic locale's idea of whitespace, plus the
+		// characters with special meaning inside arguments.
+		const auto u = static_cast<unsigned char>(*c);
+		if (u == ' ' || static_cast<unsigned char>(u - '\t') <= '\r' - '\t') return true;
+		if (u == '"' || u == '\'' || u == '\\') return true;
+	}
+	return false;
+}
+
+/* static */ bool Response::NeedsEscaping(std::string_view arg)
 {
-	bool escaping = false;
-	std::string escaped;
+	auto *c = arg.data();
+	auto *const end = c + arg.size();
+
+	// The same test as NeedsEscapingScalar, sixteen bytes at a time.
+	// Most arguments are short, but file paths can be long.
+#if defined(PLAYD_RESPONSE_SSE2)
+	const auto space = _mm_set1_epi8(' ');
+	const auto dquote = _mm_set1_epi8('"');
+	const auto squote = _mm_set1_epi8('\'');
+	const auto backslash = _mm_set1_epi8('\\');
+	const auto tab = _mm_set1_epi8('\t');
+	const auto ctrl_span = _mm_set1_epi8('\r' - '\t');
+	for (; 16 <= end - c; c += 16) {
+		const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(c));
+		auto hits = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, dquote));
+		hits = _mm_or_si128(hits, _mm_or_si128(_mm_cmpeq_epi8(v, squote), _mm_cmpeq_epi8(v, backslash)));
 
-	for (char c : arg) {
-		// These are the characters (including all whitespace, via
-		// isspace())  whose presence means we need to single-quote
-		// escape the argument.
-		const bool is_escaper = c == '"' || c == '\'' || c == '\\';
-		if (isspace(c) || is_escaper) escaping = true;
+		// Unsigned v - '\t' <= '\r' - '\t' catches \t, \n, \v, \f and \r.
+		const auto ctrl = _mm_sub_epi8(v, tab);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_min_epu8(ctrl, ctrl_span), ctrl));
+
+		if (_mm_movemask_epi8(hits) != 0) return true;
+	}
+#elif defined(PLAYD_RESPONSE_NEON)
+	const auto ctrl_span = vdupq_n_u8('\r' - '\t');
+	for (; 16 <= end - c; c += 16) {
+		const auto v = vld1q_u8(reinterpret_cast<const std::uint8_t *>(c));
+		auto hits = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('"')));
+		hits = vorrq_u8(hits, vorrq_u8(vceqq_u8(v, vdupq_n_u8('\'')), vceqq_u8(v, vdupq_n_u8('\\'))));
+		hits = vorrq_u8(hits, vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), ctrl_span));
 
-		// Since we use single-quote escaping, the only thing we need
-		// to escape by itself is single quotes, which are replaced by
-		// the sequence '\'' (break out of single quotes, escape a
-		// single quote, then re-enter single quotes).
-		escaped += (c == '\'') ? R"('\'')" : std::string(1, c);
+		if (vmaxvq_u8(hits) != 0) return true;
 	}
+#endif
 
+	return NeedsEscapingScalar(c, end);
+}
+
+/* static */ void Response::AppendEscaped(std::string &out, std::string_view arg)
+{
 	// Only single-quote escape if necessary.
 	// Otherwise, it wastes two characters!
-	if (escaping) return "'" + escaped + "'";
-	return escaped;
+	if (!NeedsEscaping(arg)) {
+		out.append(arg);
+		return;
+	}
+
+	// Since we use single-quote escaping, the only thing we need to escape
+	// by itself is single quotes, which are replaced by the sequence '\''
+	// (break out of single quotes, escape a single quote, then re-enter
+	// single quotes).  Everything between them goes in as-is.
+	out.push_back('\'');
+	for (auto quote = arg.find('\''); quote != std::string_view::npos; quote = arg.find('\'')) {
+		out.append(arg.substr(0, quote));
+		out.append(R"('\'')");
+		arg.remove_prefix(quote + 1);
+	}
+	out.append(arg);
+	out.push_back('\'');
+}
+
+/* static */ void Response::AppendBase64(std::string &out, std::string_view bytes)
+{
+	static constexpr std::string_view ALPHABET{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+
+	const auto byte = [&bytes](std::size_t i) {
+		return static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[i]));
+	};
+
+	out.reserve(out.size() + (((bytes.size() + 2) / 3) * 4));
+	std::size_t i = 0;
+	for (; i + 3 <= bytes.size(); i += 3) {
+		const auto bits = (byte(i) << 16U) | (byte(i + 1) << 8U) | byte(i + 2);
+		for (const auto shift : {18U, 12U, 6U, 0U}) out.push_back(ALPHABET[(bits >> shift) & 0x3FU]);
+	}
+
+	// The last one or two bytes are padded out to four characters.
+	const auto left = bytes.size() - i;
+	if (left == 0) return;
+	const auto bits = (byte(i) << 16U) | (left == 2 ? byte(i + 1) << 8U : 0U);
+	out.push_back(ALPHABET[(bits >> 18U) & 0x3FU]);
+	out.push_back(ALPHABET[(bits >> 12U) & 0x3FU]);
+	out.push_back(left == 2 ? ALPHABET[(bits >> 6U) & 0x3FU] : '=');
+	out.push_back('=');
 }
 
 //
@@ -94,4 +307,14 @@ void ResponseSink::Respond(ClientId, const Response &) const
 	// By default, do nothing.
 }
 
+void ResponseSink::Multicast(const std::vector<ClientId> &ids, const Response &response) const
+{
+	for (const auto id : ids) this->Respond(id, response);
+}
+
+void ResponseSink::Complete(ClientId id, const Response &response) const
+{
+	this->Respond(id, response);
+}
+
 } // namespace Playd
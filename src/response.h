@@ -10,11 +10,14 @@
 #ifndef PLAYD_IO_RESPONSE_H
 #define PLAYD_IO_RESPONSE_H
 
+#include <concepts>
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include "errors.h"
@@ -54,11 +57,21 @@ public:
 		PLAY,  ///< The loaded file is playing.
 		STOP,  ///< The loaded file has stopped.
 		ACK,   ///< Command result.
-		LEN    ///< Server sending song length.
+		LEN,   ///< Server sending song length.
+		CUE,   ///< The cued file just changed.
+		STATS, ///< Server sending playback statistics.
+		LOUD,  ///< Server sending loudness readings.
+		WAVE,  ///< Server sending a waveform overview.
+		TRIM,  ///< Where the loaded file was trimmed.
+		QUEUE, ///< The queue just changed.
+		WARN,  ///< Something went wrong, but playback carried on.
+		SET,   ///< Server sending a setting's value.
+		TAP,   ///< Server sending tapped audio.
+		PROBE  ///< Server sending what a file holds, without loading it.
 	};
 
 	/// The number of codes, which should agree with Response::Code.
-	static constexpr std::uint8_t CODE_COUNT = 10;
+	static constexpr std::uint8_t CODE_COUNT = 20;
 
 	/**
 	 * Constructs a Response with no arguments.
@@ -74,6 +87,39 @@ public:
 	 */
 	Response &AddArg(Tag arg);
 
+	/**
+	 * Adds an integer argument to this Response.
+	 * In text, this is formatted in decimal; in binary frames, it is a
+	 * fixed-width 64-bit field.
+	 * @tparam T The type of the integer.
+	 * @param arg The argument to add.
+	 * @return A reference to this Response, for chaining.
+	 */
+	template <std::integral T>
+	    requires(!std::same_as<T, bool> && !std::same_as<T, char>)
+	Response &AddArg(T arg)
+	{
+		if constexpr (std::is_signed_v<T>) {
+			this->AddInteger(FieldType::INT, static_cast<std::uint64_t>(static_cast<std::int64_t>(arg)));
+		} else {
+			this->AddInteger(FieldType::UINT, static_cast<std::uint64_t>(arg));
+		}
+		return *this;
+	}
+
+	/**
+	 * Adds a binary argument to this Response.
+	 * In text, this is base64-encoded; in binary frames, it is sent as is.
+	 * @param bytes The argument to add.
+	 * @return A reference to this Response, for chaining.
+	 */
+	Response &AddBytes(std::string_view bytes);
+
+	/**
+	 * @return The Response::Code representing the response command.
+	 */
+	[[nodiscard]] Code GetCode() const;
+
 	/**
 	 * Packs the Response, converting it to a BAPS3 protocol message.
 	 * Pack()ing does not alter the Response, which may be Pack()ed again.
@@ -81,6 +127,21 @@ public:
 	 */
 	[[nodiscard]] std::string Pack() const;
 
+	/**
+	 * Packs the Response onto the end of a string, as Pack() does.
+	 * @param out The string to which the BAPS3 message, sans newline, is
+	 *   appended.
+	 */
+	void PackInto(std::string &out) const;
+
+	/**
+	 * Packs the Response as a binary frame onto the end of a string.
+	 * None of the Response's arguments are escaped in this form.
+	 * @param out The string to which the frame is appended.
+	 * @see README.commands.md for the frame format.
+	 */
+	void PackFrame(std::string &out) const;
+
 	/**
 	 * Shortcut for constructing a final response to a successful request.
 	 * @param tag The tag of the original request.
@@ -105,16 +166,67 @@ public:
 	static Response Failure(Tag tag, std::string_view msg);
 
 private:
+	/// Types of field inside a Response, as in binary frames.
+	enum class FieldType : std::uint8_t {
+		TEXT, ///< A 32-bit length, then that many bytes.
+		INT,  ///< A signed 64-bit integer.
+		UINT, ///< An unsigned 64-bit integer.
+		BYTES ///< A 32-bit length, then that many bytes of binary.
+	};
+
+	/**
+	 * Adds a text field (the tag, or an argument).
+	 * @param text The unescaped text.
+	 */
+	void AddText(std::string_view text);
+
 	/**
-	 * Escapes a single response argument.
+	 * Adds a length-prefixed field.
+	 * @param type FieldType::TEXT or FieldType::BYTES.
+	 * @param data The field's contents.
+	 */
+	void AddSized(FieldType type, std::string_view data);
+
+	/**
+	 * Adds an integer field.
+	 * @param type FieldType::INT or FieldType::UINT.
+	 * @param bits The integer, as a 64-bit pattern.
+	 */
+	void AddInteger(FieldType type, std::uint64_t bits);
+
+	/**
+	 * Checks whether a response argument needs quoting.
+	 * @param arg The argument to check.
+	 * @return Whether @a arg contains whitespace, quotes or backslashes.
+	 */
+	static bool NeedsEscaping(std::string_view arg);
+
+	/**
+	 * Escapes a single response argument onto the end of a string.
+	 * @param out The string to append to.
 	 * @param arg The argument to escape.
-	 * @return The escaped argument.
 	 */
-	static std::string EscapeArg(std::string_view arg);
+	static void AppendEscaped(std::string &out, std::string_view arg);
 
-	/// The current packed form of the response.
+	/**
+	 * Base64-encodes bytes onto the end of a string.
+	 * The encoding never needs escaping.
+	 * @param out The string to append to.
+	 * @param bytes The bytes to encode.
+	 */
+	static void AppendBase64(std::string &out, std::string_view bytes);
+
+	/// The response code.
+	Code code;
+
+	/// The number of fields, including the tag.
+	std::uint8_t field_count;
+
+	/// The tag and arguments, unescaped, in binary frame format.
+	/// Text packing works from these too.
 	/// @see Pack
-	std::string string;
+	/// @see PackFrame
+	std::string fields;
 };
 
 /**
@@ -134,6 +246,24 @@ public:
 	 * @param response The Response to output.
 	 */
 	virtual void Respond(ClientId id, const Response &response) const;
+
+	/**
+	 * Outputs the same response to several clients.
+	 * By default, this calls Respond() for each; sinks that can share work
+	 * between the clients should override it.
+	 * @param ids The IDs of the clients receiving this response.
+	 * @param response The Response to output.
+	 */
+	virtual void Multicast(const std::vector<ClientId> &ids, const Response &response) const;
+
+	/**
+	 * Outputs the reply to a command that didn't reply straight away.
+	 * Sinks that hold a client's later commands back until it has its
+	 * reply should override this; by default, it calls Respond().
+	 * @param id The ID of the client that sent the command.
+	 * @param response The reply.
+	 */
+	virtual void Complete(ClientId id, const Response &response) const;
 };
 
 } // namespace Playd
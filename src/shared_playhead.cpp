@@ -0,0 +1,135 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the SharedPlayhead class.
+ * @see shared_playhead.h
+ */
+
+#include "shared_playhead.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#undef max
+#include <gsl/gsl>
+
+#include "errors.h"
+#include "response.h"
+
+namespace Playd
+{
+// Readers in other languages rely on the layout in README.md.
+static_assert(sizeof(SharedPlayhead::Layout) == 56, "the shared playhead's layout has changed");
+
+SharedPlayhead::SharedPlayhead(const std::string &path) : fd{-1}, layout{nullptr}
+{
+#ifdef _WIN32
+	// Readers may already have the file open, so it is shared every way.
+	const auto file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+	                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+	                              FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw FileError("can't open " + path + ": error " + std::to_string(GetLastError()));
+	}
+	const auto close_file = gsl::finally([file] { CloseHandle(file); });
+
+	// A mapping bigger than its file grows the file to fit, which does for
+	// sizing it; the view then keeps both alive by itself.
+	const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, sizeof(Layout), nullptr);
+	if (mapping == nullptr) throw FileError("can't size " + path + ": error " + std::to_string(GetLastError()));
+	const auto close_mapping = gsl::finally([mapping] { CloseHandle(mapping); });
+
+	auto *raw = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Layout));
+	if (raw == nullptr) throw FileError("can't map " + path + ": error " + std::to_string(GetLastError()));
+#else
+	this->fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (this->fd < 0) throw FileError("can't open " + path + ": " + std::strerror(errno));
+
+	if (ftruncate(this->fd, sizeof(Layout)) != 0) {
+		const auto err = errno;
+		close(this->fd);
+		throw FileError("can't size " + path + ": " + std::strerror(err));
+	}
+
+	auto raw = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+	if (raw == MAP_FAILED) {
+		const auto err = errno;
+		close(this->fd);
+		throw FileError("can't map " + path + ": " + std::strerror(err));
+	}
+#endif
+
+	// Whatever an earlier playd left there is stale, so start afresh.  The
+	// magic goes in last, so readers can tell a half-set-up file.
+	this->layout = new (raw) Layout{0, 0, {0}, {0}, {0}, {0}, {0}, {0}};
+	this->layout->version = VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	this->layout->magic = MAGIC;
+}
+
+SharedPlayhead::~SharedPlayhead()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(this->layout);
+#else
+	munmap(this->layout, sizeof(Layout));
+	close(this->fd);
+#endif
+}
+
+void SharedPlayhead::Publish(const Snapshot &snapshot)
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	auto &l = *this->layout;
+
+	// Odd while writing; the fence keeps the fields from moving above it.
+	const auto seq = l.sequence.load(std::memory_order_relaxed);
+	l.sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	l.state.store(static_cast<std::uint64_t>(snapshot.state), std::memory_order_relaxed);
+	l.position.store(snapshot.position.count(), std::memory_order_relaxed);
+	l.length.store(snapshot.length.count(), std::memory_order_relaxed);
+	l.generation.store(snapshot.generation, std::memory_order_relaxed);
+	l.clock.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+
+	l.sequence.store(seq + 2, std::memory_order_release);
+}
+
+SharedPlayhead::Snapshot SharedPlayhead::Read() const
+{
+	const auto &l = *this->layout;
+
+	while (true) {
+		const auto before = l.sequence.load(std::memory_order_acquire);
+		if (before % 2 != 0) continue;
+
+		Snapshot snapshot{static_cast<Response::Code>(l.state.load(std::memory_order_relaxed)),
+		                  std::chrono::microseconds{l.position.load(std::memory_order_relaxed)},
+		                  std::chrono::microseconds{l.length.load(std::memory_order_relaxed)},
+		                  l.generation.load(std::memory_order_relaxed),
+		                  std::chrono::nanoseconds{l.clock.load(std::memory_order_relaxed)}};
+
+		// The fence keeps the fields from moving below the second check.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (l.sequence.load(std::memory_order_relaxed) == before) return snapshot;
+	}
+}
+
+} // namespace Playd
@@ -0,0 +1,109 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the SharedPlayhead class.
+ * @see shared_playhead.cpp
+ */
+
+#ifndef PLAYD_SHARED_PLAYHEAD_H
+#define PLAYD_SHARED_PLAYHEAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "response.h"
+
+namespace Playd
+{
+/**
+ * A player's state and position, published in a shared-memory file for
+ * clients on the same host.
+ *
+ * The file holds one Layout, guarded by a seqlock: the sequence number is
+ * odd while playd is writing, and goes up by two with each snapshot, so a
+ * reader that sees the same even number before and after reading the
+ * fields has a consistent snapshot.  Readers map the file read-only and
+ * never take locks, make syscalls, or cause playd any work, however often
+ * they read.
+ *
+ * playd publishes whenever the player updates: every few milliseconds while
+ * playing, and after every command and load.  The snapshot's clock time
+ * lets readers move the position on between updates, if they need to.
+ */
+class SharedPlayhead
+{
+public:
+	/// The magic number at the start of the file ("PLHD", little-endian).
+	static constexpr std::uint32_t MAGIC = 0x44484c50;
+
+	/// The version of the layout, which goes up with incompatible changes.
+	static constexpr std::uint32_t VERSION = 1;
+
+	/**
+	 * The file's layout, in the host's byte order.
+	 * Every field after the header is a lock-free 64-bit atomic, so that
+	 * readers in other processes see whole values.
+	 */
+	struct Layout {
+		std::uint32_t magic;                   ///< MAGIC.
+		std::uint32_t version;                 ///< VERSION.
+		std::atomic<std::uint64_t> sequence;   ///< The seqlock; odd while writing.
+		std::atomic<std::uint64_t> state;      ///< The state, as a Response::Code (EJECT, STOP, PLAY or END).
+		std::atomic<std::int64_t> position;    ///< The position, in microseconds.
+		std::atomic<std::int64_t> length;      ///< The loaded file's length, in microseconds.
+		std::atomic<std::uint64_t> generation; ///< Goes up with each load and eject.
+		std::atomic<std::int64_t> clock;       ///< When this was published, in steady-clock nanoseconds.
+	};
+
+	/// One consistent reading of the layout's fields.
+	struct Snapshot {
+		Response::Code state;               ///< The state (EJECT, STOP, PLAY or END).
+		std::chrono::microseconds position; ///< The position; zero if ejected.
+		std::chrono::microseconds length;   ///< The length; zero if ejected.
+		std::uint64_t generation;           ///< Goes up with each load and eject.
+		std::chrono::nanoseconds clock;     ///< When it was published, by the steady clock.
+	};
+
+	/**
+	 * Creates (or takes over) the shared-memory file and maps it.
+	 * @param path The file's path; somewhere in /dev/shm keeps it in memory.
+	 * @exception FileError if the file can't be created or mapped.
+	 */
+	explicit SharedPlayhead(const std::string &path);
+
+	/// Destructs a SharedPlayhead, unmapping (but not removing) the file.
+	~SharedPlayhead();
+
+	/// Deleted copy constructor.
+	SharedPlayhead(const SharedPlayhead &) = delete;
+
+	/// Deleted copy-assignment.
+	SharedPlayhead &operator=(const SharedPlayhead &) = delete;
+
+	/**
+	 * Publishes a snapshot.
+	 * @param snapshot The snapshot; its clock is ignored, and set to now.
+	 */
+	void Publish(const Snapshot &snapshot);
+
+	/**
+	 * Reads the snapshot, as a reader in another process would.
+	 * @return The last snapshot published.
+	 */
+	[[nodiscard]] Snapshot Read() const;
+
+private:
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared snapshots need lock-free atomics");
+
+	int fd;          ///< The file's descriptor; unused on Windows, where the mapping holds the file.
+	Layout *layout;  ///< The file, mapped.
+};
+
+} // namespace Playd
+
+#endif // PLAYD_SHARED_PLAYHEAD_H
@@ -0,0 +1,37 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of the table of audio sink backends playd was built with.
+ * @see sinks.h
+ */
+
+#include "sinks.h"
+
+#include <map>
+#include <string>
+
+#include "audio/sink.h"
+
+#ifdef WITH_ALSA
+#include "audio/sinks/alsa.h"
+#endif // WITH_ALSA
+
+#ifdef WITH_RTP
+#include "audio/sinks/rtp.h"
+#endif // WITH_RTP
+
+namespace Playd
+{
+const std::map<std::string, SinkBackend> SINK_BACKENDS{
+        {"sdl", {Audio::SDLSink::GetDevicesInfo, Audio::SDLSink::IsOutputDevice, Audio::SDLSink::NativeRate}},
+#ifdef WITH_RTP
+        {"rtp", {Audio::RtpSink::GetDevicesInfo, Audio::RtpSink::IsOutputDevice, nullptr}},
+#endif // WITH_RTP
+#ifdef WITH_ALSA
+        {"alsa", {Audio::AlsaSink::GetDevicesInfo, Audio::AlsaSink::IsOutputDevice, nullptr}},
+#endif // WITH_ALSA
+};
+
+} // namespace Playd
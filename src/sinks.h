@@ -0,0 +1,44 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the table of audio sink backends playd was built with.
+ * @see sinks.cpp
+ */
+
+#ifndef PLAYD_SINKS_H
+#define PLAYD_SINKS_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Playd
+{
+/// An audio output backend, and how to find its devices.
+struct SinkBackend {
+	/// Lists the backend's output devices, with their IDs.
+	std::vector<std::pair<int, std::string>> (*devices)();
+
+	/// Checks whether an ID is one of the backend's output devices.
+	bool (*is_output)(int);
+
+	/// Gets the rate an output device runs at natively, if known; null if
+	/// the backend can't say.
+	std::optional<std::uint32_t> (*native_rate)(int);
+};
+
+/// The backends, by the name given to --backend=.
+extern const std::map<std::string, SinkBackend> SINK_BACKENDS;
+
+/// The backend used if none is asked for.
+constexpr std::string_view DEFAULT_SINK_BACKEND{"sdl"};
+
+} // namespace Playd
+
+#endif // PLAYD_SINKS_H
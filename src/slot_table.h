@@ -0,0 +1,190 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration and implementation of the SlotTable class template.
+ */
+
+#ifndef PLAYD_SLOT_TABLE_H
+#define PLAYD_SLOT_TABLE_H
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gsl/gsl>
+
+#include "errors.h"
+#include "messages.h"
+#include "response.h"
+
+namespace Playd
+{
+/**
+ * A table of owned objects, keyed by generation-tagged client IDs.
+ *
+ * The objects are kept densely, so iterating over them touches only live
+ * ones; removing one moves the last into its place.  Each ID names a slot
+ * (its low half, from 1) and that slot's generation (its high half), which
+ * goes up whenever the slot is freed, so an ID that outlives its object
+ * finds nothing rather than whatever took its slot next.
+ *
+ * @tparam T The type of object held.
+ */
+template <typename T>
+class SlotTable
+{
+public:
+	/// An object and the ID it was added under.
+	struct Entry {
+		ClientId id;            ///< The object's ID.
+		std::unique_ptr<T> obj; ///< The object.
+	};
+
+	/// The number of bits of an ID that name its slot.
+	static constexpr std::size_t SLOT_BITS = std::numeric_limits<std::size_t>::digits / 2;
+
+	/// The most slots a table can have.
+	static constexpr std::size_t MAX_SLOTS = (std::size_t{1} << SLOT_BITS) - 1;
+
+	/**
+	 * Reserves an ID for an object about to be added.
+	 * The ID stays reserved until the object it names is removed, or
+	 * until the next call, if nothing is added under it.
+	 * @return A fresh ID, which is never BROADCAST.
+	 * @exception InternalError if the table can't take any more slots.
+	 */
+	[[nodiscard]] ClientId NextId()
+	{
+		if (this->free.empty()) {
+			if (this->slots.size() == MAX_SLOTS) throw InternalError(MSG_TOO_MANY_CONNS);
+			this->free.push_back(this->slots.size());
+			this->slots.push_back({0, NONE});
+		}
+		return IdOf(this->free.back());
+	}
+
+	/**
+	 * Adds an object under the ID last given by NextId().
+	 * @param id The ID from NextId().
+	 * @param obj The object to add.
+	 */
+	void Add(ClientId id, std::unique_ptr<T> obj)
+	{
+		Expects(!this->free.empty() && id == IdOf(this->free.back()));
+
+		this->slots[this->free.back()].dense = this->dense.size();
+		this->free.pop_back();
+		this->dense.push_back({id, std::move(obj)});
+	}
+
+	/**
+	 * Looks up an object.
+	 * @param id The object's ID.
+	 * @return The object, or nullptr if @a id is BROADCAST, was never
+	 *   given out, or names an object since removed.
+	 */
+	[[nodiscard]] T *Find(ClientId id) const
+	{
+		const auto *slot = this->Occupied(id);
+		return slot == nullptr ? nullptr : this->dense[slot->dense].obj.get();
+	}
+
+	/**
+	 * Removes an object, moving the last object into its place.
+	 * @param id The object's ID.
+	 * @return The object, or nullptr if Find() wouldn't have found it.
+	 */
+	std::unique_ptr<T> Remove(ClientId id)
+	{
+		auto *slot = this->Occupied(id);
+		if (slot == nullptr) return nullptr;
+
+		const auto index = slot->dense;
+		auto obj = std::move(this->dense[index].obj);
+		if (index + 1 < this->dense.size()) {
+			this->dense[index] = std::move(this->dense.back());
+			this->slots[SlotOf(this->dense[index].id)].dense = index;
+		}
+		this->dense.pop_back();
+
+		slot->dense = NONE;
+		slot->generation++;
+		this->free.push_back(SlotOf(id));
+		return obj;
+	}
+
+	/// @return The number of objects in the table.
+	[[nodiscard]] std::size_t Size() const
+	{
+		return this->dense.size();
+	}
+
+	/// @return Whether the table is empty.
+	[[nodiscard]] bool Empty() const
+	{
+		return this->dense.empty();
+	}
+
+	/// @return The start of the objects, in no particular order.
+	[[nodiscard]] typename std::vector<Entry>::const_iterator begin() const
+	{
+		return this->dense.cbegin();
+	}
+
+	/// @return The end of the objects.
+	[[nodiscard]] typename std::vector<Entry>::const_iterator end() const
+	{
+		return this->dense.cend();
+	}
+
+private:
+	/// The dense index of a free slot.
+	static constexpr std::size_t NONE = std::numeric_limits<std::size_t>::max();
+
+	/// One slot, through which IDs reach objects.
+	struct Slot {
+		std::size_t generation; ///< How many times the slot has been freed.
+		std::size_t dense;      ///< Where its object is in dense, or NONE.
+	};
+
+	/// @return The slot index named by @a id (which may be out of range).
+	static constexpr std::size_t SlotOf(ClientId id)
+	{
+		return (static_cast<std::size_t>(id) & MAX_SLOTS) - 1;
+	}
+
+	/// @return The ID of the slot at @a index, as of its current generation.
+	[[nodiscard]] ClientId IdOf(std::size_t index) const
+	{
+		const auto generation = this->slots[index].generation & MAX_SLOTS;
+		return static_cast<ClientId>((generation << SLOT_BITS) | (index + 1));
+	}
+
+	/// @return The slot @a id names, if that ID's object is still there.
+	[[nodiscard]] const Slot *Occupied(ClientId id) const
+	{
+		const auto index = SlotOf(id);
+		if (this->slots.size() <= index) return nullptr;
+		const auto &slot = this->slots[index];
+		if (slot.dense == NONE || IdOf(index) != id) return nullptr;
+		return &slot;
+	}
+
+	/// @copydoc Occupied(ClientId) const
+	[[nodiscard]] Slot *Occupied(ClientId id)
+	{
+		return const_cast<Slot *>(std::as_const(*this).Occupied(id));
+	}
+
+	std::vector<Entry> dense;      ///< The objects, packed together.
+	std::vector<Slot> slots;       ///< The slots, indexed by ID.
+	std::vector<std::size_t> free; ///< The indices of free slots.
+};
+
+} // namespace Playd
+
+#endif // PLAYD_SLOT_TABLE_H
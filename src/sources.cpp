@@ -0,0 +1,63 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of the table of audio sources playd was built with.
+ * @see sources.h
+ */
+
+#include "sources.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include "player.h"
+
+#ifdef WITH_FLAC
+#include "audio/sources/flac.h"
+#endif // WITH_FLAC
+#ifdef WITH_MP3
+#include "audio/sources/http.h"
+#include "audio/sources/mp3.h"
+#endif // WITH_MP3
+#ifdef WITH_OPUS
+#include "audio/sources/opus.h"
+#endif // WITH_OPUS
+#ifdef WITH_SNDFILE
+#include "audio/sources/sndfile.h"
+#endif // WITH_SNDFILE
+
+namespace Playd
+{
+// libsndfile's probe takes FLAC and Ogg files too, so the decoders made for
+// them go first, to get there before it does.
+const std::vector<Player::Decoder> SOURCES{
+#ifdef WITH_FLAC
+        {"flac", {"flac"}, Audio::FlacSource::Probe, Audio::FlacSource::MakeUnique},
+#endif // WITH_FLAC
+
+#ifdef WITH_OPUS
+        {"opusfile", {"opus"}, Audio::OpusSource::Probe, Audio::OpusSource::MakeUnique},
+#endif // WITH_OPUS
+
+#ifdef WITH_MP3
+        {"mpg123", {"mp3"}, Audio::MP3Source::Probe, Audio::MP3Source::MakeUnique},
+        {"http", {}, nullptr, Audio::HttpSource::MakeUnique, {"http", "https"}},
+#endif // WITH_MP3
+
+#ifdef WITH_SNDFILE
+        {"sndfile", {"flac", "ogg", "wav"}, Audio::SndfileSource::Probe, Audio::SndfileSource::MakeUnique},
+#endif // WITH_SNDFILE
+};
+
+void InitSourceLibraries()
+{
+#ifdef WITH_MP3
+	// mpg123 insists on us running its init and exit functions, too.
+	mpg123_init();
+	atexit(mpg123_exit);
+#endif // WITH_MP3
+}
+
+} // namespace Playd
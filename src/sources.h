@@ -0,0 +1,28 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the table of audio sources playd was built with.
+ * @see sources.cpp
+ */
+
+#ifndef PLAYD_SOURCES_H
+#define PLAYD_SOURCES_H
+
+#include <vector>
+
+#include "player.h"
+
+namespace Playd
+{
+/// The decoders playd was built with, in probing order.
+extern const std::vector<Player::Decoder> SOURCES;
+
+/// Initialises any decoder libraries that need it, and registers their
+/// cleanup to happen at exit.
+void InitSourceLibraries();
+
+} // namespace Playd
+
+#endif // PLAYD_SOURCES_H
@@ -0,0 +1,280 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the StateSnapshot class.
+ * @see state_snapshot.h
+ */
+
+#include "state_snapshot.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#undef max
+#include <gsl/gsl>
+
+#include "errors.h"
+#include "response.h"
+
+namespace Playd
+{
+// Standbys written in other languages rely on the layout in README.md.
+static_assert(sizeof(StateSnapshot::Layout) == 65536, "the state snapshot's layout has changed");
+
+StateSnapshot::StateSnapshot(const std::string &path) : fd{-1}, layout{nullptr}, owned{false}, text_current{false}
+{
+#ifdef _WIN32
+	this->fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | _O_NOINHERIT, _S_IREAD | _S_IWRITE);
+	if (this->fd < 0) throw FileError("can't open " + path + ": " + std::strerror(errno));
+
+	// Windows won't resize a file another process has mapped, but a mapping
+	// bigger than the file grows it, which sizes it for whoever comes first.
+	const auto file = reinterpret_cast<HANDLE>(_get_osfhandle(this->fd));
+	const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, sizeof(Layout), nullptr);
+	auto *raw = mapping == nullptr ? nullptr : MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Layout));
+	const auto err = GetLastError();
+	if (mapping != nullptr) CloseHandle(mapping); // The view keeps it alive.
+	if (raw == nullptr) {
+		_close(this->fd);
+		throw FileError("can't map " + path + ": error " + std::to_string(err));
+	}
+#else
+	this->fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (this->fd < 0) throw FileError("can't open " + path + ": " + std::strerror(errno));
+
+	// Owners and standbys both size the file, so whichever comes first
+	// leaves the other something to map.
+	if (ftruncate(this->fd, sizeof(Layout)) != 0) {
+		const auto err = errno;
+		close(this->fd);
+		throw FileError("can't size " + path + ": " + std::strerror(err));
+	}
+
+	auto raw = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+	if (raw == MAP_FAILED) {
+		const auto err = errno;
+		close(this->fd);
+		throw FileError("can't map " + path + ": " + std::strerror(err));
+	}
+#endif
+
+	// Unlike the shared playhead, whatever is already there may be a dead
+	// owner's last snapshot, which is the whole point; so nothing is reset
+	// until this becomes the owner.
+	this->layout = static_cast<Layout *>(raw);
+}
+
+StateSnapshot::~StateSnapshot()
+{
+	// Withdrawing the snapshot tells standbys we went on purpose.
+	if (this->owned) this->layout->magic.store(0, std::memory_order_relaxed);
+
+#ifdef _WIN32
+	UnmapViewOfFile(this->layout);
+	_close(this->fd);
+#else
+	munmap(this->layout, sizeof(Layout));
+	close(this->fd); // This also frees the lock.
+#endif
+}
+
+bool StateSnapshot::TryOwn()
+{
+	if (this->owned) return true;
+#ifdef _WIN32
+	// Windows locks keep other processes from reading what they cover, so
+	// the lock goes on a byte past the layout, where nobody reads.
+	OVERLAPPED past_layout{};
+	past_layout.Offset = sizeof(Layout);
+	const auto file = reinterpret_cast<HANDLE>(_get_osfhandle(this->fd));
+	if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &past_layout)) return false;
+#else
+	if (flock(this->fd, LOCK_EX | LOCK_NB) != 0) return false;
+#endif
+	this->owned = true;
+
+	// A dead owner's snapshot is kept for us to take over from, unless it
+	// died halfway through publishing it, leaving it torn (and the seqlock
+	// the wrong way round for us); anything else is stale, so start afresh.
+	// The magic only goes in with the first snapshot, so standbys have
+	// nothing to follow until then.
+	if (this->layout->magic.load(std::memory_order_acquire) == MAGIC && this->layout->version == VERSION &&
+	    this->layout->sequence.load(std::memory_order_acquire) % 2 == 0) {
+		return true;
+	}
+	this->layout->magic.store(0, std::memory_order_relaxed);
+	this->layout = new (this->layout) Layout{{0}, VERSION, {0}, {0}, {0}, {0}, {0}, {}};
+	return true;
+}
+
+bool StateSnapshot::Owned() const
+{
+	return this->owned;
+}
+
+void StateSnapshot::Publish(const State &state)
+{
+	Expects(this->owned);
+
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	auto &l = *this->layout;
+
+	// Most snapshots only move the position on, so the text is only
+	// rewritten when it changes.
+	Encode(state, this->scratch);
+	const auto new_text = !this->text_current || this->scratch != this->text;
+	if (new_text) std::swap(this->scratch, this->text);
+	this->text_current = true;
+
+	// Odd while writing; the fence keeps the fields from moving above it.
+	const auto seq = l.sequence.load(std::memory_order_relaxed);
+	l.sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	l.state.store(static_cast<std::uint64_t>(state.state), std::memory_order_relaxed);
+	l.position.store(state.position.count(), std::memory_order_relaxed);
+	l.clock.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+	if (new_text) {
+		l.text_bytes.store(this->text.size(), std::memory_order_relaxed);
+		for (std::size_t i = 0; i * sizeof(std::uint64_t) < this->text.size(); i++) {
+			std::uint64_t word = 0;
+			const auto at = i * sizeof(std::uint64_t);
+			std::memcpy(&word, this->text.data() + at, std::min(sizeof(word), this->text.size() - at));
+			l.text[i].store(word, std::memory_order_relaxed);
+		}
+	}
+
+	l.sequence.store(seq + 2, std::memory_order_release);
+
+	// Only now is there something for standbys to follow.
+	l.magic.store(MAGIC, std::memory_order_release);
+}
+
+std::optional<StateSnapshot::State> StateSnapshot::Read()
+{
+	const auto &l = *this->layout;
+	std::string raw;
+
+	for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+		if (l.magic.load(std::memory_order_acquire) != MAGIC || l.version != VERSION) {
+			this->last_read = std::nullopt;
+			return std::nullopt;
+		}
+
+		const auto before = l.sequence.load(std::memory_order_acquire);
+		if (before % 2 != 0) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		State state{static_cast<Response::Code>(l.state.load(std::memory_order_relaxed)),
+		            std::chrono::microseconds{l.position.load(std::memory_order_relaxed)},
+		            {},
+		            {},
+		            {},
+		            std::chrono::nanoseconds{l.clock.load(std::memory_order_relaxed)}};
+
+		// A torn read can give any size at all, so clamp it, and let the
+		// sequence check throw the text away.
+		const auto bytes = std::min<std::uint64_t>(l.text_bytes.load(std::memory_order_relaxed), TEXT_BYTES);
+		raw.resize(bytes);
+		for (std::size_t i = 0; i * sizeof(std::uint64_t) < bytes; i++) {
+			const auto word = l.text[i].load(std::memory_order_relaxed);
+			const auto at = i * sizeof(std::uint64_t);
+			std::memcpy(raw.data() + at, &word, std::min<std::size_t>(sizeof(word), bytes - at));
+		}
+
+		// The fence keeps the fields from moving below the second check.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (l.sequence.load(std::memory_order_relaxed) != before) continue;
+
+		if (!Decode(raw, state)) return std::nullopt;
+		this->last_read = state;
+		return state;
+	}
+
+	// Either the owner is slow, and the next read will catch up, or it died
+	// mid-publish, and whoever takes over picks up from here.
+	if (this->last_read) return this->last_read;
+	return State{Response::Code::EJECT, std::chrono::microseconds{0}, {}, {}, {}, {}};
+}
+
+/* static */ std::chrono::microseconds StateSnapshot::PositionNow(const State &state)
+{
+	if (state.state != Response::Code::PLAY) return state.position;
+
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	const auto since = std::max(std::chrono::nanoseconds{0}, now - state.clock);
+	return state.position + std::chrono::duration_cast<std::chrono::microseconds>(since);
+}
+
+/* static */ void StateSnapshot::Encode(const State &state, std::string &out)
+{
+	out.clear();
+
+	// A loaded and cued file too long to snapshot leave nothing to follow.
+	if (TEXT_BYTES < state.file.size() + state.cued.size() + 2) return;
+	out.append(state.file).push_back('\0');
+	out.append(state.cued).push_back('\0');
+
+	for (const auto &item : state.queue) {
+		const auto overlap = std::to_string(item.overlap.count());
+		if (TEXT_BYTES < out.size() + overlap.size() + item.path.size() + 2) break;
+		out.append(overlap).push_back('\0');
+		out.append(item.path).push_back('\0');
+	}
+}
+
+/* static */ bool StateSnapshot::Decode(const std::string &text, State &state)
+{
+	// Nothing at all is a snapshot with nothing loaded.
+	if (text.empty()) return true;
+
+	std::vector<std::string_view> fields;
+	std::string_view rest{text};
+	while (!rest.empty()) {
+		const auto end = rest.find('\0');
+		if (end == std::string_view::npos) return false;
+		fields.push_back(rest.substr(0, end));
+		rest.remove_prefix(end + 1);
+	}
+	if (fields.size() < 2 || fields.size() % 2 != 0) return false;
+
+	state.file = fields[0];
+	state.cued = fields[1];
+	for (std::size_t i = 2; i < fields.size(); i += 2) {
+		std::uint32_t overlap = 0;
+		const auto field = fields[i];
+		const auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), overlap);
+		if (ec != std::errc{} || ptr != field.data() + field.size()) return false;
+		state.queue.push_back(QueuedFile{std::string{fields[i + 1]}, std::chrono::milliseconds{overlap}});
+	}
+	return true;
+}
+
+} // namespace Playd
@@ -0,0 +1,173 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the StateSnapshot class.
+ * @see state_snapshot.cpp
+ */
+
+#ifndef PLAYD_STATE_SNAPSHOT_H
+#define PLAYD_STATE_SNAPSHOT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "response.h"
+
+namespace Playd
+{
+/**
+ * Enough of a player's state for a standby playd to take over from it, kept
+ * in a memory-mapped file: the loaded file and its position, whether it is
+ * playing, and the cued and queued files.
+ *
+ * One playd owns the file at a time, by holding an exclusive lock on it, and
+ * is the only one to publish into it.  A standby maps the same file, follows
+ * it (opening and seeking the same files, but never playing them), and takes
+ * the lock when it comes free.  The kernel frees the lock when its owner
+ * dies, however it dies, so takeover needs no heartbeats or timeouts.  An
+ * owner exiting cleanly withdraws its snapshot first, so that standbys carry
+ * on waiting rather than taking over.
+ *
+ * As with SharedPlayhead, the file holds one Layout guarded by a seqlock.
+ */
+class StateSnapshot
+{
+public:
+	/// The magic number at the start of the file ("SNAP", little-endian).
+	static constexpr std::uint32_t MAGIC = 0x50414e53;
+
+	/// The version of the layout, which goes up with incompatible changes.
+	static constexpr std::uint32_t VERSION = 1;
+
+	/// How many 64-bit words the file has for paths.
+	static constexpr std::size_t TEXT_WORDS = 8186;
+
+	/**
+	 * The file's layout, in the host's byte order.
+	 * The paths are packed into lock-free 64-bit atomics for the same
+	 * reason as the other fields: so that readers never see torn values.
+	 */
+	struct Layout {
+		std::atomic<std::uint32_t> magic;              ///< MAGIC, or 0 if there is nothing to follow.
+		std::uint32_t version;                         ///< VERSION.
+		std::atomic<std::uint64_t> sequence;           ///< The seqlock; odd while writing.
+		std::atomic<std::uint64_t> state;              ///< The state, as a Response::Code (EJECT, STOP, PLAY or END).
+		std::atomic<std::int64_t> position;            ///< The loaded file's position, in microseconds.
+		std::atomic<std::int64_t> clock;               ///< When this was published, in steady-clock nanoseconds.
+		std::atomic<std::uint64_t> text_bytes;         ///< How many bytes of text hold paths.
+		std::atomic<std::uint64_t> text[TEXT_WORDS];   ///< The paths; see State.
+	};
+
+	/// A file in the queue.
+	struct QueuedFile {
+		std::string path;                  ///< The path it was queued from.
+		std::chrono::milliseconds overlap; ///< How long it crossfades in over the file before.
+	};
+
+	/// One consistent reading of the snapshot.
+	struct State {
+		Response::Code state;               ///< The state (EJECT, STOP, PLAY or END).
+		std::chrono::microseconds position; ///< The loaded file's position; zero if ejected.
+		std::string file;                   ///< The loaded file's path; empty if ejected.
+		std::string cued;                   ///< The cued file's path; empty if none.
+		std::vector<QueuedFile> queue;      ///< The queue, front first.
+		std::chrono::nanoseconds clock;     ///< When it was published, by the steady clock.
+	};
+
+	/**
+	 * Opens (or creates) the snapshot file and maps it, without owning it.
+	 * @param path The file's path; somewhere in /dev/shm keeps it in memory.
+	 * @exception FileError if the file can't be created or mapped.
+	 */
+	explicit StateSnapshot(const std::string &path);
+
+	/// Destructs a StateSnapshot, withdrawing the snapshot if owned, and
+	/// unmapping (but not removing) the file.
+	~StateSnapshot();
+
+	/// Deleted copy constructor.
+	StateSnapshot(const StateSnapshot &) = delete;
+
+	/// Deleted copy-assignment.
+	StateSnapshot &operator=(const StateSnapshot &) = delete;
+
+	/**
+	 * Tries to become the file's owner, without waiting.
+	 * @return Whether this is now the owner; false if another is.
+	 */
+	bool TryOwn();
+
+	/// @return Whether this owns the file, and so can publish into it.
+	[[nodiscard]] bool Owned() const;
+
+	/**
+	 * Publishes a snapshot.
+	 * Queued files that don't fit in the file are left off the end of the
+	 * queue.  The paths are only rewritten when they change.
+	 * @param state The snapshot; its clock is ignored, and set to now.
+	 */
+	void Publish(const State &state);
+
+	/**
+	 * Reads the snapshot, as a standby would.
+	 * This never waits long on a publish: an owner killed in the middle of
+	 * one leaves it unfinished forever, so after a few tries this gives back
+	 * the last snapshot it read whole instead (or, if there wasn't one,
+	 * an eject, as there is nothing to follow).
+	 * @return The last snapshot published, or nothing if there is none
+	 *   (or it has been withdrawn).
+	 */
+	[[nodiscard]] std::optional<State> Read();
+
+	/**
+	 * Works out where a snapshot's file has got to by now, assuming it has
+	 * played on since the snapshot if it was playing.
+	 * @param state The snapshot.
+	 * @return The position it has reached.
+	 */
+	[[nodiscard]] static std::chrono::microseconds PositionNow(const State &state);
+
+private:
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "state snapshots need lock-free atomics");
+
+	/// The most bytes of text the file holds.
+	static constexpr std::size_t TEXT_BYTES = TEXT_WORDS * sizeof(std::uint64_t);
+
+	/// How many times Read tries for a whole snapshot before giving up.
+	static constexpr int READ_ATTEMPTS = 100;
+
+	int fd;                         ///< The file's descriptor.
+	Layout *layout;                 ///< The file, mapped.
+	bool owned;                     ///< Whether this holds the file's lock.
+	std::string text;               ///< The text last published, if owned.
+	bool text_current;              ///< Whether the file holds text, rather than a dead owner's.
+	std::string scratch;            ///< Scratch space for encoding text.
+	std::optional<State> last_read; ///< The last snapshot read whole, if not owned.
+
+	/**
+	 * Encodes a snapshot's paths as text: the loaded and cued files, then
+	 * each queued file's overlap and path, each ending in a NUL.
+	 * @param state The snapshot.
+	 * @param out The string to encode into, which is cleared first.
+	 */
+	static void Encode(const State &state, std::string &out);
+
+	/**
+	 * Decodes a snapshot's paths from text.
+	 * @param text The text.
+	 * @param state The snapshot to decode into.
+	 * @return Whether the text was well-formed.
+	 */
+	static bool Decode(const std::string &text, State &state);
+};
+
+} // namespace Playd
+
+#endif // PLAYD_STATE_SNAPSHOT_H
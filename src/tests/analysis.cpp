@@ -0,0 +1,82 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for whole-file analysis.
+ */
+
+#include "../audio/analysis.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/silence.h"
+#include "../audio/sources/ram.h"
+#include "../audio/waveform.h"
+#include "catch.hpp"
+#include "pcm_clip.h"
+
+namespace Playd::Tests
+{
+/**
+ * Makes a stereo 16-bit clip at 48kHz, quiet at each end.
+ * @param frames The number of sample frames.
+ * @return The clip.
+ */
+static std::shared_ptr<const Audio::PcmClip> TrackClip(std::size_t frames)
+{
+	std::vector<std::int16_t> samples(frames * 2);
+	for (std::size_t i = frames / 10; i < frames - frames / 5; i++) {
+		samples[2 * i] = static_cast<std::int16_t>(static_cast<std::int32_t>((i * 7919) % 40000) - 20000);
+		samples[2 * i + 1] = static_cast<std::int16_t>(-samples[2 * i] / 2);
+	}
+	return MakeClip("track.wav", 48000, 2, samples);
+}
+
+SCENARIO ("Analysis finds everything the separate scans would, in one decode", "[analysis]") {
+	GIVEN ("a clip spanning many decode chunks") {
+		const auto clip = TrackClip(100000);
+		const auto open = [&clip] { return std::make_unique<Audio::RamSource>(clip); };
+
+		WHEN ("it is analysed for cue points and two waveforms") {
+			Audio::RamSource source{clip};
+			const auto analysis = Audio::Analyse(source, {-60.0, {100, 7}});
+
+			THEN ("it has the clip's length") {
+				REQUIRE(analysis.length == 100000);
+			}
+
+			THEN ("the cue points are those FindCuePoints finds") {
+				Audio::RamSource other{clip};
+				REQUIRE(analysis.cues == Audio::FindCuePoints(other, -60.0));
+			}
+
+			THEN ("the waveforms are those ComputeWaveform finds") {
+				REQUIRE(analysis.waveforms.size() == 2);
+				REQUIRE(analysis.waveforms[0] == Audio::ComputeWaveform(open, 100, 1));
+				REQUIRE(analysis.waveforms[1] == Audio::ComputeWaveform(open, 7, 1));
+			}
+
+			THEN ("it has a loudness") {
+				REQUIRE(analysis.loudness.has_value());
+				REQUIRE(analysis.loudness->integrated < 0.0);
+			}
+		}
+
+		WHEN ("it is analysed for nothing in particular") {
+			Audio::RamSource source{clip};
+			const auto analysis = Audio::Analyse(source, {});
+
+			THEN ("there are no cue points or waveforms") {
+				REQUIRE_FALSE(analysis.cues.has_value());
+				REQUIRE(analysis.waveforms.empty());
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
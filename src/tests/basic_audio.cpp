@@ -7,9 +7,13 @@
  */
 
 #include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <sstream>
 
 #include "../audio/audio.h"
+#include "../audio/decode_scheduler.h"
 #include "catch.hpp"
 #include "dummy_audio_sink.h"
 #include "dummy_audio_source.h"
@@ -86,6 +90,31 @@ SCENARIO ("BasicAudio responds to getters with valid responses", "[basic-audio]"
 	}
 }
 
+SCENARIO ("BasicAudio publishes its position on each update", "[basic-audio]") {
+	GIVEN ("a BasicAudio whose sink we can still move") {
+		auto src = std::make_unique<DummyAudioSource>("test");
+		auto snk = std::make_unique<DummyAudioSink>(*src, 0);
+		auto *sink = snk.get();
+		Audio::BasicAudio pa(std::move(src), std::move(snk));
+
+		WHEN ("the sink moves on, a second's worth of samples") {
+			sink->position = 44100;
+
+			THEN ("the position stays put until the next update") {
+				REQUIRE(pa.Position() == std::chrono::microseconds{0});
+			}
+
+			AND_WHEN ("the audio is updated") {
+				pa.Update();
+
+				THEN ("the position is the sink's, in microseconds") {
+					REQUIRE(pa.Position() == std::chrono::seconds{1});
+				}
+			}
+		}
+	}
+}
+
 SCENARIO ("BasicAudio propagates source emptiness correctly", "[basic-audio]") {
 	GIVEN ("a valid set of dummy components") {
 		auto src = std::make_unique<DummyAudioSource>("test");
@@ -147,4 +176,109 @@ SCENARIO ("BasicAudio acquires state from the sink correctly", "[basic-audio]")
 	}
 }
 
+SCENARIO ("BasicAudio's decode worker reports state changes", "[basic-audio]") {
+	GIVEN ("a BasicAudio whose source has run out, with a decode worker") {
+		auto src = std::make_unique<DummyAudioSource>("test");
+		auto snk = std::make_unique<DummyAudioSink>(*src, 0);
+		snk->state = Audio::Audio::State::STOPPED;
+		src->run_out = true;
+
+		// These must outlive the BasicAudio, as its worker uses them.
+		std::mutex lock;
+		std::condition_variable cv;
+		bool notified{false};
+		Audio::DecodeScheduler scheduler{1};
+
+		Audio::BasicAudio pa(std::move(src), std::move(snk));
+
+		pa.StartWorker(scheduler, [&] {
+			{
+				std::lock_guard guard{lock};
+				notified = true;
+			}
+			cv.notify_one();
+		});
+
+		WHEN ("the worker has had time to notice") {
+			std::unique_lock guard{lock};
+			const auto woke = cv.wait_for(guard, std::chrono::seconds{5}, [&] { return notified; });
+
+			THEN ("the worker has notified us") {
+				REQUIRE(woke);
+			}
+			THEN ("Update() returns AT_END") {
+				REQUIRE(pa.Update() == Audio::Audio::State::AT_END);
+			}
+		}
+	}
+}
+
+/// A DummyAudioSource whose decoding holds on until it is let go.
+class HeldAudioSource : public DummyAudioSource
+{
+public:
+	using DummyAudioSource::DummyAudioSource;
+
+	using DummyAudioSource::Decode;
+
+	Audio::Source::DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		std::unique_lock guard{this->lock};
+		this->decoding = true;
+		this->cv.notify_all();
+		this->cv.wait_for(guard, std::chrono::seconds{5}, [this] { return this->released; });
+		return DummyAudioSource::Decode(out);
+	}
+
+	/**
+	 * Waits for a decode to start.
+	 * @return Whether one did, within five seconds.
+	 */
+	bool WaitForDecode()
+	{
+		std::unique_lock guard{this->lock};
+		return this->cv.wait_for(guard, std::chrono::seconds{5}, [this] { return this->decoding; });
+	}
+
+	/// Lets any decode, now or later, finish.
+	void Release()
+	{
+		{
+			std::lock_guard guard{this->lock};
+			this->released = true;
+		}
+		this->cv.notify_all();
+	}
+
+private:
+	std::mutex lock;             ///< Guards decoding and released.
+	std::condition_variable cv;  ///< Signalled when either changes.
+	bool decoding{false};        ///< Whether a decode has started.
+	bool released{false};        ///< Whether decodes may finish.
+};
+
+SCENARIO ("BasicAudio's updates don't wait for its decode worker", "[basic-audio]") {
+	GIVEN ("a BasicAudio with a decode worker stuck in a decode") {
+		auto src = std::make_unique<HeldAudioSource>("test");
+		auto *held = src.get();
+		auto snk = std::make_unique<DummyAudioSink>(*src, 0);
+
+		Audio::DecodeScheduler scheduler{1};
+		Audio::BasicAudio pa(std::move(src), std::move(snk));
+		pa.StartWorker(scheduler, [] {});
+		const auto release = gsl::finally([held] { held->Release(); });
+		REQUIRE(held->WaitForDecode());
+
+		WHEN ("it is updated") {
+			auto update = std::async(std::launch::async, [&pa] { return pa.Update(); });
+
+			THEN ("the update returns without the decode finishing") {
+				REQUIRE(update.wait_for(std::chrono::seconds{5}) == std::future_status::ready);
+				REQUIRE(update.get() == Audio::Audio::State::STOPPED);
+				REQUIRE(pa.Position() == std::chrono::microseconds{0});
+			}
+		}
+	}
+}
+
 } // namespace Playd::Tests
@@ -0,0 +1,145 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the BufferPolicy class.
+ */
+
+#include "../audio/buffer_policy.h"
+
+#include <chrono>
+#include <cstdint>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+using namespace std::chrono_literals;
+
+/// Makes the outcome of a sink that played for ten seconds.
+static Audio::BufferPolicy::Outcome MakeOutcome(std::chrono::milliseconds capacity, std::chrono::milliseconds lowest,
+                                                std::uint64_t underruns)
+{
+	return Audio::BufferPolicy::Outcome{capacity, lowest, 10s, underruns};
+}
+
+SCENARIO ("BufferPolicies size buffers in time, not bytes", "[buffer-policy]") {
+	GIVEN ("a policy fixed at 250ms") {
+		Audio::BufferPolicy policy{250ms, 250ms};
+
+		THEN ("a 44.1kHz stereo 16-bit sink gets a quarter-second of frames") {
+			REQUIRE(policy.Bytes(44100, 4) == 11025 * 4);
+		}
+
+		THEN ("even a tiny size leaves room for one frame") {
+			REQUIRE(Audio::BufferPolicy::BytesFor(1ms, 100, 8) == 8);
+		}
+
+		WHEN ("a sink reports underruns") {
+			policy.Report(MakeOutcome(250ms, 0ms, 5));
+
+			THEN ("the size doesn't change") {
+				REQUIRE(policy.Size() == 250ms);
+			}
+		}
+	}
+}
+
+SCENARIO ("BufferPolicies adapt to how sinks get on", "[buffer-policy]") {
+	GIVEN ("a policy between 100ms and 1000ms") {
+		Audio::BufferPolicy policy{100ms, 1000ms};
+
+		THEN ("it starts at the largest size") {
+			REQUIRE(policy.Size() == 1000ms);
+		}
+
+		WHEN ("a sink never gets near empty") {
+			policy.Report(MakeOutcome(1000ms, 900ms, 0));
+
+			THEN ("the size shrinks") {
+				REQUIRE(policy.Size() == 750ms);
+			}
+
+			AND_WHEN ("many more sinks do the same") {
+				for (int i = 0; i < 20; i++) policy.Report(MakeOutcome(policy.Size(), policy.Size(), 0));
+
+				THEN ("the size stops at the smallest") {
+					REQUIRE(policy.Size() == 100ms);
+				}
+
+				AND_WHEN ("a sink then underruns") {
+					policy.Report(MakeOutcome(100ms, 0ms, 1));
+
+					THEN ("the size doubles") {
+						REQUIRE(policy.Size() == 200ms);
+					}
+				}
+			}
+		}
+
+		WHEN ("a sink gets close to empty without underrunning") {
+			policy.Report(MakeOutcome(1000ms, 900ms, 0));
+			policy.Report(MakeOutcome(750ms, 50ms, 0));
+
+			THEN ("the size grows, but no further than the largest") {
+				REQUIRE(policy.Size() == 1000ms);
+			}
+		}
+
+		WHEN ("a sink plays for less than a buffer's worth") {
+			policy.Report(Audio::BufferPolicy::Outcome{1000ms, 1000ms, 500ms, 0});
+
+			THEN ("the size doesn't change") {
+				REQUIRE(policy.Size() == 1000ms);
+			}
+		}
+
+		WHEN ("the range is narrowed below the current size") {
+			policy.SetSizes(100ms, 400ms);
+
+			THEN ("the size comes down into it") {
+				REQUIRE(policy.Sizes() == Audio::BufferPolicy::Range{100ms, 400ms});
+				REQUIRE(policy.Size() == 400ms);
+			}
+
+			AND_WHEN ("a sink underruns") {
+				policy.Report(MakeOutcome(400ms, 0ms, 1));
+
+				THEN ("the size grows no further than the new largest") {
+					REQUIRE(policy.Size() == 400ms);
+				}
+			}
+		}
+
+		WHEN ("the range is fixed") {
+			policy.SetSizes(250ms, 250ms);
+
+			THEN ("sinks no longer change the size") {
+				policy.Report(MakeOutcome(250ms, 0ms, 5));
+				REQUIRE(policy.Size() == 250ms);
+			}
+		}
+	}
+}
+
+SCENARIO ("BufferPolicy ranges read and write as MS or MIN-MAX", "[buffer-policy]") {
+	THEN ("a single size is fixed") {
+		REQUIRE(Audio::BufferPolicy::ParseRange("250") == Audio::BufferPolicy::Range{250ms, 250ms});
+		REQUIRE(Audio::BufferPolicy::FormatRange({250ms, 250ms}) == "250");
+	}
+
+	THEN ("two sizes are a range") {
+		REQUIRE(Audio::BufferPolicy::ParseRange("100-1000") == Audio::BufferPolicy::Range{100ms, 1000ms});
+		REQUIRE(Audio::BufferPolicy::FormatRange({100ms, 1000ms}) == "100-1000");
+	}
+
+	THEN ("anything else is refused") {
+		REQUIRE_THROWS_AS(Audio::BufferPolicy::ParseRange("0"), ConfigError);
+		REQUIRE_THROWS_AS(Audio::BufferPolicy::ParseRange("1000-100"), ConfigError);
+		REQUIRE_THROWS_AS(Audio::BufferPolicy::ParseRange("fast"), ConfigError);
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,251 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the ChannelMatrix and RemixedSource classes.
+ */
+
+#include "../audio/channel_matrix.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <gsl/gsl>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "../audio/source.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// -3 dB, as a gain.
+static const auto HALF_POWER = Approx(std::numbers::sqrt2 / 2.0);
+
+/**
+ * Runs one frame through a matrix.
+ * @param m The matrix.
+ * @param in One input sample, a value per channel.
+ * @return The output sample.
+ */
+static std::vector<float> Route(const Audio::ChannelMatrix &m, const std::vector<float> &in)
+{
+	std::vector<float> out(m.OutChannels());
+	m.Apply(in, out);
+	return out;
+}
+
+SCENARIO ("Channel matrices fold and spread channels between SDL's layouts", "[channel-matrix]") {
+	GIVEN ("mono to stereo") {
+		Audio::ChannelMatrix m{1, 2};
+
+		THEN ("the channel goes to both sides at full level") {
+			REQUIRE(Route(m, {0.5F}) == std::vector<float>{0.5F, 0.5F});
+		}
+	}
+
+	GIVEN ("stereo to mono") {
+		Audio::ChannelMatrix m{2, 1};
+
+		THEN ("both sides go into it at -3 dB") {
+			REQUIRE(m.Gain(0, 0) == HALF_POWER);
+			REQUIRE(m.Gain(0, 1) == HALF_POWER);
+		}
+	}
+
+	GIVEN ("stereo to stereo") {
+		Audio::ChannelMatrix m{2, 2};
+
+		THEN ("each side goes straight through") {
+			REQUIRE(Route(m, {0.25F, -0.75F}) == std::vector<float>{0.25F, -0.75F});
+		}
+	}
+
+	GIVEN ("5.1 to stereo") {
+		Audio::ChannelMatrix m{6, 2};
+
+		THEN ("the centre and surrounds fold in at -3 dB, and the LFE is dropped") {
+			REQUIRE(m.Gain(0, 0) == 1.0F);
+			REQUIRE(m.Gain(0, 1) == 0.0F);
+			REQUIRE(m.Gain(0, 2) == HALF_POWER);
+			REQUIRE(m.Gain(1, 2) == HALF_POWER);
+			REQUIRE(m.Gain(0, 3) == 0.0F);
+			REQUIRE(m.Gain(1, 3) == 0.0F);
+			REQUIRE(m.Gain(0, 4) == HALF_POWER);
+			REQUIRE(m.Gain(1, 4) == 0.0F);
+			REQUIRE(m.Gain(1, 5) == HALF_POWER);
+
+			const auto out = Route(m, {0.1F, 0.2F, 0.3F, 0.4F, 0.5F, 0.6F});
+			REQUIRE(out[0] == Approx(0.1 + (0.3 + 0.5) * std::numbers::sqrt2 / 2.0));
+			REQUIRE(out[1] == Approx(0.2 + (0.3 + 0.6) * std::numbers::sqrt2 / 2.0));
+		}
+	}
+
+	GIVEN ("7.1 to 5.1") {
+		Audio::ChannelMatrix m{8, 6};
+
+		THEN ("the sides go into the backs, and the rest goes straight through") {
+			for (std::uint8_t c = 0; c < 6; c++) REQUIRE(m.Gain(c, c) == 1.0F);
+			REQUIRE(m.Gain(4, 6) == 1.0F);
+			REQUIRE(m.Gain(5, 7) == 1.0F);
+		}
+	}
+
+	GIVEN ("stereo to 5.1") {
+		Audio::ChannelMatrix m{2, 6};
+
+		THEN ("only the front left and right play") {
+			REQUIRE(Route(m, {0.5F, -0.5F}) == std::vector<float>{0.5F, -0.5F, 0.0F, 0.0F, 0.0F, 0.0F});
+		}
+	}
+
+	GIVEN ("mono to 5.1") {
+		Audio::ChannelMatrix m{1, 6};
+
+		THEN ("the channel goes to the centre") {
+			REQUIRE(Route(m, {0.5F}) == std::vector<float>{0.0F, 0.0F, 0.5F, 0.0F, 0.0F, 0.0F});
+		}
+	}
+
+	GIVEN ("a matrix with a gain changed") {
+		Audio::ChannelMatrix m{2, 2};
+		m.SetGain(0, 1, 0.5F);
+
+		WHEN ("many frames go through it") {
+			std::vector<float> in;
+			for (int i = 0; i < 1000; i++) {
+				in.push_back(0.25F);
+				in.push_back(0.5F);
+			}
+			std::vector<float> out(in.size());
+			m.Apply(in, out);
+
+			THEN ("every frame is mixed the same") {
+				for (int i = 0; i < 1000; i++) {
+					REQUIRE(out[2 * i] == 0.5F);
+					REQUIRE(out[2 * i + 1] == 0.5F);
+				}
+			}
+		}
+	}
+}
+
+/// A 16-bit source of a fixed number of samples, each channel at its own level.
+class LayoutSource : public Audio::Source
+{
+public:
+	LayoutSource(std::uint8_t channels, std::uint64_t length)
+	    : Audio::Source("layout"), channels{channels}, length{length}, position{0}
+	{
+	}
+
+	using Audio::Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		const auto count = std::min<std::uint64_t>(out.size() / this->BytesPerSample(), this->length - this->position);
+		std::vector<std::int16_t> samples;
+		for (std::uint64_t i = 0; i < count; i++) {
+			for (std::uint8_t c = 0; c < this->channels; c++) {
+				samples.push_back(static_cast<std::int16_t>(1000 * (c + 1)));
+			}
+		}
+		std::memcpy(out.data(), samples.data(), samples.size() * sizeof(std::int16_t));
+		this->position += count;
+
+		const auto state = this->position == this->length ? DecodeState::END_OF_FILE : DecodeState::DECODING;
+		return std::make_pair(state, count * this->BytesPerSample());
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return this->channels;
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return 44100;
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return Audio::SampleFormat::SINT16;
+	}
+
+	std::uint64_t Seek(std::uint64_t new_position) override
+	{
+		this->position = std::min(new_position, this->length);
+		return this->position;
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->length;
+	}
+
+private:
+	std::uint8_t channels;  ///< How many channels there are.
+	std::uint64_t length;   ///< How long the source is, in samples.
+	std::uint64_t position; ///< Where the source is, in samples.
+};
+
+SCENARIO ("RemixedSources deliver any file in a fixed number of channels", "[channel-matrix]") {
+	GIVEN ("a mono file remixed to stereo") {
+		Audio::RemixedSource source{std::make_unique<LayoutSource>(1, 10000), 2};
+
+		THEN ("it is stereo FLOAT32, at the same rate and length") {
+			REQUIRE(source.ChannelCount() == 2);
+			REQUIRE(source.OutputSampleFormat() == Audio::SampleFormat::FLOAT32);
+			REQUIRE(source.SampleRate() == 44100);
+			REQUIRE(source.Length() == 10000);
+		}
+
+		WHEN ("it is all decoded, in a small buffer") {
+			std::vector<std::byte> buffer(source.BytesPerSample() * 300);
+			std::vector<float> all;
+			for (;;) {
+				const auto [state, count] = source.Decode(buffer);
+				const auto *floats = reinterpret_cast<const float *>(buffer.data());
+				all.insert(all.end(), floats, floats + count / sizeof(float));
+				if (state == Audio::Source::DecodeState::END_OF_FILE) break;
+			}
+
+			THEN ("every sample is there, on both sides") {
+				REQUIRE(all.size() == 20000);
+				REQUIRE(all.front() == Approx(1000.0 / 32768.0));
+				REQUIRE(all.back() == Approx(1000.0 / 32768.0));
+			}
+		}
+
+		WHEN ("it is sought") {
+			THEN ("the inner file is sought to the same place") {
+				REQUIRE(source.Seek(2500) == 2500);
+			}
+		}
+	}
+
+	GIVEN ("a 5.1 file remixed to stereo") {
+		Audio::RemixedSource source{std::make_unique<LayoutSource>(6, 100), 2};
+
+		THEN ("it reports converting to FLOAT32, then remixing") {
+			REQUIRE(source.Conversions() == Audio::ConversionList{"s16>f32", "6>2ch"});
+		}
+
+		WHEN ("it is decoded") {
+			std::vector<std::byte> buffer(source.BytesPerSample() * 100);
+			const auto [state, count] = source.Decode(buffer);
+
+			THEN ("each side gets its front, the centre and its surround") {
+				REQUIRE(count == buffer.size());
+				const auto *floats = reinterpret_cast<const float *>(buffer.data());
+				REQUIRE(floats[0] == Approx((1000.0 + (3000.0 + 5000.0) * std::numbers::sqrt2 / 2.0) / 32768.0));
+				REQUIRE(floats[1] == Approx((2000.0 + (3000.0 + 6000.0) * std::numbers::sqrt2 / 2.0) / 32768.0));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,89 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the command table.
+ */
+
+#include "../commands.h"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("FindCommand finds commands by verb and arity", "[commands]") {
+	GIVEN ("playd's command table") {
+		const std::array<std::pair<std::string_view, std::size_t>, 13> expected{{
+		        {"play", 0},
+		        {"stop", 0},
+		        {"end", 0},
+		        {"eject", 0},
+		        {"dump", 0},
+		        {"take", 0},
+		        {"stats", 0},
+		        {"fload", 1},
+		        {"pos", 1},
+		        {"cue", 1},
+		        {"play-at", 1},
+		        {"stop-at", 1},
+		        {"posrate", 1},
+		}};
+
+		THEN ("every command is found with the right arity") {
+			for (const auto &[verb, arity] : expected) {
+				const auto *command = FindCommand(verb, arity);
+				REQUIRE(command != nullptr);
+				REQUIRE(command->verb == verb);
+			}
+		}
+
+		THEN ("commands are not found with the wrong arity") {
+			REQUIRE(FindCommand("play", 1) == nullptr);
+			REQUIRE(FindCommand("fload", 0) == nullptr);
+		}
+
+		THEN ("variadic commands are found with any arity but zero") {
+			for (const std::size_t arity : {1, 2, 100}) {
+				const auto *command = FindCommand("probe", arity);
+				REQUIRE(command != nullptr);
+				REQUIRE(command->arity == Command::VARIADIC);
+			}
+			REQUIRE(FindCommand("probe", 0) == nullptr);
+		}
+
+		THEN ("unknown verbs are not found") {
+			REQUIRE(FindCommand("", 0) == nullptr);
+			REQUIRE(FindCommand("plays", 0) == nullptr);
+			REQUIRE(FindCommand("PLAY", 0) == nullptr);
+		}
+	}
+}
+
+SCENARIO ("Command tables are built at compile time", "[commands]") {
+	GIVEN ("a small table of commands") {
+		static constexpr std::array<Command, 3> commands{{
+		        {"a", 0, nullptr},
+		        {"a", 1, nullptr},
+		        {"b", 0, nullptr},
+		}};
+		static constexpr CommandTable<3> table{commands};
+
+		THEN ("lookups can happen at compile time too") {
+			STATIC_REQUIRE(table.Find("a", 1) != nullptr);
+			STATIC_REQUIRE(table.Find("c", 0) == nullptr);
+		}
+
+		THEN ("the same verb with different arities are different commands") {
+			REQUIRE(table.Find("a", 0)->arity == 0);
+			REQUIRE(table.Find("a", 1)->arity == 1);
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,94 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the ConfigFile class.
+ */
+
+#include "../config_file.h"
+
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Reads a configuration from a string.
+ * @param text The configuration.
+ * @return The ConfigFile.
+ */
+static ConfigFile ReadConfig(std::string_view text)
+{
+	std::istringstream in{std::string{text}};
+	return ConfigFile{in, "test.conf"};
+}
+
+SCENARIO ("ConfigFiles add options to the command line", "[config-file]") {
+	GIVEN ("a file with options, a flag, comments and blank lines") {
+		const auto config = ReadConfig("# A comment\n"
+		                               "buffer = 250-2000\n"
+		                               "\n"
+		                               "  fast-start  \n"
+		                               "update-period=10\n"
+		                               "devices = 0,1\n"
+		                               "port = 1351\n");
+
+		WHEN ("they are added to a command line with none of them") {
+			std::vector<std::string_view> args{"playd", "2"};
+			config.AddOptionsTo(args);
+
+			THEN ("each option is added, as the command line would give it") {
+				REQUIRE(args == std::vector<std::string_view>{"playd", "2", "--buffer=250-2000", "--fast-start",
+				                                              "--update-period=10"});
+			}
+		}
+
+		WHEN ("they are added to a command line with some of them") {
+			std::vector<std::string_view> args{"playd", "--buffer=500", "--fast-start", "2"};
+			config.AddOptionsTo(args);
+
+			THEN ("the command line's win") {
+				REQUIRE(args == std::vector<std::string_view>{"playd", "--buffer=500", "--fast-start", "2",
+				                                              "--update-period=10"});
+			}
+		}
+
+		THEN ("the positional arguments are kept apart") {
+			REQUIRE(config.Positional("devices") == "0,1");
+			REQUIRE(config.Positional("port") == "1351");
+			REQUIRE(!config.Positional("host"));
+		}
+	}
+
+	GIVEN ("a file with an option whose name starts another's") {
+		const auto config = ReadConfig("listen-backlog = 64\n");
+
+		WHEN ("it is added to a command line with the other") {
+			std::vector<std::string_view> args{"playd", "--listen=[::]:1350", "0"};
+			config.AddOptionsTo(args);
+
+			THEN ("it is still added") {
+				REQUIRE(args.back() == "--listen-backlog=64");
+			}
+		}
+	}
+
+	THEN ("invalid lines are refused, with where they are") {
+		REQUIRE_THROWS_AS(ReadConfig("--buffer = 250\n"), ConfigError);
+		REQUIRE_THROWS_AS(ReadConfig("Buffer = 250\n"), ConfigError);
+		REQUIRE_THROWS_AS(ReadConfig("buffer =\n"), ConfigError);
+		REQUIRE_THROWS_AS(ReadConfig("host\n"), ConfigError);
+		REQUIRE_THROWS_WITH(ReadConfig("buffer = 250\n\nbuffer = 500\n"), "test.conf:3: buffer is set twice");
+	}
+
+	THEN ("a missing file is refused") {
+		REQUIRE_THROWS_AS(ConfigFile{"/nonexistent/playd.conf"}, ConfigError);
+	}
+}
+
+} // namespace Playd::Tests
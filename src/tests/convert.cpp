@@ -0,0 +1,356 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for sample format conversion.
+ */
+
+#include "../audio/convert.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <gsl/gsl>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Converts a vector of samples of one type into a vector of another.
+template <typename To, typename From>
+static std::vector<To> Convert(Audio::SampleFormat from, Audio::SampleFormat to, const std::vector<From> &in)
+{
+	std::vector<To> out(in.size());
+	const gsl::span<const std::byte> src(reinterpret_cast<const std::byte *>(in.data()), in.size() * sizeof(From));
+	const gsl::span<std::byte> dest(reinterpret_cast<std::byte *>(out.data()), out.size() * sizeof(To));
+	Audio::ConvertSamples(from, to, src, dest);
+	return out;
+}
+
+SCENARIO ("Sample conversion maps known values", "[convert]") {
+	using SF = Audio::SampleFormat;
+
+	// 19 samples covers one or two whole vectors and a scalar tail on
+	// every kernel.
+	GIVEN ("a run of 16-bit samples that is not a whole number of vectors") {
+		std::vector<std::int16_t> in(19, 0);
+		in[0] = 16384;
+		in[1] = -32768;
+		in[17] = 32767;
+		in[18] = -16384;
+
+		WHEN ("the samples are converted to floats") {
+			auto out = Convert<float>(SF::SINT16, SF::FLOAT32, in);
+
+			THEN ("each sample is scaled into [-1, 1]") {
+				REQUIRE(out[0] == 0.5f);
+				REQUIRE(out[1] == -1.0f);
+				REQUIRE(out[2] == 0.0f);
+				REQUIRE(out[17] == 32767.0f / 32768.0f);
+				REQUIRE(out[18] == -0.5f);
+			}
+
+			AND_WHEN ("the floats are converted back") {
+				auto back = Convert<std::int16_t>(SF::FLOAT32, SF::SINT16, out);
+
+				THEN ("the original samples come back") {
+					REQUIRE(back == in);
+				}
+			}
+		}
+
+		WHEN ("the samples are widened to 32 bits and narrowed again") {
+			auto wide = Convert<std::int32_t>(SF::SINT16, SF::SINT32, in);
+			auto back = Convert<std::int16_t>(SF::SINT32, SF::SINT16, wide);
+
+			THEN ("the widened samples are shifted into the top half") {
+				REQUIRE(wide[0] == 16384 * 65536);
+				REQUIRE(wide[1] == INT32_MIN);
+				REQUIRE(wide[18] == -16384 * 65536);
+			}
+
+			THEN ("the original samples come back") {
+				REQUIRE(back == in);
+			}
+		}
+	}
+
+	GIVEN ("a run of 32-bit samples that is not a whole number of vectors") {
+		std::vector<std::int32_t> in(11, 0);
+		in[0] = INT32_MIN;
+		in[1] = 1 << 30;
+		in[10] = -(1 << 29);
+
+		WHEN ("the samples are converted to floats and back") {
+			auto out = Convert<float>(SF::SINT32, SF::FLOAT32, in);
+			auto back = Convert<std::int32_t>(SF::FLOAT32, SF::SINT32, out);
+
+			THEN ("the floats are scaled into [-1, 1]") {
+				REQUIRE(out[0] == -1.0f);
+				REQUIRE(out[1] == 0.5f);
+				REQUIRE(out[10] == -0.25f);
+			}
+
+			THEN ("exactly representable samples come back") {
+				REQUIRE(back == in);
+			}
+		}
+	}
+
+	GIVEN ("8-bit samples") {
+		std::vector<std::uint8_t> u{0, 128, 192};
+		std::vector<std::int8_t> s{-128, 0, 64};
+
+		WHEN ("they are converted to floats") {
+			auto uout = Convert<float>(SF::UINT8, SF::FLOAT32, u);
+			auto sout = Convert<float>(SF::SINT8, SF::FLOAT32, s);
+
+			THEN ("both signednesses give the same floats") {
+				REQUIRE(uout == std::vector<float>{-1.0f, 0.0f, 0.5f});
+				REQUIRE(sout == uout);
+			}
+		}
+	}
+}
+
+SCENARIO ("Sample conversion saturates out-of-range floats", "[convert]") {
+	using SF = Audio::SampleFormat;
+
+	GIVEN ("floats at and beyond full scale, spread over vector and tail") {
+		std::vector<float> in(13, 0.0f);
+		in[0] = 1.0f;
+		in[1] = -1.0f;
+		in[2] = 4.0f;
+		in[3] = -4.0f;
+		in[10] = 1.5f;
+		in[11] = -1.5f;
+		in[12] = 1.0f;
+
+		WHEN ("the floats are converted to 16-bit samples") {
+			auto out = Convert<std::int16_t>(SF::FLOAT32, SF::SINT16, in);
+
+			THEN ("the samples clamp to the 16-bit range") {
+				REQUIRE(out[0] == INT16_MAX);
+				REQUIRE(out[1] == INT16_MIN);
+				REQUIRE(out[2] == INT16_MAX);
+				REQUIRE(out[3] == INT16_MIN);
+				REQUIRE(out[10] == INT16_MAX);
+				REQUIRE(out[11] == INT16_MIN);
+				REQUIRE(out[12] == INT16_MAX);
+			}
+		}
+
+		WHEN ("the floats are converted to 32-bit samples") {
+			auto out = Convert<std::int32_t>(SF::FLOAT32, SF::SINT32, in);
+
+			THEN ("the samples clamp to the 32-bit range") {
+				REQUIRE(out[0] == out[12]);
+				REQUIRE(out[0] > INT32_MAX - 256);
+				REQUIRE(out[1] == INT32_MIN);
+				REQUIRE(out[2] == out[0]);
+				REQUIRE(out[3] == INT32_MIN);
+				REQUIRE(out[10] == out[0]);
+				REQUIRE(out[11] == INT32_MIN);
+			}
+		}
+	}
+}
+
+SCENARIO ("Sample conversion rejects unsupported pairs", "[convert]") {
+	using SF = Audio::SampleFormat;
+
+	GIVEN ("a conversion into 8-bit samples") {
+		std::vector<std::byte> in(4);
+		std::vector<std::byte> out(1);
+
+		THEN ("CanConvert says it is unsupported") {
+			REQUIRE_FALSE(Audio::CanConvert(SF::FLOAT32, SF::UINT8));
+			REQUIRE(Audio::CanConvert(SF::UINT8, SF::FLOAT32));
+			REQUIRE(Audio::CanConvert(SF::SINT16, SF::SINT16));
+		}
+
+		WHEN ("ConvertSamples is asked to do it anyway") {
+			THEN ("an InternalError is raised") {
+				REQUIRE_THROWS_AS(Audio::ConvertSamples(SF::FLOAT32, SF::UINT8, in, out), InternalError);
+			}
+		}
+	}
+}
+
+SCENARIO ("Looked-up conversions match ConvertSamples", "[convert]") {
+	using SF = Audio::SampleFormat;
+
+	GIVEN ("a run of 16-bit samples") {
+		const std::vector<std::int16_t> in{16384, -32768, 0, 32767, -16384};
+
+		WHEN ("the conversion to floats is looked up and run") {
+			const auto convert = Audio::FindConverter(SF::SINT16, SF::FLOAT32);
+			REQUIRE(convert != nullptr);
+			std::vector<float> out(in.size());
+			convert(reinterpret_cast<const std::byte *>(in.data()), reinterpret_cast<std::byte *>(out.data()),
+			        in.size());
+
+			THEN ("it gives the same samples as ConvertSamples") {
+				REQUIRE(out == Convert<float>(SF::SINT16, SF::FLOAT32, in));
+			}
+		}
+
+		WHEN ("the conversion to the same format is looked up and run") {
+			std::vector<std::int16_t> out(in.size());
+			Audio::FindConverter(SF::SINT16, SF::SINT16)(reinterpret_cast<const std::byte *>(in.data()),
+			                                             reinterpret_cast<std::byte *>(out.data()), in.size());
+
+			THEN ("the samples are copied") {
+				REQUIRE(out == in);
+			}
+		}
+	}
+
+	GIVEN ("an unsupported pair of formats") {
+		THEN ("there is no conversion to look up") {
+			REQUIRE(Audio::FindConverter(SF::FLOAT32, SF::UINT8) == nullptr);
+			REQUIRE(Audio::FindConverter(SF::SINT16, SF::SINT8) == nullptr);
+		}
+	}
+}
+
+SCENARIO ("Sample mixing applies per-channel gains", "[convert]") {
+	// 19 stereo frames cover whole vector runs and a scalar tail on every
+	// kernel; the gains and samples are exact in binary, so the vector and
+	// scalar code must agree to the bit.
+	GIVEN ("a stereo mix bed and a stereo voice") {
+		std::vector<float> bed(38);
+		std::vector<float> voice(38);
+		for (std::size_t i = 0; i < bed.size(); i++) {
+			bed[i] = 0.125f;
+			voice[i] = (i % 2 == 0) ? 1.0f : -0.5f;
+		}
+		const std::vector<float> gains{0.5f, 0.25f};
+
+		WHEN ("the voice is mixed into the bed") {
+			const gsl::span<const std::byte> src(reinterpret_cast<const std::byte *>(voice.data()),
+			                                     voice.size() * sizeof(float));
+			const gsl::span<std::byte> dest(reinterpret_cast<std::byte *>(bed.data()), bed.size() * sizeof(float));
+			Audio::MixSamples(src, dest, gains);
+
+			THEN ("each channel is scaled by its own gain and summed") {
+				for (std::size_t i = 0; i < bed.size(); i += 2) {
+					REQUIRE(bed[i] == 0.625f);
+					REQUIRE(bed[i + 1] == 0.0f);
+				}
+			}
+		}
+	}
+
+	GIVEN ("more channels than the vector kernels handle") {
+		const std::size_t channels = Audio::MIX_MAX_CHANNELS + 1;
+		std::vector<float> bed(channels * 3, 0.0f);
+		std::vector<float> voice(channels * 3, 1.0f);
+		std::vector<float> gains(channels);
+		for (std::size_t c = 0; c < channels; c++) gains[c] = static_cast<float>(c);
+
+		WHEN ("the voice is mixed into the bed") {
+			const gsl::span<const std::byte> src(reinterpret_cast<const std::byte *>(voice.data()),
+			                                     voice.size() * sizeof(float));
+			const gsl::span<std::byte> dest(reinterpret_cast<std::byte *>(bed.data()), bed.size() * sizeof(float));
+			Audio::MixSamples(src, dest, gains);
+
+			THEN ("the scalar code still applies each gain") {
+				for (std::size_t i = 0; i < bed.size(); i++) REQUIRE(bed[i] == static_cast<float>(i % channels));
+			}
+		}
+	}
+}
+
+/// Views a vector of samples as bytes.
+template <typename T>
+static gsl::span<std::byte> Bytes(std::vector<T> &samples)
+{
+	return gsl::span<std::byte>(reinterpret_cast<std::byte *>(samples.data()), samples.size() * sizeof(T));
+}
+
+SCENARIO ("Gains ramp and saturate samples in place", "[convert]") {
+	// As with mixing, 19 stereo frames reach the scalar tail of every
+	// kernel, and the ramp is exact in binary.
+	GIVEN ("19 stereo frames of floats") {
+		std::vector<float> samples(38, 0.5f);
+
+		WHEN ("a ramp up from unity is applied") {
+			Audio::ApplyGain(Audio::SampleFormat::FLOAT32, 2, Bytes(samples), 1.0f, 0.0625f);
+
+			THEN ("each frame gets its own gain, on both channels") {
+				for (std::size_t i = 0; i < samples.size(); i++) {
+					REQUIRE(samples[i] == 0.5f * (1.0f + (0.0625f * static_cast<float>(i / 2))));
+				}
+			}
+		}
+	}
+
+	GIVEN ("19 stereo frames of 16-bit integers") {
+		std::vector<std::int16_t> samples(38);
+		for (std::size_t i = 0; i < samples.size(); i++) {
+			samples[i] = (i % 3 == 0) ? 20000 : (i % 3 == 1) ? -20000 : 100;
+		}
+
+		WHEN ("they are doubled") {
+			Audio::ApplyGain(Audio::SampleFormat::SINT16, 2, Bytes(samples), 2.0f, 0.0f);
+
+			THEN ("loud samples saturate, and quiet ones double") {
+				for (std::size_t i = 0; i < samples.size(); i++) {
+					const std::int16_t expected = (i % 3 == 0) ? 32767 : (i % 3 == 1) ? -32768 : 200;
+					REQUIRE(samples[i] == expected);
+				}
+			}
+		}
+	}
+
+	GIVEN ("mono 32-bit integers and unsigned 8-bit samples") {
+		std::vector<std::int32_t> wide{INT32_MAX, INT32_MIN, 3};
+		std::vector<std::uint8_t> narrow{255, 0, 128};
+
+		WHEN ("they are halved") {
+			Audio::ApplyGain(Audio::SampleFormat::SINT32, 1, Bytes(wide), 0.5f, 0.0f);
+			Audio::ApplyGain(Audio::SampleFormat::UINT8, 1, Bytes(narrow), 0.5f, 0.0f);
+
+			THEN ("they keep their centres and round to nearest even") {
+				REQUIRE(wide == std::vector<std::int32_t>{1073741824, -1073741824, 2});
+				REQUIRE(narrow == std::vector<std::uint8_t>{192, 64, 128});
+			}
+		}
+	}
+}
+
+SCENARIO ("Loud sample scans find the ends of the loud part", "[convert]") {
+	GIVEN ("19 samples, loud only at 5 and 13") {
+		std::vector<float> samples(19, 0.0005f);
+		samples[2] = -0.001f;
+		samples[5] = -0.25f;
+		samples[13] = 0.002f;
+		samples[17] = std::nanf("");
+
+		WHEN ("they are scanned at -60 dBFS") {
+			const auto [first, end] = Audio::FindLoud(samples, 0.001f);
+
+			THEN ("the loud part runs from 5 to 13, whichever sign, ignoring NaN and the level itself") {
+				REQUIRE(first == 5);
+				REQUIRE(end == 14);
+			}
+		}
+
+		WHEN ("they are scanned at a level none of them reach") {
+			const auto [first, end] = Audio::FindLoud(samples, 0.5f);
+
+			THEN ("there is no loud part") {
+				REQUIRE(first == samples.size());
+				REQUIRE(end == samples.size());
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,146 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the coroutine types.
+ */
+
+#include "../coro.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <uv.h>
+
+#include "../errors.h"
+#include "../io.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Waits on some work, noting what comes back.
+ * @param run The background runner.
+ * @param work The work.
+ * @param log Where to note what happens.
+ * @return The coroutine.
+ */
+static Coro::Task AwaitWork(const Coro::RunFn &run, std::function<int()> work, std::vector<std::string> &log)
+{
+	log.emplace_back("started");
+	Coro::InBackground<int> working{run, std::move(work)};
+	try {
+		const auto result = co_await working;
+		log.push_back("got " + std::to_string(result));
+	} catch (FileError &e) {
+		log.push_back("threw " + std::string{e.Message()});
+	}
+}
+
+/**
+ * Sleeps on a loop, noting when it wakes.
+ * @param loop The loop to sleep on.
+ * @param log Where to note what happens.
+ * @return The coroutine.
+ */
+static Coro::Task SleepOn(uv_loop_t *loop, std::vector<std::string> &log)
+{
+	log.emplace_back("sleeping");
+	co_await IO::Sleep{loop, std::chrono::milliseconds{10}};
+	log.emplace_back("woke");
+}
+
+SCENARIO ("Tasks wait on background work", "[coro]") {
+	GIVEN ("a runner that holds work back until asked") {
+		std::vector<std::pair<std::function<void()>, std::function<void()>>> queued;
+		const Coro::RunFn run = [&queued](auto work, auto done) { queued.emplace_back(work, done); };
+		std::vector<std::string> log;
+
+		WHEN ("a task waits on work that returns") {
+			AwaitWork(run, [] { return 42; }, log);
+
+			THEN ("it runs up to the wait, and no further") {
+				REQUIRE(log == std::vector<std::string>{"started"});
+				REQUIRE(queued.size() == 1);
+			}
+
+			AND_WHEN ("the work runs, but isn't done yet") {
+				queued[0].first();
+
+				THEN ("the task is still waiting") {
+					REQUIRE(log == std::vector<std::string>{"started"});
+				}
+
+				AND_WHEN ("it is done") {
+					queued[0].second();
+
+					THEN ("the task carries on with the result") {
+						REQUIRE(log == std::vector<std::string>{"started", "got 42"});
+					}
+				}
+			}
+		}
+
+		WHEN ("a task waits on work that throws") {
+			AwaitWork(run, []() -> int { throw FileError("gone"); }, log);
+			queued[0].first();
+			queued[0].second();
+
+			THEN ("the task catches what it threw") {
+				REQUIRE(log == std::vector<std::string>{"started", "threw gone"});
+			}
+		}
+	}
+
+	GIVEN ("a runner that does everything at once") {
+		const Coro::RunFn run = [](auto work, auto done) {
+			work();
+			done();
+		};
+		std::vector<std::string> log;
+
+		WHEN ("a task waits on work") {
+			AwaitWork(run, [] { return 7; }, log);
+
+			THEN ("it has finished by the time it returns") {
+				REQUIRE(log == std::vector<std::string>{"started", "got 7"});
+			}
+		}
+	}
+}
+
+SCENARIO ("Tasks sleep on a libuv loop", "[coro]") {
+	GIVEN ("a loop, and a task sleeping on it") {
+		uv_loop_t loop;
+		REQUIRE(uv_loop_init(&loop) == 0);
+		bool closed = false;
+		std::vector<std::string> log;
+		SleepOn(&loop, log);
+
+		THEN ("the task waits for the loop") {
+			REQUIRE(log == std::vector<std::string>{"sleeping"});
+		}
+
+		WHEN ("the loop runs until it has nothing left to do") {
+			uv_run(&loop, UV_RUN_DEFAULT);
+
+			THEN ("the task has woken, and its timer is closed") {
+				REQUIRE(log == std::vector<std::string>{"sleeping", "woke"});
+				REQUIRE(uv_loop_close(&loop) == 0);
+				closed = true;
+			}
+		}
+
+		// Sections that didn't wake the task still have to let it go.
+		if (!closed) {
+			uv_run(&loop, UV_RUN_DEFAULT);
+			uv_loop_close(&loop);
+		}
+	}
+}
+
+} // namespace Playd::Tests
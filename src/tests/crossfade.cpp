@@ -0,0 +1,116 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the CrossfadeSource class.
+ */
+
+#include "../audio/crossfade.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sample_format.h"
+#include "../audio/sources/ram.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Makes a source over a mono FLOAT32 clip, at 1kHz, of one level throughout.
+ * @param path The clip's path.
+ * @param frames How long the clip is, in samples.
+ * @param level The level of every sample.
+ * @return The source.
+ */
+static std::unique_ptr<Audio::Source> Level(std::string path, std::size_t frames, float level)
+{
+	auto clip = std::make_shared<Audio::PcmClip>();
+	clip->path = std::move(path);
+	clip->rate = 1000;
+	clip->channels = 1;
+	clip->format = Audio::SampleFormat::FLOAT32;
+	clip->samples.resize(frames * sizeof(float));
+	for (std::size_t i = 0; i < frames; i++) std::memcpy(clip->samples.data() + i * sizeof(float), &level, sizeof(float));
+	return std::make_unique<Audio::RamSource>(std::move(clip));
+}
+
+/**
+ * Decodes some of a mono FLOAT32 source.
+ * @param source The source.
+ * @param frames How many samples to decode.
+ * @return The samples.
+ */
+static std::vector<float> Take(Audio::Source &source, std::size_t frames)
+{
+	std::vector<float> samples(frames);
+	const auto [state, bytes] =
+	        source.Decode(gsl::span<std::byte>{reinterpret_cast<std::byte *>(samples.data()), frames * sizeof(float)});
+	samples.resize(bytes / sizeof(float));
+	return samples;
+}
+
+SCENARIO ("CrossfadeSources mix the end of one file into the start of another", "[crossfade]") {
+	GIVEN ("a one-second crossfade from the last second of a quiet file into a loud one") {
+		auto tail = Level("quiet.wav", 3000, 0.5F);
+		auto inner = Level("loud.wav", 4000, 1.0F);
+		REQUIRE(Audio::CrossfadeSource::CanMix(*tail, *inner));
+		Audio::CrossfadeSource source{std::move(inner), std::move(tail), std::chrono::seconds{2},
+		                              std::chrono::seconds{1}};
+
+		THEN ("it looks like the file being faded into") {
+			REQUIRE(source.Path() == "loud.wav");
+			REQUIRE(source.Length() == 4000);
+			REQUIRE(source.SampleRate() == 1000);
+		}
+
+		WHEN ("the overlap, and a little more, is decoded") {
+			const auto samples = Take(source, 1500);
+
+			THEN ("the two are mixed along equal-power curves, then the new file plays alone") {
+				REQUIRE(samples.size() == 1500);
+				REQUIRE(samples[0] == Approx(0.5).margin(1e-6));
+				REQUIRE(samples[512] == Approx(std::sqrt(0.512) + 0.5 * std::sqrt(0.488)).margin(1e-6));
+				REQUIRE(samples[1200] == 1.0F);
+				REQUIRE(samples.back() == 1.0F);
+			}
+
+			AND_WHEN ("the source seeks back to the start") {
+				source.Seek(0);
+
+				THEN ("the overlap is mixed in again") {
+					REQUIRE(Take(source, 1)[0] == Approx(0.5).margin(1e-6));
+				}
+			}
+		}
+
+		WHEN ("the source seeks past the start") {
+			source.Seek(200);
+
+			THEN ("it plays as the new file, with no overlap") {
+				REQUIRE(Take(source, 1)[0] == 1.0F);
+			}
+		}
+	}
+
+	GIVEN ("sources at different rates") {
+		auto tail = Level("quiet.wav", 3000, 0.5F);
+		auto clip = std::make_shared<Audio::PcmClip>();
+		clip->rate = 2000;
+		clip->channels = 1;
+		clip->format = Audio::SampleFormat::FLOAT32;
+		Audio::RamSource inner{clip};
+
+		THEN ("they can't be mixed") {
+			REQUIRE_FALSE(Audio::CrossfadeSource::CanMix(*tail, inner));
+		}
+	}
+}
+
+} // namespace Playd::Tests
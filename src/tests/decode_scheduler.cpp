@@ -0,0 +1,145 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the DecodeScheduler class.
+ */
+
+#include "../audio/decode_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// A job that records when it runs, and can be made to block.
+class RecordingJob : public Audio::DecodeScheduler::Job
+{
+public:
+	/**
+	 * Constructs a RecordingJob.
+	 * @param name The name to record the job's rounds under.
+	 * @param headroom What the job says its headroom is.
+	 * @param log The log to record rounds in, with its lock.
+	 */
+	RecordingJob(std::string name, std::chrono::microseconds headroom, std::vector<std::string> &log,
+	             std::mutex &lock, std::condition_variable &cv)
+	    : name{std::move(name)}, headroom{headroom}, log{log}, lock{lock}, cv{cv}
+	{
+	}
+
+	std::chrono::microseconds Headroom() override
+	{
+		return this->headroom;
+	}
+
+	void Run() override
+	{
+		std::unique_lock guard{this->lock};
+		this->log.push_back(this->name);
+		this->cv.notify_all();
+		this->cv.wait(guard, [&] { return !this->blocked; });
+	}
+
+	bool blocked{false}; ///< Whether Run() waits; guarded by the lock.
+
+private:
+	std::string name;                    ///< The job's name.
+	std::chrono::microseconds headroom;  ///< The job's headroom.
+	std::vector<std::string> &log;       ///< Where rounds are recorded.
+	std::mutex &lock;                    ///< Guards the log and blocked.
+	std::condition_variable &cv;         ///< Signals changes to either.
+};
+
+SCENARIO ("DecodeSchedulers run the most urgent job first", "[decode-scheduler]") {
+	GIVEN ("a one-worker scheduler, busy with a job that blocks") {
+		std::vector<std::string> log;
+		std::mutex lock;
+		std::condition_variable cv;
+
+		RecordingJob blocker{"blocker", std::chrono::seconds{1}, log, lock, cv};
+		RecordingJob relaxed{"relaxed", std::chrono::milliseconds{500}, log, lock, cv};
+		RecordingJob starving{"starving", std::chrono::milliseconds{1}, log, lock, cv};
+
+		Audio::DecodeScheduler scheduler{1};
+		blocker.blocked = true;
+		scheduler.Add(blocker);
+		{
+			std::unique_lock guard{lock};
+			REQUIRE(cv.wait_for(guard, std::chrono::seconds{5}, [&] { return !log.empty(); }));
+		}
+
+		WHEN ("a relaxed job and then a starving one are added, and the blocker lets go") {
+			scheduler.Add(relaxed);
+			scheduler.Add(starving);
+			{
+				std::lock_guard guard{lock};
+				blocker.blocked = false;
+			}
+			cv.notify_all();
+
+			// Polling can run the jobs again, so only their first rounds
+			// are in any particular order.
+			const auto first = [&](const std::string &name) { return std::find(log.begin(), log.end(), name); };
+			std::unique_lock guard{lock};
+			REQUIRE(cv.wait_for(guard, std::chrono::seconds{5}, [&] { return first("relaxed") != log.end(); }));
+
+			THEN ("the starving job runs before the relaxed one") {
+				REQUIRE(log[0] == "blocker");
+				REQUIRE(first("starving") < first("relaxed"));
+			}
+		}
+
+		// Removing waits for any running round, so blocked jobs must go.
+		{
+			std::lock_guard guard{lock};
+			blocker.blocked = false;
+		}
+		cv.notify_all();
+		scheduler.Remove(blocker);
+		scheduler.Remove(relaxed);
+		scheduler.Remove(starving);
+	}
+}
+
+SCENARIO ("DecodeSchedulers stop running jobs once they are removed", "[decode-scheduler]") {
+	GIVEN ("a scheduler with a job that has run") {
+		std::vector<std::string> log;
+		std::mutex lock;
+		std::condition_variable cv;
+		RecordingJob job{"job", {}, log, lock, cv};
+
+		Audio::DecodeScheduler scheduler{2};
+		scheduler.Add(job);
+		{
+			std::unique_lock guard{lock};
+			REQUIRE(cv.wait_for(guard, std::chrono::seconds{5}, [&] { return !log.empty(); }));
+		}
+
+		WHEN ("the job is removed, and then woken") {
+			scheduler.Remove(job);
+			const auto runs = [&] {
+				std::lock_guard guard{lock};
+				return log.size();
+			}();
+			scheduler.Wake(job);
+			std::this_thread::sleep_for(Audio::DecodeScheduler::POLL_PERIOD * 4);
+
+			THEN ("it doesn't run again") {
+				std::lock_guard guard{lock};
+				REQUIRE(log.size() == runs);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,89 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the DriftResampler class.
+ */
+
+#include "../audio/drift_resampler.h"
+
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <vector>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("DriftResamplers stretch their input by their step", "[drift-resampler]") {
+	GIVEN ("a stereo drift resampler, and a second of a stereo sine") {
+		Audio::DriftResampler r{2};
+		std::vector<float> in(2 * 1000);
+		for (std::size_t i = 0; i < 1000; i++) {
+			in[2 * i] = static_cast<float>(std::sin(2.0 * std::numbers::pi * static_cast<double>(i) / 50.0));
+			in[2 * i + 1] = -in[2 * i];
+		}
+		std::vector<float> out;
+
+		WHEN ("it resamples at a step of 1") {
+			r.Process(in, out);
+
+			THEN ("the input comes out untouched, but for its last two samples") {
+				REQUIRE(out.size() == in.size() - 4);
+				for (std::size_t i = 0; i < out.size(); i++) REQUIRE(out[i] == in[i]);
+				REQUIRE(r.Produced() == 998);
+				REQUIRE(r.Consumed() == 998.0);
+			}
+
+			AND_WHEN ("more input follows") {
+				r.Process(in, out);
+
+				THEN ("the samples held back come out first") {
+					REQUIRE(out.size() == 2 * in.size() - 4);
+					REQUIRE(out[1996] == in[1996]);
+					REQUIRE(out[2000] == in[0]);
+				}
+			}
+
+			AND_WHEN ("it is reset") {
+				r.Reset();
+
+				THEN ("it starts again from nothing") {
+					REQUIRE(r.Produced() == 0);
+					REQUIRE(r.Consumed() == 0.0);
+				}
+			}
+		}
+
+		WHEN ("it resamples at a step of a half") {
+			r.SetStep(0.5);
+			r.Process(in, out);
+
+			THEN ("there are about twice as many samples, on the same curve") {
+				REQUIRE(out.size() / 2 == Approx(2000).margin(6));
+				for (std::size_t i = 0; i < out.size() / 2; i++) {
+					const auto expected = std::sin(2.0 * std::numbers::pi * static_cast<double>(i) / 100.0);
+					REQUIRE(out[2 * i] == Approx(expected).margin(0.01));
+					REQUIRE(out[2 * i + 1] == -out[2 * i]);
+				}
+				REQUIRE(r.Consumed() == Approx(static_cast<double>(r.Produced()) / 2));
+			}
+		}
+
+		WHEN ("it resamples in small pieces, at a step a little over 1") {
+			r.SetStep(1.001);
+			for (std::size_t i = 0; i < in.size(); i += 10) {
+				r.Process(gsl::span<const float>{in}.subspan(i, 10), out);
+			}
+
+			THEN ("it loses a sample or so, and goes through as much input as it says") {
+				REQUIRE(out.size() / 2 == Approx(997).margin(1));
+				REQUIRE(r.Consumed() == Approx(1.001 * static_cast<double>(r.Produced())));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -8,6 +8,7 @@
  * @see tests/dummy_audio_sink.cpp
  */
 
+#include <atomic>
 #include <cstdint>
 
 #include "../audio/sink.h"
@@ -41,7 +42,8 @@ public:
 	size_t Transfer(gsl::span<const std::byte> src) override;
 
 	/// The current state of the sink.
-	Audio::Sink::State state = Audio::Sink::State::STOPPED;
+	/// This is atomic so that tests can poke it under a decode worker.
+	std::atomic<Audio::Sink::State> state = Audio::Sink::State::STOPPED;
 
 	/// The current position, in samples.
 	uint64_t position = 0;
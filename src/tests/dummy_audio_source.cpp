@@ -17,10 +17,10 @@
 
 namespace Playd::Tests
 {
-Audio::Source::DecodeResult DummyAudioSource::Decode()
+Audio::Source::DecodeSpanResult DummyAudioSource::Decode(gsl::span<std::byte>)
 {
 	auto state = run_out ? Audio::Source::DecodeState::END_OF_FILE : Audio::Source::DecodeState::DECODING;
-	return std::make_pair(state, Audio::Source::DecodeVector());
+	return std::make_pair(state, 0);
 }
 
 std::uint8_t DummyAudioSource::ChannelCount() const
@@ -53,4 +53,9 @@ std::uint64_t DummyAudioSource::Length() const
 {
 	return 0;
 }
+
+std::uint64_t DummyAudioSource::SkippedFrames() const
+{
+	return this->skipped;
+}
 } // namespace Playd::Tests
@@ -25,7 +25,9 @@ public:
 	 */
 	DummyAudioSource(std::string_view path) : Audio::Source(path){};
 
-	Audio::Source::DecodeResult Decode() override;
+	using Audio::Source::Decode;
+
+	Audio::Source::DecodeSpanResult Decode(gsl::span<std::byte> out) override;
 
 	std::uint8_t ChannelCount() const override;
 
@@ -41,11 +43,17 @@ public:
 	/// @return The length of the DummyAudioSource.
 	std::uint64_t Length() const override;
 
+	/// @return The value of skipped.
+	std::uint64_t SkippedFrames() const override;
+
 	/// The position of the AudioSource, in samples.
 	std::uint64_t position;
 
 	/// If true, the audio source will claim it has run out.
 	bool run_out = false;
+
+	/// The number of damaged frames the source claims to have skipped.
+	std::uint64_t skipped = 0;
 };
 
 } // namespace Playd::Tests
@@ -8,6 +8,7 @@
 
 #include "dummy_response_sink.h"
 
+#include <cstddef>
 #include <ostream>
 #include <string>
 
@@ -17,9 +18,20 @@ DummyResponseSink::DummyResponseSink(std::ostream &os) : os(os)
 {
 }
 
-void DummyResponseSink::Respond(size_t, const Response &response) const
+std::size_t DummyResponseSink::Completions() const
+{
+	return this->completions;
+}
+
+void DummyResponseSink::Respond(ClientId, const Response &response) const
 {
 	this->os << response.Pack() << std::endl;
 }
 
+void DummyResponseSink::Complete(ClientId id, const Response &response) const
+{
+	this->completions++;
+	this->Respond(id, response);
+}
+
 } // namespace Playd::Tests
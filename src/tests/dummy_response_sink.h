@@ -9,6 +9,7 @@
 #ifndef PLAYD_TESTS_DUMMY_RESPONSE_SINK_H
 #define PLAYD_TESTS_DUMMY_RESPONSE_SINK_H
 
+#include <cstddef>
 #include <ostream>
 
 #include "../response.h"
@@ -25,12 +26,20 @@ public:
 	 */
 	DummyResponseSink(std::ostream &os);
 
+	/// @return How many of the responses were replies sent through Complete().
+	[[nodiscard]] std::size_t Completions() const;
+
 protected:
-	virtual void Respond(size_t id, const Response &response) const override;
+	virtual void Respond(ClientId id, const Response &response) const override;
+
+	virtual void Complete(ClientId id, const Response &response) const override;
 
 private:
 	/// Reference to the output stream.
 	std::ostream &os;
+
+	/// How many replies went through Complete().
+	mutable std::size_t completions{0};
 };
 
 } // namespace Playd::Tests
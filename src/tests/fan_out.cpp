@@ -0,0 +1,119 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the FanOutSink class.
+ */
+
+#include "../audio/sinks/fan_out.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../audio/sinks/sim.h"
+#include "../clock.h"
+#include "catch.hpp"
+#include "dummy_audio_source.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("FanOutSinks keep mirrored devices in step with the leader", "[fan-out]") {
+	GIVEN ("a fan-out to two sim devices, the mirror's running 0.05% fast") {
+		SimClock clock;
+		DummyAudioSource source{"test"};
+		const auto rate = source.SampleRate();
+		const auto frame = source.BytesPerSample();
+
+		std::vector<std::unique_ptr<Audio::Sink>> sinks;
+		auto leader_sink = std::make_unique<Audio::SimSink>(source, clock, rate / 4);
+		auto mirror_sink = std::make_unique<Audio::SimSink>(source, clock, rate / 4, 1.0005);
+		auto *leader = leader_sink.get();
+		auto *mirror = mirror_sink.get();
+		sinks.push_back(std::move(leader_sink));
+		sinks.push_back(std::move(mirror_sink));
+		Audio::FanOutSink sink{source, std::move(sinks), clock};
+
+		std::vector<std::byte> samples(frame * 1024);
+		const auto feed = [&] {
+			// As the player does, find out where the device has got to first.
+			sink.Position();
+			while (sink.WantsMore()) {
+				if (sink.Transfer(samples) == 0) break;
+			}
+		};
+
+		THEN ("it reports a mirror, in step") {
+			REQUIRE(sink.Mirrors().size() == 1);
+			REQUIRE(sink.Mirrors()[0].correction == 0.0);
+		}
+
+		WHEN ("it plays for two minutes") {
+			feed();
+			sink.Start();
+			for (int i = 0; i < 24000; i++) {
+				clock.Advance(std::chrono::milliseconds{5});
+				feed();
+			}
+
+			THEN ("the mirror is heard with the leader, corrected for its drift") {
+				const auto stats = sink.Mirrors()[0];
+				REQUIRE(std::abs(stats.lead.count()) < 2000);
+				REQUIRE(stats.correction == Approx(0.0005).margin(0.0001));
+				REQUIRE(stats.overflows == 0);
+				REQUIRE(leader->Fed().underruns == 0);
+				REQUIRE(mirror->Fed().underruns == 0);
+			}
+
+			THEN ("the mirror's device has played more samples, for the same audio") {
+				REQUIRE(leader->Position() < mirror->Position());
+			}
+
+			AND_WHEN ("it is sought") {
+				sink.SetPosition(rate);
+
+				THEN ("all the sinks move, and the mirror keeps its correction") {
+					REQUIRE(sink.Position() == rate);
+					REQUIRE(mirror->Position() == rate);
+					REQUIRE(sink.Mirrors()[0].correction == Approx(0.0005).margin(0.0001));
+				}
+			}
+		}
+
+		WHEN ("it plays for two minutes, but the mirror never starts") {
+			feed();
+			leader->Start();
+			for (int i = 0; i < 24000; i++) {
+				clock.Advance(std::chrono::milliseconds{5});
+				feed();
+			}
+
+			THEN ("the leader plays regardless, and the mirror's backlog is dropped") {
+				REQUIRE(leader->Fed().underruns == 0);
+				REQUIRE(sink.Mirrors()[0].correction == 0.0);
+				REQUIRE(0 < sink.Mirrors()[0].overflows);
+				REQUIRE(sink.BufferBytes() < 4 * rate * frame);
+			}
+		}
+	}
+
+	GIVEN ("a fan-out to one device") {
+		SimClock clock;
+		DummyAudioSource source{"test"};
+		std::vector<std::unique_ptr<Audio::Sink>> sinks;
+		sinks.push_back(std::make_unique<Audio::SimSink>(source, clock, 100));
+		Audio::FanOutSink sink{source, std::move(sinks), clock};
+
+		THEN ("it has no mirrors, and passes through") {
+			REQUIRE(sink.Mirrors().empty());
+			std::vector<std::byte> samples(source.BytesPerSample() * 200);
+			REQUIRE(sink.Transfer(samples) == source.BytesPerSample() * 100);
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,134 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the FileSink class.
+ */
+
+#include "../audio/sinks/file.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "dummy_audio_source.h"
+
+namespace Playd::Tests
+{
+/**
+ * Reads a whole file.
+ * @param path The file.
+ * @return Its bytes.
+ */
+static std::vector<std::uint8_t> ReadAll(const std::string &path)
+{
+	std::ifstream in{path, std::ios::binary};
+	return std::vector<std::uint8_t>{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+SCENARIO ("FileSinks pack WAV headers", "[file-sink]") {
+	std::array<std::byte, Audio::FileSink::WAV_HEADER_BYTES> header{};
+
+	GIVEN ("a header for a second of 48kHz stereo float") {
+		Audio::FileSink::PackWavHeader(header, Audio::SampleFormat::FLOAT32, 2, 48000, 384000);
+
+		THEN ("the sizes and format are right, and little-endian") {
+			std::array<std::byte, 4> riff_size{std::byte{0x24}, std::byte{0xDC}, std::byte{0x05}, std::byte{0x00}};
+			REQUIRE(std::equal(riff_size.begin(), riff_size.end(), header.begin() + 4));
+			REQUIRE(header[20] == std::byte{3});
+			REQUIRE(header[22] == std::byte{2});
+			REQUIRE(header[32] == std::byte{8});
+			REQUIRE(header[34] == std::byte{32});
+			std::array<std::byte, 4> data_size{std::byte{0x00}, std::byte{0xDC}, std::byte{0x05}, std::byte{0x00}};
+			REQUIRE(std::equal(data_size.begin(), data_size.end(), header.begin() + 40));
+		}
+	}
+
+	GIVEN ("a header for more than WAV can hold") {
+		Audio::FileSink::PackWavHeader(header, Audio::SampleFormat::SINT16, 2, 48000, UINT64_MAX);
+
+		THEN ("the sizes are the largest possible") {
+			REQUIRE(header[20] == std::byte{1});
+			for (std::size_t i = 40; i < 44; i++) REQUIRE(header[i] == std::byte{0xFF});
+		}
+	}
+
+	GIVEN ("signed 8-bit samples") {
+		THEN ("they can't go in a WAV") {
+			REQUIRE_THROWS_AS(Audio::FileSink::PackWavHeader(header, Audio::SampleFormat::SINT8, 1, 8000, 0),
+			                  FileError);
+		}
+	}
+}
+
+SCENARIO ("FileSinks write what they're given while playing", "[file-sink]") {
+	const auto path = (std::filesystem::temp_directory_path() / "playd-test-file-sink").string();
+
+	// The dummy source is stereo and 32-bit, so this is one frame.
+	DummyAudioSource source{"test"};
+	const std::array<std::int32_t, 2> frame{0x11223344, 0x55667788};
+	const gsl::span<const std::byte> bytes{reinterpret_cast<const std::byte *>(frame.data()), sizeof(frame)};
+
+	GIVEN ("a stopped WAV sink") {
+		auto sink = std::make_unique<Audio::FileSink>(source, path, Audio::FileSink::Container::WAV);
+
+		THEN ("it takes nothing") {
+			REQUIRE(sink->Transfer(bytes) == 0);
+			REQUIRE(!sink->WantsMore());
+		}
+
+		WHEN ("it is started, given a frame, and told the source is out") {
+			sink->Start();
+			REQUIRE(sink->WantsMore());
+			REQUIRE(sink->Transfer(bytes) == sizeof(frame));
+			sink->SourceOut();
+
+			THEN ("it is at the end, one frame in") {
+				REQUIRE(sink->CurrentState() == Audio::Sink::State::AT_END);
+				REQUIRE(sink->Position() == 1);
+				REQUIRE(sink->BytesWritten() == sizeof(frame));
+			}
+
+			AND_WHEN ("it is closed") {
+				sink.reset();
+
+				THEN ("the file is the header, sized for the frame, then the frame") {
+					const auto file = ReadAll(path);
+					REQUIRE(file.size() == Audio::FileSink::WAV_HEADER_BYTES + sizeof(frame));
+					REQUIRE(file[4] == 36 + sizeof(frame));
+					REQUIRE(file[40] == sizeof(frame));
+					REQUIRE(file[44] == 0x44);
+					REQUIRE(file[48] == 0x88);
+				}
+			}
+		}
+	}
+
+	GIVEN ("a raw PCM sink, given a frame while playing") {
+		{
+			Audio::FileSink sink{source, path, Audio::FileSink::Container::PCM};
+			sink.Start();
+			REQUIRE(sink.Transfer(bytes) == sizeof(frame));
+		}
+
+		THEN ("the file is just the frame") {
+			const auto file = ReadAll(path);
+			REQUIRE(file.size() == sizeof(frame));
+			REQUIRE(file[0] == 0x44);
+		}
+	}
+
+	std::filesystem::remove(path);
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,138 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for binary frames.
+ */
+
+#include "../frame.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../response.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Builds a request frame out of words.
+static std::string MakeFrame(const std::vector<std::string_view> &words)
+{
+	std::string body;
+	PutBigEndian(body, words.size(), 1);
+	for (const auto word : words) {
+		PutBigEndian(body, word.size(), 4);
+		body.append(word);
+	}
+
+	std::string frame;
+	PutBigEndian(frame, body.size(), FrameReader::LENGTH_BYTES);
+	return frame + body;
+}
+
+SCENARIO ("FrameReaders decode request frames", "[frame]") {
+	GIVEN ("a FrameReader and two frames") {
+		FrameReader r;
+		const auto data = MakeFrame({"tag", "fload", "a b.mp3"}) + MakeFrame({"t2", "play"});
+
+		std::vector<std::vector<std::string>> lines;
+		const auto collect = [&lines](Tokeniser::Line line) { lines.emplace_back(line.begin(), line.end()); };
+		const std::vector<std::vector<std::string>> expected{{"tag", "fload", "a b.mp3"}, {"t2", "play"}};
+
+		WHEN ("both frames are fed at once") {
+			REQUIRE(r.Feed(data, collect));
+
+			THEN ("both lines come out, unescaped") {
+				REQUIRE(lines == expected);
+			}
+		}
+
+		WHEN ("the frames are fed a byte at a time") {
+			auto ok = true;
+			for (const char c : data) ok = ok && r.Feed(std::string_view{&c, 1}, collect);
+
+			THEN ("the same lines come out") {
+				REQUIRE(ok);
+				REQUIRE(lines == expected);
+			}
+		}
+
+		WHEN ("a frame claims more words than it holds") {
+			auto bad = MakeFrame({"tag", "play"});
+			bad[4] = 3;
+
+			THEN ("the FrameReader rejects it") {
+				REQUIRE_FALSE(r.Feed(bad, collect));
+			}
+		}
+
+		WHEN ("a frame is too big") {
+			std::string bad;
+			PutBigEndian(bad, FrameReader::MAX_FRAME + 1, FrameReader::LENGTH_BYTES);
+
+			THEN ("the FrameReader rejects it before it arrives") {
+				REQUIRE_FALSE(r.Feed(bad, collect));
+			}
+		}
+	}
+}
+
+SCENARIO ("Responses pack into binary frames", "[frame][response]") {
+	GIVEN ("a POS response") {
+		auto rs = Response("it's", Response::Code::POS).AddArg(std::int64_t{-2});
+
+		WHEN ("it is packed as a frame") {
+			std::string frame;
+			rs.PackFrame(frame);
+
+			THEN ("it has a length, code, field count, and unescaped fields") {
+				REQUIRE(GetBigEndian(frame.data(), 4) == frame.size() - 4);
+				REQUIRE(frame[4] == static_cast<char>(Response::Code::POS));
+				REQUIRE(frame[5] == 2);
+
+				// The tag: a text field.
+				REQUIRE(frame[6] == 0);
+				REQUIRE(GetBigEndian(frame.data() + 7, 4) == 4);
+				REQUIRE(frame.substr(11, 4) == "it's");
+
+				// The position: a signed, fixed-width integer.
+				REQUIRE(frame[15] == 1);
+				REQUIRE(static_cast<std::int64_t>(GetBigEndian(frame.data() + 16, 8)) == -2);
+				REQUIRE(frame.size() == 24);
+			}
+		}
+
+		WHEN ("it is packed as text") {
+			THEN ("the same response comes out, escaped") {
+				REQUIRE(rs.Pack() == R"('it'\''s' POS -2)");
+			}
+		}
+	}
+
+	GIVEN ("a WAVE response with binary in it") {
+		auto rs = Response("t", Response::Code::WAVE).AddBytes(std::string{"\xFF\0 '", 4});
+
+		WHEN ("it is packed as a frame") {
+			std::string frame;
+			rs.PackFrame(frame);
+
+			THEN ("the bytes go in as they are") {
+				REQUIRE(frame[12] == 3);
+				REQUIRE(GetBigEndian(frame.data() + 13, 4) == 4);
+				REQUIRE(frame.substr(17) == std::string{"\xFF\0 '", 4});
+			}
+		}
+
+		WHEN ("it is packed as text") {
+			THEN ("the bytes are in base64, which never needs escaping") {
+				REQUIRE(rs.Pack() == "t WAVE /wAgJw==");
+				REQUIRE(Response("t", Response::Code::WAVE).AddBytes("abc").AddBytes("ab").Pack() ==
+				        "t WAVE YWJj YWI=");
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,109 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Gain class.
+ */
+
+#include "../audio/gain.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Runs a second of mono full-scale floats through a gain.
+ * @param gain The gain, at 48kHz.
+ * @return The samples, after the gain.
+ */
+static std::vector<float> Ones(Audio::Gain &gain)
+{
+	std::vector<float> samples(48000, 1.0f);
+	gain.Apply(gsl::span<std::byte>{reinterpret_cast<std::byte *>(samples.data()), samples.size() * sizeof(float)});
+	return samples;
+}
+
+SCENARIO ("Gains fade samples from one level to another", "[gain]") {
+	GIVEN ("a fresh gain") {
+		Audio::Gain gain{Audio::SampleFormat::FLOAT32, 1, 48000};
+
+		THEN ("it is at unity, and leaves samples alone") {
+			REQUIRE(gain.Level() == 1.0);
+			const auto samples = Ones(gain);
+			REQUIRE(samples.front() == 1.0f);
+			REQUIRE(samples.back() == 1.0f);
+		}
+
+		WHEN ("it jumps to -6dB") {
+			gain.Fade(std::chrono::microseconds{0}, -6.0, Audio::Gain::Shape::LOG);
+
+			THEN ("every sample is about halved") {
+				const auto samples = Ones(gain);
+				REQUIRE(samples.front() == Approx(0.501187).margin(1e-6));
+				REQUIRE(samples.back() == Approx(0.501187).margin(1e-6));
+			}
+		}
+
+		WHEN ("it fades linearly to silence over half a second") {
+			gain.Fade(std::chrono::milliseconds{500}, -std::numeric_limits<double>::infinity(),
+			          Audio::Gain::Shape::LINEAR);
+
+			THEN ("the level falls in a straight line, to nothing") {
+				const auto samples = Ones(gain);
+				REQUIRE(samples[0] == 1.0f);
+				REQUIRE(samples[6000] == Approx(0.75).margin(1e-6));
+				REQUIRE(samples[12000] == Approx(0.5).margin(1e-6));
+				REQUIRE(samples[24000] == 0.0f);
+				REQUIRE(samples.back() == 0.0f);
+				REQUIRE(gain.Level() == 0.0);
+			}
+		}
+
+		WHEN ("it fades logarithmically to -20dB over a second") {
+			gain.Fade(std::chrono::seconds{1}, -20.0, Audio::Gain::Shape::LOG);
+
+			THEN ("the level falls evenly in decibels") {
+				const auto samples = Ones(gain);
+				REQUIRE(samples[12000] == Approx(std::pow(10.0, -5.0 / 20.0)).margin(1e-4));
+				REQUIRE(samples[24000] == Approx(std::pow(10.0, -10.0 / 20.0)).margin(1e-4));
+				REQUIRE(gain.Level() == Approx(0.1));
+			}
+		}
+
+		WHEN ("it fades out along an equal-power curve over a second") {
+			gain.Fade(std::chrono::seconds{1}, -std::numeric_limits<double>::infinity(),
+			          Audio::Gain::Shape::EQUAL_POWER);
+
+			THEN ("the power falls in a straight line, to nothing") {
+				const auto samples = Ones(gain);
+				REQUIRE(samples[12000] == Approx(std::sqrt(0.75)).margin(1e-6));
+				REQUIRE(samples[24000] == Approx(std::sqrt(0.5)).margin(1e-6));
+				REQUIRE(samples[36000] == Approx(0.5).margin(1e-6));
+				REQUIRE(gain.Level() == 0.0);
+			}
+		}
+
+		WHEN ("a fade is interrupted by another") {
+			gain.Fade(std::chrono::seconds{2}, -std::numeric_limits<double>::infinity(), Audio::Gain::Shape::LINEAR);
+			std::ignore = Ones(gain);
+			gain.Fade(std::chrono::seconds{1}, 0.0, Audio::Gain::Shape::LINEAR);
+
+			THEN ("the new fade starts from wherever the old one got to") {
+				const auto samples = Ones(gain);
+				REQUIRE(samples[0] == Approx(0.5).margin(1e-6));
+				REQUIRE(samples[24000] == Approx(0.75).margin(1e-6));
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,116 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the URL and response parsing of the HttpStream class.
+ */
+
+#include "../audio/http_stream.h"
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("HttpStream parses http:// URLs", "[http-stream]") {
+	GIVEN ("a URL with a port, path and query") {
+		const auto url = Audio::HttpStream::ParseUrl("http://radio.example:8000/live.mp3?x=1#frag");
+
+		THEN ("the host, port and target are split out, without the fragment") {
+			REQUIRE(url.host == "radio.example");
+			REQUIRE(url.port == 8000);
+			REQUIRE(url.target == "/live.mp3?x=1");
+		}
+	}
+
+	GIVEN ("a URL with just a host") {
+		const auto url = Audio::HttpStream::ParseUrl("HTTP://radio.example");
+
+		THEN ("the port is 80 and the target is the root") {
+			REQUIRE(url.host == "radio.example");
+			REQUIRE(url.port == 80);
+			REQUIRE(url.target == "/");
+		}
+	}
+
+	GIVEN ("a URL with a bracketed IPv6 address") {
+		const auto url = Audio::HttpStream::ParseUrl("http://[::1]:8080/a");
+
+		THEN ("the host loses its brackets") {
+			REQUIRE(url.host == "::1");
+			REQUIRE(url.port == 8080);
+			REQUIRE(url.target == "/a");
+		}
+	}
+
+	GIVEN ("malformed or unsupported URLs") {
+		THEN ("they are rejected") {
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("https://radio.example/"), FileError);
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("ftp://radio.example/"), FileError);
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("/tmp/file.mp3"), FileError);
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("http://:80/"), FileError);
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("http://radio.example:99999/"), FileError);
+			REQUIRE_THROWS_AS(Audio::HttpStream::ParseUrl("http://[::1/"), FileError);
+		}
+	}
+}
+
+SCENARIO ("HttpStream parses response heads", "[http-stream]") {
+	GIVEN ("a partial response") {
+		const auto head = Audio::HttpStream::ParseHead(
+		        "HTTP/1.1 206 Partial Content\r\ncontent-range: bytes 100-999/1000\r\nContent-Length: 900");
+
+		THEN ("the body starts at the range, and the size is the whole file's") {
+			REQUIRE(head);
+			REQUIRE(head->status == 206);
+			REQUIRE(head->offset == 100);
+			REQUIRE(head->size == 1000);
+			REQUIRE(head->ranges);
+		}
+	}
+
+	GIVEN ("a whole response from a server that takes ranges") {
+		const auto head =
+		        Audio::HttpStream::ParseHead("HTTP/1.0 200 OK\nAccept-Ranges: bytes\nContent-Length: 1234");
+
+		THEN ("the body starts at the start, and the size is its length") {
+			REQUIRE(head);
+			REQUIRE(head->status == 200);
+			REQUIRE(head->offset == 0);
+			REQUIRE(head->size == 1234);
+			REQUIRE(head->ranges);
+		}
+	}
+
+	GIVEN ("an Icecast response") {
+		const auto head = Audio::HttpStream::ParseHead("ICY 200 OK\r\nicy-name: Test\r\nContent-Type: audio/mpeg");
+
+		THEN ("it has no size, and can't be seeked") {
+			REQUIRE(head);
+			REQUIRE(head->status == 200);
+			REQUIRE(!head->size);
+			REQUIRE(!head->ranges);
+		}
+	}
+
+	GIVEN ("a redirect") {
+		const auto head = Audio::HttpStream::ParseHead("HTTP/1.1 302 Found\r\nLocation:  http://b.example/x ");
+
+		THEN ("the location is kept, trimmed") {
+			REQUIRE(head);
+			REQUIRE(head->status == 302);
+			REQUIRE(head->location == "http://b.example/x");
+		}
+	}
+
+	GIVEN ("malformed heads") {
+		THEN ("they are rejected") {
+			REQUIRE(!Audio::HttpStream::ParseHead("SMTP 220 hello"));
+			REQUIRE(!Audio::HttpStream::ParseHead("HTTP/1.1 abc OK"));
+			REQUIRE(!Audio::HttpStream::ParseHead("HTTP/1.1 206 OK\r\nContent-Range: pages 1-2/3"));
+		}
+	}
+}
+
+} // namespace Playd::Tests
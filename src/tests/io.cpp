@@ -0,0 +1,127 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the parts of the I/O system that work without a client.
+ */
+
+#include <chrono>
+
+#include "../io.h"
+
+#include "../response.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("ReadBufferPool reuses buffers", "[io]") {
+	GIVEN ("an empty pool") {
+		IO::ReadBufferPool pool;
+
+		WHEN ("a buffer is acquired") {
+			auto buf = pool.Acquire();
+
+			THEN ("it is a full-size buffer") {
+				REQUIRE(buf.base != nullptr);
+				REQUIRE(buf.len == IO::ReadBufferPool::BUFFER_SIZE);
+				pool.Release(buf.base);
+			}
+
+			AND_WHEN ("it is released and another is acquired") {
+				pool.Release(buf.base);
+				REQUIRE(pool.FreeCount() == 1);
+				auto again = pool.Acquire();
+
+				THEN ("the same buffer comes back") {
+					REQUIRE(again.base == buf.base);
+					REQUIRE(pool.FreeCount() == 0);
+				}
+
+				THEN ("it is counted as in flight, and no other buffer is held") {
+					REQUIRE(pool.InFlightCount() == 1);
+					REQUIRE(pool.HeldCount() == 1);
+				}
+				pool.Release(again.base);
+			}
+		}
+
+		WHEN ("more buffers than the cap are released") {
+			std::vector<uv_buf_t> bufs;
+			for (size_t i = 0; i < IO::ReadBufferPool::MAX_FREE + 2; i++) bufs.push_back(pool.Acquire());
+			for (auto &buf : bufs) pool.Release(buf.base);
+
+			THEN ("only the cap's worth are kept") {
+				REQUIRE(pool.FreeCount() == IO::ReadBufferPool::MAX_FREE);
+				REQUIRE(pool.HeldCount() == IO::ReadBufferPool::MAX_FREE);
+				REQUIRE(pool.InFlightCount() == 0);
+			}
+		}
+
+		WHEN ("a null buffer is released") {
+			pool.Release(nullptr);
+
+			THEN ("nothing is added to the pool") {
+				REQUIRE(pool.FreeCount() == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("PackResponse adds the newline", "[io]") {
+	GIVEN ("a response") {
+		Response r{"tag", Response::Code::POS};
+		r.AddArg("100");
+
+		WHEN ("it is packed for the wire") {
+			auto packed = IO::PackResponse(r);
+
+			THEN ("it is the packed response plus a newline") {
+				REQUIRE(*packed == "tag POS 100\n");
+			}
+		}
+	}
+}
+
+SCENARIO ("Flushes asked for from timers don't wait for other events", "[io]") {
+	GIVEN ("a loop with a flusher, and a long timer standing for the next unrelated event") {
+		uv_loop_t loop;
+		REQUIRE(uv_loop_init(&loop) == 0);
+
+		bool flushed = false;
+		IO::Flusher flusher;
+		flusher.Init(&loop, [&flushed] { flushed = true; });
+
+		uv_timer_t next_event;
+		uv_timer_init(&loop, &next_event);
+		uv_timer_start(&next_event, [](uv_timer_t *) {}, 2000, 0);
+
+		WHEN ("a timer arms the flusher, as the position timer does") {
+			uv_timer_t arming;
+			uv_timer_init(&loop, &arming);
+			arming.data = static_cast<void *>(&flusher);
+			uv_timer_start(&arming, [](uv_timer_t *t) { static_cast<IO::Flusher *>(t->data)->Arm(); }, 1, 0);
+
+			const auto start = std::chrono::steady_clock::now();
+			while (!flushed && std::chrono::steady_clock::now() - start < std::chrono::seconds{5}) {
+				uv_run(&loop, UV_RUN_ONCE);
+			}
+			const auto took = std::chrono::steady_clock::now() - start;
+
+			THEN ("the flush happens without waiting for the next event") {
+				REQUIRE(flushed);
+				REQUIRE(took < std::chrono::seconds{1});
+				REQUIRE_FALSE(flusher.Armed());
+			}
+
+			uv_close(reinterpret_cast<uv_handle_t *>(&arming), nullptr);
+		}
+
+		flusher.Close();
+		uv_close(reinterpret_cast<uv_handle_t *>(&next_event), nullptr);
+		uv_run(&loop, UV_RUN_DEFAULT);
+		REQUIRE(uv_loop_close(&loop) == 0);
+	}
+}
+
+} // namespace Playd::Tests
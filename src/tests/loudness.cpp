@@ -0,0 +1,115 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the LoudnessMeter class.
+ */
+
+#include "../audio/loudness.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/**
+ * Feeds a meter a stereo sine wave, the same on both channels.
+ * @param meter The meter, which should be stereo FLOAT32.
+ * @param rate The sample rate, in Hz.
+ * @param freq The frequency of the sine, in Hz.
+ * @param amplitude The amplitude of the sine.
+ * @param seconds How long the sine lasts.
+ * @param phase The starting phase of the sine, in radians.
+ */
+static void FeedSine(Audio::LoudnessMeter &meter, std::uint32_t rate, double freq, double amplitude,
+                     double seconds, double phase = 0.0)
+{
+	const auto frames = static_cast<std::size_t>(rate * seconds);
+	std::vector<float> samples(frames * 2);
+	for (std::size_t i = 0; i < frames; i++) {
+		const auto x = amplitude * std::sin((2.0 * std::numbers::pi * freq * i / rate) + phase);
+		samples[2 * i] = samples[(2 * i) + 1] = static_cast<float>(x);
+	}
+	meter.Feed(gsl::span<const std::byte>{reinterpret_cast<const std::byte *>(samples.data()),
+	                                      samples.size() * sizeof(float)});
+}
+
+SCENARIO ("LoudnessMeters read nothing from silence", "[loudness]") {
+	GIVEN ("a meter fed a second of silence") {
+		Audio::LoudnessMeter meter{Audio::SampleFormat::FLOAT32, 2, 48000};
+		FeedSine(meter, 48000, 1000, 0.0, 1.0);
+
+		THEN ("every reading is silent") {
+			const auto r = meter.Read();
+			REQUIRE(r.momentary == Audio::LoudnessMeter::SILENCE);
+			REQUIRE(r.short_term == Audio::LoudnessMeter::SILENCE);
+			REQUIRE(r.integrated == Audio::LoudnessMeter::SILENCE);
+			REQUIRE(r.true_peak == Audio::LoudnessMeter::SILENCE);
+		}
+	}
+}
+
+SCENARIO ("LoudnessMeters read steady tones as BS.1770 says", "[loudness]") {
+	// A 1kHz sine at -20dBFS on both stereo channels is -20 LUFS.
+	for (const std::uint32_t rate : {44100U, 48000U, 96000U}) {
+		GIVEN ("a meter fed five seconds of -20dBFS 1kHz sine at " + std::to_string(rate) + "Hz") {
+			Audio::LoudnessMeter meter{Audio::SampleFormat::FLOAT32, 2, rate};
+			FeedSine(meter, rate, 1000, 0.1, 5.0);
+
+			THEN ("all of the loudness readings are -20 LUFS, and the peak -20 dBTP") {
+				const auto r = meter.Read();
+				REQUIRE(r.momentary == Approx(-20.0).margin(0.05));
+				REQUIRE(r.short_term == Approx(-20.0).margin(0.05));
+				REQUIRE(r.integrated == Approx(-20.0).margin(0.1));
+				REQUIRE(r.true_peak == Approx(-20.0).margin(0.05));
+			}
+		}
+	}
+}
+
+SCENARIO ("LoudnessMeters gate quiet passages out of integrated loudness", "[loudness]") {
+	GIVEN ("a meter fed five seconds at -20 LUFS, then five at -40 LUFS") {
+		Audio::LoudnessMeter meter{Audio::SampleFormat::FLOAT32, 2, 48000};
+		FeedSine(meter, 48000, 1000, 0.1, 5.0);
+		FeedSine(meter, 48000, 1000, 0.01, 5.0);
+
+		THEN ("the integrated loudness ignores the quiet part, but short-term doesn't") {
+			const auto r = meter.Read();
+			REQUIRE(r.integrated == Approx(-20.0).margin(0.2));
+			REQUIRE(r.short_term == Approx(-40.0).margin(0.1));
+			REQUIRE(r.true_peak == Approx(-20.0).margin(0.05));
+		}
+
+		WHEN ("the meter is restarted") {
+			meter.Restart();
+
+			THEN ("only the integrated loudness and peak are left") {
+				const auto r = meter.Read();
+				REQUIRE(r.momentary == Audio::LoudnessMeter::SILENCE);
+				REQUIRE(r.integrated == Approx(-20.0).margin(0.2));
+				REQUIRE(r.true_peak == Approx(-20.0).margin(0.05));
+			}
+		}
+	}
+}
+
+SCENARIO ("LoudnessMeters find peaks between samples", "[loudness]") {
+	GIVEN ("a meter fed a quarter-rate sine whose samples all miss its peaks") {
+		// Every sample is at +-sin(45 degrees), 3dB under the real peak.
+		Audio::LoudnessMeter meter{Audio::SampleFormat::FLOAT32, 2, 48000};
+		FeedSine(meter, 48000, 12000, 0.5, 1.0, std::numbers::pi / 4);
+
+		THEN ("the true peak is near the real peak, not the samples") {
+			REQUIRE(meter.Read().true_peak == Approx(20.0 * std::log10(0.5)).margin(0.5));
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,102 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the MappedFile class.
+ */
+
+#include "../audio/mapped_file.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("MappedFiles read like files", "[mapped-file]") {
+	const auto path = (std::filesystem::temp_directory_path() / "playd-test-mapped-file").string();
+
+	GIVEN ("a mapped file with ten bytes in it") {
+		std::ofstream{path, std::ios::binary} << "0123456789";
+		Audio::MappedFile file{path};
+		std::array<std::byte, 4> buf{};
+
+		THEN ("the size and cursor are right") {
+			REQUIRE(file.Size() == 10);
+			REQUIRE(file.Tell() == 0);
+		}
+
+		WHEN ("four bytes are read") {
+			const auto count = file.Read(buf);
+
+			THEN ("they are the first four, and the cursor moves past them") {
+				REQUIRE(count == 4);
+				REQUIRE(buf[0] == std::byte{'0'});
+				REQUIRE(buf[3] == std::byte{'3'});
+				REQUIRE(file.Tell() == 4);
+			}
+		}
+
+		WHEN ("the cursor seeks to two bytes from the end, and four are read") {
+			REQUIRE(file.Seek(-2, SEEK_END) == 8);
+			const auto count = file.Read(buf);
+
+			THEN ("only the last two come back") {
+				REQUIRE(count == 2);
+				REQUIRE(buf[0] == std::byte{'8'});
+				REQUIRE(buf[1] == std::byte{'9'});
+				REQUIRE(file.Read(buf) == 0);
+			}
+		}
+
+		WHEN ("the cursor seeks relative to itself") {
+			REQUIRE(file.Seek(3, SEEK_SET) == 3);
+
+			THEN ("it moves from where it was") {
+				REQUIRE(file.Seek(2, SEEK_CUR) == 5);
+			}
+		}
+
+		WHEN ("the cursor seeks outside the file") {
+			REQUIRE(file.Seek(3, SEEK_SET) == 3);
+			const auto before = file.Seek(-1, SEEK_SET);
+			const auto after = file.Seek(11, SEEK_SET);
+
+			THEN ("the seek fails, and the cursor stays put") {
+				REQUIRE_FALSE(before);
+				REQUIRE_FALSE(after);
+				REQUIRE(file.Tell() == 3);
+			}
+		}
+	}
+
+	GIVEN ("an empty file") {
+		std::ofstream{path, std::ios::binary};
+		Audio::MappedFile file{path};
+
+		THEN ("there's nothing to read") {
+			std::array<std::byte, 4> buf{};
+			REQUIRE(file.Size() == 0);
+			REQUIRE(file.Read(buf) == 0);
+		}
+	}
+
+	GIVEN ("a file that doesn't exist") {
+		std::filesystem::remove(path);
+
+		THEN ("mapping it fails") {
+			REQUIRE_THROWS_AS(Audio::MappedFile{path}, FileError);
+		}
+	}
+
+	std::filesystem::remove(path);
+}
+
+} // namespace Playd::Tests
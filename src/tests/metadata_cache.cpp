@@ -0,0 +1,128 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the MetadataCache class.
+ */
+
+#include "../audio/metadata_cache.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("MetadataCaches remember files between openings", "[metadata-cache]") {
+	GIVEN ("a fresh cache and a file") {
+		const auto dir = std::filesystem::temp_directory_path();
+		const auto cache_path = (dir / "playd-test-cache").string();
+		const auto file_path = (dir / "playd-test-cache-file.mp3").string();
+		std::filesystem::remove(cache_path);
+		std::ofstream{file_path} << "not really an mp3";
+
+		const Audio::MetadataCache::Entry entry{1234, 44100, 2, Audio::SampleFormat::SINT16, 16, {0, 4096, 8192}};
+
+		WHEN ("nothing has been stored") {
+			Audio::MetadataCache cache{cache_path};
+
+			THEN ("the file isn't found") {
+				REQUIRE_FALSE(cache.Find(file_path));
+			}
+		}
+
+		WHEN ("the file's entry is stored and the cache reopened") {
+			{
+				Audio::MetadataCache cache{cache_path};
+				cache.Store(file_path, entry);
+			}
+			Audio::MetadataCache cache{cache_path};
+
+			THEN ("the entry comes back") {
+				const auto found = cache.Find(file_path);
+				REQUIRE(found);
+				REQUIRE(found->length == 1234);
+				REQUIRE(found->rate == 44100);
+				REQUIRE(found->channels == 2);
+				REQUIRE(found->format == Audio::SampleFormat::SINT16);
+				REQUIRE(found->index_step == 16);
+				REQUIRE(found->index == entry.index);
+			}
+
+			AND_WHEN ("the file changes") {
+				std::ofstream{file_path, std::ios::app} << ", but longer";
+
+				THEN ("the entry is stale, and isn't found") {
+					REQUIRE_FALSE(cache.Find(file_path));
+				}
+			}
+		}
+
+		WHEN ("the cache file has a half-written entry on the end") {
+			{
+				Audio::MetadataCache cache{cache_path};
+				cache.Store(file_path, entry);
+			}
+			std::ofstream{cache_path, std::ios::app | std::ios::binary} << "\x40\x00";
+
+			THEN ("the good entries survive reopening") {
+				Audio::MetadataCache cache{cache_path};
+				REQUIRE(cache.Find(file_path));
+			}
+		}
+
+		WHEN ("the cache file has a bad entry before a good one") {
+			const auto other_path = (dir / "playd-test-cache-other.mp3").string();
+			std::ofstream{other_path} << "not really an mp3 either";
+			{
+				Audio::MetadataCache cache{cache_path};
+				cache.Store(file_path, entry);
+				cache.Store(other_path, entry);
+			}
+			const auto size = std::filesystem::file_size(cache_path);
+
+			// Break the first entry's path size, which is after the magic
+			// and the 34 bytes of the record header before it.
+			{
+				std::fstream raw{cache_path, std::ios::in | std::ios::out | std::ios::binary};
+				raw.seekp(8 + 34);
+				const std::uint16_t bad_path_size = 1;
+				raw.write(reinterpret_cast<const char *>(&bad_path_size), sizeof bad_path_size);
+			}
+
+			THEN ("only the bad entry is lost, and nothing is cut off") {
+				{
+					Audio::MetadataCache cache{cache_path};
+					REQUIRE_FALSE(cache.Find(file_path));
+					REQUIRE(cache.Find(other_path));
+					REQUIRE(std::filesystem::file_size(cache_path) == size);
+					cache.Store(file_path, entry);
+				}
+
+				Audio::MetadataCache cache{cache_path};
+				REQUIRE(cache.Find(file_path));
+				REQUIRE(cache.Find(other_path));
+			}
+
+			std::filesystem::remove(other_path);
+		}
+
+		WHEN ("the cache path holds something that isn't a cache") {
+			std::ofstream{cache_path} << "definitely not a cache";
+
+			THEN ("opening it fails") {
+				REQUIRE_THROWS_AS(Audio::MetadataCache{cache_path}, ConfigError);
+			}
+		}
+
+		std::filesystem::remove(cache_path);
+		std::filesystem::remove(file_path);
+	}
+}
+
+} // namespace Playd::Tests
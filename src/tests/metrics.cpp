@@ -0,0 +1,132 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Metrics class.
+ */
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../audio/stats.h"
+#include "../commands.h"
+#include "../metrics.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("Metrics are written in the OpenMetrics format", "[metrics]") {
+	GIVEN ("one idle player and one playing player") {
+		Audio::CallbackStats stats;
+		const auto start = Audio::CallbackStats::Clock::now();
+		stats.RecordCallback(start, start + std::chrono::microseconds{100}, std::chrono::milliseconds{10}, 0,
+		                     false);
+		stats.RecordFill(50);
+
+		const std::vector<Metrics::PlayerSample> players{{0, std::nullopt, 2, 1, 64}, {1, stats.Read(), 0, 0, 0}};
+
+		WHEN ("the metrics are written") {
+			std::ostringstream out;
+			Metrics::WriteOpenMetrics(out, players);
+			const auto text = out.str();
+
+			THEN ("each player's connections and queues are there") {
+				REQUIRE(text.find("playd_connections{player=\"0\"} 2\n") != std::string::npos);
+				REQUIRE(text.find("playd_queued_responses{player=\"0\"} 1\n") != std::string::npos);
+				REQUIRE(text.find("playd_write_queue_bytes{player=\"0\"} 64\n") != std::string::npos);
+			}
+
+			AND_THEN ("slow clients' evictions, coalesced updates and dropped audio are counted") {
+				REQUIRE(text.find("playd_evicted_clients_total ") != std::string::npos);
+				REQUIRE(text.find("playd_coalesced_responses_total ") != std::string::npos);
+				REQUIRE(text.find("playd_dropped_responses_total ") != std::string::npos);
+			}
+
+			AND_THEN ("only the playing player has audio figures") {
+				REQUIRE(text.find("playd_callbacks_total{player=\"1\"} 1\n") != std::string::npos);
+				REQUIRE(text.find("playd_callbacks_total{player=\"0\"}") == std::string::npos);
+			}
+
+			AND_THEN ("histogram buckets are cumulative, and end in +Inf") {
+				REQUIRE(text.find("playd_buffer_fill_percent_bucket{player=\"1\",le=\"31\"} 0\n") !=
+				        std::string::npos);
+				REQUIRE(text.find("playd_buffer_fill_percent_bucket{player=\"1\",le=\"63\"} 1\n") !=
+				        std::string::npos);
+				REQUIRE(text.find("playd_buffer_fill_percent_bucket{player=\"1\",le=\"127\"} 1\n") !=
+				        std::string::npos);
+				REQUIRE(text.find("playd_buffer_fill_percent_bucket{player=\"1\",le=\"+Inf\"} 1\n") !=
+				        std::string::npos);
+				REQUIRE(text.find("playd_buffer_fill_percent_sum{player=\"1\"} 50\n") != std::string::npos);
+			}
+
+			AND_THEN ("every command verb has latency histograms") {
+				REQUIRE(text.find("playd_command_wait_microseconds_count{verb=\"play\"}") != std::string::npos);
+				REQUIRE(text.find("playd_command_microseconds_count{verb=\"play\"}") != std::string::npos);
+				REQUIRE(text.find("playd_command_reply_microseconds_count{verb=\"play\"}") != std::string::npos);
+			}
+
+			AND_THEN ("every player's memory is there, with the process's own") {
+				REQUIRE(text.find("playd_memory_bytes{player=\"0\",use=\"client_output\"} 64\n") != std::string::npos);
+				REQUIRE(text.find("playd_memory_bytes{player=\"1\",use=\"audio_buffers\"} 0\n") != std::string::npos);
+				REQUIRE(text.find("playd_memory_bytes{use=\"read_buffers_in_flight\"} 0\n") != std::string::npos);
+				REQUIRE(text.find("playd_largest_client_memory_bytes{player=\"0\"} 0\n") != std::string::npos);
+			}
+
+			AND_THEN ("start latencies are only there once known") {
+				REQUIRE(text.find("playd_start_microseconds{") == std::string::npos);
+			}
+
+			AND_THEN ("the output ends with EOF") {
+				REQUIRE(text.ends_with("# EOF\n"));
+			}
+		}
+	}
+}
+
+SCENARIO ("Metrics records command latencies by verb", "[metrics]") {
+	GIVEN ("a command") {
+		const auto *command = FindCommand("play", 0);
+		REQUIRE(command != nullptr);
+
+		std::ostringstream before;
+		Metrics::WriteOpenMetrics(before, {});
+
+		WHEN ("it is recorded as taking 300us") {
+			Metrics::RecordCommand(*command, Metrics::CommandStage::RAN, std::chrono::microseconds{300});
+
+			THEN ("its verb's count and sum go up") {
+				std::ostringstream after;
+				Metrics::WriteOpenMetrics(after, {});
+				REQUIRE(before.str() != after.str());
+				REQUIRE(after.str().find("playd_command_microseconds_bucket{verb=\"play\",le=\"511\"}") !=
+				        std::string::npos);
+			}
+		}
+	}
+}
+
+SCENARIO ("Metrics answers HTTP requests", "[metrics]") {
+	GIVEN ("a request for /metrics") {
+		const auto reply = Metrics::Serve("GET /metrics HTTP/1.1\r\nHost: playd\r\n\r\n", {});
+
+		THEN ("the metrics come back, as OpenMetrics") {
+			REQUIRE(reply.starts_with("HTTP/1.0 200 OK\r\n"));
+			REQUIRE(reply.find(std::string{"Content-Type: "} + std::string{Metrics::CONTENT_TYPE}) !=
+			        std::string::npos);
+			REQUIRE(reply.ends_with("# EOF\n"));
+		}
+	}
+
+	GIVEN ("a request for something else") {
+		const auto reply = Metrics::Serve("GET /favicon.ico HTTP/1.1\r\n\r\n", {});
+
+		THEN ("nothing is found") {
+			REQUIRE(reply.starts_with("HTTP/1.0 404 Not Found\r\n"));
+		}
+	}
+}
+
+} // namespace Playd::Tests
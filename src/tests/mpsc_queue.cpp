@@ -0,0 +1,74 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the MpscQueue class template.
+ */
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../mpsc_queue.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("MpscQueue hands values over in order", "[mpsc-queue]") {
+	GIVEN ("an empty queue") {
+		MpscQueue<std::unique_ptr<int>> queue;
+
+		THEN ("nothing can be popped") {
+			REQUIRE_FALSE(queue.Pop().has_value());
+		}
+
+		WHEN ("values are pushed") {
+			for (int i = 0; i < 3; i++) queue.Push(std::make_unique<int>(i));
+
+			THEN ("they come back out in the order they went in, then nothing") {
+				for (int i = 0; i < 3; i++) {
+					auto value = queue.Pop();
+					REQUIRE(value.has_value());
+					REQUIRE(**value == i);
+				}
+				REQUIRE_FALSE(queue.Pop().has_value());
+			}
+		}
+	}
+}
+
+SCENARIO ("MpscQueue takes values from many threads at once", "[mpsc-queue]") {
+	GIVEN ("four threads each pushing a thousand values") {
+		constexpr int THREADS = 4;
+		constexpr int PER_THREAD = 1000;
+		MpscQueue<int> queue;
+
+		std::vector<std::thread> producers;
+		for (int t = 0; t < THREADS; t++) {
+			producers.emplace_back([&queue, t] {
+				for (int i = 0; i < PER_THREAD; i++) queue.Push(t * PER_THREAD + i);
+			});
+		}
+		for (auto &producer : producers) producer.join();
+
+		WHEN ("the queue is drained") {
+			std::vector<int> last(THREADS, -1);
+			int count = 0;
+			auto ordered = true;
+			while (auto value = queue.Pop()) {
+				const auto thread = *value / PER_THREAD;
+				ordered = ordered && last[thread] < *value;
+				last[thread] = *value;
+				count++;
+			}
+
+			THEN ("every value is there, in each thread's order") {
+				REQUIRE(count == THREADS * PER_THREAD);
+				REQUIRE(ordered);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
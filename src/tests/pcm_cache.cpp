@@ -0,0 +1,91 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the PcmCache class.
+ */
+
+#include "../audio/pcm_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "pcm_clip.h"
+
+namespace Playd::Tests
+{
+/// Makes a silent clip of a given size, in bytes, for a given file.
+static std::shared_ptr<const Audio::PcmClip> SizedClip(const std::string &path, std::size_t size)
+{
+	return MakeClip(path, 48000, 2, std::vector<std::int16_t>(size / sizeof(std::int16_t)));
+}
+
+SCENARIO ("PcmCaches keep recently used clips within budget", "[pcm-cache]") {
+	GIVEN ("a cache with room for 100 bytes of files up to 16 bytes, and three small files") {
+		const auto dir = std::filesystem::temp_directory_path();
+		const auto a = (dir / "playd-test-pcm-a.wav").string();
+		const auto b = (dir / "playd-test-pcm-b.wav").string();
+		const auto c = (dir / "playd-test-pcm-c.wav").string();
+		for (const auto &path : {a, b, c}) std::ofstream{path} << "tiny";
+
+		Audio::PcmCache cache{100, 16};
+
+		THEN ("small files are let in, but big ones aren't") {
+			REQUIRE(cache.Admits(a));
+			std::ofstream{c} << "rather more than sixteen bytes";
+			REQUIRE_FALSE(cache.Admits(c));
+		}
+
+		WHEN ("two 40-byte clips are stored") {
+			cache.Store(*cache.Admits(a), SizedClip(a, 40));
+			cache.Store(*cache.Admits(b), SizedClip(b, 40));
+
+			THEN ("both can be found") {
+				REQUIRE(cache.Find(a));
+				REQUIRE(cache.Find(b));
+				REQUIRE(cache.Used() == 80);
+			}
+
+			AND_WHEN ("the first is used, and a third stored") {
+				REQUIRE(cache.Find(a));
+				cache.Store(*cache.Admits(c), SizedClip(c, 40));
+
+				THEN ("the least recently used clip makes room for it") {
+					REQUIRE(cache.Find(a));
+					REQUIRE_FALSE(cache.Find(b));
+					REQUIRE(cache.Find(c));
+					REQUIRE(cache.Used() == 80);
+				}
+			}
+
+			AND_WHEN ("a file changes") {
+				std::ofstream{a, std::ios::app} << "er";
+
+				THEN ("its clip is stale, and is dropped") {
+					REQUIRE_FALSE(cache.Find(a));
+					REQUIRE(cache.Used() == 40);
+				}
+			}
+		}
+
+		WHEN ("a clip bigger than the whole budget is stored") {
+			cache.Store(*cache.Admits(a), SizedClip(a, 102));
+
+			THEN ("it isn't kept") {
+				REQUIRE_FALSE(cache.Find(a));
+				REQUIRE(cache.Used() == 0);
+			}
+		}
+
+		for (const auto &path : {a, b, c}) std::filesystem::remove(path);
+	}
+}
+
+} // namespace Playd::Tests
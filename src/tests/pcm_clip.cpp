@@ -0,0 +1,37 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Definition of helpers for building decoded clips in tests.
+ * @see tests/pcm_clip.h
+ */
+
+#include "pcm_clip.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sample_format.h"
+
+namespace Playd::Tests
+{
+std::shared_ptr<const Audio::PcmClip> MakeClip(std::string path, std::uint32_t rate, std::uint8_t channels,
+                                               const std::vector<std::int16_t> &samples)
+{
+	auto clip = std::make_shared<Audio::PcmClip>();
+	clip->path = std::move(path);
+	clip->rate = rate;
+	clip->channels = channels;
+	clip->format = Audio::SampleFormat::SINT16;
+	clip->samples.resize(samples.size() * sizeof(std::int16_t));
+	std::memcpy(clip->samples.data(), samples.data(), clip->samples.size());
+	return clip;
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,35 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of helpers for building decoded clips in tests.
+ * @see tests/pcm_clip.cpp
+ */
+
+#ifndef PLAYD_TESTS_PCM_CLIP_H
+#define PLAYD_TESTS_PCM_CLIP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+
+namespace Playd::Tests
+{
+/**
+ * Makes a 16-bit clip, for feeding to RamSources and caches.
+ * @param path The file the clip stands for.
+ * @param rate The sample rate, in Hz.
+ * @param channels The number of channels.
+ * @param samples The samples, interleaved.
+ * @return The clip.
+ */
+std::shared_ptr<const Audio::PcmClip> MakeClip(std::string path, std::uint32_t rate, std::uint8_t channels,
+                                               const std::vector<std::int16_t> &samples);
+
+} // namespace Playd::Tests
+
+#endif // PLAYD_TESTS_PCM_CLIP_H
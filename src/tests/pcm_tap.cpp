@@ -0,0 +1,153 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the PcmTap class.
+ */
+
+#include "../audio/pcm_tap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "../audio/source.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Stereo 16-bit audio, as fed to the taps here.
+static const Audio::StreamFormat STEREO{Audio::SampleFormat::SINT16, 2, 44100, 4};
+
+/// Three-channel 16-bit audio, whose samples don't fit a chunk exactly.
+static const Audio::StreamFormat THREE{Audio::SampleFormat::SINT16, 3, 48000, 6};
+
+/**
+ * Feeds a tap bytes counting up from a value.
+ * @param tap The tap.
+ * @param format The format to feed them as.
+ * @param count The number of bytes.
+ * @param first The first byte's value.
+ */
+static void FeedCount(Audio::PcmTap &tap, const Audio::StreamFormat &format, std::size_t count,
+                      std::uint8_t first = 0)
+{
+	std::vector<std::byte> bytes(count);
+	for (std::size_t i = 0; i < count; i++) bytes[i] = static_cast<std::byte>((first + i) & 0xFFU);
+	tap.Feed(format, bytes);
+}
+
+/**
+ * Takes everything from a tap.
+ * @param tap The tap.
+ * @return The size of each chunk taken, in order.
+ */
+static std::vector<std::size_t> DrainSizes(Audio::PcmTap &tap)
+{
+	std::vector<std::size_t> sizes;
+	tap.Drain([&sizes](const Audio::PcmTap::Chunk &chunk) { sizes.push_back(chunk.samples.size()); });
+	return sizes;
+}
+
+SCENARIO ("PcmTaps gather fed samples into chunks", "[pcm-tap]") {
+	GIVEN ("a tap that nobody is listening to") {
+		Audio::PcmTap tap;
+
+		WHEN ("it is fed a chunk and more") {
+			FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES * 2);
+
+			THEN ("there is nothing to take") {
+				REQUIRE(DrainSizes(tap).empty());
+			}
+		}
+
+		WHEN ("it is listened to") {
+			tap.SetListening(true);
+
+			AND_WHEN ("it is fed less than a chunk") {
+				FeedCount(tap, STEREO, 400);
+
+				THEN ("there is nothing to take yet") {
+					REQUIRE(DrainSizes(tap).empty());
+				}
+
+				AND_WHEN ("it is fed the rest of the chunk, and some") {
+					FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES - 400 + 8, 400 % 256);
+
+					THEN ("the one full chunk can be taken, in order and with its format") {
+						std::vector<Audio::PcmTap::Chunk> chunks;
+						std::vector<std::byte> first_bytes;
+						tap.Drain([&](const Audio::PcmTap::Chunk &chunk) {
+							chunks.push_back(chunk);
+							first_bytes.assign(chunk.samples.begin(), chunk.samples.begin() + 1000);
+						});
+						REQUIRE(chunks.size() == 1);
+						REQUIRE(chunks[0].samples.size() == Audio::PcmTap::CHUNK_BYTES);
+						REQUIRE(chunks[0].format == Audio::SampleFormat::SINT16);
+						REQUIRE(chunks[0].channels == 2);
+						REQUIRE(chunks[0].rate == 44100);
+						for (std::size_t i = 0; i < first_bytes.size(); i++) {
+							REQUIRE(first_bytes[i] == static_cast<std::byte>(i & 0xFFU));
+						}
+					}
+				}
+			}
+
+			AND_WHEN ("it is fed samples that don't fill a chunk exactly") {
+				FeedCount(tap, THREE, THREE.bytes_per_sample * 5500);
+
+				THEN ("its chunks stop short, on whole samples") {
+					const auto sizes = DrainSizes(tap);
+					REQUIRE(sizes.size() == 2);
+					REQUIRE(sizes[0] % THREE.bytes_per_sample == 0);
+					REQUIRE(Audio::PcmTap::CHUNK_BYTES - THREE.bytes_per_sample < sizes[0]);
+				}
+			}
+
+			AND_WHEN ("it is fed one format, then another") {
+				FeedCount(tap, STEREO, 400);
+				FeedCount(tap, THREE, THREE.bytes_per_sample * 2000);
+
+				THEN ("the first format's samples end their own chunk") {
+					std::vector<Audio::PcmTap::Chunk> chunks;
+					tap.Drain([&chunks](const Audio::PcmTap::Chunk &chunk) { chunks.push_back(chunk); });
+					REQUIRE(chunks.size() == 1);
+					REQUIRE(chunks[0].samples.size() == 400);
+					REQUIRE(chunks[0].channels == 2);
+				}
+			}
+
+			AND_WHEN ("it is fed more than its ring holds") {
+				FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES * (Audio::PcmTap::RING_CHUNKS + 4));
+
+				THEN ("only the ring's worth is kept, and the rest dropped") {
+					REQUIRE(DrainSizes(tap).size() == Audio::PcmTap::RING_CHUNKS);
+				}
+
+				AND_WHEN ("it is taken from, and fed again") {
+					DrainSizes(tap);
+					FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES);
+
+					THEN ("it carries on") {
+						REQUIRE(DrainSizes(tap).size() == 1);
+					}
+				}
+			}
+
+			AND_WHEN ("it is fed a chunk and a half, then stopped and started again") {
+				FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES + 400);
+				tap.SetListening(false);
+				tap.SetListening(true);
+				FeedCount(tap, STEREO, Audio::PcmTap::CHUNK_BYTES - 400);
+
+				THEN ("nothing from before is kept") {
+					REQUIRE(DrainSizes(tap).empty());
+				}
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
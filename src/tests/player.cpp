@@ -8,7 +8,23 @@
 
 #include "../player.h"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <sstream>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // _WIN32
 
 #include "../errors.h"
 #include "../messages.h"
@@ -21,13 +37,17 @@ using namespace std::string_literals;
 
 namespace Playd::Tests
 {
-const std::map<std::string, Player::SourceFn> DUMMY_SRCS{
-        {"mp3",
+const std::vector<Player::Decoder> DUMMY_SRCS{
+        {"dummy",
+         {"mp3"},
+         nullptr,
          [](std::string_view path) -> std::unique_ptr<Audio::Source> {
 	         return std::make_unique<DummyAudioSource, std::string_view>(std::move(path));
          }},
-        {"ogg", [](std::string_view) -> std::unique_ptr<Audio::Source> { throw FileError("test failure 1"); }},
-        {"flac", [](std::string_view) -> std::unique_ptr<Audio::Source> { throw InternalError("test failure 2"); }}};
+        {"fail1", {"ogg"}, nullptr,
+         [](std::string_view) -> std::unique_ptr<Audio::Source> { throw FileError("test failure 1"); }},
+        {"fail2", {"flac"}, nullptr,
+         [](std::string_view) -> std::unique_ptr<Audio::Source> { throw InternalError("test failure 2"); }}};
 
 SCENARIO ("Player announces changes in state correctly", "[player]") {
 	GIVEN ("a fresh Player using dummy audio sources and sinks") {
@@ -77,6 +97,263 @@ SCENARIO ("Player accurately represents whether it is running", "[player]") {
 	}
 }
 
+SCENARIO ("Player reports whether it needs polling", "[player]") {
+	GIVEN ("a fresh Player using dummy audio sources and sinks") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		WHEN ("the player has nothing loaded") {
+			THEN ("IsPlaying() is false") {
+				REQUIRE_FALSE(p.IsPlaying());
+			}
+		}
+		WHEN ("the player has a stopped file loaded") {
+			p.Load("tag", "foo.mp3");
+			THEN ("IsPlaying() is false") {
+				REQUIRE_FALSE(p.IsPlaying());
+			}
+
+			AND_WHEN ("the file is played") {
+				p.SetPlaying("tag", true);
+				THEN ("IsPlaying() is true") {
+					REQUIRE(p.IsPlaying());
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Player settings can be tuned while it runs", "[player]") {
+	GIVEN ("a Player with a tunable buffer and a fixed setting") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		auto policy = std::make_shared<Audio::BufferPolicy>(std::chrono::milliseconds{250},
+		                                                    std::chrono::milliseconds{2000});
+		p.EnableBufferTuning(policy);
+		p.AddFixedSetting("listen-backlog", "128");
+
+		THEN ("a dump reports every setting") {
+			std::ignore = p.Dump(BROADCAST, "tag");
+			REQUIRE(os.str() == "tag EJECT\ntag SET update-period 5\ntag SET buffer 250-2000\ntag SET pre-roll 0\n"
+			                    "tag SET listen-backlog 128\n");
+		}
+
+		WHEN ("the update period is set") {
+			const auto rs = p.Set("tag", "update-period", "20");
+
+			THEN ("the player wants updating that often, and says so") {
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(p.UpdatePeriod() == std::chrono::milliseconds{20});
+				REQUIRE(os.str() == "tag SET update-period 20\n");
+			}
+		}
+
+		WHEN ("the buffer is set") {
+			const auto rs = p.Set("tag", "buffer", "500");
+
+			THEN ("new sinks get the new size") {
+				REQUIRE(rs.Pack() == "tag ACK OK success");
+				REQUIRE(policy->Size() == std::chrono::milliseconds{500});
+				REQUIRE(os.str() == "tag SET buffer 500\n");
+			}
+
+			AND_WHEN ("the pre-roll is set longer than it") {
+				os.str("");
+				const auto too_long = p.Set("tag", "pre-roll", "1000");
+
+				THEN ("it is refused, and nothing changes") {
+					REQUIRE(too_long.Pack() == "tag ACK WHAT '"s + std::string{MSG_SET_INVALID_PRE_ROLL} + "'");
+					REQUIRE(os.str().empty());
+				}
+			}
+		}
+
+		WHEN ("invalid values are given") {
+			THEN ("they are refused") {
+				REQUIRE(p.Set("tag", "update-period", "0").Pack() != "tag ACK OK success");
+				REQUIRE(p.Set("tag", "update-period", "5000").Pack() != "tag ACK OK success");
+				REQUIRE(p.Set("tag", "buffer", "500-100").Pack() != "tag ACK OK success");
+				REQUIRE(p.UpdatePeriod() == Player::DEFAULT_UPDATE_PERIOD);
+			}
+		}
+
+		WHEN ("a fixed setting is set") {
+			THEN ("it is refused as fixed") {
+				REQUIRE(p.Set("tag", "listen-backlog", "64").Pack() ==
+				        "tag ACK WHAT '"s + std::string{MSG_SET_FIXED} + "'");
+			}
+		}
+
+		WHEN ("an unknown setting is set") {
+			THEN ("it is refused as unknown") {
+				REQUIRE(p.Set("tag", "turbo", "1").Pack() == "tag ACK WHAT '"s + std::string{MSG_SET_UNKNOWN} + "'");
+			}
+		}
+	}
+}
+
+SCENARIO ("Player can cue and take files", "[player]") {
+	GIVEN ("a fresh Player using dummy audio sources and sinks") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("nothing is cued") {
+			THEN ("taking returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_CUED} + "'"s;
+				REQUIRE(p.Take("tag").Pack() == r);
+			}
+		}
+		WHEN ("a file of an unknown type is cued") {
+			THEN ("the cue returns failure") {
+				REQUIRE_FALSE(p.Cue("tag", "blah.wav").Pack() == "tag ACK OK success");
+			}
+		}
+		WHEN ("a file is cued") {
+			auto res = p.Cue("tag", "bar.mp3");
+
+			THEN ("the cue returns success") {
+				REQUIRE(res.Pack() == "tag ACK OK success");
+			}
+			THEN ("the cue is announced, but nothing is loaded") {
+				REQUIRE(os.str() == "! CUE bar.mp3\n");
+			}
+
+			AND_WHEN ("the file is taken") {
+				os.str("");
+				auto tres = p.Take("tag");
+
+				THEN ("the take returns success") {
+					REQUIRE(tres.Pack() == "tag ACK OK success");
+				}
+				THEN ("the cued file is now loaded, and no longer cued") {
+					REQUIRE(os.str() == "! STOP\n! FLOAD bar.mp3\n! POS 0\n! LEN 0\n");
+				}
+			}
+
+			AND_WHEN ("the file is taken while another is playing") {
+				p.Load("tag", "foo.mp3");
+				p.SetPlaying("tag", true);
+				p.Take("tag");
+
+				THEN ("the taken file is playing") {
+					REQUIRE(p.IsPlaying());
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Player can queue files and move on to them", "[player]") {
+	GIVEN ("a loaded Player using dummy audio sources and sinks") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		p.Load("tag", "foo.mp3");
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("nothing is queued") {
+			THEN ("moving on returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_QUEUED} + "'"s;
+				REQUIRE(p.Next("tag").Pack() == r);
+			}
+			THEN ("dequeueing returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_QUEUE_INVALID_INDEX} + "'"s;
+				REQUIRE(p.Dequeue("tag", "0").Pack() == r);
+			}
+		}
+		WHEN ("a file of an unknown type is queued") {
+			auto res = p.Enqueue("tag", "blah.wav");
+
+			THEN ("it is queued, then dropped as it can't be opened") {
+				REQUIRE(res.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! QUEUE blah.wav\n! QUEUE\n");
+			}
+		}
+		WHEN ("a file is queued with a bad overlap") {
+			THEN ("the enqueue returns failure, and nothing is queued") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_QUEUE_INVALID_OVERLAP} + "'"s;
+				REQUIRE(p.Enqueue("tag", "bar.mp3", "x").Pack() == r);
+				REQUIRE(p.Enqueue("tag", "bar.mp3", "-1").Pack() == r);
+				REQUIRE(p.Enqueue("tag", "bar.mp3", "30001").Pack() == r);
+				REQUIRE(os.str().empty());
+			}
+		}
+		WHEN ("a file is queued to crossfade") {
+			auto res = p.Enqueue("tag", "bar.mp3", "3000");
+
+			THEN ("it is queued as any other") {
+				REQUIRE(res.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! QUEUE bar.mp3\n");
+			}
+		}
+		WHEN ("two files are queued") {
+			p.Enqueue("tag", "bar.mp3");
+			auto res = p.Enqueue("tag", "baz.mp3");
+
+			THEN ("each change to the queue is announced") {
+				REQUIRE(res.Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "! QUEUE bar.mp3\n! QUEUE bar.mp3 baz.mp3\n");
+			}
+			THEN ("a dump includes the queue") {
+				os.str("");
+				std::ignore = p.Dump(BROADCAST, "tag");
+				REQUIRE(os.str() == "tag STOP\ntag FLOAD foo.mp3\ntag POS 0\ntag LEN 0\ntag QUEUE bar.mp3 baz.mp3\n"
+				                    "tag SET update-period 5\ntag SET pre-roll 0\n");
+			}
+
+			AND_WHEN ("the player moves on") {
+				os.str("");
+				auto nres = p.Next("tag");
+
+				THEN ("the first queued file is loaded, and no longer queued") {
+					REQUIRE(nres.Pack() == "tag ACK OK success");
+					REQUIRE(os.str() == "! STOP\n! FLOAD bar.mp3\n! POS 0\n! LEN 0\n! QUEUE baz.mp3\n");
+				}
+
+				AND_WHEN ("it moves on again") {
+					os.str("");
+					p.Next("tag");
+
+					THEN ("the queue is announced as empty") {
+						REQUIRE(os.str() == "! STOP\n! FLOAD baz.mp3\n! POS 0\n! LEN 0\n! QUEUE\n");
+					}
+				}
+			}
+
+			AND_WHEN ("the player moves on while playing") {
+				p.SetPlaying("tag", true);
+				p.Next("tag");
+
+				THEN ("the new file is playing") {
+					REQUIRE(p.IsPlaying());
+				}
+			}
+
+			AND_WHEN ("the first file is dequeued") {
+				os.str("");
+				auto dres = p.Dequeue("tag", "0");
+
+				THEN ("the rest of the queue moves up") {
+					REQUIRE(dres.Pack() == "tag ACK OK success");
+					REQUIRE(os.str() == "! QUEUE baz.mp3\n");
+				}
+			}
+
+			AND_WHEN ("a file past the end of the queue is dequeued") {
+				THEN ("the dequeue returns failure") {
+					auto r = "tag ACK WHAT '"s + std::string{MSG_QUEUE_INVALID_INDEX} + "'"s;
+					REQUIRE(p.Dequeue("tag", "2").Pack() == r);
+					REQUIRE(p.Dequeue("tag", "x").Pack() == r);
+				}
+			}
+		}
+	}
+}
+
 SCENARIO ("Player interacts correctly with the audio system", "[player]") {
 	GIVEN ("a fresh Player using dummy audio sources and sinks") {
 		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
@@ -106,6 +383,53 @@ SCENARIO ("Player interacts correctly with the audio system", "[player]") {
 				auto r = "tag ACK WHAT '"s + std::string{MSG_LOAD_EMPTY_PATH} + "'"s;
 				REQUIRE(p.Load("tag", "").Pack() == r);
 			}
+			THEN ("asking for position updates every 100ms returns success") {
+				p.AddClient(static_cast<ClientId>(1));
+				REQUIRE(p.PosRate(static_cast<ClientId>(1), "tag", "100").Pack() == "tag ACK OK success");
+			}
+			THEN ("asking for position updates at a bad period returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_POSRATE_INVALID_VALUE} + "'"s;
+				for (const auto *period : {"", "-1", "1.5", "fast"}) {
+					REQUIRE(p.PosRate(static_cast<ClientId>(1), "tag", period).Pack() == r);
+				}
+			}
+			THEN ("asking for statistics returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_STATS_UNAVAILABLE} + "'"s;
+				REQUIRE(p.Stats(BROADCAST, "tag").Pack() == r);
+			}
+			THEN ("asking for loudness returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_LOUDNESS_OFF} + "'"s;
+				REQUIRE(p.Loudness(BROADCAST, "tag").Pack() == r);
+				REQUIRE(p.LoudRate(static_cast<ClientId>(1), "tag", "100").Pack() == r);
+			}
+			THEN ("with meters on, asking for loudness updates returns success") {
+				p.EnableLoudnessMeters();
+				REQUIRE(p.LoudRate(static_cast<ClientId>(1), "tag", "100").Pack() == "tag ACK OK success");
+				REQUIRE(p.LoudRate(static_cast<ClientId>(1), "tag", "0").Pack() == "tag ACK OK success");
+			}
+			THEN ("tapping, and untapping, returns success, even twice") {
+				for (const auto *on : {"1", "1", "0", "0"}) {
+					REQUIRE(p.Tap(static_cast<ClientId>(1), "tag", on).Pack() == "tag ACK OK success");
+				}
+			}
+			THEN ("tapping with a bad value returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_TAP_INVALID_VALUE} + "'"s;
+				for (const auto *on : {"", "2", "on"}) {
+					REQUIRE(p.Tap(static_cast<ClientId>(1), "tag", on).Pack() == r);
+				}
+			}
+			THEN ("fading returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_LOADED} + "'"s;
+				REQUIRE(p.Fade("tag", "1000", "-inf").Pack() == r);
+			}
+			THEN ("changing the rate returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_LOADED} + "'"s;
+				REQUIRE(p.Rate("tag", "1.5").Pack() == r);
+			}
+			THEN ("asking for a waveform returns failure") {
+				auto r = "tag ACK WHAT '"s + std::string{MSG_CMD_NEEDS_LOADED} + "'"s;
+				REQUIRE(p.Waveform(BROADCAST, "tag", "100")->Pack() == r);
+			}
 		}
 
 		WHEN ("there is audio loaded") {
@@ -137,6 +461,46 @@ SCENARIO ("Player interacts correctly with the audio system", "[player]") {
 					auto r = "tag ACK WHAT '"s + std::string{MSG_LOAD_EMPTY_PATH} + "'"s;
 					REQUIRE(p.Load("tag", "").Pack() == r);
 				}
+				THEN ("asking for a waveform sends one, then returns success") {
+					std::ostringstream os;
+					DummyResponseSink drs(os);
+					p.SetIo(drs);
+
+					// The dummy file is empty, so the overview is silent.
+					REQUIRE(p.Waveform(BROADCAST, "tag", "2")->Pack() == "tag ACK OK success");
+					REQUIRE(os.str() == "tag WAVE blah.mp3 2 AAAAAAAAAAAAAAAA\n");
+				}
+				THEN ("fading returns success") {
+					REQUIRE(p.Fade("tag", "1000", "-inf").Pack() == "tag ACK OK success");
+					REQUIRE(p.Fade("tag", "0", "-3.5", "linear").Pack() == "tag ACK OK success");
+				}
+				THEN ("fading with a bad duration or level returns failure") {
+					auto r = "tag ACK WHAT '"s + std::string{MSG_FADE_INVALID_VALUE} + "'"s;
+					REQUIRE(p.Fade("tag", "-1", "0").Pack() == r);
+					REQUIRE(p.Fade("tag", "1000", "loud").Pack() == r);
+					REQUIRE(p.Fade("tag", "1000", "30").Pack() == r);
+					REQUIRE(p.Fade("tag", "1000", "nan").Pack() == r);
+				}
+				THEN ("changing the rate returns success") {
+					REQUIRE(p.Rate("tag", "0.75").Pack() == "tag ACK OK success");
+					REQUIRE(p.Rate("tag", "1").Pack() == "tag ACK OK success");
+				}
+				THEN ("changing to a bad rate returns failure") {
+					auto r = "tag ACK WHAT '"s + std::string{MSG_RATE_INVALID_VALUE} + "'"s;
+					for (const auto *rate : {"", "0", "0.4", "2.5", "-1", "fast", "nan"}) {
+						REQUIRE(p.Rate("tag", rate).Pack() == r);
+					}
+				}
+				THEN ("fading with a bad shape returns failure") {
+					auto r = "tag ACK WHAT '"s + std::string{MSG_FADE_INVALID_SHAPE} + "'"s;
+					REQUIRE(p.Fade("tag", "1000", "0", "wobbly").Pack() == r);
+				}
+				THEN ("asking for a waveform at a bad resolution returns failure") {
+					auto r = "tag ACK WHAT '"s + std::string{MSG_WAVEFORM_INVALID_VALUE} + "'"s;
+					for (const auto *buckets : {"", "0", "-1", "8193", "many"}) {
+						REQUIRE(p.Waveform(BROADCAST, "tag", buckets)->Pack() == r);
+					}
+				}
 			}
 
 			AND_WHEN("the audio is playing")
@@ -246,6 +610,109 @@ SCENARIO ("Player handles End requests correctly", "[player]") {
 	}
 }
 
+SCENARIO ("Player warns of damaged frames its files skip", "[player]") {
+	GIVEN ("a Player with a file loaded") {
+		DummyAudioSource *source = nullptr;
+		const std::vector<Player::Decoder> srcs{
+		        {"dummy",
+		         {"mp3"},
+		         nullptr,
+		         [&source](std::string_view path) -> std::unique_ptr<Audio::Source> {
+			         auto src = std::make_unique<DummyAudioSource, std::string_view>(std::move(path));
+			         source = src.get();
+			         return src;
+		         }}};
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, srcs);
+		p.Load("tag", "blah.mp3");
+		REQUIRE(source != nullptr);
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("the file has skipped nothing") {
+			REQUIRE(p.Update());
+
+			THEN ("the player warns of nothing") {
+				REQUIRE(os.str().empty());
+			}
+		}
+
+		WHEN ("the file skips some frames") {
+			source->skipped = 3;
+			REQUIRE(p.Update());
+
+			THEN ("the next update warns of them") {
+				REQUIRE(os.str() == "! WARN skipped-frames 3\n");
+			}
+
+			AND_WHEN ("it skips no more") {
+				os.str("");
+				REQUIRE(p.Update());
+
+				THEN ("the player doesn't warn again") {
+					REQUIRE(os.str().empty());
+				}
+			}
+
+			AND_WHEN ("it skips another") {
+				source->skipped = 4;
+				os.str("");
+				REQUIRE(p.Update());
+
+				THEN ("the player warns of the new total") {
+					REQUIRE(os.str() == "! WARN skipped-frames 4\n");
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Player schedules playing and stopping", "[player]") {
+	GIVEN ("a loaded Player") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+
+		p.Load("tag", "blah.mp3");
+
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		WHEN ("the player is told to play at a time that isn't a number") {
+			auto res = p.SetPlayingAt("tag", true, "soon");
+
+			THEN ("it rejects the command") {
+				REQUIRE(res.Pack() == "tag ACK WHAT '"s + std::string{MSG_AT_INVALID_VALUE} + "'"s);
+				REQUIRE_FALSE(p.IsPlaying());
+			}
+		}
+
+		WHEN ("the player is told to play at a time that has passed") {
+			auto res = p.SetPlayingAt("tag", true, "1");
+
+			THEN ("it starts playing, and says so") {
+				REQUIRE(res.Pack() == "tag ACK OK success");
+				REQUIRE(p.IsPlaying());
+				REQUIRE(os.str() == "! PLAY\n! POS 0\n");
+			}
+
+			AND_WHEN ("it is then told to stop at a time that has passed") {
+				os.str("");
+				res = p.SetPlayingAt("tag", false, "1");
+
+				THEN ("the stop is only announced on the next update") {
+					REQUIRE(res.Pack() == "tag ACK OK success");
+					REQUIRE(os.str().empty());
+
+					p.Update();
+					REQUIRE_FALSE(p.IsPlaying());
+					REQUIRE(os.str() == "! STOP\n! POS 0\n");
+				}
+			}
+		}
+	}
+}
+
 SCENARIO ("Player refuses commands when quitting", "[player]") {
 	GIVEN ("a loaded Player") {
 		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
@@ -279,7 +746,7 @@ SCENARIO ("Player refuses commands when quitting", "[player]") {
 				REQUIRE(p.Quit("tag").Pack() == response);
 			}
 			THEN ("dumping returns a player-closing failure") {
-				REQUIRE(p.Dump(5, "tag").Pack() == response);
+				REQUIRE(p.Dump(ClientId{5}, "tag").Pack() == response);
 			}
 		}
 	}
@@ -345,4 +812,472 @@ SCENARIO ("Player handles load errors properly", "[seek]") {
 	}
 }
 
+SCENARIO ("Player can load files in the background", "[player]") {
+	GIVEN ("a Player with a background runner that holds onto its work") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+
+		std::vector<std::pair<std::function<void()>, std::function<void()>>> queued;
+		p.SetBackgroundRunner([&queued](auto work, auto done) { queued.emplace_back(work, done); });
+		const auto run_all = [&queued] {
+			for (auto &[work, done] : queued) {
+				work();
+				done();
+			}
+			queued.clear();
+		};
+
+		WHEN ("a file is loaded in the background") {
+			const auto rs = p.LoadInBackground(static_cast<ClientId>(1), "tag", "baz.mp3");
+
+			THEN ("there is no response, and nothing is loaded yet") {
+				REQUIRE_FALSE(rs);
+				REQUIRE(os.str().empty());
+				REQUIRE(queued.size() == 1);
+			}
+
+			AND_WHEN ("the work finishes") {
+				run_all();
+
+				THEN ("the state is dumped, then the load is acknowledged") {
+					REQUIRE(os.str() == "! STOP\n! FLOAD baz.mp3\n! POS 0\n! LEN 0\ntag ACK OK success\n");
+				}
+
+				AND_THEN ("the acknowledgement is sent as the load's late reply") {
+					REQUIRE(drs.Completions() == 1);
+				}
+
+				AND_WHEN ("the file is ejected") {
+					os.str("");
+					const auto rs = p.Eject("tag2");
+
+					THEN ("it is ejected at once, and torn down in the background") {
+						REQUIRE(rs.Pack() == "tag2 ACK OK success");
+						REQUIRE(os.str() == "tag2 EJECT\n");
+						REQUIRE(queued.size() == 1);
+						run_all();
+						REQUIRE(os.str() == "tag2 EJECT\n");
+					}
+				}
+			}
+
+			AND_WHEN ("another file is loaded before the work finishes") {
+				std::ignore = p.LoadInBackground(static_cast<ClientId>(1), "tag2", "foo.mp3");
+				run_all();
+
+				THEN ("the first load is superseded by the second") {
+					REQUIRE(os.str() == "tag ACK FAIL 'Load superseded before it finished'\n"
+					                    "! STOP\n! FLOAD foo.mp3\n! POS 0\n! LEN 0\ntag2 ACK OK success\n");
+				}
+			}
+		}
+
+		WHEN ("a file that fails to open is loaded in the background") {
+			std::ignore = p.LoadInBackground(static_cast<ClientId>(1), "tag", "blah.ogg");
+			run_all();
+
+			THEN ("the failure is sent once the work finishes") {
+				REQUIRE(os.str() == "tag ACK FAIL 'test failure 1'\n");
+			}
+		}
+	}
+}
+
+SCENARIO ("Player probes files without loading them", "[player]") {
+	GIVEN ("a Player with a file loaded") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+		p.Load("tag", "baz.mp3");
+		os.str("");
+
+		WHEN ("some files are probed") {
+			const auto rs = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3", "bar.mp3"});
+
+			THEN ("each gets a PROBE, in order, and the loaded file is untouched") {
+				REQUIRE(rs);
+				REQUIRE(rs->Pack() == "tag ACK OK success");
+				REQUIRE(os.str() == "tag PROBE foo.mp3 0 44100 2 s32\ntag PROBE bar.mp3 0 44100 2 s32\n");
+				REQUIRE(p.Dump(static_cast<ClientId>(1), "dump").Pack() == "dump ACK OK success");
+				REQUIRE(os.str().find("FLOAD baz.mp3") != std::string::npos);
+			}
+		}
+
+		WHEN ("some of the files probed can't be opened") {
+			const auto rs = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3", "blah.ogg", "none.txt"});
+
+			THEN ("the rest are sent, and the first failure is named") {
+				REQUIRE(rs);
+				REQUIRE(rs->Pack() == "tag ACK FAIL 'blah.ogg: test failure 1'");
+				REQUIRE(os.str() == "tag PROBE foo.mp3 0 44100 2 s32\n");
+			}
+		}
+
+		WHEN ("a file fails to open with an error other than a file error") {
+			const auto rs = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3", "blah.flac"});
+
+			THEN ("it is reported as that file's failure") {
+				REQUIRE(rs);
+				REQUIRE(rs->Pack() == "tag ACK FAIL 'blah.flac: test failure 2'");
+				REQUIRE(os.str() == "tag PROBE foo.mp3 0 44100 2 s32\n");
+			}
+		}
+
+		WHEN ("an empty path is probed") {
+			const auto rs = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3", ""});
+
+			THEN ("the probe is refused") {
+				REQUIRE(rs);
+				REQUIRE(rs->Pack().starts_with("tag ACK WHAT"));
+				REQUIRE(os.str().empty());
+			}
+		}
+
+		AND_GIVEN ("a background runner that holds onto its work") {
+			std::vector<std::pair<std::function<void()>, std::function<void()>>> queued;
+			p.SetBackgroundRunner([&queued](auto work, auto done) { queued.emplace_back(work, done); });
+
+			WHEN ("some files are probed") {
+				const auto rs = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3", "bar.mp3"});
+
+				THEN ("every file opens at once, and nothing is sent yet") {
+					REQUIRE_FALSE(rs);
+					REQUIRE(queued.size() == 2);
+					REQUIRE(os.str().empty());
+				}
+
+				AND_WHEN ("the files open, last first") {
+					for (auto it = queued.rbegin(); it != queued.rend(); it++) {
+						it->first();
+						it->second();
+					}
+
+					THEN ("the PROBEs are sent together, in order, then the acknowledgement") {
+						REQUIRE(os.str() == "tag PROBE foo.mp3 0 44100 2 s32\ntag PROBE bar.mp3 0 44100 2 s32\n"
+						                    "tag ACK OK success\n");
+						REQUIRE(drs.Completions() == 1);
+					}
+				}
+			}
+
+			WHEN ("a file fails to open with an error other than a file error") {
+				std::ignore = p.Probe(static_cast<ClientId>(1), "tag", {"blah.flac"});
+				for (auto &[work, done] : queued) {
+					work();
+					done();
+				}
+
+				THEN ("the failure is sent as the file's") {
+					REQUIRE(os.str() == "tag ACK FAIL 'blah.flac: test failure 2'\n");
+				}
+			}
+		}
+	}
+
+	GIVEN ("a Player whose sources note when their scans start") {
+		static int scans = 0;
+		class ScanningSource : public DummyAudioSource
+		{
+		public:
+			using DummyAudioSource::DummyAudioSource;
+			void StartScans() override
+			{
+				scans++;
+			}
+		};
+		const std::vector<Player::Decoder> decoders{
+		        {"scanning", {"mp3"}, nullptr, [](std::string_view path) -> std::unique_ptr<Audio::Source> {
+			         return std::make_unique<ScanningSource>(path);
+		         }}};
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, decoders);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+		scans = 0;
+
+		WHEN ("a file is probed") {
+			std::ignore = p.Probe(static_cast<ClientId>(1), "tag", {"foo.mp3"});
+
+			THEN ("its scans never start") {
+				REQUIRE(scans == 0);
+			}
+		}
+
+		WHEN ("a file is loaded") {
+			p.Load("tag", "foo.mp3");
+
+			THEN ("its scans start") {
+				REQUIRE(scans == 1);
+			}
+		}
+	}
+}
+
+SCENARIO ("Player holds commands back until it is ready", "[player]") {
+	GIVEN ("a Player holding commands back") {
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		std::ostringstream os;
+		DummyResponseSink drs(os);
+		p.SetIo(drs);
+		p.HoldUntilReady();
+
+		WHEN ("a load and a play arrive") {
+			const auto load = p.WhenReady(static_cast<ClientId>(1), [&p] { return p.Load("t1", "baz.mp3"); });
+			const auto play = p.WhenReady(static_cast<ClientId>(1), [&p] { return p.SetPlaying("t2", true); });
+
+			THEN ("neither runs, or responds") {
+				REQUIRE_FALSE(load);
+				REQUIRE_FALSE(play);
+				REQUIRE(os.str().empty());
+				REQUIRE_FALSE(p.IsPlaying());
+			}
+
+			AND_WHEN ("the player is ready") {
+				p.MarkReady();
+
+				THEN ("they run in order, and send their responses") {
+					REQUIRE(p.IsPlaying());
+					REQUIRE(os.str() == "! STOP\n! FLOAD baz.mp3\n! POS 0\n! LEN 0\nt1 ACK OK success\n"
+					                    "! PLAY\n! POS 0\nt2 ACK OK success\n");
+					REQUIRE(drs.Completions() == 2);
+				}
+
+				THEN ("later commands run straight away") {
+					const auto rs = p.WhenReady(static_cast<ClientId>(1), [&p] { return p.SetPlaying("t3", false); });
+					REQUIRE(rs);
+					REQUIRE_FALSE(p.IsPlaying());
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Player picks decoders by probing files, then by extension", "[player]") {
+	GIVEN ("a probing decoder, a decoder without a probe, and a file") {
+		const auto path = (std::filesystem::temp_directory_path() / "playd-test-probe.wav").string();
+		const auto open = [](std::string_view path) -> std::unique_ptr<Audio::Source> {
+			return std::make_unique<DummyAudioSource, std::string_view>(std::move(path));
+		};
+		const std::vector<Player::Decoder> decoders{
+		        {"plain", {"wav"}, nullptr, open},
+		        {"sniffer",
+		         {"snf"},
+		         [](gsl::span<const std::byte> head) {
+			         return 4 <= head.size() && std::memcmp(head.data(), "SNIF", 4) == 0;
+		         },
+		         open},
+		        {"streamer", {}, nullptr, open, {"http"}}};
+
+		WHEN ("the file starts with what the probe looks for") {
+			std::ofstream{path, std::ios::binary} << "SNIF and then some audio";
+
+			THEN ("the probing decoder takes it, whatever its extension") {
+				const auto decoder = Player::FindDecoder(decoders, path);
+				REQUIRE(decoder != nullptr);
+				REQUIRE(decoder->name == "sniffer");
+			}
+		}
+
+		WHEN ("the file doesn't") {
+			std::ofstream{path, std::ios::binary} << "RIFF or something";
+
+			THEN ("its extension decides") {
+				const auto decoder = Player::FindDecoder(decoders, path);
+				REQUIRE(decoder != nullptr);
+				REQUIRE(decoder->name == "plain");
+			}
+		}
+
+		WHEN ("the file doesn't exist, and has an extension nobody takes") {
+			std::filesystem::remove(path);
+
+			THEN ("no decoder is picked") {
+				REQUIRE(Player::FindDecoder(decoders, path + ".xyz") == nullptr);
+			}
+		}
+
+		WHEN ("the path is a URL") {
+			THEN ("its scheme decides, whatever its extension") {
+				const auto decoder = Player::FindDecoder(decoders, "http://radio.example/live.wav");
+				REQUIRE(decoder != nullptr);
+				REQUIRE(decoder->name == "streamer");
+				REQUIRE(Player::FindDecoder(decoders, "ftp://radio.example/live.wav") == nullptr);
+			}
+		}
+
+		std::filesystem::remove(path);
+	}
+}
+
+SCENARIO ("Player publishes its playhead in shared memory", "[player][shared-playhead]") {
+	GIVEN ("a fresh Player with a shared playhead") {
+		const auto path = (std::filesystem::temp_directory_path() / "playd-test-player-playhead").string();
+		Player p(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+		auto owned = std::make_unique<SharedPlayhead>(path);
+		const auto *playhead = owned.get();
+		p.EnableSharedPlayhead(std::move(owned));
+
+		THEN ("the snapshot says it is ejected") {
+			REQUIRE(playhead->Read().state == Response::Code::EJECT);
+		}
+
+		WHEN ("a file is loaded, and the player updated") {
+			p.Load("tag", "baz.mp3");
+			p.Update();
+
+			THEN ("the snapshot says it is stopped, in a newer generation") {
+				const auto snapshot = playhead->Read();
+				REQUIRE(snapshot.state == Response::Code::STOP);
+				REQUIRE(snapshot.position == std::chrono::microseconds{0});
+				REQUIRE(0 < snapshot.generation);
+			}
+		}
+
+		std::remove(path.c_str());
+	}
+}
+
+SCENARIO ("Standby players follow snapshots, and take over from dead owners", "[player][state-snapshot]") {
+	const auto path = (std::filesystem::temp_directory_path() / "playd-test-player-snapshot").string();
+	std::remove(path.c_str());
+
+	std::ostringstream os;
+	DummyResponseSink drs(os);
+	Player standby(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>, DUMMY_SRCS);
+	standby.SetIo(drs);
+
+	GIVEN ("an owning Player, and a standby Player for its snapshot") {
+		auto owner = std::make_unique<Player>(0, &std::make_unique<DummyAudioSink, const Audio::Source &, int>,
+		                                      DUMMY_SRCS);
+		auto owned = std::make_unique<StateSnapshot>(path);
+		REQUIRE(owned->TryOwn());
+		owner->EnableSnapshot(std::move(owned));
+		standby.StandBy(std::make_unique<StateSnapshot>(path));
+
+		WHEN ("the owner loads and queues files, and both update") {
+			owner->Load("tag", "baz.mp3");
+			owner->Enqueue("tag", "qux.mp3", "250");
+			owner->Update();
+			standby.Update();
+
+			THEN ("the standby opens them too") {
+				REQUIRE(os.str().find("! FLOAD baz.mp3\n") != std::string::npos);
+				REQUIRE(os.str().find("! QUEUE qux.mp3\n") != std::string::npos);
+				REQUIRE(standby.IsStandingBy());
+			}
+
+			THEN ("the standby refuses to play") {
+				auto r = "tag ACK FAIL '"s + std::string{MSG_CMD_STANDING_BY} + "'"s;
+				REQUIRE(standby.SetPlaying("tag", true).Pack() == r);
+				REQUIRE_FALSE(standby.IsPlaying());
+			}
+
+			AND_WHEN ("the owner exits cleanly") {
+				owner = nullptr;
+				standby.Update();
+
+				THEN ("the standby carries on standing by") {
+					REQUIRE(standby.IsStandingBy());
+				}
+			}
+		}
+	}
+
+#ifndef _WIN32
+	// Only a real exit frees the lock, so the owners that die are children,
+	// which needs fork().
+	GIVEN ("a standby Player for a playing owner that dies without withdrawing its snapshot") {
+		standby.StandBy(std::make_unique<StateSnapshot>(path));
+
+		const auto child = fork();
+		if (child == 0) {
+			StateSnapshot dying{path};
+			if (dying.TryOwn()) {
+				dying.Publish({Response::Code::PLAY, std::chrono::microseconds{0}, "baz.mp3", "", {}, {}});
+			}
+			_exit(0);
+		}
+		REQUIRE(0 < child);
+		REQUIRE(waitpid(child, nullptr, 0) == child);
+
+		WHEN ("the standby updates") {
+			standby.Update();
+
+			THEN ("it takes over, playing the owner's file") {
+				REQUIRE_FALSE(standby.IsStandingBy());
+				REQUIRE(standby.IsPlaying());
+				REQUIRE(os.str().find("! FLOAD baz.mp3\n") != std::string::npos);
+				REQUIRE(os.str().find("! WARN took-over 1\n") != std::string::npos);
+			}
+
+			THEN ("it publishes snapshots of its own") {
+				StateSnapshot reader{path};
+				const auto state = reader.Read();
+				REQUIRE(state.has_value());
+				REQUIRE(state->state == Response::Code::PLAY);
+				REQUIRE(state->file == "baz.mp3");
+			}
+		}
+	}
+
+	GIVEN ("a standby Player for a playing owner killed halfway through publishing") {
+		standby.StandBy(std::make_unique<StateSnapshot>(path));
+
+		// The owner waits for the standby to follow it before dying.
+		int followed[2];
+		int published[2];
+		REQUIRE(pipe(followed) == 0);
+		REQUIRE(pipe(published) == 0);
+		const auto child = fork();
+		if (child == 0) {
+			char byte = 0;
+			StateSnapshot dying{path};
+			if (dying.TryOwn()) {
+				dying.Publish({Response::Code::PLAY, std::chrono::microseconds{0}, "baz.mp3", "", {}, {}});
+			}
+			std::ignore = write(published[1], &byte, 1);
+			std::ignore = read(followed[0], &byte, 1);
+
+			// Start the next publish as Publish would, and go no further.
+			const auto fd = open(path.c_str(), O_RDWR);
+			auto *raw = mmap(nullptr, sizeof(StateSnapshot::Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (raw != MAP_FAILED) static_cast<StateSnapshot::Layout *>(raw)->sequence.fetch_add(1);
+			_exit(0);
+		}
+		REQUIRE(0 < child);
+
+		char byte = 0;
+		REQUIRE(read(published[0], &byte, 1) == 1);
+		standby.Update();
+		REQUIRE(standby.IsStandingBy());
+		REQUIRE(write(followed[1], &byte, 1) == 1);
+		REQUIRE(waitpid(child, nullptr, 0) == child);
+		for (const auto fd : {followed[0], followed[1], published[0], published[1]}) close(fd);
+
+		WHEN ("the standby updates") {
+			standby.Update();
+
+			THEN ("it takes over from the last snapshot it read whole") {
+				REQUIRE_FALSE(standby.IsStandingBy());
+				REQUIRE(standby.IsPlaying());
+				REQUIRE(os.str().find("! WARN took-over 1\n") != std::string::npos);
+			}
+
+			THEN ("its own snapshots can be read") {
+				StateSnapshot reader{path};
+				const auto state = reader.Read();
+				REQUIRE(state.has_value());
+				REQUIRE(state->state == Response::Code::PLAY);
+				REQUIRE(state->file == "baz.mp3");
+			}
+		}
+	}
+#endif // _WIN32
+
+	std::remove(path.c_str());
+}
+
 } // namespace Playd::Tests
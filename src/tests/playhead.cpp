@@ -0,0 +1,72 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the PlayheadClock class.
+ */
+
+#include "../audio/playhead.h"
+
+#include <chrono>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("PlayheadClocks estimate what is being heard", "[playhead]") {
+	GIVEN ("a clock at 1000Hz") {
+		using namespace std::chrono_literals;
+		Audio::PlayheadClock clock{1000};
+		const Audio::PlayheadClock::Clock::time_point t0{1s};
+
+		THEN ("it starts at 0") {
+			REQUIRE(clock.Read(t0) == 0);
+		}
+
+		WHEN ("500 samples are handed over with 300 still to play") {
+			clock.Publish(500, 300, t0);
+
+			THEN ("the playhead is behind the handover") {
+				REQUIRE(clock.Read(t0) == 200);
+			}
+
+			THEN ("the playhead runs on at the sample rate") {
+				REQUIRE(clock.Read(t0 + 100ms) == 300);
+			}
+
+			THEN ("the playhead can't pass the handover") {
+				REQUIRE(clock.Read(t0 + 1s) == 500);
+			}
+
+			AND_WHEN ("a late snapshot lands behind the last reading") {
+				REQUIRE(clock.Read(t0 + 250ms) == 450);
+				clock.Publish(600, 200, t0 + 250ms);
+
+				THEN ("the playhead doesn't go backwards") {
+					REQUIRE(clock.Read(t0 + 250ms) == 450);
+				}
+			}
+
+			AND_WHEN ("the clock is held") {
+				clock.Hold(t0 + 100ms);
+
+				THEN ("it stays put until the next snapshot") {
+					REQUIRE(clock.Read(t0 + 200ms) == 300);
+					clock.Publish(600, 300, t0 + 200ms);
+					REQUIRE(clock.Read(t0 + 250ms) == 350);
+				}
+			}
+
+			AND_WHEN ("the clock is reset") {
+				clock.Reset(50, t0 + 100ms);
+
+				THEN ("it reads the new position, even going backwards") {
+					REQUIRE(clock.Read(t0 + 200ms) == 50);
+				}
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,90 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the RamSource class.
+ */
+
+#include "../audio/sources/ram.h"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sample_format.h"
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("RamSources play clips out of memory", "[ram-source]") {
+	GIVEN ("a RamSource over a stereo 16-bit clip of four samples") {
+		auto clip = std::make_shared<Audio::PcmClip>();
+		clip->path = "jingle.wav";
+		clip->rate = 48000;
+		clip->channels = 2;
+		clip->format = Audio::SampleFormat::SINT16;
+		for (int i = 0; i < 16; i++) clip->samples.push_back(static_cast<std::byte>(i));
+		Audio::RamSource source{clip};
+
+		THEN ("it describes the clip") {
+			REQUIRE(source.Path() == "jingle.wav");
+			REQUIRE(source.SampleRate() == 48000);
+			REQUIRE(source.ChannelCount() == 2);
+			REQUIRE(source.OutputSampleFormat() == Audio::SampleFormat::SINT16);
+			REQUIRE(source.Length() == 4);
+		}
+
+		WHEN ("three samples are decoded, then three more") {
+			std::array<std::byte, 12> buf{};
+			const auto [first_state, first_count] = source.Decode(buf);
+			const auto [second_state, second_count] = source.Decode(buf);
+
+			THEN ("the first three come back, then only the last") {
+				REQUIRE(first_state == Audio::Source::DecodeState::DECODING);
+				REQUIRE(first_count == 12);
+				REQUIRE(second_state == Audio::Source::DecodeState::DECODING);
+				REQUIRE(second_count == 4);
+				REQUIRE(buf[0] == std::byte{12});
+			}
+
+			AND_WHEN ("another round is decoded") {
+				THEN ("the clip has run out") {
+					REQUIRE(source.Decode(buf).first == Audio::Source::DecodeState::END_OF_FILE);
+				}
+			}
+		}
+
+		WHEN ("the source seeks to the third sample") {
+			REQUIRE(source.Seek(2) == 2);
+
+			THEN ("decoding starts from there") {
+				std::array<std::byte, 4> buf{};
+				REQUIRE(source.Decode(buf).second == 4);
+				REQUIRE(buf[0] == std::byte{8});
+			}
+		}
+
+		WHEN ("the source seeks past the end") {
+			THEN ("the seek fails") {
+				REQUIRE_THROWS_AS(source.Seek(5), SeekError);
+			}
+		}
+
+		WHEN ("the source is decoded whole into another clip") {
+			const auto copy = Audio::RamSource::DecodeAll(source);
+
+			THEN ("the new clip is the same as the old one") {
+				REQUIRE(copy->path == clip->path);
+				REQUIRE(copy->rate == clip->rate);
+				REQUIRE(copy->channels == clip->channels);
+				REQUIRE(copy->format == clip->format);
+				REQUIRE(copy->samples == clip->samples);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,212 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Resampler and ResampledSource classes.
+ */
+
+#include "../audio/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <gsl/gsl>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#include "../audio/sample_format.h"
+#include "../audio/source.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// Runs a whole signal through a resampler, including the drained tail.
+static std::vector<float> ResampleAll(Audio::Resampler &r, const std::vector<float> &in, std::uint8_t channels)
+{
+	r.Push(in);
+	r.Drain();
+
+	std::vector<float> out;
+	std::vector<float> chunk(256 * channels);
+	while (const auto count = r.Pull(chunk)) {
+		out.insert(out.end(), chunk.begin(), chunk.begin() + count * channels);
+	}
+	return out;
+}
+
+SCENARIO ("Resamplers keep the length and level of a signal", "[resampler]") {
+	GIVEN ("a tenth of a second of stereo DC at 44.1 kHz") {
+		std::vector<float> in;
+		for (int i = 0; i < 4410; i++) {
+			in.push_back(0.5f);
+			in.push_back(-0.25f);
+		}
+
+		WHEN ("it is resampled to 48 kHz") {
+			Audio::Resampler r{44100, 48000, 2, Audio::Resampler::Quality::MEDIUM};
+			auto out = ResampleAll(r, in, 2);
+
+			THEN ("there is a tenth of a second of output, give or take the filter") {
+				const auto frames = static_cast<int>(out.size() / 2);
+				REQUIRE(std::abs(frames - 4800) <= static_cast<int>(r.Taps()));
+			}
+
+			THEN ("the level of each channel is unchanged away from the ends") {
+				float left_error = 0.0f;
+				float right_error = 0.0f;
+				for (size_t i = 200; i < 4600; i++) {
+					left_error = std::max(left_error, std::abs(out[i * 2] - 0.5f));
+					right_error = std::max(right_error, std::abs(out[i * 2 + 1] + 0.25f));
+				}
+				REQUIRE(left_error < 1e-3f);
+				REQUIRE(right_error < 1e-3f);
+			}
+		}
+
+		WHEN ("it is resampled down to 22.05 kHz") {
+			Audio::Resampler r{44100, 22050, 2, Audio::Resampler::Quality::LOW};
+			auto out = ResampleAll(r, in, 2);
+
+			THEN ("there is a tenth of a second of output, give or take the filter") {
+				const auto frames = static_cast<int>(out.size() / 2);
+				REQUIRE(std::abs(frames - 2205) <= static_cast<int>(r.Taps()));
+			}
+
+			THEN ("the level is unchanged away from the ends") {
+				float error = 0.0f;
+				for (size_t i = 100; i < 2100; i++) error = std::max(error, std::abs(out[i * 2] - 0.5f));
+				REQUIRE(error < 1e-3f);
+			}
+		}
+	}
+}
+
+SCENARIO ("Resamplers keep the timing of a signal", "[resampler]") {
+	GIVEN ("a 1 kHz mono sine wave at 44.1 kHz") {
+		constexpr double freq = 1000.0;
+		std::vector<float> in(44100 / 10);
+		for (size_t i = 0; i < in.size(); i++) {
+			in[i] = static_cast<float>(0.5 * std::sin(2.0 * std::numbers::pi * freq * i / 44100.0));
+		}
+
+		WHEN ("it is resampled to 48 kHz at high quality") {
+			Audio::Resampler r{44100, 48000, 1, Audio::Resampler::Quality::HIGH};
+			auto out = ResampleAll(r, in, 1);
+
+			THEN ("each output sample matches the sine wave sampled at 48 kHz") {
+				double error = 0.0;
+				for (size_t i = 200; i < 4600; i++) {
+					const auto ideal = 0.5 * std::sin(2.0 * std::numbers::pi * freq * i / 48000.0);
+					error = std::max(error, std::abs(out[i] - ideal));
+				}
+				REQUIRE(error < 2e-3);
+			}
+		}
+	}
+}
+
+/// A mono, 16-bit source of a fixed number of samples of constant level.
+class ConstantSource : public Audio::Source
+{
+public:
+	ConstantSource(std::uint32_t rate, std::uint64_t length)
+	    : Audio::Source("constant"), rate{rate}, length{length}, position{0}
+	{
+	}
+
+	using Audio::Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		if (this->position == this->length) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+		const auto count = std::min<std::uint64_t>(out.size() / 2, this->length - this->position);
+		const std::int16_t level = 16384;
+		for (size_t i = 0; i < count; i++) std::memcpy(out.data() + i * 2, &level, 2);
+
+		this->position += count;
+		return std::make_pair(DecodeState::DECODING, count * 2);
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return 1;
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return this->rate;
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return Audio::SampleFormat::SINT16;
+	}
+
+	std::uint64_t Seek(std::uint64_t new_position) override
+	{
+		this->position = new_position;
+		return new_position;
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->length;
+	}
+
+	std::uint32_t rate;     ///< The sample rate.
+	std::uint64_t length;   ///< The length, in samples.
+	std::uint64_t position; ///< The position, in samples.
+};
+
+SCENARIO ("ResampledSource presents another source at a new rate", "[resampler]") {
+	GIVEN ("a one-second 44.1 kHz source resampled to 48 kHz") {
+		auto inner = std::make_unique<ConstantSource>(44100, 44100);
+		auto *raw_inner = inner.get();
+		Audio::ResampledSource src{std::move(inner), 48000, Audio::Resampler::Quality::MEDIUM};
+
+		THEN ("it reports the new rate, FLOAT32 samples and a rescaled length") {
+			REQUIRE(src.SampleRate() == 48000);
+			REQUIRE(src.OutputSampleFormat() == Audio::SampleFormat::FLOAT32);
+			REQUIRE(src.ChannelCount() == 1);
+			REQUIRE(src.Length() == 48000);
+		}
+
+		THEN ("it reports converting to FLOAT32, then resampling") {
+			REQUIRE(src.Conversions() == Audio::ConversionList{"s16>f32", "44100>48000Hz"});
+		}
+
+		WHEN ("it is decoded to the end") {
+			std::vector<float> buf(1024);
+			const gsl::span<std::byte> out(reinterpret_cast<std::byte *>(buf.data()), buf.size() * sizeof(float));
+
+			size_t total = 0;
+			float last_mid = 0.0f;
+			for (;;) {
+				auto [state, count] = src.Decode(out);
+				total += count / sizeof(float);
+				if (count != 0 && 20000 < total && total < 30000) last_mid = buf[0];
+				if (state == Audio::Source::DecodeState::END_OF_FILE) break;
+			}
+
+			THEN ("about a second of samples comes out at the converted level") {
+				REQUIRE(std::abs(static_cast<long>(total) - 48000) < 64);
+				REQUIRE(std::abs(last_mid - 0.5f) < 1e-3f);
+			}
+		}
+
+		WHEN ("it is seeked half way") {
+			const auto pos = src.Seek(24000);
+
+			THEN ("the inner source is seeked to the equivalent position") {
+				REQUIRE(raw_inner->position == 22050);
+				REQUIRE(pos == 24000);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -8,6 +8,7 @@
 
 #include "../response.h"
 
+#include <cstdint>
 #include <string>
 
 #include "catch.hpp"
@@ -25,6 +26,12 @@ SCENARIO ("Response's convenience constructors create correct Responses", "[comm
 				REQUIRE(s == "tag ACK OK success");
 			}
 		}
+
+		WHEN ("its code is asked for") {
+			THEN ("it is ACK") {
+				REQUIRE(c.GetCode() == Response::Code::ACK);
+			}
+		}
 	}
 
 	GIVEN ("A Response created via Response::Invalid()") {
@@ -130,4 +137,37 @@ SCENARIO ("Responses correctly escape arguments with single quotes", "[response]
 	}
 }
 
+SCENARIO ("Responses escape long arguments wherever the special character is", "[response]") {
+	GIVEN ("a long path with nothing to escape") {
+		const std::string path(40, 'x');
+
+		THEN ("it is not quoted") {
+			REQUIRE(Response("tag", Response::Code::FLOAD).AddArg(path).Pack() == "tag FLOAD " + path);
+		}
+
+		WHEN ("one character is replaced with something needing escaping") {
+			THEN ("it is quoted, whether the character is in a vector or the tail") {
+				for (const char special : {' ', '\t', '\r', '"', '\\'}) {
+					for (const size_t at : {size_t{0}, size_t{15}, size_t{16}, size_t{39}}) {
+						auto escaped = path;
+						escaped[at] = special;
+						REQUIRE(Response("tag", Response::Code::FLOAD).AddArg(escaped).Pack() ==
+						        "tag FLOAD '" + escaped + "'");
+					}
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Responses format integer arguments", "[response]") {
+	WHEN ("the Response is fed integers") {
+		auto r = Response("tag", Response::Code::POS).AddArg(std::int64_t{-42}).AddArg(UINT64_MAX).AddArg(0);
+
+		THEN ("they are formatted in decimal, unquoted") {
+			REQUIRE(r.Pack() == "tag POS -42 18446744073709551615 0");
+		}
+	}
+}
+
 } // namespace Playd::Tests
@@ -8,7 +8,13 @@
 
 #include "../audio/ringbuffer.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <gsl/gsl>
+#include <thread>
 
 #include "../errors.h"
 #include "catch.hpp"
@@ -147,4 +153,214 @@ SCENARIO ("Ring buffer reports capacities correctly", "[ringbuffer]") {
 	}
 }
 
+SCENARIO ("Ring buffer lends out contiguous write regions", "[ringbuffer]") {
+	GIVEN ("a ring buffer whose write position is near the end") {
+		constexpr int cap{32};
+		constexpr int amt{24};
+		Audio::RingBuffer rb{cap};
+		std::array<std::byte, cap> buf{};
+
+		rb.Write(gsl::span<const std::byte>{buf.data(), amt});
+		rb.Read(gsl::span<std::byte>{buf.data(), amt});
+
+		WHEN ("a write region is acquired") {
+			auto region = rb.AcquireWrite();
+
+			THEN ("the region stops at the end of the buffer") {
+				REQUIRE(region.size() == cap - amt);
+			}
+
+			AND_WHEN ("part of the region is committed") {
+				std::fill(region.begin(), region.end(), std::byte{42});
+				rb.CommitWrite(4);
+
+				THEN ("only the committed bytes are readable") {
+					REQUIRE(rb.ReadCapacity() == 4);
+				}
+				THEN ("the committed bytes read back as written") {
+					std::array<std::byte, 4> out{};
+					rb.Read(out);
+					REQUIRE(std::all_of(out.begin(), out.end(), [](auto b) { return b == std::byte{42}; }));
+				}
+			}
+
+			AND_WHEN ("more than the region is committed") {
+				THEN ("an internal error is raised") {
+					REQUIRE_THROWS_AS(rb.CommitWrite(region.size() + 1), InternalError);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Ring buffer capacities are rounded up to powers of two", "[ringbuffer]") {
+	GIVEN ("a ring buffer constructed with a non-power-of-two capacity") {
+		Audio::RingBuffer rb{33};
+
+		THEN ("Capacity() is the next power of two") {
+			REQUIRE(rb.Capacity() == 64);
+		}
+		THEN ("WriteCapacity() is the full capacity") {
+			REQUIRE(rb.WriteCapacity() == 64);
+		}
+	}
+}
+
+SCENARIO ("Ring buffer preserves data across the wrap-around point", "[ringbuffer]") {
+	GIVEN ("a ring buffer whose counters are near the end of the buffer") {
+		constexpr int cap{32};
+		Audio::RingBuffer rb{cap};
+		std::array<std::byte, cap> buf{};
+		gsl::czstring<> msg{"this message is 2^5 chars long!\0this bit isn't\0"};
+		auto m8 = reinterpret_cast<const std::byte *>(msg);
+
+		rb.Write(gsl::span<const std::byte>{m8, 24});
+		rb.Read(gsl::span<std::byte>{buf.data(), 24});
+
+		WHEN ("a write is made that crosses the end of the buffer") {
+			rb.Write(gsl::span<const std::byte>{m8, 16});
+
+			THEN ("ReadCapacity() is the amount written") {
+				REQUIRE(rb.ReadCapacity() == 16);
+			}
+
+			AND_WHEN("the data is read back")
+			{
+				rb.Read(gsl::span<std::byte>{buf.data(), 16});
+
+				THEN ("the data is the same as that written") {
+					REQUIRE(std::memcmp(buf.data(), m8, 16) == 0);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Ring buffer ReadSome reads only what is available", "[ringbuffer]") {
+	GIVEN ("an empty ring buffer and properly sized buffer") {
+		constexpr int cap{32};
+		Audio::RingBuffer rb{cap};
+		std::array<std::byte, cap> buf{};
+		gsl::czstring<> msg{"this message is 2^5 chars long!\0this bit isn't\0"};
+		auto m8 = reinterpret_cast<const std::byte *>(msg);
+
+		WHEN ("ReadSome is called on the empty buffer") {
+			THEN ("it reads nothing, and does not throw") {
+				REQUIRE(rb.ReadSome(gsl::span<std::byte>{buf.data(), cap}) == 0);
+			}
+		}
+		WHEN ("ReadSome asks for more than is available") {
+			rb.Write(gsl::span<const std::byte>{m8, 8});
+
+			THEN ("it reads only what is available") {
+				REQUIRE(rb.ReadSome(gsl::span<std::byte>{buf.data(), cap}) == 8);
+				REQUIRE(std::memcmp(buf.data(), m8, 8) == 0);
+				REQUIRE(rb.ReadCapacity() == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("Ring buffer Skip discards from the front", "[ringbuffer]") {
+	GIVEN ("a partially filled ring buffer") {
+		constexpr int cap{32};
+		Audio::RingBuffer rb{cap};
+		std::array<std::byte, cap> buf{};
+		gsl::czstring<> msg{"this message is 2^5 chars long!\0this bit isn't\0"};
+		auto m8 = reinterpret_cast<const std::byte *>(msg);
+
+		rb.Write(gsl::span<const std::byte>{m8, 16});
+
+		WHEN ("part of the data is skipped") {
+			const auto skipped = rb.Skip(5);
+
+			THEN ("the rest is read back from after the skip") {
+				REQUIRE(skipped == 5);
+				REQUIRE(rb.ReadCapacity() == 11);
+				REQUIRE(rb.WriteCapacity() == cap - 11);
+				REQUIRE(rb.ReadSome(gsl::span<std::byte>{buf.data(), cap}) == 11);
+				REQUIRE(std::memcmp(buf.data(), m8 + 5, 11) == 0);
+			}
+		}
+		WHEN ("more is skipped than is available") {
+			THEN ("only what is available is skipped") {
+				REQUIRE(rb.Skip(cap) == 16);
+				REQUIRE(rb.ReadCapacity() == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("Ring buffer discards only data written before a flush", "[ringbuffer]") {
+	GIVEN ("a partially filled ring buffer") {
+		constexpr int cap{32};
+		Audio::RingBuffer rb{cap};
+		std::array<std::byte, cap> buf{};
+		gsl::czstring<> msg{"this message is 2^5 chars long!\0this bit isn't\0"};
+		auto m8 = reinterpret_cast<const std::byte *>(msg);
+
+		rb.Write(gsl::span<const std::byte>{m8, 16});
+
+		WHEN ("the buffer is flushed and then written to again") {
+			rb.Flush();
+			rb.Write(gsl::span<const std::byte>{m8 + 16, 8});
+
+			THEN ("ReadCapacity() is the amount written after the flush") {
+				REQUIRE(rb.ReadCapacity() == 8);
+			}
+			THEN ("reading gives back the data written after the flush") {
+				REQUIRE(rb.ReadSome(gsl::span<std::byte>{buf.data(), cap}) == 8);
+				REQUIRE(std::memcmp(buf.data(), m8 + 16, 8) == 0);
+			}
+		}
+	}
+}
+
+SCENARIO ("Ring buffer transfers data intact between two threads", "[ringbuffer]") {
+	GIVEN ("a small ring buffer, and a producer writing sequence numbers") {
+		// Each record is one 64-bit sequence number.  All reads, writes,
+		// and flushes happen on record boundaries, so the consumer should
+		// only ever see whole, strictly increasing records.
+		constexpr std::uint64_t records{200000};
+		constexpr size_t rsize{sizeof(std::uint64_t)};
+		Audio::RingBuffer rb{64 * rsize};
+
+		WHEN ("a consumer reads concurrently while the producer flushes") {
+			std::atomic<bool> done{false};
+			std::thread producer{[&rb, &done] {
+				for (std::uint64_t i = 1; i <= records;) {
+					if (rb.WriteCapacity() < rsize) {
+						std::this_thread::yield();
+						continue;
+					}
+					rb.Write(gsl::span<const std::byte>{reinterpret_cast<const std::byte *>(&i), rsize});
+					if (i % 1000 == 0) rb.Flush();
+					i++;
+				}
+				done.store(true);
+			}};
+
+			std::uint64_t last{0};
+			bool in_order{true};
+			std::array<std::uint64_t, 16> got{};
+			auto gotb = gsl::span<std::byte>{reinterpret_cast<std::byte *>(got.data()), got.size() * rsize};
+			while (last < records && in_order) {
+				const auto n = rb.ReadSome(gotb) / rsize;
+				for (size_t i = 0; i < n; i++) {
+					in_order = in_order && last < got[i];
+					last = got[i];
+				}
+				// Flushes may discard the last record, so stop once
+				// the producer has finished and the buffer is dry.
+				if (n == 0 && done.load() && rb.ReadCapacity() == 0) break;
+			}
+			producer.join();
+
+			THEN ("every record read was whole and in order") {
+				REQUIRE(in_order);
+			}
+		}
+	}
+}
+
 } // namespace playd::tests
@@ -0,0 +1,58 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for real-time audio buffer memory.
+ */
+
+#include "../audio/rt_memory.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("RtVectors behave like vectors", "[rt-memory]") {
+	GIVEN ("an RtVector of 1000 floats") {
+		Audio::RtVector<float> floats(1000);
+
+		THEN ("it starts zeroed") {
+			REQUIRE(std::all_of(floats.begin(), floats.end(), [](float f) { return f == 0.0f; }));
+		}
+
+		THEN ("it is aligned for the float kernels") {
+			REQUIRE(reinterpret_cast<std::uintptr_t>(floats.data()) % 32 == 0);
+		}
+
+		WHEN ("it grows past a page") {
+			std::iota(floats.begin(), floats.end(), 0.0f);
+			floats.resize(100000, -1.0f);
+
+			THEN ("it keeps what it had, and fills the rest") {
+				REQUIRE(floats[999] == 999.0f);
+				REQUIRE(floats[1000] == -1.0f);
+				REQUIRE(floats.back() == -1.0f);
+			}
+		}
+	}
+
+	GIVEN ("huge pages have been asked for") {
+		Audio::EnableHugePages();
+
+		WHEN ("an RtVector bigger than a huge page is made") {
+			Audio::RtVector<std::byte> bytes(5 * 1024 * 1024 + 1, std::byte{0x5A});
+
+			THEN ("it works whether or not huge pages were to hand") {
+				REQUIRE(bytes.front() == std::byte{0x5A});
+				REQUIRE(bytes.back() == std::byte{0x5A});
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
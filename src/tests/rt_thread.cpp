@@ -0,0 +1,66 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the ThreadPolicy class.
+ */
+
+#include "../audio/rt_thread.h"
+
+#include <vector>
+
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("ThreadPolicies parse priorities and CPU lists", "[rt-thread]") {
+	GIVEN ("valid priorities") {
+		THEN ("they parse to themselves") {
+			REQUIRE(Audio::ThreadPolicy::ParsePriority("1") == 1);
+			REQUIRE(Audio::ThreadPolicy::ParsePriority("99") == 99);
+		}
+	}
+
+	GIVEN ("invalid priorities") {
+		THEN ("they are rejected") {
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParsePriority("0"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParsePriority("100"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParsePriority("high"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParsePriority(""), ConfigError);
+		}
+	}
+
+	GIVEN ("a CPU list with single CPUs, ranges and duplicates") {
+		const auto cpus = Audio::ThreadPolicy::ParseCpus("5,0-2,1");
+
+		THEN ("it parses to each CPU once, in order") {
+			REQUIRE(cpus == std::vector<int>{0, 1, 2, 5});
+		}
+	}
+
+	GIVEN ("invalid CPU lists") {
+		THEN ("they are rejected") {
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParseCpus(""), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParseCpus("1,"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParseCpus("3-1"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParseCpus("-1"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::ThreadPolicy::ParseCpus("0-100000"), ConfigError);
+		}
+	}
+}
+
+SCENARIO ("Default ThreadPolicies leave threads alone", "[rt-thread]") {
+	GIVEN ("a default policy") {
+		const Audio::ThreadPolicy policy;
+
+		THEN ("it is default, and applies without trouble") {
+			REQUIRE(policy.IsDefault());
+			REQUIRE_NOTHROW(policy.Check());
+			REQUIRE_NOTHROW(policy.ApplyToThisThread());
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,117 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the RtpSink class.
+ */
+
+#include "../audio/sinks/rtp.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../errors.h"
+#include "catch.hpp"
+#include "dummy_audio_source.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("RtpSinks pack RTP headers and L24 samples", "[rtp-sink]") {
+	GIVEN ("an RTP header") {
+		std::array<std::byte, Audio::RtpSink::HEADER_BYTES> header{};
+		Audio::RtpSink::PackHeader(header, 96, 0x1234, 0x89ABCDEF, 0x01020304);
+
+		THEN ("it is version 2, big-endian, with the fields in order") {
+			REQUIRE(header == std::array<std::byte, 12>{std::byte{0x80}, std::byte{96}, std::byte{0x12},
+			                                            std::byte{0x34}, std::byte{0x89}, std::byte{0xAB},
+			                                            std::byte{0xCD}, std::byte{0xEF}, std::byte{0x01},
+			                                            std::byte{0x02}, std::byte{0x03}, std::byte{0x04}});
+		}
+	}
+
+	GIVEN ("some 32-bit samples") {
+		const std::array<std::int32_t, 2> in{0x12345678, -256};
+		std::array<std::byte, 6> out{};
+		Audio::RtpSink::PackL24(in, out);
+
+		THEN ("their top 24 bits are packed big-endian") {
+			REQUIRE(out == std::array<std::byte, 6>{std::byte{0x12}, std::byte{0x34}, std::byte{0x56},
+			                                        std::byte{0xFF}, std::byte{0xFF}, std::byte{0xFF}});
+		}
+	}
+}
+
+SCENARIO ("RtpSinks parse destinations", "[rtp-sink]") {
+	GIVEN ("IPv4 and bracketed IPv6 destinations") {
+		THEN ("they parse to their host and port") {
+			REQUIRE(Audio::RtpSink::ParseDestination("239.69.1.1:5004") == std::make_pair(std::string{"239.69.1.1"},
+			                                                                              std::uint16_t{5004}));
+			REQUIRE(Audio::RtpSink::ParseDestination("[ff05::1]:5006") ==
+			        std::make_pair(std::string{"ff05::1"}, std::uint16_t{5006}));
+		}
+	}
+
+	GIVEN ("invalid destinations") {
+		THEN ("they are rejected") {
+			REQUIRE_THROWS_AS(Audio::RtpSink::ParseDestination("239.69.1.1"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::RtpSink::ParseDestination(":5004"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::RtpSink::ParseDestination("ff05::1:5004"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::RtpSink::ParseDestination("239.69.1.1:0"), ConfigError);
+			REQUIRE_THROWS_AS(Audio::RtpSink::ParseDestination("239.69.1.1:99999"), ConfigError);
+		}
+	}
+}
+
+SCENARIO ("RtpSinks send what they're given as RTP", "[rtp-sink]") {
+	GIVEN ("a socket listening on loopback, and an RtpSink sending to it") {
+		const auto fd = socket(AF_INET, SOCK_DGRAM, 0);
+		REQUIRE(0 <= fd);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		REQUIRE(bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+		socklen_t len = sizeof(addr);
+		REQUIRE(getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len) == 0);
+		timeval timeout{1, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		// The dummy source is stereo, 32-bit and 44.1kHz, so each 1ms packet
+		// has 44 frames in it.
+		DummyAudioSource source{"test"};
+		Audio::RtpSink sink{source, 0, Audio::RtpSink::Config{"127.0.0.1", ntohs(addr.sin_port)}};
+
+		WHEN ("it is given a sample and started") {
+			const std::array<std::int32_t, 2> frame{0x11223344, 0x55667788};
+			const gsl::span<const std::byte> bytes{reinterpret_cast<const std::byte *>(frame.data()),
+			                                       sizeof(frame)};
+			REQUIRE(sink.Transfer(bytes) == sizeof(frame));
+			sink.Start();
+
+			THEN ("the first packet holds the sample, then silence") {
+				std::vector<std::byte> packet(2048);
+				const auto got = recv(fd, packet.data(), packet.size(), 0);
+				REQUIRE(got == static_cast<ssize_t>(Audio::RtpSink::HEADER_BYTES + (44 * 2 * 3)));
+				REQUIRE(packet[0] == std::byte{0x80});
+				REQUIRE(packet[1] == std::byte{96});
+				const auto *payload = packet.data() + Audio::RtpSink::HEADER_BYTES;
+				REQUIRE(payload[0] == std::byte{0x11});
+				REQUIRE(payload[3] == std::byte{0x55});
+				REQUIRE(payload[6] == std::byte{0x00});
+			}
+
+			sink.Stop();
+		}
+
+		close(fd);
+	}
+}
+
+} // namespace Playd::Tests
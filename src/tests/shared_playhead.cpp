@@ -0,0 +1,76 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the SharedPlayhead class.
+ */
+
+#include "../shared_playhead.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "../errors.h"
+#include "../response.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("SharedPlayheads publish consistent snapshots", "[shared-playhead]") {
+	const auto path = (std::filesystem::temp_directory_path() / "playd-test-shared-playhead").string();
+
+	GIVEN ("a shared playhead") {
+		SharedPlayhead playhead{path};
+
+		THEN ("the file starts with the magic number and version") {
+			std::ifstream in{path, std::ios::binary};
+			std::uint32_t header[2]{};
+			in.read(reinterpret_cast<char *>(header), sizeof(header));
+			REQUIRE(header[0] == SharedPlayhead::MAGIC);
+			REQUIRE(header[1] == SharedPlayhead::VERSION);
+			REQUIRE(std::filesystem::file_size(path) == sizeof(SharedPlayhead::Layout));
+		}
+
+		WHEN ("a snapshot is published") {
+			const auto before = std::chrono::steady_clock::now().time_since_epoch();
+			playhead.Publish({Response::Code::PLAY, std::chrono::microseconds{1500}, std::chrono::microseconds{60000},
+			                  4, {}});
+
+			THEN ("reading gives it back, stamped with the time") {
+				const auto snapshot = playhead.Read();
+				REQUIRE(snapshot.state == Response::Code::PLAY);
+				REQUIRE(snapshot.position == std::chrono::microseconds{1500});
+				REQUIRE(snapshot.length == std::chrono::microseconds{60000});
+				REQUIRE(snapshot.generation == 4);
+				REQUIRE(before <= snapshot.clock);
+			}
+
+			AND_WHEN ("another is published") {
+				playhead.Publish({Response::Code::EJECT, std::chrono::microseconds{0}, std::chrono::microseconds{0},
+				                  5, {}});
+
+				THEN ("reading gives back only the newer one") {
+					const auto snapshot = playhead.Read();
+					REQUIRE(snapshot.state == Response::Code::EJECT);
+					REQUIRE(snapshot.position == std::chrono::microseconds{0});
+					REQUIRE(snapshot.generation == 5);
+				}
+			}
+		}
+	}
+
+	GIVEN ("a path that can't be created") {
+		THEN ("making a shared playhead there fails") {
+			REQUIRE_THROWS_AS(SharedPlayhead{"/nonexistent/playd-test-shared-playhead"}, FileError);
+		}
+	}
+
+	std::remove(path.c_str());
+}
+
+} // namespace Playd::Tests
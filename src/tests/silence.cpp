@@ -0,0 +1,182 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for silence detection, and the TrimmedSource and CueCache classes.
+ */
+
+#include "../audio/silence.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sources/ram.h"
+#include "catch.hpp"
+#include "pcm_clip.h"
+
+namespace Playd::Tests
+{
+/**
+ * Makes a mono 16-bit clip at 1kHz, so that each sample is a millisecond.
+ * @param samples The samples.
+ * @return The clip.
+ */
+static std::shared_ptr<const Audio::PcmClip> QuietClip(const std::vector<std::int16_t> &samples)
+{
+	return MakeClip("silence.wav", 1000, 1, samples);
+}
+
+/// Shorthand for a point in a 1kHz clip.
+static std::chrono::microseconds Ms(std::int64_t ms)
+{
+	return std::chrono::milliseconds{ms};
+}
+
+SCENARIO ("Cue points mark the audible part of a file", "[silence]") {
+	GIVEN ("a clip with silence, then two loud samples, then silence") {
+		Audio::RamSource source{QuietClip({0, 3, -3, 10000, 0, -20000, 0, 0})};
+
+		WHEN ("its cue points are found at -60 dBFS") {
+			const auto cues = Audio::FindCuePoints(source, -60.0);
+
+			THEN ("they run from the first loud sample to just after the last") {
+				REQUIRE(cues == Audio::CuePoints{Ms(3), Ms(6)});
+			}
+		}
+	}
+
+	GIVEN ("a clip longer than the backwards scan's window") {
+		std::vector<std::int16_t> samples(25000);
+		samples[100] = 1000;
+		samples[2000] = -1000;
+		Audio::RamSource source{QuietClip(samples)};
+
+		WHEN ("its cue points are found") {
+			const auto cues = Audio::FindCuePoints(source, -60.0);
+
+			THEN ("the scan goes back window by window to the last loud sample") {
+				REQUIRE(cues == Audio::CuePoints{Ms(100), Ms(2001)});
+			}
+		}
+	}
+
+	GIVEN ("a clip that is silent throughout") {
+		Audio::RamSource source{QuietClip({0, 1, -1, 0})};
+
+		WHEN ("its cue points are found") {
+			const auto cues = Audio::FindCuePoints(source, -60.0);
+
+			THEN ("they cover the whole clip") {
+				REQUIRE(cues == Audio::CuePoints{Ms(0), Ms(4)});
+			}
+		}
+	}
+}
+
+SCENARIO ("TrimmedSources play only between their cue points", "[silence]") {
+	GIVEN ("a clip trimmed to its middle three samples") {
+		auto inner = std::make_unique<Audio::RamSource>(QuietClip({1, 2, 3, 4, 5, 6, 7}));
+		Audio::TrimmedSource source{std::move(inner), Audio::CuePoints{Ms(2), Ms(5)}};
+
+		THEN ("its length is the trimmed length, and it keeps its cue points") {
+			REQUIRE(source.Length() == 3);
+			REQUIRE(source.Cues() == Audio::CuePoints{Ms(2), Ms(5)});
+		}
+
+		WHEN ("it is decoded") {
+			std::vector<std::int16_t> out(7);
+			const auto [state, bytes] = source.Decode(
+			        gsl::span<std::byte>{reinterpret_cast<std::byte *>(out.data()), out.size() * 2});
+
+			THEN ("only the trimmed samples come out, and then it runs out") {
+				REQUIRE(state == Audio::Source::DecodeState::END_OF_FILE);
+				REQUIRE(bytes == 6);
+				REQUIRE(out[0] == 3);
+				REQUIRE(out[2] == 5);
+			}
+		}
+
+		WHEN ("it is sought past its first sample") {
+			const auto pos = source.Seek(1);
+			std::vector<std::int16_t> out(7);
+			const auto [state, bytes] = source.Decode(
+			        gsl::span<std::byte>{reinterpret_cast<std::byte *>(out.data()), out.size() * 2});
+
+			THEN ("positions count from the in point") {
+				REQUIRE(pos == 1);
+				REQUIRE(bytes == 4);
+				REQUIRE(out[0] == 4);
+			}
+		}
+	}
+}
+
+SCENARIO ("CueCaches remember cue points of unchanged files", "[silence]") {
+	GIVEN ("a fresh cache and a file") {
+		const auto dir = std::filesystem::temp_directory_path();
+		const auto cache_path = (dir / "playd-test-cues").string();
+		const auto file_path = (dir / "playd-test-cues-file.mp3").string();
+		std::filesystem::remove(cache_path);
+		std::ofstream{file_path} << "not really an mp3";
+
+		const Audio::CuePoints cues{Ms(1500), Ms(180250)};
+
+		WHEN ("nothing has been stored") {
+			const Audio::CueCache cache{cache_path};
+
+			THEN ("nothing is found") {
+				REQUIRE_FALSE(cache.Find(file_path, -60.0));
+			}
+		}
+
+		WHEN ("the cue points are stored and the cache reopened") {
+			{
+				Audio::CueCache cache{cache_path};
+				cache.Store(file_path, -60.0, cues);
+			}
+			const Audio::CueCache cache{cache_path};
+
+			THEN ("they are found, but only at the same threshold") {
+				REQUIRE(cache.Find(file_path, -60.0) == cues);
+				REQUIRE_FALSE(cache.Find(file_path, -50.0));
+			}
+
+			AND_WHEN ("the file changes") {
+				std::ofstream{file_path} << "a different, longer file";
+
+				THEN ("they are no longer found") {
+					REQUIRE_FALSE(cache.Find(file_path, -60.0));
+				}
+			}
+		}
+
+		WHEN ("the cache is cut off mid-record and reopened") {
+			{
+				Audio::CueCache cache{cache_path};
+				cache.Store(file_path, -60.0, cues);
+				cache.Store(file_path, -50.0, cues);
+			}
+			const auto size = std::filesystem::file_size(cache_path);
+			std::filesystem::resize_file(cache_path, size - 3);
+			const Audio::CueCache cache{cache_path};
+
+			THEN ("the records before the damage survive") {
+				REQUIRE(cache.Find(file_path, -60.0) == cues);
+				REQUIRE_FALSE(cache.Find(file_path, -50.0));
+			}
+		}
+
+		std::filesystem::remove(cache_path);
+		std::filesystem::remove(file_path);
+	}
+}
+
+} // namespace Playd::Tests
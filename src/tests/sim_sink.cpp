@@ -0,0 +1,345 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the SimClock and SimSink classes, and soak tests of the Player
+ * playing through them.
+ */
+
+#include "../audio/sinks/sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../clock.h"
+#include "../player.h"
+#include "catch.hpp"
+#include "dummy_response_sink.h"
+
+namespace Playd::Tests
+{
+/// The rate of the simulated files, in Hz.
+static constexpr std::uint32_t SIM_RATE = 8000;
+
+/// A mono SINT16 source of silence, which costs next to nothing to decode.
+class SilentSource : public Audio::Source
+{
+public:
+	/**
+	 * Constructs a SilentSource.
+	 * @param path The path of the file it stands for.
+	 * @param length How long it is, in samples.
+	 */
+	SilentSource(std::string_view path, std::uint64_t length) : Audio::Source{path}, length{length}, position{0}
+	{
+	}
+
+	using Audio::Source::Decode;
+
+	DecodeSpanResult Decode(gsl::span<std::byte> out) override
+	{
+		if (this->position == this->length) return std::make_pair(DecodeState::END_OF_FILE, 0);
+
+		const auto count = std::min<std::uint64_t>(out.size() / 2, this->length - this->position);
+		std::memset(out.data(), 0, count * 2);
+		this->position += count;
+		return std::make_pair(DecodeState::DECODING, count * 2);
+	}
+
+	std::uint8_t ChannelCount() const override
+	{
+		return 1;
+	}
+
+	std::uint32_t SampleRate() const override
+	{
+		return SIM_RATE;
+	}
+
+	Audio::SampleFormat OutputSampleFormat() const override
+	{
+		return Audio::SampleFormat::SINT16;
+	}
+
+	std::uint64_t Seek(std::uint64_t new_position) override
+	{
+		this->position = std::min(new_position, this->length);
+		return this->position;
+	}
+
+	std::uint64_t Length() const override
+	{
+		return this->length;
+	}
+
+private:
+	std::uint64_t length;   ///< How long the source is, in samples.
+	std::uint64_t position; ///< Where the source is, in samples.
+};
+
+/**
+ * Counts the lines in some output that start with a given response.
+ * @param out The output.
+ * @param start What the lines start with.
+ * @return The number of lines.
+ */
+static std::size_t CountLines(const std::string &out, const std::string &start)
+{
+	std::istringstream in{out};
+	std::size_t count = 0;
+	for (std::string line; std::getline(in, line);) count += line.rfind(start, 0) == 0;
+	return count;
+}
+
+SCENARIO ("SimClocks only move when told to", "[sim]") {
+	GIVEN ("a sim clock") {
+		SimClock clock;
+		const auto start = clock.Now();
+
+		WHEN ("it is moved on") {
+			clock.Advance(std::chrono::hours{2});
+
+			THEN ("it tells the new time, and no later") {
+				REQUIRE(clock.Now() - start == std::chrono::hours{2});
+				REQUIRE(clock.Now() - start == std::chrono::hours{2});
+			}
+		}
+	}
+}
+
+SCENARIO ("SimSinks play their buffers as a device would, by their clock", "[sim]") {
+	GIVEN ("a sim sink holding half a second, fed from a long file") {
+		SimClock clock;
+		SilentSource source{"long.sim", SIM_RATE * 10};
+		Audio::SimSink sink{source, clock, SIM_RATE / 2};
+		std::vector<std::byte> samples(SIM_RATE * 2);
+
+		REQUIRE(sink.Transfer(samples) == samples.size() / 2);
+		REQUIRE_FALSE(sink.WantsMore());
+
+		WHEN ("the clock moves on while the sink is stopped") {
+			clock.Advance(std::chrono::seconds{1});
+
+			THEN ("nothing plays") {
+				REQUIRE(sink.Position() == 0);
+				REQUIRE(sink.Buffered() == SIM_RATE / 2);
+			}
+		}
+
+		WHEN ("it plays for a quarter of a second") {
+			sink.Start();
+			clock.Advance(std::chrono::milliseconds{250});
+
+			THEN ("exactly a quarter of a second plays") {
+				REQUIRE(sink.Position() == SIM_RATE / 4);
+				REQUIRE(sink.Buffered() == SIM_RATE / 4);
+				REQUIRE(sink.Fed().lowest == SIM_RATE / 4);
+				REQUIRE(sink.Fed().underruns == 0);
+			}
+		}
+
+		WHEN ("it plays for longer than it has buffered") {
+			sink.Start();
+			clock.Advance(std::chrono::seconds{1});
+
+			THEN ("it plays what it has, and counts the underrun") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::PLAYING);
+				REQUIRE(sink.Position() == SIM_RATE / 2);
+				REQUIRE(sink.Fed().underruns == 1);
+				REQUIRE(sink.Fed().starved == SIM_RATE / 2);
+			}
+		}
+
+		WHEN ("the source runs out, and the buffer plays out") {
+			sink.SourceOut();
+			sink.Start();
+			clock.Advance(std::chrono::seconds{1});
+
+			THEN ("it ends, without counting an underrun") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::AT_END);
+				REQUIRE(sink.Fed().underruns == 0);
+			}
+		}
+
+		WHEN ("it is scheduled to start in 100ms, and stop 50ms after that") {
+			const auto start = clock.Now() + std::chrono::milliseconds{100};
+			sink.StartAt(start);
+			sink.StopAt(start + std::chrono::milliseconds{50});
+			clock.Advance(std::chrono::milliseconds{60});
+
+			THEN ("it plays silence until then") {
+				REQUIRE(sink.CurrentState() == Audio::Sink::State::PLAYING);
+				REQUIRE(sink.Position() == 0);
+			}
+
+			AND_WHEN ("the clock passes both") {
+				clock.Advance(std::chrono::milliseconds{200});
+
+				THEN ("it played exactly the 50ms in between") {
+					REQUIRE(sink.CurrentState() == Audio::Sink::State::STOPPED);
+					REQUIRE(sink.Position() == SIM_RATE / 20);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO ("Players play through sim sinks for hours, deterministically", "[sim][player]") {
+	GIVEN ("a player on a sim clock, with sim sinks holding half a second") {
+		SimClock clock;
+		Audio::SimSink *sink = nullptr;
+		const std::vector<Player::Decoder> decoders{
+		        {"sim", {"sim"}, nullptr, [](std::string_view path) -> std::unique_ptr<Audio::Source> {
+			         return std::make_unique<SilentSource>(path, std::uint64_t{SIM_RATE} * 3600);
+		         }}};
+		Player p{0,
+		         [&clock, &sink](const Audio::Source &source, int) -> std::unique_ptr<Audio::Sink> {
+			         auto made = std::make_unique<Audio::SimSink>(source, clock, SIM_RATE / 2);
+			         sink = made.get();
+			         return made;
+		         },
+		         decoders};
+		p.UseClock(clock);
+
+		std::ostringstream os;
+		DummyResponseSink drs{os};
+		p.SetIo(drs);
+		p.AddClient(static_cast<ClientId>(1));
+
+		// As in playd's main loop, the sink gets an update between loading
+		// and playing, which fills it up.
+		p.Load("tag", "an-hour.sim");
+		p.Update();
+		p.SetPlaying("tag", true);
+		REQUIRE(sink != nullptr);
+		os.str("");
+
+		WHEN ("it plays an hour-long file, updating every 10ms") {
+			for (auto t = std::chrono::milliseconds{0}; t <= std::chrono::seconds{3601}; t += std::chrono::milliseconds{10}) {
+				clock.Advance(std::chrono::milliseconds{10});
+				p.Update();
+			}
+			const auto fed = sink->Fed();
+
+			THEN ("it plays all of it, without underrunning, and ends") {
+				REQUIRE(fed.played == std::uint64_t{SIM_RATE} * 3600);
+				REQUIRE(fed.underruns == 0);
+				REQUIRE(CountLines(os.str(), "! END") == 1);
+			}
+			THEN ("the client is told the position once a second") {
+				const auto pos = CountLines(os.str(), "! POS");
+				REQUIRE(3600 <= pos);
+				REQUIRE(pos <= 3602);
+			}
+			THEN ("each update tops the sink up, so it never drops below one update's worth from full") {
+				REQUIRE(360000 <= fed.refills);
+				REQUIRE(fed.lowest == SIM_RATE / 2 - SIM_RATE / 100);
+			}
+		}
+
+		WHEN ("it plays for a minute, updating only every second") {
+			for (int i = 0; i < 60; i++) {
+				clock.Advance(std::chrono::seconds{1});
+				p.Update();
+			}
+			const auto fed = sink->Fed();
+
+			THEN ("the sink underruns on every update, for at least half of each second") {
+				REQUIRE(fed.underruns == 60);
+				REQUIRE(60 * (SIM_RATE - SIM_RATE / 2) <= fed.starved);
+			}
+		}
+	}
+}
+
+SCENARIO ("Players with a pre-roll wait for their sinks to fill before playing", "[sim][player]") {
+	GIVEN ("a player on a sim clock, with sim sinks holding half a second, and a quarter-second pre-roll") {
+		SimClock clock;
+		Audio::SimSink *sink = nullptr;
+		const std::vector<Player::Decoder> decoders{
+		        {"sim", {"sim"}, nullptr, [](std::string_view path) -> std::unique_ptr<Audio::Source> {
+			         return std::make_unique<SilentSource>(path, std::uint64_t{SIM_RATE} * 60);
+		         }}};
+		Player p{0,
+		         [&clock, &sink](const Audio::Source &source, int) -> std::unique_ptr<Audio::Sink> {
+			         auto made = std::make_unique<Audio::SimSink>(source, clock, SIM_RATE / 2);
+			         sink = made.get();
+			         return made;
+		         },
+		         decoders};
+		p.UseClock(clock);
+		p.EnablePreRoll(std::chrono::milliseconds{250});
+
+		std::ostringstream os;
+		DummyResponseSink drs{os};
+		p.SetIo(drs);
+
+		// Unlike the soak test, nothing fills the sink before playing.
+		p.Load("tag", "a-minute.sim");
+		REQUIRE(sink != nullptr);
+		os.str("");
+
+		WHEN ("the file is played straight after loading") {
+			REQUIRE(p.SetPlaying("tag", true).Pack() == "tag ACK OK success");
+
+			THEN ("the sink doesn't start yet, and nobody is told it has") {
+				REQUIRE(sink->CurrentState() == Audio::Sink::State::STOPPED);
+				REQUIRE(CountLines(os.str(), "! PLAY") == 0);
+			}
+			THEN ("the player still wants polling, to get it started") {
+				REQUIRE(p.IsPlaying());
+			}
+
+			AND_WHEN ("the player updates, and plays on for ten seconds") {
+				REQUIRE(p.Update());
+
+				THEN ("the first update fills the sink and starts it, announcing PLAY once") {
+					REQUIRE(sink->CurrentState() == Audio::Sink::State::PLAYING);
+					REQUIRE(CountLines(os.str(), "! PLAY") == 1);
+				}
+
+				for (int i = 0; i < 1000; i++) {
+					clock.Advance(std::chrono::milliseconds{10});
+					p.Update();
+				}
+
+				THEN ("it never underruns") {
+					REQUIRE(sink->Fed().underruns == 0);
+					REQUIRE(CountLines(os.str(), "! PLAY") == 1);
+				}
+			}
+
+			AND_WHEN ("it is stopped again before the player updates") {
+				REQUIRE(p.SetPlaying("tag", false).Pack() == "tag ACK OK success");
+				REQUIRE(p.Update());
+
+				THEN ("it never starts, and nobody is told anything") {
+					REQUIRE(sink->CurrentState() == Audio::Sink::State::STOPPED);
+					REQUIRE_FALSE(p.IsPlaying());
+					REQUIRE(os.str().empty());
+				}
+			}
+		}
+
+		WHEN ("the sink is filled before the file is played") {
+			REQUIRE(p.Update());
+			os.str("");
+			REQUIRE(p.SetPlaying("tag", true).Pack() == "tag ACK OK success");
+
+			THEN ("it starts, and is announced, straight away") {
+				REQUIRE(sink->CurrentState() == Audio::Sink::State::PLAYING);
+				REQUIRE(CountLines(os.str(), "! PLAY") == 1);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -0,0 +1,78 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the SlotTable class template.
+ */
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "../slot_table.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("SlotTable finds objects by ID until they are removed", "[slot-table]") {
+	GIVEN ("a table with three objects") {
+		SlotTable<int> table;
+		std::vector<ClientId> ids;
+		for (int i = 0; i < 3; i++) {
+			const auto id = table.NextId();
+			table.Add(id, std::make_unique<int>(i));
+			ids.push_back(id);
+		}
+
+		THEN ("the IDs start at 1 and are all different") {
+			REQUIRE(ids[0] == static_cast<ClientId>(1));
+			REQUIRE(std::set<ClientId>(ids.begin(), ids.end()).size() == 3);
+			REQUIRE(table.Size() == 3);
+		}
+
+		THEN ("each ID finds its object, and BROADCAST finds nothing") {
+			for (int i = 0; i < 3; i++) REQUIRE(*table.Find(ids[i]) == i);
+			REQUIRE(table.Find(BROADCAST) == nullptr);
+		}
+
+		WHEN ("the first object is removed") {
+			const auto removed = table.Remove(ids[0]);
+
+			THEN ("the object comes back, and its ID finds nothing") {
+				REQUIRE(removed != nullptr);
+				REQUIRE(*removed == 0);
+				REQUIRE(table.Find(ids[0]) == nullptr);
+				REQUIRE(table.Size() == 2);
+			}
+
+			AND_THEN ("the others are still found, and iterated over") {
+				REQUIRE(*table.Find(ids[1]) == 1);
+				REQUIRE(*table.Find(ids[2]) == 2);
+
+				int sum = 0;
+				for (const auto &[id, obj] : table) sum += *obj;
+				REQUIRE(sum == 3);
+			}
+
+			AND_THEN ("removing it again does nothing") {
+				REQUIRE(table.Remove(ids[0]) == nullptr);
+				REQUIRE(table.Size() == 2);
+			}
+
+			AND_WHEN ("another object takes its slot") {
+				const auto id = table.NextId();
+				table.Add(id, std::make_unique<int>(3));
+
+				THEN ("it gets a new ID, and the old one still finds nothing") {
+					REQUIRE(id != ids[0]);
+					REQUIRE(*table.Find(id) == 3);
+					REQUIRE(table.Find(ids[0]) == nullptr);
+					REQUIRE(table.Size() == 3);
+				}
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
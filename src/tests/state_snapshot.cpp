@@ -0,0 +1,132 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the StateSnapshot class.
+ */
+
+#include "../state_snapshot.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "../errors.h"
+#include "../response.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("StateSnapshots publish states for one owner at a time", "[state-snapshot]") {
+	const auto path = (std::filesystem::temp_directory_path() / "playd-test-state-snapshot").string();
+	std::remove(path.c_str());
+
+	GIVEN ("an owned snapshot, and another on the same file") {
+		StateSnapshot owner{path};
+		StateSnapshot standby{path};
+		REQUIRE(owner.TryOwn());
+
+		THEN ("only the first owns it") {
+			REQUIRE(owner.Owned());
+			REQUIRE_FALSE(standby.TryOwn());
+			REQUIRE_FALSE(standby.Owned());
+			REQUIRE(std::filesystem::file_size(path) == sizeof(StateSnapshot::Layout));
+		}
+
+		THEN ("there is nothing to read until the owner publishes") {
+			REQUIRE_FALSE(standby.Read().has_value());
+		}
+
+		WHEN ("a state is published") {
+			const auto before = std::chrono::steady_clock::now().time_since_epoch();
+			owner.Publish({Response::Code::STOP,
+			               std::chrono::microseconds{1500},
+			               "/music/a b.mp3",
+			               "/music/c.flac",
+			               {{"/music/d.ogg", std::chrono::milliseconds{0}},
+			                {"/music/e.mp3", std::chrono::milliseconds{2500}}},
+			               {}});
+
+			THEN ("the other reads it back, stamped with the time") {
+				const auto state = standby.Read();
+				REQUIRE(state.has_value());
+				REQUIRE(state->state == Response::Code::STOP);
+				REQUIRE(state->position == std::chrono::microseconds{1500});
+				REQUIRE(state->file == "/music/a b.mp3");
+				REQUIRE(state->cued == "/music/c.flac");
+				REQUIRE(state->queue.size() == 2);
+				REQUIRE(state->queue[1].path == "/music/e.mp3");
+				REQUIRE(state->queue[1].overlap == std::chrono::milliseconds{2500});
+				REQUIRE(before <= state->clock);
+			}
+
+			THEN ("a stopped state stays where it was") {
+				REQUIRE(StateSnapshot::PositionNow(*standby.Read()) == std::chrono::microseconds{1500});
+			}
+
+			AND_WHEN ("an eject is published") {
+				owner.Publish({Response::Code::EJECT, std::chrono::microseconds{0}, "", "", {}, {}});
+
+				THEN ("reading gives back only the eject") {
+					const auto state = standby.Read();
+					REQUIRE(state.has_value());
+					REQUIRE(state->state == Response::Code::EJECT);
+					REQUIRE(state->file.empty());
+					REQUIRE(state->cued.empty());
+					REQUIRE(state->queue.empty());
+				}
+			}
+		}
+
+		WHEN ("a playing state is published") {
+			owner.Publish({Response::Code::PLAY, std::chrono::microseconds{1500}, "/music/a.mp3", "", {}, {}});
+
+			THEN ("its position moves on with the clock") {
+				REQUIRE(std::chrono::microseconds{1500} <= StateSnapshot::PositionNow(*standby.Read()));
+			}
+		}
+
+		WHEN ("a queue too long for the file is published") {
+			const std::string long_path(10000, 'x');
+			StateSnapshot::State state{Response::Code::STOP, std::chrono::microseconds{0}, "/music/a.mp3", "", {}, {}};
+			for (int i = 0; i < 100; i++) state.queue.push_back({long_path, std::chrono::milliseconds{0}});
+			owner.Publish(state);
+
+			THEN ("as much of the queue as fits is read back") {
+				const auto read = standby.Read();
+				REQUIRE(read.has_value());
+				REQUIRE(read->file == "/music/a.mp3");
+				REQUIRE(!read->queue.empty());
+				REQUIRE(read->queue.size() < 100);
+				REQUIRE(read->queue.back().path == long_path);
+			}
+		}
+	}
+
+	GIVEN ("an owner that publishes and then goes away cleanly") {
+		StateSnapshot standby{path};
+		{
+			StateSnapshot owner{path};
+			REQUIRE(owner.TryOwn());
+			owner.Publish({Response::Code::PLAY, std::chrono::microseconds{0}, "/music/a.mp3", "", {}, {}});
+			REQUIRE(standby.Read().has_value());
+		}
+
+		THEN ("its snapshot is withdrawn, but the file can be owned again") {
+			REQUIRE_FALSE(standby.Read().has_value());
+			REQUIRE(standby.TryOwn());
+		}
+	}
+
+	GIVEN ("a path that can't be created") {
+		THEN ("making a snapshot there fails") {
+			REQUIRE_THROWS_AS(StateSnapshot{"/nonexistent/playd-test-state-snapshot"}, FileError);
+		}
+	}
+
+	std::remove(path.c_str());
+}
+
+} // namespace Playd::Tests
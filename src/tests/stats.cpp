@@ -0,0 +1,96 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Histogram and CallbackStats classes.
+ */
+
+#include "../audio/stats.h"
+
+#include <chrono>
+#include <cstdint>
+
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("Histograms summarise the values recorded into them", "[stats]") {
+	GIVEN ("an empty histogram") {
+		Audio::Histogram h;
+
+		THEN ("its summary is all zeroes") {
+			const auto s = h.Summarise();
+			REQUIRE(s.count == 0);
+			REQUIRE(s.p50 == 0);
+			REQUIRE(s.p99 == 0);
+			REQUIRE(s.max == 0);
+		}
+
+		WHEN ("a hundred small values and one large value are recorded") {
+			for (int i = 0; i < 100; i++) h.Record(5);
+			h.Record(1000);
+
+			THEN ("the median is bounded by the small values' bucket") {
+				const auto s = h.Summarise();
+				REQUIRE(s.count == 101);
+				REQUIRE(5 <= s.p50);
+				REQUIRE(s.p50 < 8);
+			}
+
+			THEN ("the maximum is exact") {
+				REQUIRE(h.Summarise().max == 1000);
+			}
+
+			THEN ("the sum and bucket counts are exact") {
+				const auto s = h.Summarise();
+				REQUIRE(s.sum == 1500);
+				REQUIRE(s.buckets[3] == 100);
+				REQUIRE(s.buckets[10] == 1);
+				REQUIRE(Audio::Histogram::UpperBound(3) == 7);
+				REQUIRE(Audio::Histogram::UpperBound(10) == 1023);
+			}
+		}
+
+		WHEN ("only one value is recorded") {
+			h.Record(100);
+
+			THEN ("the percentiles don't overshoot it") {
+				const auto s = h.Summarise();
+				REQUIRE(s.p50 == 100);
+				REQUIRE(s.p99 == 100);
+			}
+		}
+	}
+}
+
+SCENARIO ("CallbackStats counts callbacks, underruns and jitter", "[stats]") {
+	GIVEN ("a fresh CallbackStats") {
+		Audio::CallbackStats stats;
+		using namespace std::chrono_literals;
+		const auto t0 = Audio::CallbackStats::Clock::now();
+
+		WHEN ("three callbacks are recorded, the last late and underrunning") {
+			stats.RecordCallback(t0, t0 + 100us, 10ms, 0, false);
+			stats.RecordCallback(t0 + 10ms, t0 + 10ms + 100us, 10ms, 0, false);
+			stats.RecordCallback(t0 + 22ms, t0 + 22ms + 100us, 10ms, 64, true);
+
+			THEN ("the counters add up") {
+				const auto s = stats.Read();
+				REQUIRE(s.callbacks == 3);
+				REQUIRE(s.underruns == 1);
+				REQUIRE(s.silent_bytes == 64);
+				REQUIRE(s.exec.max == 100);
+			}
+
+			THEN ("the jitter reflects the late callback only") {
+				const auto s = stats.Read();
+				REQUIRE(s.jitter.count == 2);
+				REQUIRE(s.jitter.max == 2000);
+				REQUIRE(s.jitter.p50 == 0);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
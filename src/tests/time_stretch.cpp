@@ -0,0 +1,208 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the TimeStretch and StretchedSource classes.
+ */
+
+#include "../audio/time_stretch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sample_format.h"
+#include "../audio/sources/ram.h"
+#include "../errors.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+/// The rate of the test signals, in Hz.
+static constexpr std::uint32_t RATE = 8000;
+
+/**
+ * Makes a mono sine wave.
+ * @param frames How long the wave is, in samples.
+ * @param hz The wave's frequency.
+ * @return The samples.
+ */
+static std::vector<float> Sine(std::size_t frames, double hz)
+{
+	std::vector<float> samples(frames);
+	for (std::size_t i = 0; i < frames; i++) {
+		samples[i] = static_cast<float>(0.5 * std::sin(2.0 * std::numbers::pi * hz * static_cast<double>(i) / RATE));
+	}
+	return samples;
+}
+
+/**
+ * Pushes all of some samples through a stretcher, and pulls out the result.
+ * @param stretch The stretcher.
+ * @param in The samples.
+ * @return Everything the stretcher gave back.
+ */
+static std::vector<float> StretchAll(Audio::TimeStretch &stretch, const std::vector<float> &in)
+{
+	stretch.Push(in);
+	stretch.Drain();
+
+	std::vector<float> out;
+	std::vector<float> chunk(333);
+	while (!stretch.Done()) {
+		const auto got = stretch.Pull(chunk);
+		out.insert(out.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(got));
+	}
+	return out;
+}
+
+/**
+ * Counts the upward zero crossings in some samples.
+ * @param samples The samples.
+ * @return How many times they go from negative to non-negative.
+ */
+static std::size_t Crossings(const std::vector<float> &samples)
+{
+	std::size_t count = 0;
+	for (std::size_t i = 1; i < samples.size(); i++) count += samples[i - 1] < 0.0F && 0.0F <= samples[i];
+	return count;
+}
+
+/**
+ * Makes a source over a mono clip.
+ * @param format The clip's sample format.
+ * @param samples The clip, as floats (which are only copied as is for FLOAT32).
+ * @return The source.
+ */
+static std::unique_ptr<Audio::Source> Clip(Audio::SampleFormat format, const std::vector<float> &samples)
+{
+	auto clip = std::make_shared<Audio::PcmClip>();
+	clip->path = "sine.wav";
+	clip->rate = RATE;
+	clip->channels = 1;
+	clip->format = format;
+	clip->samples.resize(samples.size() * Audio::sample_format_bps[static_cast<int>(format)]);
+	if (format == Audio::SampleFormat::FLOAT32) std::memcpy(clip->samples.data(), samples.data(), clip->samples.size());
+	return std::make_unique<Audio::RamSource>(std::move(clip));
+}
+
+SCENARIO ("TimeStretches change the speed of audio, but not its pitch", "[time-stretch]") {
+	GIVEN ("a second of a 400Hz sine wave, and a stretcher") {
+		const auto in = Sine(RATE, 400.0);
+		Audio::TimeStretch stretch{1, RATE};
+
+		WHEN ("it is stretched at normal speed") {
+			const auto out = StretchAll(stretch, in);
+
+			THEN ("it comes back as it went in") {
+				REQUIRE(out.size() == in.size());
+				float worst = 0.0F;
+				for (std::size_t i = 0; i < in.size(); i++) worst = std::max(worst, std::fabs(out[i] - in[i]));
+				REQUIRE(worst < 1e-6F);
+				REQUIRE(stretch.InputAt(1234) == 1234);
+			}
+		}
+
+		WHEN ("it is stretched at double speed") {
+			stretch.SetSpeed(2.0);
+			const auto out = StretchAll(stretch, in);
+
+			THEN ("it takes half as long, at the same pitch") {
+				REQUIRE(out.size() == Approx(RATE / 2).margin(RATE / 50));
+				const auto hz = static_cast<double>(Crossings(out)) * RATE / static_cast<double>(out.size());
+				REQUIRE(hz == Approx(400.0).epsilon(0.03));
+			}
+			THEN ("output samples map back to twice as far into the input") {
+				REQUIRE(stretch.InputAt(1000) == 2000);
+			}
+		}
+
+		WHEN ("it is stretched at half speed") {
+			stretch.SetSpeed(0.5);
+			const auto out = StretchAll(stretch, in);
+
+			THEN ("it takes twice as long, at the same pitch") {
+				REQUIRE(out.size() == Approx(RATE * 2).margin(RATE / 50));
+				const auto hz = static_cast<double>(Crossings(out)) * RATE / static_cast<double>(out.size());
+				REQUIRE(hz == Approx(400.0).epsilon(0.03));
+			}
+		}
+
+		WHEN ("the speed changes part-way through") {
+			stretch.Push(in);
+			std::vector<float> chunk(800);
+			REQUIRE(stretch.Pull(chunk) == 800);
+			stretch.SetSpeed(2.0);
+			REQUIRE(stretch.Pull(chunk) == 800);
+
+			THEN ("positions follow each speed in turn") {
+				REQUIRE(stretch.InputAt(400) == 400);
+				REQUIRE(stretch.InputAt(1600) == Approx(2400).margin(20));
+			}
+		}
+	}
+}
+
+SCENARIO ("StretchedSources play sources faster or slower", "[time-stretch]") {
+	GIVEN ("a stretched source over a one-second clip") {
+		Audio::StretchedSource source{Clip(Audio::SampleFormat::FLOAT32, Sine(RATE, 400.0))};
+		std::vector<std::byte> out(512 * sizeof(float));
+
+		THEN ("it passes the clip straight through") {
+			REQUIRE_FALSE(source.Stretching());
+			REQUIRE(source.Speed() == 1.0);
+			REQUIRE(source.Length() == RATE);
+			REQUIRE(source.InnerPosition(1234) == 1234);
+		}
+
+		WHEN ("it plays at double speed from a quarter of the way in") {
+			REQUIRE(source.Decode(gsl::span<std::byte>{out}).second == out.size());
+			source.SetSpeed(2.0);
+
+			std::size_t bytes = 0;
+			for (auto state = Audio::Source::DecodeState::DECODING; state != Audio::Source::DecodeState::END_OF_FILE;) {
+				const auto [s, count] = source.Decode(gsl::span<std::byte>{out});
+				state = s;
+				bytes += count;
+			}
+
+			THEN ("the rest of it takes half as long") {
+				REQUIRE(source.Stretching());
+				REQUIRE(bytes / sizeof(float) == Approx((RATE - 512) / 2).margin(RATE / 50));
+			}
+			THEN ("its positions map back into the clip") {
+				REQUIRE(source.InnerPosition(400) == 400);
+				REQUIRE(source.InnerPosition(512 + 1000) == Approx(512 + 2000).margin(20));
+				REQUIRE(source.InnerPosition(RATE) == RATE);
+			}
+
+			AND_WHEN ("it seeks back to normal speed") {
+				source.SetSpeed(1.0);
+				REQUIRE(source.Seek(100) == 100);
+
+				THEN ("it passes the clip straight through again") {
+					REQUIRE_FALSE(source.Stretching());
+					REQUIRE(source.InnerPosition(200) == 200);
+				}
+			}
+		}
+	}
+
+	GIVEN ("a stretched source over a clip whose format can't be stretched") {
+		Audio::StretchedSource source{Clip(Audio::SampleFormat::UINT8, Sine(RATE, 400.0))};
+
+		THEN ("changing its speed fails, but staying at normal speed doesn't") {
+			REQUIRE_FALSE(Audio::StretchedSource::CanStretch(source));
+			REQUIRE_THROWS_AS(source.SetSpeed(1.5), FileError);
+			REQUIRE_NOTHROW(source.SetSpeed(1.0));
+		}
+	}
+}
+
+} // namespace Playd::Tests
@@ -8,6 +8,10 @@
 
 #include "../tokeniser.h"
 
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "catch.hpp"
 
 namespace Playd::Tests
@@ -384,4 +388,121 @@ SCENARIO ("Tokeniser is compliant with the BAPS3 spec", "[tokeniser][spec]") {
 	}
 }
 
+SCENARIO ("Tokenisers can stream lines without copying them", "[tokeniser]") {
+	GIVEN ("A fresh Tokeniser") {
+		Tokeniser t;
+
+		WHEN ("the Tokeniser is fed a plain line in one chunk") {
+			const std::string raw{"tag  fload   /tmp/x.mp3\n"};
+			std::vector<std::string_view> words;
+			REQUIRE(t.Feed(raw, [&words](Tokeniser::Line line) { words.assign(line.begin(), line.end()); }));
+
+			THEN ("the words are views into the chunk") {
+				REQUIRE(words == std::vector<std::string_view>{"tag", "fload", "/tmp/x.mp3"});
+				REQUIRE(words[2].data() == raw.data() + 13);
+			}
+		}
+
+		WHEN ("the Tokeniser is fed a line split across two chunks") {
+			std::vector<std::vector<std::string>> lines;
+			const auto collect = [&lines](Tokeniser::Line line) { lines.emplace_back(line.begin(), line.end()); };
+			REQUIRE(t.Feed("tag po", collect));
+			const auto before = lines.size();
+			REQUIRE(t.Feed("s 10\ntag stop\n", collect));
+
+			THEN ("nothing is emitted until the line is complete") {
+				REQUIRE(before == 0);
+			}
+
+			THEN ("both lines come out whole, in order") {
+				REQUIRE(lines == std::vector<std::vector<std::string>>{{"tag", "pos", "10"}, {"tag", "stop"}});
+			}
+		}
+
+		WHEN ("plain and quoted lines are mixed in one chunk") {
+			auto lines = t.Feed("a b\nc 'd e'\nf\n");
+
+			THEN ("each line is tokenised correctly") {
+				REQUIRE(lines == std::vector<std::vector<std::string>>{{"a", "b"}, {"c", "d e"}, {"f"}});
+			}
+		}
+
+		WHEN ("a quoted newline is followed by a plain line") {
+			auto lines = t.Feed("a 'b\nc'\nd\n");
+
+			THEN ("the quoted newline does not end the line") {
+				REQUIRE(lines == std::vector<std::vector<std::string>>{{"a", "b\nc"}, {"d"}});
+			}
+		}
+	}
+}
+
+SCENARIO ("Tokenisers reject lines over their limits", "[tokeniser]") {
+	GIVEN ("A Tokeniser accepting lines of up to 16 bytes and 3 words") {
+		Tokeniser t{{16, 3}};
+		std::vector<std::vector<std::string>> lines;
+		const auto collect = [&lines](Tokeniser::Line line) { lines.emplace_back(line.begin(), line.end()); };
+
+		WHEN ("the Tokeniser is fed lines right at the limits") {
+			const auto ok = t.Feed("tag fload /x.mp3\ntag 'a b' c\n", collect);
+
+			THEN ("they are accepted") {
+				REQUIRE(ok);
+				REQUIRE(lines == std::vector<std::vector<std::string>>{{"tag", "fload", "/x.mp3"}, {"tag", "a b", "c"}});
+			}
+		}
+
+		WHEN ("the Tokeniser is fed a plain line one byte too long") {
+			const auto ok = t.Feed("tag stop\ntag fload /xy.mp3\ntag play\n", collect);
+
+			THEN ("the lines before it come out, and it is rejected") {
+				REQUIRE_FALSE(ok);
+				REQUIRE(lines == std::vector<std::vector<std::string>>{{"tag", "stop"}});
+			}
+		}
+
+		WHEN ("the Tokeniser is fed a line with too many words") {
+			const auto plain = t.Feed("a b c d\n", collect);
+
+			THEN ("it is rejected") {
+				REQUIRE_FALSE(plain);
+				REQUIRE(lines.empty());
+			}
+		}
+
+		WHEN ("the Tokeniser is fed too many quoted words") {
+			const auto quoted = t.Feed("a b c 'd'\n", collect);
+
+			THEN ("it is rejected") {
+				REQUIRE_FALSE(quoted);
+				REQUIRE(lines.empty());
+			}
+		}
+
+		WHEN ("the Tokeniser is fed a long line a chunk at a time, without a newline") {
+			auto ok = true;
+			auto chunks = 0;
+			for (; ok && chunks < 100; chunks++) ok = t.Feed("aaaa", collect);
+
+			THEN ("it is rejected as soon as it goes over the limit") {
+				REQUIRE_FALSE(ok);
+				REQUIRE(chunks == 5);
+			}
+
+			THEN ("what was held of it is let go") {
+				REQUIRE(t.HeldBytes() == Tokeniser{}.HeldBytes());
+			}
+
+			AND_WHEN ("the Tokeniser is fed more") {
+				const auto more = t.Feed("a\nb\n", collect);
+
+				THEN ("it stays rejected") {
+					REQUIRE_FALSE(more);
+					REQUIRE(lines.empty());
+				}
+			}
+		}
+	}
+}
+
 } // namespace Playd::Tests
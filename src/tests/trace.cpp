@@ -0,0 +1,118 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for the Trace class.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../trace.h"
+#include "catch.hpp"
+
+namespace Playd::Tests
+{
+SCENARIO ("Trace records events only while it is on", "[trace]") {
+	GIVEN ("tracing that has started and stopped") {
+		Trace::Start("");
+		Trace::Record(TraceKind::DECODE_BEGIN);
+		Trace::Record(TraceKind::DECODE_END, 4096);
+		Trace::Stop();
+		Trace::Record(TraceKind::COMMAND, 1);
+
+		WHEN ("the events are collected") {
+			const auto events = Trace::Collect();
+
+			THEN ("only the events while it was on are there, in order") {
+				REQUIRE(events.size() == 2);
+				REQUIRE(events[0].kind == TraceKind::DECODE_BEGIN);
+				REQUIRE(events[1].kind == TraceKind::DECODE_END);
+				REQUIRE(events[1].arg == 4096);
+				REQUIRE(events[0].time <= events[1].time);
+				REQUIRE(events[0].thread == events[1].thread);
+			}
+		}
+
+		WHEN ("tracing starts again") {
+			Trace::Start("");
+			Trace::Stop();
+
+			THEN ("the old events are forgotten") {
+				REQUIRE(Trace::Collect().empty());
+			}
+		}
+	}
+}
+
+SCENARIO ("Trace keeps each thread's most recent events", "[trace]") {
+	GIVEN ("more events than a ring holds, on two threads") {
+		Trace::Start("");
+		for (std::size_t i = 0; i < Trace::CAPACITY + 10; i++) Trace::Record(TraceKind::TRANSFER, i);
+		std::thread{[] { Trace::Record(TraceKind::CALLBACK_BEGIN, 64); }}.join();
+		Trace::Stop();
+
+		WHEN ("the events are collected") {
+			const auto events = Trace::Collect();
+
+			// A full ring's oldest slot is the next to be written, so
+			// collecting never trusts it.
+			THEN ("the oldest of the first thread's are gone, and the other thread's is kept") {
+				REQUIRE(events.size() == Trace::CAPACITY);
+
+				const auto transfers = std::count_if(events.begin(), events.end(), [](const TraceEvent &e) {
+					return e.kind == TraceKind::TRANSFER;
+				});
+				REQUIRE(transfers == Trace::CAPACITY - 1);
+
+				const auto first = std::find_if(events.begin(), events.end(), [](const TraceEvent &e) {
+					return e.kind == TraceKind::TRANSFER;
+				});
+				REQUIRE(first->arg == 11);
+
+				const auto callback = std::find_if(events.begin(), events.end(), [](const TraceEvent &e) {
+					return e.kind == TraceKind::CALLBACK_BEGIN;
+				});
+				REQUIRE(callback != events.end());
+				REQUIRE(callback->thread != first->thread);
+			}
+		}
+	}
+}
+
+SCENARIO ("Trace writes the Chrome trace format", "[trace]") {
+	GIVEN ("a decode and a command") {
+		const std::vector<TraceEvent> events{{1500, 0, 1, TraceKind::DECODE_BEGIN},
+		                                     {2042, 4096, 1, TraceKind::DECODE_END},
+		                                     {3000, 2, 3, TraceKind::COMMAND}};
+
+		WHEN ("they are written") {
+			std::ostringstream out;
+			Trace::WriteChrome(out, events);
+			const auto json = out.str();
+
+			THEN ("the decode is a duration, in microseconds") {
+				REQUIRE(json.find(R"({"name":"decode","cat":"playd","ph":"B","ts":1.500,"pid":1,"tid":1})") !=
+				        std::string::npos);
+				REQUIRE(json.find(R"("ph":"E","ts":2.042,"pid":1,"tid":1,"args":{"bytes":4096}})") !=
+				        std::string::npos);
+			}
+
+			AND_THEN ("the command is an instant, with its client") {
+				REQUIRE(json.find(R"({"name":"command","cat":"playd","ph":"i","s":"t","ts":3.000,"pid":1,"tid":3,)"
+				                  R"("args":{"client":2}})") != std::string::npos);
+			}
+
+			AND_THEN ("the events are in a traceEvents list") {
+				REQUIRE(json.rfind(R"({"traceEvents":[)", 0) == 0);
+				REQUIRE(json.find("],\"displayTimeUnit\":\"ns\"}") != std::string::npos);
+			}
+		}
+	}
+}
+
+} // namespace Playd::Tests
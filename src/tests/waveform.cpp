@@ -0,0 +1,120 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Tests for waveform overviews, and the WaveformCache class.
+ */
+
+#include "../audio/waveform.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "../audio/pcm_cache.h"
+#include "../audio/sources/ram.h"
+#include "catch.hpp"
+#include "pcm_clip.h"
+
+namespace Playd::Tests
+{
+SCENARIO ("Waveform overviews hold the peaks of each bucket", "[waveform]") {
+	GIVEN ("a clip of a loud half, then a silent half") {
+		const auto clip = MakeClip("overview.wav", 44100, 1, {16384, -16384, 16384, -16384, 0, 0, 0, 0});
+		const auto open = [&clip] { return std::make_unique<Audio::RamSource>(clip); };
+
+		WHEN ("it is cut into two buckets") {
+			const auto waveform = Audio::ComputeWaveform(open, 2, 1);
+
+			THEN ("the first bucket has the peaks, and the second nothing") {
+				REQUIRE(waveform.size() == 2);
+				REQUIRE(waveform[0] == Audio::WaveformBucket{-16384, 16384, 16384});
+				REQUIRE(waveform[1] == Audio::WaveformBucket{0, 0, 0});
+			}
+
+			AND_WHEN ("it is packed") {
+				const auto packed = Audio::PackWaveform(waveform);
+
+				THEN ("each bucket is three big-endian 16-bit levels") {
+					REQUIRE(packed.size() == 2 * Audio::WAVEFORM_BUCKET_BYTES);
+					REQUIRE(packed.substr(0, 6) == std::string{"\xC0\x00\x40\x00\x40\x00", 6});
+					REQUIRE(packed.substr(6) == std::string(6, '\0'));
+				}
+			}
+		}
+
+		WHEN ("it is cut into more buckets than it has samples") {
+			const auto waveform = Audio::ComputeWaveform(open, 16, 1);
+
+			THEN ("every sample lands in one bucket, and the rest are empty") {
+				REQUIRE(waveform[0] == Audio::WaveformBucket{16384, 16384, 16384});
+				REQUIRE(waveform[1] == Audio::WaveformBucket{0, 0, 0});
+				REQUIRE(waveform[2] == Audio::WaveformBucket{-16384, -16384, 16384});
+			}
+		}
+	}
+
+	GIVEN ("a clip long enough to split between threads") {
+		std::vector<std::int16_t> samples(std::size_t{1} << 21U);
+		for (std::size_t i = 0; i < samples.size(); i++) {
+			samples[i] = static_cast<std::int16_t>(static_cast<std::int32_t>((i * 7919) % 65536) - 32768);
+		}
+		const auto clip = MakeClip("overview.wav", 44100, 1, samples);
+		const auto open = [&clip] { return std::make_unique<Audio::RamSource>(clip); };
+
+		WHEN ("it is overviewed on one thread, and on several") {
+			const auto one = Audio::ComputeWaveform(open, 1000, 1);
+			const auto several = Audio::ComputeWaveform(open, 1000, 4);
+
+			THEN ("the overviews are the same") {
+				REQUIRE(one == several);
+			}
+		}
+	}
+}
+
+SCENARIO ("WaveformCaches remember overviews of unchanged files", "[waveform]") {
+	GIVEN ("a fresh cache, a file, and an overview of it") {
+		const auto dir = std::filesystem::temp_directory_path();
+		const auto cache_path = (dir / "playd-test-waveforms").string();
+		const auto file_path = (dir / "playd-test-waveform-file.mp3").string();
+		std::filesystem::remove_all(cache_path);
+		std::ofstream{file_path} << "not really an mp3";
+
+		const Audio::Waveform waveform{{-1, 1, 1}, {-2, 2, 1}, {-3, 3, 2}};
+		const Audio::WaveformCache cache{cache_path};
+
+		WHEN ("nothing has been stored") {
+			THEN ("nothing is found") {
+				REQUIRE_FALSE(cache.Find(file_path, 3));
+			}
+		}
+
+		WHEN ("the overview is stored") {
+			cache.Store(file_path, waveform);
+
+			THEN ("it is found, at the same resolution, by another cache") {
+				const Audio::WaveformCache other{cache_path};
+				REQUIRE(other.Find(file_path, 3) == waveform);
+				REQUIRE_FALSE(other.Find(file_path, 4));
+			}
+
+			AND_WHEN ("the file changes") {
+				std::ofstream{file_path} << "a different, longer file";
+
+				THEN ("the overview is no longer found") {
+					REQUIRE_FALSE(cache.Find(file_path, 3));
+				}
+			}
+		}
+
+		std::filesystem::remove_all(cache_path);
+		std::filesystem::remove(file_path);
+	}
+}
+
+} // namespace Playd::Tests
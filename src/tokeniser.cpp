@@ -11,20 +11,111 @@
 
 #include <gsl/gsl>
 #include <locale>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 namespace Playd
 {
 
-Tokeniser::Tokeniser() : escape_next{false}, in_word{false}, quote_type{QuoteType::NONE}
+/// The characters that stop a line being split in place.
+static constexpr std::string_view SPECIAL_CHARS{"'\"\\"};
+
+/// The characters that separate words, as in the classic locale's isspace.
+static constexpr std::string_view SPACE_CHARS{" \t\n\v\f\r"};
+
+Tokeniser::Tokeniser() : Tokeniser(Limits{})
+{
+}
+
+Tokeniser::Tokeniser(Limits limits)
+    : escape_next{false},
+      in_word{false},
+      quote_type{QuoteType::NONE},
+      line_ready{false},
+      limits{limits},
+      line_bytes{0},
+      rejected{false}
 {
 }
 
-std::vector<std::vector<std::string>> Tokeniser::Feed(const std::string &raw)
+bool Tokeniser::Feed(std::string_view raw, const LineHandler &on_line)
 {
-	// The list of ready lines should be cleared by any previous Feed.
-	Expects(this->ready_lines.empty());
+	while (!raw.empty() && !this->rejected) {
+		// Fast path: a whole line, with nothing to unescape, that we can
+		// split without copying.
+		if (this->AtLineStart()) {
+			const auto nl = raw.find('\n');
+			if (nl != std::string_view::npos) {
+				const auto line = raw.substr(0, nl);
+				if (this->limits.line < this->line_bytes + line.size()) {
+					this->Reject();
+					break;
+				}
+				if (line.find_first_of(SPECIAL_CHARS) == std::string_view::npos) {
+					if (!this->SplitInPlace(line, on_line)) break;
+					raw.remove_prefix(nl + 1);
+					continue;
+				}
+			}
+		}
 
+		// Slow path: the line needs unescaping, or carries on into the
+		// next chunk, so build it up a character at a time.
+		raw.remove_prefix(this->FeedSlowly(raw, on_line));
+	}
+
+	return !this->rejected;
+}
+
+std::vector<std::vector<std::string>> Tokeniser::Feed(std::string_view raw)
+{
+	std::vector<std::vector<std::string>> lines;
+	std::ignore = this->Feed(raw, [&lines](Line line) { lines.emplace_back(line.begin(), line.end()); });
+	return lines;
+}
+
+std::size_t Tokeniser::HeldBytes() const
+{
+	auto bytes = this->current_word.capacity() + this->words.capacity() * sizeof(std::string) +
+	             this->views.capacity() * sizeof(std::string_view);
+	for (const auto &word : this->words) bytes += word.capacity();
+	return bytes;
+}
+
+bool Tokeniser::AtLineStart() const
+{
+	return this->words.empty() && !this->in_word && !this->escape_next && this->quote_type == QuoteType::NONE;
+}
+
+bool Tokeniser::SplitInPlace(std::string_view line, const LineHandler &on_line)
+{
+	this->views.clear();
+
+	for (auto start = line.find_first_not_of(SPACE_CHARS); start != std::string_view::npos;) {
+		if (this->views.size() == this->limits.words) {
+			this->Reject();
+			return false;
+		}
+
+		const auto end = line.find_first_of(SPACE_CHARS, start);
+		this->views.push_back(line.substr(start, end - start));
+		if (end == std::string_view::npos) break;
+		start = line.find_first_not_of(SPACE_CHARS, end);
+	}
+
+	on_line(this->views);
+	this->line_bytes = 0;
+	return true;
+}
+
+size_t Tokeniser::FeedSlowly(std::string_view raw, const LineHandler &on_line)
+{
+	size_t consumed = 0;
 	for (const char c : raw) {
+		consumed++;
+
 		if (this->escape_next) {
 			this->Push(c);
 			continue;
@@ -43,12 +134,41 @@ std::vector<std::vector<std::string>> Tokeniser::Feed(const std::string &raw)
 				FeedUnquotedChar(c);
 				break;
 		}
+
+		// Checking as each byte goes in is what keeps a line that never
+		// ends from taking up more than the limits.
+		if (this->limits.words < this->words.size()) {
+			this->Reject();
+			break;
+		}
+
+		if (this->line_ready) {
+			this->views.assign(this->words.begin(), this->words.end());
+			on_line(this->views);
+
+			this->words.clear();
+			this->line_ready = false;
+			this->line_bytes = 0;
+			break;
+		}
+
+		if (this->limits.line < ++this->line_bytes) {
+			this->Reject();
+			break;
+		}
 	}
 
-	auto lines = this->ready_lines;
-	this->ready_lines.clear();
+	return consumed;
+}
 
-	return lines;
+void Tokeniser::Reject()
+{
+	this->rejected = true;
+
+	// Swapping, rather than clearing, gives the memory back too.
+	std::string{}.swap(this->current_word);
+	std::vector<std::string>{}.swap(this->words);
+	std::vector<std::string_view>{}.swap(this->views);
 }
 
 void Tokeniser::FeedUnquotedChar(char c)
@@ -135,9 +255,8 @@ void Tokeniser::Emit()
 	// line as the end of the word too.
 	this->EndWord();
 
-	this->ready_lines.push_back(this->words);
-
-	this->words.clear();
+	// FeedSlowly sends the words off and clears them.
+	this->line_ready = true;
 
 	// The state should now be clean and ready for another command.
 	Ensures(this->quote_type == QuoteType::NONE);
@@ -10,6 +10,14 @@
 #ifndef PLAYD_TOKENISER_H
 #define PLAYD_TOKENISER_H
 
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#undef max
+#include <gsl/gsl>
+
 #include "response.h"
 
 namespace Playd
@@ -21,24 +29,82 @@ namespace Playd
  * A Tokeniser is fed chunks of incoming data from the IO system, and emits any
  * fully-formed command lines it encounters to the command handler.
  *
+ * Lines without quotes or escapes, and which arrive in one chunk, are split
+ * in place: their words are views into the chunk itself.  Only lines that
+ * need unescaping, or which straddle two chunks, are copied.
+ *
+ * Each Tokeniser has limits on how long a line can be, and how many words it
+ * can have.  A line going over them is rejected as soon as it does, so a
+ * client sending megabytes without a newline costs no more memory than one
+ * sending a line right at the limit.
+ *
  * @see CommandHandler
  * @see IoCore
  */
 class Tokeniser
 {
 public:
-	/// Constructs a new Tokeniser.
+	/**
+	 * A tokenised line.
+	 * The words are only valid until the LineHandler receiving them returns.
+	 */
+	using Line = gsl::span<const std::string_view>;
+
+	/// Type of functions that receive tokenised lines.
+	using LineHandler = std::function<void(Line)>;
+
+	/// The longest line, in bytes and not counting its newline, accepted by
+	/// default: the same as the largest binary frame.
+	static constexpr std::size_t DEFAULT_MAX_LINE = 64 * 1024;
+
+	/// The most words in a line accepted by default.
+	static constexpr std::size_t DEFAULT_MAX_WORDS = 1024;
+
+	/// Limits on the lines a Tokeniser accepts.
+	struct Limits {
+		std::size_t line{DEFAULT_MAX_LINE};   ///< The longest line, in raw bytes, not counting its newline.
+		std::size_t words{DEFAULT_MAX_WORDS}; ///< The most words in a line.
+	};
+
+	/// Constructs a new Tokeniser, with the default limits.
 	Tokeniser();
 
 	/**
-	 * Feeds a string into a Tokeniser.
-	 * @param raw Const reference to the raw string to feed.  The string
-	 *   need not contain complete lines.
+	 * Constructs a new Tokeniser.
+	 * @param limits The limits on the lines it accepts.
+	 */
+	explicit Tokeniser(Limits limits);
+
+	/**
+	 * Feeds a chunk of data into a Tokeniser, without copying where possible.
+	 * @param raw The raw data to feed.  This only needs to live until Feed
+	 *   returns, and need not contain complete lines.
+	 * @param on_line The function to call with each line completed by this
+	 *   chunk, in order.
+	 * @return False if a line went over the Tokeniser's limits; the lines
+	 *   before it have been sent off, but the Tokeniser can't be used after
+	 *   this.
+	 * @note Escaping a multi-byte UTF-8 character is undefined behaviour.
+	 */
+	[[nodiscard]] bool Feed(std::string_view raw, const LineHandler &on_line);
+
+	/**
+	 * Feeds a string into a Tokeniser, copying out the lines.
+	 * @param raw The raw string to feed.  The string need not contain
+	 *   complete lines.
 	 * @return The vector of lines that have been successfully tokenised in
-	 *   this tokenising pass.  This vector may be empty.
+	 *   this tokenising pass.  This vector may be empty, and stops short at
+	 *   any line going over the Tokeniser's limits.
 	 * @note Escaping a multi-byte UTF-8 character is undefined behaviour.
 	 */
-	std::vector<std::vector<std::string>> Feed(const std::string &raw);
+	std::vector<std::vector<std::string>> Feed(std::string_view raw);
+
+	/**
+	 * How much memory the Tokeniser holds on to between chunks.
+	 * This is at most a little over the line limit, however much is fed.
+	 * @return The size of its buffers, in bytes.
+	 */
+	[[nodiscard]] std::size_t HeldBytes() const;
 
 private:
 	/// Enumeration of quotation types.
@@ -48,11 +114,12 @@ private:
 		DOUBLE  ///< In double quotes ("").
 	};
 
-	/// The current vector of completed, tokenised lines.
-	/// This is cleared at the end of every Tokeniser::Feed.
-	std::vector<std::vector<std::string>> ready_lines;
+	/// Where views of the current line's words are built up.
+	/// This keeps its capacity between lines, so it rarely allocates.
+	std::vector<std::string_view> views;
 
-	/// The current vector of completed, tokenised words.
+	/// The current vector of completed, tokenised words, for lines that
+	/// can't be split in place.
 	std::vector<std::string> words;
 
 	/// The current, incomplete word to which new characters should be
@@ -69,7 +136,45 @@ private:
 	/// The type of quotation currently being used in this Tokeniser.
 	QuoteType quote_type;
 
-	/// Finishes the current word and sends the line to the CommandHandler.
+	/// Whether the character-by-character path has just finished a line.
+	bool line_ready;
+
+	/// The limits on the lines this Tokeniser accepts.
+	Limits limits;
+
+	/// How many bytes of the current line have been fed so far.
+	std::size_t line_bytes;
+
+	/// Whether a line has gone over the limits.
+	bool rejected;
+
+	/**
+	 * Checks whether the Tokeniser is between lines.
+	 * @return True if no part of a line has been fed.
+	 */
+	[[nodiscard]] bool AtLineStart() const;
+
+	/**
+	 * Splits a line with no quotes or escapes in place.
+	 * @param line The line, without its newline.
+	 * @param on_line The function to send the split line to.
+	 * @return False if the line has too many words, in which case it has
+	 *   been rejected.
+	 */
+	bool SplitInPlace(std::string_view line, const LineHandler &on_line);
+
+	/**
+	 * Feeds characters one by one until a line finishes, or @a raw ends.
+	 * @param raw The raw data to feed.
+	 * @param on_line The function to send any finished line to.
+	 * @return The number of characters consumed.
+	 */
+	size_t FeedSlowly(std::string_view raw, const LineHandler &on_line);
+
+	/// Rejects the current line, and lets go of everything fed for it.
+	void Reject();
+
+	/// Finishes the current word and marks the line as ready.
 	void Emit();
 
 	/// Finishes the current word, adding it to the tokenised line.
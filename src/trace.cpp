@@ -0,0 +1,225 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Implementation of the Trace class.
+ * @see trace.h
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "errors.h"
+#include "trace.h"
+
+namespace Playd
+{
+/// One thread's events.  Only its thread writes to it.
+struct Trace::Ring {
+	/// One event, as stored.  The fields are atomic so that collecting
+	/// while the thread records is well-defined, if sometimes torn; the
+	/// head says which slots might be.
+	struct Slot {
+		std::atomic<std::uint64_t> time{0};
+		std::atomic<std::uint64_t> arg{0};
+		std::atomic<std::uint8_t> kind{0};
+	};
+
+	explicit Ring(std::uint32_t thread) : thread{thread}
+	{
+	}
+
+	std::uint32_t thread;                  ///< The thread's number.
+	std::atomic<std::uint64_t> head{0};    ///< How many events have been recorded.
+	std::array<Slot, Trace::CAPACITY> slots; ///< The events, as a ring.
+};
+
+/// The state shared by every thread's tracing.
+struct Trace::Registry {
+	std::mutex lock;                          ///< Guards everything below.
+	std::vector<std::shared_ptr<Ring>> rings; ///< Every thread's ring.
+	std::string path;                         ///< Where dumps go.
+};
+
+/* static */ Trace::Registry &Trace::GetRegistry()
+{
+	// This outlives every thread that might still be tracing at exit.
+	static Registry registry;
+	return registry;
+}
+
+namespace
+{
+/// When tracing last started, on the steady clock, in nanoseconds.
+std::atomic<std::uint64_t> started{0};
+
+/// @return The time now, on the steady clock, in nanoseconds.
+std::uint64_t Now()
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+/// The Chrome trace names, phases and argument names of each kind.
+struct KindInfo {
+	std::string_view name;
+	char phase;
+	std::string_view arg;
+};
+
+KindInfo Describe(TraceKind kind)
+{
+	switch (kind) {
+		case TraceKind::DECODE_BEGIN:
+			return {"decode", 'B', ""};
+		case TraceKind::DECODE_END:
+			return {"decode", 'E', "bytes"};
+		case TraceKind::TRANSFER:
+			return {"transfer", 'i', "bytes"};
+		case TraceKind::CALLBACK_BEGIN:
+			return {"callback", 'B', "bytes"};
+		case TraceKind::CALLBACK_END:
+			return {"callback", 'E', "silent"};
+		case TraceKind::COMMAND:
+			return {"command", 'i', "client"};
+		case TraceKind::RESPOND:
+			return {"respond", 'i', "bytes"};
+		case TraceKind::WRITE_DONE:
+			return {"write", 'i', "bytes"};
+	}
+	return {"unknown", 'i', "arg"};
+}
+
+} // namespace
+
+/* static */ std::atomic<bool> Trace::enabled{false};
+
+/* static */ void Trace::Start(std::string_view path)
+{
+	auto &registry = GetRegistry();
+	{
+		std::lock_guard guard{registry.lock};
+		registry.path = std::string{path};
+	}
+	started.store(Now(), std::memory_order_relaxed);
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+/* static */ void Trace::Stop()
+{
+	enabled.store(false, std::memory_order_relaxed);
+}
+
+/* static */ void Trace::Push(TraceKind kind, std::uint64_t arg)
+{
+	thread_local std::shared_ptr<Ring> ring;
+	if (!ring) {
+		auto &registry = GetRegistry();
+		std::lock_guard guard{registry.lock};
+		ring = std::make_shared<Ring>(static_cast<std::uint32_t>(registry.rings.size() + 1));
+		registry.rings.push_back(ring);
+	}
+
+	const auto head = ring->head.load(std::memory_order_relaxed);
+	auto &slot = ring->slots[head % CAPACITY];
+	slot.time.store(Now(), std::memory_order_relaxed);
+	slot.arg.store(arg, std::memory_order_relaxed);
+	slot.kind.store(static_cast<std::uint8_t>(kind), std::memory_order_relaxed);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+/* static */ std::vector<TraceEvent> Trace::Collect()
+{
+	std::vector<std::shared_ptr<Ring>> rings;
+	{
+		auto &registry = GetRegistry();
+		std::lock_guard guard{registry.lock};
+		rings = registry.rings;
+	}
+	const auto since = started.load(std::memory_order_relaxed);
+
+	std::vector<TraceEvent> events;
+	for (const auto &ring : rings) {
+		const auto head = ring->head.load(std::memory_order_acquire);
+		const auto first = head - std::min<std::uint64_t>(head, CAPACITY);
+
+		std::vector<TraceEvent> read;
+		read.reserve(head - first);
+		for (auto i = first; i < head; i++) {
+			const auto &slot = ring->slots[i % CAPACITY];
+			read.push_back({slot.time.load(std::memory_order_relaxed), slot.arg.load(std::memory_order_relaxed),
+			                ring->thread, static_cast<TraceKind>(slot.kind.load(std::memory_order_relaxed))});
+		}
+
+		// Anything the thread has lapped while we read might be torn,
+		// including the slot it might be writing now.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const auto now = ring->head.load(std::memory_order_relaxed) + 1;
+		const auto lapped = now - std::min<std::uint64_t>(now, CAPACITY);
+		const auto skip = std::min<std::uint64_t>(read.size(), lapped - std::min(lapped, first));
+
+		for (auto it = read.begin() + static_cast<std::ptrdiff_t>(skip); it != read.end(); it++) {
+			if (it->time < since) continue;
+			it->time -= since;
+			events.push_back(*it);
+		}
+	}
+
+	std::stable_sort(events.begin(), events.end(),
+	                 [](const TraceEvent &a, const TraceEvent &b) { return a.time < b.time; });
+	return events;
+}
+
+/* static */ void Trace::WriteChrome(std::ostream &out, const std::vector<TraceEvent> &events)
+{
+	out << "{\"traceEvents\":[";
+	auto first = true;
+	for (const auto &event : events) {
+		const auto info = Describe(event.kind);
+
+		out << (first ? "\n" : ",\n");
+		first = false;
+		out << R"({"name":")" << info.name << R"(","cat":"playd","ph":")" << info.phase << "\"";
+		if (info.phase == 'i') out << R"(,"s":"t")";
+		out << R"(,"ts":)" << event.time / 1000 << "." << std::setw(3) << std::setfill('0') << event.time % 1000;
+		out << R"(,"pid":1,"tid":)" << event.thread;
+		if (!info.arg.empty()) out << R"(,"args":{")" << info.arg << "\":" << event.arg << "}";
+		out << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+/* static */ void Trace::Dump()
+{
+	std::string path;
+	{
+		auto &registry = GetRegistry();
+		std::lock_guard guard{registry.lock};
+		path = registry.path;
+	}
+	if (path.empty()) return;
+
+	const auto events = Collect();
+	std::ofstream out{path, std::ios::trunc};
+	WriteChrome(out, events);
+	if (!out) {
+		Debug() << "trace: can't write to" << path << std::endl;
+		return;
+	}
+	Debug() << "trace: wrote" << events.size() << "events to" << path << std::endl;
+}
+
+} // namespace Playd
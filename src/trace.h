@@ -0,0 +1,118 @@
+// This file is part of playd.
+// playd is licensed under the MIT licence: see LICENSE.txt.
+
+/**
+ * @file
+ * Declaration of the Trace class.
+ * @see trace.cpp
+ */
+
+#ifndef PLAYD_TRACE_H
+#define PLAYD_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Playd
+{
+/// The things that happen on playd's hot paths, as traced.
+enum class TraceKind : std::uint8_t {
+	DECODE_BEGIN,   ///< A source starts decoding.
+	DECODE_END,     ///< A source has decoded; the argument is the bytes decoded.
+	TRANSFER,       ///< Audio goes to a sink; the argument is the bytes taken.
+	CALLBACK_BEGIN, ///< A device callback starts; the argument is the bytes asked for.
+	CALLBACK_END,   ///< A device callback ends; the argument is the bytes left silent.
+	COMMAND,        ///< A command arrives; the argument is the client's ID.
+	RESPOND,        ///< A response is queued; the argument is its size in bytes.
+	WRITE_DONE,     ///< A write to a client finishes; the argument is the bytes written.
+};
+
+/// One traced event, as stored.
+struct TraceEvent {
+	std::uint64_t time;   ///< When it happened, in nanoseconds since tracing began.
+	std::uint64_t arg;    ///< What it carries, which depends on its kind.
+	std::uint32_t thread; ///< The thread it happened on, numbered from 1.
+	TraceKind kind;       ///< What happened.
+};
+
+/**
+ * A low-overhead trace of the hot paths, for latency investigations.
+ *
+ * Each thread records fixed-size binary events into its own ring, so
+ * recording takes no locks and formats nothing; when the ring is full, the
+ * oldest events go.  With tracing off, which it is unless Start() is
+ * called, recording is one relaxed load.  A thread's first event while
+ * tracing allocates its ring, once.
+ *
+ * Collect() reads every thread's ring without stopping the writers, keeping
+ * only events it knows weren't overwritten as it read; WriteChrome() puts
+ * them in the Chrome trace format, which chrome://tracing and Perfetto
+ * open.
+ */
+class Trace
+{
+public:
+	/// The number of events each thread keeps.
+	static constexpr std::size_t CAPACITY = 16384;
+
+	/**
+	 * Starts tracing, forgetting anything traced before.
+	 * @param path Where Dump() writes the trace.
+	 */
+	static void Start(std::string_view path);
+
+	/// Stops tracing.  What was traced is kept until the next Start().
+	static void Stop();
+
+	/**
+	 * Records an event, if tracing is on.
+	 * @param kind What happened.
+	 * @param arg What it carries.
+	 */
+	static void Record(TraceKind kind, std::uint64_t arg = 0)
+	{
+		if (enabled.load(std::memory_order_relaxed)) Push(kind, arg);
+	}
+
+	/**
+	 * Reads every thread's events since Start(), oldest first.
+	 * A full ring's oldest event is left out, as its thread may be
+	 * overwriting it.
+	 * @return The events.
+	 */
+	static std::vector<TraceEvent> Collect();
+
+	/**
+	 * Writes events in the Chrome trace format.
+	 * @param out The stream to write to.
+	 * @param events The events, as from Collect().
+	 */
+	static void WriteChrome(std::ostream &out, const std::vector<TraceEvent> &events);
+
+	/**
+	 * Writes everything traced so far to the path given to Start().
+	 * This does nothing if tracing has never started.
+	 */
+	static void Dump();
+
+private:
+	struct Ring;
+	struct Registry;
+
+	/// @return The rings and dump path, shared by every thread.
+	static Registry &GetRegistry();
+
+	/// Records an event into the calling thread's ring.
+	static void Push(TraceKind kind, std::uint64_t arg);
+
+	/// Whether tracing is on.
+	static std::atomic<bool> enabled;
+};
+
+} // namespace Playd
+
+#endif // PLAYD_TRACE_H